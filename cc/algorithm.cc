@@ -16,10 +16,126 @@
 
 #include <emmintrin.h>
 
+// AVX2 and AVX-512 implementations of ArgMax are compiled with per-function
+// target attributes and selected at runtime, so that a single binary can take
+// advantage of whatever vector width the selfplay hosts support. Toolchains
+// without target attribute support (e.g. MSVC) fall back to the SSE
+// implementation.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MG_INTERNAL_HAVE_AVX_DISPATCH 1
+#include <immintrin.h>
+#endif
+
 #include <cstdint>
+#include <limits>
 
 namespace minigo {
 
+namespace {
+
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+
+// AVX2 version of ArgMaxSse: identical interleaved-maximums scheme, but eight
+// elements per iteration. Requires span.size() >= 8.
+__attribute__((target("avx2"))) int ArgMaxAvx2(absl::Span<const float> span) {
+  __m256i idx_max = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 val_max = _mm256_loadu_ps(span.data());
+  __m256i idx = idx_max;
+  __m256i step = _mm256_set1_epi32(8);
+
+  size_t safe_size = span.size() & ~7;
+  for (size_t i = 8; i < safe_size; i += 8) {
+    idx = _mm256_add_epi32(idx, step);
+    __m256 val = _mm256_loadu_ps(span.data() + i);
+
+    // `idx_max[i] = val[i] > val_max[i] ? idx[i] : idx_max[i]`
+    __m256i mask = _mm256_castps_si256(_mm256_cmp_ps(val, val_max, _CMP_GT_OQ));
+    idx_max = _mm256_blendv_epi8(idx_max, idx, mask);
+    val_max = _mm256_max_ps(val, val_max);
+  }
+
+  float vals[8];
+  int32_t idxs[8];
+  _mm256_storeu_ps(vals, val_max);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(idxs), idx_max);
+
+  // Find the maximum of the per-lane maximums, breaking ties using the
+  // smaller index.
+  int result = idxs[0];
+  for (int i = 1; i < 8; ++i) {
+    if ((vals[i] > span[result]) ||
+        (vals[i] == span[result] && idxs[i] < result)) {
+      result = idxs[i];
+    }
+  }
+
+  for (size_t i = safe_size; i < span.size(); ++i) {
+    if (span[i] > span[result]) {
+      result = i;
+    }
+  }
+
+  return result;
+}
+
+// AVX-512 version of ArgMaxSse: sixteen elements per iteration, using mask
+// registers for the index blend. Requires span.size() >= 16.
+__attribute__((target("avx512f"))) int ArgMaxAvx512(
+    absl::Span<const float> span) {
+  __m512i idx_max = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                      13, 14, 15);
+  __m512 val_max = _mm512_loadu_ps(span.data());
+  __m512i idx = idx_max;
+  __m512i step = _mm512_set1_epi32(16);
+
+  size_t safe_size = span.size() & ~15;
+  for (size_t i = 16; i < safe_size; i += 16) {
+    idx = _mm512_add_epi32(idx, step);
+    __m512 val = _mm512_loadu_ps(span.data() + i);
+
+    __mmask16 gt = _mm512_cmp_ps_mask(val, val_max, _CMP_GT_OQ);
+    idx_max = _mm512_mask_mov_epi32(idx_max, gt, idx);
+    val_max = _mm512_max_ps(val, val_max);
+  }
+
+  float vals[16];
+  int32_t idxs[16];
+  _mm512_storeu_ps(vals, val_max);
+  _mm512_storeu_si512(idxs, idx_max);
+
+  int result = idxs[0];
+  for (int i = 1; i < 16; ++i) {
+    if ((vals[i] > span[result]) ||
+        (vals[i] == span[result] && idxs[i] < result)) {
+      result = idxs[i];
+    }
+  }
+
+  for (size_t i = safe_size; i < span.size(); ++i) {
+    if (span[i] > span[result]) {
+      result = i;
+    }
+  }
+
+  return result;
+}
+
+// Returns the widest vector instruction set supported by the CPU:
+// 0 == SSE2, 1 == AVX2, 2 == AVX-512.
+int DetectVectorLevel() {
+  if (__builtin_cpu_supports("avx512f")) {
+    return 2;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return 1;
+  }
+  return 0;
+}
+
+#endif  // MG_INTERNAL_HAVE_AVX_DISPATCH
+
+}  // namespace
+
 // ArgMaxSse works by treating the input array as four separate interleaved
 // arrays: calculating the maximum of each array independently and then finding
 // the maximum of the maximums. If multiple elements have the same value, the
@@ -102,4 +218,26 @@ int ArgMaxSse(absl::Span<const float> span) {
   return result;
 }
 
+int ArgMaxSimd(absl::Span<const float> span) {
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const int vector_level = DetectVectorLevel();
+  if (vector_level == 2 && span.size() >= 16) {
+    return ArgMaxAvx512(span);
+  }
+  if (vector_level >= 1 && span.size() >= 8) {
+    return ArgMaxAvx2(span);
+  }
+#endif
+  return ArgMaxSse(span);
+}
+
+void ArgMaxK(absl::Span<float> span, absl::Span<int> indices) {
+  MG_CHECK(indices.size() <= span.size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    int idx = ArgMaxSimd(span);
+    indices[i] = idx;
+    span[idx] = -std::numeric_limits<float>::infinity();
+  }
+}
+
 }  // namespace minigo
@@ -43,6 +43,19 @@ inline int ArgMax(const T& container, Compare cmp) {
 // 5x faster than the ArgMax<float>.
 int ArgMaxSse(absl::Span<const float> span);
 
+// Like ArgMaxSse, but selects an AVX2 or AVX-512 implementation at runtime if
+// the CPU supports one, falling back to ArgMaxSse otherwise. The wider
+// variants process eight or sixteen elements per iteration instead of four.
+int ArgMaxSimd(absl::Span<const float> span);
+
+// Writes the indices of the `indices.size()` largest elements of `span` into
+// `indices`, ordered from largest value to smallest (equal values are ordered
+// by increasing index). Destroys the contents of `span`: each winner is
+// overwritten with -infinity so that the vectorized argmax can be rerun to
+// find the next one, which for the small `k` we care about (the best two or
+// three moves) is faster than a scalar partial sort.
+void ArgMaxK(absl::Span<float> span, absl::Span<int> indices);
+
 }  // namespace minigo
 
 #endif  // CC_ALGORITHM_H_
@@ -14,6 +14,7 @@
 
 #include "cc/algorithm.h"
 
+#include <algorithm>
 #include <array>
 
 #include "cc/random.h"
@@ -74,7 +75,82 @@ TEST(AlgorithmTest, ArgMax3) {
   ASSERT_EQ(2, ArgMaxSse(vals));
 }
 
+TEST(AlgorithmTest, ArgMaxSimdRandom) {
+  Random rnd(Random::kUniqueSeed, Random::kUniqueStream);
+
+  // Sizes chosen to exercise the AVX-512, AVX2 and SSE paths, including
+  // their scalar tails.
+  std::array<float, 1237> vals_1237;
+  std::array<float, 19> vals_19;
+  std::array<float, 9> vals_9;
+  for (int iter = 0; iter < 100; ++iter) {
+    rnd.Uniform(&vals_1237);
+    ASSERT_EQ(ArgMax(vals_1237), ArgMaxSimd(vals_1237));
+
+    rnd.Uniform(&vals_19);
+    ASSERT_EQ(ArgMax(vals_19), ArgMaxSimd(vals_19));
+
+    rnd.Uniform(&vals_9);
+    ASSERT_EQ(ArgMax(vals_9), ArgMaxSimd(vals_9));
+  }
+}
+
+TEST(AlgorithmTest, ArgMaxSimdTieBreak) {
+  std::array<float, 45> vals{};
+  vals[3] = 1;
+  vals[27] = 1;
+  ASSERT_EQ(3, ArgMaxSimd(vals));
+
+  vals[44] = 1;
+  ASSERT_EQ(3, ArgMaxSimd(vals));
+
+  vals[44] = 2;
+  ASSERT_EQ(44, ArgMaxSimd(vals));
+  vals[21] = 2;
+  ASSERT_EQ(21, ArgMaxSimd(vals));
+  vals[20] = 2;
+  ASSERT_EQ(20, ArgMaxSimd(vals));
+}
 
+TEST(AlgorithmTest, ArgMaxKRandom) {
+  Random rnd(Random::kUniqueSeed, Random::kUniqueStream);
+
+  constexpr int kK = 3;
+  std::array<float, 362> vals;
+  for (int iter = 0; iter < 100; ++iter) {
+    rnd.Uniform(&vals);
+
+    // Compute the expected top-k with a stable scalar sort, which orders
+    // equal values by increasing index like ArgMaxK does.
+    std::array<int, vals.size()> expected;
+    for (size_t i = 0; i < vals.size(); ++i) {
+      expected[i] = i;
+    }
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&vals](int a, int b) { return vals[a] > vals[b]; });
+
+    std::array<int, kK> actual;
+    ArgMaxK(absl::MakeSpan(vals), absl::MakeSpan(actual));
+    for (int i = 0; i < kK; ++i) {
+      ASSERT_EQ(expected[i], actual[i]);
+    }
+  }
+}
+
+TEST(AlgorithmTest, ArgMaxKTieBreak) {
+  std::array<float, 45> vals{};
+  vals[3] = 2;
+  vals[27] = 1;
+  vals[30] = 1;
+  vals[40] = 1;
+
+  std::array<int, 4> actual;
+  ArgMaxK(absl::MakeSpan(vals), absl::MakeSpan(actual));
+  ASSERT_EQ(3, actual[0]);
+  ASSERT_EQ(27, actual[1]);
+  ASSERT_EQ(30, actual[2]);
+  ASSERT_EQ(40, actual[3]);
+}
 
 }  // namespace
 }  // namespace minigo
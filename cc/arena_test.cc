@@ -0,0 +1,105 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/arena.h"
+
+#include <cstdint>
+
+#include "cc/platform/utils.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(ArenaTest, Alignment) {
+  Arena arena(256);
+  for (int i = 0; i < 100; ++i) {
+    auto* c = arena.New<char>('x');
+    auto* d = arena.New<double>(1.0);
+    EXPECT_EQ('x', *c);
+    EXPECT_EQ(1.0, *d);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(d) % alignof(double));
+  }
+}
+
+TEST(ArenaTest, OversizedAllocation) {
+  struct Big {
+    char data[4096];
+  };
+  Arena arena(256);
+  auto* big = arena.New<Big>();
+  EXPECT_NE(nullptr, big);
+  EXPECT_GE(arena.allocated_bytes(), sizeof(Big));
+}
+
+TEST(ArenaTest, DestructorsRunOnReset) {
+  struct Counted {
+    explicit Counted(int* count) : count(count) {}
+    ~Counted() { ++*count; }
+    int* count;
+  };
+
+  int count = 0;
+  Arena arena;
+  for (int i = 0; i < 10; ++i) {
+    arena.New<Counted>(&count);
+  }
+  EXPECT_EQ(0, count);
+  arena.Reset();
+  EXPECT_EQ(10, count);
+
+  // Trivially destructible objects require no cleanup.
+  arena.New<int>(42);
+  arena.Reset();
+  EXPECT_EQ(10, count);
+}
+
+TEST(ArenaTest, BlocksRequestHugePages) {
+  auto before = GetLargePageStats().requested_bytes;
+  {
+    // Default sized blocks are one huge page, so growing the arena should
+    // show up in the huge page allocation stats on platforms that support
+    // them.
+    Arena arena;
+    arena.New<int>(42);
+#if defined(__linux__)
+    EXPECT_GE(GetLargePageStats().requested_bytes,
+              before + Arena::kDefaultBlockSize);
+#endif
+  }
+  // The blocks are returned when the arena is destroyed.
+  EXPECT_EQ(before, GetLargePageStats().requested_bytes);
+}
+
+TEST(ArenaTest, ResetKeepingBlocks) {
+  Arena arena(256);
+  for (int i = 0; i < 100; ++i) {
+    arena.New<double>(1.0);
+  }
+  auto allocated = arena.allocated_bytes();
+  EXPECT_GT(allocated, 0);
+
+  // Resetting with keep_blocks retains the blocks and subsequent
+  // allocations reuse them instead of growing the arena.
+  arena.Reset(/*keep_blocks=*/true);
+  EXPECT_EQ(allocated, arena.allocated_bytes());
+  for (int i = 0; i < 100; ++i) {
+    auto* d = arena.New<double>(1.0);
+    EXPECT_EQ(1.0, *d);
+  }
+  EXPECT_EQ(allocated, arena.allocated_bytes());
+}
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,94 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/background_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "cc/logging.h"
+#include "cc/platform/utils.h"
+
+namespace minigo {
+
+namespace {
+
+// Background work is mostly-idle bookkeeping: a couple of threads keep a
+// selfplay worker's output draining, and a GTP instance barely needs one.
+// Scale gently with the machine so a 96-core selfplay host gets a little
+// extra write bandwidth without recreating the thread-per-feature spread.
+int ChooseNumThreads() {
+  return std::min(4, std::max(2, GetNumLogicalCpus() / 16));
+}
+
+}  // namespace
+
+constexpr int BackgroundPool::kNumPriorities;
+
+BackgroundPool* BackgroundPool::Get() {
+  // Deliberately leaked: the pool's threads run until process exit.
+  static BackgroundPool* impl = new BackgroundPool();
+  return impl;
+}
+
+BackgroundPool::BackgroundPool() {
+  int num_threads = ChooseNumThreads();
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(absl::make_unique<LambdaThread>(
+        absl::StrCat("BgPool:", i), [this]() { Run(); }));
+    // Background work yields to search & inference threads.
+    threads_.back()->SetPriority(Thread::Priority::kLow);
+  }
+  for (auto& t : threads_) {
+    t->Start();
+  }
+}
+
+void BackgroundPool::Schedule(Priority priority, std::function<void()> fn) {
+  MG_DCHECK(fn != nullptr);
+  absl::MutexLock lock(&mutex_);
+  queues_[static_cast<int>(priority)].push_back(std::move(fn));
+}
+
+void BackgroundPool::Run() {
+  for (;;) {
+    std::function<void()> fn;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &BackgroundPool::HasWork));
+      for (auto& queue : queues_) {
+        if (!queue.empty()) {
+          fn = std::move(queue.front());
+          queue.pop_front();
+          break;
+        }
+      }
+    }
+    fn();
+  }
+}
+
+bool BackgroundPool::HasWork() const {
+  for (const auto& queue : queues_) {
+    if (!queue.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace minigo
@@ -0,0 +1,80 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_ASYNC_BACKGROUND_POOL_H_
+#define CC_ASYNC_BACKGROUND_POOL_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "cc/async/thread.h"
+
+namespace minigo {
+
+// Runs background work on a small process-wide pool of threads, replacing
+// the dedicated thread that each background consumer used to own (writer
+// threads, the reclaimer thread, ...). A small GTP process no longer pays a
+// stack and a schedulable thread per feature for work that's mostly idle,
+// and the pool's threads run at low OS priority so background work doesn't
+// displace search threads.
+//
+// Tasks carry a priority so small, latency-sensitive work isn't stuck in
+// line behind bulk work like a 60MB example shard. Within a priority, tasks
+// run in FIFO order; nothing else is guaranteed: tasks may run concurrently
+// with each other, so consumers that need ordering between their own tasks
+// must provide it themselves (see file::AsyncWriter for the usual pattern of
+// one task that reschedules itself while work remains).
+//
+// Tasks must not block indefinitely: a task that parks a pool thread starves
+// every other consumer. Work that blocks for the life of the process (the
+// inotify read loop, the metrics server's accept loop) keeps its own thread.
+class BackgroundPool {
+ public:
+  enum class Priority {
+    kHigh,    // Small tasks someone may be waiting on.
+    kNormal,  // The default: file output and similar.
+    kLow,     // Work nobody waits for, e.g. reclaiming discarded trees.
+  };
+
+  // Returns the process-wide pool, starting its threads on first use. The
+  // pool runs for the remainder of the process's lifetime.
+  static BackgroundPool* Get();
+
+  // Schedules `fn` to run on one of the pool's threads.
+  void Schedule(Priority priority, std::function<void()> fn)
+      LOCKS_EXCLUDED(&mutex_);
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  static constexpr int kNumPriorities = 3;
+
+  BackgroundPool();
+
+  void Run() LOCKS_EXCLUDED(&mutex_);
+  bool HasWork() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  absl::Mutex mutex_;
+  std::deque<std::function<void()>> queues_[kNumPriorities] GUARDED_BY(
+      &mutex_);
+
+  std::vector<std::unique_ptr<Thread>> threads_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_ASYNC_BACKGROUND_POOL_H_
@@ -0,0 +1,99 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/background_pool.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "cc/async/semaphore.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(BackgroundPoolTest, RunsScheduledTasks) {
+  auto* pool = BackgroundPool::Get();
+  ASSERT_GE(pool->num_threads(), 2);
+
+  absl::Mutex mutex;
+  int num_run = 0;
+  for (int i = 0; i < 100; ++i) {
+    pool->Schedule(BackgroundPool::Priority::kNormal, [&]() {
+      absl::MutexLock lock(&mutex);
+      num_run += 1;
+    });
+  }
+
+  absl::MutexLock lock(&mutex);
+  auto all_run = [&]() EXCLUSIVE_LOCKS_REQUIRED(&mutex) {
+    return num_run == 100;
+  };
+  mutex.Await(absl::Condition(&all_run));
+}
+
+TEST(BackgroundPoolTest, TasksCanScheduleTasks) {
+  auto* pool = BackgroundPool::Get();
+
+  Semaphore done;
+  pool->Schedule(BackgroundPool::Priority::kNormal, [&]() {
+    pool->Schedule(BackgroundPool::Priority::kNormal, [&]() { done.Post(); });
+  });
+  done.Wait();
+}
+
+TEST(BackgroundPoolTest, HigherPriorityRunsFirst) {
+  auto* pool = BackgroundPool::Get();
+
+  // Park every pool thread on a gate so the tasks scheduled below all queue
+  // up behind them.
+  Semaphore gate;
+  for (int i = 0; i < pool->num_threads(); ++i) {
+    pool->Schedule(BackgroundPool::Priority::kHigh, [&]() { gate.Wait(); });
+  }
+
+  absl::Mutex mutex;
+  std::vector<std::string> order;
+  auto record = [&](std::string name) {
+    absl::MutexLock lock(&mutex);
+    order.push_back(std::move(name));
+  };
+  pool->Schedule(BackgroundPool::Priority::kLow, [&]() { record("low_1"); });
+  pool->Schedule(BackgroundPool::Priority::kLow, [&]() { record("low_2"); });
+  pool->Schedule(BackgroundPool::Priority::kNormal,
+                 [&]() { record("normal"); });
+  pool->Schedule(BackgroundPool::Priority::kHigh, [&]() { record("high"); });
+
+  // Release a single thread: it drains all four tasks by itself while its
+  // siblings stay parked, so the order it dequeues them in is deterministic.
+  gate.Post();
+  {
+    absl::MutexLock lock(&mutex);
+    auto all_run = [&]() EXCLUSIVE_LOCKS_REQUIRED(&mutex) {
+      return order.size() == 4;
+    };
+    mutex.Await(absl::Condition(&all_run));
+    EXPECT_EQ(std::vector<std::string>({"high", "normal", "low_1", "low_2"}),
+              order);
+  }
+
+  // Unpark the rest of the pool.
+  for (int i = 1; i < pool->num_threads(); ++i) {
+    gate.Post();
+  }
+}
+
+}  // namespace
+}  // namespace minigo
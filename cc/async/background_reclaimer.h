@@ -0,0 +1,52 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_ASYNC_BACKGROUND_RECLAIMER_H_
+#define CC_ASYNC_BACKGROUND_RECLAIMER_H_
+
+#include <memory>
+
+#include "cc/async/background_pool.h"
+
+namespace minigo {
+
+// Destroys large object graphs (e.g. a discarded MCTS tree and its arena) in
+// the background, so that the thread discarding them doesn't stall for the
+// duration of the destructor.
+//
+// Destruction runs on the shared background pool at low priority: nobody
+// waits on a reclaim, so it yields to file output and other scheduled work.
+class BackgroundReclaimer {
+ public:
+  // Returns the process-wide reclaimer.
+  static BackgroundReclaimer* Get();
+
+  // Schedules `obj` for destruction on the background pool.
+  template <typename T>
+  void Reclaim(std::unique_ptr<T> obj) {
+    if (obj == nullptr) {
+      return;
+    }
+    auto* raw = obj.release();
+    BackgroundPool::Get()->Schedule(BackgroundPool::Priority::kLow,
+                                    [raw]() { delete raw; });
+  }
+
+ private:
+  BackgroundReclaimer() = default;
+};
+
+}  // namespace minigo
+
+#endif  // CC_ASYNC_BACKGROUND_RECLAIMER_H_
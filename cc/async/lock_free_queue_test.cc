@@ -0,0 +1,156 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/lock_free_queue.h"
+
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/logging.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Verify that the queue is a FIFO.
+TEST(LockFreeQueueTest, Ordering) {
+  LockFreeQueue<int> q(4);
+
+  q.Push(1);
+  q.Push(2);
+  q.Push(3);
+
+  int x;
+  EXPECT_EQ(1, q.Pop());
+  EXPECT_TRUE(q.TryPop(&x));
+  EXPECT_EQ(2, x);
+  EXPECT_EQ(3, q.Pop());
+
+  EXPECT_FALSE(q.TryPop(&x));
+}
+
+// Verify that the capacity is rounded up to a power of two and that TryPush
+// fails on a full queue.
+TEST(LockFreeQueueTest, Bounded) {
+  LockFreeQueue<int> q(3);
+  EXPECT_EQ(4, q.capacity());
+
+  for (int i = 0; i < 4; ++i) {
+    int x = i;
+    EXPECT_TRUE(q.TryPush(&x));
+  }
+  int x = 99;
+  EXPECT_FALSE(q.TryPush(&x));
+
+  EXPECT_EQ(0, q.Pop());
+  EXPECT_TRUE(q.TryPush(&x));
+}
+
+// Verify that PopWithTimeout works whether the queue is empty or not.
+TEST(LockFreeQueueTest, PopWithTimeout) {
+  LockFreeQueue<int> q(4);
+  int x;
+  // Pop with a 2ms delay on an empty queue should take at least 1ms.
+  auto start = absl::Now();
+  EXPECT_FALSE(q.PopWithTimeout(&x, absl::Milliseconds(2)));
+  EXPECT_LT(absl::Milliseconds(1), absl::Now() - start);
+
+  q.Push(-123);
+  EXPECT_TRUE(q.PopWithTimeout(&x, absl::Milliseconds(2)));
+  EXPECT_EQ(-123, x);
+}
+
+// Verify that the queue works with move-only objects.
+TEST(LockFreeQueueTest, MoveOnlyObject) {
+  // A simple move-only type.
+  struct MoveOnly {
+    MoveOnly() : x(-1) {}
+    explicit MoveOnly(int x) : x(x) {}
+    MoveOnly(const MoveOnly&) = delete;
+    MoveOnly& operator=(const MoveOnly&) = delete;
+    MoveOnly(MoveOnly&& other) : x(other.x) { other.x = -1; }
+    MoveOnly& operator=(MoveOnly&& other) {
+      x = other.x;
+      other.x = -1;
+      return *this;
+    }
+    int x;
+  };
+  LockFreeQueue<MoveOnly> q(4);
+
+  q.Push(MoveOnly(42));
+  EXPECT_EQ(42, q.Pop().x);
+}
+
+// Hammer the queue from multiple producers and consumers at once and check
+// that every pushed value is popped exactly once.
+TEST(LockFreeQueueTest, Multithreading) {
+  constexpr int kNumProducers = 4;
+  constexpr int kNumConsumers = 4;
+  constexpr int kIntsPerProducer = 10000;
+
+  // A queue much smaller than the number of pushed ints, so that producers
+  // regularly find it full and consumers regularly find it empty.
+  LockFreeQueue<int> q(64);
+
+  std::vector<std::thread> producers;
+  for (int i = 0; i < kNumProducers; ++i) {
+    producers.emplace_back([&q, i]() {
+      for (int j = 0; j < kIntsPerProducer; ++j) {
+        q.Push(i * kIntsPerProducer + j);
+      }
+    });
+  }
+
+  absl::Mutex m;
+  std::map<int, int> popped;
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < kNumConsumers; ++i) {
+    consumers.emplace_back([&]() {
+      std::vector<int> my_popped;
+      int x;
+      while (my_popped.size() < kNumProducers * kIntsPerProducer &&
+             q.PopWithTimeout(&x, absl::Milliseconds(100))) {
+        my_popped.push_back(x);
+      }
+      MG_LOG(INFO) << "popped " << my_popped.size() << " ints";
+
+      absl::MutexLock lock(&m);
+      for (int x : my_popped) {
+        popped[x] += 1;
+      }
+    });
+  }
+
+  for (auto& t : producers) {
+    t.join();
+  }
+  for (auto& t : consumers) {
+    t.join();
+  }
+
+  std::map<int, int> pushed;
+  for (int i = 0; i < kNumProducers * kIntsPerProducer; ++i) {
+    pushed[i] = 1;
+  }
+  EXPECT_THAT(popped, ::testing::ContainerEq(pushed));
+}
+
+}  // namespace
+}  // namespace minigo
@@ -15,30 +15,50 @@
 #ifndef CC_ASYNC_SEMAPHORE_H_
 #define CC_ASYNC_SEMAPHORE_H_
 
+#include <atomic>
+
 #include "absl/synchronization/mutex.h"
 
 namespace minigo {
 
+// A counting semaphore with a lock-free fast path: when posts are available,
+// Post is a single fetch_add and Wait a single fetch_sub. The mutex is only
+// touched when a Wait must block (and by the Posts that wake it), so
+// semaphores gating high-frequency events stay out of lock profiles.
 class Semaphore {
  public:
   void Post() {
-    absl::MutexLock lock(&mutex_);
-    ++count_;
+    // If `count_` was negative, a waiter beat us to the decrement and is
+    // blocked (or about to block) on the slow path: hand it a wakeup token.
+    if (count_.fetch_add(1, std::memory_order_release) < 0) {
+      absl::MutexLock lock(&mutex_);
+      ++num_wakeups_;
+    }
   }
 
   void Wait() {
-    mutex_.LockWhen(absl::Condition(this, &Semaphore::is_non_zero));
-    --count_;
-    mutex_.Unlock();
+    // Fast path: a post was available and we claimed it.
+    if (count_.fetch_sub(1, std::memory_order_acquire) > 0) {
+      return;
+    }
+
+    // Slow path: block until a Post hands us a wakeup token.
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(this, &Semaphore::has_wakeup));
+    --num_wakeups_;
   }
 
  private:
-  bool is_non_zero() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
-    return count_ != 0;
+  bool has_wakeup() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return num_wakeups_ != 0;
   }
 
+  // Number of available posts when positive; number of waiters that have
+  // taken (or are taking) the slow path when negative.
+  std::atomic<int> count_{0};
+
   absl::Mutex mutex_;
-  int count_ = 0;
+  int num_wakeups_ GUARDED_BY(&mutex_) = 0;
 };
 
 }  // namespace minigo
@@ -0,0 +1,73 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/semaphore.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Waits on posts that are already available never block.
+TEST(SemaphoreTest, FastPath) {
+  Semaphore sem;
+  sem.Post();
+  sem.Post();
+  sem.Wait();
+  sem.Wait();
+}
+
+// Hammer the semaphore from multiple posters and waiters and check that
+// every post is consumed by exactly one wait.
+TEST(SemaphoreTest, Multithreading) {
+  constexpr int kNumThreads = 4;
+  constexpr int kPostsPerThread = 10000;
+
+  Semaphore sem;
+  std::atomic<int> num_waits{0};
+
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < kNumThreads; ++i) {
+    waiters.emplace_back([&]() {
+      for (int j = 0; j < kPostsPerThread; ++j) {
+        sem.Wait();
+        num_waits.fetch_add(1);
+      }
+    });
+  }
+
+  std::vector<std::thread> posters;
+  for (int i = 0; i < kNumThreads; ++i) {
+    posters.emplace_back([&]() {
+      for (int j = 0; j < kPostsPerThread; ++j) {
+        sem.Post();
+      }
+    });
+  }
+
+  for (auto& t : posters) {
+    t.join();
+  }
+  for (auto& t : waiters) {
+    t.join();
+  }
+  EXPECT_EQ(kNumThreads * kPostsPerThread, num_waits.load());
+}
+
+}  // namespace
+}  // namespace minigo
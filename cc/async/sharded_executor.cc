@@ -14,7 +14,13 @@
 
 #include "cc/async/sharded_executor.h"
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "cc/trace_sampler.h"
 #include "wtf/macros.h"
 
 namespace minigo {
@@ -22,7 +28,7 @@ namespace minigo {
 ShardedExecutor::ShardedExecutor(int num_shards) {
   threads_.reserve(num_shards - 1);
   for (int i = 1; i < num_shards; ++i) {
-    threads_.push_back(absl::make_unique<WorkerThread>(i, num_shards));
+    threads_.push_back(absl::make_unique<WorkerThread>(this, i));
   }
   for (auto& t : threads_) {
     t->Start();
@@ -30,6 +36,10 @@ ShardedExecutor::ShardedExecutor(int num_shards) {
 }
 
 ShardedExecutor::~ShardedExecutor() {
+  {
+    absl::MutexLock lock(&mutex_);
+    joining_ = true;
+  }
   for (auto& t : threads_) {
     t->Join();
   }
@@ -38,16 +48,24 @@ ShardedExecutor::~ShardedExecutor() {
 void ShardedExecutor::Execute(const std::function<void(int, int)>& fn) {
   WTF_SCOPE0("ShardedExecutor::Execute");
   if (!threads_.empty()) {
-    auto num_shards = threads_.size() + 1;
+    auto num_shards = static_cast<int>(threads_.size()) + 1;
 
-    // Create a blocking counter initialized to the number of threads that will
-    // do work. Each thread pops a shard of work off its queue, executes the
-    // function, then decrements this counter.
+    // Serialize concurrent Execute callers; holding the dispatch mutex
+    // until all workers are done also keeps `fn` and `counter` alive for
+    // them.
+    absl::MutexLock dispatch_lock(&dispatch_mutex_);
+
+    // Create a blocking counter initialized to the number of threads that
+    // will do work. Each thread runs its shard of work, then decrements
+    // this counter.
     absl::BlockingCounter counter(threads_.size());
 
-    // Push some work on to each thread's queue.
-    for (auto& t : threads_) {
-      t->Execute(&fn, &counter);
+    // Publish the work and wake all the workers with a single broadcast.
+    {
+      absl::MutexLock lock(&mutex_);
+      fn_ = &fn;
+      counter_ = &counter;
+      epoch_ += 1;
     }
 
     // Execute shard 0 on the caller's thread.
@@ -60,35 +78,94 @@ void ShardedExecutor::Execute(const std::function<void(int, int)>& fn) {
   }
 }
 
-ShardedExecutor::WorkerThread::WorkerThread(int shard, int num_shards)
-    : Thread(absl::StrCat("ShardExec:", shard)),
-      shard_(shard),
-      num_shards_(num_shards) {}
+void ShardedExecutor::ExecuteBalanced(
+    int num_items, const std::function<void(int, int)>& item_fn) {
+  WTF_SCOPE0("ShardedExecutor::ExecuteBalanced");
+  if (num_items == 0) {
+    return;
+  }
 
-void ShardedExecutor::WorkerThread::Execute(
-    const std::function<void(int, int)>* fn, absl::BlockingCounter* counter) {
-  work_queue_.Push({fn, counter});
-}
+  // Each shard starts with a contiguous range of items and claims them a
+  // chunk at a time; a shard that exhausts its own range steals chunks from
+  // the other shards' ranges. A claim is a fetch_add on the range's cursor,
+  // so stealing needs no deques or locks: thieves race the range's owner on
+  // the same cursor and the overshoot is bounded by one chunk per shard.
+  struct Cursor {
+    alignas(64) std::atomic<int> next;
+    int end;
+  };
+
+  int num_shards = static_cast<int>(threads_.size()) + 1;
+
+  // Tiny workloads aren't worth a broadcast and a join: run them here.
+  if (num_items < num_shards) {
+    for (int item = 0; item < num_items; ++item) {
+      item_fn(item, 0);
+    }
+    return;
+  }
 
-void ShardedExecutor::WorkerThread::Join() {
-  // Pushing null work onto the queue tells the Run loop to stop.
-  work_queue_.Push({nullptr, nullptr});
-  Thread::Join();
+  std::vector<Cursor> cursors(num_shards);
+  for (int i = 0; i < num_shards; ++i) {
+    auto range = GetShardRange(i, num_shards, num_items);
+    cursors[i].next.store(range.begin, std::memory_order_relaxed);
+    cursors[i].end = range.end;
+  }
+  int chunk_size = std::max(1, num_items / (num_shards * 8));
+
+  Execute([&cursors, &item_fn, chunk_size, num_shards](int shard_idx, int) {
+    for (int i = 0; i < num_shards; ++i) {
+      auto& cursor = cursors[(shard_idx + i) % num_shards];
+      for (;;) {
+        int begin =
+            cursor.next.fetch_add(chunk_size, std::memory_order_relaxed);
+        if (begin >= cursor.end) {
+          break;
+        }
+        int end = std::min(begin + chunk_size, cursor.end);
+        for (int item = begin; item < end; ++item) {
+          item_fn(item, shard_idx);
+        }
+      }
+    }
+  });
 }
 
+ShardedExecutor::WorkerThread::WorkerThread(ShardedExecutor* executor,
+                                            int shard)
+    : Thread(absl::StrCat("ShardExec:", shard)),
+      executor_(executor),
+      shard_(shard) {}
+
 void ShardedExecutor::WorkerThread::Run() {
-  WTF_THREAD_ENABLE("ShardedExecutor");
+  TraceSampler trace_sampler("ShardedExecutor");
 
+  int num_shards = static_cast<int>(executor_->threads_.size()) + 1;
+  int64_t last_epoch = 0;
   for (;;) {
-    auto work = work_queue_.Pop();
-    if (work.fn == nullptr) {
-      break;
+    const std::function<void(int, int)>* fn;
+    absl::BlockingCounter* counter;
+    {
+      absl::MutexLock lock(&executor_->mutex_);
+      auto has_work = [this, last_epoch]()
+                          EXCLUSIVE_LOCKS_REQUIRED(&executor_->mutex_) {
+        return executor_->epoch_ != last_epoch || executor_->joining_;
+      };
+      executor_->mutex_.Await(absl::Condition(&has_work));
+      if (executor_->epoch_ == last_epoch) {
+        // Joining, and no unseen work.
+        break;
+      }
+      last_epoch = executor_->epoch_;
+      fn = executor_->fn_;
+      counter = executor_->counter_;
     }
+    trace_sampler.Tick();
     {
       WTF_SCOPE0("ShardedExecutor::Run");
-      (*work.fn)(shard_, num_shards_);
+      (*fn)(shard_, num_shards);
     }
-    work.counter->DecrementCount();
+    counter->DecrementCount();
   }
 }
 
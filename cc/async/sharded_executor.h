@@ -15,14 +15,15 @@
 #ifndef CC_ASYNC_SHARDED_EXECUTOR_H_
 #define CC_ASYNC_SHARDED_EXECUTOR_H_
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <vector>
 
-#include "absl/memory/memory.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
 #include "cc/async/thread.h"
-#include "cc/async/thread_safe_queue.h"
 
 namespace minigo {
 
@@ -69,27 +70,44 @@ class ShardedExecutor {
   // Blocks until all shards of work are complete.
   void Execute(const std::function<void(int, int)>& fn);
 
+  // Calls `item_fn(item, shard_idx)` once for every item in [0, num_items),
+  // spreading the calls across the executor's threads. Unlike carving the
+  // items into static GetShardRange slices, items are claimed a chunk at a
+  // time from per-shard ranges and shards that exhaust their own range
+  // steal chunks from the others', so workloads with wildly uneven per-item
+  // cost finish at the speed of the aggregate rather than the slowest
+  // shard.
+  // Workloads with fewer items than shards run entirely on the calling
+  // thread: at that size the fixed dispatch cost exceeds the work.
+  // `item_fn` may be invoked concurrently from multiple threads.
+  // Blocks until all items have been processed.
+  void ExecuteBalanced(int num_items,
+                       const std::function<void(int, int)>& item_fn);
+
  private:
   struct WorkerThread : public Thread {
-    WorkerThread(int shard, int num_shards);
-
-    void Execute(const std::function<void(int, int)>* fn,
-                 absl::BlockingCounter* counter);
-    void Join() override;
+    WorkerThread(ShardedExecutor* executor, int shard);
 
    private:
-    struct Work {
-      const std::function<void(int, int)>* fn;
-      absl::BlockingCounter* counter;
-    };
-
     void Run() override;
 
+    ShardedExecutor* const executor_;
     const int shard_;
-    const int num_shards_;
-    ThreadSafeQueue<Work> work_queue_;
   };
 
+  // Dispatch state shared by all worker threads. Rather than pushing a work
+  // item onto every worker's queue, Execute publishes the function once and
+  // bumps `epoch_`; releasing the mutex then wakes all the workers with a
+  // single broadcast. `dispatch_mutex_` serializes concurrent Execute
+  // callers and is held until every worker has finished the published
+  // function, so `fn_` and `counter_` stay valid while workers use them.
+  absl::Mutex dispatch_mutex_ ACQUIRED_BEFORE(&mutex_);
+  absl::Mutex mutex_;
+  int64_t epoch_ GUARDED_BY(&mutex_) = 0;
+  const std::function<void(int, int)>* fn_ GUARDED_BY(&mutex_) = nullptr;
+  absl::BlockingCounter* counter_ GUARDED_BY(&mutex_) = nullptr;
+  bool joining_ GUARDED_BY(&mutex_) = false;
+
   std::vector<std::unique_ptr<WorkerThread>> threads_;
 };
 
@@ -0,0 +1,89 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/sharded_executor.h"
+
+#include <atomic>
+#include <memory>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(ShardedExecutorTest, Execute) {
+  for (int num_shards : {1, 3, 8}) {
+    ShardedExecutor executor(num_shards);
+    std::atomic<int> num_calls{0};
+    executor.Execute([&num_calls, num_shards](int shard, int n) {
+      EXPECT_GE(shard, 0);
+      EXPECT_LT(shard, n);
+      EXPECT_EQ(num_shards, n);
+      num_calls.fetch_add(1);
+    });
+    EXPECT_EQ(num_shards, num_calls.load());
+  }
+}
+
+TEST(ShardedExecutorTest, ExecuteBalanced) {
+  constexpr int kNumItems = 1000;
+  for (int num_shards : {1, 3, 8}) {
+    ShardedExecutor executor(num_shards);
+
+    std::unique_ptr<std::atomic<int>[]> counts(
+        new std::atomic<int>[kNumItems]);
+    for (int i = 0; i < kNumItems; ++i) {
+      counts[i].store(0);
+    }
+
+    // Give the items wildly uneven costs so that static shards would finish
+    // at very different times: work stealing must still process every item
+    // exactly once.
+    executor.ExecuteBalanced(
+        kNumItems, [&counts, num_shards](int item, int shard_idx) {
+          EXPECT_GE(shard_idx, 0);
+          EXPECT_LT(shard_idx, num_shards);
+          if (item % 100 == 0) {
+            absl::SleepFor(absl::Milliseconds(1));
+          }
+          counts[item].fetch_add(1);
+        });
+
+    for (int i = 0; i < kNumItems; ++i) {
+      EXPECT_EQ(1, counts[i].load()) << "item " << i;
+    }
+  }
+}
+
+TEST(ShardedExecutorTest, ExecuteBalancedCallerRuns) {
+  // Workloads with fewer items than shards run entirely on the calling
+  // thread as shard 0.
+  ShardedExecutor executor(8);
+  std::atomic<int> num_calls{0};
+  executor.ExecuteBalanced(3, [&num_calls](int item, int shard_idx) {
+    EXPECT_EQ(0, shard_idx);
+    num_calls.fetch_add(1);
+  });
+  EXPECT_EQ(3, num_calls.load());
+}
+
+TEST(ShardedExecutorTest, ExecuteBalancedEmpty) {
+  ShardedExecutor executor(4);
+  executor.ExecuteBalanced(0, [](int, int) { FAIL(); });
+}
+
+}  // namespace
+}  // namespace minigo
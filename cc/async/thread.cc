@@ -15,7 +15,15 @@
 #include "cc/async/thread.h"
 
 #include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <utility>
 
 #include "cc/logging.h"
 
@@ -30,6 +38,16 @@ Thread::Thread(std::string name) : name_(std::move(name)) {
 
 Thread::~Thread() = default;
 
+void Thread::SetAffinity(std::vector<int> cpus) {
+  MG_CHECK(!impl_.joinable()) << "SetAffinity must be called before Start";
+  affinity_ = std::move(cpus);
+}
+
+void Thread::SetPriority(Priority priority) {
+  MG_CHECK(!impl_.joinable()) << "SetPriority must be called before Start";
+  priority_ = priority;
+}
+
 void Thread::Start() {
   impl_ = std::thread([this] {
 #ifdef TARGET_OS_MAC
@@ -37,6 +55,7 @@ void Thread::Start() {
       pthread_setname_np(name_.c_str());
     }
 #endif
+    ApplySchedulingSettings();
     Run();
   });
 
@@ -52,6 +71,34 @@ void Thread::Join() {
   impl_.join();
 }
 
+void Thread::ApplySchedulingSettings() {
+#ifdef __linux__
+  if (!affinity_.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : affinity_) {
+      CPU_SET(cpu, &cpus);
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+      MG_LOG(WARNING) << "couldn't set affinity of thread \"" << name_ << "\"";
+    }
+  }
+
+  if (priority_ != Priority::kNormal) {
+    // setpriority adjusts the nice value of a single thread when given a
+    // thread ID. Raising priority (negative nice) may fail with EPERM for
+    // unprivileged processes; that's fine, the kHigh hint is best-effort.
+    int nice_value = priority_ == Priority::kLow ? 10 : -5;
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, nice_value) != 0 &&
+        priority_ == Priority::kLow) {
+      MG_LOG(WARNING) << "couldn't lower priority of thread \"" << name_
+                      << "\"";
+    }
+  }
+#endif  // __linux__
+}
+
 void LambdaThread::Run() { closure_(); }
 
 }  // namespace minigo
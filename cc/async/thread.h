@@ -18,6 +18,7 @@
 #include <functional>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "absl/synchronization/mutex.h"
 
@@ -25,6 +26,17 @@ namespace minigo {
 
 class Thread {
  public:
+  // Scheduling priority relative to other threads in the process. `kLow` is
+  // for background work (e.g. file output) that shouldn't displace
+  // latency-sensitive threads; it never requires elevated privileges.
+  // Raising priority above `kNormal` may require privileges and is applied
+  // on a best-effort basis.
+  enum class Priority {
+    kHigh,
+    kNormal,
+    kLow,
+  };
+
   virtual ~Thread();
 
   Thread() = default;
@@ -35,13 +47,28 @@ class Thread {
 
   std::thread::native_handle_type handle() { return impl_.native_handle(); }
 
+  // Restricts the thread to the given logical CPUs. Must be called before
+  // `Start`; the mask is applied on the new thread before `Run`, so memory
+  // that `Run` first-touches is allocated near the CPUs it executes on.
+  // Best-effort: unsupported platforms ignore it.
+  void SetAffinity(std::vector<int> cpus);
+
+  // Sets the thread's scheduling priority. Must be called before `Start`.
+  // Best-effort: unsupported platforms ignore it.
+  void SetPriority(Priority priority);
+
   virtual void Start();
   virtual void Join();
 
  private:
   virtual void Run() = 0;
 
+  // Applies affinity_ and priority_; called on the new thread before Run.
+  void ApplySchedulingSettings();
+
   std::string name_;
+  std::vector<int> affinity_;
+  Priority priority_ = Priority::kNormal;
   std::thread impl_;
 };
 
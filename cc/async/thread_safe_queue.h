@@ -17,10 +17,12 @@
 
 #include <queue>
 #include <utility>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 
 namespace minigo {
 
@@ -37,6 +39,24 @@ class ThreadSafeQueue {
     queue_.push(std::forward<T>(x));
   }
 
+  // Pushes every element of `items` under a single lock acquisition,
+  // moving from the elements.
+  void PushAll(absl::Span<T> items) {
+    absl::MutexLock lock(&m_);
+    for (auto& x : items) {
+      queue_.push(std::move(x));
+    }
+  }
+
+  // Pushes a copy of every element of `items` under a single lock
+  // acquisition.
+  void PushAll(absl::Span<const T> items) {
+    absl::MutexLock lock(&m_);
+    for (const auto& x : items) {
+      queue_.push(x);
+    }
+  }
+
   bool TryPop(T* x) {
     absl::MutexLock lock(&m_);
     if (queue_.empty()) {
@@ -67,6 +87,29 @@ class ThreadSafeQueue {
     return true;
   }
 
+  // Appends every queued element to `items` under a single lock
+  // acquisition. Doesn't block: an empty queue appends nothing.
+  void PopAll(std::vector<T>* items) {
+    absl::MutexLock lock(&m_);
+    while (!queue_.empty()) {
+      items->push_back(std::move(queue_.front()));
+      queue_.pop();
+    }
+  }
+
+  // Appends up to `n` queued elements to `items` under a single lock
+  // acquisition, returning the number popped. Doesn't block.
+  size_t TryPopN(size_t n, std::vector<T>* items) {
+    absl::MutexLock lock(&m_);
+    size_t num_popped = 0;
+    while (num_popped < n && !queue_.empty()) {
+      items->push_back(std::move(queue_.front()));
+      queue_.pop();
+      num_popped += 1;
+    }
+    return num_popped;
+  }
+
   bool empty() const {
     absl::MutexLock lock(&m_);
     return queue_.empty();
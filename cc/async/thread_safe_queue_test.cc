@@ -47,6 +47,31 @@ TEST(ThreadSafeQueueTest, Ordering) {
   EXPECT_FALSE(q.TryPop(&x));
 }
 
+// Verify that the bulk operations move whole batches and preserve ordering.
+TEST(ThreadSafeQueueTest, BulkOperations) {
+  ThreadSafeQueue<std::string> q;
+
+  std::vector<std::string> pushed = {"a", "b", "c", "d", "e"};
+  q.PushAll(absl::MakeConstSpan(pushed));
+
+  std::vector<std::string> popped;
+  EXPECT_EQ(2, q.TryPopN(2, &popped));
+  EXPECT_THAT(popped, ::testing::ElementsAre("a", "b"));
+
+  q.PopAll(&popped);
+  EXPECT_THAT(popped, ::testing::ElementsAre("a", "b", "c", "d", "e"));
+  EXPECT_TRUE(q.empty());
+
+  // TryPopN and PopAll don't block on an empty queue.
+  EXPECT_EQ(0, q.TryPopN(3, &popped));
+  q.PopAll(&popped);
+  EXPECT_EQ(5, popped.size());
+
+  // The moving PushAll overload accepts a mutable span.
+  q.PushAll(absl::MakeSpan(pushed));
+  EXPECT_EQ("a", q.Pop());
+}
+
 // Verify that PopWithTimeout works whether the queue is empty or not.
 TEST(ThreadSafeQueueTest, PopWithTimeout) {
   ThreadSafeQueue<int> q;
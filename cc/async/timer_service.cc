@@ -0,0 +1,135 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/timer_service.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "cc/logging.h"
+
+namespace minigo {
+
+namespace {
+
+// Timers close enough to a wakeup run on the same wakeup instead of
+// scheduling another one. A timer may fire early by up to a tenth of its
+// period, capped at this window; the existing consumers poll on second-scale
+// intervals, so firing up to 100ms early is harmless.
+constexpr absl::Duration kMaxCoalesceSlack = absl::Milliseconds(100);
+
+}  // namespace
+
+constexpr TimerService::TimerId TimerService::kInvalidTimerId;
+
+TimerService* TimerService::Get() {
+  // Deliberately leaked: the service's thread runs until process exit.
+  static TimerService* impl = new TimerService();
+  return impl;
+}
+
+TimerService::TimerService() {
+  thread_ = absl::make_unique<LambdaThread>("TimerSvc", [this]() { Run(); });
+  thread_->Start();
+}
+
+TimerService::TimerId TimerService::AddPeriodic(absl::Duration period,
+                                                std::function<void()> fn) {
+  absl::MutexLock lock(&mutex_);
+  auto timer = absl::make_unique<Timer>();
+  timer->id = next_id_++;
+  timer->period = period;
+  timer->deadline = absl::Now();
+  timer->fn = std::move(fn);
+  timers_.push_back(std::move(timer));
+  changed_ = true;
+  return timers_.back()->id;
+}
+
+void TimerService::Cancel(TimerId id) {
+  absl::MutexLock lock(&mutex_);
+  Timer* timer = nullptr;
+  for (auto& t : timers_) {
+    if (t->id == id) {
+      timer = t.get();
+      break;
+    }
+  }
+  MG_CHECK(timer != nullptr) << "unknown timer " << id;
+
+  timer->cancelled = true;
+  changed_ = true;
+
+  // Wait until the timer's callback isn't running on the service's thread.
+  // The Timer itself is heap-allocated, so it stays put even if AddPeriodic
+  // grows `timers_` while we wait.
+  mutex_.Await(absl::Condition(&TimerService::TimerIsIdle, timer));
+
+  for (auto it = timers_.begin(); it != timers_.end(); ++it) {
+    if (it->get() == timer) {
+      timers_.erase(it);
+      break;
+    }
+  }
+}
+
+void TimerService::Run() {
+  absl::MutexLock lock(&mutex_);
+  for (;;) {
+    // Run every due callback. The timer list can change while the lock is
+    // dropped around a callback, so re-scan from the start after each one.
+    for (;;) {
+      auto now = absl::Now();
+      Timer* due = nullptr;
+      for (auto& t : timers_) {
+        auto slack = std::min(kMaxCoalesceSlack, t->period / 10);
+        if (!t->cancelled && !t->running && t->deadline - slack <= now) {
+          due = t.get();
+          break;
+        }
+      }
+      if (due == nullptr) {
+        break;
+      }
+
+      due->running = true;
+      mutex_.Unlock();
+      due->fn();
+      mutex_.Lock();
+      due->running = false;
+      // Like PollThread, the next invocation is scheduled a full period
+      // after the previous one finished.
+      due->deadline = absl::Now() + due->period;
+    }
+
+    // Sleep until the earliest deadline, or until the timer list changes.
+    absl::Time next = absl::InfiniteFuture();
+    for (auto& t : timers_) {
+      if (!t->cancelled) {
+        next = std::min(next, t->deadline);
+      }
+    }
+    changed_ = false;
+    mutex_.AwaitWithTimeout(absl::Condition(this, &TimerService::Changed),
+                            next - absl::Now());
+  }
+}
+
+bool TimerService::Changed() const { return changed_; }
+
+bool TimerService::TimerIsIdle(Timer* timer) { return !timer->running; }
+
+}  // namespace minigo
@@ -0,0 +1,86 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_ASYNC_TIMER_SERVICE_H_
+#define CC_ASYNC_TIMER_SERVICE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "cc/async/thread.h"
+
+namespace minigo {
+
+// Multiplexes periodic callbacks onto a single shared thread, replacing the
+// dedicated poll thread that each periodic consumer used to own. Wakeups are
+// coalesced: when the service's thread wakes for the earliest deadline it
+// also runs every other callback that's due within a small window, so
+// co-scheduled timers don't each wake a core separately.
+//
+// Callbacks run on the service's thread and should be brief: a slow callback
+// delays the others. Callbacks must not call AddPeriodic or Cancel.
+class TimerService {
+ public:
+  using TimerId = int64_t;
+  static constexpr TimerId kInvalidTimerId = 0;
+
+  // Returns the process-wide timer service, starting its thread on first
+  // use. The service runs for the remainder of the process's lifetime.
+  static TimerService* Get();
+
+  // Schedules `fn` to run every `period`. The first invocation happens as
+  // soon as the service's thread gets to it, matching the old PollThread
+  // which polled once immediately on start.
+  TimerId AddPeriodic(absl::Duration period, std::function<void()> fn)
+      LOCKS_EXCLUDED(&mutex_);
+
+  // Cancels the timer and blocks until any in-flight invocation of its
+  // callback has returned, so the caller can safely destroy state the
+  // callback uses once Cancel returns.
+  void Cancel(TimerId id) LOCKS_EXCLUDED(&mutex_);
+
+ private:
+  struct Timer {
+    TimerId id;
+    absl::Duration period;
+    absl::Time deadline;
+    std::function<void()> fn;
+    bool running = false;
+    bool cancelled = false;
+  };
+
+  TimerService();
+
+  void Run() LOCKS_EXCLUDED(&mutex_);
+  bool Changed() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  static bool TimerIsIdle(Timer* timer);
+
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Timer>> timers_ GUARDED_BY(&mutex_);
+  TimerId next_id_ GUARDED_BY(&mutex_) = 1;
+
+  // Set when a timer is added or cancelled to wake the service's thread
+  // early so it can recompute its next deadline.
+  bool changed_ GUARDED_BY(&mutex_) = false;
+
+  std::unique_ptr<Thread> thread_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_ASYNC_TIMER_SERVICE_H_
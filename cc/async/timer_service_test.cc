@@ -0,0 +1,79 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async/timer_service.h"
+
+#include <atomic>
+
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// A periodic callback fires repeatedly and stops firing once cancelled.
+TEST(TimerServiceTest, Periodic) {
+  std::atomic<int> num_calls{0};
+  auto id = TimerService::Get()->AddPeriodic(
+      absl::Milliseconds(10), [&num_calls]() { num_calls.fetch_add(1); });
+
+  while (num_calls.load() < 3) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  TimerService::Get()->Cancel(id);
+
+  // No more invocations after Cancel returns.
+  int calls_after_cancel = num_calls.load();
+  absl::SleepFor(absl::Milliseconds(50));
+  EXPECT_EQ(calls_after_cancel, num_calls.load());
+}
+
+// Cancel blocks until an in-flight callback has returned.
+TEST(TimerServiceTest, CancelWaitsForInFlightCallback) {
+  absl::Notification started;
+  std::atomic<bool> finished{false};
+  auto id = TimerService::Get()->AddPeriodic(
+      absl::Milliseconds(1), [&started, &finished]() {
+        if (!started.HasBeenNotified()) {
+          started.Notify();
+        }
+        absl::SleepFor(absl::Milliseconds(20));
+        finished.store(true);
+      });
+
+  started.WaitForNotification();
+  TimerService::Get()->Cancel(id);
+  EXPECT_TRUE(finished.load());
+}
+
+// Multiple timers make progress independently on the shared thread.
+TEST(TimerServiceTest, MultipleTimers) {
+  std::atomic<int> a{0};
+  std::atomic<int> b{0};
+  auto id_a = TimerService::Get()->AddPeriodic(absl::Milliseconds(5),
+                                               [&a]() { a.fetch_add(1); });
+  auto id_b = TimerService::Get()->AddPeriodic(absl::Milliseconds(5),
+                                               [&b]() { b.fetch_add(1); });
+
+  while (a.load() < 2 || b.load() < 2) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+
+  TimerService::Get()->Cancel(id_a);
+  TimerService::Get()->Cancel(id_b);
+}
+
+}  // namespace
+}  // namespace minigo
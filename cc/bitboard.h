@@ -0,0 +1,229 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_BITBOARD_H_
+#define CC_BITBOARD_H_
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "cc/constants.h"
+#include "cc/logging.h"
+
+namespace minigo {
+
+// A whole-board bitmask with one bit per intersection. Position maintains
+// bitboard planes of the black stones, white stones and legal moves, so that
+// vectorized code and feature extraction can operate on a handful of 64-bit
+// words instead of scanning kN * kN scattered bytes.
+class Bitboard {
+ public:
+  static constexpr int kNumWords = (kN * kN + 63) / 64;
+
+  bool test(int c) const {
+    MG_DCHECK(c >= 0 && c < kN * kN);
+    return ((words_[c >> 6] >> (c & 63)) & 1) != 0;
+  }
+
+  void set(int c) {
+    MG_DCHECK(c >= 0 && c < kN * kN);
+    words_[c >> 6] |= uint64_t{1} << (c & 63);
+  }
+
+  void clear(int c) {
+    MG_DCHECK(c >= 0 && c < kN * kN);
+    words_[c >> 6] &= ~(uint64_t{1} << (c & 63));
+  }
+
+  void clear_all() { words_.fill(0); }
+
+  // Returns the number of set bits.
+  int count() const {
+    int n = 0;
+    for (auto w : words_) {
+      n += static_cast<int>(std::bitset<64>(w).count());
+    }
+    return n;
+  }
+
+  const std::array<uint64_t, kNumWords>& words() const { return words_; }
+
+  // Calls `fn(c)` for the index of each set bit, in ascending order.
+  template <typename Fn>
+  void ForEach(Fn&& fn) const {
+    for (int w = 0; w < kNumWords; ++w) {
+      auto word = words_[w];
+      while (word != 0) {
+        fn(w * 64 + CountTrailingZeros(word));
+        word &= word - 1;
+      }
+    }
+  }
+
+  Bitboard& operator&=(const Bitboard& other) {
+    for (int i = 0; i < kNumWords; ++i) {
+      words_[i] &= other.words_[i];
+    }
+    return *this;
+  }
+
+  Bitboard& operator|=(const Bitboard& other) {
+    for (int i = 0; i < kNumWords; ++i) {
+      words_[i] |= other.words_[i];
+    }
+    return *this;
+  }
+
+  Bitboard& operator^=(const Bitboard& other) {
+    for (int i = 0; i < kNumWords; ++i) {
+      words_[i] ^= other.words_[i];
+    }
+    return *this;
+  }
+
+  friend Bitboard operator&(Bitboard a, const Bitboard& b) {
+    a &= b;
+    return a;
+  }
+
+  friend Bitboard operator|(Bitboard a, const Bitboard& b) {
+    a |= b;
+    return a;
+  }
+
+  friend Bitboard operator^(Bitboard a, const Bitboard& b) {
+    a ^= b;
+    return a;
+  }
+
+  friend bool operator==(const Bitboard& a, const Bitboard& b) {
+    return a.words_ == b.words_;
+  }
+  friend bool operator!=(const Bitboard& a, const Bitboard& b) {
+    return !(a == b);
+  }
+
+  // Shifts every bit towards higher indices by `n`, where 0 < n < 64.
+  // Bits shifted past the last point on the board are discarded.
+  Bitboard& operator<<=(int n) {
+    MG_DCHECK(n > 0 && n < 64);
+    for (int i = kNumWords - 1; i > 0; --i) {
+      words_[i] = (words_[i] << n) | (words_[i - 1] >> (64 - n));
+    }
+    words_[0] <<= n;
+    words_[kNumWords - 1] &= kLastWordMask;
+    return *this;
+  }
+
+  // Shifts every bit towards lower indices by `n`, where 0 < n < 64.
+  Bitboard& operator>>=(int n) {
+    MG_DCHECK(n > 0 && n < 64);
+    for (int i = 0; i < kNumWords - 1; ++i) {
+      words_[i] = (words_[i] >> n) | (words_[i + 1] << (64 - n));
+    }
+    words_[kNumWords - 1] >>= n;
+    return *this;
+  }
+
+  // Returns the complement, restricted to points on the board.
+  friend Bitboard operator~(Bitboard a) {
+    for (auto& w : a.words_) {
+      w = ~w;
+    }
+    a.words_[kNumWords - 1] &= kLastWordMask;
+    return a;
+  }
+
+  // Masks of the points not in the first (respectively last) column. Used to
+  // stop horizontal shifts from wrapping between adjacent rows.
+  static const Bitboard& NotFirstCol() {
+    static const Bitboard b = MakeColMask(0);
+    return b;
+  }
+  static const Bitboard& NotLastCol() {
+    static const Bitboard b = MakeColMask(kN - 1);
+    return b;
+  }
+
+ private:
+  // Mask of the valid bits in the last word.
+  static constexpr uint64_t kLastWordMask =
+      (kN * kN % 64) == 0 ? ~uint64_t{0}
+                          : (uint64_t{1} << (kN * kN % 64)) - 1;
+
+  // Returns the index of the lowest set bit of `x`, which must be non-zero.
+  static int CountTrailingZeros(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctzll(x);
+#endif
+  }
+
+  // Returns the mask of all points not in column `col`.
+  static Bitboard MakeColMask(int col) {
+    Bitboard b;
+    for (int c = 0; c < kN * kN; ++c) {
+      if (c % kN != col) {
+        b.set(c);
+      }
+    }
+    return b;
+  }
+
+  std::array<uint64_t, kNumWords> words_{};
+};
+
+// Returns the set of points horizontally or vertically adjacent to a set bit
+// in `b`. A set bit's own point is only included if it also neighbors another
+// set bit.
+inline Bitboard Neighbors(const Bitboard& b) {
+  Bitboard up = b;
+  Bitboard down = b;
+  Bitboard left = b;
+  Bitboard right = b;
+  up >>= kN;
+  down <<= kN;
+  left >>= 1;
+  left &= Bitboard::NotLastCol();
+  right <<= 1;
+  right &= Bitboard::NotFirstCol();
+  return up | down | left | right;
+}
+
+// Expands `seed` to cover every connected component of `mask` that contains
+// at least one seed bit, by repeated parallel neighbor propagation.
+inline Bitboard FloodFill(Bitboard seed, const Bitboard& mask) {
+  seed &= mask;
+  for (;;) {
+    Bitboard next = seed;
+    next |= Neighbors(seed);
+    next &= mask;
+    if (next == seed) {
+      return seed;
+    }
+    seed = next;
+  }
+}
+
+}  // namespace minigo
+
+#endif  // CC_BITBOARD_H_
@@ -0,0 +1,276 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Builds a warm inference cache pack for a model from the openings of a
+// directory of selfplay SGF games:
+//
+//   build_cache_pack --sgf_dir=sgf/ --model=model.minigo \
+//       --output=cache.mgcache
+//
+// The first --max_moves positions of each game are replayed through the
+// model once and the results are written to --output in the persistent
+// MmapInferenceCache format, so the pack can be published alongside a newly
+// trained model and passed to selfplay workers as --cache_file. Freshly
+// provisioned workers then start with the common opening positions already
+// cached instead of every worker in the fleet re-running the same
+// inferences.
+//
+// Each unique position is evaluated under all eight inference symmetries by
+// default (the same symmetries selfplay picks pseudo-randomly at lookup
+// time), so a packed position always hits. --num_symmetries trades pack
+// build time for hit rate when that's too slow.
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "cc/constants.h"
+#include "cc/coord.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/init.h"
+#include "cc/inline_vector.h"
+#include "cc/logging.h"
+#include "cc/mcts_tree.h"
+#include "cc/model/inference_cache.h"
+#include "cc/model/loader.h"
+#include "cc/model/model.h"
+#include "cc/model/types.h"
+#include "cc/position.h"
+#include "cc/sgf.h"
+#include "cc/symmetries.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(sgf_dir, "", "Directory to load SGF games from.");
+DEFINE_string(model, "", "Path to a minigo model.");
+DEFINE_string(device, "", "Device to run on (e.g. TPU address).");
+DEFINE_string(output, "", "Path to write the cache pack to.");
+DEFINE_string(cache_model_name, "",
+              "Model name to stamp into the pack. This must match the "
+              "--model flag the selfplay workers will run with, or they'll "
+              "treat the pack as stale and clear it; defaults to this "
+              "tool's --model value.");
+DEFINE_int32(cache_size_mb, 1024,
+             "Size of the cache pack in MB. Make it the same size as the "
+             "workers' --cache_file_size_mb so opening the pack doesn't "
+             "resize (and clear) it.");
+DEFINE_int32(max_moves, 20,
+             "Number of opening moves of each game to add to the pack.");
+DEFINE_int32(num_symmetries, 8,
+             "Number of inference symmetries to evaluate each position "
+             "under. Selfplay looks positions up under a pseudo-random "
+             "symmetry, so a pack built with fewer than 8 only hits for a "
+             "fraction of lookups.");
+DEFINE_int32(batch_size, 256, "Inference batch size.");
+
+namespace minigo {
+namespace {
+
+// One unique opening position, holding everything needed both to build the
+// model input and to derive the cache key selfplay will look it up under.
+struct OpeningPosition {
+  InferenceCache::Key key;
+  symmetry::Symmetry canonical_sym;
+  Position position{Color::kBlack};
+  // The position's stones and those of the positions before it, newest
+  // first, as required by ModelInput.
+  inline_vector<StoneSnapshot, kMaxPositionHistory> history;
+};
+
+// Deduplicated opening positions from all games, in first-seen order.
+struct OpeningSet {
+  std::vector<std::unique_ptr<OpeningPosition>> positions;
+  absl::flat_hash_set<InferenceCache::Key> seen;
+
+  void Add(Coord prev_move, bool has_canonical_sym,
+           symmetry::Symmetry canonical_sym, const Position& position,
+           const std::vector<StoneSnapshot>& snapshots) {
+    // Positions without a unique canonical symmetry use the identity, the
+    // same fallback MctsNode makes.
+    auto sym = has_canonical_sym ? canonical_sym : symmetry::kIdentity;
+    InferenceCache::Key key(prev_move, sym, position);
+    if (!seen.insert(key).second) {
+      return;
+    }
+
+    auto opening = absl::make_unique<OpeningPosition>();
+    opening->key = key;
+    opening->canonical_sym = sym;
+    opening->position = position;
+    for (auto it = snapshots.rbegin();
+         it != snapshots.rend() &&
+         opening->history.size() < opening->history.capacity();
+         ++it) {
+      opening->history.push_back(*it);
+    }
+    positions.push_back(std::move(opening));
+  }
+};
+
+// Replays the first --max_moves positions of a game's main line into the
+// opening set. The canonical symmetry is carried along the game the same
+// way MctsNode does it: computed lazily from each position in turn and
+// frozen once a position with a unique canonical symmetry is found.
+class OpeningCollector : public sgf::StreamingVisitor {
+ public:
+  explicit OpeningCollector(OpeningSet* openings) : openings_(openings) {
+    snapshots_.push_back(position_.stone_snapshot());
+  }
+
+  // The first tree to close marks the end of the main line.
+  bool OnTreeEnd() override { return false; }
+
+  bool OnMove(Move move) override {
+    if (num_moves_ >= FLAGS_max_moves) {
+      return false;
+    }
+    if (!position_.legal_move(move.c)) {
+      // The game was played under different rules (or is corrupt): stop
+      // reading rather than packing positions selfplay can't reach.
+      return false;
+    }
+
+    if (!has_canonical_sym_) {
+      auto sym = CalculateCanonicalSymmetry(position_);
+      if (sym.has_value()) {
+        has_canonical_sym_ = true;
+        canonical_sym_ = sym.value();
+      }
+    }
+
+    position_.PlayMove(move.c);
+    snapshots_.push_back(position_.stone_snapshot());
+    openings_->Add(move.c, has_canonical_sym_, canonical_sym_, position_,
+                   snapshots_);
+    num_moves_ += 1;
+    return true;
+  }
+
+ private:
+  OpeningSet* openings_;
+  Position position_{Color::kBlack};
+  std::vector<StoneSnapshot> snapshots_;
+  bool has_canonical_sym_ = false;
+  symmetry::Symmetry canonical_sym_ = symmetry::kIdentity;
+  int num_moves_ = 0;
+};
+
+void Run() {
+  MG_CHECK(!FLAGS_sgf_dir.empty()) << "--sgf_dir is required";
+  MG_CHECK(!FLAGS_model.empty()) << "--model is required";
+  MG_CHECK(!FLAGS_output.empty()) << "--output is required";
+  MG_CHECK(FLAGS_num_symmetries >= 1 &&
+           FLAGS_num_symmetries <= symmetry::kNumSymmetries);
+
+  OpeningSet openings;
+
+  // Every game starts from the empty board, whose root inference selfplay
+  // also looks up in the cache.
+  {
+    Position empty(Color::kBlack);
+    std::vector<StoneSnapshot> snapshots{empty.stone_snapshot()};
+    openings.Add(Coord::kInvalid, false, symmetry::kIdentity, empty,
+                 snapshots);
+  }
+
+  std::vector<std::string> basenames;
+  MG_CHECK(file::ListDir(FLAGS_sgf_dir, &basenames))
+      << "couldn't list " << FLAGS_sgf_dir;
+
+  int num_games = 0;
+  for (const auto& basename : basenames) {
+    if (!absl::EndsWith(basename, ".sgf")) {
+      continue;
+    }
+    auto path = file::JoinPath(FLAGS_sgf_dir, basename);
+    std::string contents;
+    if (!file::ReadFile(path, &contents)) {
+      continue;
+    }
+    OpeningCollector collector(&openings);
+    std::string error;
+    if (!sgf::ParseStreaming(contents, &collector, &error)) {
+      MG_LOG(WARNING) << "couldn't parse \"" << path << "\": " << error;
+      continue;
+    }
+    num_games += 1;
+  }
+  MG_LOG(INFO) << "Collected " << openings.positions.size()
+               << " unique opening positions from " << num_games << " games";
+
+  auto model_name = FLAGS_cache_model_name.empty() ? FLAGS_model
+                                                   : FLAGS_cache_model_name;
+  auto capacity = MmapInferenceCache::CalculateCapacity(FLAGS_cache_size_mb);
+  MG_CHECK(openings.positions.size() <= capacity)
+      << "the pack only holds " << capacity
+      << " positions; increase --cache_size_mb or reduce --max_moves";
+  auto cache = MmapInferenceCache::Open(FLAGS_output, capacity, model_name);
+  MG_CHECK(cache != nullptr)
+      << "couldn't open cache pack \"" << FLAGS_output << "\"";
+
+  auto model = NewModel(FLAGS_model, FLAGS_device);
+
+  std::vector<ModelInput> inputs(FLAGS_batch_size);
+  std::vector<ModelOutput> outputs(FLAGS_batch_size);
+  for (int sym_idx = 0; sym_idx < FLAGS_num_symmetries; ++sym_idx) {
+    auto inference_sym = static_cast<symmetry::Symmetry>(sym_idx);
+    auto batch_size = static_cast<size_t>(FLAGS_batch_size);
+    for (size_t begin = 0; begin < openings.positions.size();
+         begin += batch_size) {
+      auto end = std::min(begin + batch_size, openings.positions.size());
+
+      std::vector<const ModelInput*> input_ptrs;
+      std::vector<ModelOutput*> output_ptrs;
+      for (size_t i = begin; i < end; ++i) {
+        const auto& opening = *openings.positions[i];
+        auto& input = inputs[i - begin];
+        input.sym = inference_sym;
+        input.position = &opening.position;
+        input.stone_history.clear();
+        for (const auto& snapshot : opening.history) {
+          input.stone_history.push_back(&snapshot);
+        }
+        input_ptrs.push_back(&input);
+        output_ptrs.push_back(&outputs[i - begin]);
+      }
+
+      model->RunMany(input_ptrs, &output_ptrs, nullptr);
+
+      for (size_t i = begin; i < end; ++i) {
+        const auto& opening = *openings.positions[i];
+        cache->Merge(opening.key, opening.canonical_sym, inference_sym,
+                     &outputs[i - begin]);
+      }
+    }
+  }
+
+  MG_LOG(INFO) << "Cache pack stats: " << cache->GetStats();
+
+  // Flush the mapping back to --output.
+  cache.reset();
+  ShutdownModelFactories();
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Builds an rsync-style binary delta between two model generations (see
+// cc/model/model_delta.h). Run by the trainer after each generation is
+// written:
+//
+//   build_model_delta --base=models/000041.minigo \
+//                     --target=models/000042.minigo
+//
+// The delta is written next to the target as `<target>.mgdelta` (or to
+// --output). Workers whose model cache holds the base generation download
+// just the delta and patch locally instead of fetching the full model.
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "cc/file/utils.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/model/model_delta.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(base, "", "Path to the previous model generation.");
+DEFINE_string(target, "", "Path to the new model generation.");
+DEFINE_string(output, "",
+              "Path to write the delta to. Defaults to <target>.mgdelta.");
+DEFINE_uint64(chunk_size, minigo::kDefaultDeltaChunkSize,
+              "Chunk size used to match runs of the base. Smaller chunks "
+              "find more matches but grow the delta's op overhead.");
+
+namespace minigo {
+namespace {
+
+void Run() {
+  MG_CHECK(!FLAGS_base.empty()) << "--base is required";
+  MG_CHECK(!FLAGS_target.empty()) << "--target is required";
+
+  std::string base, target;
+  MG_CHECK(file::ReadFile(FLAGS_base, &base))
+      << "error reading " << FLAGS_base;
+  MG_CHECK(file::ReadFile(FLAGS_target, &target))
+      << "error reading " << FLAGS_target;
+
+  auto delta = BuildModelDelta(base, target, FLAGS_chunk_size);
+
+  // Sanity-check the delta before publishing it: a delta that doesn't apply
+  // cleanly would make every worker fall back to a full fetch.
+  std::string patched;
+  MG_CHECK(ApplyModelDelta(base, delta, &patched))
+      << "built delta doesn't apply cleanly";
+
+  auto output = FLAGS_output.empty() ? absl::StrCat(FLAGS_target, ".mgdelta")
+                                     : FLAGS_output;
+  MG_CHECK(file::WriteFile(output, delta)) << "error writing " << output;
+
+  MG_LOG(INFO) << "wrote " << output << ": " << delta.size() << " bytes for a "
+               << target.size() << " byte model ("
+               << (target.empty()
+                       ? 0.f
+                       : 100.f * static_cast<float>(delta.size()) /
+                             static_cast<float>(target.size()))
+               << "% of a full fetch)";
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  return 0;
+}
@@ -0,0 +1,134 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Aggregates the openings of a directory of selfplay SGF games into an
+// opening book (see cc/opening_book.h):
+//
+//   build_opening_book --sgf_dir=sgf/ --output=openings.mgbook
+//
+// Each game's first --max_moves positions contribute one visit to the move
+// that was played, folded through all eight board symmetries; moves seen
+// fewer than --min_weight times are dropped as too rare to trust.
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "cc/constants.h"
+#include "cc/coord.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/opening_book.h"
+#include "cc/position.h"
+#include "cc/sgf.h"
+#include "cc/symmetries.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(sgf_dir, "", "Directory to load SGF games from.");
+DEFINE_string(output, "", "Path to write the book to.");
+DEFINE_int32(max_moves, 20,
+             "Number of opening moves of each game to add to the book.");
+DEFINE_int32(min_weight, 10,
+             "Moves seen fewer than this many times are dropped from the "
+             "book.");
+
+namespace minigo {
+namespace {
+
+// Adds the first --max_moves positions of a game's main line to the book.
+class BookAccumulator : public sgf::StreamingVisitor {
+ public:
+  explicit BookAccumulator(OpeningBook* book) : book_(book) {}
+
+  // The first tree to close marks the end of the main line.
+  bool OnTreeEnd() override { return false; }
+
+  bool OnMove(Move move) override {
+    if (num_moves_ >= FLAGS_max_moves) {
+      return false;
+    }
+    if (!position_.legal_move(move.c)) {
+      // The game was played under different rules (or is corrupt): stop
+      // reading rather than recording positions we can't reach.
+      return false;
+    }
+
+    for (int i = 0; i < symmetry::kNumSymmetries; ++i) {
+      auto sym = static_cast<symmetry::Symmetry>(i);
+      auto key = OpeningBook::KeyHash(prev_move_, sym, position_);
+      auto c = move.c < kN * kN ? symmetry::kCoords[sym][move.c] : move.c;
+      book_->AddVisits(key, c, 1);
+    }
+
+    position_.PlayMove(move.c);
+    prev_move_ = move.c;
+    num_moves_ += 1;
+    return true;
+  }
+
+ private:
+  OpeningBook* book_;
+  Position position_{Color::kBlack};
+  Coord prev_move_ = Coord::kInvalid;
+  int num_moves_ = 0;
+};
+
+void Run() {
+  MG_CHECK(!FLAGS_sgf_dir.empty()) << "--sgf_dir is required";
+  MG_CHECK(!FLAGS_output.empty()) << "--output is required";
+
+  std::vector<std::string> basenames;
+  MG_CHECK(file::ListDir(FLAGS_sgf_dir, &basenames))
+      << "couldn't list " << FLAGS_sgf_dir;
+
+  OpeningBook book;
+  int num_games = 0;
+  std::string contents;
+  for (const auto& basename : basenames) {
+    if (!absl::EndsWith(basename, ".sgf")) {
+      continue;
+    }
+    auto path = file::JoinPath(FLAGS_sgf_dir, basename);
+    if (!file::ReadFile(path, &contents)) {
+      MG_LOG(WARNING) << "couldn't read " << path;
+      continue;
+    }
+    BookAccumulator accumulator(&book);
+    std::string error;
+    if (!sgf::ParseStreaming(contents, &accumulator, &error)) {
+      MG_LOG(WARNING) << "error parsing " << path << ": " << error;
+      continue;
+    }
+    num_games += 1;
+  }
+  MG_LOG(INFO) << "Aggregated " << num_games << " games into " << book.size()
+               << " positions";
+
+  book.Prune(FLAGS_min_weight);
+  MG_LOG(INFO) << book.size() << " positions left after dropping moves seen "
+               << "fewer than " << FLAGS_min_weight << " times";
+
+  MG_CHECK(file::WriteFile(FLAGS_output, book.Serialize()));
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  return 0;
+}
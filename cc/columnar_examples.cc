@@ -0,0 +1,220 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/columnar_examples.h"
+
+#include <cstring>
+
+#include "cc/constants.h"
+#include "cc/file/path.h"
+#include "cc/logging.h"
+#include "cc/model/model.h"
+#include "cc/symmetries.h"
+
+namespace minigo {
+namespace columnar {
+
+namespace {
+
+constexpr char kMagic[8] = {'m', 'g', 'c', 'o', 'l', 'u', 'm', 'n'};
+// Version 2 replaced the dense float pi column with SparsePi's fixed-size
+// packed encoding.
+constexpr uint32_t kVersion = 2;
+constexpr size_t kColumnAlignment = 64;
+
+size_t AlignUp(size_t x) {
+  return (x + kColumnAlignment - 1) & ~(kColumnAlignment - 1);
+}
+
+// Fills in a header and computes the column layout for a file holding
+// `num_examples` examples, returning the total file size.
+size_t InitHeader(uint32_t feature_bytes, uint64_t num_examples,
+                  Header* header) {
+  memcpy(header->magic, kMagic, sizeof(kMagic));
+  header->version = kVersion;
+  header->board_size = kN;
+  header->feature_bytes = feature_bytes;
+  header->reserved = 0;
+  header->num_examples = num_examples;
+
+  auto field_sizes = FieldSizes(feature_bytes);
+  size_t offset = AlignUp(sizeof(Header));
+  for (int i = 0; i < kNumColumns; ++i) {
+    header->column_offset[i] = offset;
+    header->column_size[i] = num_examples * field_sizes[i];
+    offset = AlignUp(offset + header->column_size[i]);
+  }
+  return offset;
+}
+
+// Copies `size` bytes of `src` into example `i`'s slot in `column`.
+void FillField(const void* src, size_t size, size_t i, Header* header,
+               int column, std::string* contents) {
+  memcpy(&(*contents)[header->column_offset[column] + i * size], src, size);
+}
+
+}  // namespace
+
+std::array<size_t, kNumColumns> FieldSizes(uint32_t feature_bytes) {
+  return {{feature_bytes, SparsePi::kPackedSize, sizeof(float),
+           sizeof(float), sizeof(int32_t), sizeof(uint16_t)}};
+}
+
+bool FileView::Parse(absl::string_view contents, FileView* view) {
+  if (contents.size() < sizeof(Header)) {
+    MG_LOG(WARNING) << "columnar file too small (" << contents.size()
+                    << " bytes)";
+    return false;
+  }
+  const auto* header = reinterpret_cast<const Header*>(contents.data());
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+    MG_LOG(WARNING) << "bad magic in columnar file";
+    return false;
+  }
+  if (header->version != kVersion) {
+    MG_LOG(WARNING) << "unsupported columnar file version " << header->version;
+    return false;
+  }
+  if (header->board_size != kN) {
+    MG_LOG(WARNING) << "columnar file is for board size " << header->board_size
+                    << ", expected " << kN;
+    return false;
+  }
+
+  auto field_sizes = FieldSizes(header->feature_bytes);
+  for (int i = 0; i < kNumColumns; ++i) {
+    if (header->column_size[i] != header->num_examples * field_sizes[i] ||
+        header->column_offset[i] + header->column_size[i] > contents.size()) {
+      MG_LOG(WARNING) << "bad column " << i << " in columnar file";
+      return false;
+    }
+    view->columns[i] = contents.substr(header->column_offset[i],
+                                       header->column_size[i]);
+  }
+  view->header = header;
+  return true;
+}
+
+void FileView::AppendRow(size_t i, std::string* row) const {
+  MG_DCHECK(i < header->num_examples);
+  auto field_sizes = FieldSizes(header->feature_bytes);
+  for (int col = 0; col < kNumColumns; ++col) {
+    row->append(columns[col].data() + i * field_sizes[col], field_sizes[col]);
+  }
+}
+
+std::string SerializeRows(uint32_t feature_bytes,
+                          const std::vector<absl::string_view>& rows) {
+  Header header;
+  auto file_size = InitHeader(feature_bytes, rows.size(), &header);
+  auto field_sizes = FieldSizes(feature_bytes);
+
+  size_t row_stride = 0;
+  for (int col = 0; col < kNumColumns; ++col) {
+    row_stride += field_sizes[col];
+  }
+
+  std::string contents(file_size, '\0');
+  memcpy(&contents[0], &header, sizeof(header));
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const auto& row = rows[i];
+    MG_CHECK(row.size() == row_stride)
+        << "expected " << row_stride << " byte rows, got " << row.size();
+    size_t src = 0;
+    for (int col = 0; col < kNumColumns; ++col) {
+      FillField(row.data() + src, field_sizes[col], i, &header, col,
+                &contents);
+      src += field_sizes[col];
+    }
+  }
+  return contents;
+}
+
+std::string SerializeGameExamples(const FeatureDescriptor& feature_desc,
+                                  const Game& game, bool augment) {
+  int num_syms = augment ? symmetry::kNumSymmetries : 1;
+  uint64_t num_examples = 0;
+  for (const auto& move : game.moves()) {
+    if (move->is_trainable()) {
+      num_examples += num_syms;
+    }
+  }
+
+  auto shape = feature_desc.GetInputShape(1);
+  auto feature_bytes = static_cast<uint32_t>(shape.num_elements());
+
+  Header header;
+  auto file_size = InitHeader(feature_bytes, num_examples, &header);
+  std::string contents(file_size, '\0');
+  memcpy(&contents[0], &header, sizeof(header));
+
+  BoardFeatureBuffer<uint8_t> features_buffer;
+  Tensor<uint8_t> features(shape, features_buffer.data());
+
+  float outcome = game.result();
+  size_t i = 0;
+  for (size_t move_idx = 0; move_idx < game.moves().size(); ++move_idx) {
+    const auto* move = game.moves()[move_idx].get();
+    if (!move->is_trainable()) {
+      continue;
+    }
+
+    ModelInput input;
+    input.position = &move->position;
+    game.GetStoneHistory(move_idx, kMaxPositionHistory, &input.stone_history);
+
+    for (int sym_idx = 0; sym_idx < num_syms; ++sym_idx) {
+      auto sym = static_cast<symmetry::Symmetry>(sym_idx);
+
+      // The feature generators apply the input's symmetry as the features
+      // are written, so augmentation reuses the same vectorized kernels as
+      // inference-time symmetries.
+      input.sym = sym;
+      feature_desc.set_bytes({&input}, &features);
+
+      auto n = static_cast<int32_t>(move->N);
+      auto c = static_cast<uint16_t>(symmetry::ApplySymmetry(sym, move->c));
+      FillField(features.data, feature_bytes, i, &header, kColX, &contents);
+      char pi[SparsePi::kPackedSize];
+      if (sym == symmetry::kIdentity) {
+        move->search_pi->Pack(pi);
+      } else {
+        move->search_pi->ApplySymmetry(sym).Pack(pi);
+      }
+      FillField(pi, sizeof(pi), i, &header, kColPi, &contents);
+      FillField(&outcome, sizeof(outcome), i, &header, kColOutcome, &contents);
+      FillField(&move->Q, sizeof(move->Q), i, &header, kColQ, &contents);
+      FillField(&n, sizeof(n), i, &header, kColN, &contents);
+      FillField(&c, sizeof(c), i, &header, kColC, &contents);
+      i += 1;
+    }
+  }
+  MG_CHECK(i == num_examples);
+
+  return contents;
+}
+
+void WriteGameExamples(const std::string& output_dir,
+                       const std::string& output_name,
+                       const FeatureDescriptor& feature_desc, const Game& game,
+                       bool augment, file::AsyncWriter* writer) {
+  auto output_path = file::JoinPath(output_dir, output_name + ".mgcol");
+  // Serialization is just memcpys, so unlike the TF Example path there's
+  // nothing expensive to defer to the writer pool.
+  writer->WriteFile(std::move(output_path),
+                    SerializeGameExamples(feature_desc, game, augment));
+}
+
+}  // namespace columnar
+}  // namespace minigo
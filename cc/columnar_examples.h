@@ -0,0 +1,125 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_COLUMNAR_EXAMPLES_H_
+#define CC_COLUMNAR_EXAMPLES_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "cc/file/async_writer.h"
+#include "cc/game.h"
+#include "cc/model/features.h"
+
+namespace minigo {
+namespace columnar {
+
+// A columnar, memory-mappable alternative to the TF Example records written
+// by cc/tf_utils.cc. The training input pipeline spends most of its time
+// decoding per-example protos; in this format every example field has a
+// fixed stride and lives in its own contiguous section, so shuffling and
+// training-side reads are raw memory copies with no decode step.
+//
+// A `.mgcol` file is laid out as:
+//
+//   Header            (magic, version, board size, feature tensor size,
+//                      example count and a per-column offset/size index)
+//   x       column    num_examples * feature_bytes      uint8
+//   pi      column    num_examples                      SparsePi (packed)
+//   outcome column    num_examples                      float
+//   q       column    num_examples                      float
+//   n       column    num_examples                      int32
+//   c       column    num_examples                      uint16
+//
+// Each column starts on a 64 byte boundary. The fields carry the same
+// values as the identically named features of the TF Examples built by
+// tf_utils.cc. Files are written uncompressed so consumers can mmap them.
+
+// Column indices, in file and row order.
+enum Column {
+  kColX = 0,
+  kColPi = 1,
+  kColOutcome = 2,
+  kColQ = 3,
+  kColN = 4,
+  kColC = 5,
+  kNumColumns = 6,
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t board_size;
+  // Size in bytes of one example's input feature tensor.
+  uint32_t feature_bytes;
+  uint32_t reserved;
+  uint64_t num_examples;
+  // Byte offset and size of each column, relative to the start of the file.
+  uint64_t column_offset[kNumColumns];
+  uint64_t column_size[kNumColumns];
+};
+
+// Returns the size in bytes of one example's field in each column.
+std::array<size_t, kNumColumns> FieldSizes(uint32_t feature_bytes);
+
+// A validated, zero-copy view of a columnar file. The view points into
+// `contents`, which must outlive it.
+struct FileView {
+  // Parses and validates `contents`, returning false if it isn't a columnar
+  // file for this board size.
+  static bool Parse(absl::string_view contents, FileView* view);
+
+  // Appends example `i`'s fields, concatenated in column order, to `row`.
+  // Rows are the interchange format used when examples flow through
+  // record-oriented code like sample_records; SerializeRows turns them back
+  // into a columnar file.
+  void AppendRow(size_t i, std::string* row) const;
+
+  const Header* header = nullptr;
+  absl::string_view columns[kNumColumns];
+};
+
+// Returns the contents of a columnar file holding the given fixed-stride
+// rows (as built by FileView::AppendRow), scattering each row's fields back
+// into their columns.
+std::string SerializeRows(uint32_t feature_bytes,
+                          const std::vector<absl::string_view>& rows);
+
+// Returns the contents of a columnar file holding one example per trainable
+// move of `game`, equivalent to the TF Examples that
+// tf_utils::WriteGameExamples would write for it.
+// If `augment` is true, each trainable move is written once per board
+// symmetry instead: the input features are generated through the symmetry
+// (which runs the vectorized ApplySymmetryPlanar kernels) and the policy and
+// move coordinates are remapped to match, so the training input pipeline
+// doesn't have to permute feature tensors itself.
+std::string SerializeGameExamples(const FeatureDescriptor& feature_desc,
+                                  const Game& game, bool augment);
+
+// Writes `game`'s examples to `<output_dir>/<output_name>.mgcol` on
+// `writer`'s thread pool. Unlike the TF Example path this doesn't need
+// TensorFlow, so it works in binaries built without --define=tf=1.
+void WriteGameExamples(const std::string& output_dir,
+                       const std::string& output_name,
+                       const FeatureDescriptor& feature_desc, const Game& game,
+                       bool augment, file::AsyncWriter* writer);
+
+}  // namespace columnar
+}  // namespace minigo
+
+#endif  // CC_COLUMNAR_EXAMPLES_H_
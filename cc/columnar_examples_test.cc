@@ -0,0 +1,225 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/columnar_examples.h"
+
+#include <cstring>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "cc/constants.h"
+#include "cc/game.h"
+#include "cc/model/features.h"
+#include "cc/random.h"
+#include "cc/test_utils.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace columnar {
+namespace {
+
+// Plays a short random game with a trainable move at every position.
+Game PlayTestGame(int num_moves) {
+  Game::Options game_options;
+  Game game("black", "white", game_options);
+
+  Random rnd(614944751, 1);
+  TestablePosition position("");
+  for (int i = 0; i < num_moves; ++i) {
+    Coord c;
+    do {
+      c = rnd.UniformInt(0, kN * kN - 1);
+    } while (!position.legal_move(c));
+
+    // Policies are sparse like the real CalculateSearchPi output; every
+    // other move has more visited children than SparsePi stores exactly.
+    int num_visited = 1 + rnd.UniformInt(0, 2 * SparsePi::kMaxEntries - 2);
+    std::array<float, kNumMoves> search_pi{};
+    for (int j = 0; j < num_visited; ++j) {
+      search_pi[rnd.UniformInt(0, kNumMoves - 1)] = rnd();
+    }
+    float sum = 0;
+    for (auto p : search_pi) {
+      sum += p;
+    }
+    for (auto& p : search_pi) {
+      p /= sum;
+    }
+    float q = rnd() * 2 - 1;
+    int n = 1 + rnd.UniformInt(0, 1000);
+    game.AddTrainableMove(position.to_play(), c, position, "", q, n,
+                          search_pi);
+    position.PlayMove(c);
+  }
+  game.SetGameOverBecauseOfPasses(7.5);
+  return game;
+}
+
+TEST(ColumnarExamplesTest, GameRoundTrip) {
+  constexpr int kTestMoves = 16;
+  auto game = PlayTestGame(kTestMoves);
+  auto feature_desc = FeatureDescriptor::Create("agz", "nhwc");
+
+  auto contents = SerializeGameExamples(feature_desc, game, false);
+
+  FileView view;
+  ASSERT_TRUE(FileView::Parse(contents, &view));
+  EXPECT_EQ(kN, view.header->board_size);
+  ASSERT_EQ(kTestMoves, view.header->num_examples);
+
+  auto shape = feature_desc.GetInputShape(1);
+  auto feature_bytes = static_cast<uint32_t>(shape.num_elements());
+  ASSERT_EQ(feature_bytes, view.header->feature_bytes);
+
+  BoardFeatureBuffer<uint8_t> features_buffer;
+  Tensor<uint8_t> features(shape, features_buffer.data());
+
+  for (int i = 0; i < kTestMoves; ++i) {
+    const auto* move = game.moves()[i].get();
+
+    ModelInput input;
+    input.sym = symmetry::kIdentity;
+    input.position = &move->position;
+    game.GetStoneHistory(i, kMaxPositionHistory, &input.stone_history);
+    feature_desc.set_bytes({&input}, &features);
+    EXPECT_EQ(0, memcmp(view.columns[kColX].data() + i * feature_bytes,
+                        features.data, feature_bytes));
+
+    char pi[SparsePi::kPackedSize];
+    move->search_pi->Pack(pi);
+    EXPECT_EQ(0, memcmp(view.columns[kColPi].data() + i * sizeof(pi), pi,
+                        sizeof(pi)));
+
+    float outcome;
+    memcpy(&outcome,
+           view.columns[kColOutcome].data() + i * sizeof(outcome),
+           sizeof(outcome));
+    EXPECT_EQ(game.result(), outcome);
+
+    float q;
+    memcpy(&q, view.columns[kColQ].data() + i * sizeof(q), sizeof(q));
+    EXPECT_EQ(move->Q, q);
+
+    int32_t n;
+    memcpy(&n, view.columns[kColN].data() + i * sizeof(n), sizeof(n));
+    EXPECT_EQ(move->N, n);
+
+    uint16_t c;
+    memcpy(&c, view.columns[kColC].data() + i * sizeof(c), sizeof(c));
+    EXPECT_EQ(move->c, Coord(c));
+  }
+}
+
+TEST(ColumnarExamplesTest, SymmetryAugmentation) {
+  constexpr int kTestMoves = 4;
+  auto game = PlayTestGame(kTestMoves);
+  auto feature_desc = FeatureDescriptor::Create("agz", "nhwc");
+
+  auto contents = SerializeGameExamples(feature_desc, game, true);
+  FileView view;
+  ASSERT_TRUE(FileView::Parse(contents, &view));
+  ASSERT_EQ(kTestMoves * symmetry::kNumSymmetries, view.header->num_examples);
+
+  auto shape = feature_desc.GetInputShape(1);
+  auto feature_bytes = static_cast<uint32_t>(shape.num_elements());
+  BoardFeatureBuffer<uint8_t> features_buffer;
+  Tensor<uint8_t> features(shape, features_buffer.data());
+
+  for (int i = 0; i < kTestMoves; ++i) {
+    const auto* move = game.moves()[i].get();
+    for (int s = 0; s < symmetry::kNumSymmetries; ++s) {
+      auto sym = static_cast<symmetry::Symmetry>(s);
+      size_t row = i * symmetry::kNumSymmetries + s;
+
+      ModelInput input;
+      input.sym = sym;
+      input.position = &move->position;
+      game.GetStoneHistory(i, kMaxPositionHistory, &input.stone_history);
+      feature_desc.set_bytes({&input}, &features);
+      EXPECT_EQ(0, memcmp(view.columns[kColX].data() + row * feature_bytes,
+                          features.data, feature_bytes));
+
+      char pi[SparsePi::kPackedSize];
+      move->search_pi->ApplySymmetry(sym).Pack(pi);
+      EXPECT_EQ(0, memcmp(view.columns[kColPi].data() + row * sizeof(pi), pi,
+                          sizeof(pi)));
+
+      uint16_t c;
+      memcpy(&c, view.columns[kColC].data() + row * sizeof(c), sizeof(c));
+      EXPECT_EQ(symmetry::ApplySymmetry(sym, move->c), Coord(c));
+    }
+  }
+
+  // A remapped policy is the original with its board coordinates permuted;
+  // the pass probability and the dropped-tail remainder are untouched.
+  const auto& pi = *game.moves()[0]->search_pi;
+  std::array<float, kNumMoves> dense, sym_dense;
+  pi.ToDense(&dense);
+  pi.ApplySymmetry(symmetry::kRot90).ToDense(&sym_dense);
+  for (int c = 0; c < kN * kN; ++c) {
+    EXPECT_EQ(dense[c],
+              sym_dense[symmetry::ApplySymmetry(symmetry::kRot90, Coord(c))]);
+  }
+  EXPECT_EQ(dense[Coord::kPass], sym_dense[Coord::kPass]);
+}
+
+TEST(ColumnarExamplesTest, RowsRoundTrip) {
+  auto game = PlayTestGame(9);
+  auto feature_desc = FeatureDescriptor::Create("agz", "nhwc");
+  auto contents = SerializeGameExamples(feature_desc, game, false);
+
+  FileView view;
+  ASSERT_TRUE(FileView::Parse(contents, &view));
+
+  // Gather every example into a row, as sample_records does when reading,
+  // then scatter the rows back into a columnar file as it does when
+  // writing: the result should hold identical columns.
+  std::vector<std::string> rows(view.header->num_examples);
+  std::vector<absl::string_view> row_views;
+  for (uint64_t i = 0; i < view.header->num_examples; ++i) {
+    view.AppendRow(i, &rows[i]);
+    row_views.push_back(rows[i]);
+  }
+
+  auto rewritten =
+      SerializeRows(view.header->feature_bytes, row_views);
+  FileView rewritten_view;
+  ASSERT_TRUE(FileView::Parse(rewritten, &rewritten_view));
+  ASSERT_EQ(view.header->num_examples, rewritten_view.header->num_examples);
+  for (int col = 0; col < kNumColumns; ++col) {
+    EXPECT_EQ(view.columns[col], rewritten_view.columns[col]);
+  }
+}
+
+TEST(ColumnarExamplesTest, RejectsCorruptFiles) {
+  auto game = PlayTestGame(3);
+  auto feature_desc = FeatureDescriptor::Create("agz", "nhwc");
+  auto contents = SerializeGameExamples(feature_desc, game, false);
+
+  FileView view;
+  EXPECT_FALSE(FileView::Parse("", &view));
+  EXPECT_FALSE(FileView::Parse(contents.substr(0, 32), &view));
+
+  auto bad_magic = contents;
+  bad_magic[0] = 'x';
+  EXPECT_FALSE(FileView::Parse(bad_magic, &view));
+
+  // Truncating the file makes a column run off the end.
+  EXPECT_FALSE(FileView::Parse(
+      absl::string_view(contents).substr(0, contents.size() / 2), &view));
+}
+
+}  // namespace
+}  // namespace columnar
+}  // namespace minigo
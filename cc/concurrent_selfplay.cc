@@ -12,36 +12,57 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cmath>
+#include <pthread.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <thread>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_replace.h"
 #include "absl/strings/str_split.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
-#include "cc/async/poll_thread.h"
+#include "cc/async/timer_service.h"
 #include "cc/async/sharded_executor.h"
 #include "cc/async/thread.h"
+#include "cc/async/lock_free_queue.h"
 #include "cc/async/thread_safe_queue.h"
+#include "cc/file/async_writer.h"
 #include "cc/file/directory_watcher.h"
 #include "cc/file/path.h"
 #include "cc/file/utils.h"
+#include "cc/algorithm.h"
+#include "cc/columnar_examples.h"
+#include "cc/coordinator_client.h"
 #include "cc/game.h"
 #include "cc/game_utils.h"
 #include "cc/init.h"
+#include "cc/latency_histogram.h"
 #include "cc/logging.h"
 #include "cc/mcts_tree.h"
+#include "cc/metrics.h"
+#include "cc/metrics_server.h"
 #include "cc/model/inference_cache.h"
 #include "cc/model/loader.h"
+#include "cc/model/model_cache.h"
 #include "cc/platform/utils.h"
 #include "cc/random.h"
 #include "cc/tf_utils.h"
+#include "cc/trace_sampler.h"
 #include "cc/wtf_saver.h"
 #include "cc/zobrist.h"
 #include "gflags/gflags.h"
@@ -53,28 +74,69 @@
 //    `MctsTree` and a `Game`. The `SelfplayGame` is responsible for selecting
 //    leaves in the MCTS tree to run inference on, propagating inference
 //    results back up the tree, and playing moves.
-//  - `SelfplayThread` : owns multiple `SelfplayGame` instances and uses them
-//    to play games concurrently. See SelfplayThread::Run for the sequence of
-//    operations performed when playing games. Tree search is carried out in
-//    batches on multiple threads in parallel.
+//  - `SelfplayThread` : plays multiple `SelfplayGame` instances concurrently.
+//    Live games are kept in a pool shared between all threads: each thread
+//    checks out a batch of games for one iteration of tree search and returns
+//    the games that haven't finished afterwards, so a thread whose games
+//    finish early picks up tree search for any other live game instead of
+//    idling. See SelfplayThread::Run for the sequence of operations performed
+//    when playing games. Tree search is carried out in batches on multiple
+//    threads in parallel.
 //  - `Selfplayer` : owns multiple `SelfplayThread` instances, which lets the
 //    binary perform tree search on multiple threads.
 //  - `OutputThread` : responsible for writing SGF & training examples to
 //    storage. After a game finished, its `SelfplayThread` hands the
-//    `SelfplayGame` instance back to the `Selfplayer`, which pushes it onto
-//    an output queue for `OutputThread` to consume.
+//    `SelfplayGame` instance back to the `Selfplayer`, which extracts the
+//    game's output record and pushes it onto the consuming `OutputThread`'s
+//    queue (games are hashed across `--output_threads` workers); the
+//    `SelfplayGame` itself (most importantly its `MctsTree`) is freed
+//    immediately.
 
 // Inference flags.
 DEFINE_string(device, "",
               "Optional ID of the device to run inference on. For TPUs, pass "
               "the gRPC address.");
 DEFINE_string(model, "", "Path to a minigo model.");
+DEFINE_string(fast_model, "",
+              "Optional path to a smaller model used to service the readouts "
+              "of 'fast' moves when fastplay_frequency > 0. Fast moves are "
+              "never used as training targets, so the bulk of a game's "
+              "readouts can run on a distilled net that's much cheaper than "
+              "the full model, which stays reserved for the full-readout "
+              "moves that produce training targets. The fast model's outputs "
+              "are never merged into the inference cache.");
+DEFINE_string(model_cache_dir, "",
+              "Optional directory used as a host-local cache of model files, "
+              "shared by all minigo processes on the host: the model is "
+              "downloaded once per host and its weights are mapped read-only "
+              "into each process.");
 DEFINE_int32(cache_size_mb, 0, "Size of the inference cache in MB.");
 DEFINE_int32(cache_shards, 8,
              "Number of ways to shard the inference cache. The cache uses "
              "is locked on a per-shard basis, so more shards means less "
              "contention but each shard is smaller. The number of shards "
-             "is clamped such that it's always <= parallel_games.");
+             "is clamped such that it's always <= parallel_games. Ignored "
+             "if lock_free_cache is true.");
+DEFINE_bool(lock_free_cache, false,
+            "Use the lock-free inference cache instead of the mutex-sharded "
+            "one. Reduces lock contention when running large numbers of "
+            "selfplay threads at the cost of approximate (rather than exact) "
+            "LRU eviction.");
+DEFINE_string(cache_file, "",
+              "Optional path to a memory-mapped inference cache file that "
+              "persists across restarts. The file is keyed to the model: if "
+              "it was written for a different model its contents are "
+              "discarded. The in-memory cache configured by cache_size_mb "
+              "acts as a first level over the file.");
+DEFINE_int32(cache_file_size_mb, 1024,
+             "Size of the memory-mapped inference cache file in MB. Only "
+             "used if cache_file is set.");
+DEFINE_int32(num_prefetch, 0,
+             "Number of likely child positions per game to speculatively "
+             "evaluate after each tree search iteration, storing the results "
+             "in the inference cache so that future iterations hit the cache "
+             "instead of waiting on inference. Requires an inference cache. "
+             "0 disables prefetching.");
 
 // Tree search flags.
 DEFINE_int32(num_readouts, 104,
@@ -89,6 +151,16 @@ DEFINE_int32(fastplay_readouts, 20,
              "'fastplay_frequency' should be nonzero.");
 DEFINE_int32(virtual_losses, 8,
              "Number of virtual losses when running tree search.");
+DEFINE_bool(adaptive_readouts, false,
+            "If true, a move's tree search may stop before 'num_readouts' "
+            "when more reads can no longer change the outcome: either the "
+            "best child's visit lead over the runner-up exceeds the "
+            "remaining readout budget, or the root's absolute Q exceeds "
+            "'certainty_q'. The saved readouts are banked and reinvested in "
+            "later moves whose evaluation is close.");
+DEFINE_double(certainty_q, 0.95,
+              "Absolute root Q above which a position is considered decided "
+              "for the purposes of 'adaptive_readouts'.");
 DEFINE_double(dirichlet_alpha, 0.03, "Alpha value for Dirichlet noise.");
 DEFINE_double(noise_mix, 0.25, "The amount of noise to mix into the root.");
 DEFINE_double(value_init_penalty, 2.0,
@@ -111,6 +183,17 @@ DEFINE_int32(restrict_pass_alive_play_threshold, 4,
              "restrict_pass_alive_play_threshold pass moves in a row, playing "
              "moves in pass-alive territory of either player is disallowed.");
 
+// Memory flags.
+DEFINE_int32(memory_budget_mb, 0,
+             "If non-zero, a soft budget in MB shared by the search trees "
+             "and the in-memory inference cache. While usage is over budget "
+             "a periodic governor frees recycled trees, shrinks the cache "
+             "(leaving the trees their current footprint) and compacts live "
+             "trees down to their active search subtrees, in that order; the "
+             "cache grows back towards its configured capacity when games "
+             "finish and memory frees up. The lock-free and memory-mapped "
+             "caches have fixed-size entry tables and are never resized.");
+
 // Threading flags.
 DEFINE_int32(selfplay_threads, 3,
              "Number of threads to run batches of selfplay games on.");
@@ -128,6 +211,18 @@ DEFINE_uint64(seed, 0,
               "Random seed. Use default value of 0 to use a time-based seed. "
               "This seed is used to control the moves played, not whether a "
               "game has resignation disabled or is a holdout.");
+DEFINE_bool(deterministic, false,
+            "Play the exact same games on every run with the same flags and "
+            "--seed, for bisecting performance regressions: each game's "
+            "random draws come from streams keyed by (game id, move number), "
+            "game ids are pinned to selfplay threads, and each game uses a "
+            "private inference cache instead of the shared one (inference "
+            "results shared between games would make each game's search "
+            "depend on thread timing). Requires a non-zero --seed and a "
+            "fixed --model; incompatible with --coordinator, --num_prefetch "
+            "and --cache_file. Game records are identical across runs; how "
+            "they're grouped into output shards still depends on completion "
+            "order. Throughput is lower than normal mode.");
 DEFINE_double(min_resign_threshold, -1.0,
               "Each game's resign threshold is picked randomly from the range "
               "[min_resign_threshold, max_resign_threshold)");
@@ -145,7 +240,35 @@ DEFINE_bool(run_forever, false,
 DEFINE_string(abort_file, "",
               "If non-empty, specifies a path to a file whose presence is "
               "checked for periodically when run_forever=true. If the file "
-              "exists the selfplay process will abort immediately.");
+              "exists the selfplay process will abort immediately. Prefer "
+              "the push-based controls where possible: SIGTERM/SIGUSR1 "
+              "locally, or drain/abort commands from a coordinator.");
+DEFINE_string(checkpoint_file, "",
+              "If non-empty, in-flight games are periodically checkpointed "
+              "to this local file and resumed from it at startup, so that "
+              "preempted workers restart games mid-way through instead of "
+              "from move zero.");
+DEFINE_int32(checkpoint_interval_secs, 60,
+             "Interval in seconds between checkpoints of in-flight games. "
+             "Only used if checkpoint_file is set.");
+DEFINE_int32(drain_deadline_secs, 0,
+             "If > 0 and checkpoint_file is set, a drain (SIGTERM/SIGUSR1 "
+             "or a coordinator drain command) that hasn't finished after "
+             "this many seconds checkpoints the remaining in-flight games "
+             "and exits instead of playing them out. Set this a few seconds "
+             "below the preemption warning of the VMs the worker runs on so "
+             "that games too long to finish are resumed by the replacement "
+             "worker rather than lost.");
+
+// Coordination flags.
+DEFINE_string(coordinator, "",
+              "Optional \"host:port\" address of a selfplay coordinator. "
+              "When set, the worker registers with the coordinator on "
+              "startup, takes its model and game quota from the "
+              "coordinator's assignments instead of --model and --num_games, "
+              "and streams a record of each completed game back over the "
+              "connection. The worker runs until the coordinator tells it "
+              "to shut down.");
 
 // Output flags.
 DEFINE_double(holdout_pct, 0.03,
@@ -165,11 +288,84 @@ DEFINE_string(sgf_dir, "",
               "substring \"$MODEL\", the name of the last models used for "
               "inference when playing a game will be substituded in the "
               "path.");
+DEFINE_bool(dedup_examples, false,
+            "If true, write at most one training example per position: each "
+            "output thread remembers the stone hashes of the positions it "
+            "has written examples for and drops repeats (first seen wins). "
+            "Selfplay produces vast numbers of identical early-game "
+            "positions every generation; deduping them shrinks the training "
+            "data and stops training from being biased towards openings. "
+            "Holdout games are never deduped. The dedup rate is reported by "
+            "the selfplay_examples_written and selfplay_examples_deduped "
+            "counters.");
+DEFINE_int32(sgf_sample_period, 1,
+             "Write the SGF for 1-in-N games. Resign-threshold outliers "
+             "(games where the eventual winner's eval dipped below the "
+             "resign threshold) are always written regardless of sampling, "
+             "since they're what resign thresholds are calibrated from. "
+             "<= 1 writes every game.");
 DEFINE_string(wtf_trace, "/tmp/minigo.wtf-trace",
               "Output path for WTF traces.");
+DEFINE_int32(trace_sample_period, 1,
+             "Trace 1 in every N selfplay iterations (and parallel search "
+             "batches) in the WTF timeline. 1 traces everything; larger "
+             "values keep continuous timeline visibility in production at a "
+             "fraction of the tracing overhead.");
 DEFINE_bool(verbose, true, "Whether to log progress.");
+DEFINE_bool(async_logging, true,
+            "Format log lines into a lock-free ring buffer and write them to "
+            "stderr from a background thread, so that logging doesn't stall "
+            "the selfplay threads.");
+DEFINE_int32(stats_interval_secs, 0,
+             "If > 0, log each selfplay thread's per-phase latency "
+             "histograms at this interval. The histograms are always logged "
+             "when a thread exits.");
+DEFINE_int32(metrics_interval_secs, 0,
+             "If > 0, dump the always-on performance counters (see "
+             "cc/metrics.h) as a machine-readable log line at this interval.");
+DEFINE_int32(metrics_port, 0,
+             "If > 0, serve the always-on performance counters over HTTP on "
+             "this port in the Prometheus text format, so fleet monitoring "
+             "can scrape the worker directly instead of parsing its logs.");
 DEFINE_int32(output_threads, 1,
-             "Number of threads write training examples on.");
+             "Number of threads write training examples on. Each thread "
+             "pulls from its own queue of completed games, hashed by game "
+             "id, and writes its own output shards.");
+DEFINE_string(example_format, "tfrecord",
+              "Format to write training examples in: \"tfrecord\" (zlib "
+              "compressed TFRecords of TF Example protos) or \"columnar\" "
+              "(uncompressed, mmap-able .mgcol files with one contiguous "
+              "fixed-stride section per feature, see "
+              "cc/columnar_examples.h). Columnar examples skip the proto "
+              "decode in the training input pipeline; they're read and "
+              "shuffled by sample_records with a .mgcol destination.");
+DEFINE_bool(augment_examples, false,
+            "Write each training example once per board symmetry, with the "
+            "features, policy and move coordinate remapped to match, instead "
+            "of leaving the 8-fold symmetry augmentation to the training "
+            "input pipeline. Requires --example_format=columnar. Holdout "
+            "games are never augmented.");
+DEFINE_int32(output_shard_mb, 0,
+             "If > 0, append many games' training examples into large "
+             "rotating TFRecord shards of roughly this many megabytes "
+             "(compressed) instead of writing one file per game. Large "
+             "shards cut the output object count by ~100x, which speeds up "
+             "bucket listing and training input reads at fleet scale. "
+             "Shards also rotate after --output_shard_secs, or when the "
+             "output directory changes (new hour or new model).");
+DEFINE_int32(output_shard_secs, 900,
+             "Maximum age of an output shard before it's rotated. Only "
+             "used when --output_shard_mb > 0. Rotation is checked as "
+             "games are written, so an idle worker may hold a shard "
+             "slightly longer.");
+DEFINE_int32(benchmark_secs, 0,
+             "If > 0, run in benchmark mode: after warming up for "
+             "benchmark_secs/2, measure for benchmark_secs, log steady-state "
+             "games/hour, leaves/second and average inference batch "
+             "occupancy, then exit without waiting for in-flight games to "
+             "finish. Use with --run_forever=true and a \"fake:...\" model "
+             "to measure scheduling changes on machines without an "
+             "accelerator.");
 
 namespace minigo {
 namespace {
@@ -184,6 +380,135 @@ std::string GetOutputDir(absl::Time now, const std::string& model_name,
   return file::JoinPath(processed_root_dir, sub_dirs);
 }
 
+// Absolute root Q below which a position is considered close enough to be
+// worth reinvesting readouts saved by adaptive_readouts.
+constexpr float kCloseQ = 0.2f;
+
+// Always-on counters for fleet dashboards (see cc/metrics.h), dumped as a
+// machine-readable log line by Selfplayer::Run when --metrics_interval_secs
+// is set and served over HTTP when --metrics_port is set.
+Counter nodes_selected_counter("selfplay_nodes_selected");
+Counter leaves_queued_counter("selfplay_leaves_queued");
+Counter cache_hits_counter("selfplay_cache_hits");
+Counter leaf_collisions_counter("selfplay_leaf_collisions");
+Counter games_completed_counter("selfplay_games_completed");
+Counter examples_written_counter("selfplay_examples_written");
+Counter examples_deduped_counter("selfplay_examples_deduped");
+Counter inference_batches_counter("selfplay_inference_batches");
+Counter inferences_counter("selfplay_inferences");
+Gauge games_in_flight_gauge("selfplay_games_in_flight");
+
+// Huge page backing for the tree arenas and feature buffers (see
+// AllocLargePages). Refreshed whenever the metrics are dumped, so dTLB
+// tuning can be verified from the same scrape.
+Gauge huge_bytes_requested_gauge("memory_huge_bytes_requested");
+Gauge huge_bytes_backed_gauge("memory_huge_bytes_backed");
+
+void UpdateLargePageGauges() {
+  auto stats = GetLargePageStats();
+  huge_bytes_requested_gauge.Set(static_cast<int64_t>(stats.requested_bytes));
+  huge_bytes_backed_gauge.Set(static_cast<int64_t>(stats.anon_huge_bytes));
+}
+
+// Implements --benchmark_secs: measures steady-state selfplay throughput
+// from the always-on counters, logs it and exits the process. Called on the
+// main thread once the selfplay threads are running.
+void RunThroughputBenchmark() {
+  MG_LOG(INFO) << "Benchmark: warming up for " << FLAGS_benchmark_secs / 2
+               << " seconds";
+  absl::SleepFor(absl::Seconds(FLAGS_benchmark_secs) / 2);
+
+  auto games_before = games_completed_counter.Sum();
+  auto leaves_before = leaves_queued_counter.Sum();
+  auto batches_before = inference_batches_counter.Sum();
+  auto inferences_before = inferences_counter.Sum();
+  auto start = absl::Now();
+
+  MG_LOG(INFO) << "Benchmark: measuring for " << FLAGS_benchmark_secs
+               << " seconds";
+  absl::SleepFor(absl::Seconds(FLAGS_benchmark_secs));
+
+  auto secs = absl::ToDoubleSeconds(absl::Now() - start);
+  auto games = games_completed_counter.Sum() - games_before;
+  auto leaves = leaves_queued_counter.Sum() - leaves_before;
+  auto batches = inference_batches_counter.Sum() - batches_before;
+  auto inferences = inferences_counter.Sum() - inferences_before;
+
+  auto max_batch_size =
+      FLAGS_concurrent_games_per_thread * FLAGS_virtual_losses;
+  auto avg_batch_size =
+      batches > 0 ? static_cast<double>(inferences) / batches : 0;
+
+  MG_LOG(INFO) << "Benchmark: games/hour = " << games * 3600 / secs;
+  MG_LOG(INFO) << "Benchmark: leaves/second = " << leaves / secs;
+  MG_LOG(INFO) << "Benchmark: batch occupancy = " << avg_batch_size << " / "
+               << max_batch_size << " ("
+               << 100 * avg_batch_size / max_batch_size << "%)";
+  MG_LOG(INFO) << DumpMetricsLine();
+
+  // In-flight games aren't worth finishing in benchmark mode; flush the
+  // logs and exit.
+  DisableAsyncLogging();
+  std::exit(0);
+}
+
+// Game checkpoint serialization helpers. Checkpoints only ever live on the
+// local disk of the host that wrote them, so fields are encoded in the
+// host's native byte order.
+constexpr uint32_t kCheckpointMagic = 0x4d47434b;
+// Version 2 replaced the dense float search_pi with SparsePi's packed
+// encoding.
+constexpr uint32_t kCheckpointVersion = 2;
+
+template <typename T>
+void AppendPod(const T& src, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&src), sizeof(src));
+}
+
+void AppendString(const std::string& src, std::string* dst) {
+  AppendPod(static_cast<uint32_t>(src.size()), dst);
+  dst->append(src);
+}
+
+bool ReadBytes(const char** src, const char* end, void* dst, size_t len) {
+  if (static_cast<size_t>(end - *src) < len) {
+    return false;
+  }
+  memcpy(dst, *src, len);
+  *src += len;
+  return true;
+}
+
+template <typename T>
+bool ReadPod(const char** src, const char* end, T* dst) {
+  return ReadBytes(src, end, dst, sizeof(*dst));
+}
+
+bool ReadString(const char** src, const char* end, std::string* dst) {
+  uint32_t len;
+  if (!ReadPod(src, end, &len) ||
+      static_cast<size_t>(end - *src) < static_cast<size_t>(len)) {
+    return false;
+  }
+  dst->assign(*src, len);
+  *src += len;
+  return true;
+}
+
+// Deterministic mode RNG keying (see --deterministic). Each game derives a
+// seed from --seed and its id, and draws from fixed streams of that seed:
+// stream 1 for the game's randomized options (resign threshold, holdout),
+// stream 2 for per-game constants and stream 3+n for move n. Keying every
+// move to its own stream means a move's draws don't depend on how many
+// draws earlier moves made, which also lets a game resumed from a
+// checkpoint pick its draws back up mid-game.
+uint64_t DeterministicGameSeed(int game_id) {
+  return FLAGS_seed ^ (static_cast<uint64_t>(game_id) * Random::kLargePrime);
+}
+constexpr int kDeterministicOptionsStream = 1;
+constexpr int kDeterministicConstantsStream = 2;
+constexpr int kDeterministicMoveStreamBase = 3;
+
 // Information required to run a single inference.
 struct Inference {
   InferenceCache::Key cache_key;
@@ -192,6 +517,22 @@ struct Inference {
   ModelOutput output;
 };
 
+// A speculative inference request for a position that tree search is likely
+// to reach soon. Unlike `Inference`, the result is only merged into the
+// inference cache and never incorporated into a game's tree, so the request
+// owns copies of the positions it needs: the game it came from may finish
+// (and free its tree) before the inference completes.
+struct PrefetchInference {
+  InferenceCache::Key cache_key;
+  symmetry::Symmetry canonical_sym;
+  // Copy of the leaf's position, plus packed snapshots of the stones of the
+  // positions that led up to it.
+  Position position{Color::kBlack};
+  inline_vector<StoneSnapshot, kMaxPositionHistory> snapshots;
+  ModelInput input;
+  ModelOutput output;
+};
+
 // Holds all the state for a single selfplay game.
 // Each `SelfplayThread` plays multiple games in parallel, calling
 // `SelectLeaves`, `ProcessInferences` and `MaybePlayMove` sequentially.
@@ -211,6 +552,15 @@ class SelfplayGame {
     // Frequency that a move should be a "fast" play.
     float fastplay_frequency;
 
+    // If true, a move's search may stop before its readout budget is spent
+    // when more reads can no longer change the outcome. The saved readouts
+    // are reinvested in later moves whose evaluation is close.
+    bool adaptive_readouts;
+
+    // Absolute root Q above which a position is considered decided when
+    // `adaptive_readouts` is enabled.
+    float certainty_q;
+
     // Alpha value for Dirichlet noise.
     float dirichlet_alpha;
 
@@ -227,7 +577,7 @@ class SelfplayGame {
     bool target_pruning;
 
     // If true, perform verbose logging. Usually restricted to just the first
-    // `SelfplayGame` of the first `SelfplayThread`.
+    // game started.
     bool verbose;
 
     // If false, pass is only read and played if there are no other legal
@@ -237,6 +587,15 @@ class SelfplayGame {
     // Disallow playing in pass-alive territory once the number of passes played
     // during a game is at least `restrict_pass_alive_play_threshold`.
     int restrict_pass_alive_play_threshold;
+
+    // If true, the game's random draws come from streams keyed by
+    // (game id, move number) and the game caches inference results privately,
+    // so it plays identically on every run (see --deterministic).
+    bool deterministic = false;
+
+    // Capacity of the private inference cache in deterministic mode, in
+    // entries. Zero means the game runs without a cache.
+    size_t private_cache_capacity = 0;
   };
 
   // Stats about the nodes visited during SelectLeaves.
@@ -246,11 +605,18 @@ class SelfplayGame {
     int num_cache_hits = 0;
     int num_game_over_leaves = 0;
 
+    // Number of selected leaves that already had virtual loss applied, i.e.
+    // the search re-selected a leaf whose inference from earlier in the same
+    // pass hasn't come back yet. Each collision queues a redundant
+    // inference.
+    int num_collisions = 0;
+
     SelectLeavesStats& operator+=(const SelectLeavesStats& other) {
       num_leaves_queued += other.num_leaves_queued;
       num_nodes_selected += other.num_nodes_selected;
       num_cache_hits += other.num_cache_hits;
       num_game_over_leaves += other.num_game_over_leaves;
+      num_collisions += other.num_collisions;
       return *this;
     }
   };
@@ -258,19 +624,67 @@ class SelfplayGame {
   SelfplayGame(int game_id, const Options& options, std::unique_ptr<Game> game,
                std::unique_ptr<MctsTree> tree);
 
+  // Reinitializes a recycled SelfplayGame for a new game. The existing tree
+  // is reset rather than reallocated, so the new game's search reuses the
+  // arena memory of the game this instance played previously.
+  void Reset(int game_id, const Options& options, std::unique_ptr<Game> game);
+
   int game_id() const { return game_id_; }
   Game* game() { return game_.get(); }
   const Game* game() const { return game_.get(); }
   const MctsTree* tree() const { return tree_.get(); }
+
+  // Current size in bytes of the tree's arena.
+  size_t tree_bytes() const { return tree_->allocated_bytes(); }
+
+  // Frees all tree memory outside the current search subtree (see
+  // MctsTree::Compact). Only safe while the game isn't checked out by a
+  // SelfplayThread.
+  void CompactTree() { tree_->Compact(); }
+
   absl::Duration duration() const { return duration_; }
   const Options& options() const { return options_; }
+
+  // Number of reads the current move's search still wants. Games with lots
+  // of remaining readouts (fresh trees) are the ones that can make use of
+  // other games' unused leaf budget.
+  int remaining_readouts() const {
+    return std::max(0, target_readouts_ - tree_->root()->N());
+  }
+
   const std::vector<std::string>& models_used() const { return models_used_; }
 
+  // True if the current move's search is a low-readout "fast" move (see
+  // Options::fastplay_frequency). Fast moves' inferences may be routed to a
+  // cheaper model (see --fast_model).
+  bool fastplay() const { return fastplay_; }
+
+  // The game's private inference cache in deterministic mode, or null when
+  // the game should use the shared cache.
+  InferenceCache* private_cache() const { return private_cache_.get(); }
+
   // Selects leaves to perform inference on.
   // Returns the number of leaves selected. It is possible that no leaves will
   // be selected if all desired leaves are already in the inference cache.
+  // `extra_budget` is a shared pool of leaf selections on top of the game's
+  // own budget (leaf_budget_, at most `num_virtual_losses`): a game that
+  // stops short of its nominal allotment (cache hits, readout target
+  // reached, game over, shrunk budget) donates the unused part to the pool,
+  // and a game that exhausts its allotment keeps selecting while it can draw
+  // from the pool. May be null, in which case the game's budget is a hard
+  // cap as before.
   SelectLeavesStats SelectLeaves(InferenceCache* cache,
-                                 std::vector<Inference>* inferences);
+                                 std::vector<Inference>* inferences,
+                                 std::atomic<int>* extra_budget);
+
+  // Selects up to `num_prefetch` of the root's children by action score that
+  // haven't been evaluated yet and appends speculative inference requests
+  // for them to `prefetches`. The next SelectLeaves pass will most likely
+  // descend through these children, so having their results in the cache by
+  // then turns inference waits into cache hits.
+  // Returns the number of requests queued.
+  int SelectPrefetchLeaves(int num_prefetch, InferenceCache* cache,
+                           std::vector<PrefetchInference>* prefetches);
 
   // Processes the inferences selected by `SelectedLeaves` that were evaluated
   // by the SelfplayThread.
@@ -283,10 +697,39 @@ class SelfplayGame {
   // can play a move.
   bool MaybePlayMove();
 
+  // Restores the state that isn't derivable from the `Game` when resuming
+  // from a checkpoint: the models used so far and the consecutive pass
+  // counters, which are rebuilt from the move history.
+  void RestoreCheckpointState(std::vector<std::string> models_used);
+
+  // Moves the finished game's output record out of the SelfplayGame.
+  // Must only be called once, after the game is over.
+  std::unique_ptr<Game> ReleaseGame() {
+    MG_CHECK(game_ != nullptr && game_->game_over());
+    return std::move(game_);
+  }
+
  private:
+  // Deterministic mode: re-keys the game's RNG to the stream for the move
+  // about to be searched, so the fastplay choice, Dirichlet noise and
+  // soft-pick draws for move n are the same on every run regardless of
+  // thread timing or how many draws earlier moves made.
+  void ReseedForMove();
+
+  // Deterministic mode setup shared by the constructor and Reset: keys the
+  // RNG and inference symmetry to the game id and creates the private
+  // inference cache.
+  void InitDeterministic();
+
   // Randomly choose whether or not to fast play.
   bool ShouldFastplay();
 
+  // Returns true if the current move's search can stop before
+  // `target_readouts_` because more reads can no longer change the outcome:
+  // either the best child's visit lead over the runner-up exceeds the
+  // remaining readout budget, or the root's Q is past the certainty bound.
+  bool CanTerminateSearchEarly() const;
+
   // Returns true if the predicted win rate is below `resign_threshold`.
   bool ShouldResign() const;
 
@@ -305,16 +748,21 @@ class SelfplayGame {
   bool MaybeQueueInference(MctsNode* leaf, InferenceCache* cache,
                            std::vector<Inference>* inferences);
 
-  const Options options_;
+  // These members would be const if SelfplayGames weren't recycled; they are
+  // only written by the constructor and Reset.
+  Options options_;
   int target_readouts_;
   std::unique_ptr<Game> game_;
   std::unique_ptr<MctsTree> tree_;
   const bool use_ansi_colors_;
-  const absl::Time start_time_;
+  absl::Time start_time_;
   absl::Duration duration_;
   std::vector<std::string> models_used_;
   Random rnd_;
-  const uint64_t inference_symmetry_mix_;
+  uint64_t inference_symmetry_mix_;
+
+  // Only created in deterministic mode (see private_cache()).
+  std::unique_ptr<InferenceCache> private_cache_;
 
   // We need to wait until the root is expanded by the first call to
   // SelectLeaves in the game before injecting noise.
@@ -332,7 +780,76 @@ class SelfplayGame {
   // move is played.
   int num_consecutive_passes_[2] = {0, 0};
 
-  const int game_id_;
+  // Readouts saved by terminating searches early, available to top up the
+  // budget of later moves whose evaluation is close.
+  int saved_readouts_ = 0;
+
+  // Adaptive per-pass leaf selection budget, in [2, num_virtual_losses].
+  // Shrunk when the current move's selections keep colliding with leaves
+  // pending inference and grown back when they don't (see MaybePlayMove).
+  int leaf_budget_ = 0;
+
+  // Leaf selections and collisions observed so far for the current move's
+  // search, used to retune leaf_budget_ when the move is played.
+  int move_leaf_selections_ = 0;
+  int move_leaf_collisions_ = 0;
+
+  // Scratch space for MctsTree::IncorporateResultsBatch.
+  std::vector<const Inference*> sorted_inference_ptrs_;
+  std::vector<MctsNode*> leaf_ptrs_;
+  std::vector<const ModelOutput*> output_ptrs_;
+
+  int game_id_;
+};
+
+// Serializes the state needed to resume `selfplay_game` after a restart: the
+// game options, the moves played so far and the models used. The tree is not
+// serialized; resuming replays the moves and rebuilds root statistics with
+// fresh reads. The game's RNG is reseeded on resume because `Random` doesn't
+// expose its internal state.
+void AppendGameCheckpoint(const SelfplayGame& selfplay_game,
+                          std::string* dst) {
+  const auto* game = selfplay_game.game();
+  AppendPod(selfplay_game.game_id(), dst);
+  AppendPod(static_cast<uint8_t>(selfplay_game.options().is_holdout), dst);
+  AppendPod(game->options().resign_threshold, dst);
+  AppendPod(static_cast<uint8_t>(game->options().resign_enabled), dst);
+  AppendPod(game->options().komi, dst);
+  AppendString(game->black_name(), dst);
+
+  AppendPod(static_cast<uint32_t>(selfplay_game.models_used().size()), dst);
+  for (const auto& model : selfplay_game.models_used()) {
+    AppendString(model, dst);
+  }
+
+  AppendPod(static_cast<uint32_t>(game->moves().size()), dst);
+  for (const auto& move : game->moves()) {
+    AppendPod(static_cast<uint16_t>(move->c), dst);
+    AppendPod(static_cast<uint8_t>(move->color == Color::kBlack ? 0 : 1), dst);
+    AppendPod(move->Q, dst);
+    AppendPod(move->N, dst);
+    AppendString(move->comment, dst);
+    AppendPod(static_cast<uint8_t>(move->is_trainable()), dst);
+    if (move->is_trainable()) {
+      char packed[SparsePi::kPackedSize];
+      move->search_pi->Pack(packed);
+      dst->append(packed, sizeof(packed));
+    }
+  }
+}
+
+// Everything OutputThread needs to write a finished game. Extracted from
+// the SelfplayGame in Selfplayer::EndGame: the Game is already a compact,
+// move-indexed record of the training data (per-move search_pi, values and
+// positions), so handing it off lets the rest of the SelfplayGame — most
+// importantly its MctsTree — be destroyed as soon as the game finishes
+// instead of living on the output queue until its outputs have been written.
+struct GameOutput {
+  int game_id;
+  bool is_holdout;
+  absl::Duration duration;
+  std::vector<std::string> models_used;
+  std::unique_ptr<Game> game;
 };
 
 // The main application class.
@@ -347,7 +864,29 @@ class Selfplayer {
 
   void Run() LOCKS_EXCLUDED(&mutex_);
 
-  std::unique_ptr<SelfplayGame> StartNewGame(bool verbose)
+  std::unique_ptr<SelfplayGame> StartNewGame(int thread_id)
+      LOCKS_EXCLUDED(&mutex_);
+
+  // Checks out up to `max_games` games for one iteration of tree search:
+  // live games returned to the shared pool by other threads are taken first
+  // and any remaining slots are topped up with new games. If `block` is
+  // true, blocks while the pool is empty but other threads still hold live
+  // games that they may return, and only returns false once all games have
+  // finished and there are no new games left to start. If `block` is false,
+  // returns false as soon as no games are immediately available.
+  // Pooled games remember which thread last ran them, and CheckOutGames
+  // prefers giving a thread its own games back: their trees are likely
+  // still warm in that core's cache and were first-touched on its NUMA
+  // node.
+  bool CheckOutGames(int thread_id, size_t max_games,
+                     std::vector<std::unique_ptr<SelfplayGame>>* games,
+                     bool block) LOCKS_EXCLUDED(&mutex_);
+
+  // Returns a thread's still-live games to the shared pool after an
+  // iteration of tree search. Null entries (games that just finished and
+  // were handed to EndGame) are skipped. Clears `games`.
+  void ReturnGames(int thread_id,
+                   std::vector<std::unique_ptr<SelfplayGame>>* games)
       LOCKS_EXCLUDED(&mutex_);
 
   void EndGame(std::unique_ptr<SelfplayGame> selfplay_game)
@@ -360,6 +899,12 @@ class Selfplayer {
   // CPU tree search and GPU inference.
   void ExecuteSharded(std::function<void(int, int)> fn);
 
+  // Runs `item_fn(item, shard_idx)` for every item in [0, num_items) on the
+  // shared executor, with work stealing between shards (see
+  // ShardedExecutor::ExecuteBalanced).
+  void ExecuteBalanced(int num_items,
+                       const std::function<void(int, int)>& item_fn);
+
   // Grabs a model from a pool. If `selfplay_threads > parallel_inference`,
   // `AcquireModel` may block if a model isn't immediately available.
   std::unique_ptr<Model> AcquireModel();
@@ -367,29 +912,182 @@ class Selfplayer {
   // Gives a previously acquired model back to the pool.
   void ReleaseModel(std::unique_ptr<Model> model);
 
+  // Grabs a model from the fast-model pool, or returns null if --fast_model
+  // isn't set. Like AcquireModel, may block if all instances are in use.
+  std::unique_ptr<Model> AcquireFastModel();
+
+  // Gives a previously acquired fast model back to its pool.
+  void ReleaseFastModel(std::unique_ptr<Model> model);
+
  private:
   void ParseFlags() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
-  FeatureDescriptor InitializeModels();
+  FeatureDescriptor InitializeModels(const std::string& model_path);
+
+  // Loads and warms up `parallel_inference` instances of the model at
+  // `path`. Shared by CreateModels and the fast-model pool setup.
+  std::vector<std::unique_ptr<Model>> BuildModels(const std::string& path);
+
+  // Loads and warms up `parallel_inference` instances of the model at `path`,
+  // then swaps them into the model pool. Runs on the DirectoryWatcher's poll
+  // thread when following a model pattern, so the current generation keeps
+  // serving while the next one loads.
   void CreateModels(const std::string& path);
   void CheckAbortFile();
 
+  // Periodic memory governor (see FLAGS_memory_budget_mb): sums the trees'
+  // arena sizes and the in-memory inference cache's footprint, and frees
+  // recycled trees, shrinks the cache and compacts live trees (in that
+  // order) while the total is over budget. Live trees are compacted as
+  // threads return them to the pool, the only point at which they're
+  // quiescent.
+  void CheckMemoryBudget() LOCKS_EXCLUDED(&mutex_);
+
+  // Periodic checkpointing of in-flight games (see FLAGS_checkpoint_file).
+  // A checkpoint window opens when the checkpoint interval expires; games
+  // are serialized as threads return them to the pool (the only point at
+  // which they're quiescent) and the checkpoint is written out atomically
+  // once every live game has been captured. A game serialized early in the
+  // window may play further moves before the file is written; resuming it
+  // just replays those moves.
+  void MaybeStartCheckpointLocked() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  void CheckpointGameLocked(const SelfplayGame& selfplay_game)
+      EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  void MaybeFinishCheckpointLocked() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  // Draining past --drain_deadline_secs switches from playing in-flight
+  // games out to "parking" them: a final checkpoint window is forced open
+  // and every remaining game is serialized into it and destroyed instead of
+  // being handed back to a thread. The window closes (and the checkpoint is
+  // written) when the last game parks, after which the threads see no work
+  // left and the normal shutdown path flushes the output threads.
+  // MaybeStartParkingLocked returns true once the deadline has expired.
+  bool MaybeStartParkingLocked() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  void ParkGameLocked(std::unique_ptr<SelfplayGame> selfplay_game)
+      EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  // Stops new games from starting and, if --drain_deadline_secs is set,
+  // starts the countdown after which in-flight games are parked.
+  void BeginDrainLocked() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  // Resumes games from the checkpoint file if one exists, placing them in
+  // the game pool. Called once before the selfplay threads start.
+  void ResumeFromCheckpoint() LOCKS_EXCLUDED(&mutex_);
+
+  // Deserializes a single game written by AppendGameCheckpoint, replaying
+  // its moves to rebuild the game tree.
+  std::unique_ptr<SelfplayGame> ResumeGame(const char** src, const char* end)
+      LOCKS_EXCLUDED(&mutex_);
+
+  // Deterministic mode: the next game id owned by `thread_id`. Ids are
+  // partitioned by (id - 1) % selfplay_threads; after resuming from a
+  // checkpoint a thread's first id starts past every resumed game.
+  int NextDeterministicGameIdLocked(int thread_id)
+      EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
   mutable absl::Mutex mutex_;
   MctsTree::Options tree_options_ GUARDED_BY(&mutex_);
   int num_games_remaining_ GUARDED_BY(&mutex_) = 0;
   Random rnd_ GUARDED_BY(&mutex_);
   WinStats win_stats_ GUARDED_BY(&mutex_);
-  ThreadSafeQueue<std::unique_ptr<SelfplayGame>> output_queue_;
+  // Finished games waiting to be written out, one queue per output thread.
+  // Games are assigned to a queue by game id (see EndGame), so a given game
+  // always lands in the same worker, and each worker's rotating example
+  // shards see its games in a single FIFO order rather than racing with the
+  // other workers over one shared queue. The vector is populated in Run
+  // before any selfplay or output thread starts and is immutable after
+  // that. Lock-free because every selfplay thread pushes onto them; if an
+  // output thread falls more than a queue's worth of games behind, pushes
+  // to it block until it catches up.
+  std::vector<std::unique_ptr<LockFreeQueue<std::unique_ptr<GameOutput>>>>
+      output_queues_;
   ShardedExecutor executor_;
 
+  // Live games not currently checked out by a SelfplayThread, tagged with
+  // the thread that last ran them (-1 for games that haven't run yet).
+  struct PooledGame {
+    std::unique_ptr<SelfplayGame> game;
+    int last_thread_id;
+  };
+  std::vector<PooledGame> game_pool_ GUARDED_BY(&mutex_);
+
+  // Finished SelfplayGames are recycled here instead of destroyed so that
+  // the next game started can reuse their tree's arena memory.
+  std::vector<std::unique_ptr<SelfplayGame>> recycled_games_
+      GUARDED_BY(&mutex_);
+
+  // Number of live games currently checked out by SelfplayThreads. Together
+  // with `game_pool_` and `num_games_remaining_` this determines when
+  // CheckOutGames can tell a thread that all the work is done.
+  int num_games_checked_out_ GUARDED_BY(&mutex_) = 0;
+
+  // Checkpointing state, see MaybeStartCheckpointLocked.
+  absl::flat_hash_set<int> live_game_ids_ GUARDED_BY(&mutex_);
+  bool checkpoint_in_progress_ GUARDED_BY(&mutex_) = false;
+  std::string checkpoint_data_ GUARDED_BY(&mutex_);
+  absl::flat_hash_set<int> checkpointed_game_ids_ GUARDED_BY(&mutex_);
+  uint32_t num_checkpointed_games_ GUARDED_BY(&mutex_) = 0;
+  absl::Time next_checkpoint_time_ GUARDED_BY(&mutex_) =
+      absl::InfiniteFuture();
+
+  // Drain deadline state, see MaybeStartParkingLocked.
+  absl::Time drain_deadline_ GUARDED_BY(&mutex_) = absl::InfiniteFuture();
+  bool parking_ GUARDED_BY(&mutex_) = false;
+  uint32_t num_parked_games_ GUARDED_BY(&mutex_) = 0;
+
   ThreadSafeQueue<std::unique_ptr<Model>> models_;
 
+  // Pool of fast-model instances (see --fast_model). Unlike `models_`, the
+  // fast model is fixed for the lifetime of the run: it doesn't follow
+  // generation swaps, so released instances always return to the pool.
+  ThreadSafeQueue<std::unique_ptr<Model>> fast_models_;
+
   // The latest path that matches the model pattern.
   std::string latest_model_name_ GUARDED_BY(&mutex_);
 
   int next_game_id_ GUARDED_BY(&mutex_) = 1;
 
+  // Deterministic mode state (see --deterministic): the next game id each
+  // selfplay thread will start, and the capacity of the private per-game
+  // inference caches.
+  std::vector<int> deterministic_next_game_ids_ GUARDED_BY(&mutex_);
+  size_t deterministic_cache_capacity_ GUARDED_BY(&mutex_) = 0;
+
+  // Memory governor state, see CheckMemoryBudget. `governed_cache_` points
+  // at the inference cache for as long as the selfplay threads are running.
+  // `tree_bytes_` maps live game IDs to their tree's arena size as recorded
+  // the last time the game was returned to the pool; trees grow while
+  // checked out, so the sum lags actual usage by up to one search iteration.
+  InferenceCache* governed_cache_ GUARDED_BY(&mutex_) = nullptr;
+  size_t cache_entry_bytes_ GUARDED_BY(&mutex_) = 0;
+  size_t cache_capacity_ GUARDED_BY(&mutex_) = 0;
+  size_t configured_cache_capacity_ GUARDED_BY(&mutex_) = 0;
+  absl::flat_hash_map<int, size_t> tree_bytes_ GUARDED_BY(&mutex_);
+  bool compact_returned_trees_ GUARDED_BY(&mutex_) = false;
+
+  // Coordinator mode state, see FLAGS_coordinator. `coordinator_` is
+  // created before the selfplay threads start and never changes afterwards.
+  // `coordinator_thread_` reads assignments off the connection for the
+  // lifetime of the run, topping up `num_games_remaining_` and swapping in
+  // newly trained models.
+  std::unique_ptr<CoordinatorClient> coordinator_;
+  std::thread coordinator_thread_;
+  bool coordinator_shutdown_ GUARDED_BY(&mutex_) = false;
+  std::string coordinator_model_ GUARDED_BY(&mutex_);
+
+  // Set by a drain command (SIGTERM locally, a coordinator "drain" message
+  // in fleet mode): in-flight games play out to completion but no new games
+  // are started.
+  bool draining_ GUARDED_BY(&mutex_) = false;
+
+  // Waits on SIGTERM/SIGUSR1 with sigwait, so control actions propagate
+  // immediately with no polling. Woken up with a final signal and joined at
+  // the end of Run.
+  std::thread control_thread_;
+  std::atomic<bool> control_thread_active_{false};
+
   std::unique_ptr<DirectoryWatcher> directory_watcher_;
-  std::unique_ptr<PollThread> abort_file_watcher_;
+  TimerService::TimerId abort_file_timer_ = TimerService::kInvalidTimerId;
+  TimerService::TimerId memory_timer_ = TimerService::kInvalidTimerId;
 
   std::unique_ptr<WtfSaver> wtf_saver_;
 };
@@ -400,28 +1098,12 @@ class SelfplayThread : public Thread {
   SelfplayThread(int thread_id, Selfplayer* selfplayer,
                  std::shared_ptr<InferenceCache> cache);
 
- private:
-  void Run() override;
-
-  // Starts new games playing.
-  void StartNewGames();
-
-  // Selects leaves to perform inference on for all currently playing games.
-  // The selected leaves are stored in `inferences_` and `inference_spans_`
-  // maps contents of `inferences_` back to the `SelfplayGames` that they
-  // came from.
-  void SelectLeaves();
-
-  // Runs inference on the leaves selected by `SelectLeaves`.
-  // Returns the name of the model that ran the inferences.
-  std::string RunInferences();
-
-  // Calls `SelfplayGame::ProcessInferences` for all inferences performed.
-  void ProcessInferences(const std::string& model);
-
-  // Plays moves on all games that have performed sufficient reads.
-  void PlayMoves();
+  // Logs the per-phase latency histograms accumulated by this thread.
+  // Histogram updates are lock-free, so this is safe to call from another
+  // thread while selfplay is still running.
+  void LogPhaseStats() const;
 
+ private:
   struct TreeSearch {
     // Holds the span of inferences requested for a single `SelfplayGame`:
     // `pos` and `len` index into the `inferences` array.
@@ -429,41 +1111,184 @@ class SelfplayThread : public Thread {
       SelfplayGame* selfplay_game;
       size_t pos;
       size_t len;
+
+      // True if `pos` and `len` index into `fast_inferences` instead of
+      // `inferences`.
+      bool fast = false;
     };
 
     void Clear() {
       inferences.clear();
+      fast_inferences.clear();
       inference_spans.clear();
+      input_ptrs.clear();
+      output_ptrs.clear();
+      fast_input_ptrs.clear();
+      fast_output_ptrs.clear();
+      inference_done = nullptr;
+      fast_inference_done = nullptr;
     }
 
     std::vector<Inference> inferences;
+
+    // Inferences for games currently playing a "fast" move, routed to the
+    // fast model when one is configured (see --fast_model). Kept separate
+    // from `inferences` because the two sets are submitted to different
+    // models and only the full model's results are merged into the
+    // inference cache.
+    std::vector<Inference> fast_inferences;
     std::vector<InferenceSpan> inference_spans;
+
+    // Pointers into `inferences` / `fast_inferences` passed to
+    // Model::RunManyAsync, and the notifications signaled when the
+    // asynchronous inferences complete. Null if the search didn't queue any
+    // inferences for the corresponding model.
+    std::vector<const ModelInput*> input_ptrs;
+    std::vector<ModelOutput*> output_ptrs;
+    std::vector<const ModelInput*> fast_input_ptrs;
+    std::vector<ModelOutput*> fast_output_ptrs;
+    std::unique_ptr<absl::Notification> inference_done;
+    std::unique_ptr<absl::Notification> fast_inference_done;
+  };
+
+  // One stage of the thread's two-stage search pipeline: the games checked
+  // out from the Selfplayer's shared pool for a batch of tree search and the
+  // inferences selected from them. The thread alternates between its two
+  // groups so that leaves for one group are selected on the CPU while the
+  // other group's inference batch runs on the accelerator.
+  struct SearchGroup {
+    std::vector<std::unique_ptr<SelfplayGame>> selfplay_games;
+    std::vector<TreeSearch> searches;
+
+    // Name of the model the group's inferences were submitted to, recorded
+    // when the batch is submitted because the model itself is returned to
+    // the pool before the batch completes.
+    std::string model_name;
   };
 
+  void Run() override;
+
+  // Selects leaves and submits the group's inference batch, then selects
+  // and submits the speculative prefetch inferences (see PrefetchLeaves)
+  // and releases the model.
+  void BeginSearch(SearchGroup* group);
+
+  // Waits for the group's inference batch, incorporates the results, plays
+  // moves on games that have performed sufficient reads and returns the
+  // group's games to the shared pool. No-op if the group has no games.
+  void FinishSearch(SearchGroup* group);
+
+  // Selects leaves to perform inference on for all the group's games.
+  // The selected leaves are stored in each search's `inferences` and
+  // `inference_spans` maps contents of `inferences` back to the
+  // `SelfplayGames` that they came from.
+  // Each shard submits its inferences with Model::RunManyAsync as soon as it
+  // finishes selecting leaves, so inference on the first shards can run while
+  // the remaining shards are still selecting leaves.
+  void SelectLeaves(SearchGroup* group);
+
+  // Waits for the inferences submitted by `SelectLeaves` to complete.
+  void RunInferences(SearchGroup* group);
+
+  // Calls `SelfplayGame::ProcessInferences` for all inferences performed.
+  void ProcessInferences(SearchGroup* group);
+
+  // Submits speculative inferences for the group's games' most likely next
+  // children (see SelfplayGame::SelectPrefetchLeaves). The prefetched
+  // inferences complete in the background and are merged into the inference
+  // cache at the start of the next BeginSearch.
+  void PrefetchLeaves(SearchGroup* group);
+
+  // Waits for any outstanding prefetch submitted by a previous
+  // PrefetchLeaves and merges its results into the inference cache.
+  void MergePrefetchedInferences();
+
+  // Plays moves on all the group's games that have performed sufficient
+  // reads.
+  void PlayMoves(SearchGroup* group);
+
+  // Returns the cache a game's inferences are served from and merged into:
+  // the game's private cache in deterministic mode, the shared cache
+  // otherwise.
+  InferenceCache* GetCache(SelfplayGame* selfplay_game) {
+    auto* private_cache = selfplay_game->private_cache();
+    return private_cache != nullptr ? private_cache : cache_.get();
+  }
+
   Selfplayer* selfplayer_;
-  std::vector<std::unique_ptr<SelfplayGame>> selfplay_games_;
+  SearchGroup groups_[2];
+
+  // Model used for the current BeginSearch's inferences. Acquired at the
+  // start of SelectLeaves and released once all of the batch's inference
+  // requests have been submitted.
   std::unique_ptr<Model> model_;
+
+  // Fast model used for the current BeginSearch's fast-move inferences, or
+  // null if --fast_model isn't set. Same lifetime as `model_`.
+  std::unique_ptr<Model> fast_model_;
   std::shared_ptr<InferenceCache> cache_;
-  std::vector<TreeSearch> searches_;
+
+  // Speculative inferences submitted by PrefetchLeaves, and the notification
+  // signaled when they complete. Null if no prefetch is in flight.
+  std::vector<PrefetchInference> prefetches_;
+  std::vector<const ModelInput*> prefetch_input_ptrs_;
+  std::vector<ModelOutput*> prefetch_output_ptrs_;
+  std::unique_ptr<absl::Notification> prefetch_done_;
   int num_games_finished_ = 0;
+
+  // Per-phase latency histograms for the search loop. Recording a sample is
+  // a single relaxed atomic increment, so the histograms can be read by the
+  // stats logger thread while this thread keeps accumulating.
+  LatencyHistogram select_leaves_latency_;
+  LatencyHistogram inference_wait_latency_;
+  LatencyHistogram process_inferences_latency_;
+  LatencyHistogram play_moves_latency_;
+
   const int thread_id_;
 };
 
 // Writes SGFs and training examples for completed games to disk.
 class OutputThread : public Thread {
  public:
+  // `coordinator` may be null; if set, a record of each completed game is
+  // streamed to it in addition to the file outputs.
   OutputThread(int thread_id, FeatureDescriptor feature_descriptor,
-               ThreadSafeQueue<std::unique_ptr<SelfplayGame>>* output_queue);
+               LockFreeQueue<std::unique_ptr<GameOutput>>* output_queue,
+               CoordinatorClient* coordinator);
 
  private:
   void Run() override;
-  void WriteOutputs(std::unique_ptr<SelfplayGame> selfplay_game);
+  void WriteOutputs(std::unique_ptr<GameOutput> output);
 
-  ThreadSafeQueue<std::unique_ptr<SelfplayGame>>* output_queue_;
+  // Demotes trainable moves whose position this thread has already written
+  // an example for to non-trainable, so the example writers skip them.
+  void DedupExamples(Game* game);
+
+  LockFreeQueue<std::unique_ptr<GameOutput>>* output_queue_;
+  CoordinatorClient* coordinator_;
   const std::string output_dir_;
   const std::string holdout_dir_;
   const std::string sgf_dir_;
   const FeatureDescriptor feature_descriptor_;
+
+  // Performs the actual file writes in the background so that slow
+  // filesystems (e.g. GCS) don't stall the output queue. The destructor
+  // flushes all pending writes.
+  file::AsyncWriter async_writer_;
+
+  // Only set when --output_shard_mb > 0: batch many games into large
+  // rotating TFRecord shards instead of one file per game. Holdout games
+  // get their own writer so the occasional holdout game doesn't force the
+  // training shard to rotate. Declared after async_writer_ so their
+  // destructors can queue the final shards on it.
+  std::unique_ptr<tf_utils::ShardedExampleWriter> example_shards_;
+  std::unique_ptr<tf_utils::ShardedExampleWriter> holdout_shards_;
+
+  // Only used when --dedup_examples is set: the stone hashes (combined with
+  // the side to play) of every position this thread has written a training
+  // example for. Threads dedup independently, so a position may still be
+  // written up to --output_threads times.
+  absl::flat_hash_set<zobrist::Hash> example_positions_written_;
 };
 
 Selfplayer::Selfplayer()
@@ -485,10 +1310,58 @@ SelfplayGame::SelfplayGame(int game_id, const Options& options,
       inference_symmetry_mix_(rnd_.UniformUint64()),
       game_id_(game_id) {
   target_readouts_ = options_.num_readouts;
+  leaf_budget_ = options_.num_virtual_losses;
+  if (options_.deterministic) {
+    InitDeterministic();
+  }
+}
+
+void SelfplayGame::Reset(int game_id, const Options& options,
+                         std::unique_ptr<Game> game) {
+  options_ = options;
+  target_readouts_ = options_.num_readouts;
+  game_ = std::move(game);
+  tree_->Reset(Position(Color::kBlack));
+  start_time_ = absl::Now();
+  duration_ = absl::Duration();
+  models_used_.clear();
+  inference_symmetry_mix_ = rnd_.UniformUint64();
+  inject_noise_before_next_read_ = false;
+  fastplay_ = false;
+  num_consecutive_passes_[0] = 0;
+  num_consecutive_passes_[1] = 0;
+  saved_readouts_ = 0;
+  leaf_budget_ = options_.num_virtual_losses;
+  move_leaf_selections_ = 0;
+  move_leaf_collisions_ = 0;
+  game_id_ = game_id;
+  if (options_.deterministic) {
+    InitDeterministic();
+  }
+}
+
+void SelfplayGame::InitDeterministic() {
+  inference_symmetry_mix_ =
+      Random(DeterministicGameSeed(game_id_), kDeterministicConstantsStream)
+          .UniformUint64();
+  ReseedForMove();
+  if (options_.private_cache_capacity > 0) {
+    private_cache_ =
+        absl::make_unique<BasicInferenceCache>(options_.private_cache_capacity);
+  } else {
+    private_cache_ = absl::make_unique<NullInferenceCache>();
+  }
+}
+
+void SelfplayGame::ReseedForMove() {
+  MG_DCHECK(options_.deterministic);
+  rnd_.Reseed(DeterministicGameSeed(game_id_),
+              kDeterministicMoveStreamBase + tree_->root()->position().n());
 }
 
 SelfplayGame::SelectLeavesStats SelfplayGame::SelectLeaves(
-    InferenceCache* cache, std::vector<Inference>* inferences) {
+    InferenceCache* cache, std::vector<Inference>* inferences,
+    std::atomic<int>* extra_budget) {
   // We can only inject noise if the root is expanded. If it isn't expanded
   // yet, the next call to SelectLeaf must by definition select the root (and
   // break out of the loop below). We'll then inject the noise on the subsequent
@@ -500,6 +1373,32 @@ SelfplayGame::SelectLeavesStats SelfplayGame::SelectLeaves(
 
   const auto* root = tree_->root();
   SelectLeavesStats stats;
+
+  // Leaf selections drawn from `extra_budget` on top of the game's own
+  // allotment.
+  int extra_taken = 0;
+  auto within_budget = [&]() {
+    if (stats.num_leaves_queued < leaf_budget_ + extra_taken) {
+      return true;
+    }
+    if (extra_budget == nullptr) {
+      return false;
+    }
+    if (leaf_budget_ < options_.num_virtual_losses) {
+      // The budget was shrunk because this tree's selections keep colliding;
+      // drawing extra selections from the pool would just queue more
+      // redundant visits down the same line.
+      return false;
+    }
+    if (extra_budget->fetch_sub(1) < 1) {
+      // The pool was already empty; put the token back.
+      extra_budget->fetch_add(1);
+      return false;
+    }
+    extra_taken += 1;
+    return true;
+  };
+
   do {
     auto* leaf = tree_->SelectLeaf(options_.allow_pass);
     if (leaf == nullptr) {
@@ -510,15 +1409,22 @@ SelfplayGame::SelectLeavesStats SelfplayGame::SelectLeaves(
       break;
     }
 
-    stats.num_nodes_selected += leaf->position.n() - root->position.n();
+    stats.num_nodes_selected += leaf->position().n() - root->position().n();
 
     if (leaf->game_over()) {
       float value =
-          leaf->position.CalculateScore(game_->options().komi) > 0 ? 1 : -1;
+          leaf->position().CalculateScore(game_->options().komi) > 0 ? 1 : -1;
       tree_->IncorporateEndGameResult(leaf, value);
       stats.num_game_over_leaves += 1;
       continue;
     }
+    move_leaf_selections_ += 1;
+    if (leaf->num_virtual_losses_applied > 0) {
+      // The leaf is already pending inference from an earlier selection this
+      // pass: virtual loss wasn't enough to steer the search elsewhere.
+      stats.num_collisions += 1;
+      move_leaf_collisions_ += 1;
+    }
     if (MaybeQueueInference(leaf, cache, inferences)) {
       stats.num_leaves_queued += 1;
     } else {
@@ -530,11 +1436,80 @@ SelfplayGame::SelectLeavesStats SelfplayGame::SelectLeaves(
       }
       break;
     }
-  } while (stats.num_leaves_queued < options_.num_virtual_losses &&
-           tree_->root()->N() < target_readouts_);
+  } while (within_budget() && tree_->root()->N() < target_readouts_);
+
+  if (extra_budget != nullptr) {
+    // Donate whatever part of the allotment (and any drawn extra that went
+    // unqueued) this game couldn't turn into leaves. The donation is based
+    // on the nominal allotment rather than leaf_budget_, so the selections a
+    // shrunk budget withholds from this tree go to the pool instead of
+    // disappearing; group-wide batch fill is preserved.
+    auto unused =
+        options_.num_virtual_losses + extra_taken - stats.num_leaves_queued;
+    if (unused > 0) {
+      extra_budget->fetch_add(unused);
+    }
+  }
   return stats;
 }
 
+int SelfplayGame::SelectPrefetchLeaves(
+    int num_prefetch, InferenceCache* cache,
+    std::vector<PrefetchInference>* prefetches) {
+  const auto* root = tree_->root();
+  if (!root->is_expanded || game_->game_over()) {
+    return 0;
+  }
+
+  auto child_action_score = root->CalculateChildActionScore();
+
+  // Find the `num_prefetch` best children with the vectorized top-k argmax
+  // rather than repeatedly scanning the whole array for its maximum.
+  std::vector<int> best_moves(std::min<int>(num_prefetch, kNumMoves));
+  ArgMaxK(absl::MakeSpan(child_action_score), absl::MakeSpan(best_moves));
+
+  const auto& legal_moves = root->position().legal_moves();
+  int num_queued = 0;
+  for (int move : best_moves) {
+    Coord c(move);
+    // Illegal moves have a large negative action score, so once we hit one
+    // there are no legal moves left to prefetch.
+    if (!legal_moves[c]) {
+      break;
+    }
+
+    auto* leaf = tree_->MaybeAddRootChild(c);
+    if (leaf->is_expanded || leaf->game_over()) {
+      // The child has already been evaluated (or never will be), there's
+      // nothing to prefetch.
+      continue;
+    }
+
+    auto inference_sym = GetInferenceSymmetry(leaf);
+    auto cache_key =
+        InferenceCache::Key(leaf->move, leaf->canonical_symmetry,
+                            leaf->position());
+    ModelOutput cached_output;
+    if (cache->TryGet(cache_key, leaf->canonical_symmetry, inference_sym,
+                      &cached_output)) {
+      continue;
+    }
+
+    prefetches->emplace_back();
+    auto& prefetch = prefetches->back();
+    prefetch.cache_key = cache_key;
+    prefetch.canonical_sym = leaf->canonical_symmetry;
+    prefetch.input.sym = inference_sym;
+    prefetch.position = leaf->position();
+    tree_->GetStoneHistory(leaf, &prefetch.input);
+    for (const auto* snapshot : prefetch.input.stone_history) {
+      prefetch.snapshots.push_back(*snapshot);
+    }
+    num_queued += 1;
+  }
+  return num_queued;
+}
+
 void SelfplayGame::ProcessInferences(const std::string& model_name,
                                      absl::Span<const Inference> inferences) {
   if (!model_name.empty()) {
@@ -543,10 +1518,30 @@ void SelfplayGame::ProcessInferences(const std::string& model_name,
     }
   }
 
+  // Incorporate the inference outputs back into tree search, backing the
+  // whole batch's values up the tree in one deduplicated pass. The leaves
+  // are sorted by depth first so that expansion and backup visit the tree
+  // in coherent passes instead of bouncing between shallow and deep nodes:
+  // leaves at the same depth were selected through heavily shared path
+  // prefixes that are still warm from the previous leaf's walk.
+  sorted_inference_ptrs_.clear();
   for (const auto& inference : inferences) {
-    tree_->IncorporateResults(inference.leaf, inference.output.policy,
-                              inference.output.value);
-    tree_->RevertVirtualLoss(inference.leaf);
+    sorted_inference_ptrs_.push_back(&inference);
+  }
+  std::sort(sorted_inference_ptrs_.begin(), sorted_inference_ptrs_.end(),
+            [](const Inference* a, const Inference* b) {
+              return a->leaf->position().n() < b->leaf->position().n();
+            });
+
+  leaf_ptrs_.clear();
+  output_ptrs_.clear();
+  for (const auto* inference : sorted_inference_ptrs_) {
+    leaf_ptrs_.push_back(inference->leaf);
+    output_ptrs_.push_back(&inference->output);
+  }
+  tree_->IncorporateResultsBatch(leaf_ptrs_, output_ptrs_);
+  for (const auto* inference : sorted_inference_ptrs_) {
+    tree_->RevertVirtualLoss(inference->leaf);
   }
 }
 
@@ -554,7 +1549,12 @@ bool SelfplayGame::MaybePlayMove() {
   // Check if this game's tree search has performed enough reads that it
   // should now play a move.
   if (tree_->root()->N() < target_readouts_) {
-    return false;
+    if (!options_.adaptive_readouts || !CanTerminateSearchEarly()) {
+      return false;
+    }
+    // Bank the readouts we're not going to perform; they're reinvested in
+    // later moves whose evaluation is close.
+    saved_readouts_ += target_readouts_ - tree_->root()->N();
   }
 
   // Handle resignation.
@@ -570,7 +1570,7 @@ bool SelfplayGame::MaybePlayMove() {
 
     Coord c = tree_->PickMove(&rnd_, restrict_pass_alive_moves);
     if (options_.verbose) {
-      const auto& position = tree_->root()->position;
+      const auto& position = tree_->root()->position();
       MG_LOG(INFO) << position.ToPrettyString(use_ansi_colors_);
       MG_LOG(INFO) << "Move: " << position.n()
                    << " Captures X: " << position.num_captures()[0]
@@ -593,11 +1593,11 @@ bool SelfplayGame::MaybePlayMove() {
 
     if (!fastplay_ && c != Coord::kResign) {
       auto search_pi = tree_->CalculateSearchPi();
-      game_->AddTrainableMove(tree_->to_play(), c, tree_->root()->position,
+      game_->AddTrainableMove(tree_->to_play(), c, tree_->root()->position(),
                               std::move(model_str), tree_->root()->Q(),
                               tree_->root()->N(), search_pi);
     } else {
-      game_->AddNonTrainableMove(tree_->to_play(), c, tree_->root()->position,
+      game_->AddNonTrainableMove(tree_->to_play(), c, tree_->root()->position(),
                                  std::move(model_str), tree_->root()->Q(),
                                  tree_->root()->N());
     }
@@ -618,8 +1618,8 @@ bool SelfplayGame::MaybePlayMove() {
     tree_->PlayMove(c);
 
     // If the whole board is pass-alive, play pass moves to end the game.
-    if (tree_->root()->position.n() >= kMinPassAliveMoves &&
-        tree_->root()->position.CalculateWholeBoardPassAlive()) {
+    if (tree_->root()->position().n() >= kMinPassAliveMoves &&
+        tree_->root()->position().CalculateWholeBoardPassAlive()) {
       while (!tree_->is_game_over()) {
         tree_->PlayMove(Coord::kPass);
       }
@@ -632,11 +1632,44 @@ bool SelfplayGame::MaybePlayMove() {
     }
   }
 
+  // Retune the leaf budget from the collision rate of the move just played.
+  // In a narrow position the search funnels into one line and selections
+  // collide with leaves still pending inference, so extra budget only queues
+  // redundant visits: shrink. Once collisions subside, grow back towards the
+  // configured allotment. The budget never exceeds the allotment, so batch
+  // and shared memory buffer sizing derived from --virtual_losses still
+  // holds; the withheld selections are donated to the group's extra budget
+  // pool (see SelectLeaves), keeping batch fill high.
+  if (move_leaf_selections_ > 0) {
+    if (move_leaf_collisions_ * 5 >= move_leaf_selections_) {
+      // More than 20% of selections collided.
+      leaf_budget_ =
+          std::max(leaf_budget_ - 1, std::min(2, options_.num_virtual_losses));
+    } else if (move_leaf_collisions_ * 20 <= move_leaf_selections_) {
+      // Less than 5% collided.
+      leaf_budget_ = std::min(leaf_budget_ + 1, options_.num_virtual_losses);
+    }
+  }
+  move_leaf_selections_ = 0;
+  move_leaf_collisions_ = 0;
+
   if (!game_->game_over()) {
+    if (options_.deterministic) {
+      // The fastplay draw below is the first draw of the next move's stream.
+      ReseedForMove();
+    }
     fastplay_ = ShouldFastplay();
     inject_noise_before_next_read_ = !fastplay_;
     int num_readouts =
         fastplay_ ? options_.fastplay_readouts : options_.num_readouts;
+    if (options_.adaptive_readouts && !fastplay_ && saved_readouts_ > 0 &&
+        std::fabs(tree_->root()->Q()) < kCloseQ) {
+      // Reinvest banked readouts in close positions, up to doubling the
+      // move's normal budget.
+      int bonus = std::min(saved_readouts_, options_.num_readouts);
+      num_readouts += bonus;
+      saved_readouts_ -= bonus;
+    }
     target_readouts_ = tree_->root()->N() + num_readouts;
     if (!fastplay_) {
       if (options_.fastplay_frequency > 0) {
@@ -650,11 +1683,70 @@ bool SelfplayGame::MaybePlayMove() {
   return true;
 }
 
+void SelfplayGame::RestoreCheckpointState(
+    std::vector<std::string> models_used) {
+  models_used_ = std::move(models_used);
+
+  // Rebuild the consecutive pass counters the same way MaybePlayMove
+  // maintains them: they latch once they reach
+  // `restrict_pass_alive_play_threshold`.
+  for (const auto& move : game_->moves()) {
+    int& num_passes =
+        num_consecutive_passes_[move->color == Color::kBlack ? 0 : 1];
+    if (num_passes < options_.restrict_pass_alive_play_threshold) {
+      if (move->c == Coord::kPass) {
+        num_passes += 1;
+      } else {
+        num_passes = 0;
+      }
+    }
+  }
+
+  // In deterministic mode the constructor already keyed the RNG to the
+  // resumed move's stream; replaying the stream's first draw recovers the
+  // fastplay choice the original run made for this move. (The resumed
+  // search itself still isn't identical to the uninterrupted one: the tree
+  // statistics are rebuilt with fresh reads.)
+  if (options_.deterministic && tree_->root()->position().n() > 0) {
+    fastplay_ = ShouldFastplay();
+    inject_noise_before_next_read_ = !fastplay_;
+  }
+}
+
 bool SelfplayGame::ShouldFastplay() {
   return options_.fastplay_frequency > 0 &&
          rnd_() < options_.fastplay_frequency;
 }
 
+bool SelfplayGame::CanTerminateSearchEarly() const {
+  const auto* root = tree_->root();
+  if (!root->is_expanded) {
+    return false;
+  }
+  int remaining = target_readouts_ - root->N();
+
+  // Decided position: the root's Q is past the certainty bound, so further
+  // reads are very unlikely to change the evaluation.
+  if (std::fabs(root->Q()) > options_.certainty_q) {
+    return true;
+  }
+
+  // Insurmountable lead: even if every remaining readout went to the
+  // runner-up, it couldn't overtake the best child.
+  int best_n = 0;
+  int second_n = 0;
+  for (int i = 0; i < kNumMoves; ++i) {
+    int n = root->child_N(i);
+    if (n > best_n) {
+      second_n = best_n;
+      best_n = n;
+    } else if (n > second_n) {
+      second_n = n;
+    }
+  }
+  return best_n - second_n > remaining;
+}
+
 bool SelfplayGame::ShouldResign() const {
   return game_->options().resign_enabled &&
          tree_->root()->Q_perspective() < game_->options().resign_threshold;
@@ -668,7 +1760,7 @@ void SelfplayGame::InjectNoise() {
 symmetry::Symmetry SelfplayGame::GetInferenceSymmetry(
     const MctsNode* node) const {
   uint64_t bits =
-      Random::MixBits(node->position.stone_hash() * Random::kLargePrime +
+      Random::MixBits(node->position().stone_hash() * Random::kLargePrime +
                       inference_symmetry_mix_);
   return static_cast<symmetry::Symmetry>(bits % symmetry::kNumSymmetries);
 }
@@ -679,7 +1771,7 @@ bool SelfplayGame::MaybeQueueInference(MctsNode* leaf, InferenceCache* cache,
 
   auto inference_sym = GetInferenceSymmetry(leaf);
   auto cache_key =
-      InferenceCache::Key(leaf->move, leaf->canonical_symmetry, leaf->position);
+      InferenceCache::Key(leaf->move, leaf->canonical_symmetry, leaf->position());
   if (cache->TryGet(cache_key, leaf->canonical_symmetry, inference_sym,
                     &cached_output)) {
     tree_->IncorporateResults(leaf, cached_output.policy, cached_output.value);
@@ -692,47 +1784,227 @@ bool SelfplayGame::MaybeQueueInference(MctsNode* leaf, InferenceCache* cache,
   inference.input.sym = inference_sym;
   inference.leaf = leaf;
 
-  // TODO(tommadams): add a method to FeatureDescriptor that returns the
-  // required position history size.
-  auto* node = leaf;
-  for (int i = 0; i < inference.input.position_history.capacity(); ++i) {
-    inference.input.position_history.push_back(&node->position);
-    node = node->parent;
-    if (node == nullptr) {
-      break;
-    }
-  }
+  tree_->GetStoneHistory(leaf, &inference.input);
 
   tree_->AddVirtualLoss(leaf);
   return true;
 }
 
 void Selfplayer::Run() {
-  // Create the inference cache.
-  std::shared_ptr<InferenceCache> inference_cache;
-  if (FLAGS_cache_size_mb > 0) {
-    auto capacity = BasicInferenceCache::CalculateCapacity(FLAGS_cache_size_mb);
-    MG_LOG(INFO) << "Will cache up to " << capacity
+  // Handle control signals on a dedicated sigwait thread: SIGUSR1 drains
+  // (in-flight games play out but no new games start) and SIGTERM drains on
+  // the first signal and aborts on the second, so a stuck drain can still
+  // be killed cleanly. The signals are blocked here, before any other
+  // threads are spawned, so that every thread inherits the mask and
+  // delivery always goes to the sigwait.
+  sigset_t control_signals;
+  sigemptyset(&control_signals);
+  sigaddset(&control_signals, SIGTERM);
+  sigaddset(&control_signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &control_signals, nullptr);
+  control_thread_active_.store(true);
+  control_thread_ = std::thread([this, control_signals]() {
+    bool drained = false;
+    for (;;) {
+      int sig = 0;
+      if (sigwait(&control_signals, &sig) != 0 ||
+          !control_thread_active_.load()) {
+        return;
+      }
+      if (sig == SIGTERM && drained) {
+        MG_LOG(FATAL) << "Aborting on second SIGTERM";
+      }
+      MG_LOG(INFO) << "Draining on signal " << sig
+                   << ", finishing in-flight games";
+      drained = true;
+      absl::MutexLock lock(&mutex_);
+      BeginDrainLocked();
+    }
+  });
+
+  if (FLAGS_async_logging) {
+    EnableAsyncLogging();
+  }
+
+  // Prefetched inferences are only useful if there's a cache to put them in.
+  if (FLAGS_num_prefetch > 0) {
+    MG_CHECK(FLAGS_cache_size_mb > 0 || !FLAGS_cache_file.empty())
+        << "--num_prefetch requires an inference cache";
+  }
+
+  // One output queue per output thread, created before any thread that
+  // could touch them starts.
+  MG_CHECK(FLAGS_output_threads > 0);
+  output_queues_.reserve(FLAGS_output_threads);
+  for (int i = 0; i < FLAGS_output_threads; ++i) {
+    output_queues_.push_back(
+        absl::make_unique<LockFreeQueue<std::unique_ptr<GameOutput>>>(1024));
+  }
+
+  if (FLAGS_run_forever) {
+    // Note that we don't ever have to worry about cancelling this timer
+    // because it's only ever created when selfplay runs forever and when it
+    // comes time to terminate the process, CheckAbortFile will call abort().
+    abort_file_timer_ = TimerService::Get()->AddPeriodic(
+        absl::Seconds(5), std::bind(&Selfplayer::CheckAbortFile, this));
+  }
+
+  // Connect to the coordinator and wait for the first assignment if one was
+  // configured; otherwise the model and game quota come from flags.
+  std::string model_path = FLAGS_model;
+  if (!FLAGS_coordinator.empty()) {
+    coordinator_ = CoordinatorClient::Connect(FLAGS_coordinator);
+    MG_CHECK(coordinator_ != nullptr)
+        << "couldn't connect to coordinator at " << FLAGS_coordinator;
+    coordinator_->Register(FLAGS_selfplay_threads);
+
+    CoordinatorClient::Assignment assignment;
+    for (;;) {
+      auto command = coordinator_->WaitForCommand(&assignment);
+      if (command == CoordinatorClient::Command::kAssign) {
+        break;
+      }
+      MG_CHECK(command == CoordinatorClient::Command::kDrain)
+          << "coordinator shut down before sending an assignment";
+      // A drain with no games in flight is a no-op.
+    }
+    MG_LOG(INFO) << "Coordinator assigned model " << assignment.model
+                 << " and " << assignment.num_games << " games";
+    model_path = assignment.model;
+    {
+      absl::MutexLock lock(&mutex_);
+      num_games_remaining_ = assignment.num_games;
+      coordinator_model_ = assignment.model;
+    }
+
+    // Keep reading commands for the lifetime of the run: the coordinator
+    // tops up the game quota, repoints workers at newly trained models, and
+    // pushes drain/abort control actions.
+    coordinator_thread_ = std::thread([this]() {
+      CoordinatorClient::Assignment assignment;
+      for (bool done = false; !done;) {
+        switch (coordinator_->WaitForCommand(&assignment)) {
+          case CoordinatorClient::Command::kAssign: {
+            MG_LOG(INFO) << "Coordinator assigned model " << assignment.model
+                         << " and " << assignment.num_games << " games";
+            std::string new_model;
+            {
+              absl::MutexLock lock(&mutex_);
+              num_games_remaining_ += assignment.num_games;
+              draining_ = false;
+              drain_deadline_ = absl::InfiniteFuture();
+              parking_ = false;
+              if (assignment.model != coordinator_model_) {
+                coordinator_model_ = assignment.model;
+                new_model = assignment.model;
+              }
+            }
+            if (!new_model.empty()) {
+              CreateModels(new_model);
+            }
+            break;
+          }
+          case CoordinatorClient::Command::kDrain: {
+            MG_LOG(INFO) << "Coordinator sent drain, finishing in-flight "
+                            "games";
+            absl::MutexLock lock(&mutex_);
+            BeginDrainLocked();
+            break;
+          }
+          case CoordinatorClient::Command::kAbort:
+            MG_LOG(FATAL) << "Aborting on coordinator command";
+            break;
+          case CoordinatorClient::Command::kShutdown:
+            done = true;
+            break;
+        }
+      }
+      MG_LOG(INFO) << "Coordinator shut the connection down";
+      absl::MutexLock lock(&mutex_);
+      coordinator_shutdown_ = true;
+    });
+  }
+
+  // Load the models. Model initialization dominates startup on accelerator
+  // hosts (device setup plus a warm-up inference per instance), so run it on
+  // its own thread and overlap it with the rest of the setup work: building
+  // the inference cache (which may fault in a large memory-mapped cache
+  // file), resuming checkpointed games and creating the selfplay threads.
+  FeatureDescriptor feature_descriptor{};
+  std::thread model_init_thread([this, &feature_descriptor, &model_path]() {
+    feature_descriptor = InitializeModels(model_path);
+  });
+
+  // Create the in-memory inference cache. In deterministic mode there's no
+  // shared cache: each game owns a private cache (see --deterministic), so
+  // the shared one is a no-op placeholder.
+  std::unique_ptr<InferenceCache> memory_cache;
+  size_t memory_cache_capacity = 0;
+  if (FLAGS_deterministic) {
+    if (FLAGS_cache_size_mb > 0) {
+      absl::MutexLock lock(&mutex_);
+      MG_LOG(INFO) << "Deterministic mode: each game will cache up to "
+                   << deterministic_cache_capacity_
+                   << " inferences privately.";
+    }
+    memory_cache = absl::make_unique<NullInferenceCache>();
+  } else if (FLAGS_cache_size_mb > 0 && FLAGS_lock_free_cache) {
+    memory_cache_capacity =
+        LockFreeInferenceCache::CalculateCapacity(FLAGS_cache_size_mb);
+    MG_LOG(INFO) << "Will cache up to " << memory_cache_capacity
+                 << " inferences, using roughly " << FLAGS_cache_size_mb
+                 << "MB.\n";
+    memory_cache =
+        absl::make_unique<LockFreeInferenceCache>(memory_cache_capacity);
+  } else if (FLAGS_cache_size_mb > 0) {
+    memory_cache_capacity =
+        BasicInferenceCache::CalculateCapacity(FLAGS_cache_size_mb);
+    MG_LOG(INFO) << "Will cache up to " << memory_cache_capacity
                  << " inferences, using roughly " << FLAGS_cache_size_mb
                  << "MB.\n";
-    inference_cache = std::make_shared<ThreadSafeInferenceCache>(
-        capacity, FLAGS_cache_shards);
+    memory_cache = absl::make_unique<ThreadSafeInferenceCache>(
+        memory_cache_capacity, FLAGS_cache_shards);
   } else {
-    inference_cache = std::make_shared<NullInferenceCache>();
+    memory_cache = absl::make_unique<NullInferenceCache>();
   }
 
-  if (FLAGS_run_forever) {
-    // Note that we don't ever have to worry about joining this thread because
-    // it's only ever created when selfplay runs forever and when it comes time
-    // to terminate the process, CheckAbortFile will call abort().
-    abort_file_watcher_ = absl::make_unique<PollThread>(
-        "AbortWatcher", absl::Seconds(5),
-        std::bind(&Selfplayer::CheckAbortFile, this));
-    abort_file_watcher_->Start();
+  // Layer the in-memory cache over a memory-mapped cache file if one was
+  // requested.
+  std::shared_ptr<InferenceCache> inference_cache;
+  if (!FLAGS_cache_file.empty()) {
+    auto capacity =
+        MmapInferenceCache::CalculateCapacity(FLAGS_cache_file_size_mb);
+    MG_LOG(INFO) << "Will cache up to " << capacity << " inferences in "
+                 << FLAGS_cache_file << ", using roughly "
+                 << FLAGS_cache_file_size_mb << "MB of disk.\n";
+    auto file_cache =
+        MmapInferenceCache::Open(FLAGS_cache_file, capacity, FLAGS_model);
+    MG_CHECK(file_cache != nullptr)
+        << "couldn't open cache file \"" << FLAGS_cache_file << "\"";
+    inference_cache = std::make_shared<TieredInferenceCache>(
+        std::move(memory_cache), std::move(file_cache));
+  } else {
+    inference_cache = std::move(memory_cache);
   }
 
-  // Load the models.
-  auto feature_descriptor = InitializeModels();
+  if (FLAGS_memory_budget_mb > 0) {
+    {
+      absl::MutexLock lock(&mutex_);
+      governed_cache_ = inference_cache.get();
+      cache_capacity_ = memory_cache_capacity;
+      configured_cache_capacity_ = memory_cache_capacity;
+      cache_entry_bytes_ =
+          memory_cache_capacity > 0
+              ? static_cast<size_t>(FLAGS_cache_size_mb) * 1024 * 1024 /
+                    memory_cache_capacity
+              : 0;
+    }
+    memory_timer_ = TimerService::Get()->AddPeriodic(
+        absl::Seconds(5), std::bind(&Selfplayer::CheckMemoryBudget, this));
+  }
+
+  // Resume any games checkpointed by a previous run.
+  ResumeFromCheckpoint();
 
   // Initialize the selfplay threads.
   std::vector<std::unique_ptr<SelfplayThread>> selfplay_threads;
@@ -746,14 +2018,39 @@ void Selfplayer::Run() {
     }
   }
 
-  // Start the output threads.
+  // On multi-socket hosts, pin each selfplay thread to the CPUs of one NUMA
+  // node so that tree search doesn't have to pull MctsTree nodes across the
+  // socket interconnect. Games are created on the thread that first checks
+  // them out, so their trees are first-touched (and therefore allocated) on
+  // that thread's node.
+  auto num_numa_nodes = GetNumNumaNodes();
+  if (num_numa_nodes > 1) {
+    for (int i = 0; i < FLAGS_selfplay_threads; ++i) {
+      auto cpus = GetNumaNodeCpus(i % num_numa_nodes);
+      if (!cpus.empty()) {
+        selfplay_threads[i]->SetAffinity(std::move(cpus));
+      }
+    }
+  }
+
+  // The rest of startup needs the loaded models: the output threads read
+  // the feature descriptor and the selfplay threads block on inference as
+  // soon as they start, so this is the point where setup has to wait for
+  // model initialization to finish.
+  model_init_thread.join();
+
+  // Start the output threads, each pulling from its own queue. Output is
+  // background I/O: run it at low priority so it never displaces the
+  // cache-hot search threads.
+  MG_CHECK(output_queues_.size() == static_cast<size_t>(FLAGS_output_threads));
   std::vector<std::unique_ptr<OutputThread>> output_threads;
   output_threads.reserve(FLAGS_output_threads);
   for (int i = 0; i < FLAGS_output_threads; ++i) {
-    output_threads.push_back(
-        absl::make_unique<OutputThread>(i, feature_descriptor, &output_queue_));
+    output_threads.push_back(absl::make_unique<OutputThread>(
+        i, feature_descriptor, output_queues_[i].get(), coordinator_.get()));
   }
   for (auto& t : output_threads) {
+    t->SetPriority(Thread::Priority::kLow);
     t->Start();
   }
 
@@ -766,21 +2063,94 @@ void Selfplayer::Run() {
   for (auto& t : selfplay_threads) {
     t->Start();
   }
+
+  // Periodically log the threads' per-phase latency histograms if requested.
+  TimerService::TimerId stats_timer = TimerService::kInvalidTimerId;
+  if (FLAGS_stats_interval_secs > 0) {
+    stats_timer = TimerService::Get()->AddPeriodic(
+        absl::Seconds(FLAGS_stats_interval_secs), [&selfplay_threads]() {
+          for (auto& t : selfplay_threads) {
+            t->LogPhaseStats();
+          }
+        });
+  }
+
+  // Periodically dump the always-on performance counters if requested.
+  TimerService::TimerId metrics_timer = TimerService::kInvalidTimerId;
+  if (FLAGS_metrics_interval_secs > 0) {
+    metrics_timer = TimerService::Get()->AddPeriodic(
+        absl::Seconds(FLAGS_metrics_interval_secs), []() {
+          UpdateLargePageGauges();
+          MG_LOG(INFO) << DumpMetricsLine();
+        });
+  }
+
+  // Serve the counters over HTTP if requested. Stops (and so stops touching
+  // the metrics) when it goes out of scope at the end of Run.
+  MetricsServer metrics_server;
+  if (FLAGS_metrics_port > 0) {
+    metrics_server.Start(FLAGS_metrics_port);
+  }
+
+  if (FLAGS_benchmark_secs > 0) {
+    RunThroughputBenchmark();  // Logs throughput and exits the process.
+  }
+
   for (auto& t : selfplay_threads) {
     t->Join();
   }
+  if (stats_timer != TimerService::kInvalidTimerId) {
+    TimerService::Get()->Cancel(stats_timer);
+  }
+  if (metrics_timer != TimerService::kInvalidTimerId) {
+    TimerService::Get()->Cancel(metrics_timer);
+  }
+  if (memory_timer_ != TimerService::kInvalidTimerId) {
+    // Cancel before `inference_cache` goes out of scope so a late governor
+    // tick can't touch a destroyed cache.
+    TimerService::Get()->Cancel(memory_timer_);
+    absl::MutexLock lock(&mutex_);
+    governed_cache_ = nullptr;
+  }
 
-  // Stop the output threads by pushing one null game onto the output queue
-  // for each thread, causing the threads to exit when they pop them off.
-  for (size_t i = 0; i < output_threads.size(); ++i) {
-    output_queue_.Push(nullptr);
+  // Stop the output threads by pushing a null game onto each thread's
+  // queue, causing the threads to exit when they pop them off.
+  for (auto& queue : output_queues_) {
+    queue->Push(nullptr);
   }
   for (auto& t : output_threads) {
     t->Join();
   }
-  MG_CHECK(output_queue_.empty());
+  for (const auto& queue : output_queues_) {
+    MG_CHECK(queue->empty());
+  }
+
+  // All game records have been streamed; drop the coordinator connection.
+  if (coordinator_ != nullptr) {
+    coordinator_->Close();
+    coordinator_thread_.join();
+  }
 
-  if (FLAGS_cache_size_mb > 0) {
+  // Wake the control thread out of sigwait so it can be joined.
+  control_thread_active_.store(false);
+  pthread_kill(control_thread_.native_handle(), SIGUSR1);
+  control_thread_.join();
+
+  // All games have completed; remove the checkpoint so the next run doesn't
+  // resume games whose outputs have already been written. If the drain
+  // deadline parked games instead, the checkpoint holds them for the
+  // replacement worker and must be left in place.
+  {
+    absl::MutexLock lock(&mutex_);
+    if (num_parked_games_ > 0) {
+      MG_LOG(INFO) << "Parked " << num_parked_games_ << " in-flight games in "
+                   << FLAGS_checkpoint_file;
+    } else if (!FLAGS_checkpoint_file.empty()) {
+      std::remove(FLAGS_checkpoint_file.c_str());
+    }
+  }
+
+  if (FLAGS_cache_size_mb > 0 && !FLAGS_deterministic) {
     MG_LOG(INFO) << "Inference cache stats: " << inference_cache->GetStats();
   }
 
@@ -788,9 +2158,12 @@ void Selfplayer::Run() {
     absl::MutexLock lock(&mutex_);
     MG_LOG(INFO) << FormatWinStatsTable({{latest_model_name_, win_stats_}});
   }
+
+  // Flush any log lines still buffered in the async logger.
+  DisableAsyncLogging();
 }
 
-std::unique_ptr<SelfplayGame> Selfplayer::StartNewGame(bool verbose) {
+std::unique_ptr<SelfplayGame> Selfplayer::StartNewGame(int thread_id) {
   WTF_SCOPE0("StartNewGame");
 
   Game::Options game_options;
@@ -799,22 +2172,58 @@ std::unique_ptr<SelfplayGame> Selfplayer::StartNewGame(bool verbose) {
 
   std::string player_name;
   int game_id;
+  std::unique_ptr<SelfplayGame> recycled;
   {
     absl::MutexLock lock(&mutex_);
-    if (!FLAGS_run_forever && num_games_remaining_ == 0) {
+    if (draining_) {
       return nullptr;
     }
-    if (!FLAGS_run_forever) {
-      num_games_remaining_ -= 1;
+    if (FLAGS_deterministic) {
+      // Game ids are partitioned across the selfplay threads so that every
+      // run plays the same games on the same threads.
+      game_id = NextDeterministicGameIdLocked(thread_id);
+      if (!FLAGS_run_forever && game_id > FLAGS_num_games) {
+        return nullptr;
+      }
+      deterministic_next_game_ids_[thread_id] =
+          game_id + FLAGS_selfplay_threads;
+      next_game_id_ = std::max(next_game_id_, game_id + 1);
+      if (!FLAGS_run_forever && num_games_remaining_ > 0) {
+        num_games_remaining_ -= 1;
+      }
+    } else {
+      if (!FLAGS_run_forever && num_games_remaining_ == 0) {
+        return nullptr;
+      }
+      if (!FLAGS_run_forever) {
+        num_games_remaining_ -= 1;
+      }
+      game_id = next_game_id_++;
     }
+    num_games_checked_out_ += 1;
+    games_in_flight_gauge.Set(num_games_checked_out_);
 
     player_name = latest_model_name_;
-    game_id = next_game_id_++;
-
-    game_options.resign_threshold =
-        -rnd_.Uniform(std::fabs(FLAGS_min_resign_threshold),
-                      std::fabs(FLAGS_max_resign_threshold));
-    game_options.resign_enabled = rnd_() >= FLAGS_disable_resign_pct;
+    live_game_ids_.insert(game_id);
+
+    if (FLAGS_deterministic) {
+      // The per-game randomization comes from a stream keyed by the game id
+      // instead of the shared RNG, so the values don't depend on the order
+      // in which threads start games.
+      Random options_rnd(DeterministicGameSeed(game_id),
+                         kDeterministicOptionsStream);
+      game_options.resign_threshold =
+          -options_rnd.Uniform(std::fabs(FLAGS_min_resign_threshold),
+                               std::fabs(FLAGS_max_resign_threshold));
+      game_options.resign_enabled = options_rnd() >= FLAGS_disable_resign_pct;
+      selfplay_options.is_holdout = options_rnd() < FLAGS_holdout_pct;
+    } else {
+      game_options.resign_threshold =
+          -rnd_.Uniform(std::fabs(FLAGS_min_resign_threshold),
+                        std::fabs(FLAGS_max_resign_threshold));
+      game_options.resign_enabled = rnd_() >= FLAGS_disable_resign_pct;
+      selfplay_options.is_holdout = rnd_() < FLAGS_holdout_pct;
+    }
 
     tree_options = tree_options_;
 
@@ -822,36 +2231,231 @@ std::unique_ptr<SelfplayGame> Selfplayer::StartNewGame(bool verbose) {
     selfplay_options.num_readouts = FLAGS_num_readouts;
     selfplay_options.fastplay_readouts = FLAGS_fastplay_readouts;
     selfplay_options.fastplay_frequency = FLAGS_fastplay_frequency;
+    selfplay_options.adaptive_readouts = FLAGS_adaptive_readouts;
+    selfplay_options.certainty_q = FLAGS_certainty_q;
     selfplay_options.noise_mix = FLAGS_noise_mix;
     selfplay_options.dirichlet_alpha = FLAGS_dirichlet_alpha;
-    selfplay_options.is_holdout = rnd_() < FLAGS_holdout_pct;
     selfplay_options.target_pruning = FLAGS_target_pruning;
-    selfplay_options.verbose = verbose;
+    // Games migrate between threads, so rather than the first game of the
+    // first thread, verbose logging follows the first game started.
+    selfplay_options.verbose = FLAGS_verbose && game_id == 1;
     selfplay_options.allow_pass = FLAGS_allow_pass;
     selfplay_options.restrict_pass_alive_play_threshold =
         FLAGS_restrict_pass_alive_play_threshold;
+    selfplay_options.deterministic = FLAGS_deterministic;
+    selfplay_options.private_cache_capacity = deterministic_cache_capacity_;
+
+    if (!recycled_games_.empty()) {
+      recycled = std::move(recycled_games_.back());
+      recycled_games_.pop_back();
+    }
   }
 
   auto game = absl::make_unique<Game>(player_name, player_name, game_options);
+  if (recycled != nullptr) {
+    recycled->Reset(game_id, selfplay_options, std::move(game));
+    return recycled;
+  }
+
   auto tree =
       absl::make_unique<MctsTree>(Position(Color::kBlack), tree_options);
-
   return absl::make_unique<SelfplayGame>(game_id, selfplay_options,
                                          std::move(game), std::move(tree));
 }
 
+int Selfplayer::NextDeterministicGameIdLocked(int thread_id) {
+  if (deterministic_next_game_ids_.empty()) {
+    deterministic_next_game_ids_.resize(FLAGS_selfplay_threads, 0);
+  }
+  int next = deterministic_next_game_ids_[thread_id];
+  if (next == 0) {
+    // First game for this thread: the smallest id it owns that's at least
+    // `next_game_id_`, which a checkpoint restore will have bumped past
+    // every resumed game.
+    int t = FLAGS_selfplay_threads;
+    next = next_game_id_ + ((thread_id - (next_game_id_ - 1)) % t + t) % t;
+  }
+  return next;
+}
+
+bool Selfplayer::CheckOutGames(
+    int thread_id, size_t max_games,
+    std::vector<std::unique_ptr<SelfplayGame>>* games, bool block) {
+  MG_CHECK(games->empty());
+
+  for (;;) {
+    bool all_done;
+    {
+      absl::MutexLock lock(&mutex_);
+
+      if (MaybeStartParkingLocked()) {
+        for (auto& pooled_game : game_pool_) {
+          ParkGameLocked(std::move(pooled_game.game));
+        }
+        game_pool_.clear();
+        MaybeFinishCheckpointLocked();
+      }
+
+      if (block && !FLAGS_deterministic) {
+        // Wait until there's a game to take from the pool, a new game can be
+        // started, or all outstanding games have finished (in which case the
+        // thread is done). While a coordinator connection is up, an empty
+        // quota just means waiting for the next assignment. In deterministic
+        // mode there's nothing to wait for: a thread's games are never held
+        // by another thread, so its work is always immediately available (or
+        // exhausted).
+        auto has_work = [this]() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+          if (!game_pool_.empty()) {
+            return true;
+          }
+          if (draining_) {
+            return num_games_checked_out_ == 0;
+          }
+          return num_games_remaining_ > 0 || FLAGS_run_forever ||
+                 (num_games_checked_out_ == 0 &&
+                  (coordinator_ == nullptr || coordinator_shutdown_));
+        };
+        mutex_.Await(absl::Condition(&has_work));
+      }
+
+      // First pass: take games this thread ran last. Scanning backwards
+      // means an entry swapped in from the back was already examined.
+      for (size_t i = game_pool_.size(); i > 0 && games->size() < max_games;) {
+        --i;
+        if (game_pool_[i].last_thread_id != thread_id) {
+          continue;
+        }
+        games->push_back(std::move(game_pool_[i].game));
+        if (i != game_pool_.size() - 1) {
+          game_pool_[i] = std::move(game_pool_.back());
+        }
+        game_pool_.pop_back();
+        num_games_checked_out_ += 1;
+      }
+
+      // Second pass: top up with anyone else's games. Skipped in
+      // deterministic mode, where games are pinned to their home thread.
+      if (!FLAGS_deterministic) {
+        while (!game_pool_.empty() && games->size() < max_games) {
+          games->push_back(std::move(game_pool_.back().game));
+          game_pool_.pop_back();
+          num_games_checked_out_ += 1;
+        }
+      }
+      games_in_flight_gauge.Set(num_games_checked_out_);
+
+      // In deterministic mode a thread is done as soon as it has no game to
+      // run: its pooled games were taken by the first pass and StartNewGame
+      // below fails only once its id partition is exhausted (or the run is
+      // draining), neither of which another thread can change.
+      all_done = games->empty() &&
+                 (FLAGS_deterministic ||
+                  (num_games_checked_out_ == 0 &&
+                   (draining_ ||
+                    (num_games_remaining_ == 0 && !FLAGS_run_forever &&
+                     (coordinator_ == nullptr || coordinator_shutdown_)))));
+    }
+
+    // Top up with new games. StartNewGame locks the mutex itself, so this is
+    // done outside the lock.
+    while (games->size() < max_games) {
+      auto selfplay_game = StartNewGame(thread_id);
+      if (selfplay_game == nullptr) {
+        break;
+      }
+      games->push_back(std::move(selfplay_game));
+    }
+
+    if (!games->empty()) {
+      return true;
+    }
+    if (all_done || !block) {
+      return false;
+    }
+    // Raced with other threads for the pooled & new games and lost; go
+    // around again.
+  }
+}
+
+void Selfplayer::ReturnGames(
+    int thread_id, std::vector<std::unique_ptr<SelfplayGame>>* games) {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (MaybeStartParkingLocked()) {
+      for (auto& selfplay_game : *games) {
+        if (selfplay_game != nullptr) {
+          ParkGameLocked(std::move(selfplay_game));
+        }
+        num_games_checked_out_ -= 1;
+      }
+      games_in_flight_gauge.Set(num_games_checked_out_);
+      MaybeFinishCheckpointLocked();
+      games->clear();
+      return;
+    }
+    MaybeStartCheckpointLocked();
+    for (auto& selfplay_game : *games) {
+      if (selfplay_game != nullptr) {
+        if (FLAGS_memory_budget_mb > 0) {
+          // Returned games are quiescent, so this is where the memory
+          // governor's tree compaction and accounting happen.
+          if (compact_returned_trees_) {
+            selfplay_game->CompactTree();
+          }
+          tree_bytes_[selfplay_game->game_id()] = selfplay_game->tree_bytes();
+        }
+        CheckpointGameLocked(*selfplay_game);
+        game_pool_.push_back({std::move(selfplay_game), thread_id});
+      }
+      num_games_checked_out_ -= 1;
+    }
+    games_in_flight_gauge.Set(num_games_checked_out_);
+    MaybeFinishCheckpointLocked();
+  }
+  games->clear();
+}
+
 void Selfplayer::EndGame(std::unique_ptr<SelfplayGame> selfplay_game) {
+  games_completed_counter.Increment();
   {
     absl::MutexLock lock(&mutex_);
     win_stats_.Update(*selfplay_game->game());
+    live_game_ids_.erase(selfplay_game->game_id());
+    // The game's tree is no longer live; once recycled it's accounted for by
+    // the memory governor as a recycled tree instead.
+    tree_bytes_.erase(selfplay_game->game_id());
+  }
+
+  // Extract just what the OutputThread needs; the emptied SelfplayGame (and
+  // its tree) is recycled for the next game to start.
+  auto output = absl::make_unique<GameOutput>();
+  output->game_id = selfplay_game->game_id();
+  output->is_holdout = selfplay_game->options().is_holdout;
+  output->duration = selfplay_game->duration();
+  output->models_used = selfplay_game->models_used();
+  output->game = selfplay_game->ReleaseGame();
+
+  {
+    absl::MutexLock lock(&mutex_);
+    recycled_games_.push_back(std::move(selfplay_game));
   }
-  output_queue_.Push(std::move(selfplay_game));
+
+  // Hash the game to a worker by id: the assignment doesn't depend on which
+  // worker is busy, so a game always goes to the same worker's rotating
+  // shards and per-worker dedup sees a stable partition of the games.
+  auto& queue = output_queues_[output->game_id % output_queues_.size()];
+  queue->Push(std::move(output));
 }
 
 void Selfplayer::ExecuteSharded(std::function<void(int, int)> fn) {
   executor_.Execute(std::move(fn));
 }
 
+void Selfplayer::ExecuteBalanced(
+    int num_items, const std::function<void(int, int)>& item_fn) {
+  executor_.ExecuteBalanced(num_items, item_fn);
+}
+
 std::unique_ptr<Model> Selfplayer::AcquireModel() { return models_.Pop(); }
 
 void Selfplayer::ReleaseModel(std::unique_ptr<Model> model) {
@@ -865,41 +2469,98 @@ void Selfplayer::ReleaseModel(std::unique_ptr<Model> model) {
   }
 }
 
+std::unique_ptr<Model> Selfplayer::AcquireFastModel() {
+  if (FLAGS_fast_model.empty()) {
+    return nullptr;
+  }
+  return fast_models_.Pop();
+}
+
+void Selfplayer::ReleaseFastModel(std::unique_ptr<Model> model) {
+  fast_models_.Push(std::move(model));
+}
+
 void Selfplayer::ParseFlags() {
-  // Check that exactly one of (run_forever and num_games) is set.
-  if (FLAGS_run_forever) {
+  if (!FLAGS_coordinator.empty()) {
+    // The coordinator hands out the model and the game quota.
+    MG_CHECK(!FLAGS_run_forever)
+        << "run_forever must not be set when using a coordinator";
     MG_CHECK(FLAGS_num_games == 0)
-        << "num_games must not be set if run_forever is true";
+        << "num_games must not be set when using a coordinator";
+    MG_CHECK(FLAGS_model.empty())
+        << "model must not be set when using a coordinator";
   } else {
-    MG_CHECK(FLAGS_num_games > 0)
-        << "num_games must be set if run_forever is false";
+    // Check that exactly one of (run_forever and num_games) is set.
+    if (FLAGS_run_forever) {
+      MG_CHECK(FLAGS_num_games == 0)
+          << "num_games must not be set if run_forever is true";
+    } else {
+      MG_CHECK(FLAGS_num_games > 0)
+          << "num_games must be set if run_forever is false";
+    }
+    MG_CHECK(!FLAGS_model.empty());
   }
-  MG_CHECK(!FLAGS_model.empty());
 
-  // Clamp num_concurrent_games_per_thread to avoid a situation where a single
-  // thread ends up playing considerably more games than the others.
-  if (!FLAGS_run_forever) {
-    auto max_concurrent_games_per_thread =
-        (FLAGS_num_games + FLAGS_selfplay_threads - 1) / FLAGS_selfplay_threads;
-    FLAGS_concurrent_games_per_thread = std::min(
-        max_concurrent_games_per_thread, FLAGS_concurrent_games_per_thread);
+  MG_CHECK(FLAGS_fast_model.empty() || FLAGS_fastplay_frequency > 0)
+      << "fast_model requires a non-zero fastplay_frequency";
+
+  if (FLAGS_deterministic) {
+    MG_CHECK(FLAGS_seed != 0) << "--deterministic requires an explicit --seed";
+    MG_CHECK(FLAGS_coordinator.empty())
+        << "--deterministic doesn't support a coordinator";
+    MG_CHECK(FLAGS_model.find("%d") == std::string::npos)
+        << "--deterministic requires a fixed model, not a pattern";
+    MG_CHECK(FLAGS_num_prefetch == 0)
+        << "--deterministic doesn't support --num_prefetch: prefetched "
+           "inferences land in the shared cache";
+    MG_CHECK(FLAGS_cache_file.empty())
+        << "--deterministic doesn't support --cache_file";
   }
 
+  MG_CHECK(FLAGS_example_format == "tfrecord" ||
+           FLAGS_example_format == "columnar")
+      << "unknown example format \"" << FLAGS_example_format << "\"";
+  MG_CHECK(FLAGS_example_format == "tfrecord" || FLAGS_output_shard_mb == 0)
+      << "--output_shard_mb only supports the tfrecord example format";
+  MG_CHECK(!FLAGS_augment_examples || FLAGS_example_format == "columnar")
+      << "--augment_examples requires --example_format=columnar";
+
   tree_options_.value_init_penalty = FLAGS_value_init_penalty;
   tree_options_.policy_softmax_temp = FLAGS_policy_softmax_temp;
   tree_options_.soft_pick_enabled = true;
   num_games_remaining_ = FLAGS_num_games;
+
+  if (FLAGS_deterministic && FLAGS_cache_size_mb > 0) {
+    // The cache budget is split into private per-game caches (Run skips
+    // creating the shared cache in deterministic mode). Each thread's
+    // two-stage pipeline keeps up to two groups of games live at once.
+    int num_live_games =
+        2 * FLAGS_selfplay_threads * FLAGS_concurrent_games_per_thread;
+    deterministic_cache_capacity_ = BasicInferenceCache::CalculateCapacity(
+        std::max(1, FLAGS_cache_size_mb / num_live_games));
+  }
+
+  if (!FLAGS_checkpoint_file.empty()) {
+    next_checkpoint_time_ =
+        absl::Now() + absl::Seconds(FLAGS_checkpoint_interval_secs);
+  }
 }
 
-FeatureDescriptor Selfplayer::InitializeModels() {
-  if (FLAGS_model.find("%d") != std::string::npos) {
+FeatureDescriptor Selfplayer::InitializeModels(const std::string& model_path) {
+  if (coordinator_ == nullptr && model_path.find("%d") != std::string::npos) {
     using namespace std::placeholders;
     directory_watcher_ = absl::make_unique<DirectoryWatcher>(
-        FLAGS_model, absl::Seconds(5),
+        model_path, absl::Seconds(5),
         std::bind(&Selfplayer::CreateModels, this, _1));
-    MG_LOG(INFO) << "Waiting for model to match pattern " << FLAGS_model;
+    MG_LOG(INFO) << "Waiting for model to match pattern " << model_path;
   } else {
-    CreateModels(FLAGS_model);
+    CreateModels(model_path);
+  }
+
+  if (!FLAGS_fast_model.empty()) {
+    for (auto& model : BuildModels(FLAGS_fast_model)) {
+      fast_models_.Push(std::move(model));
+    }
   }
 
   // Get the feature descriptor from the first model loaded.
@@ -913,20 +2574,53 @@ FeatureDescriptor Selfplayer::InitializeModels() {
   return feature_descriptor;
 }
 
-void Selfplayer::CreateModels(const std::string& path) {
+std::vector<std::unique_ptr<Model>> Selfplayer::BuildModels(
+    const std::string& path) {
   MG_LOG(INFO) << "Loading model " << path;
 
   auto def = LoadModelDefinition(path);
   auto* factory = GetModelFactory(def, FLAGS_device);
 
-  auto model = factory->NewModel(def);
+  std::vector<std::unique_ptr<Model>> models;
+  models.reserve(FLAGS_parallel_inference);
+  for (int i = 0; i < FLAGS_parallel_inference; ++i) {
+    models.push_back(factory->NewModel(def));
+  }
+
+  // Run a warm-up inference on each instance so that one-time backend
+  // initialization (GPU memory pools, kernel autotuning) doesn't stall the
+  // first real batches.
+  Position warm_up_position(Color::kBlack);
+  ModelInput input;
+  input.sym = symmetry::kIdentity;
+  input.position = &warm_up_position;
+  input.stone_history.push_back(&warm_up_position.stone_snapshot());
+  ModelOutput output;
+  std::vector<const ModelInput*> inputs = {&input};
+  std::vector<ModelOutput*> outputs = {&output};
+  for (auto& model : models) {
+    model->RunMany(inputs, &outputs, nullptr);
+  }
+
+  return models;
+}
+
+void Selfplayer::CreateModels(const std::string& path) {
+  // Build the full set of new model instances before publishing any of them:
+  // loading a large model can take several seconds and the old generation
+  // keeps serving inferences the whole time.
+  auto models = BuildModels(path);
+
+  // Swap the new generation in. Once `latest_model_name_` changes, the old
+  // models are dropped as the selfplay threads release them (see
+  // ReleaseModel), so the pool never shrinks below the number of fully
+  // initialized models.
   {
     absl::MutexLock lock(&mutex_);
-    latest_model_name_ = model->name();
+    latest_model_name_ = models[0]->name();
   }
-  models_.Push(std::move(model));
-  for (int i = 1; i < FLAGS_parallel_inference; ++i) {
-    models_.Push(factory->NewModel(def));
+  for (auto& model : models) {
+    models_.Push(std::move(model));
   }
 }
 
@@ -936,81 +2630,469 @@ void Selfplayer::CheckAbortFile() {
   }
 }
 
+void Selfplayer::CheckMemoryBudget() {
+  const auto budget =
+      static_cast<size_t>(FLAGS_memory_budget_mb) * 1024 * 1024;
+
+  absl::MutexLock lock(&mutex_);
+
+  size_t tree_bytes = 0;
+  for (const auto& kv : tree_bytes_) {
+    tree_bytes += kv.second;
+  }
+  size_t recycled_bytes = 0;
+  for (const auto& selfplay_game : recycled_games_) {
+    recycled_bytes += selfplay_game->tree_bytes();
+  }
+  size_t cache_bytes = cache_capacity_ * cache_entry_bytes_;
+
+  if (tree_bytes + recycled_bytes + cache_bytes <= budget) {
+    compact_returned_trees_ = false;
+    // With headroom back (e.g. long games have finished), grow the cache
+    // back towards its configured capacity.
+    if (governed_cache_ != nullptr && cache_entry_bytes_ > 0 &&
+        cache_capacity_ < configured_cache_capacity_) {
+      auto cache_budget = budget - tree_bytes - recycled_bytes;
+      auto target = std::min(configured_cache_capacity_,
+                             cache_budget / cache_entry_bytes_);
+      if (target > cache_capacity_ && governed_cache_->SetCapacity(target)) {
+        MG_LOG(INFO) << "Memory governor: growing inference cache capacity "
+                     << cache_capacity_ << " -> " << target;
+        cache_capacity_ = target;
+      }
+    }
+    return;
+  }
+
+  // Recycled trees only exist to speed up starting new games: drop them
+  // first, they're memory we're holding onto for no pressing reason.
+  if (recycled_bytes > 0) {
+    MG_LOG(INFO) << "Memory governor: over budget, freeing " << recycled_bytes
+                 << " bytes of recycled trees";
+    recycled_games_.clear();
+    recycled_bytes = 0;
+    if (tree_bytes + cache_bytes <= budget) {
+      compact_returned_trees_ = false;
+      return;
+    }
+  }
+
+  // Next, rebalance: leave the trees their current footprint and shrink the
+  // in-memory cache towards whatever is left, down to a tenth of its
+  // configured capacity.
+  if (governed_cache_ != nullptr && cache_entry_bytes_ > 0) {
+    auto min_capacity = std::max<size_t>(1, configured_cache_capacity_ / 10);
+    auto cache_budget = budget > tree_bytes ? budget - tree_bytes : 0;
+    auto target = std::max(min_capacity, cache_budget / cache_entry_bytes_);
+    if (target < cache_capacity_ && governed_cache_->SetCapacity(target)) {
+      MG_LOG(INFO) << "Memory governor: shrinking inference cache capacity "
+                   << cache_capacity_ << " -> " << target;
+      cache_capacity_ = target;
+      cache_bytes = cache_capacity_ * cache_entry_bytes_;
+      if (tree_bytes + cache_bytes <= budget) {
+        compact_returned_trees_ = false;
+        return;
+      }
+    }
+  }
+
+  // Still over budget: compact live trees down to their active search
+  // subtrees as threads return them to the pool. The flag stays set until a
+  // later check finds the process back under budget.
+  if (!compact_returned_trees_) {
+    MG_LOG(INFO) << "Memory governor: over budget (" << tree_bytes
+                 << " tree bytes + " << cache_bytes << " cache bytes > "
+                 << budget << "), compacting search trees";
+    compact_returned_trees_ = true;
+  }
+}
+
+void Selfplayer::MaybeStartCheckpointLocked() {
+  if (FLAGS_checkpoint_file.empty() || parking_ || checkpoint_in_progress_ ||
+      absl::Now() < next_checkpoint_time_) {
+    return;
+  }
+
+  checkpoint_in_progress_ = true;
+  checkpoint_data_.clear();
+  checkpointed_game_ids_.clear();
+  num_checkpointed_games_ = 0;
+
+  // Games sitting in the pool are quiescent; grab them now in case no
+  // thread returns them before the window closes.
+  for (const auto& pooled_game : game_pool_) {
+    CheckpointGameLocked(*pooled_game.game);
+  }
+}
+
+void Selfplayer::CheckpointGameLocked(const SelfplayGame& selfplay_game) {
+  if (!checkpoint_in_progress_ ||
+      !checkpointed_game_ids_.insert(selfplay_game.game_id()).second) {
+    return;
+  }
+  AppendGameCheckpoint(selfplay_game, &checkpoint_data_);
+  num_checkpointed_games_ += 1;
+}
+
+void Selfplayer::MaybeFinishCheckpointLocked() {
+  if (!checkpoint_in_progress_) {
+    return;
+  }
+  for (int id : live_game_ids_) {
+    if (checkpointed_game_ids_.find(id) == checkpointed_game_ids_.end()) {
+      return;
+    }
+  }
+
+  std::string contents;
+  AppendPod(kCheckpointMagic, &contents);
+  AppendPod(kCheckpointVersion, &contents);
+  AppendPod(static_cast<uint32_t>(kNumMoves), &contents);
+  AppendPod(num_checkpointed_games_, &contents);
+  contents += checkpoint_data_;
+
+  // Write to a temporary file and rename it into place so that a crash
+  // mid-write never leaves a truncated checkpoint behind.
+  auto tmp_path = absl::StrCat(FLAGS_checkpoint_file, ".tmp");
+  if (!file::WriteFile(tmp_path, contents) ||
+      std::rename(tmp_path.c_str(), FLAGS_checkpoint_file.c_str()) != 0) {
+    MG_LOG(WARNING) << "couldn't write checkpoint to "
+                    << FLAGS_checkpoint_file;
+  }
+
+  checkpoint_in_progress_ = false;
+  checkpoint_data_.clear();
+  checkpointed_game_ids_.clear();
+  next_checkpoint_time_ =
+      absl::Now() + absl::Seconds(FLAGS_checkpoint_interval_secs);
+}
+
+void Selfplayer::BeginDrainLocked() {
+  draining_ = true;
+  num_games_remaining_ = 0;
+  if (FLAGS_drain_deadline_secs > 0 && !FLAGS_checkpoint_file.empty() &&
+      drain_deadline_ == absl::InfiniteFuture()) {
+    drain_deadline_ = absl::Now() + absl::Seconds(FLAGS_drain_deadline_secs);
+  }
+}
+
+bool Selfplayer::MaybeStartParkingLocked() {
+  if (!parking_) {
+    if (!draining_ || absl::Now() < drain_deadline_) {
+      return false;
+    }
+    MG_LOG(INFO) << "Drain deadline expired, checkpointing remaining "
+                    "in-flight games to "
+                 << FLAGS_checkpoint_file;
+    parking_ = true;
+    // Force a fresh checkpoint window open so that every remaining game
+    // lands in one final checkpoint at its latest move. If a periodic
+    // window was already open it's abandoned: any games it had captured are
+    // still live and will be re-serialized as they park.
+    checkpoint_in_progress_ = true;
+    checkpoint_data_.clear();
+    checkpointed_game_ids_.clear();
+    num_checkpointed_games_ = 0;
+  }
+  return true;
+}
+
+void Selfplayer::ParkGameLocked(std::unique_ptr<SelfplayGame> selfplay_game) {
+  CheckpointGameLocked(*selfplay_game);
+  // The game's id stays in `live_game_ids_` so MaybeFinishCheckpointLocked
+  // writes the final checkpoint exactly when the last in-flight game parks.
+  tree_bytes_.erase(selfplay_game->game_id());
+  num_parked_games_ += 1;
+}
+
+void Selfplayer::ResumeFromCheckpoint() {
+  std::string contents;
+  if (FLAGS_checkpoint_file.empty() ||
+      !file::FileExists(FLAGS_checkpoint_file) ||
+      !file::ReadFile(FLAGS_checkpoint_file, &contents)) {
+    return;
+  }
+
+  const char* src = contents.data();
+  const char* end = src + contents.size();
+  uint32_t magic, version, num_moves, num_games;
+  MG_CHECK(ReadPod(&src, end, &magic) && magic == kCheckpointMagic)
+      << FLAGS_checkpoint_file << " is not a checkpoint file";
+  MG_CHECK(ReadPod(&src, end, &version) && version == kCheckpointVersion)
+      << "unsupported checkpoint version";
+  MG_CHECK(ReadPod(&src, end, &num_moves) && num_moves == kNumMoves)
+      << "checkpoint was written for a different board size";
+  MG_CHECK(ReadPod(&src, end, &num_games));
+
+  std::vector<std::unique_ptr<SelfplayGame>> games;
+  games.reserve(num_games);
+  for (uint32_t i = 0; i < num_games; ++i) {
+    games.push_back(ResumeGame(&src, end));
+  }
+  MG_LOG(INFO) << "Resumed " << games.size() << " games from "
+               << FLAGS_checkpoint_file;
+
+  absl::MutexLock lock(&mutex_);
+  for (auto& selfplay_game : games) {
+    // In deterministic mode a resumed game goes back to its home thread;
+    // otherwise whichever thread gets there first picks it up.
+    int thread_id =
+        FLAGS_deterministic
+            ? (selfplay_game->game_id() - 1) % FLAGS_selfplay_threads
+            : -1;
+    game_pool_.push_back({std::move(selfplay_game), thread_id});
+  }
+}
+
+std::unique_ptr<SelfplayGame> Selfplayer::ResumeGame(const char** src,
+                                                     const char* end) {
+  Game::Options game_options;
+  MctsTree::Options tree_options;
+  SelfplayGame::Options selfplay_options;
+
+  int game_id;
+  uint8_t is_holdout, resign_enabled;
+  std::string player_name;
+  MG_CHECK(ReadPod(src, end, &game_id));
+  MG_CHECK(ReadPod(src, end, &is_holdout));
+  MG_CHECK(ReadPod(src, end, &game_options.resign_threshold));
+  MG_CHECK(ReadPod(src, end, &resign_enabled));
+  MG_CHECK(ReadPod(src, end, &game_options.komi));
+  game_options.resign_enabled = resign_enabled != 0;
+  MG_CHECK(ReadString(src, end, &player_name));
+
+  uint32_t num_models;
+  MG_CHECK(ReadPod(src, end, &num_models));
+  std::vector<std::string> models_used(num_models);
+  for (auto& model : models_used) {
+    MG_CHECK(ReadString(src, end, &model));
+  }
+
+  {
+    absl::MutexLock lock(&mutex_);
+    tree_options = tree_options_;
+    // A resumed game counts against num_games just like a new one: it was
+    // already counted by the run that checkpointed it.
+    if (!FLAGS_run_forever && num_games_remaining_ > 0) {
+      num_games_remaining_ -= 1;
+    }
+    next_game_id_ = std::max(next_game_id_, game_id + 1);
+    live_game_ids_.insert(game_id);
+    selfplay_options.private_cache_capacity = deterministic_cache_capacity_;
+  }
+
+  selfplay_options.num_virtual_losses = FLAGS_virtual_losses;
+  selfplay_options.num_readouts = FLAGS_num_readouts;
+  selfplay_options.fastplay_readouts = FLAGS_fastplay_readouts;
+  selfplay_options.fastplay_frequency = FLAGS_fastplay_frequency;
+  selfplay_options.adaptive_readouts = FLAGS_adaptive_readouts;
+  selfplay_options.certainty_q = FLAGS_certainty_q;
+  selfplay_options.noise_mix = FLAGS_noise_mix;
+  selfplay_options.dirichlet_alpha = FLAGS_dirichlet_alpha;
+  selfplay_options.is_holdout = is_holdout != 0;
+  selfplay_options.target_pruning = FLAGS_target_pruning;
+  selfplay_options.verbose = false;
+  selfplay_options.allow_pass = FLAGS_allow_pass;
+  selfplay_options.restrict_pass_alive_play_threshold =
+      FLAGS_restrict_pass_alive_play_threshold;
+  selfplay_options.deterministic = FLAGS_deterministic;
+
+  auto game = absl::make_unique<Game>(player_name, player_name, game_options);
+  auto tree =
+      absl::make_unique<MctsTree>(Position(Color::kBlack), tree_options);
+
+  uint32_t num_moves;
+  MG_CHECK(ReadPod(src, end, &num_moves));
+  for (uint32_t i = 0; i < num_moves; ++i) {
+    uint16_t raw_coord;
+    uint8_t raw_color, trainable;
+    float Q;
+    int N;
+    std::string comment;
+    MG_CHECK(ReadPod(src, end, &raw_coord));
+    MG_CHECK(ReadPod(src, end, &raw_color));
+    MG_CHECK(ReadPod(src, end, &Q));
+    MG_CHECK(ReadPod(src, end, &N));
+    MG_CHECK(ReadString(src, end, &comment));
+    MG_CHECK(ReadPod(src, end, &trainable));
+
+    Coord c(raw_coord);
+    Color color = raw_color == 0 ? Color::kBlack : Color::kWhite;
+    const auto& position = tree->root()->position();
+    if (trainable != 0) {
+      char packed[SparsePi::kPackedSize];
+      MG_CHECK(ReadBytes(src, end, packed, sizeof(packed)));
+      game->AddTrainableMove(color, c, position, std::move(comment), Q, N,
+                             SparsePi::Unpack(packed));
+    } else {
+      game->AddNonTrainableMove(color, c, position, std::move(comment), Q, N);
+    }
+    tree->PlayMove(c);
+  }
+
+  // Only live games are checkpointed, so the replayed game can't be over.
+  MG_CHECK(!tree->is_game_over());
+
+  auto selfplay_game = absl::make_unique<SelfplayGame>(
+      game_id, selfplay_options, std::move(game), std::move(tree));
+  selfplay_game->RestoreCheckpointState(std::move(models_used));
+  return selfplay_game;
+}
+
 SelfplayThread::SelfplayThread(int thread_id, Selfplayer* selfplayer,
                                std::shared_ptr<InferenceCache> cache)
     : Thread(absl::StrCat("Selfplay:", thread_id)),
       selfplayer_(selfplayer),
       cache_(std::move(cache)),
-      thread_id_(thread_id) {
-  selfplay_games_.resize(FLAGS_concurrent_games_per_thread);
-}
+      thread_id_(thread_id) {}
 
 void SelfplayThread::Run() {
-  WTF_THREAD_ENABLE("SelfplayThread");
+  TraceSampler trace_sampler("SelfplayThread");
 
-  searches_.resize(FLAGS_parallel_search);
-  while (!selfplay_games_.empty()) {
-    StartNewGames();
-    SelectLeaves();
-    auto model_name = RunInferences();
-    ProcessInferences(model_name);
-    PlayMoves();
+  for (auto& group : groups_) {
+    group.searches.resize(FLAGS_parallel_search);
+  }
+
+  int cur = 0;
+  for (;;) {
+    trace_sampler.Tick();
+
+    auto* group = &groups_[cur];
+    auto* other = &groups_[1 - cur];
+
+    // Check out the next batch of games. Try without blocking first: if no
+    // games are immediately available, the other group's games may be the
+    // only live ones left, so finish its in-flight search (which returns its
+    // games to the pool) before waiting.
+    if (!selfplayer_->CheckOutGames(thread_id_,
+                                    FLAGS_concurrent_games_per_thread,
+                                    &group->selfplay_games, /*block=*/false)) {
+      FinishSearch(other);
+      if (!selfplayer_->CheckOutGames(thread_id_,
+                                      FLAGS_concurrent_games_per_thread,
+                                      &group->selfplay_games,
+                                      /*block=*/true)) {
+        break;
+      }
+    }
+
+    // Select and submit this group's inferences, then incorporate the other
+    // group's results and play its moves while this group's batch runs on
+    // the accelerator.
+    BeginSearch(group);
+    FinishSearch(other);
+    cur = 1 - cur;
+  }
+
+  // Wait for any outstanding prefetch before the buffers it writes into are
+  // destroyed.
+  if (prefetch_done_ != nullptr) {
+    prefetch_done_->WaitForNotification();
   }
 
   MG_LOG(INFO) << "SelfplayThread " << thread_id_ << " played "
                << num_games_finished_ << " games";
+  LogPhaseStats();
 }
 
-void SelfplayThread::StartNewGames() {
-  WTF_SCOPE0("StartNewGames");
-  for (size_t i = 0; i < selfplay_games_.size();) {
-    if (selfplay_games_[i] == nullptr) {
-      // The i'th element is null, either start a new game, or remove the
-      // element from the `selfplay_games_` array.
-      bool verbose = FLAGS_verbose && thread_id_ == 0 && i == 0;
-      auto selfplay_game = selfplayer_->StartNewGame(verbose);
-      if (selfplay_game == nullptr) {
-        // There are no more games to play remove the empty i'th slot from the
-        // array. To do this without having to shuffle all the elements down,
-        // we move the last element into position i and pop off the back. After
-        // doing this, go around the loop again without incrementing i
-        // (otherwise we'd skip over the newly moved element).
-        selfplay_games_[i] = std::move(selfplay_games_.back());
-        selfplay_games_.pop_back();
-        continue;
-      } else {
-        selfplay_games_[i] = std::move(selfplay_game);
-      }
-    }
-    // We didn't remove an element from the array, iterate as normal.
-    i += 1;
+void SelfplayThread::LogPhaseStats() const {
+  MG_LOG(INFO) << "SelfplayThread " << thread_id_ << " phase latencies:"
+               << " select_leaves[" << select_leaves_latency_.ToString()
+               << "] inference_wait[" << inference_wait_latency_.ToString()
+               << "] process_inferences["
+               << process_inferences_latency_.ToString() << "] play_moves["
+               << play_moves_latency_.ToString() << "]";
+}
+
+void SelfplayThread::BeginSearch(SearchGroup* group) {
+  // Make sure the results of the previous prefetch are in the cache before
+  // selection starts looking for them.
+  MergePrefetchedInferences();
+
+  auto start = absl::Now();
+  SelectLeaves(group);
+  select_leaves_latency_.Add(absl::Now() - start);
+  group->model_name = model_->name();
+  PrefetchLeaves(group);
+
+  // The inferences submitted for this group only fill buffers owned by this
+  // thread, so the models can be released while they're still in flight.
+  selfplayer_->ReleaseModel(std::move(model_));
+  if (fast_model_ != nullptr) {
+    selfplayer_->ReleaseFastModel(std::move(fast_model_));
+  }
+}
+
+void SelfplayThread::FinishSearch(SearchGroup* group) {
+  if (group->selfplay_games.empty()) {
+    return;
   }
+
+  auto start = absl::Now();
+  RunInferences(group);
+  auto inferences_done = absl::Now();
+  ProcessInferences(group);
+  auto processing_done = absl::Now();
+  PlayMoves(group);
+  inference_wait_latency_.Add(inferences_done - start);
+  process_inferences_latency_.Add(processing_done - inferences_done);
+  play_moves_latency_.Add(absl::Now() - processing_done);
+  selfplayer_->ReturnGames(thread_id_, &group->selfplay_games);
 }
 
-void SelfplayThread::SelectLeaves() {
-  WTF_SCOPE("SelectLeaves: games", size_t)(selfplay_games_.size());
+void SelfplayThread::SelectLeaves(SearchGroup* group) {
+  WTF_SCOPE("SelectLeaves: games", size_t)(group->selfplay_games.size());
+
+  // Acquire the models up front so that each shard can submit its inferences
+  // as soon as it finishes selecting leaves.
+  model_ = selfplayer_->AcquireModel();
+  fast_model_ = selfplayer_->AcquireFastModel();
+
+  // Budget exactly `num_virtual_losses` leaf selections per game for the
+  // iteration, but share the budget across the group: games late in their
+  // move's search or late in the game (cache hits, readout target, game
+  // over) rarely fill their allotment, which chronically underfills the
+  // inference batches. Processing those stale trees first means the budget
+  // they donate to the pool is available by the time the fresh trees - the
+  // ones that can almost always turn extra budget into leaves - select.
+  std::sort(group->selfplay_games.begin(), group->selfplay_games.end(),
+            [](const std::unique_ptr<SelfplayGame>& a,
+               const std::unique_ptr<SelfplayGame>& b) {
+              return a->remaining_readouts() < b->remaining_readouts();
+            });
+  std::atomic<int> extra_budget(0);
 
   std::atomic<size_t> game_idx(0);
-  selfplayer_->ExecuteSharded([this, &game_idx](int shard_idx, int num_shards) {
+  selfplayer_->ExecuteSharded([this, group, &game_idx,
+                               &extra_budget](int shard_idx, int num_shards) {
     WTF_SCOPE0("SelectLeaf");
-    MG_CHECK(static_cast<size_t>(num_shards) == searches_.size());
+    MG_CHECK(static_cast<size_t>(num_shards) == group->searches.size());
 
     SelfplayGame::SelectLeavesStats total_stats;
 
-    auto& search = searches_[shard_idx];
+    auto& search = group->searches[shard_idx];
     search.Clear();
 
     for (;;) {
       auto i = game_idx.fetch_add(1);
-      if (i >= selfplay_games_.size()) {
+      if (i >= group->selfplay_games.size()) {
         break;
       }
 
       TreeSearch::InferenceSpan span;
-      span.selfplay_game = selfplay_games_[i].get();
-      span.pos = search.inferences.size();
-      auto stats = span.selfplay_game->SelectLeaves(cache_.get(),
-                                                    &search.inferences);
+      span.selfplay_game = group->selfplay_games[i].get();
+      // A fast move's readouts are never used as training targets, so they
+      // can run on the cheaper fast model when one is configured.
+      span.fast = fast_model_ != nullptr && span.selfplay_game->fastplay();
+      auto* inferences =
+          span.fast ? &search.fast_inferences : &search.inferences;
+      span.pos = inferences->size();
+      // Sharing unused leaf budget between games would make each game's
+      // search depend on how the others were sharded, so deterministic mode
+      // caps every game at its own allotment.
+      auto stats = span.selfplay_game->SelectLeaves(
+          GetCache(span.selfplay_game), inferences,
+          FLAGS_deterministic ? nullptr : &extra_budget);
       span.len = stats.num_leaves_queued;
       if (span.len > 0) {
         search.inference_spans.push_back(span);
@@ -1018,69 +3100,182 @@ void SelfplayThread::SelectLeaves() {
       total_stats += stats;
     }
 
-    WTF_APPEND_SCOPE("leaves, nodes, cache_hits, game_over", int, int, int, int)
+    // Submit this shard's inferences while other shards are still selecting
+    // leaves. Models that don't override RunManyAsync run the inference
+    // synchronously on this thread, which still overlaps it with the other
+    // shards' leaf selection.
+    if (!search.inferences.empty()) {
+      for (auto& x : search.inferences) {
+        search.input_ptrs.push_back(&x.input);
+        search.output_ptrs.push_back(&x.output);
+      }
+      search.inference_done = absl::make_unique<absl::Notification>();
+      auto* done = search.inference_done.get();
+      inference_batches_counter.Increment();
+      inferences_counter.Increment(search.input_ptrs.size());
+      model_->RunManyAsync(search.input_ptrs, &search.output_ptrs, nullptr,
+                           [done]() { done->Notify(); });
+    }
+    if (!search.fast_inferences.empty()) {
+      for (auto& x : search.fast_inferences) {
+        search.fast_input_ptrs.push_back(&x.input);
+        search.fast_output_ptrs.push_back(&x.output);
+      }
+      search.fast_inference_done = absl::make_unique<absl::Notification>();
+      auto* done = search.fast_inference_done.get();
+      inference_batches_counter.Increment();
+      inferences_counter.Increment(search.fast_input_ptrs.size());
+      fast_model_->RunManyAsync(search.fast_input_ptrs,
+                                &search.fast_output_ptrs, nullptr,
+                                [done]() { done->Notify(); });
+    }
+
+    WTF_APPEND_SCOPE("leaves, nodes, cache_hits, game_over, collisions", int,
+                     int, int, int, int)
     (total_stats.num_leaves_queued, total_stats.num_nodes_selected,
-     total_stats.num_cache_hits, total_stats.num_game_over_leaves);
+     total_stats.num_cache_hits, total_stats.num_game_over_leaves,
+     total_stats.num_collisions);
+
+    // One batched increment per shard rather than one per leaf.
+    nodes_selected_counter.Increment(total_stats.num_nodes_selected);
+    leaves_queued_counter.Increment(total_stats.num_leaves_queued);
+    cache_hits_counter.Increment(total_stats.num_cache_hits);
+    leaf_collisions_counter.Increment(total_stats.num_collisions);
   });
 }
 
-std::string SelfplayThread::RunInferences() {
+void SelfplayThread::RunInferences(SearchGroup* group) {
   WTF_SCOPE0("RunInferences");
 
-  // TODO(tommadams): stop allocating theses temporary vectors.
-  std::vector<const ModelInput*> input_ptrs;
-  std::vector<ModelOutput*> output_ptrs;
-  for (auto& s : searches_) {
-    for (auto& x : s.inferences) {
-      input_ptrs.push_back(&x.input);
-      output_ptrs.push_back(&x.output);
+  // The inferences were submitted asynchronously by SelectLeaves: wait for
+  // them all to complete.
+  for (auto& s : group->searches) {
+    if (s.inference_done != nullptr) {
+      s.inference_done->WaitForNotification();
+    }
+    if (s.fast_inference_done != nullptr) {
+      s.fast_inference_done->WaitForNotification();
     }
   }
-
-  if (input_ptrs.empty()) {
-    return {};
-  }
-
-  std::string model_name;
-  auto model = selfplayer_->AcquireModel();
-  model->RunMany(input_ptrs, &output_ptrs, nullptr);
-  model_name = model->name();
-  selfplayer_->ReleaseModel(std::move(model));
-  return model_name;
 }
 
-void SelfplayThread::ProcessInferences(const std::string& model_name) {
+void SelfplayThread::ProcessInferences(SearchGroup* group) {
   {
     WTF_SCOPE0("UpdateCache");
-    for (auto& s : searches_) {
-      for (auto& inference : s.inferences) {
-        cache_->Merge(inference.cache_key, inference.leaf->canonical_symmetry,
-                      inference.input.sym, &inference.output);
+    // Only the full model's results are merged; fast-model evaluations are
+    // incorporated into their own game's tree but deliberately kept out of
+    // the shared cache so that full-readout searches never consume them.
+    for (auto& s : group->searches) {
+      for (const auto& span : s.inference_spans) {
+        if (span.fast) {
+          continue;
+        }
+        auto* cache = GetCache(span.selfplay_game);
+        for (auto& inference :
+             absl::MakeSpan(s.inferences).subspan(span.pos, span.len)) {
+          cache->Merge(inference.cache_key,
+                       inference.leaf->canonical_symmetry,
+                       inference.input.sym, &inference.output);
+        }
       }
     }
   }
 
   {
     WTF_SCOPE0("ProcessInferences");
-    for (auto& s : searches_) {
+    // Each span's tree updates touch only its own game's tree and each game
+    // has at most one span, so the spans can be processed in parallel. The
+    // cost per span varies with how many inferences the game queued, so the
+    // work is spread with stealing rather than static slices.
+    struct SpanRef {
+      TreeSearch* search;
+      const TreeSearch::InferenceSpan* span;
+    };
+    std::vector<SpanRef> spans;
+    for (auto& s : group->searches) {
       for (const auto& span : s.inference_spans) {
-        span.selfplay_game->ProcessInferences(
-            model_name,
-            absl::MakeSpan(s.inferences).subspan(span.pos, span.len));
+        spans.push_back({&s, &span});
       }
     }
+    selfplayer_->ExecuteBalanced(
+        static_cast<int>(spans.size()),
+        [group, &spans](int item, int shard_idx) {
+          const auto& x = spans[item];
+          auto& inferences =
+              x.span->fast ? x.search->fast_inferences : x.search->inferences;
+          // Fast-model spans pass an empty model name: fast moves aren't
+          // trainable, so the fast model shouldn't show up in the game's
+          // models_used metadata.
+          x.span->selfplay_game->ProcessInferences(
+              x.span->fast ? std::string() : group->model_name,
+              absl::MakeSpan(inferences).subspan(x.span->pos, x.span->len));
+        });
   }
 }
 
-void SelfplayThread::PlayMoves() {
+void SelfplayThread::PrefetchLeaves(SearchGroup* group) {
+  if (FLAGS_num_prefetch > 0) {
+    WTF_SCOPE0("PrefetchLeaves");
+    MG_CHECK(prefetch_done_ == nullptr);
+
+    for (auto& selfplay_game : group->selfplay_games) {
+      selfplay_game->SelectPrefetchLeaves(FLAGS_num_prefetch, cache_.get(),
+                                          &prefetches_);
+    }
+
+    // Now that `prefetches_` won't grow any more it's safe to take pointers
+    // into it. Each request's position and stone history point at the copies
+    // the request owns, so the inference stays valid even if its game
+    // finishes before the batch runs.
+    for (auto& prefetch : prefetches_) {
+      prefetch.input.position = &prefetch.position;
+      prefetch.input.stone_history.clear();
+      for (const auto& snapshot : prefetch.snapshots) {
+        prefetch.input.stone_history.push_back(&snapshot);
+      }
+      prefetch_input_ptrs_.push_back(&prefetch.input);
+      prefetch_output_ptrs_.push_back(&prefetch.output);
+    }
+
+    if (!prefetch_input_ptrs_.empty()) {
+      prefetch_done_ = absl::make_unique<absl::Notification>();
+      auto* done = prefetch_done_.get();
+      inference_batches_counter.Increment();
+      inferences_counter.Increment(prefetch_input_ptrs_.size());
+      model_->RunManyAsync(prefetch_input_ptrs_, &prefetch_output_ptrs_,
+                           nullptr, [done]() { done->Notify(); });
+    }
+  }
+}
+
+void SelfplayThread::MergePrefetchedInferences() {
+  if (prefetch_done_ == nullptr) {
+    return;
+  }
+
+  WTF_SCOPE("MergePrefetches: inferences", size_t)(prefetches_.size());
+  prefetch_done_->WaitForNotification();
+  prefetch_done_ = nullptr;
+
+  for (auto& prefetch : prefetches_) {
+    cache_->Merge(prefetch.cache_key, prefetch.canonical_sym,
+                  prefetch.input.sym, &prefetch.output);
+  }
+  prefetches_.clear();
+  prefetch_input_ptrs_.clear();
+  prefetch_output_ptrs_.clear();
+}
+
+void SelfplayThread::PlayMoves(SearchGroup* group) {
   WTF_SCOPE0("PlayMoves");
 
-  for (auto& selfplay_game : selfplay_games_) {
+  for (auto& selfplay_game : group->selfplay_games) {
     if (!selfplay_game->MaybePlayMove()) {
       continue;
     }
     if (selfplay_game->options().verbose && FLAGS_cache_size_mb > 0) {
-      MG_LOG(INFO) << "Inference cache stats: " << cache_->GetStats();
+      MG_LOG(INFO) << "Inference cache stats: "
+                   << GetCache(selfplay_game.get())->GetStats();
     }
     if (selfplay_game->game()->game_over()) {
       selfplayer_->EndGame(std::move(selfplay_game));
@@ -1092,30 +3287,71 @@ void SelfplayThread::PlayMoves() {
 
 OutputThread::OutputThread(
     int thread_id, FeatureDescriptor feature_descriptor,
-    ThreadSafeQueue<std::unique_ptr<SelfplayGame>>* output_queue)
+    LockFreeQueue<std::unique_ptr<GameOutput>>* output_queue,
+    CoordinatorClient* coordinator)
     : Thread(absl::StrCat("Output:", thread_id)),
       output_queue_(output_queue),
+      coordinator_(coordinator),
       output_dir_(FLAGS_output_dir),
       holdout_dir_(FLAGS_holdout_dir),
       sgf_dir_(FLAGS_sgf_dir),
-      feature_descriptor_(std::move(feature_descriptor)) {}
+      feature_descriptor_(std::move(feature_descriptor)) {
+  if (FLAGS_output_shard_mb > 0) {
+    // Each output thread writes its own shards; GetOutputName makes the
+    // stems unique across workers too.
+    auto stem = GetOutputName(thread_id);
+    auto max_bytes = static_cast<size_t>(FLAGS_output_shard_mb) * 1024 * 1024;
+    auto max_age = absl::Seconds(FLAGS_output_shard_secs);
+    example_shards_ = absl::make_unique<tf_utils::ShardedExampleWriter>(
+        stem, max_bytes, max_age, &async_writer_);
+    holdout_shards_ = absl::make_unique<tf_utils::ShardedExampleWriter>(
+        stem, max_bytes, max_age, &async_writer_);
+  }
+}
 
 void OutputThread::Run() {
   for (;;) {
-    auto selfplay_game = output_queue_->Pop();
-    if (selfplay_game == nullptr) {
+    auto output = output_queue_->Pop();
+    if (output == nullptr) {
       break;
     }
-    WriteOutputs(std::move(selfplay_game));
+    WriteOutputs(std::move(output));
   }
 }
 
-void OutputThread::WriteOutputs(std::unique_ptr<SelfplayGame> selfplay_game) {
+void OutputThread::DedupExamples(Game* game) {
+  for (const auto& move : game->moves()) {
+    if (!move->is_trainable()) {
+      continue;
+    }
+    // Key on the stone hash plus the side to play: transpositions reached by
+    // different move orders dedup together, while the same stones with the
+    // other player to move (a genuinely different training example) don't.
+    auto key = move->position.stone_hash() ^
+               zobrist::ToPlayHash(move->position.to_play());
+    if (!example_positions_written_.insert(key).second) {
+      // First seen wins: demote repeats to non-trainable so the example
+      // writers skip them.
+      move->search_pi = absl::nullopt;
+      examples_deduped_counter.Increment();
+    }
+  }
+}
+
+void OutputThread::WriteOutputs(std::unique_ptr<GameOutput> output) {
   auto now = absl::Now();
-  auto output_name = GetOutputName(selfplay_game->game_id());
-  auto* game = selfplay_game->game();
+  auto output_name = GetOutputName(output->game_id);
+  auto* game = output->game.get();
   if (FLAGS_verbose) {
-    LogEndGameInfo(*game, selfplay_game->duration());
+    LogEndGameInfo(*game, output->duration);
+  }
+
+  // Dedup before anything else can see the game: the SGF writes below hand
+  // the game to the async writer's threads, after which it must not be
+  // mutated. Holdout games are never deduped: they're a validation sample
+  // and should keep the real position distribution.
+  if (FLAGS_dedup_examples && !output->is_holdout && !output_dir_.empty()) {
+    DedupExamples(game);
   }
 
   // Take the player name from the last model used to play a move. This is
@@ -1123,22 +3359,58 @@ void OutputThread::WriteOutputs(std::unique_ptr<SelfplayGame> selfplay_game) {
   // be played by a model before training a new one. By assigned a game to
   // the last model used to play a move rather than the first, training waits
   // for less time and so we produce new models more quickly.
-  const auto& models_used = selfplay_game->models_used();
+  const auto& models_used = output->models_used;
   const auto& player_name =
       !models_used.empty() ? models_used.back() : game->black_name();
 
-  if (!sgf_dir_.empty()) {
-    WriteSgf(GetOutputDir(now, player_name, file::JoinPath(sgf_dir_, "clean")),
-             output_name, *game, false);
-    WriteSgf(GetOutputDir(now, player_name, file::JoinPath(sgf_dir_, "full")),
-             output_name, *game, true);
+  // Stream the game record to the coordinator before queueing the file
+  // writes, so it learns of the completed game without waiting on storage.
+  if (coordinator_ != nullptr) {
+    coordinator_->ReportGame(output_name, player_name, game->result_string(),
+                             game->num_moves(),
+                             MakeSgfString(*game, false));
+  }
+
+  // The game is shared with the async writer, which formats the SGF strings
+  // on its own threads after WriteOutputs returns. Hold a reference for the
+  // rest of this function so the example writes below can't race the writer
+  // dropping the last one.
+  std::shared_ptr<const Game> shared_game = std::move(output->game);
+  if (!sgf_dir_.empty() &&
+      ShouldWriteSgf(*game, output->game_id, FLAGS_sgf_sample_period)) {
+    WriteSgfAsync(
+        GetOutputDir(now, player_name, file::JoinPath(sgf_dir_, "clean")),
+        output_name, shared_game, false, &async_writer_);
+    WriteSgfAsync(
+        GetOutputDir(now, player_name, file::JoinPath(sgf_dir_, "full")),
+        output_name, shared_game, true, &async_writer_);
   }
 
-  const auto& example_dir =
-      selfplay_game->options().is_holdout ? holdout_dir_ : output_dir_;
+  const auto& example_dir = output->is_holdout ? holdout_dir_ : output_dir_;
   if (!example_dir.empty()) {
-    tf_utils::WriteGameExamples(GetOutputDir(now, player_name, example_dir),
-                                output_name, feature_descriptor_, *game);
+    int num_trainable = 0;
+    for (const auto& move : game->moves()) {
+      num_trainable += move->is_trainable() ? 1 : 0;
+    }
+
+    // Holdout games are a validation sample and keep the real position
+    // distribution, so they're written unaugmented. ParseFlags checks that
+    // --augment_examples implies the columnar format.
+    const bool augment = FLAGS_augment_examples && !output->is_holdout;
+    examples_written_counter.Increment(
+        augment ? num_trainable * symmetry::kNumSymmetries : num_trainable);
+
+    auto game_dir = GetOutputDir(now, player_name, example_dir);
+    if (example_shards_ != nullptr) {
+      auto& shards = output->is_holdout ? holdout_shards_ : example_shards_;
+      shards->Write(game_dir, feature_descriptor_, *game);
+    } else if (FLAGS_example_format == "columnar") {
+      columnar::WriteGameExamples(game_dir, output_name, feature_descriptor_,
+                                  *game, augment, &async_writer_);
+    } else {
+      tf_utils::WriteGameExamples(game_dir, output_name, feature_descriptor_,
+                                  *game, &async_writer_);
+    }
   }
 }
 
@@ -1147,7 +3419,8 @@ void OutputThread::WriteOutputs(std::unique_ptr<SelfplayGame> selfplay_game) {
 
 int main(int argc, char* argv[]) {
   minigo::Init(&argc, &argv);
-  minigo::zobrist::Init(FLAGS_seed);
+  minigo::SetModelCacheDir(FLAGS_model_cache_dir);
+  minigo::TraceSampler::SetPeriod(FLAGS_trace_sample_period);
 
   {
     minigo::Selfplayer selfplayer;
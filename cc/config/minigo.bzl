@@ -9,11 +9,29 @@ def _board_size_copts():
         "//conditions:default": ["-DMINIGO_BOARD_SIZE=19"],
     })
 
+# Defines the preprocessor macro MG_DISABLE_HOT_CHECKS, which compiles out
+# MG_HOT_CHECK assertions (see cc/logging.h), when bazel build is invoked
+# with --define=hot_checks=0.
+def _hot_check_copts():
+    return select({
+        "//cc/config:disable_hot_checks": ["-DMG_DISABLE_HOT_CHECKS"],
+        "//conditions:default": [],
+    })
+
+# Defines the preprocessor macro MG_FP16_PRIORS, which stores MCTS priors in
+# half precision (see MctsNode::EdgeStats in cc/mcts_tree.h), when bazel
+# build is invoked with --define=fp16_priors=1.
+def _fp16_prior_copts():
+    return select({
+        "//cc/config:fp16_priors": ["-DMG_FP16_PRIORS"],
+        "//conditions:default": [],
+    })
+
 # Generates a cc_binary target that defines MINIGO_BOARD_SIZE.
 def minigo_cc_binary(name, copts = [], **kwargs):
     native.cc_binary(
         name = name,
-        copts = _board_size_copts() + copts,
+        copts = _board_size_copts() + _hot_check_copts() + _fp16_prior_copts() + copts,
         **kwargs
     )
 
@@ -21,7 +39,7 @@ def minigo_cc_binary(name, copts = [], **kwargs):
 def minigo_cc_library(name, copts = [], **kwargs):
     native.cc_library(
         name = name,
-        copts = _board_size_copts() + copts,
+        copts = _board_size_copts() + _hot_check_copts() + _fp16_prior_copts() + copts,
         **kwargs
     )
 
@@ -30,7 +48,7 @@ def minigo_cc_test(name, size = "small", copts = [], **kwargs):
     native.cc_test(
         name = name,
         size = size,
-        copts = _board_size_copts() + copts,
+        copts = _board_size_copts() + _hot_check_copts() + _fp16_prior_copts() + copts,
         **kwargs
     )
 
@@ -50,7 +68,7 @@ def minigo_cc_test_9_only(name, srcs, size = "small", deps = [], copts = [], **k
             "//cc/config:minigo9": deps,
             "//conditions:default": ["@com_google_googletest//:gtest_main"],
         }),
-        copts = _board_size_copts() + copts,
+        copts = _board_size_copts() + _hot_check_copts() + _fp16_prior_copts() + copts,
         **kwargs
     )
 
@@ -70,7 +88,7 @@ def minigo_cc_test_19_only(name, srcs, size = "small", deps = [], copts = [], **
             "//cc/config:minigo9": ["@com_google_googletest//:gtest_main"],
             "//conditions:default": deps,
         }),
-        copts = _board_size_copts() + copts,
+        copts = _board_size_copts() + _hot_check_copts() + _fp16_prior_copts() + copts,
         **kwargs
     )
 
@@ -84,11 +102,17 @@ minigo_engine_copts = select({
 }) + select({
     "//cc/config:enable_tpu": ["-DMG_ENABLE_TPU_DUAL_NET"],
     "//conditions:default": [],
+}) + select({
+    "//cc/config:enable_trt": ["-DMG_ENABLE_TRT_DUAL_NET"],
+    "//conditions:default": [],
 })
 
 # dependencies for enabled inference engines.
 minigo_engine_deps = select({
-    "//cc/config:enable_tf": ["//cc/dual_net:tf_dual_net"],
+    "//cc/config:enable_tf": [
+        "//cc/dual_net:remote_dual_net",
+        "//cc/dual_net:tf_dual_net",
+    ],
     "//conditions:default": [],
 }) + select({
     "//cc/config:enable_lite": ["//cc/dual_net:lite_dual_net"],
@@ -96,5 +120,8 @@ minigo_engine_deps = select({
 }) + select({
     "//cc/config:enable_tpu": ["//cc/dual_net:tpu_dual_net"],
     "//conditions:default": [],
+}) + select({
+    "//cc/config:enable_trt": ["//cc/dual_net:trt_dual_net"],
+    "//conditions:default": [],
 })
 
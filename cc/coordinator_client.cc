@@ -0,0 +1,204 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/coordinator_client.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_split.h"
+#include "cc/constants.h"
+#include "cc/logging.h"
+
+namespace minigo {
+
+std::unique_ptr<CoordinatorClient> CoordinatorClient::Connect(
+    const std::string& address) {
+  std::pair<std::string, std::string> host_port =
+      absl::StrSplit(address, ':');
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo* infos;
+  int err = getaddrinfo(host_port.first.c_str(), host_port.second.c_str(),
+                        &hints, &infos);
+  if (err != 0) {
+    MG_LOG(ERROR) << "can't resolve coordinator address " << address << ": "
+                  << gai_strerror(err);
+    return nullptr;
+  }
+
+  int fd = -1;
+  for (addrinfo* info = infos; info != nullptr; info = info->ai_next) {
+    fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (fd == -1) {
+      continue;
+    }
+    if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(infos);
+
+  if (fd == -1) {
+    MG_LOG(ERROR) << "can't connect to coordinator at " << address;
+    return nullptr;
+  }
+
+  MG_LOG(INFO) << "Connected to coordinator at " << address;
+  return absl::WrapUnique(new CoordinatorClient(fd));
+}
+
+CoordinatorClient::CoordinatorClient(int fd) : fd_(fd) {}
+
+CoordinatorClient::~CoordinatorClient() { Close(); }
+
+void CoordinatorClient::Register(int num_selfplay_threads) {
+  char hostname[256];
+  if (gethostname(hostname, sizeof(hostname)) != 0) {
+    hostname[0] = '\0';
+  }
+  hostname[sizeof(hostname) - 1] = '\0';
+
+  nlohmann::json msg = {
+      {"type", "register"},
+      {"hostname", hostname},
+      {"pid", getpid()},
+      {"board_size", kN},
+      {"selfplay_threads", num_selfplay_threads},
+  };
+  SendMessage(msg);
+}
+
+CoordinatorClient::Command CoordinatorClient::WaitForCommand(
+    Assignment* assignment) {
+  nlohmann::json msg;
+  while (ReadMessage(&msg)) {
+    auto type = msg.value("type", "");
+    if (type == "shutdown") {
+      return Command::kShutdown;
+    }
+    if (type == "drain") {
+      return Command::kDrain;
+    }
+    if (type == "abort") {
+      return Command::kAbort;
+    }
+    if (type != "assign") {
+      MG_LOG(WARNING) << "ignoring unexpected coordinator message " << msg;
+      continue;
+    }
+    assignment->model = msg.value("model", "");
+    assignment->num_games = msg.value("num_games", 0);
+    if (assignment->model.empty()) {
+      MG_LOG(WARNING) << "ignoring assignment without a model " << msg;
+      continue;
+    }
+    return Command::kAssign;
+  }
+  return Command::kShutdown;
+}
+
+void CoordinatorClient::ReportGame(const std::string& name,
+                                   const std::string& model,
+                                   const std::string& result, int num_moves,
+                                   const std::string& sgf) {
+  nlohmann::json msg = {
+      {"type", "game"},   {"name", name},
+      {"model", model},   {"result", result},
+      {"num_moves", num_moves}, {"sgf", sgf},
+  };
+  SendMessage(msg);
+}
+
+void CoordinatorClient::Close() {
+  absl::MutexLock lock(&send_mutex_);
+  if (fd_ != -1) {
+    // shutdown rather than close so a concurrent ReadMessage call sees EOF
+    // instead of reading from a recycled descriptor.
+    shutdown(fd_, SHUT_RDWR);
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void CoordinatorClient::SendMessage(const nlohmann::json& msg) {
+  auto line = msg.dump();
+  line.push_back('\n');
+
+  absl::MutexLock lock(&send_mutex_);
+  if (fd_ == -1) {
+    return;
+  }
+  size_t sent = 0;
+  while (sent < line.size()) {
+    auto n = send(fd_, line.data() + sent, line.size() - sent, 0);
+    if (n <= 0) {
+      MG_LOG(WARNING) << "error sending to coordinator, closing connection";
+      shutdown(fd_, SHUT_RDWR);
+      close(fd_);
+      fd_ = -1;
+      return;
+    }
+    sent += n;
+  }
+}
+
+bool CoordinatorClient::ReadMessage(nlohmann::json* msg) {
+  for (;;) {
+    auto newline = read_buffer_.find('\n');
+    if (newline != std::string::npos) {
+      auto line = read_buffer_.substr(0, newline);
+      read_buffer_.erase(0, newline + 1);
+      if (line.empty()) {
+        continue;
+      }
+      *msg = nlohmann::json::parse(line, nullptr, /*allow_exceptions=*/false);
+      if (msg->is_discarded()) {
+        MG_LOG(WARNING) << "ignoring malformed coordinator message \"" << line
+                        << "\"";
+        continue;
+      }
+      return true;
+    }
+
+    int fd;
+    {
+      absl::MutexLock lock(&send_mutex_);
+      fd = fd_;
+    }
+    if (fd == -1) {
+      return false;
+    }
+    char buffer[4096];
+    auto n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      return false;
+    }
+    read_buffer_.append(buffer, n);
+  }
+}
+
+}  // namespace minigo
@@ -0,0 +1,125 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_COORDINATOR_CLIENT_H_
+#define CC_COORDINATOR_CLIENT_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/synchronization/mutex.h"
+#include "cc/json.h"
+
+namespace minigo {
+
+// Client for the selfplay coordinator, which replaces the file-based worker
+// coordination (model discovery via DirectoryWatcher, completion discovery
+// by the RL loop polling storage) with a persistent connection: workers
+// register, receive their model pointer and game quota, and stream a record
+// of each completed game back as soon as it finishes.
+//
+// The protocol is newline-delimited JSON over TCP. Every message is a single
+// JSON object on one line with a "type" field:
+//
+//   worker -> coordinator:
+//     {"type": "register", "hostname": ..., "pid": ..., "board_size": ...,
+//      "selfplay_threads": ...}
+//     {"type": "game", "name": ..., "model": ..., "result": ...,
+//      "num_moves": ..., "sgf": ...}
+//
+//   coordinator -> worker:
+//     {"type": "assign", "model": <path>, "num_games": <n>}
+//     {"type": "drain"}
+//     {"type": "abort"}
+//     {"type": "shutdown"}
+//
+// The coordinator may send further "assign" messages at any time to point
+// workers at a newly trained model or top up their quota; "model" is a
+// storage path, so the (large) model data itself still comes from shared
+// storage. Training examples are also still written to storage: only the
+// per-game completion record (including its SGF) is streamed, which is what
+// the RL loop needs to stop polling.
+//
+// Sending is thread safe; ReadMessage must only be called from one thread.
+// Uses POSIX sockets, so like the shared memory inference buffer this is
+// not available on Windows.
+class CoordinatorClient {
+ public:
+  // A unit of work received from the coordinator.
+  struct Assignment {
+    // Path of the model to play with.
+    std::string model;
+
+    // Number of games to add to the worker's quota.
+    int num_games = 0;
+  };
+
+  // Commands pushed by the coordinator.
+  enum class Command {
+    // A new Assignment; more work and possibly a new model.
+    kAssign,
+
+    // Finish in-flight games but start no new ones.
+    kDrain,
+
+    // Kill the process immediately, abandoning in-flight games.
+    kAbort,
+
+    // The run is over (also returned when the connection closes).
+    kShutdown,
+  };
+
+  // Connects to the coordinator at `address` ("host:port").
+  // Returns nullptr on failure.
+  static std::unique_ptr<CoordinatorClient> Connect(const std::string& address);
+
+  ~CoordinatorClient();
+
+  // Sends the registration message describing this worker.
+  void Register(int num_selfplay_threads);
+
+  // Blocks until the coordinator sends the next command, filling in
+  // `assignment` when it returns kAssign.
+  Command WaitForCommand(Assignment* assignment);
+
+  // Streams one completed game's record back to the coordinator.
+  // Thread safe.
+  void ReportGame(const std::string& name, const std::string& model,
+                  const std::string& result, int num_moves,
+                  const std::string& sgf);
+
+  // Shuts the connection down, unblocking any WaitForCommand call.
+  void Close();
+
+ private:
+  explicit CoordinatorClient(int fd);
+
+  // Sends one message as a single JSON line. Thread safe.
+  void SendMessage(const nlohmann::json& msg) LOCKS_EXCLUDED(&send_mutex_);
+
+  // Reads the next message, skipping lines that don't parse.
+  // Returns false when the connection is closed.
+  bool ReadMessage(nlohmann::json* msg);
+
+  absl::Mutex send_mutex_;
+  int fd_ GUARDED_BY(&send_mutex_);
+
+  // Carries bytes read past the previous newline over to the next
+  // ReadMessage call.
+  std::string read_buffer_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_COORDINATOR_CLIENT_H_
@@ -0,0 +1,201 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/corpus_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "cc/constants.h"
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr char kMagic[8] = {'m', 'g', 'i', 'n', 'd', 'e', 'x', 0};
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t board_size;
+  uint64_t num_games;
+  uint64_t num_positions;
+};
+
+template <typename T>
+void AppendPod(const T& src, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&src), sizeof(src));
+}
+
+template <typename T>
+bool ReadPod(const char** src, const char* end, T* dst) {
+  if (static_cast<size_t>(end - *src) < sizeof(*dst)) {
+    return false;
+  }
+  memcpy(dst, *src, sizeof(*dst));
+  *src += sizeof(*dst);
+  return true;
+}
+
+void AppendString(const std::string& src, std::string* dst) {
+  AppendPod(static_cast<uint32_t>(src.size()), dst);
+  dst->append(src);
+}
+
+bool ReadString(const char** src, const char* end, std::string* dst) {
+  uint32_t size;
+  if (!ReadPod(src, end, &size) ||
+      static_cast<size_t>(end - *src) < size) {
+    return false;
+  }
+  dst->assign(*src, size);
+  *src += size;
+  return true;
+}
+
+}  // namespace
+
+bool CorpusIndex::Load(const std::string& path) {
+  std::string contents;
+  if (!file::ReadFile(path, &contents)) {
+    return false;
+  }
+
+  const char* src = contents.data();
+  const char* end = src + contents.size();
+  Header header;
+  if (!ReadPod(&src, end, &header) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    MG_LOG(WARNING) << path << " is not a corpus index";
+    return false;
+  }
+  if (header.version != kVersion) {
+    MG_LOG(WARNING) << path << " has unsupported version " << header.version;
+    return false;
+  }
+  if (header.board_size != kN) {
+    MG_LOG(WARNING) << path << " is for board size " << header.board_size
+                    << ", expected " << kN;
+    return false;
+  }
+
+  games_.clear();
+  games_.reserve(header.num_games);
+  for (uint64_t i = 0; i < header.num_games; ++i) {
+    Game game;
+    if (!ReadString(&src, end, &game.path) ||
+        !ReadPod(&src, end, &game.byte_offset) ||
+        !ReadPod(&src, end, &game.num_moves) ||
+        !ReadString(&src, end, &game.result)) {
+      MG_LOG(WARNING) << path << " is truncated";
+      return false;
+    }
+    games_.push_back(std::move(game));
+  }
+
+  entries_.clear();
+  entries_.reserve(header.num_positions);
+  for (uint64_t i = 0; i < header.num_positions; ++i) {
+    zobrist::Hash key;
+    uint32_t num_hits;
+    if (!ReadPod(&src, end, &key) || !ReadPod(&src, end, &num_hits)) {
+      MG_LOG(WARNING) << path << " is truncated";
+      return false;
+    }
+    auto& entry = entries_[key];
+    entry.reserve(num_hits);
+    for (uint32_t j = 0; j < num_hits; ++j) {
+      Hit hit;
+      if (!ReadPod(&src, end, &hit.game) ||
+          !ReadPod(&src, end, &hit.move_number) || hit.game >= games_.size() ||
+          hit.move_number > games_[hit.game].num_moves) {
+        MG_LOG(WARNING) << path << " is corrupt";
+        return false;
+      }
+      entry.push_back(hit);
+    }
+    // Serialize writes hits sorted, but don't trust the file.
+    std::sort(entry.begin(), entry.end(), [](const Hit& a, const Hit& b) {
+      return a.game != b.game ? a.game < b.game
+                              : a.move_number < b.move_number;
+    });
+  }
+  return true;
+}
+
+const CorpusIndex::Entry* CorpusIndex::Lookup(zobrist::Hash key) const {
+  auto it = entries_.find(key);
+  return it == entries_.end() ? nullptr : &it->second;
+}
+
+uint32_t CorpusIndex::AddGame(Game game) {
+  games_.push_back(std::move(game));
+  return static_cast<uint32_t>(games_.size() - 1);
+}
+
+void CorpusIndex::AddPosition(zobrist::Hash key, uint32_t game,
+                              uint32_t move_number) {
+  MG_CHECK(game < games_.size());
+  MG_CHECK(move_number <= games_[game].num_moves);
+  entries_[key].push_back({game, move_number});
+}
+
+std::string CorpusIndex::Serialize() const {
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.board_size = kN;
+  header.num_games = games_.size();
+  header.num_positions = entries_.size();
+
+  std::string contents;
+  contents.reserve(sizeof(header) + games_.size() * 64 +
+                   entries_.size() * 32);
+  AppendPod(header, &contents);
+
+  for (const auto& game : games_) {
+    AppendString(game.path, &contents);
+    AppendPod(game.byte_offset, &contents);
+    AppendPod(game.num_moves, &contents);
+    AppendString(game.result, &contents);
+  }
+
+  std::vector<zobrist::Hash> keys;
+  keys.reserve(entries_.size());
+  for (const auto& kv : entries_) {
+    keys.push_back(kv.first);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  for (auto key : keys) {
+    auto entry = entries_.at(key);
+    std::sort(entry.begin(), entry.end(), [](const Hit& a, const Hit& b) {
+      return a.game != b.game ? a.game < b.game
+                              : a.move_number < b.move_number;
+    });
+    AppendPod(key, &contents);
+    AppendPod(static_cast<uint32_t>(entry.size()), &contents);
+    for (const auto& hit : entry) {
+      AppendPod(hit.game, &contents);
+      AppendPod(hit.move_number, &contents);
+    }
+  }
+  return contents;
+}
+
+}  // namespace minigo
@@ -0,0 +1,113 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_CORPUS_INDEX_H_
+#define CC_CORPUS_INDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cc/platform/utils.h"
+#include "cc/position.h"
+#include "cc/zobrist.h"
+
+namespace minigo {
+
+// An index over a corpus of game records. Analysis tools like replay_games.cc
+// answer every query by re-parsing and replaying the whole corpus; the index
+// is built in one such sweep (by index_corpus.cc) and then answers "which
+// games reached this position, and where do they live?" from a single small
+// file, so queries only open the matching game records.
+//
+// Each indexed game records where it lives (path and byte offset within the
+// file, for archives that hold several games), its length and its result.
+// Positions are keyed by Position::stone_hash() — the Zobrist hash of the
+// stones alone, ignoring side to move and ko, which is what corpus queries
+// want — and are sampled at a move stride chosen by the indexing tool, so a
+// lookup that misses can still be answered by replaying only the games whose
+// sampled positions match a nearby position.
+//
+// Like the opening book, hashes come from the compile-time Zobrist tables and
+// so are safe to store in a file.
+class CorpusIndex {
+ public:
+  // One indexed game record.
+  struct Game {
+    // File the game lives in.
+    std::string path;
+
+    // Byte offset of the game's record within the file; zero for formats
+    // that hold one game per file, like our selfplay SGFs.
+    uint64_t byte_offset = 0;
+
+    // Number of moves in the game's main line.
+    uint32_t num_moves = 0;
+
+    // The game's result, e.g. "B+R"; empty if the record didn't have one.
+    std::string result;
+  };
+
+  // One occurrence of an indexed position.
+  struct Hit {
+    // Index into games().
+    uint32_t game;
+
+    // The position arose after this many moves of the game's main line.
+    uint32_t move_number;
+  };
+
+  // The occurrences recorded for one position, sorted by ascending
+  // (game, move_number).
+  using Entry = std::vector<Hit>;
+
+  // Returns the index key for a position.
+  static zobrist::Hash KeyHash(const Position& position) {
+    return position.stone_hash();
+  }
+
+  // Loads an index written by Serialize, returning false on failure.
+  MG_WARN_UNUSED_RESULT bool Load(const std::string& path);
+
+  // Returns the occurrences of the position with the given key, or nullptr
+  // if the position isn't in the index.
+  const Entry* Lookup(zobrist::Hash key) const;
+
+  const std::vector<Game>& games() const { return games_; }
+
+  // The remaining methods are only used when building an index.
+
+  // Adds a game record, returning its index for use in AddPosition.
+  uint32_t AddGame(Game game);
+
+  // Records that `game` reached the position with the given key after
+  // `move_number` moves.
+  void AddPosition(zobrist::Hash key, uint32_t game, uint32_t move_number);
+
+  // Serializes the index. The output is deterministic: positions are written
+  // in ascending key order.
+  std::string Serialize() const;
+
+  size_t num_games() const { return games_.size(); }
+  size_t num_positions() const { return entries_.size(); }
+
+ private:
+  std::vector<Game> games_;
+  absl::flat_hash_map<zobrist::Hash, Entry> entries_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_CORPUS_INDEX_H_
@@ -0,0 +1,143 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/corpus_index.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(CorpusIndexTest, AddLookup) {
+  CorpusIndex index;
+  auto game_a = index.AddGame({"a.sgf", 0, 100, "B+R"});
+  auto game_b = index.AddGame({"b.sgf", 0, 50, "W+1.5"});
+
+  index.AddPosition(123, game_a, 8);
+  index.AddPosition(123, game_b, 16);
+  index.AddPosition(456, game_a, 100);
+
+  const auto* entry = index.Lookup(123);
+  ASSERT_NE(nullptr, entry);
+  ASSERT_EQ(2, entry->size());
+  EXPECT_EQ(nullptr, index.Lookup(789));
+
+  entry = index.Lookup(456);
+  ASSERT_NE(nullptr, entry);
+  ASSERT_EQ(1, entry->size());
+  EXPECT_EQ(game_a, (*entry)[0].game);
+  EXPECT_EQ(100, (*entry)[0].move_number);
+  EXPECT_EQ("a.sgf", index.games()[game_a].path);
+  EXPECT_EQ("B+R", index.games()[game_a].result);
+}
+
+TEST(CorpusIndexTest, SerializeLoadRoundTrip) {
+  Random rnd(896301594, 1);
+  CorpusIndex index;
+  std::vector<zobrist::Hash> keys;
+  for (int i = 0; i < 20; ++i) {
+    auto game = index.AddGame({absl::StrCat("game_", i, ".sgf"), 0,
+                               static_cast<uint32_t>(100 + i),
+                               i % 2 == 0 ? "B+R" : "W+0.5"});
+    for (uint32_t move = 8; move <= 100; move += 8) {
+      // Draw keys from a small range so some positions occur in several
+      // games.
+      auto key = rnd.UniformUint64() % 50;
+      keys.push_back(key);
+      index.AddPosition(key, game, move);
+    }
+  }
+
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  auto path = file::JoinPath(tmpdir, "test.mgindex");
+  MG_CHECK(file::WriteFile(path, index.Serialize()));
+
+  CorpusIndex loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  ASSERT_EQ(index.num_games(), loaded.num_games());
+  ASSERT_EQ(index.num_positions(), loaded.num_positions());
+  for (size_t i = 0; i < index.num_games(); ++i) {
+    EXPECT_EQ(index.games()[i].path, loaded.games()[i].path);
+    EXPECT_EQ(index.games()[i].byte_offset, loaded.games()[i].byte_offset);
+    EXPECT_EQ(index.games()[i].num_moves, loaded.games()[i].num_moves);
+    EXPECT_EQ(index.games()[i].result, loaded.games()[i].result);
+  }
+  for (auto key : keys) {
+    const auto* entry = index.Lookup(key);
+    const auto* loaded_entry = loaded.Lookup(key);
+    ASSERT_NE(nullptr, entry);
+    ASSERT_NE(nullptr, loaded_entry);
+    ASSERT_EQ(entry->size(), loaded_entry->size());
+    // Loaded entries are sorted by ascending (game, move_number) and hold
+    // the same hits as the original.
+    uint32_t prev_game = 0;
+    uint32_t prev_move = 0;
+    for (const auto& loaded_hit : *loaded_entry) {
+      EXPECT_TRUE(loaded_hit.game > prev_game ||
+                  (loaded_hit.game == prev_game &&
+                   loaded_hit.move_number >= prev_move));
+      prev_game = loaded_hit.game;
+      prev_move = loaded_hit.move_number;
+      bool found = false;
+      for (const auto& hit : *entry) {
+        if (hit.game == loaded_hit.game &&
+            hit.move_number == loaded_hit.move_number) {
+          found = true;
+        }
+      }
+      EXPECT_TRUE(found);
+    }
+  }
+}
+
+TEST(CorpusIndexTest, RejectsCorruptIndices) {
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  auto path = file::JoinPath(tmpdir, "corrupt.mgindex");
+
+  CorpusIndex index;
+  auto game = index.AddGame({"a.sgf", 0, 100, "B+R"});
+  index.AddPosition(123, game, 8);
+  auto contents = index.Serialize();
+
+  CorpusIndex loaded;
+  MG_CHECK(file::WriteFile(path, ""));
+  EXPECT_FALSE(loaded.Load(path));
+
+  MG_CHECK(file::WriteFile(path, contents.substr(0, contents.size() - 1)));
+  EXPECT_FALSE(loaded.Load(path));
+
+  auto bad_magic = contents;
+  bad_magic[0] = 'x';
+  MG_CHECK(file::WriteFile(path, bad_magic));
+  EXPECT_FALSE(loaded.Load(path));
+
+  // A hit that points past the end of its game's main line is rejected.
+  auto bad_move = contents;
+  bad_move[bad_move.size() - 4] = 101;
+  MG_CHECK(file::WriteFile(path, bad_move));
+  EXPECT_FALSE(loaded.Load(path));
+}
+
+}  // namespace
+}  // namespace minigo
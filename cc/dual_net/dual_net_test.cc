@@ -80,7 +80,8 @@ TYPED_TEST(DualNetTest, TestEmptyBoardBlackToPlay) {
   TestablePosition board("");
   ModelInput input;
   input.sym = symmetry::kIdentity;
-  input.position_history.push_back(&board);
+  input.position = &board;
+  input.stone_history.push_back(&board.stone_snapshot());
 
   BoardFeatureBuffer<float> buffer;
   Tensor<float> features = {{1, kN, kN, FeatureType::kNumPlanes},
@@ -106,7 +107,8 @@ TYPED_TEST(DualNetTest, TestEmptyBoardWhiteToPlay) {
   TestablePosition board("", Color::kWhite);
   ModelInput input;
   input.sym = symmetry::kIdentity;
-  input.position_history.push_back(&board);
+  input.position = &board;
+  input.stone_history.push_back(&board.stone_snapshot());
 
   BoardFeatureBuffer<float> buffer;
   Tensor<float> features = {{1, kN, kN, FeatureType::kNumPlanes},
@@ -137,8 +139,9 @@ TYPED_TEST(DualNetTest, TestSetFeatures) {
 
   ModelInput input;
   input.sym = symmetry::kIdentity;
+  input.position = &positions.front();
   for (const auto& p : positions) {
-    input.position_history.push_back(&p);
+    input.stone_history.push_back(&p.stone_snapshot());
   }
 
   BoardFeatureBuffer<float> buffer;
@@ -198,8 +201,9 @@ TYPED_TEST(DualNetTest, TestStoneFeaturesWithCapture) {
 
   ModelInput input;
   input.sym = symmetry::kIdentity;
+  input.position = &positions.front();
   for (const auto& p : positions) {
-    input.position_history.push_back(&p);
+    input.stone_history.push_back(&p.stone_snapshot());
   }
 
   BoardFeatureBuffer<float> buffer;
@@ -242,7 +246,8 @@ TYPED_TEST(DualNetTest, TestBackendsEqual) {
     auto c = GetRandomLegalMove(position, &rnd);
     position.PlayMove(c);
   }
-  input.position_history.push_back(&position);
+  input.position = &position;
+  input.stone_history.push_back(&position.stone_snapshot());
 
   ModelOutput ref_output;
   std::string ref_name;
@@ -295,7 +300,8 @@ TEST(WouldCaptureTest, WouldCaptureBlack) {
 
   ModelInput input;
   input.sym = symmetry::kIdentity;
-  input.position_history.push_back(&board);
+  input.position = &board;
+  input.stone_history.push_back(&board.stone_snapshot());
 
   BoardFeatureBuffer<float> buffer;
   Tensor<float> features = {{1, kN, kN, Mlperf07Features::kNumPlanes},
@@ -324,7 +330,8 @@ TEST(WouldCaptureTest, WouldCaptureWhite) {
 
   ModelInput input;
   input.sym = symmetry::kIdentity;
-  input.position_history.push_back(&board);
+  input.position = &board;
+  input.stone_history.push_back(&board.stone_snapshot());
 
   BoardFeatureBuffer<float> buffer;
   Tensor<float> features = {{1, kN, kN, Mlperf07Features::kNumPlanes},
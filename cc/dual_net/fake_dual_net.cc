@@ -14,15 +14,21 @@
 
 #include "cc/dual_net/fake_dual_net.h"
 
+#include <utility>
+
 #include "absl/memory/memory.h"
+#include "absl/time/clock.h"
 #include "cc/logging.h"
 
 namespace minigo {
 
-FakeDualNet::FakeDualNet(absl::Span<const float> priors, float value)
+FakeDualNet::FakeDualNet(absl::Span<const float> priors, float value,
+                         const Options& options)
     : Model("fake", FeatureDescriptor::Create<AgzFeatures>(
                         FeatureDescriptor::Layout::kNhwc)),
-      value_(value) {
+      value_(value),
+      options_(options),
+      rnd_(0, Random::kUniqueStream) {
   if (!priors.empty()) {
     MG_CHECK(priors.size() == kNumMoves);
     for (int i = 0; i < kNumMoves; ++i) {
@@ -33,6 +39,42 @@ FakeDualNet::FakeDualNet(absl::Span<const float> priors, float value)
       prior = 1.0 / kNumMoves;
     }
   }
+
+  if (options_.simulates_latency()) {
+    device_thread_ = absl::make_unique<LambdaThread>("FakeDevice", [this]() {
+      for (;;) {
+        auto batch = pending_batches_.Pop();
+        if (batch.callback == nullptr) {
+          return;
+        }
+        absl::SleepFor(batch.deadline - absl::Now());
+        batch.callback();
+      }
+    });
+    device_thread_->Start();
+  }
+}
+
+FakeDualNet::~FakeDualNet() {
+  if (device_thread_ != nullptr) {
+    pending_batches_.Push({absl::InfinitePast(), nullptr});
+    device_thread_->Join();
+  }
+}
+
+absl::Time FakeDualNet::SimulateBatch(size_t num_inputs) {
+  auto latency =
+      options_.base_latency + num_inputs * options_.latency_per_input;
+
+  absl::MutexLock lock(&mutex_);
+  if (options_.jitter > 0) {
+    latency *= 1 + options_.jitter * (2 * rnd_() - 1);
+  }
+  // The device runs batches back to back: a batch submitted while an
+  // earlier one is still running doesn't start until that one finishes.
+  auto now = absl::Now();
+  device_free_time_ = std::max(device_free_time_, now) + latency;
+  return device_free_time_;
 }
 
 void FakeDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
@@ -45,6 +87,40 @@ void FakeDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
   if (model != nullptr) {
     *model = "FakeDualNet";
   }
+  if (options_.simulates_latency()) {
+    absl::SleepFor(SimulateBatch(inputs.size()) - absl::Now());
+  }
+}
+
+void FakeDualNet::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                               std::vector<ModelOutput*>* outputs,
+                               std::string* model_name,
+                               std::function<void()> callback) {
+  if (!options_.simulates_latency()) {
+    Model::RunManyAsync(inputs, outputs, model_name, std::move(callback));
+    return;
+  }
+
+  for (auto* output : *outputs) {
+    output->policy = priors_;
+    output->value = value_;
+  }
+  if (model_name != nullptr) {
+    *model_name = "FakeDualNet";
+  }
+  pending_batches_.Push({SimulateBatch(inputs.size()), std::move(callback)});
+}
+
+std::unique_ptr<Model> FakeDualNetFactory::NewModel(
+    const ModelDefinition& def) {
+  const auto& metadata = def.metadata;
+  FakeDualNet::Options options;
+  options.base_latency =
+      absl::Microseconds(metadata.Get<uint64_t>("base_latency_us"));
+  options.latency_per_input =
+      absl::Microseconds(metadata.Get<uint64_t>("latency_per_input_us"));
+  options.jitter = metadata.Get<float>("jitter");
+  return absl::make_unique<FakeDualNet>(absl::Span<const float>(), 0, options);
 }
 
 }  // namespace minigo
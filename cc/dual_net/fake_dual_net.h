@@ -16,24 +16,88 @@
 #define CC_DUAL_NET_FAKE_DUAL_NET_H_
 
 #include <array>
+#include <functional>
+#include <memory>
 
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "cc/async/thread.h"
+#include "cc/async/thread_safe_queue.h"
+#include "cc/model/factory.h"
 #include "cc/model/model.h"
+#include "cc/random.h"
 
 namespace minigo {
 
 class FakeDualNet : public Model {
  public:
+  // A simple latency model for a simulated accelerator, so selfplay
+  // scheduling changes can be benchmarked on machines without one. A batch
+  // of n inferences takes:
+  //   (base_latency + n * latency_per_input) * (1 + jitter * U(-1, 1))
+  // and batches submitted to the same FakeDualNet run one after another,
+  // like on a real device. The default (all zeros) completes inference
+  // immediately, preserving the old test behavior.
+  struct Options {
+    absl::Duration base_latency;
+    absl::Duration latency_per_input;
+    double jitter = 0;
+
+    bool simulates_latency() const {
+      return base_latency > absl::ZeroDuration() ||
+             latency_per_input > absl::ZeroDuration();
+    }
+  };
+
   FakeDualNet() : FakeDualNet(absl::Span<const float>(), 0) {}
-  FakeDualNet(absl::Span<const float> priors, float value);
+  FakeDualNet(absl::Span<const float> priors, float value)
+      : FakeDualNet(priors, value, Options()) {}
+  FakeDualNet(absl::Span<const float> priors, float value,
+              const Options& options);
+  ~FakeDualNet() override;
 
   void RunMany(const std::vector<const ModelInput*>& inputs,
                std::vector<ModelOutput*>* outputs,
                std::string* model_name) override;
 
+  // When simulating latency, fills the outputs immediately but doesn't
+  // invoke the callback until the simulated device would have finished the
+  // batch, returning as soon as the batch is submitted (like a real
+  // accelerator backend). Otherwise defers to the base synchronous
+  // implementation.
+  void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs,
+                    std::string* model_name,
+                    std::function<void()> callback) override;
+
  private:
+  // Returns the time at which the simulated device will finish a batch of
+  // `num_inputs` inferences submitted now, accounting for batches already
+  // queued on the device.
+  absl::Time SimulateBatch(size_t num_inputs);
+
   std::array<float, kNumMoves> priors_;
   float value_;
+  Options options_;
+
+  // State of the simulated device: a thread that completes batches in
+  // submission order, each at its precomputed deadline. An entry with a
+  // null callback tells the thread to exit.
+  struct PendingBatch {
+    absl::Time deadline;
+    std::function<void()> callback;
+  };
+  std::unique_ptr<Thread> device_thread_;
+  ThreadSafeQueue<PendingBatch> pending_batches_;
+  absl::Mutex mutex_;
+  Random rnd_ GUARDED_BY(&mutex_);
+  absl::Time device_free_time_ GUARDED_BY(&mutex_) = absl::InfinitePast();
+};
+
+class FakeDualNetFactory : public ModelFactory {
+ public:
+  std::unique_ptr<Model> NewModel(const ModelDefinition& def) override;
 };
 
 }  // namespace minigo
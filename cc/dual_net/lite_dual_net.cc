@@ -14,7 +14,11 @@
 
 #include "cc/dual_net/lite_dual_net.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "cc/constants.h"
@@ -43,8 +47,8 @@ void Unquantize(const TfLiteQuantizationParams& params,
 
 class LiteDualNet : public Model {
  public:
-  LiteDualNet(const ModelDefinition& def,
-              const FeatureDescriptor& feature_desc);
+  LiteDualNet(const ModelDefinition& def, const FeatureDescriptor& feature_desc,
+              int num_threads);
 
   void RunMany(const std::vector<const ModelInput*>& inputs,
                std::vector<ModelOutput*>* outputs,
@@ -53,11 +57,10 @@ class LiteDualNet : public Model {
  private:
   void Reserve(int capacity);
 
-  // The raw model bytes. These bytes must outlive the parsed model, so
-  // `model_bytes_` must be ordered in the list of members before `model_`.
-  // TODO(tommadams): share model bytes between all instances of the same
-  // model.
-  std::string model_bytes_;
+  // The raw model bytes, shared with all other instances of the same model.
+  // These bytes must outlive the parsed model, so `model_bytes_` must be
+  // ordered in the list of members before `model_`.
+  ModelBytes model_bytes_;
 
   std::unique_ptr<tflite::FlatBufferModel> model_;
   std::unique_ptr<tflite::Interpreter> interpreter_;
@@ -78,7 +81,8 @@ class LiteDualNet : public Model {
 };
 
 LiteDualNet::LiteDualNet(const ModelDefinition& def,
-                         const FeatureDescriptor& feature_desc)
+                         const FeatureDescriptor& feature_desc,
+                         int num_threads)
     : Model(std::string(file::Stem(def.path)), feature_desc),
       model_bytes_(def.model_bytes),
       graph_path_(def.path) {
@@ -90,8 +94,7 @@ LiteDualNet::LiteDualNet(const ModelDefinition& def,
   tflite::InterpreterBuilder(*model_, resolver)(&interpreter_);
   MG_CHECK(interpreter_ != nullptr);
 
-  // Let's just use all the processors we can.
-  interpreter_->SetNumThreads(GetNumLogicalCpus());
+  interpreter_->SetNumThreads(num_threads);
 
   const auto& inputs = interpreter_->inputs();
   MG_CHECK(inputs.size() == 1);
@@ -124,10 +127,17 @@ LiteDualNet::LiteDualNet(const ModelDefinition& def,
 
 void LiteDualNet::Reserve(int capacity) {
   MG_CHECK(capacity > 0);
-  if (capacity == batch_capacity_) {
+  if (capacity <= batch_capacity_) {
     return;
   }
 
+  // Resizing the input tensor forces TFLite to replan the whole graph, so
+  // grow the batch dimension geometrically and never shrink it: batches
+  // smaller than the allocated capacity run padded and the steady-state batch
+  // size (which fluctuates under the batcher's adaptive sizing) reuses the
+  // same plan.
+  capacity = std::max(capacity, 2 * batch_capacity_);
+
   // Resize input tensor to batch size.
   auto shape = feature_descriptor().GetInputShape(capacity);
   MG_CHECK(interpreter_->ResizeInputTensor(
@@ -151,7 +161,12 @@ void LiteDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
                           std::string* model_name) {
   MG_CHECK(inputs.size() == outputs->size());
 
-  Reserve(inputs.size());
+  Reserve(static_cast<int>(inputs.size()));
+  if (static_cast<int>(inputs.size()) < batch_capacity_) {
+    // Zero the input tensor so the padding rows at the end of the batch
+    // compute on deterministic data.
+    memset(input_->data.raw, 0, input_->bytes);
+  }
 
   Tensor<float> policy, value;
   const auto& dims = input_->dims->data;
@@ -197,12 +212,29 @@ void LiteDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
 
 }  // namespace
 
+LiteDualNetFactory::LiteDualNetFactory(absl::string_view device) {
+  if (device.empty()) {
+    // Let's just use all the processors we can.
+    num_threads_ = GetNumLogicalCpus();
+  } else {
+    MG_CHECK(absl::SimpleAtoi(device, &num_threads_) && num_threads_ > 0)
+        << "expected a positive thread count for the lite device, got \""
+        << device << "\"";
+  }
+}
+
 std::unique_ptr<Model> LiteDualNetFactory::NewModel(
     const ModelDefinition& def) {
+  // Quantized models take uint8 features directly; models converted before
+  // the input_type metadata was added fall back to float and are handled by
+  // the input tensor type check in RunMany.
+  std::string input_type = "float";
+  def.metadata.TryGet("input_type", &input_type);
   auto feature_desc =
       FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
-                                def.metadata.Get<std::string>("input_layout"));
-  return absl::make_unique<LiteDualNet>(def, feature_desc);
+                                def.metadata.Get<std::string>("input_layout"),
+                                input_type);
+  return absl::make_unique<LiteDualNet>(def, feature_desc, num_threads_);
 }
 
 }  // namespace minigo
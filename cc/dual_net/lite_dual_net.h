@@ -18,6 +18,7 @@
 #include <memory>
 #include <string>
 
+#include "absl/strings/string_view.h"
 #include "cc/model/model.h"
 #include "cc/model/factory.h"
 
@@ -25,7 +26,16 @@ namespace minigo {
 
 class LiteDualNetFactory : public ModelFactory {
  public:
+  // For the lite engine, `device` holds the number of intra-op threads each
+  // model runs inference with, e.g. "4". An empty string uses all logical
+  // CPUs, which is only a good default when running a single inference
+  // process per host.
+  explicit LiteDualNetFactory(absl::string_view device);
+
   std::unique_ptr<Model> NewModel(const ModelDefinition& def) override;
+
+ private:
+  int num_threads_;
 };
 
 }  // namespace minigo
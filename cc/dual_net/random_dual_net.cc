@@ -31,15 +31,23 @@ RandomDualNet::RandomDualNet(std::string name,
                              uint64_t seed, float policy_stddev,
                              float value_stddev)
     : Model(std::move(name), feature_desc),
-      rnd_(seed, Random::kUniqueStream),
+      seed_(seed),
       policy_stddev_(policy_stddev),
       value_stddev_(value_stddev) {}
 
 void RandomDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
                             std::vector<ModelOutput*>* outputs,
                             std::string* model_name) {
-  for (auto* output : *outputs) {
-    rnd_.NormalDistribution(0.5, policy_stddev_, &output->policy);
+  for (size_t i = 0; i < outputs->size(); ++i) {
+    const auto& input = *inputs[i];
+    auto* output = (*outputs)[i];
+    // Key the generator on the input so that each position always evaluates
+    // to the same output, no matter how the positions are batched across
+    // calls. Symmetries get distinct streams: searching with random symmetry
+    // selection should still see eight different evaluations per position.
+    Random rnd(seed_ ^ input.position->stone_hash(),
+               static_cast<int>(input.sym) + 1);
+    rnd.NormalDistribution(0.5, policy_stddev_, &output->policy);
     for (auto& p : output->policy) {
       p = std::exp(p);
     }
@@ -52,7 +60,7 @@ void RandomDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
     }
 
     do {
-      output->value = rnd_.NormalDistribution(0, value_stddev_);
+      output->value = rnd.NormalDistribution(0, value_stddev_);
     } while (output->value < -1 || output->value > 1);
   }
   if (model_name != nullptr) {
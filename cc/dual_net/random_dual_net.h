@@ -37,12 +37,15 @@ class RandomDualNet : public Model {
   // Output value is a normal distribution with a mean of 0 and a standard
   // deviation of value_stddev. The output value is repeatedly sampled from the
   // normal distribution until a value is found in the range [-1, 1].
+  // Like a real network, the output is a pure function of the input: the
+  // generator is keyed on (seed, position, symmetry) for each input, so how
+  // positions are batched across calls doesn't affect their evaluations.
   void RunMany(const std::vector<const ModelInput*>& inputs,
                std::vector<ModelOutput*>* outputs,
                std::string* model_name) override;
 
  private:
-  Random rnd_;
+  const uint64_t seed_;
   const float policy_stddev_;
   const float value_stddev_;
 };
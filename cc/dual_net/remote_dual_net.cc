@@ -0,0 +1,265 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/remote_dual_net.h"
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/synchronization/mutex.h"
+#include "cc/constants.h"
+#include "cc/file/path.h"
+#include "cc/logging.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/public/session.h"
+#include "wtf/macros.h"
+
+namespace minigo {
+namespace {
+
+class RemoteDualNet : public Model {
+ public:
+  RemoteDualNet(const std::string& graph_path,
+                const FeatureDescriptor& feature_desc,
+                const tensorflow::GraphDef& graph_def,
+                const std::string& address);
+  ~RemoteDualNet() override;
+
+  // Safe to call concurrently: up to kNumBuffers batches are in flight at
+  // once, so one batch's features stream to the server while another
+  // executes there.
+  void RunMany(const std::vector<const ModelInput*>& inputs,
+               std::vector<ModelOutput*>* outputs,
+               std::string* model_name) override;
+
+  void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs,
+                    std::string* model_name,
+                    std::function<void()> callback) override;
+
+ private:
+  // Pre-allocated feed & fetch tensors for one in-flight batch.
+  struct Buffer {
+    std::vector<tensorflow::Tensor> inputs;
+    std::vector<tensorflow::Tensor> outputs;
+    int batch_capacity = 0;
+  };
+
+  static constexpr int kNumBuffers = 2;
+
+  // Blocks until a buffer is free.
+  Buffer* AcquireBuffer() LOCKS_EXCLUDED(&buffer_mutex_);
+  void ReleaseBuffer(Buffer* buffer) LOCKS_EXCLUDED(&buffer_mutex_);
+
+  void Reserve(Buffer* buffer, int capacity);
+
+  bool has_free_buffer() const EXCLUSIVE_LOCKS_REQUIRED(&buffer_mutex_) {
+    return !free_buffers_.empty();
+  }
+
+  std::unique_ptr<tensorflow::Session> session_;
+  tensorflow::Session::CallableHandle handle_;
+
+  Buffer buffers_[kNumBuffers];
+  absl::Mutex buffer_mutex_;
+  std::vector<Buffer*> free_buffers_ GUARDED_BY(&buffer_mutex_);
+
+  const std::string graph_path_;
+  tensorflow::DataType input_type_ = tensorflow::DT_INVALID;
+};
+
+RemoteDualNet::RemoteDualNet(const std::string& graph_path,
+                             const FeatureDescriptor& feature_desc,
+                             const tensorflow::GraphDef& graph_def,
+                             const std::string& address)
+    : Model(std::string(file::Stem(file::Basename(graph_path))), feature_desc),
+      graph_path_(graph_path) {
+  tensorflow::SessionOptions session_options;
+  session_options.target = address;
+  session_options.config.set_allow_soft_placement(true);
+  session_.reset(tensorflow::NewSession(session_options));
+  TF_CHECK_OK(session_->Create(graph_def));
+
+  tensorflow::CallableOptions callable_options;
+  callable_options.add_feed("pos_tensor");
+  callable_options.add_fetch("policy_output");
+  callable_options.add_fetch("value_output");
+  callable_options.add_target("policy_output");
+  callable_options.add_target("value_output");
+
+  // Allow a more generous timeout than the in-process engines: the request
+  // may have to wait out a transient network error or a server restart.
+  callable_options.mutable_run_options()->set_timeout_in_ms(60 * 1000);
+
+  TF_CHECK_OK(session_->MakeCallable(callable_options, &handle_));
+
+  for (const auto& node : graph_def.node()) {
+    if (node.name() == "pos_tensor") {
+      auto it = node.attr().find("dtype");
+      MG_CHECK(it != node.attr().end());
+      input_type_ = it->second.type();
+      break;
+    }
+  }
+  MG_CHECK(input_type_ == tensorflow::DT_FLOAT ||
+           input_type_ == tensorflow::DT_BOOL)
+      << input_type_;
+
+  absl::MutexLock lock(&buffer_mutex_);
+  for (auto& buffer : buffers_) {
+    free_buffers_.push_back(&buffer);
+  }
+}
+
+RemoteDualNet::~RemoteDualNet() {
+  if (session_ != nullptr) {
+    TF_CHECK_OK(session_->ReleaseCallable(handle_));
+    TF_CHECK_OK(session_->Close());
+  }
+}
+
+void RemoteDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
+                            std::vector<ModelOutput*>* outputs,
+                            std::string* model_name) {
+  MG_CHECK(inputs.size() == outputs->size());
+
+  auto* buffer = AcquireBuffer();
+  Reserve(buffer, static_cast<int>(inputs.size()));
+
+  WTF_SCOPE("RemoteDualNet::Run: inputs, capacity", size_t, int)
+  (inputs.size(), buffer->batch_capacity);
+
+  auto shape = feature_descriptor().GetInputShape(buffer->batch_capacity);
+  if (input_type_ == tensorflow::DT_FLOAT) {
+    WTF_SCOPE("Features::SetFloat: inputs", size_t)(inputs.size());
+    Tensor<float> features(shape, buffer->inputs[0].flat<float>().data());
+    feature_descriptor().set_floats(inputs, &features);
+  } else {
+    WTF_SCOPE("Features::SetBool: inputs", size_t)(inputs.size());
+    static_assert(sizeof(bool) == sizeof(uint8_t), "bool must be 1 byte");
+    Tensor<uint8_t> features(
+        shape,
+        reinterpret_cast<uint8_t*>(buffer->inputs[0].flat<bool>().data()));
+    feature_descriptor().set_bytes(inputs, &features);
+  }
+
+  // Run the model on the server. Runs are deliberately not serialized: the
+  // gRPC transfer of one batch overlaps the server-side execution of
+  // another.
+  {
+    WTF_SCOPE("Session::Run: capacity", int)(buffer->batch_capacity);
+    buffer->outputs.clear();
+    TF_CHECK_OK(session_->RunCallable(handle_, buffer->inputs,
+                                      &buffer->outputs, nullptr));
+  }
+
+  Tensor<float> policy({buffer->batch_capacity, kNumMoves},
+                       buffer->outputs[0].flat<float>().data());
+  Tensor<float> value({buffer->batch_capacity},
+                      buffer->outputs[1].flat<float>().data());
+  {
+    WTF_SCOPE("Model::GetOutputs: outputs", size_t)(outputs->size());
+    Model::GetOutputs(inputs, policy, value, absl::MakeSpan(*outputs));
+  }
+
+  ReleaseBuffer(buffer);
+
+  if (model_name != nullptr) {
+    *model_name = graph_path_;
+  }
+}
+
+void RemoteDualNet::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                                 std::vector<ModelOutput*>* outputs,
+                                 std::string* model_name,
+                                 std::function<void()> callback) {
+  // RunMany is safe to call concurrently, so skip the base implementation's
+  // serialization: concurrent callers pipeline their feature transfers
+  // against the batch executing on the server.
+  RunMany(inputs, outputs, model_name);
+  callback();
+}
+
+RemoteDualNet::Buffer* RemoteDualNet::AcquireBuffer() {
+  absl::MutexLock lock(&buffer_mutex_);
+  buffer_mutex_.Await(absl::Condition(this, &RemoteDualNet::has_free_buffer));
+  auto* buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+void RemoteDualNet::ReleaseBuffer(Buffer* buffer) {
+  absl::MutexLock lock(&buffer_mutex_);
+  free_buffers_.push_back(buffer);
+}
+
+void RemoteDualNet::Reserve(Buffer* buffer, int capacity) {
+  MG_CHECK(capacity > 0);
+  if (capacity <= buffer->batch_capacity) {
+    return;
+  }
+
+  buffer->inputs.clear();
+  auto shape = feature_descriptor().GetInputShape(capacity);
+  tensorflow::TensorShape tf_shape({shape[0], shape[1], shape[2], shape[3]});
+  buffer->inputs.emplace_back(input_type_, tf_shape);
+  buffer->batch_capacity = capacity;
+}
+
+}  // namespace
+
+RemoteDualNetFactory::RemoteDualNetFactory(std::string address)
+    : address_(std::move(address)) {
+  MG_CHECK(absl::StartsWith(address_, "grpc://"))
+      << "expected a grpc:// inference server address, got \"" << address_
+      << "\"";
+}
+
+std::unique_ptr<Model> RemoteDualNetFactory::NewModel(
+    const ModelDefinition& def) {
+  tensorflow::protobuf::io::CodedInputStream coded_stream(
+      reinterpret_cast<const uint8_t*>(def.model_bytes.data()),
+      def.model_bytes.size());
+  coded_stream.SetTotalBytesLimit(1024 * 1024 * 1024);
+
+  tensorflow::GraphDef graph_def;
+  MG_CHECK(graph_def.ParseFromCodedStream(&coded_stream) &&
+           coded_stream.ConsumedEntireMessage());
+
+  std::string input_type = "float";
+  def.metadata.TryGet("input_type", &input_type);
+
+  auto feature_desc =
+      FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
+                                def.metadata.Get<std::string>("input_layout"),
+                                input_type);
+
+  // Place the graph on the server's GPU; soft placement moves any
+  // unsupported ops back to its CPU.
+  for (auto& node : *graph_def.mutable_node()) {
+    node.set_device("/gpu:0");
+  }
+
+  return absl::make_unique<RemoteDualNet>(def.path, feature_desc, graph_def,
+                                          address_);
+}
+
+}  // namespace minigo
@@ -0,0 +1,45 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_REMOTE_DUAL_NET_H_
+#define CC_DUAL_NET_REMOTE_DUAL_NET_H_
+
+#include <memory>
+#include <string>
+
+#include "cc/model/factory.h"
+#include "cc/model/model.h"
+
+namespace minigo {
+
+// Runs inference on a remote TensorFlow server over gRPC instead of
+// requiring the accelerator in-process, so CPU-only selfplay machines can
+// share a pooled GPU serving tier. Feature batches are streamed to the
+// server through TensorFlow's distributed session, with up to two batches
+// in flight so one batch's features transfer while another executes.
+class RemoteDualNetFactory : public ModelFactory {
+ public:
+  // `address` is the gRPC address of the inference server,
+  // e.g. "grpc://10.240.2.10:8470".
+  explicit RemoteDualNetFactory(std::string address);
+
+  std::unique_ptr<Model> NewModel(const ModelDefinition& def) override;
+
+ private:
+  const std::string address_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_REMOTE_DUAL_NET_H_
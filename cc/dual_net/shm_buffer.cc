@@ -0,0 +1,238 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/shm_buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "cc/constants.h"
+#include "cc/logging.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x6f67696e696d6873ull;  // "shminigo"
+constexpr uint32_t kVersion = 1;
+
+// Round `x` up to a cache line boundary so slots don't false-share.
+size_t AlignUp(size_t x) { return (x + 63) & ~size_t{63}; }
+
+size_t SlotStride(int slot_capacity, int num_feature_elements) {
+  size_t n = 2 * sizeof(uint32_t);  // state, batch_size.
+  n += sizeof(float) * slot_capacity * num_feature_elements;  // features.
+  n += sizeof(float) * slot_capacity * kNumMoves;             // policy.
+  n += sizeof(float) * slot_capacity;                         // value.
+  return AlignUp(n);
+}
+
+size_t SegmentSize(int num_slots, int slot_capacity,
+                   int num_feature_elements) {
+  return AlignUp(sizeof(ShmBuffer::Header)) +
+         num_slots * SlotStride(slot_capacity, num_feature_elements);
+}
+
+}  // namespace
+
+std::unique_ptr<ShmBuffer> ShmBuffer::Create(const std::string& name,
+                                             int num_slots, int slot_capacity,
+                                             int num_feature_elements) {
+  MG_CHECK(!name.empty() && name[0] == '/') << "\"" << name << "\"";
+  MG_CHECK(num_slots > 0);
+  MG_CHECK(slot_capacity > 0);
+  MG_CHECK(num_feature_elements > 0);
+
+  // Remove any stale segment left behind by a crashed server: its mutex may
+  // be in an unrecoverable state.
+  shm_unlink(name.c_str());
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  MG_CHECK(fd >= 0) << "error creating shared memory segment \"" << name
+                    << "\"";
+
+  auto size = SegmentSize(num_slots, slot_capacity, num_feature_elements);
+  MG_CHECK(ftruncate(fd, size) == 0);
+
+  void* mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  MG_CHECK(mapping != MAP_FAILED);
+
+  auto buffer = absl::WrapUnique(
+      new ShmBuffer(name, mapping, size, /*owner=*/true));
+
+  auto* header = buffer->header();
+  header->version = kVersion;
+  header->board_size = kN;
+  header->num_slots = num_slots;
+  header->slot_capacity = slot_capacity;
+  header->num_feature_elements = num_feature_elements;
+  header->num_policy_elements = kNumMoves;
+  header->shutdown = 0;
+
+  pthread_mutexattr_t mutex_attr;
+  pthread_mutexattr_init(&mutex_attr);
+  pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+  MG_CHECK(pthread_mutex_init(&header->mutex, &mutex_attr) == 0);
+  pthread_mutexattr_destroy(&mutex_attr);
+
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+  MG_CHECK(pthread_cond_init(&header->request_cond, &cond_attr) == 0);
+  MG_CHECK(pthread_cond_init(&header->response_cond, &cond_attr) == 0);
+  pthread_condattr_destroy(&cond_attr);
+
+  for (int i = 0; i < num_slots; ++i) {
+    *buffer->slot_state(i) = kFree;
+    *buffer->slot_batch_size(i) = 0;
+  }
+
+  // Publish the magic last: clients treat a segment without it as still
+  // initializing.
+  header->magic = kMagic;
+
+  return buffer;
+}
+
+std::unique_ptr<ShmBuffer> ShmBuffer::Open(const std::string& name) {
+  MG_CHECK(!name.empty() && name[0] == '/') << "\"" << name << "\"";
+
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat stat_buf;
+  MG_CHECK(fstat(fd, &stat_buf) == 0);
+  auto size = static_cast<size_t>(stat_buf.st_size);
+  if (size < sizeof(Header)) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  MG_CHECK(mapping != MAP_FAILED);
+
+  auto buffer = absl::WrapUnique(
+      new ShmBuffer(name, mapping, size, /*owner=*/false));
+
+  const auto* header = buffer->header();
+  if (header->magic != kMagic) {
+    return nullptr;
+  }
+  MG_CHECK(header->version == kVersion) << header->version;
+  MG_CHECK(header->board_size == kN)
+      << "inference server was compiled for a " << header->board_size << "x"
+      << header->board_size << " board";
+  MG_CHECK(size == SegmentSize(header->num_slots, header->slot_capacity,
+                               header->num_feature_elements));
+
+  return buffer;
+}
+
+ShmBuffer::~ShmBuffer() {
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+  munmap(mapping_, size_);
+}
+
+uint32_t* ShmBuffer::slot_state(int i) const {
+  return reinterpret_cast<uint32_t*>(slot_base(i));
+}
+
+uint32_t* ShmBuffer::slot_batch_size(int i) const {
+  return reinterpret_cast<uint32_t*>(slot_base(i)) + 1;
+}
+
+float* ShmBuffer::slot_features(int i) const {
+  return reinterpret_cast<float*>(slot_base(i) + 2 * sizeof(uint32_t));
+}
+
+float* ShmBuffer::slot_policy(int i) const {
+  return slot_features(i) +
+         header_->slot_capacity * header_->num_feature_elements;
+}
+
+float* ShmBuffer::slot_value(int i) const {
+  return slot_policy(i) +
+         header_->slot_capacity * header_->num_policy_elements;
+}
+
+void ShmBuffer::Lock() { MG_CHECK(pthread_mutex_lock(&header_->mutex) == 0); }
+
+void ShmBuffer::Unlock() {
+  MG_CHECK(pthread_mutex_unlock(&header_->mutex) == 0);
+}
+
+void ShmBuffer::WaitRequest() {
+  MG_CHECK(pthread_cond_wait(&header_->request_cond, &header_->mutex) == 0);
+}
+
+void ShmBuffer::WaitRequestWithTimeout(int timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000;
+  }
+  auto result =
+      pthread_cond_timedwait(&header_->request_cond, &header_->mutex,
+                             &deadline);
+  MG_CHECK(result == 0 || result == ETIMEDOUT);
+}
+
+void ShmBuffer::WaitResponse() {
+  MG_CHECK(pthread_cond_wait(&header_->response_cond, &header_->mutex) == 0);
+}
+
+void ShmBuffer::SignalRequest() {
+  MG_CHECK(pthread_cond_signal(&header_->request_cond) == 0);
+}
+
+void ShmBuffer::BroadcastResponse() {
+  MG_CHECK(pthread_cond_broadcast(&header_->response_cond) == 0);
+}
+
+ShmBuffer::ShmBuffer(std::string name, void* mapping, size_t size, bool owner)
+    : name_(std::move(name)),
+      mapping_(mapping),
+      size_(size),
+      owner_(owner),
+      header_(static_cast<Header*>(mapping)) {}
+
+size_t ShmBuffer::slot_stride() const {
+  return SlotStride(header_->slot_capacity, header_->num_feature_elements);
+}
+
+char* ShmBuffer::slot_base(int i) const {
+  return static_cast<char*>(mapping_) + AlignUp(sizeof(Header)) +
+         i * slot_stride();
+}
+
+}  // namespace minigo
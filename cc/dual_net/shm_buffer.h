@@ -0,0 +1,125 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_SHM_BUFFER_H_
+#define CC_DUAL_NET_SHM_BUFFER_H_
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace minigo {
+
+// A POSIX shared memory segment through which multiple selfplay processes on
+// one host submit feature batches to a single inference server process that
+// owns the accelerator.
+//
+// The segment holds a fixed number of request slots. A client claims a free
+// slot, writes its features into the slot's buffer, marks the slot pending
+// and signals the server. The server gathers all pending slots into one
+// device batch, writes the raw policy and value outputs back into each slot
+// and marks them done. All state transitions happen under a single
+// process-shared mutex; the feature and output buffers themselves are only
+// touched by the slot's current owner, so the bulk data copies run without
+// the lock held.
+//
+// This is POSIX-only; ShmBuffer cannot be created or opened on Windows.
+class ShmBuffer {
+ public:
+  // Slot life cycle: kFree -> kFilling (client owns the buffer) -> kPending
+  // -> kRunning (server owns the buffer) -> kDone (client owns the buffer)
+  // -> kFree.
+  enum SlotState : uint32_t {
+    kFree = 0,
+    kFilling = 1,
+    kPending = 2,
+    kRunning = 3,
+    kDone = 4,
+  };
+
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t board_size;
+    uint32_t num_slots;
+    // Maximum number of inputs a single request slot can hold.
+    uint32_t slot_capacity;
+    // Number of float feature elements per input.
+    uint32_t num_feature_elements;
+    // Number of float policy elements per input.
+    uint32_t num_policy_elements;
+    // Set by the server when it shuts down; clients treat this as fatal.
+    uint32_t shutdown;
+    uint32_t padding;
+    pthread_mutex_t mutex;
+    // Signaled by clients when a slot becomes kPending.
+    pthread_cond_t request_cond;
+    // Broadcast by the server when slots become kDone, and by clients when a
+    // slot becomes kFree again.
+    pthread_cond_t response_cond;
+  };
+
+  // Creates the segment, unlinking any stale segment with the same name left
+  // behind by a crashed server. Only the inference server should call this.
+  // `name` must start with '/', e.g. "/minigo".
+  static std::unique_ptr<ShmBuffer> Create(const std::string& name,
+                                           int num_slots, int slot_capacity,
+                                           int num_feature_elements);
+
+  // Opens an existing segment, returning nullptr if the segment doesn't
+  // exist or hasn't been fully initialized yet. Clients should retry until
+  // the server comes up.
+  static std::unique_ptr<ShmBuffer> Open(const std::string& name);
+
+  // Unmaps the segment. The creating server also unlinks it.
+  ~ShmBuffer();
+
+  Header* header() const { return header_; }
+
+  uint32_t* slot_state(int i) const;
+  uint32_t* slot_batch_size(int i) const;
+  float* slot_features(int i) const;
+  float* slot_policy(int i) const;
+  float* slot_value(int i) const;
+
+  void Lock();
+  void Unlock();
+  void WaitRequest();
+  // Like WaitRequest but returns after `timeout_ms` even if nothing was
+  // signaled, so the server can poll for shutdown.
+  void WaitRequestWithTimeout(int timeout_ms);
+  void WaitResponse();
+  void SignalRequest();
+  void BroadcastResponse();
+
+ private:
+  ShmBuffer(std::string name, void* mapping, size_t size, bool owner);
+
+  // Size in bytes of one slot, including its feature and output buffers.
+  size_t slot_stride() const;
+  char* slot_base(int i) const;
+
+  const std::string name_;
+  void* const mapping_;
+  const size_t size_;
+  // True in the server process that created (and will unlink) the segment.
+  const bool owner_;
+  Header* const header_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_SHM_BUFFER_H_
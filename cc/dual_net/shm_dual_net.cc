@@ -0,0 +1,188 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/shm_dual_net.h"
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/constants.h"
+#include "cc/file/path.h"
+#include "cc/logging.h"
+#include "wtf/macros.h"
+
+namespace minigo {
+namespace {
+
+class ShmDualNet : public Model {
+ public:
+  ShmDualNet(const std::string& graph_path,
+             const FeatureDescriptor& feature_desc, ShmBuffer* buffer);
+
+  // Safe to call concurrently: each call claims its own request slot, so
+  // callers from multiple threads (and multiple processes) fill features in
+  // parallel and the server batches all pending slots together.
+  void RunMany(const std::vector<const ModelInput*>& inputs,
+               std::vector<ModelOutput*>* outputs,
+               std::string* model_name) override;
+
+  void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs,
+                    std::string* model_name,
+                    std::function<void()> callback) override;
+
+ private:
+  // Blocks until a slot is free, then claims it. Dies if the server shuts
+  // down while waiting.
+  int AcquireSlot();
+
+  ShmBuffer* const buffer_;
+  const std::string graph_path_;
+};
+
+ShmDualNet::ShmDualNet(const std::string& graph_path,
+                       const FeatureDescriptor& feature_desc,
+                       ShmBuffer* buffer)
+    : Model(std::string(file::Stem(file::Basename(graph_path))), feature_desc),
+      buffer_(buffer),
+      graph_path_(graph_path) {
+  const auto* header = buffer_->header();
+  MG_CHECK(feature_desc.num_planes * kN * kN ==
+           static_cast<int>(header->num_feature_elements))
+      << "inference server expects " << header->num_feature_elements
+      << " feature elements per input, model \"" << graph_path
+      << "\" produces " << feature_desc.num_planes * kN * kN;
+}
+
+void ShmDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
+                         std::vector<ModelOutput*>* outputs,
+                         std::string* model_name) {
+  MG_CHECK(inputs.size() == outputs->size());
+  auto* header = buffer_->header();
+  auto batch_size = static_cast<int>(inputs.size());
+  MG_CHECK(batch_size <= static_cast<int>(header->slot_capacity))
+      << batch_size;
+
+  WTF_SCOPE("ShmDualNet::Run: inputs", size_t)(inputs.size());
+
+  int slot = AcquireSlot();
+
+  {
+    WTF_SCOPE("Features::SetFloat: inputs", size_t)(inputs.size());
+    auto shape = feature_descriptor().GetInputShape(batch_size);
+    Tensor<float> features(shape, buffer_->slot_features(slot));
+    feature_descriptor().set_floats(inputs, &features);
+  }
+
+  *buffer_->slot_batch_size(slot) = batch_size;
+
+  // Hand the slot to the server and wait for the outputs to come back.
+  {
+    WTF_SCOPE("ShmDualNet::Wait: inputs", size_t)(inputs.size());
+    buffer_->Lock();
+    *buffer_->slot_state(slot) = ShmBuffer::kPending;
+    buffer_->SignalRequest();
+    while (*buffer_->slot_state(slot) != ShmBuffer::kDone) {
+      MG_CHECK(header->shutdown == 0) << "inference server shut down";
+      buffer_->WaitResponse();
+    }
+    buffer_->Unlock();
+  }
+
+  Tensor<float> policy({batch_size, kNumMoves}, buffer_->slot_policy(slot));
+  Tensor<float> value({batch_size}, buffer_->slot_value(slot));
+  {
+    WTF_SCOPE("Model::GetOutputs: outputs", size_t)(outputs->size());
+    Model::GetOutputs(inputs, policy, value, absl::MakeSpan(*outputs));
+  }
+
+  buffer_->Lock();
+  *buffer_->slot_state(slot) = ShmBuffer::kFree;
+  // Wake any clients waiting for a free slot.
+  buffer_->BroadcastResponse();
+  buffer_->Unlock();
+
+  if (model_name != nullptr) {
+    *model_name = graph_path_;
+  }
+}
+
+void ShmDualNet::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                              std::vector<ModelOutput*>* outputs,
+                              std::string* model_name,
+                              std::function<void()> callback) {
+  // RunMany is safe to call concurrently, so skip the base implementation's
+  // serialization: the more slots in flight at once, the fuller the server's
+  // batches.
+  RunMany(inputs, outputs, model_name);
+  callback();
+}
+
+int ShmDualNet::AcquireSlot() {
+  const auto* header = buffer_->header();
+  buffer_->Lock();
+  for (;;) {
+    MG_CHECK(header->shutdown == 0) << "inference server shut down";
+    for (int i = 0; i < static_cast<int>(header->num_slots); ++i) {
+      if (*buffer_->slot_state(i) == ShmBuffer::kFree) {
+        *buffer_->slot_state(i) = ShmBuffer::kFilling;
+        buffer_->Unlock();
+        return i;
+      }
+    }
+    buffer_->WaitResponse();
+  }
+}
+
+}  // namespace
+
+ShmDualNetFactory::ShmDualNetFactory(const std::string& device) {
+  absl::string_view name(device);
+  MG_CHECK(absl::ConsumePrefix(&name, "shm://"))
+      << "expected a shm:// inference server segment, got \"" << device
+      << "\"";
+  shm_name_ = absl::StrCat("/", name);
+}
+
+std::unique_ptr<Model> ShmDualNetFactory::NewModel(
+    const ModelDefinition& def) {
+  auto feature_desc =
+      FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
+                                def.metadata.Get<std::string>("input_layout"));
+  MG_CHECK(feature_desc.dtype == FeatureDescriptor::Dtype::kFloat)
+      << "shared memory inference only supports float features";
+
+  if (buffer_ == nullptr) {
+    bool logged = false;
+    while ((buffer_ = ShmBuffer::Open(shm_name_)) == nullptr) {
+      if (!logged) {
+        MG_LOG(INFO) << "waiting for inference server on \"" << shm_name_
+                     << "\"";
+        logged = true;
+      }
+      absl::SleepFor(absl::Seconds(1));
+    }
+  }
+
+  return absl::make_unique<ShmDualNet>(def.path, feature_desc, buffer_.get());
+}
+
+}  // namespace minigo
@@ -0,0 +1,54 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_SHM_DUAL_NET_H_
+#define CC_DUAL_NET_SHM_DUAL_NET_H_
+
+#include <memory>
+#include <string>
+
+#include "cc/dual_net/shm_buffer.h"
+#include "cc/model/factory.h"
+#include "cc/model/model.h"
+
+namespace minigo {
+
+// Submits inference to an inference server process on the same host through
+// a shared memory segment (see shm_buffer.h). Running several
+// concurrent_selfplay processes per accelerator would otherwise fragment
+// batching: each process's ModelBatcher only sees its own games. With this
+// factory all co-located processes feed one full-sized batch stream on the
+// process that owns the device.
+//
+// Clients only write feature planes and read raw policy & value arrays; the
+// model itself lives in the server (see shm_infer_server.cc), which must be
+// started first with a matching model.
+class ShmDualNetFactory : public ModelFactory {
+ public:
+  // `device` names the shared memory segment,
+  // e.g. "shm://minigo" -> segment "/minigo".
+  explicit ShmDualNetFactory(const std::string& device);
+
+  std::unique_ptr<Model> NewModel(const ModelDefinition& def) override;
+
+ private:
+  std::string shm_name_;
+  // Shared by all models created by this factory. Opened lazily by the first
+  // NewModel call, which blocks until the server is up.
+  std::unique_ptr<ShmBuffer> buffer_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_SHM_DUAL_NET_H_
@@ -0,0 +1,180 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/shm_dual_net.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "cc/constants.h"
+#include "cc/dual_net/shm_buffer.h"
+#include "cc/model/factory.h"
+#include "cc/position.h"
+#include "cc/symmetries.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// A stand-in for shm_infer_server that runs the same gather & scatter loop
+// in a thread, but instead of a real model writes outputs derived from each
+// input's features so the test can verify the features made the round trip:
+//   policy[i] = i * 0.001
+//   value = sum of the input's feature elements
+class FakeShmServer {
+ public:
+  explicit FakeShmServer(const std::string& name)
+      : buffer_(ShmBuffer::Create(name, 4, 8, kNumFeatureElements)),
+        thread_([this] { Run(); }) {}
+
+  ~FakeShmServer() {
+    stop_ = true;
+    thread_.join();
+    buffer_->Lock();
+    buffer_->header()->shutdown = 1;
+    buffer_->BroadcastResponse();
+    buffer_->Unlock();
+  }
+
+  static constexpr int kNumFeatureElements =
+      AgzFeatures::kNumPlanes * kN * kN;
+
+ private:
+  void Run() {
+    const auto num_slots = static_cast<int>(buffer_->header()->num_slots);
+    while (!stop_) {
+      std::vector<int> pending;
+      buffer_->Lock();
+      for (int i = 0; i < num_slots; ++i) {
+        if (*buffer_->slot_state(i) == ShmBuffer::kPending) {
+          *buffer_->slot_state(i) = ShmBuffer::kRunning;
+          pending.push_back(i);
+        }
+      }
+      if (pending.empty()) {
+        buffer_->WaitRequestWithTimeout(10);
+        buffer_->Unlock();
+        continue;
+      }
+      buffer_->Unlock();
+
+      for (int i : pending) {
+        auto n = static_cast<int>(*buffer_->slot_batch_size(i));
+        for (int row = 0; row < n; ++row) {
+          const auto* features =
+              buffer_->slot_features(i) + row * kNumFeatureElements;
+          float sum = 0;
+          for (int j = 0; j < kNumFeatureElements; ++j) {
+            sum += features[j];
+          }
+          auto* policy = buffer_->slot_policy(i) + row * kNumMoves;
+          for (int j = 0; j < kNumMoves; ++j) {
+            policy[j] = j * 0.001f;
+          }
+          buffer_->slot_value(i)[row] = sum;
+        }
+      }
+
+      buffer_->Lock();
+      for (int i : pending) {
+        *buffer_->slot_state(i) = ShmBuffer::kDone;
+      }
+      buffer_->BroadcastResponse();
+      buffer_->Unlock();
+    }
+  }
+
+  std::unique_ptr<ShmBuffer> buffer_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+constexpr int FakeShmServer::kNumFeatureElements;
+
+std::string TestShmName() {
+  return absl::StrCat("minigo_test_", getpid());
+}
+
+ModelDefinition TestModelDefinition() {
+  ModelDefinition def;
+  def.path = "test_model";
+  def.metadata.Set("engine", "tf");
+  def.metadata.Set("input_features", "agz");
+  def.metadata.Set("input_layout", "nhwc");
+  return def;
+}
+
+TEST(ShmDualNetTest, RoundTrip) {
+  FakeShmServer server(absl::StrCat("/", TestShmName()));
+
+  ShmDualNetFactory factory(absl::StrCat("shm://", TestShmName()));
+  auto model = factory.NewModel(TestModelDefinition());
+
+  Position position(Color::kBlack);
+  ModelInput input;
+  input.sym = symmetry::kIdentity;
+  input.position = &position;
+  input.stone_history.push_back(&position.stone_snapshot());
+
+  ModelOutput output;
+  std::vector<const ModelInput*> inputs = {&input, &input};
+  std::vector<ModelOutput*> outputs = {&output, &output};
+
+  std::string model_name;
+  model->RunMany(inputs, &outputs, &model_name);
+
+  EXPECT_EQ("test_model", model_name);
+  // An empty board's AGZ features are all zero except the to-play plane.
+  EXPECT_EQ(kN * kN, output.value);
+  EXPECT_EQ(0.0f, output.policy[0]);
+  EXPECT_NEAR(0.001f * (kNumMoves - 1), output.policy[Coord::kPass], 1e-6f);
+}
+
+TEST(ShmDualNetTest, ConcurrentClients) {
+  FakeShmServer server(absl::StrCat("/", TestShmName()));
+
+  ShmDualNetFactory factory(absl::StrCat("shm://", TestShmName()));
+  auto model = factory.NewModel(TestModelDefinition());
+
+  // More threads than the segment has slots, so threads must also wait for
+  // slots to free up.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&model] {
+      Position position(Color::kBlack);
+      ModelInput input;
+      input.sym = symmetry::kIdentity;
+      input.position = &position;
+  input.stone_history.push_back(&position.stone_snapshot());
+
+      for (int j = 0; j < 100; ++j) {
+        ModelOutput output;
+        std::vector<const ModelInput*> inputs = {&input};
+        std::vector<ModelOutput*> outputs = {&output};
+        model->RunMany(inputs, &outputs, nullptr);
+        ASSERT_EQ(kN * kN, output.value);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace
+}  // namespace minigo
@@ -32,9 +32,16 @@
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
 #include "tensorflow/core/public/session.h"
 #include "wtf/macros.h"
 
+#ifdef MG_ENABLE_TF_PINNED_FEATURES
+#include "cuda_runtime_api.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/types.h"
+#endif  // MG_ENABLE_TF_PINNED_FEATURES
+
 namespace minigo {
 namespace {
 
@@ -44,6 +51,39 @@ void PlaceOnDevice(tensorflow::GraphDef* graph_def, const std::string& device) {
   }
 }
 
+#ifdef MG_ENABLE_TF_PINNED_FEATURES
+// Backs a tensorflow::Tensor with page-locked (pinned) host memory.
+// FeatureDescriptor's set_floats/set_bytes already write features directly
+// into the input tensor's buffer, but by default that buffer comes from
+// TensorFlow's pageable CPU allocator and the GPU runtime has to stage it
+// through an internal pinned buffer before the device copy. Pinning the
+// tensor itself makes the host-to-device transfer a single async DMA and
+// removes that staging copy from the inference hot path.
+class PinnedTensorBuffer : public tensorflow::TensorBuffer {
+ public:
+  explicit PinnedTensorBuffer(size_t size)
+      : TensorBuffer(AllocPinned(size)), size_(size) {}
+  ~PinnedTensorBuffer() override { cudaFreeHost(data()); }
+
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(
+      tensorflow::AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocated_bytes(size_);
+  }
+
+ private:
+  static void* AllocPinned(size_t size) {
+    void* data;
+    MG_CHECK(cudaHostAlloc(&data, size, cudaHostAllocPortable) == cudaSuccess);
+    return data;
+  }
+
+  const size_t size_;
+};
+#endif  // MG_ENABLE_TF_PINNED_FEATURES
+
 class TfDualNet : public Model {
  public:
   TfDualNet(const std::string& graph_path,
@@ -75,6 +115,24 @@ TfDualNet::TfDualNet(const std::string& graph_path,
   tensorflow::SessionOptions session_options;
   session_options.config.mutable_gpu_options()->set_allow_growth(true);
 
+  // Run Grappler over the frozen graph when the session is created: fold
+  // constants, strip identity chains & dead control dependencies, fuse ops
+  // where the device has a fused kernel (e.g. batchnorm into the preceding
+  // conv), and let the layout optimizer rewrite the graph to the device's
+  // preferred layout, leaving transposes only at the feed & fetch
+  // boundaries. The rewrite runs once per session, so the cost is paid at
+  // model load, not per inference.
+  auto* graph_options = session_options.config.mutable_graph_options();
+  auto* rewriter_config = graph_options->mutable_rewrite_options();
+  rewriter_config->set_constant_folding(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_arithmetic_optimization(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_dependency_optimization(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_remapping(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_layout_optimizer(tensorflow::RewriterConfig::ON);
+  graph_options->mutable_optimizer_options()->set_opt_level(
+      tensorflow::OptimizerOptions::L1);
+  graph_options->mutable_optimizer_options()->set_do_function_inlining(true);
+
   // session_options.config.set_inter_op_parallelism_threads(1);
   // auto* thread_pool_options =
   //     session_options.config.add_session_inter_op_thread_pool();
@@ -113,6 +171,13 @@ TfDualNet::TfDualNet(const std::string& graph_path,
   MG_CHECK(input_type_ == tensorflow::DT_FLOAT ||
            input_type_ == tensorflow::DT_BOOL)
       << input_type_;
+
+  auto expected_type = feature_desc.dtype == FeatureDescriptor::Dtype::kUint8
+                           ? tensorflow::DT_BOOL
+                           : tensorflow::DT_FLOAT;
+  MG_CHECK(input_type_ == expected_type)
+      << "the model's input_type metadata doesn't match the graph's "
+         "pos_tensor dtype";
 }
 
 TfDualNet::~TfDualNet() {
@@ -174,9 +239,16 @@ void TfDualNet::Reserve(int capacity) {
 
   // pos_tensor
   auto shape = feature_descriptor().GetInputShape(capacity);
-  inputs_.emplace_back(
-      input_type_,
-      tensorflow::TensorShape({shape[0], shape[1], shape[2], shape[3]}));
+  tensorflow::TensorShape tf_shape({shape[0], shape[1], shape[2], shape[3]});
+#ifdef MG_ENABLE_TF_PINNED_FEATURES
+  auto* buffer = new PinnedTensorBuffer(
+      tf_shape.num_elements() * tensorflow::DataTypeSize(input_type_));
+  inputs_.emplace_back(input_type_, tf_shape, buffer);
+  // The tensor holds a reference to the buffer now.
+  buffer->Unref();
+#else
+  inputs_.emplace_back(input_type_, tf_shape);
+#endif
 
   batch_capacity_ = capacity;
 }
@@ -204,16 +276,30 @@ std::unique_ptr<Model> TfDualNetFactory::NewModel(const ModelDefinition& def) {
   MG_CHECK(graph_def.ParseFromCodedStream(&coded_stream) &&
            coded_stream.ConsumedEntireMessage());
 
-  // Check that we're not loading a TPU model.
+  // Check that we're not loading a TPU model, and find the input tensor's
+  // type while we're at it.
+  tensorflow::DataType graph_input_type = tensorflow::DT_INVALID;
   for (const auto& node : graph_def.node()) {
     MG_CHECK(!absl::StartsWithIgnoreCase(node.name(), "tpu"))
         << "found node named \"" << node.name()
         << "\", this model looks like it was compiled for TPU";
+    if (node.name() == "pos_tensor") {
+      auto it = node.attr().find("dtype");
+      MG_CHECK(it != node.attr().end());
+      graph_input_type = it->second.type();
+    }
   }
 
+  // Models that predate the input_type metadata declare byte features
+  // implicitly through a DT_BOOL input tensor.
+  std::string input_type =
+      graph_input_type == tensorflow::DT_BOOL ? "uint8" : "float";
+  def.metadata.TryGet("input_type", &input_type);
+
   auto feature_desc =
       FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
-                                def.metadata.Get<std::string>("input_layout"));
+                                def.metadata.Get<std::string>("input_layout"),
+                                input_type);
 
   if (place_on_gpu_) {
     PlaceOnDevice(&graph_def, "/gpu:0");
@@ -111,6 +111,11 @@ TpuDualNet::TpuDualNet(const std::string& graph_path,
   callable_options.mutable_run_options()->set_timeout_in_ms(30 * 1000);
 
   TF_CHECK_OK(session_->MakeCallable(callable_options, &handle_));
+
+  absl::MutexLock lock(&buffer_mutex_);
+  for (auto& buffer : buffers_) {
+    free_buffers_.push_back(&buffer);
+  }
 }
 
 TpuDualNet::~TpuDualNet() {
@@ -124,10 +129,11 @@ void TpuDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
                          std::string* model_name) {
   auto batch_size =
       static_cast<int>((inputs.size() + num_replicas_ - 1) / num_replicas_);
-  Reserve(batch_size);
+  auto* buffer = AcquireBuffer();
+  Reserve(buffer, batch_size);
 
   WTF_SCOPE("TpuDualNet::Run: inputs, capacity", size_t, size_t)
-  (inputs.size(), num_replicas_ * batch_capacity_);
+  (inputs.size(), num_replicas_ * buffer->batch_capacity);
 
   auto input_span = absl::MakeConstSpan(inputs);
   auto output_span = absl::MakeSpan(*outputs);
@@ -147,29 +153,34 @@ void TpuDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
       if (input_type_ == tensorflow::DT_FLOAT) {
         Tensor<float> features(
             {end - begin, kN, kN, feature_descriptor().num_planes},
-            inputs_[replica].flat<float>().data());
+            buffer->inputs[replica].flat<float>().data());
         feature_descriptor().set_floats(replica_inputs, &features);
       } else {
         static_assert(sizeof(bool) == sizeof(uint8_t), "bool must be 1 byte");
         Tensor<uint8_t> features(
             {end - begin, kN, kN, feature_descriptor().num_planes},
-            reinterpret_cast<uint8_t*>(inputs_[replica].flat<bool>().data()));
+            reinterpret_cast<uint8_t*>(
+                buffer->inputs[replica].flat<bool>().data()));
         feature_descriptor().set_bytes(replica_inputs, &features);
       }
     }
   }
 
-  // Run the model.
+  // Run the model. Runs from this instance are serialized, but the feature
+  // transfer above is not: with two buffers, the next batch's features are
+  // copied while the batch in flight executes on the device.
   {
+    absl::MutexLock lock(&run_mutex_);
     WTF_SCOPE("Session::Run: inputs, capacity", size_t, size_t)
-    (inputs.size(), num_replicas_ * batch_capacity_);
-    outputs_.clear();
-    TF_CHECK_OK(session_->RunCallable(handle_, inputs_, &outputs_, nullptr));
+    (inputs.size(), num_replicas_ * buffer->batch_capacity);
+    buffer->outputs.clear();
+    TF_CHECK_OK(session_->RunCallable(handle_, buffer->inputs,
+                                      &buffer->outputs, nullptr));
   }
 
   // Copy the policy and value out of the output tensors.
   {
-    WTF_SCOPE("GetOutputs: outputs", size_t)(outputs_.size());
+    WTF_SCOPE("GetOutputs: outputs", size_t)(buffer->outputs.size());
     for (int replica = 0; replica < num_replicas_; ++replica) {
       int begin = replica * batch_size;
       int end = std::min<int>(inputs.size(), (replica + 1) * batch_size);
@@ -179,8 +190,8 @@ void TpuDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
       auto replica_inputs = input_span.subspan(begin, end - begin);
       auto replica_outputs = output_span.subspan(begin, end - begin);
 
-      const auto& policy_tensor = outputs_[replica * 2].flat<float>();
-      const auto& value_tensor = outputs_[replica * 2 + 1].flat<float>();
+      const auto& policy_tensor = buffer->outputs[replica * 2].flat<float>();
+      const auto& value_tensor = buffer->outputs[replica * 2 + 1].flat<float>();
 
       Tensor<float> policy({end - begin, kNumMoves}, policy_tensor.data());
       Tensor<float> value({end - begin}, value_tensor.data());
@@ -188,14 +199,40 @@ void TpuDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
     }
   }
 
+  ReleaseBuffer(buffer);
+
   if (model_name != nullptr) {
     *model_name = graph_path_;
   }
 }
 
-void TpuDualNet::Reserve(size_t capacity) {
+void TpuDualNet::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                              std::vector<ModelOutput*>* outputs,
+                              std::string* model_name,
+                              std::function<void()> callback) {
+  // RunMany is safe to call concurrently, so skip the base implementation's
+  // serialization: concurrent callers pipeline their feature transfers
+  // against the session run in flight.
+  RunMany(inputs, outputs, model_name);
+  callback();
+}
+
+TpuDualNet::Buffer* TpuDualNet::AcquireBuffer() {
+  absl::MutexLock lock(&buffer_mutex_);
+  buffer_mutex_.Await(absl::Condition(this, &TpuDualNet::has_free_buffer));
+  auto* buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+void TpuDualNet::ReleaseBuffer(Buffer* buffer) {
+  absl::MutexLock lock(&buffer_mutex_);
+  free_buffers_.push_back(buffer);
+}
+
+void TpuDualNet::Reserve(Buffer* buffer, size_t capacity) {
   MG_CHECK(capacity > 0);
-  if (capacity <= batch_capacity_) {
+  if (capacity <= buffer->batch_capacity) {
     // TODO(tommadams): for now, never shrink the tensor sent for inference.
     // Resizing TPU tensors can take up to a second and we're focusing on using
     // TPUs for continuous selfplay at the moment.
@@ -207,11 +244,11 @@ void TpuDualNet::Reserve(size_t capacity) {
   auto size =
       static_cast<int>(capacity * kN * kN * feature_descriptor().num_planes);
 
-  inputs_.clear();
+  buffer->inputs.clear();
   for (int i = 0; i < num_replicas_; ++i) {
-    inputs_.emplace_back(input_type_, tensorflow::TensorShape({size}));
+    buffer->inputs.emplace_back(input_type_, tensorflow::TensorShape({size}));
   }
-  batch_capacity_ = capacity;
+  buffer->batch_capacity = capacity;
 }
 
 TpuDualNetFactory::TpuDualNetFactory(std::string tpu_name)
@@ -276,7 +313,8 @@ TpuDualNetFactory::LoadedModel TpuDualNetFactory::GetModel(
   model.session.reset(tensorflow::NewSession(options));
   model.feature_desc =
       FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
-                                def.metadata.Get<std::string>("input_layout"));
+                                def.metadata.Get<std::string>("input_layout"),
+                                input_type);
 
   TF_CHECK_OK(model.session->Create(graph_def));
   models_.emplace(def.path, model);
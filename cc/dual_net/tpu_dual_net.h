@@ -15,6 +15,7 @@
 #ifndef CC_DUAL_NET_TPU_DUAL_NET_H_
 #define CC_DUAL_NET_TPU_DUAL_NET_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
@@ -44,18 +45,50 @@ class TpuDualNet : public Model {
              TpuDualNetFactory* factory);
   ~TpuDualNet() override;
 
+  // Safe to call concurrently: feature transfer for one batch is overlapped
+  // with the session run of the batch in flight.
   void RunMany(const std::vector<const ModelInput*>& inputs,
                std::vector<ModelOutput*>* outputs,
                std::string* model_name) override;
 
+  void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs,
+                    std::string* model_name,
+                    std::function<void()> callback) override;
+
  private:
-  void Reserve(size_t capacity);
+  // Pre-allocated feed & fetch tensors for one batch. Two buffers rotate so
+  // that one can be filled with the next batch's features while the session
+  // runs the batch in flight from the other.
+  struct Buffer {
+    std::vector<tensorflow::Tensor> inputs;
+    std::vector<tensorflow::Tensor> outputs;
+    size_t batch_capacity = 0;
+  };
+
+  static constexpr int kNumBuffers = 2;
+
+  // Blocks until a buffer is free.
+  Buffer* AcquireBuffer() LOCKS_EXCLUDED(&buffer_mutex_);
+  void ReleaseBuffer(Buffer* buffer) LOCKS_EXCLUDED(&buffer_mutex_);
+
+  void Reserve(Buffer* buffer, size_t capacity);
+
+  bool has_free_buffer() const EXCLUSIVE_LOCKS_REQUIRED(&buffer_mutex_) {
+    return !free_buffers_.empty();
+  }
 
   std::shared_ptr<tensorflow::Session> session_;
   tensorflow::Session::CallableHandle handle_;
-  std::vector<tensorflow::Tensor> inputs_;
-  std::vector<tensorflow::Tensor> outputs_;
-  size_t batch_capacity_ = 0;
+
+  Buffer buffers_[kNumBuffers];
+  absl::Mutex buffer_mutex_;
+  std::vector<Buffer*> free_buffers_ GUARDED_BY(&buffer_mutex_);
+
+  // Serializes this instance's session runs, so that a buffer fill overlaps
+  // the run in flight instead of racing it.
+  absl::Mutex run_mutex_;
+
   const int num_replicas_;
   const std::string graph_path_;
   tensorflow::DataType input_type_;
@@ -0,0 +1,407 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/trt_dual_net.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NvInfer.h"
+#include "NvUffParser.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "cc/constants.h"
+#include "cc/file/path.h"
+#include "cc/latency_histogram.h"
+#include "cc/logging.h"
+#include "cuda_runtime_api.h"
+#include "wtf/macros.h"
+
+namespace minigo {
+namespace {
+
+void CheckCuda(cudaError_t error) {
+  MG_CHECK(error == cudaSuccess) << cudaGetErrorString(error);
+}
+
+// nvinfer1 objects are released by calling destroy() rather than delete.
+struct TrtDestroyer {
+  template <typename T>
+  void operator()(T* t) const {
+    if (t != nullptr) {
+      t->destroy();
+    }
+  }
+};
+
+template <typename T>
+using TrtPtr = std::unique_ptr<T, TrtDestroyer>;
+
+class Logger : public nvinfer1::ILogger {
+ public:
+  void log(Severity severity, const char* msg) override {
+    switch (severity) {
+      case Severity::kINTERNAL_ERROR:
+      case Severity::kERROR:
+        MG_LOG(ERROR) << msg;
+        break;
+      case Severity::kWARNING:
+        MG_LOG(WARNING) << msg;
+        break;
+      default:
+        // TensorRT's info-level output is very chatty during engine
+        // construction, drop it.
+        break;
+    }
+  }
+};
+
+Logger logger;
+
+// Serves an int8 calibration table that was generated offline and stored in
+// the model's metadata. TensorRT only asks for calibration batches when it
+// can't read a cached table, and we have no position data to calibrate with
+// at load time, so getBatch always reports that it has run out of batches.
+class CachedCalibrator : public nvinfer1::IInt8EntropyCalibrator2 {
+ public:
+  explicit CachedCalibrator(std::string cache) : cache_(std::move(cache)) {}
+
+  int getBatchSize() const override { return 1; }
+  bool getBatch(void**, const char**, int) override { return false; }
+
+  const void* readCalibrationCache(size_t& length) override {
+    length = cache_.size();
+    return cache_.data();
+  }
+  void writeCalibrationCache(const void*, size_t) override {}
+
+ private:
+  std::string cache_;
+};
+
+class TrtDualNet : public Model {
+ public:
+  TrtDualNet(const std::string& graph_path,
+             const FeatureDescriptor& feature_desc,
+             TrtPtr<nvinfer1::IRuntime> runtime,
+             TrtPtr<nvinfer1::ICudaEngine> engine);
+  ~TrtDualNet() override;
+
+  void RunMany(const std::vector<const ModelInput*>& inputs,
+               std::vector<ModelOutput*>* outputs,
+               std::string* model_name) override;
+
+ private:
+  void Reserve(int capacity);
+  void FreeBuffers();
+
+  // Destruction order matters: the execution context must be destroyed
+  // before the engine, and the engine before the runtime.
+  TrtPtr<nvinfer1::IRuntime> runtime_;
+  TrtPtr<nvinfer1::ICudaEngine> engine_;
+  TrtPtr<nvinfer1::IExecutionContext> context_;
+
+  cudaStream_t stream_;
+  int input_index_;
+  int policy_index_;
+  int value_index_;
+
+  // CUDA events recorded on stream_ at the phase boundaries of each batch:
+  // before the feature copy, after it, after the kernels and after the
+  // output copies. Event timestamps are taken by the device, so the elapsed
+  // times measure the transfers and kernels themselves rather than host-side
+  // launch overhead.
+  cudaEvent_t launch_event_;
+  cudaEvent_t features_copied_event_;
+  cudaEvent_t kernels_done_event_;
+  cudaEvent_t outputs_copied_event_;
+
+  // Per-batch device timings, reported on destruction.
+  LatencyHistogram host_to_device_histogram_;
+  LatencyHistogram kernel_histogram_;
+  LatencyHistogram readback_histogram_;
+
+  // Device buffers, indexed by engine binding index.
+  std::vector<void*> bindings_;
+
+  // Pinned host staging buffers: features are written directly into
+  // page-locked memory so the copies to and from the device are async DMA
+  // transfers. The feature buffer holds floats or bytes depending on the
+  // feature descriptor's dtype.
+  char* host_features_ = nullptr;
+  float* host_policy_ = nullptr;
+  float* host_value_ = nullptr;
+
+  const std::string graph_path_;
+  int batch_capacity_ = 0;
+};
+
+TrtDualNet::TrtDualNet(const std::string& graph_path,
+                       const FeatureDescriptor& feature_desc,
+                       TrtPtr<nvinfer1::IRuntime> runtime,
+                       TrtPtr<nvinfer1::ICudaEngine> engine)
+    : Model(std::string(file::Stem(file::Basename(graph_path))), feature_desc),
+      runtime_(std::move(runtime)),
+      engine_(std::move(engine)),
+      graph_path_(graph_path) {
+  context_.reset(engine_->createExecutionContext());
+  MG_CHECK(context_ != nullptr);
+
+  input_index_ = engine_->getBindingIndex("pos_tensor");
+  policy_index_ = engine_->getBindingIndex("policy_output");
+  value_index_ = engine_->getBindingIndex("value_output");
+  MG_CHECK(input_index_ >= 0 && policy_index_ >= 0 && value_index_ >= 0)
+      << "model " << graph_path_
+      << " doesn't have the expected pos_tensor, policy_output and "
+         "value_output bindings";
+  bindings_.resize(engine_->getNbBindings(), nullptr);
+
+  CheckCuda(cudaStreamCreate(&stream_));
+  CheckCuda(cudaEventCreate(&launch_event_));
+  CheckCuda(cudaEventCreate(&features_copied_event_));
+  CheckCuda(cudaEventCreate(&kernels_done_event_));
+  CheckCuda(cudaEventCreate(&outputs_copied_event_));
+}
+
+TrtDualNet::~TrtDualNet() {
+  MG_LOG(INFO) << name() << " device timings: h2d ["
+               << host_to_device_histogram_.ToString() << "] kernel ["
+               << kernel_histogram_.ToString() << "] readback ["
+               << readback_histogram_.ToString() << "]";
+  FreeBuffers();
+  CheckCuda(cudaEventDestroy(outputs_copied_event_));
+  CheckCuda(cudaEventDestroy(kernels_done_event_));
+  CheckCuda(cudaEventDestroy(features_copied_event_));
+  CheckCuda(cudaEventDestroy(launch_event_));
+  CheckCuda(cudaStreamDestroy(stream_));
+}
+
+void TrtDualNet::RunMany(const std::vector<const ModelInput*>& inputs,
+                         std::vector<ModelOutput*>* outputs,
+                         std::string* model_name) {
+  Reserve(inputs.size());
+
+  WTF_SCOPE("TrtDualNet::Run: inputs, capacity", size_t, int)
+  (inputs.size(), batch_capacity_);
+  MG_CHECK(inputs.size() == outputs->size());
+
+  auto shape = feature_descriptor().GetInputShape(batch_capacity_);
+  if (feature_descriptor().dtype == FeatureDescriptor::Dtype::kFloat) {
+    WTF_SCOPE("Features::SetFloat: inputs", size_t)(inputs.size());
+    Tensor<float> features(shape, reinterpret_cast<float*>(host_features_));
+    feature_descriptor().set_floats(inputs, &features);
+  } else {
+    WTF_SCOPE("Features::SetBytes: inputs", size_t)(inputs.size());
+    Tensor<uint8_t> features(shape,
+                             reinterpret_cast<uint8_t*>(host_features_));
+    feature_descriptor().set_bytes(inputs, &features);
+  }
+
+  // Run the model.
+  {
+    WTF_SCOPE("Context::Enqueue: capacity", int)(batch_capacity_);
+    CheckCuda(cudaEventRecord(launch_event_, stream_));
+    CheckCuda(cudaMemcpyAsync(
+        bindings_[input_index_], host_features_,
+        shape.num_elements() * feature_descriptor().bytes_per_element(),
+        cudaMemcpyHostToDevice, stream_));
+    CheckCuda(cudaEventRecord(features_copied_event_, stream_));
+    MG_CHECK(context_->enqueue(batch_capacity_, bindings_.data(), stream_,
+                               nullptr));
+    CheckCuda(cudaEventRecord(kernels_done_event_, stream_));
+    CheckCuda(cudaMemcpyAsync(host_policy_, bindings_[policy_index_],
+                              batch_capacity_ * kNumMoves * sizeof(float),
+                              cudaMemcpyDeviceToHost, stream_));
+    CheckCuda(cudaMemcpyAsync(host_value_, bindings_[value_index_],
+                              batch_capacity_ * sizeof(float),
+                              cudaMemcpyDeviceToHost, stream_));
+    CheckCuda(cudaEventRecord(outputs_copied_event_, stream_));
+    CheckCuda(cudaStreamSynchronize(stream_));
+
+    auto elapsed = [](cudaEvent_t start, cudaEvent_t end) {
+      float ms;
+      CheckCuda(cudaEventElapsedTime(&ms, start, end));
+      return absl::Milliseconds(ms);
+    };
+    host_to_device_histogram_.Add(
+        elapsed(launch_event_, features_copied_event_));
+    kernel_histogram_.Add(elapsed(features_copied_event_, kernels_done_event_));
+    readback_histogram_.Add(
+        elapsed(kernels_done_event_, outputs_copied_event_));
+  }
+
+  Tensor<float> policy({batch_capacity_, kNumMoves}, host_policy_);
+  Tensor<float> value({batch_capacity_}, host_value_);
+  {
+    WTF_SCOPE("Model::GetOutputs: outputs", size_t)(outputs->size());
+    Model::GetOutputs(inputs, policy, value, absl::MakeSpan(*outputs));
+  }
+
+  if (model_name != nullptr) {
+    *model_name = graph_path_;
+  }
+}
+
+void TrtDualNet::Reserve(int capacity) {
+  MG_CHECK(capacity > 0);
+  MG_CHECK(capacity <= engine_->getMaxBatchSize())
+      << "batch size " << capacity << " exceeds the engine's maximum of "
+      << engine_->getMaxBatchSize() << ", rebuild the engine with a larger "
+      << "trt_max_batch_size";
+  if (capacity <= batch_capacity_ && capacity > 3 * batch_capacity_ / 4) {
+    return;
+  }
+
+  FreeBuffers();
+
+  auto feature_bytes =
+      feature_descriptor().GetInputShape(capacity).num_elements() *
+      feature_descriptor().bytes_per_element();
+  CheckCuda(cudaMalloc(&bindings_[input_index_], feature_bytes));
+  CheckCuda(
+      cudaMalloc(&bindings_[policy_index_], capacity * kNumMoves * sizeof(float)));
+  CheckCuda(cudaMalloc(&bindings_[value_index_], capacity * sizeof(float)));
+
+  CheckCuda(cudaMallocHost(reinterpret_cast<void**>(&host_features_),
+                           feature_bytes));
+  CheckCuda(cudaMallocHost(reinterpret_cast<void**>(&host_policy_),
+                           capacity * kNumMoves * sizeof(float)));
+  CheckCuda(cudaMallocHost(reinterpret_cast<void**>(&host_value_),
+                           capacity * sizeof(float)));
+
+  batch_capacity_ = capacity;
+}
+
+void TrtDualNet::FreeBuffers() {
+  if (batch_capacity_ == 0) {
+    return;
+  }
+  CheckCuda(cudaFreeHost(host_value_));
+  CheckCuda(cudaFreeHost(host_policy_));
+  CheckCuda(cudaFreeHost(host_features_));
+  CheckCuda(cudaFree(bindings_[value_index_]));
+  CheckCuda(cudaFree(bindings_[policy_index_]));
+  CheckCuda(cudaFree(bindings_[input_index_]));
+  batch_capacity_ = 0;
+}
+
+// Builds an engine from a UFF graph, optionally reducing precision to fp16
+// or calibrated int8 as requested by the model's metadata.
+TrtPtr<nvinfer1::ICudaEngine> BuildEngineFromUff(
+    const ModelDefinition& def, const FeatureDescriptor& feature_desc) {
+  TrtPtr<nvinfer1::IBuilder> builder(nvinfer1::createInferBuilder(logger));
+  MG_CHECK(builder != nullptr);
+  TrtPtr<nvinfer1::INetworkDefinition> network(builder->createNetwork());
+  TrtPtr<nvuffparser::IUffParser> parser(nvuffparser::createUffParser());
+
+  nvinfer1::Dims3 dims;
+  nvuffparser::UffInputOrder order;
+  if (feature_desc.layout == FeatureDescriptor::Layout::kNhwc) {
+    dims = nvinfer1::Dims3(kN, kN, feature_desc.num_planes);
+    order = nvuffparser::UffInputOrder::kNHWC;
+  } else {
+    dims = nvinfer1::Dims3(feature_desc.num_planes, kN, kN);
+    order = nvuffparser::UffInputOrder::kNCHW;
+  }
+  MG_CHECK(parser->registerInput("pos_tensor", dims, order));
+  MG_CHECK(parser->registerOutput("policy_output"));
+  MG_CHECK(parser->registerOutput("value_output"));
+  MG_CHECK(parser->parseBuffer(def.model_bytes.data(), def.model_bytes.size(),
+                               *network, nvinfer1::DataType::kFLOAT))
+      << "couldn't parse UFF graph from " << def.path;
+
+  uint64_t max_batch_size = 256;
+  def.metadata.TryGet("trt_max_batch_size", &max_batch_size);
+  builder->setMaxBatchSize(max_batch_size);
+  builder->setMaxWorkspaceSize(1ull << 30);
+
+  std::string precision = "fp32";
+  def.metadata.TryGet("trt_precision", &precision);
+
+  // The calibrator must outlive buildCudaEngine.
+  std::unique_ptr<CachedCalibrator> calibrator;
+  if (precision == "fp16") {
+    MG_CHECK(builder->platformHasFastFp16())
+        << "this GPU doesn't have native fp16 support";
+    builder->setFp16Mode(true);
+  } else if (precision == "int8") {
+    MG_CHECK(builder->platformHasFastInt8())
+        << "this GPU doesn't have native int8 support";
+    std::string cache;
+    MG_CHECK(def.metadata.TryGet("int8_calibration", &cache))
+        << "int8 models require an \"int8_calibration\" table in their "
+           "metadata, run the calibration step when converting the model";
+    calibrator = absl::make_unique<CachedCalibrator>(std::move(cache));
+    builder->setInt8Mode(true);
+    builder->setInt8Calibrator(calibrator.get());
+  } else {
+    MG_CHECK(precision == "fp32")
+        << "unrecognized trt_precision \"" << precision << "\"";
+  }
+
+  MG_LOG(INFO) << "building " << precision << " TensorRT engine for "
+               << def.path << ", this may take a while";
+  return TrtPtr<nvinfer1::ICudaEngine>(builder->buildCudaEngine(*network));
+}
+
+}  // namespace
+
+TrtDualNetFactory::TrtDualNetFactory(absl::string_view device) {
+  if (!device.empty()) {
+    MG_CHECK(absl::SimpleAtoi(device, &device_id_))
+        << "Unrecognized device \"" << device << "\"";
+  }
+}
+
+std::unique_ptr<Model> TrtDualNetFactory::NewModel(const ModelDefinition& def) {
+  MG_CHECK(def.metadata.Get<std::string>("engine") == "trt");
+  CheckCuda(cudaSetDevice(device_id_));
+
+  std::string input_type = "float";
+  def.metadata.TryGet("input_type", &input_type);
+  auto feature_desc =
+      FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
+                                def.metadata.Get<std::string>("input_layout"),
+                                input_type);
+
+  TrtPtr<nvinfer1::IRuntime> runtime(nvinfer1::createInferRuntime(logger));
+  MG_CHECK(runtime != nullptr);
+
+  // By default the model's bytes hold a serialized engine built (and
+  // possibly calibrated) offline. Setting trt_format to "uff" instead builds
+  // the engine from a UFF graph at load time, which makes the precision
+  // choice at conversion time instead of baking it into a plan that's tied
+  // to one GPU architecture.
+  std::string format = "plan";
+  def.metadata.TryGet("trt_format", &format);
+
+  TrtPtr<nvinfer1::ICudaEngine> engine;
+  if (format == "plan") {
+    engine.reset(runtime->deserializeCudaEngine(def.model_bytes.data(),
+                                                def.model_bytes.size(),
+                                                nullptr));
+  } else {
+    MG_CHECK(format == "uff")
+        << "unrecognized trt_format \"" << format << "\"";
+    engine = BuildEngineFromUff(def, feature_desc);
+  }
+  MG_CHECK(engine != nullptr)
+      << "couldn't create a TensorRT engine from " << def.path;
+
+  return absl::make_unique<TrtDualNet>(def.path, feature_desc,
+                                       std::move(runtime), std::move(engine));
+}
+
+}  // namespace minigo
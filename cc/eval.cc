@@ -39,11 +39,12 @@
 #include "cc/logging.h"
 #include "cc/mcts_player.h"
 #include "cc/model/batching_model.h"
+#include "cc/model/inference_trace.h"
 #include "cc/model/loader.h"
 #include "cc/model/model.h"
+#include "cc/model/model_cache.h"
 #include "cc/random.h"
 #include "cc/tf_utils.h"
-#include "cc/zobrist.h"
 #include "gflags/gflags.h"
 
 // Game options flags.
@@ -55,6 +56,12 @@ DEFINE_uint64(seed, 0,
 // Tree search flags.
 DEFINE_int32(virtual_losses, 8,
              "Number of virtual losses when running tree search.");
+DEFINE_int32(num_search_threads, 1,
+             "Number of threads to fan each move's tree search across, with "
+             "virtual loss steering the threads towards different leaves. "
+             "Values > 1 keep inference requests in flight while leaves are "
+             "being selected, which helps fill the shared inference batches "
+             "when only a few eval games are running.");
 DEFINE_double(value_init_penalty, 2.0,
               "New children value initialization penalty.\n"
               "Child value = parent's value - penalty * color, clamped to"
@@ -81,8 +88,43 @@ DEFINE_string(target_device, "",
 DEFINE_int32(num_target_readouts, 100,
              "Number of readouts to make during tree search for the eval "
              "model.)");
+DEFINE_string(tournament_models, "",
+              "Comma-separated list of model paths to play a round-robin "
+              "tournament between. When set, --eval_model and --target_model "
+              "are ignored: every model is loaded once, all pairings' games "
+              "are scheduled together through the shared inference batchers, "
+              "and a full cross-table is printed at the end. All models run "
+              "on --eval_device with --num_eval_readouts readouts. "
+              "--sprt isn't supported in tournament mode.");
+DEFINE_int32(games_per_pairing, 2,
+             "Number of games each pairing plays in tournament mode, "
+             "alternating colors from game to game.");
+DEFINE_string(model_cache_dir, "",
+              "Optional directory used as a host-local cache of model files, "
+              "shared by all minigo processes on the host: each model is "
+              "downloaded once per host and its weights are mapped read-only "
+              "into each process.");
 
 DEFINE_int32(parallel_games, 32, "Number of games to play in parallel.");
+DEFINE_int32(num_games, 0,
+             "Total number of games to play. If 0, each parallel game thread "
+             "plays exactly one game, i.e. parallel_games games in total.");
+
+// Early stopping flags.
+DEFINE_bool(sprt, false,
+            "If true, stop the eval match early once a sequential "
+            "probability ratio test decides whether the eval model's win "
+            "rate is closer to sprt_p0 or sprt_p1: no new games are "
+            "scheduled and in-flight games are abandoned. Most useful with "
+            "a num_games budget much larger than parallel_games.");
+DEFINE_double(sprt_p0, 0.45,
+              "Win rate for the eval model under the SPRT null hypothesis "
+              "(eval model is not stronger).");
+DEFINE_double(sprt_p1, 0.55,
+              "Win rate for the eval model under the SPRT alternative "
+              "hypothesis (eval model is stronger).");
+DEFINE_double(sprt_alpha, 0.05, "SPRT false positive rate.");
+DEFINE_double(sprt_beta, 0.05, "SPRT false negative rate.");
 
 // Output flags.
 DEFINE_string(output_bigtable, "",
@@ -94,6 +136,10 @@ DEFINE_string(sgf_dir, "",
               "mode, no SGF is written.");
 DEFINE_string(bigtable_tag, "", "Used in Bigtable metadata.");
 DEFINE_bool(verbose, true, "Enable verbose logging.");
+DEFINE_string(inference_trace, "",
+              "If non-empty, record every inference batch to this file. The "
+              "trace can be replayed against other backends with the "
+              "replay_trace binary.");
 
 namespace minigo {
 namespace {
@@ -173,11 +219,17 @@ class Evaluator {
 
     MctsPlayer::Options player_options;
     player_options.virtual_losses = FLAGS_virtual_losses;
+    player_options.num_search_threads = FLAGS_num_search_threads;
     player_options.inject_noise = false;
     player_options.random_seed = FLAGS_seed;
     player_options.tree.value_init_penalty = FLAGS_value_init_penalty;
     player_options.tree.soft_pick_enabled = false;
 
+    if (!FLAGS_tournament_models.empty()) {
+      RunTournament(player_options, start_time);
+      return;
+    }
+
     player_options.num_readouts = FLAGS_num_eval_readouts;
     EvaluatedModel eval_model(batchers_.front().get(), FLAGS_eval_model,
                               player_options);
@@ -186,8 +238,14 @@ class Evaluator {
     EvaluatedModel target_model(batchers_.back().get(), FLAGS_target_model,
                               player_options);
 
-    int num_games = FLAGS_parallel_games;
-    for (int thread_id = 0; thread_id < num_games; ++thread_id) {
+    eval_model_ = &eval_model;
+    {
+      absl::MutexLock lock(&mutex_);
+      num_games_remaining_ =
+          FLAGS_num_games > 0 ? FLAGS_num_games : FLAGS_parallel_games;
+    }
+
+    for (int thread_id = 0; thread_id < FLAGS_parallel_games; ++thread_id) {
       bool swap_models = (thread_id & 1) != 0;
       threads_.emplace_back(
           std::bind(&Evaluator::ThreadRun, this, thread_id,
@@ -198,8 +256,13 @@ class Evaluator {
       t.join();
     }
 
-    MG_LOG(INFO) << "Evaluated " << num_games << " games, total time "
-                 << (absl::Now() - start_time);
+    int num_games_completed;
+    {
+      absl::MutexLock lock(&mutex_);
+      num_games_completed = num_games_completed_;
+    }
+    MG_LOG(INFO) << "Evaluated " << num_games_completed
+                 << " games, total time " << (absl::Now() - start_time);
 
     MG_LOG(INFO) << FormatWinStatsTable(
         {{eval_model.name(), eval_model.GetWinStats()},
@@ -207,8 +270,210 @@ class Evaluator {
   }
 
  private:
+  // A scheduled tournament game between two models, identified by their
+  // indices into the tournament's model list.
+  struct Pairing {
+    int black;
+    int white;
+  };
+
+  // Plays a round-robin tournament between --tournament_models. Every model
+  // is loaded once and every pairing's games run concurrently through the
+  // shared batchers, so an N model cross-table costs one process launch and
+  // one model-load each instead of N^2 of both.
+  void RunTournament(MctsPlayer::Options player_options,
+                     absl::Time start_time) {
+    MG_CHECK(!FLAGS_sprt) << "--sprt isn't supported in tournament mode";
+
+    player_options.num_readouts = FLAGS_num_eval_readouts;
+    std::vector<std::string> paths =
+        absl::StrSplit(FLAGS_tournament_models, ',', absl::SkipEmpty());
+    MG_CHECK(paths.size() >= 2)
+        << "--tournament_models needs at least two models";
+
+    std::vector<std::unique_ptr<EvaluatedModel>> models;
+    for (const auto& path : paths) {
+      models.push_back(absl::make_unique<EvaluatedModel>(
+          batchers_.front().get(), path, player_options));
+    }
+    auto num_models = static_cast<int>(models.size());
+
+    {
+      absl::MutexLock lock(&mutex_);
+
+      // Schedule every pairing's games, alternating colors from game to
+      // game. The schedule is shuffled so that all pairings are in flight
+      // at once and the shared inference batches stay full, instead of the
+      // tournament running as a sequence of two-model matches.
+      for (int i = 0; i < num_models; ++i) {
+        for (int j = i + 1; j < num_models; ++j) {
+          for (int g = 0; g < FLAGS_games_per_pairing; ++g) {
+            if ((g & 1) == 0) {
+              schedule_.push_back({i, j});
+            } else {
+              schedule_.push_back({j, i});
+            }
+          }
+        }
+      }
+      Random rnd(FLAGS_seed, Random::kUniqueStream);
+      rnd.Shuffle(&schedule_);
+
+      wins_.assign(num_models, std::vector<int>(num_models, 0));
+    }
+
+    for (int thread_id = 0; thread_id < FLAGS_parallel_games; ++thread_id) {
+      threads_.emplace_back(std::bind(&Evaluator::ThreadRunTournament, this,
+                                      thread_id, &models));
+    }
+    for (auto& t : threads_) {
+      t.join();
+    }
+
+    int num_games_completed;
+    std::vector<std::vector<int>> wins;
+    {
+      absl::MutexLock lock(&mutex_);
+      num_games_completed = num_games_completed_;
+      wins = wins_;
+    }
+    MG_LOG(INFO) << "Evaluated " << num_games_completed
+                 << " games, total time " << (absl::Now() - start_time);
+
+    std::vector<std::string> names;
+    std::vector<std::pair<std::string, WinStats>> stats;
+    for (const auto& model : models) {
+      names.push_back(model->name());
+      stats.emplace_back(model->name(), model->GetWinStats());
+    }
+    MG_LOG(INFO) << FormatWinStatsTable(stats);
+    MG_LOG(INFO) << FormatCrossTable(names, wins);
+  }
+
+  void ThreadRunTournament(
+      int thread_id, std::vector<std::unique_ptr<EvaluatedModel>>* models) {
+    for (;;) {
+      Pairing pairing;
+      {
+        absl::MutexLock lock(&mutex_);
+        if (schedule_.empty()) {
+          break;
+        }
+        pairing = schedule_.back();
+        schedule_.pop_back();
+      }
+
+      auto* black = (*models)[pairing.black].get();
+      auto* white = (*models)[pairing.white].get();
+      auto* winner = PlayGame(thread_id, black, white);
+      MG_CHECK(winner != nullptr);
+
+      absl::MutexLock lock(&mutex_);
+      num_games_completed_ += 1;
+      if (winner == black) {
+        wins_[pairing.black][pairing.white] += 1;
+      } else {
+        wins_[pairing.white][pairing.black] += 1;
+      }
+    }
+    MG_LOG(INFO) << "Thread " << thread_id << " stopping";
+  }
+
+  // Formats the tournament results as a cross-table: cell (r, c) holds
+  // model r's wins and losses against model c.
+  static std::string FormatCrossTable(
+      const std::vector<std::string>& names,
+      const std::vector<std::vector<int>>& wins) {
+    auto num_models = static_cast<int>(names.size());
+
+    std::string result = "Tournament cross-table (row wins-losses vs col):\n";
+    for (int i = 0; i < num_models; ++i) {
+      absl::StrAppendFormat(&result, "  #%-3d %s\n", i, names[i]);
+    }
+
+    absl::StrAppendFormat(&result, "%8s", "");
+    for (int i = 0; i < num_models; ++i) {
+      absl::StrAppendFormat(&result, "     #%-3d", i);
+    }
+    absl::StrAppendFormat(&result, "    total\n");
+
+    for (int i = 0; i < num_models; ++i) {
+      absl::StrAppendFormat(&result, "  #%-3d  ", i);
+      int total_wins = 0;
+      int total_losses = 0;
+      for (int j = 0; j < num_models; ++j) {
+        if (j == i) {
+          absl::StrAppendFormat(&result, "%9s", "-");
+        } else {
+          absl::StrAppendFormat(
+              &result, "%9s", absl::StrFormat("%d-%d", wins[i][j], wins[j][i]));
+          total_wins += wins[i][j];
+          total_losses += wins[j][i];
+        }
+      }
+      absl::StrAppendFormat(
+          &result, "%9s\n",
+          absl::StrFormat("%d-%d", total_wins, total_losses));
+    }
+    return result;
+  }
+
   void ThreadRun(int thread_id, EvaluatedModel* black_model,
                  EvaluatedModel* white_model) {
+    while (ShouldStartGame()) {
+      auto* winner = PlayGame(thread_id, black_model, white_model);
+      if (winner != nullptr) {
+        ReportResult(winner == eval_model_);
+      }
+    }
+    MG_LOG(INFO) << "Thread " << thread_id << " stopping";
+  }
+
+  // Returns true if the calling thread should play another game: the game
+  // budget hasn't been exhausted and the match result isn't already decided.
+  bool ShouldStartGame() {
+    absl::MutexLock lock(&mutex_);
+    if (match_decided_.load(std::memory_order_relaxed) ||
+        num_games_remaining_ == 0) {
+      return false;
+    }
+    num_games_remaining_ -= 1;
+    return true;
+  }
+
+  // Records a finished game's result and, if SPRT early stopping is
+  // enabled, checks whether the match is now decided: the log likelihood
+  // ratio of the eval model's win record under the two hypothesized win
+  // rates is compared against the Wald decision bounds.
+  void ReportResult(bool eval_model_won) {
+    absl::MutexLock lock(&mutex_);
+    num_games_completed_ += 1;
+    if (eval_model_won) {
+      num_eval_wins_ += 1;
+    }
+    if (!FLAGS_sprt || match_decided_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    int num_eval_losses = num_games_completed_ - num_eval_wins_;
+    double llr =
+        num_eval_wins_ * std::log(FLAGS_sprt_p1 / FLAGS_sprt_p0) +
+        num_eval_losses * std::log((1 - FLAGS_sprt_p1) / (1 - FLAGS_sprt_p0));
+    double upper = std::log((1 - FLAGS_sprt_beta) / FLAGS_sprt_alpha);
+    double lower = std::log(FLAGS_sprt_beta / (1 - FLAGS_sprt_alpha));
+    if (llr >= upper || llr <= lower) {
+      match_decided_.store(true, std::memory_order_relaxed);
+      MG_LOG(INFO) << "SPRT decided the match after " << num_games_completed_
+                   << " games (" << num_eval_wins_ << " eval model wins, "
+                   << "llr " << llr << "): the eval model is "
+                   << (llr >= upper ? "" : "not ") << "stronger";
+    }
+  }
+
+  // Plays one game and returns the winning model, or nullptr if the game
+  // was abandoned because the match was decided early.
+  EvaluatedModel* PlayGame(int thread_id, EvaluatedModel* black_model,
+                           EvaluatedModel* white_model) {
     // Only print the board using ANSI colors if stderr is sent to the
     // terminal.
     const bool use_ansi_colors = FdSupportsAnsiColors(fileno(stderr));
@@ -222,7 +487,7 @@ class Evaluator {
     if (!FLAGS_output_bigtable.empty() && !use_bigtable) {
       MG_LOG(FATAL)
           << "Bigtable output must be of the form: project,instance,table";
-      return;
+      return nullptr;
     }
 
     Game game(black_model->name(), white_model->name(), game_options_);
@@ -237,8 +502,13 @@ class Evaluator {
     auto* curr_player = black.get();
     auto* next_player = white.get();
     while (!game.game_over()) {
-      if (curr_player->root()->position.n() >= kMinPassAliveMoves &&
-          curr_player->root()->position.CalculateWholeBoardPassAlive()) {
+      if (match_decided_.load(std::memory_order_relaxed)) {
+        // The match outcome is already decided; this game can't change it,
+        // so don't burn readouts finishing it.
+        break;
+      }
+      if (curr_player->root()->position().n() >= kMinPassAliveMoves &&
+          curr_player->root()->position().CalculateWholeBoardPassAlive()) {
         // Play pass moves to end the game.
         while (!game.game_over()) {
           MG_CHECK(curr_player->PlayMove(Coord::kPass));
@@ -258,21 +528,24 @@ class Evaluator {
       }
       if (verbose) {
         MG_LOG(INFO) << absl::StreamFormat(
-            "%d: %s by %s\nQ: %0.4f", curr_player->root()->position.n(),
+            "%d: %s by %s\nQ: %0.4f", curr_player->root()->position().n(),
             move.ToGtp(), curr_player->name(), curr_player->root()->Q());
-        MG_LOG(INFO) << curr_player->root()->position.ToPrettyString(
+        MG_LOG(INFO) << curr_player->root()->position().ToPrettyString(
             use_ansi_colors);
       }
       std::swap(curr_player, next_player);
     }
     BatchingModelFactory::EndGame(black->model(), white->model());
 
-    if (game.result() > 0) {
-      black_model->UpdateWinStats(game);
-    } else {
-      white_model->UpdateWinStats(game);
+    if (!game.game_over()) {
+      // The game was abandoned because the match was decided early; its
+      // result doesn't count.
+      return nullptr;
     }
 
+    EvaluatedModel* winner = game.result() > 0 ? black_model : white_model;
+    winner->UpdateWinStats(game);
+
     if (verbose) {
       MG_LOG(INFO) << game.result_string();
       MG_LOG(INFO) << "Black was: " << game.black_name();
@@ -298,13 +571,29 @@ class Evaluator {
                                 game, output_name, FLAGS_bigtable_tag);
     }
 
-    MG_LOG(INFO) << "Thread " << thread_id << " stopping";
+    return winner;
   }
 
   Game::Options game_options_;
   std::vector<std::thread> threads_;
   std::atomic<size_t> game_id_{0};
   std::vector<std::unique_ptr<BatchingModelFactory>> batchers_;
+
+  EvaluatedModel* eval_model_ = nullptr;
+
+  absl::Mutex mutex_;
+  int num_games_remaining_ GUARDED_BY(&mutex_) = 0;
+  int num_games_completed_ GUARDED_BY(&mutex_) = 0;
+  int num_eval_wins_ GUARDED_BY(&mutex_) = 0;
+
+  // Tournament mode state: the games left to play, and wins_[i][j] counts
+  // how many games model i has won against model j with either color.
+  std::vector<Pairing> schedule_ GUARDED_BY(&mutex_);
+  std::vector<std::vector<int>> wins_ GUARDED_BY(&mutex_);
+
+  // Set once the SPRT bounds are crossed; checked without the mutex in the
+  // per-move loop so in-flight games can be abandoned promptly.
+  std::atomic<bool> match_decided_{false};
 };
 
 }  // namespace
@@ -312,7 +601,10 @@ class Evaluator {
 
 int main(int argc, char* argv[]) {
   minigo::Init(&argc, &argv);
-  minigo::zobrist::Init(FLAGS_seed);
+  minigo::SetModelCacheDir(FLAGS_model_cache_dir);
+  if (!FLAGS_inference_trace.empty()) {
+    minigo::InferenceTraceWriter::Enable(FLAGS_inference_trace);
+  }
   minigo::Evaluator evaluator;
   evaluator.Run();
   return 0;
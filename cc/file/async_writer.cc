@@ -0,0 +1,122 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/file/async_writer.h"
+
+#include <utility>
+
+#include "cc/async/background_pool.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+
+namespace minigo {
+namespace file {
+
+AsyncWriter::AsyncWriter(int max_concurrent_writes, size_t max_queued_bytes)
+    : max_concurrent_writes_(max_concurrent_writes),
+      max_queued_bytes_(max_queued_bytes) {}
+
+AsyncWriter::~AsyncWriter() {
+  // Also waits for any drain task that still holds a pointer to this writer.
+  Flush();
+}
+
+void AsyncWriter::WriteFile(std::string path, std::string contents) {
+  absl::MutexLock lock(&mutex_);
+  auto has_space = [this]() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return queued_bytes_ <= max_queued_bytes_;
+  };
+  mutex_.Await(absl::Condition(&has_space));
+  auto size = contents.size();
+  queued_bytes_ += size;
+  queue_.push_back({std::move(path), std::move(contents), nullptr, size});
+  MaybeScheduleLocked();
+}
+
+void AsyncWriter::WriteFile(std::string path, size_t estimated_size,
+                            std::function<std::string()> make_contents) {
+  absl::MutexLock lock(&mutex_);
+  auto has_space = [this]() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return queued_bytes_ <= max_queued_bytes_;
+  };
+  mutex_.Await(absl::Condition(&has_space));
+  queued_bytes_ += estimated_size;
+  queue_.push_back(
+      {std::move(path), {}, std::move(make_contents), estimated_size});
+  MaybeScheduleLocked();
+}
+
+void AsyncWriter::Flush() {
+  absl::MutexLock lock(&mutex_);
+  auto all_done = [this]() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return queue_.empty() && num_in_flight_ == 0;
+  };
+  mutex_.Await(absl::Condition(&all_done));
+}
+
+void AsyncWriter::MaybeScheduleLocked() {
+  // Each in-flight task keeps draining while writes remain queued, so one
+  // task is enough for correctness; extra tasks (up to the cap) let queued
+  // writes land in parallel.
+  if (num_in_flight_ >= max_concurrent_writes_ ||
+      num_in_flight_ >= static_cast<int>(queue_.size())) {
+    return;
+  }
+  num_in_flight_ += 1;
+  BackgroundPool::Get()->Schedule(BackgroundPool::Priority::kNormal,
+                                  [this]() { DrainOne(); });
+}
+
+void AsyncWriter::DrainOne() {
+  PendingWrite write;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (queue_.empty()) {
+      // Another task claimed the remaining writes.
+      num_in_flight_ -= 1;
+      return;
+    }
+    write = std::move(queue_.front());
+    queue_.pop_front();
+  }
+
+  if (write.make_contents != nullptr) {
+    write.contents = write.make_contents();
+  }
+
+  if (!file::RecursivelyCreateDir(std::string(Dirname(write.path))) ||
+      !file::WriteFile(write.path, write.contents)) {
+    MG_LOG(ERROR) << "async write of " << write.path << " failed";
+  }
+
+  bool reschedule;
+  {
+    absl::MutexLock lock(&mutex_);
+    queued_bytes_ -= write.queued_size;
+    reschedule = !queue_.empty();
+    if (!reschedule) {
+      num_in_flight_ -= 1;
+    }
+  }
+  if (reschedule) {
+    // One write per task: requeueing behind other consumers' tasks keeps a
+    // deep backlog here from hogging a pool thread.
+    BackgroundPool::Get()->Schedule(BackgroundPool::Priority::kNormal,
+                                    [this]() { DrainOne(); });
+  }
+}
+
+}  // namespace file
+}  // namespace minigo
@@ -0,0 +1,96 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_FILE_ASYNC_WRITER_H_
+#define CC_FILE_ASYNC_WRITER_H_
+
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "absl/synchronization/mutex.h"
+
+namespace minigo {
+namespace file {
+
+// AsyncWriter performs whole-file writes on the shared background pool
+// (cc/async/background_pool.h), so callers producing files (SGFs, TF
+// examples) don't stall on slow filesystems like GCS.
+//
+// Writes are buffered up to `max_queued_bytes`: once that much data is in
+// flight, WriteFile blocks until the backlog drains, so a slow filesystem
+// applies backpressure instead of growing the queue without bound.
+//
+// The writer creates each file's parent directory if necessary. Because the
+// writes happen after WriteFile returns, failures can't be returned to the
+// caller and are logged instead.
+class AsyncWriter {
+ public:
+  // `max_concurrent_writes` caps how many of the pool's threads this writer
+  // will occupy at once, so one writer's backlog doesn't monopolize the pool
+  // (it was the size of the writer's dedicated thread pool before the pool
+  // was shared).
+  explicit AsyncWriter(int max_concurrent_writes = 2,
+                       size_t max_queued_bytes = 64 * 1024 * 1024);
+
+  // Flushes all pending writes.
+  ~AsyncWriter();
+
+  // Queues `contents` to be written to `path`, blocking while more than
+  // `max_queued_bytes` are already queued.
+  void WriteFile(std::string path, std::string contents);
+
+  // Like the above, but the contents are produced by calling `make_contents`
+  // on a writer thread, so expensive serialization or compression runs on
+  // the writer pool (and in parallel across queued files) instead of on the
+  // caller. `estimated_size` is the caller's guess at the contents' size and
+  // is counted against `max_queued_bytes` until the write completes.
+  void WriteFile(std::string path, size_t estimated_size,
+                 std::function<std::string()> make_contents);
+
+  // Blocks until every write queued so far has been written out.
+  void Flush();
+
+ private:
+  struct PendingWrite {
+    std::string path;
+    std::string contents;
+    // If set, called on the writer thread to produce the contents.
+    std::function<std::string()> make_contents;
+    // The number of bytes this write contributes to queued_bytes_.
+    size_t queued_size;
+  };
+
+  // Writes one queued file, then either reschedules itself on the pool if
+  // more writes are queued, or exits the in-flight count.
+  void DrainOne();
+
+  // Schedules another drain task if there are unclaimed writes and the
+  // writer is below its concurrency cap.
+  void MaybeScheduleLocked() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  const int max_concurrent_writes_;
+  const size_t max_queued_bytes_;
+
+  absl::Mutex mutex_;
+  std::deque<PendingWrite> queue_ GUARDED_BY(&mutex_);
+  size_t queued_bytes_ GUARDED_BY(&mutex_) = 0;
+  // The number of drain tasks scheduled on the pool or currently running.
+  int num_in_flight_ GUARDED_BY(&mutex_) = 0;
+};
+
+}  // namespace file
+}  // namespace minigo
+
+#endif  // CC_FILE_ASYNC_WRITER_H_
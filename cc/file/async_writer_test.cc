@@ -0,0 +1,109 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/file/async_writer.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace file {
+namespace {
+
+std::string FullPath(const char* basename) {
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  return JoinPath(tmpdir, basename);
+}
+
+TEST(AsyncWriterTest, WriteAndFlush) {
+  auto dir = FullPath("async_writer/write_and_flush");
+
+  AsyncWriter writer(2);
+  // The writer should create the parent directory itself.
+  writer.WriteFile(JoinPath(dir, "a.txt"), "contents of a");
+  writer.WriteFile(JoinPath(dir, "b.txt"), "contents of b");
+  writer.Flush();
+
+  std::string contents;
+  ASSERT_TRUE(ReadFile(JoinPath(dir, "a.txt"), &contents));
+  EXPECT_EQ("contents of a", contents);
+  ASSERT_TRUE(ReadFile(JoinPath(dir, "b.txt"), &contents));
+  EXPECT_EQ("contents of b", contents);
+}
+
+TEST(AsyncWriterTest, DeferredContents) {
+  auto dir = FullPath("async_writer/deferred");
+
+  AsyncWriter writer(2);
+  for (int i = 0; i < 10; ++i) {
+    writer.WriteFile(JoinPath(dir, absl::StrCat(i, ".txt")),
+                     /*estimated_size=*/8,
+                     [i]() { return absl::StrCat("file ", i); });
+  }
+  writer.Flush();
+
+  for (int i = 0; i < 10; ++i) {
+    std::string contents;
+    ASSERT_TRUE(ReadFile(JoinPath(dir, absl::StrCat(i, ".txt")), &contents));
+    EXPECT_EQ(absl::StrCat("file ", i), contents);
+  }
+}
+
+TEST(AsyncWriterTest, DestructorDrainsQueue) {
+  auto dir = FullPath("async_writer/destructor_drains");
+
+  {
+    AsyncWriter writer(1);
+    for (int i = 0; i < 100; ++i) {
+      writer.WriteFile(JoinPath(dir, absl::StrCat(i, ".txt")),
+                       absl::StrCat("file ", i));
+    }
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    std::string contents;
+    ASSERT_TRUE(ReadFile(JoinPath(dir, absl::StrCat(i, ".txt")), &contents));
+    EXPECT_EQ(absl::StrCat("file ", i), contents);
+  }
+}
+
+TEST(AsyncWriterTest, Backpressure) {
+  auto dir = FullPath("async_writer/backpressure");
+
+  // A tiny buffer forces WriteFile to block on the in-flight writes: every
+  // write must still land exactly once.
+  AsyncWriter writer(2, /*max_queued_bytes=*/16);
+  std::string contents(64, 'x');
+  for (int i = 0; i < 100; ++i) {
+    writer.WriteFile(JoinPath(dir, absl::StrCat(i, ".txt")), contents);
+  }
+  writer.Flush();
+
+  for (int i = 0; i < 100; ++i) {
+    std::string read_back;
+    ASSERT_TRUE(ReadFile(JoinPath(dir, absl::StrCat(i, ".txt")), &read_back));
+    EXPECT_EQ(contents, read_back);
+  }
+}
+
+}  // namespace
+}  // namespace file
+}  // namespace minigo
@@ -14,12 +14,19 @@
 
 #include "cc/file/directory_watcher.h"
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif  // __linux__
+
+#include <cerrno>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
-#include "cc/async/poll_thread.h"
+#include "cc/async/timer_service.h"
 #include "cc/file/path.h"
 #include "cc/file/utils.h"
 #include "cc/logging.h"
@@ -77,15 +84,90 @@ DirectoryWatcher::DirectoryWatcher(
   MG_CHECK(ParseModelPathPattern(pattern, &directory_, &basename_pattern_));
   basename_and_length_pattern_ = absl::StrCat(basename_pattern_, "%n");
 
-  poll_thread_ = absl::make_unique<PollThread>(
-      "DirWatcher", poll_interval, std::bind(&DirectoryWatcher::Poll, this));
-  poll_thread_->Start();
+  // Prefer inotify where available: new models get picked up as soon as they
+  // hit the directory instead of up to poll_interval later. Fall back to
+  // polling if the directory can't be watched (e.g. it's on GCS).
+  if (!TryStartInotify()) {
+    poll_timer_ = TimerService::Get()->AddPeriodic(
+        poll_interval, std::bind(&DirectoryWatcher::Poll, this));
+  }
 }
 
 DirectoryWatcher::~DirectoryWatcher() {
-  poll_thread_->Join();
+  if (poll_timer_ != TimerService::kInvalidTimerId) {
+    // Cancel blocks until any in-flight Poll has returned.
+    TimerService::Get()->Cancel(poll_timer_);
+  }
+#ifdef __linux__
+  if (watch_thread_ != nullptr) {
+    // Wake the watch thread up so it notices that it should exit.
+    MG_CHECK(write(wakeup_fds_[1], "x", 1) == 1);
+    watch_thread_->Join();
+  }
+  for (int fd : {inotify_fd_, wakeup_fds_[0], wakeup_fds_[1]}) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+#endif  // __linux__
+}
+
+#ifdef __linux__
+
+bool DirectoryWatcher::TryStartInotify() {
+  inotify_fd_ = inotify_init1(IN_NONBLOCK);
+  if (inotify_fd_ == -1) {
+    return false;
+  }
+  // Watch for anything that makes a new basename appear in the directory:
+  // models are either written in place or renamed in from a temporary path.
+  if (inotify_add_watch(inotify_fd_, directory_.c_str(),
+                        IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) == -1) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+    return false;
+  }
+  MG_CHECK(pipe(wakeup_fds_) == 0);
+
+  watch_thread_ = absl::make_unique<LambdaThread>("DirWatcher", [this]() {
+    // Scan once up front for files that predate the watch.
+    Poll();
+
+    for (;;) {
+      pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wakeup_fds_[0], POLLIN, 0}};
+      if (poll(fds, 2, -1) == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        MG_LOG(ERROR) << "poll on inotify fd failed, errno:" << errno;
+        break;
+      }
+      if (fds[1].revents != 0) {
+        // The destructor wants us to exit.
+        break;
+      }
+      if (fds[0].revents != 0) {
+        // Drain the queued events: we don't care what they are, any activity
+        // in the directory just triggers a rescan. Poll() is cheap when
+        // nothing relevant changed and this keeps us robust against event
+        // overflow.
+        char buf[4096];
+        while (read(inotify_fd_, buf, sizeof(buf)) > 0) {
+        }
+        Poll();
+      }
+    }
+  });
+  watch_thread_->Start();
+  return true;
 }
 
+#else  // __linux__
+
+bool DirectoryWatcher::TryStartInotify() { return false; }
+
+#endif  // __linux__
+
 void DirectoryWatcher::Poll() {
   // List all the files in the given directory.
   std::vector<std::string> basenames;
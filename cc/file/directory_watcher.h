@@ -22,19 +22,24 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "cc/async/thread.h"
+#include "cc/async/timer_service.h"
 
 namespace minigo {
 
 class DirectoryWatcher {
  public:
-  // The `DirectoryWatcher` polls a directory at the given `poll_interval` for
-  // new files that match file `pattern`.
+  // The `DirectoryWatcher` watches a directory for new files that match file
+  // `pattern`.
   // `pattern` must be a file path that contains exactly one "%d" scanf
   // matcher in the basename part (not the dirname part).
   // `callback` will invoked whenever a later file that matches `pattern` is
   // found. The callback is invoked on a background thread (though a single
   // `DirectoryWatcher` instance only ever makes one call to `callback` at a
   // time).
+  // On Linux, local directories are watched with inotify and the callback
+  // fires as soon as a matching file appears. Elsewhere (and for paths that
+  // inotify can't watch, e.g. GCS), the directory is polled at the given
+  // `poll_interval`.
   DirectoryWatcher(const std::string& pattern, absl::Duration poll_interval,
                    std::function<void(const std::string&)> callback);
 
@@ -43,6 +48,9 @@ class DirectoryWatcher {
  private:
   void Poll();
 
+  // Attempts to watch directory_ with inotify, returning true on success.
+  bool TryStartInotify();
+
   // The directory we're watching for new files.
   std::string directory_;
 
@@ -55,7 +63,14 @@ class DirectoryWatcher {
 
   std::string latest_path_;
 
-  std::unique_ptr<Thread> poll_thread_;
+  // Periodic poll scheduled on the shared TimerService when the inotify fast
+  // path isn't available.
+  TimerService::TimerId poll_timer_ = TimerService::kInvalidTimerId;
+
+  // Used by the inotify fast path.
+  std::unique_ptr<Thread> watch_thread_;
+  int inotify_fd_ = -1;
+  int wakeup_fds_[2] = {-1, -1};
 
   std::function<void(const std::string&)> callback_;
 };
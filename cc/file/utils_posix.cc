@@ -146,7 +146,7 @@ bool ListDir(std::string directory, std::vector<std::string>* files) {
 
 bool FileExists(std::string path) {
   path = NormalizeSlashes(path);
-  return access(path.c_str(), F_OK);
+  return access(path.c_str(), F_OK) == 0;
 }
 
 }  // namespace file
@@ -12,7 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
 #include <memory>
+#include <string>
 
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
@@ -25,6 +31,123 @@
 namespace minigo {
 namespace file {
 
+namespace {
+
+// True if the path must be handled by TensorFlow's filesystem layer (e.g.
+// gs:// object storage). Local paths are handled with plain POSIX calls
+// below, so that binaries which never touch a remote path don't fault in
+// TensorFlow's Env and filesystem registry: tools like sample_records are
+// invoked thousands of times a day by the RL loop and shouldn't pay
+// TensorFlow runtime startup just to read local files.
+bool IsTfPath(absl::string_view path) {
+  return absl::StrContains(path, "://");
+}
+
+bool MaybeCreateDir(const std::string& path) {
+  int ret = mkdir(path.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+  if (ret == 0) {
+    return true;
+  }
+
+  if (errno != EEXIST) {
+    return false;
+  }
+
+  if (path == "/") {
+    return true;
+  }
+
+  struct stat st;
+  ret = stat(path.c_str(), &st);
+  if (ret != 0) {
+    return false;
+  }
+
+  return S_ISDIR(st.st_mode);
+}
+
+bool LocalRecursivelyCreateDir(const std::string& path) {
+  if (MaybeCreateDir(path)) {
+    return true;
+  }
+
+  if (!LocalRecursivelyCreateDir(std::string(Dirname(path)))) {
+    return false;
+  }
+
+  // Creates the directory knowing the parent already exists.
+  return MaybeCreateDir(path);
+}
+
+bool LocalWriteFile(const std::string& path, absl::string_view contents) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    MG_LOG(ERROR) << "error opening " << path << " for write";
+    return false;
+  }
+
+  bool ok = true;
+  if (!contents.empty()) {
+    ok = fwrite(contents.data(), contents.size(), 1, f) == 1;
+    if (!ok) {
+      MG_LOG(ERROR) << "error writing " << path;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+bool LocalReadFile(const std::string& path, std::string* contents) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    MG_LOG(ERROR) << "error opening " << path << " for read";
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  contents->resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  bool ok = contents->empty() ||
+            fread(&(*contents)[0], contents->size(), 1, f) == 1;
+  if (!ok) {
+    MG_LOG(ERROR) << "error reading " << path;
+  }
+  fclose(f);
+  return ok;
+}
+
+bool LocalGetModTime(const std::string& path, uint64_t* mtime_usec) {
+  struct stat s;
+  int result = stat(path.c_str(), &s);
+  if (result != 0) {
+    MG_LOG(ERROR) << "error statting " << path << ": " << result;
+    return false;
+  }
+  *mtime_usec = static_cast<uint64_t>(s.st_mtime) * 1000 * 1000;
+  return true;
+}
+
+bool LocalListDir(const std::string& directory,
+                  std::vector<std::string>* files) {
+  DIR* dirp = opendir(directory.c_str());
+  if (dirp == nullptr) {
+    MG_LOG(ERROR) << "could not open directory " << directory;
+    return false;
+  }
+  files->clear();
+  while (dirent* dp = readdir(dirp)) {
+    absl::string_view p(dp->d_name);
+    if (p == "." || p == "..") {
+      continue;
+    }
+    files->push_back(dp->d_name);
+  }
+  closedir(dirp);
+
+  return true;
+}
+
+}  // namespace
+
 bool RecursivelyCreateDir(std::string path) {
   path = NormalizeSlashes(path);
 
@@ -37,6 +160,10 @@ bool RecursivelyCreateDir(std::string path) {
     return true;
   }
 
+  if (!IsTfPath(path)) {
+    return LocalRecursivelyCreateDir(path);
+  }
+
   auto* env = tensorflow::Env::Default();
   status = env->RecursivelyCreateDir(path);
   if (!status.ok()) {
@@ -50,6 +177,10 @@ bool RecursivelyCreateDir(std::string path) {
 bool WriteFile(std::string path, absl::string_view contents) {
   path = NormalizeSlashes(path);
 
+  if (!IsTfPath(path)) {
+    return LocalWriteFile(path, contents);
+  }
+
   tensorflow::Status status;
   auto* env = tensorflow::Env::Default();
 
@@ -82,6 +213,10 @@ bool WriteFile(std::string path, absl::string_view contents) {
 bool ReadFile(std::string path, std::string* contents) {
   path = NormalizeSlashes(path);
 
+  if (!IsTfPath(path)) {
+    return LocalReadFile(path, contents);
+  }
+
   tensorflow::Status status;
   auto* env = tensorflow::Env::Default();
 
@@ -114,6 +249,10 @@ bool ReadFile(std::string path, std::string* contents) {
 bool GetModTime(std::string path, uint64_t* mtime_usec) {
   path = NormalizeSlashes(path);
 
+  if (!IsTfPath(path)) {
+    return LocalGetModTime(path, mtime_usec);
+  }
+
   tensorflow::Status status;
   auto* env = tensorflow::Env::Default();
   tensorflow::FileStatistics stat;
@@ -131,6 +270,10 @@ bool GetModTime(std::string path, uint64_t* mtime_usec) {
 bool ListDir(std::string directory, std::vector<std::string>* files) {
   directory = NormalizeSlashes(directory);
 
+  if (!IsTfPath(directory)) {
+    return LocalListDir(directory, files);
+  }
+
   tensorflow::Status status;
   auto* env = tensorflow::Env::Default();
 
@@ -145,6 +288,9 @@ bool ListDir(std::string directory, std::vector<std::string>* files) {
 
 bool FileExists(std::string path) {
   path = NormalizeSlashes(path);
+  if (!IsTfPath(path)) {
+    return access(path.c_str(), F_OK) == 0;
+  }
   auto* env = tensorflow::Env::Default();
   return env->FileExists(path).ok();
 }
@@ -14,6 +14,9 @@
 
 #include "cc/game.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
@@ -21,6 +24,93 @@
 
 namespace minigo {
 
+constexpr int SparsePi::kMaxEntries;
+constexpr uint16_t SparsePi::kPaddingCoord;
+constexpr size_t SparsePi::kPackedSize;
+
+SparsePi::SparsePi(const std::array<float, kNumMoves>& pi) {
+  std::vector<Entry> entries;
+  for (int i = 0; i < kNumMoves; ++i) {
+    if (pi[i] != 0) {
+      entries.push_back({static_cast<uint16_t>(i), pi[i]});
+    }
+  }
+  if (static_cast<int>(entries.size()) > kMaxEntries) {
+    std::nth_element(entries.begin(), entries.begin() + kMaxEntries,
+                     entries.end(),
+                     [](const Entry& a, const Entry& b) { return a.p > b.p; });
+    for (size_t i = kMaxEntries; i < entries.size(); ++i) {
+      remainder_ += entries[i].p;
+    }
+    entries.resize(kMaxEntries);
+    // Restore the coordinate order the untruncated path produces, so the
+    // encoding of a policy doesn't depend on how it was built.
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.c < b.c; });
+  }
+  entries.shrink_to_fit();
+  entries_ = std::move(entries);
+}
+
+void SparsePi::ToDense(std::array<float, kNumMoves>* pi) const {
+  float eps = 0;
+  if (remainder_ > 0) {
+    eps = remainder_ / (kNumMoves - entries_.size());
+  }
+  pi->fill(eps);
+  for (const auto& entry : entries_) {
+    (*pi)[entry.c] = entry.p;
+  }
+}
+
+void SparsePi::Pack(void* dst) const {
+  std::array<uint16_t, kMaxEntries> coords;
+  std::array<float, kMaxEntries> probs;
+  coords.fill(kPaddingCoord);
+  probs.fill(0);
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    coords[i] = entries_[i].c;
+    probs[i] = entries_[i].p;
+  }
+  auto* p = static_cast<char*>(dst);
+  memcpy(p, coords.data(), sizeof(coords));
+  memcpy(p + sizeof(coords), probs.data(), sizeof(probs));
+  memcpy(p + sizeof(coords) + sizeof(probs), &remainder_, sizeof(remainder_));
+}
+
+SparsePi SparsePi::ApplySymmetry(symmetry::Symmetry sym) const {
+  SparsePi result;
+  result.entries_.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    result.entries_.push_back(
+        {static_cast<uint16_t>(symmetry::ApplySymmetry(sym, Coord(entry.c))),
+         entry.p});
+  }
+  // Restore the coordinate-sorted order the constructor produces, so packed
+  // encodings stay canonical under remapping.
+  std::sort(result.entries_.begin(), result.entries_.end(),
+            [](const Entry& a, const Entry& b) { return a.c < b.c; });
+  result.remainder_ = remainder_;
+  return result;
+}
+
+SparsePi SparsePi::Unpack(const void* src) {
+  std::array<uint16_t, kMaxEntries> coords;
+  std::array<float, kMaxEntries> probs;
+  const auto* p = static_cast<const char*>(src);
+  memcpy(coords.data(), p, sizeof(coords));
+  memcpy(probs.data(), p + sizeof(coords), sizeof(probs));
+
+  SparsePi pi;
+  memcpy(&pi.remainder_, p + sizeof(coords) + sizeof(probs),
+         sizeof(pi.remainder_));
+  for (int i = 0; i < kMaxEntries && coords[i] != kPaddingCoord; ++i) {
+    MG_CHECK(coords[i] < kNumMoves);
+    pi.entries_.push_back({coords[i], probs[i]});
+  }
+  return pi;
+}
+
 std::ostream& operator<<(std::ostream& os, const Game::Options& options) {
   os << "resign_threshold:" << options.resign_threshold
      << " resign_enabled:" << options.resign_enabled << " komi:"
@@ -57,8 +147,15 @@ void Game::AddComment(const std::string& comment) {
 void Game::AddTrainableMove(Color color, Coord c, const Position& position,
                             std::string comment, float Q, int N,
                             const std::array<float, kNumMoves>& search_pi) {
-  AddNonTrainableMove(color, c, position, comment, Q, N);
-  moves_.back()->search_pi = search_pi;
+  AddTrainableMove(color, c, position, std::move(comment), Q, N,
+                   SparsePi(search_pi));
+}
+
+void Game::AddTrainableMove(Color color, Coord c, const Position& position,
+                            std::string comment, float Q, int N,
+                            SparsePi search_pi) {
+  AddNonTrainableMove(color, c, position, std::move(comment), Q, N);
+  moves_.back()->search_pi = std::move(search_pi);
 }
 
 void Game::AddNonTrainableMove(Color color, Coord c, const Position& position,
@@ -16,6 +16,8 @@
 #define CC_GAME_H_
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -26,9 +28,65 @@
 #include "cc/constants.h"
 #include "cc/coord.h"
 #include "cc/position.h"
+#include "cc/symmetries.h"
 
 namespace minigo {
 
+// Sparse encoding of a move's search policy. After a few hundred readouts
+// almost every entry of the dense policy produced by
+// MctsTree::CalculateSearchPi is zero, so storing just the visited moves as
+// (coordinate, probability) pairs cuts per-move memory by roughly 10x. The
+// kMaxEntries most probable moves are kept exactly, along with the total
+// probability mass of any dropped entries; ToDense spreads that remainder
+// uniformly over the unstored moves so the reconstructed distribution still
+// sums to 1.
+class SparsePi {
+ public:
+  struct Entry {
+    uint16_t c;
+    float p;
+  };
+
+  // Few moves have more than kMaxEntries visited children; the main
+  // exception is the opening, where the policy softmax temperature spreads
+  // visits widely and the dropped tail is close to uniform anyway.
+  static constexpr int kMaxEntries = 32;
+
+  // Padding value for unused coordinate slots in the packed encoding.
+  static constexpr uint16_t kPaddingCoord = 0xffff;
+
+  // Size in bytes of the fixed-stride packed encoding: kMaxEntries
+  // coordinates, then kMaxEntries probabilities, then the remainder.
+  static constexpr size_t kPackedSize =
+      kMaxEntries * (sizeof(uint16_t) + sizeof(float)) + sizeof(float);
+
+  SparsePi() = default;
+  explicit SparsePi(const std::array<float, kNumMoves>& pi);
+
+  // Reconstructs the dense policy.
+  void ToDense(std::array<float, kNumMoves>* pi) const;
+
+  // Writes the fixed-size packed encoding to `dst`, which must have room for
+  // kPackedSize bytes. Each field is contiguous (coordinates padded with
+  // kPaddingCoord, probabilities padded with zero) so training readers can
+  // decode each one with a single raw cast.
+  void Pack(void* dst) const;
+
+  // Parses a packed encoding written by Pack.
+  static SparsePi Unpack(const void* src);
+
+  // Returns a copy of the policy with each entry's coordinate remapped by
+  // `sym`. Pass entries and the dropped-tail remainder are unaffected.
+  SparsePi ApplySymmetry(symmetry::Symmetry sym) const;
+
+  const std::vector<Entry>& entries() const { return entries_; }
+  float remainder() const { return remainder_; }
+
+ private:
+  std::vector<Entry> entries_;
+  float remainder_ = 0;
+};
+
 // Holds game-specific options.
 // Holds the full history of a game.
 class Game {
@@ -64,7 +122,7 @@ class Game {
     std::string comment;
 
     // Only set if the move is trainable.
-    absl::optional<std::array<float, kNumMoves>> search_pi;
+    absl::optional<SparsePi> search_pi;
 
     // This is used to build training features after a selfplay game has
     // finished.
@@ -87,6 +145,9 @@ class Game {
   void AddTrainableMove(Color color, Coord c, const Position& position,
                         std::string comment, float Q, int N,
                         const std::array<float, kNumMoves>& search_pi);
+  void AddTrainableMove(Color color, Coord c, const Position& position,
+                        std::string comment, float Q, int N,
+                        SparsePi search_pi);
   void AddNonTrainableMove(Color color, Coord c, const Position& position,
                            std::string comment, float Q, int N);
 
@@ -96,11 +157,12 @@ class Game {
 
   void SetGameOverBecauseOfResign(Color winner);
 
-  // Returns up to the last `num_moves` of moves that lead up to the requested
-  // `move`, including the move itself.
+  // Fills `history` with pointers to the packed stones of up to the last
+  // `num_moves` positions that lead up to the requested `move`, including the
+  // move itself, newest first.
   // If `move < num_moves`, history will be truncated to the first `move` moves.
   template <typename T>
-  void GetPositionHistory(int move, int num_moves, T* history) const;
+  void GetStoneHistory(int move, int num_moves, T* history) const;
 
   // Get information on the bleakest move for a completed game, if the game has
   // history and was played with resign disabled. This only makes sense if
@@ -152,12 +214,12 @@ class Game {
 };
 
 template <typename T>
-void Game::GetPositionHistory(int move, int num_moves, T* history) const {
+void Game::GetStoneHistory(int move, int num_moves, T* history) const {
   history->clear();
   MG_CHECK(move >= 0);
   MG_CHECK(move < static_cast<int>(moves_.size()));
   for (int i = 0; i < num_moves && move - i >= 0; ++i) {
-    history->push_back(&moves_[move - i]->position);
+    history->push_back(&moves_[move - i]->position.stone_snapshot());
   }
 }
 
@@ -0,0 +1,107 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/game.h"
+
+#include <array>
+
+#include "cc/constants.h"
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// A policy with no more non-zero entries than SparsePi stores explicitly is
+// encoded losslessly.
+TEST(SparsePiTest, ExactRoundTrip) {
+  Random rnd(614944751, 1);
+  std::array<float, kNumMoves> pi{};
+  float sum = 0;
+  for (int i = 0; i < SparsePi::kMaxEntries; ++i) {
+    auto& p = pi[(i * 7919) % kNumMoves];
+    p = rnd();
+    sum += p;
+  }
+  for (auto& p : pi) {
+    p /= sum;
+  }
+
+  SparsePi sparse(pi);
+  EXPECT_EQ(0, sparse.remainder());
+
+  std::array<float, kNumMoves> dense;
+  sparse.ToDense(&dense);
+  EXPECT_EQ(pi, dense);
+}
+
+// When a policy has too many non-zero entries, the most probable ones are
+// kept exactly and the dropped mass is spread over the unstored moves.
+TEST(SparsePiTest, TruncatesToMostProbable) {
+  std::array<float, kNumMoves> pi{};
+  float sum = 0;
+  for (int i = 0; i < kNumMoves; ++i) {
+    pi[i] = 1.0f + i;
+    sum += pi[i];
+  }
+  for (auto& p : pi) {
+    p /= sum;
+  }
+
+  SparsePi sparse(pi);
+  ASSERT_EQ(SparsePi::kMaxEntries, sparse.entries().size());
+  float kept = 0;
+  for (const auto& entry : sparse.entries()) {
+    // The largest probabilities are at the largest coordinates.
+    EXPECT_GE(entry.c, kNumMoves - SparsePi::kMaxEntries);
+    EXPECT_EQ(pi[entry.c], entry.p);
+    kept += entry.p;
+  }
+  EXPECT_NEAR(1 - kept, sparse.remainder(), 1e-6);
+
+  std::array<float, kNumMoves> dense;
+  sparse.ToDense(&dense);
+  float total = 0;
+  for (auto p : dense) {
+    total += p;
+  }
+  EXPECT_NEAR(1, total, 1e-5);
+  for (const auto& entry : sparse.entries()) {
+    EXPECT_EQ(pi[entry.c], dense[entry.c]);
+  }
+}
+
+// The packed encoding round trips through Pack & Unpack.
+TEST(SparsePiTest, PackedRoundTrip) {
+  Random rnd(614944751, 2);
+  std::array<float, kNumMoves> pi{};
+  for (int i = 0; i < 2 * SparsePi::kMaxEntries; ++i) {
+    pi[rnd.UniformInt(0, kNumMoves - 1)] = rnd();
+  }
+
+  SparsePi sparse(pi);
+  char packed[SparsePi::kPackedSize];
+  sparse.Pack(packed);
+  auto unpacked = SparsePi::Unpack(packed);
+
+  ASSERT_EQ(sparse.entries().size(), unpacked.entries().size());
+  for (size_t i = 0; i < sparse.entries().size(); ++i) {
+    EXPECT_EQ(sparse.entries()[i].c, unpacked.entries()[i].c);
+    EXPECT_EQ(sparse.entries()[i].p, unpacked.entries()[i].p);
+  }
+  EXPECT_EQ(sparse.remainder(), unpacked.remainder());
+}
+
+}  // namespace
+}  // namespace minigo
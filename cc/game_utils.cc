@@ -66,10 +66,7 @@ std::string GetOutputName(size_t game_id) {
   return absl::StrCat(GetHostname(), "-", GetProcessId(), "-", game_id);
 }
 
-void WriteSgf(const std::string& output_dir, const std::string& output_name,
-              const Game& game, bool write_comments) {
-  MG_CHECK(file::RecursivelyCreateDir(output_dir));
-
+std::string MakeSgfString(const Game& game, bool write_comments) {
   bool log_names = game.black_name() != game.white_name();
 
   std::vector<sgf::MoveWithComment> moves;
@@ -103,9 +100,43 @@ void WriteSgf(const std::string& output_dir, const std::string& output_name,
   options.black_name = game.black_name();
   options.white_name = game.white_name();
   options.game_comment = game.comment();
-  auto sgf_str = sgf::CreateSgfString(moves, options);
+  return sgf::CreateSgfString(moves, options);
+}
+
+void WriteSgf(const std::string& output_dir, const std::string& output_name,
+              const Game& game, bool write_comments) {
+  MG_CHECK(file::RecursivelyCreateDir(output_dir));
+  auto output_path = file::JoinPath(output_dir, output_name + ".sgf");
+  MG_CHECK(file::WriteFile(output_path, MakeSgfString(game, write_comments)));
+}
+
+bool ShouldWriteSgf(const Game& game, size_t game_id, int sample_period) {
+  if (sample_period <= 1 || game_id % sample_period == 0) {
+    return true;
+  }
+  int bleakest_move;
+  float q;
+  if (game.FindBleakestMove(&bleakest_move, &q)) {
+    // q is from the winner's perspective: below the resign threshold means
+    // the winner would have incorrectly resigned, had resignation been
+    // enabled.
+    return q < game.options().resign_threshold;
+  }
+  return false;
+}
+
+void WriteSgfAsync(const std::string& output_dir,
+                   const std::string& output_name,
+                   std::shared_ptr<const Game> game, bool write_comments,
+                   file::AsyncWriter* writer) {
   auto output_path = file::JoinPath(output_dir, output_name + ".sgf");
-  MG_CHECK(file::WriteFile(output_path, sgf_str));
+  // A rough guess at the SGF's size: a handful of bytes per move, plus the
+  // search stats written into each move's comment.
+  size_t estimated_size = game->num_moves() * (write_comments ? 256 : 16);
+  writer->WriteFile(std::move(output_path), estimated_size,
+                    [game, write_comments]() {
+                      return MakeSgfString(*game, write_comments);
+                    });
 }
 
 void LogEndGameInfo(const Game& game, absl::Duration game_time) {
@@ -16,10 +16,12 @@
 #define CC_GAME_UTILS_H_
 
 #include <cstddef>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 #include "absl/time/time.h"
+#include "cc/file/async_writer.h"
 #include "cc/game.h"
 
 namespace minigo {
@@ -60,10 +62,31 @@ std::string FormatWinStatsTable(
 // (e.g. SGF, TF example, etc) based on the hostname, process ID and game ID.
 std::string GetOutputName(size_t game_id);
 
+// Returns the SGF contents for the given game, as written by WriteSgf.
+std::string MakeSgfString(const Game& game, bool write_comments);
+
 // Writes an SGF of the given game.
 void WriteSgf(const std::string& output_dir, const std::string& output_name,
               const Game& game, bool write_comments);
 
+// Returns true if the game's SGF should be written when sampling 1-in-N
+// games. Games whose id falls in the sample are written, as is every
+// resign-threshold outlier: a game played with resign disabled where the
+// eventual winner's eval dipped below the resign threshold (see
+// Game::FindBleakestMove). Those are the games resign thresholds are
+// calibrated from, so they're always kept. A sample_period <= 1 keeps
+// every game.
+bool ShouldWriteSgf(const Game& game, size_t game_id, int sample_period);
+
+// Like WriteSgf, but formats and writes the SGF on `writer`'s thread pool,
+// so the caller doesn't spend time building strings for artifacts that are
+// only occasionally read. The game is shared with the writer because
+// formatting happens after the call returns.
+void WriteSgfAsync(const std::string& output_dir,
+                   const std::string& output_name,
+                   std::shared_ptr<const Game> game, bool write_comments,
+                   file::AsyncWriter* writer);
+
 // Log game result & stats.
 void LogEndGameInfo(const Game& game, absl::Duration game_time);
 
@@ -44,6 +44,10 @@ struct Group {
 };
 
 // GroupPool is a simple memory pool for Group objects.
+// The pool's storage is a fixed-capacity array held inline in the pool (and
+// so inline in the Position that owns it), with freed IDs recycled through a
+// free list: group merge & capture during Position::PlayMove is pure index
+// manipulation and never touches the heap.
 class GroupPool {
  public:
   // Allocates a new Group with the given size and number of liberties, and
@@ -22,7 +22,7 @@
 #include "cc/init.h"
 #include "cc/minigui_gtp_client.h"
 #include "cc/model/loader.h"
-#include "cc/zobrist.h"
+#include "cc/opening_book.h"
 #include "gflags/gflags.h"
 
 // GTP flags.
@@ -41,12 +41,29 @@ DEFINE_int32(num_readouts, 100,
              "Number of readouts to make during tree search for each move.");
 DEFINE_int32(virtual_losses, 8,
              "Number of virtual losses when running tree search.");
+DEFINE_int32(num_search_threads, 1,
+             "Number of threads to fan tree search across. Values > 1 "
+             "require a batching model (see device flag).");
 DEFINE_double(value_init_penalty, 0.0,
               "New children value initialize penalty.\n"
               "child's value = parent's value - value_init_penalty * color, "
               "clamped to [-1, 1].\n"
               "0 is init-to-parent [default], 2.0 is init-to-loss.\n"
               "This behaves similarly to leela's FPU \"First Play Urgency\".");
+DEFINE_int32(undo_pool_size, 32,
+             "Number of abandoned search subtrees to keep alive for "
+             "reattachment when undo/play navigation returns to a previously "
+             "searched variation. 0 discards abandoned lines immediately.");
+
+// Opening book flags.
+DEFINE_string(opening_book, "",
+              "Optional path to an opening book built by build_opening_book. "
+              "Positions found in the book are played immediately, without "
+              "any tree search.");
+DEFINE_double(book_temperature, 0,
+              "Temperature applied to the opening book's move weights. 0 "
+              "always plays the book's most common move; higher values add "
+              "variety.");
 
 // Time control flags.
 DEFINE_double(seconds_per_move, 0,
@@ -82,12 +99,22 @@ void Gtp() {
   player_options.inject_noise = false;
   player_options.tree.soft_pick_enabled = false;
   player_options.tree.value_init_penalty = FLAGS_value_init_penalty;
+  player_options.tree.undo_pool_size = FLAGS_undo_pool_size;
   player_options.virtual_losses = FLAGS_virtual_losses;
+  player_options.num_search_threads = FLAGS_num_search_threads;
   player_options.num_readouts = FLAGS_num_readouts;
   player_options.seconds_per_move = FLAGS_seconds_per_move;
   player_options.time_limit = FLAGS_time_limit;
   player_options.decay_factor = FLAGS_decay_factor;
 
+  OpeningBook opening_book;
+  if (!FLAGS_opening_book.empty()) {
+    MG_CHECK(opening_book.Load(FLAGS_opening_book))
+        << "couldn't load opening book " << FLAGS_opening_book;
+    player_options.opening_book = &opening_book;
+    player_options.book_temperature = FLAGS_book_temperature;
+  }
+
   GtpClient::Options client_options;
   client_options.ponder_limit = FLAGS_ponder_limit;
   client_options.courtesy_pass = FLAGS_courtesy_pass;
@@ -127,7 +154,6 @@ void Gtp() {
 
 int main(int argc, char* argv[]) {
   minigo::Init(&argc, &argv);
-  minigo::zobrist::Init(0);
   minigo::Gtp();
   minigo::ShutdownModelFactories();
   return 0;
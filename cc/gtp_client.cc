@@ -32,16 +32,39 @@
 
 namespace minigo {
 
+namespace {
+
+// How long each call to Ponder searches for before returning to the Run loop
+// to poll stdin for pending GTP commands.
+constexpr absl::Duration kPonderChunk = absl::Milliseconds(100);
+
+// Maximum number of candidate moves reported in each line of analyze output.
+// This bounds the time spent formatting reports, so that short report
+// intervals don't steal a meaningful fraction of time from the search itself.
+constexpr int kMaxAnalyzeMoves = 16;
+
+}  // namespace
+
 GtpClient::GtpClient(std::string device,
                      std::shared_ptr<InferenceCache> inference_cache,
                      const std::string& model_path,
                      const Game::Options& game_options,
                      const MctsPlayer::Options& player_options,
                      const GtpClient::Options& client_options)
+    : GtpClient(device, NewModel(model_path, device),
+                std::move(inference_cache), game_options, player_options,
+                client_options) {}
+
+GtpClient::GtpClient(std::string device, std::unique_ptr<Model> model,
+                     std::shared_ptr<InferenceCache> inference_cache,
+                     const Game::Options& game_options,
+                     const MctsPlayer::Options& player_options,
+                     const GtpClient::Options& client_options)
     : inference_cache_(inference_cache),
       options_(client_options),
+      gtp_in_(&std::cin),
+      gtp_out_(&std::cout),
       device_(std::move(device)) {
-  auto model = NewModel(model_path, device_);
   game_ = absl::make_unique<Game>(model->name(), model->name(), game_options);
 
   // Create the main player. Its model doesn't run through the batcher used for
@@ -52,67 +75,120 @@ GtpClient::GtpClient(std::string device,
   if (options_.ponder_limit > 0) {
     ponder_type_ = PonderType::kReadLimited;
   }
+  RegisterCmd("analyze", &GtpClient::HandleAnalyze);
   RegisterCmd("benchmark", &GtpClient::HandleBenchmark);
   RegisterCmd("boardsize", &GtpClient::HandleBoardsize);
   RegisterCmd("clear_board", &GtpClient::HandleClearBoard);
   RegisterCmd("final_score", &GtpClient::HandleFinalScore);
   RegisterCmd("genmove", &GtpClient::HandleGenmove);
+  RegisterCmd("kgs-time_settings", &GtpClient::HandleKgsTimeSettings);
   RegisterCmd("known_command", &GtpClient::HandleKnownCommand);
   RegisterCmd("komi", &GtpClient::HandleKomi);
   RegisterCmd("list_commands", &GtpClient::HandleListCommands);
   RegisterCmd("loadsgf", &GtpClient::HandleLoadsgf);
+  RegisterCmd("lz-analyze", &GtpClient::HandleAnalyze);
   RegisterCmd("name", &GtpClient::HandleName);
   RegisterCmd("play", &GtpClient::HandlePlay);
   RegisterCmd("ponder", &GtpClient::HandlePonder);
   RegisterCmd("readouts", &GtpClient::HandleReadouts);
+  RegisterCmd("save_tree", &GtpClient::HandleSavetree);
+  RegisterCmd("load_tree", &GtpClient::HandleLoadtree);
   RegisterCmd("showboard", &GtpClient::HandleShowboard);
+  RegisterCmd("time_left", &GtpClient::HandleTimeLeft);
+  RegisterCmd("time_settings", &GtpClient::HandleTimeSettings);
   RegisterCmd("undo", &GtpClient::HandleUndo);
 }
 
 GtpClient::~GtpClient() = default;
 
-void GtpClient::Run() {
-  // Perform a warm-up inference: ML frameworks like TensorFlow often perform
-  // lazy initialization, causing the first inference to take substantially
-  // longer than subsequent ones, which can interfere with time keeping.
+void GtpClient::SetIoStreams(std::istream* in, std::ostream* out,
+                             std::function<void()> interrupt_read) {
+  gtp_in_ = in;
+  gtp_out_ = out;
+  interrupt_read_ = std::move(interrupt_read);
+}
+
+void GtpClient::Warmup() {
+  // ML frameworks like TensorFlow often perform lazy initialization and
+  // autotuning (e.g. cuDNN algorithm selection), causing the first few
+  // inferences at each batch size to take substantially longer than
+  // subsequent ones, which can interfere with time keeping. Run a few dummy
+  // batches at each batch size the search will use before announcing
+  // readiness.
   MG_LOG(INFO) << "Warming up...";
+  auto start = absl::Now();
+
   Position position(Color::kBlack);
-  ModelOutput output;
   ModelInput input;
   input.sym = symmetry::kIdentity;
-  input.position_history.push_back(&position);
-  std::vector<const ModelInput*> inputs = {&input};
-  std::vector<ModelOutput*> outputs = {&output};
-  player_->model()->RunMany(inputs, &outputs, nullptr);
-  MG_LOG(INFO) << "GTP engine ready";
-
-  // Start a background thread that pushes lines read from stdin into the
-  // thread safe stdin_queue_. This allows us to ponder when there's nothing
-  // to read from stdin.
+  input.position = &position;
+  input.stone_history.push_back(&position.stone_snapshot());
+
+  // Tree search batches up to virtual_losses leaves per inference, but the
+  // first batch of a search (and searches near game over) can be smaller.
+  constexpr int kWarmupPasses = 3;
+  for (int batch_size : {1, player_->options().virtual_losses}) {
+    std::vector<const ModelInput*> inputs(batch_size, &input);
+    std::vector<ModelOutput> output_storage(batch_size);
+    std::vector<ModelOutput*> outputs;
+    for (auto& output : output_storage) {
+      outputs.push_back(&output);
+    }
+    for (int pass = 0; pass < kWarmupPasses; ++pass) {
+      player_->model()->RunMany(inputs, &outputs, nullptr);
+    }
+  }
+
+  MG_LOG(INFO) << "GTP engine ready, warmup took " << (absl::Now() - start);
+}
+
+void GtpClient::Run() {
+  Warmup();
+
+  // Start a background thread that pushes lines read from the input stream
+  // into the thread safe stdin_queue_. This allows us to ponder when there's
+  // nothing to read.
   std::atomic<bool> running(true);
   std::thread stdin_thread([this, &running]() {
     std::string line;
-    while (std::cin) {
-      std::getline(std::cin, line);
+    while (*gtp_in_) {
+      std::getline(*gtp_in_, line);
       stdin_queue_.Push(line);
     }
     running = false;
   });
 
-  // Don't wait for the stdin reading thread to exit because there's no way to
-  // abort the blocking call std::getline read (apart from the user hitting
-  // ctrl-C). The OS will clean the thread up when the process exits.
-  stdin_thread.detach();
+  // When reading from stdin there's no way to abort the blocking getline
+  // (apart from the user hitting ctrl-C), so don't wait for the reading
+  // thread to exit; the OS will clean it up when the process exits. When
+  // running over a stream that can be interrupted, the thread is joined at
+  // the end of Run instead, before the caller destroys the streams.
+  if (interrupt_read_ == nullptr) {
+    stdin_thread.detach();
+  }
 
   NewGame();
 
   while (running) {
     std::string line;
 
+    // A streaming command like analyze stops when the next GTP command
+    // arrives and stashes that command here; handle it before reading more
+    // lines from stdin.
+    if (has_pending_cmd_) {
+      has_pending_cmd_ = false;
+      auto response = HandleCmd(pending_cmd_line_);
+      *gtp_out_ << response << std::flush;
+      if (response.done) {
+        break;
+      }
+      continue;
+    }
+
     // If there's a command waiting on stdin, process it.
     if (stdin_queue_.TryPop(&line)) {
       auto response = HandleCmd(line);
-      std::cout << response << std::flush;
+      *gtp_out_ << response << std::flush;
       if (response.done) {
         break;
       }
@@ -126,7 +202,7 @@ void GtpClient::Run() {
       // when stdin is closed with ctrl-C.
       if (stdin_queue_.PopWithTimeout(&line, absl::Seconds(1))) {
         auto response = HandleCmd(line);
-        std::cout << response << std::flush;
+        *gtp_out_ << response << std::flush;
         if (response.done) {
           break;
         }
@@ -134,6 +210,11 @@ void GtpClient::Run() {
     }
   }
   running = false;
+
+  if (interrupt_read_ != nullptr) {
+    interrupt_read_();
+    stdin_thread.join();
+  }
 }
 
 void GtpClient::NewGame() {
@@ -178,8 +259,18 @@ void GtpClient::Ponder() {
   // Remember the number of reads at the root.
   int n = player_->root()->N();
 
-  player_->TreeSearch(player_->options().virtual_losses,
-                      std::numeric_limits<int>::max());
+  // Cap the reads performed this chunk so that read-limited pondering doesn't
+  // blow through its limit when searching with multiple threads.
+  int max_num_reads = std::numeric_limits<int>::max();
+  if (ponder_type_ == PonderType::kReadLimited) {
+    max_num_reads = n + options_.ponder_limit - ponder_read_count_;
+  }
+
+  // Ponder in short chunks so the Run loop stays responsive to GTP commands
+  // arriving on stdin. Pondering searches the current root, so the reads
+  // naturally concentrate on the strongest predicted opponent replies; with
+  // tree reuse, whichever reply is played keeps all of its pondered subtree.
+  player_->Ponder(max_num_reads, absl::Now() + kPonderChunk);
 
   // Increment the ponder count by difference new and old reads.
   ponder_read_count_ += player_->root()->N() - n;
@@ -257,6 +348,111 @@ GtpClient::Response GtpClient::DispatchCmd(const std::string& cmd,
   return it->second(args);
 }
 
+GtpClient::Response GtpClient::HandleAnalyze(CmdArgs args) {
+  // analyze [color] [interval]
+  // Searches the current position continuously, printing statistics about the
+  // top candidate moves every `interval` centiseconds (default 100) until the
+  // next GTP command arrives. Also registered as lz-analyze for tools that
+  // speak Leela Zero's analysis protocol.
+  auto response = CheckArgsRange(0, 2, args);
+  if (!response.ok) {
+    return response;
+  }
+  if (player_->root()->game_over()) {
+    return Response::Error("game is over");
+  }
+
+  int interval_centis = 100;
+  for (const auto& arg : args) {
+    char ch = std::tolower(arg[0]);
+    if (ch == 'b' || ch == 'w') {
+      auto color = ch == 'b' ? Color::kBlack : Color::kWhite;
+      if (color != player_->root()->position().to_play()) {
+        return Response::Error("out of turn analysis is not yet supported");
+      }
+    } else if (!absl::SimpleAtoi(arg, &interval_centis) ||
+               interval_centis <= 0) {
+      return Response::Error("couldn't parse analysis interval");
+    }
+  }
+  auto interval = absl::Milliseconds(10 * interval_centis);
+
+  // Acknowledge the command now: the output that follows is streamed until
+  // the next command arrives, so it can't be returned through the Response.
+  *gtp_out_ << "=\n" << std::flush;
+
+  auto report_time = absl::Now() + interval;
+  for (;;) {
+    // Search in short chunks, polling stdin between chunks. Each report is a
+    // snapshot of the root's edge stats, read in place while no chunk is
+    // running: the search tree is neither paused mid-read nor copied.
+    player_->Ponder(std::numeric_limits<int>::max(),
+                    std::min(report_time, absl::Now() + kPonderChunk));
+    if (stdin_queue_.TryPop(&pending_cmd_line_)) {
+      has_pending_cmd_ = true;
+      break;
+    }
+    if (absl::Now() >= report_time) {
+      auto line = FormatAnalysis(kMaxAnalyzeMoves);
+      if (!line.empty()) {
+        *gtp_out_ << line << "\n" << std::flush;
+      }
+      report_time = absl::Now() + interval;
+    }
+  }
+
+  // Terminate the streamed response.
+  *gtp_out_ << "\n" << std::flush;
+  return Response::Streamed();
+}
+
+std::string GtpClient::FormatAnalysis(int max_moves) const {
+  const auto* root = player_->root();
+
+  // Candidate moves are the root's visited children, ordered by visit count.
+  std::vector<Coord> candidates;
+  for (auto c : root->children.moves()) {
+    if (root->child_N(c) > 0) {
+      candidates.push_back(c);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [root](Coord a, Coord b) {
+    return root->child_N(a) > root->child_N(b);
+  });
+  if (candidates.size() > static_cast<size_t>(max_moves)) {
+    candidates.resize(max_moves);
+  }
+
+  // Q is from black's perspective; winrates are reported from the
+  // perspective of the player to move, in fractions of 10000.
+  float to_play = root->position().to_play() == Color::kBlack ? 1 : -1;
+  auto to_fraction = [](float x) {
+    auto i = static_cast<int>(std::lround(x * 10000));
+    return std::max(0, std::min(10000, i));
+  };
+
+  std::string result;
+  int order = 0;
+  for (auto c : candidates) {
+    if (order != 0) {
+      absl::StrAppend(&result, " ");
+    }
+    absl::StrAppend(&result, "info move ", c.ToGtp(), " visits ",
+                    root->child_N(c), " winrate ",
+                    to_fraction((root->child_Q(c) * to_play + 1) / 2),
+                    " prior ", to_fraction(root->child_P(c)), " order ",
+                    order, " pv ", c.ToGtp());
+    const auto* child = root->children.find(c);
+    if (child != nullptr) {
+      for (auto pv : child->GetMostVisitedPath()) {
+        absl::StrAppend(&result, " ", pv.ToGtp());
+      }
+    }
+    ++order;
+  }
+  return result;
+}
+
 GtpClient::Response GtpClient::HandleBenchmark(CmdArgs args) {
   // benchmark [readouts] [virtual_losses]
   // Note: By default use current time_control (readouts or time).
@@ -320,7 +516,7 @@ GtpClient::Response GtpClient::HandleFinalScore(CmdArgs args) {
     // Game isn't over yet, calculate the current score using Tromp-Taylor
     // scoring.
     return Response::Ok(Game::FormatScore(
-        player_->root()->position.CalculateScore(game_->options().komi)));
+        player_->root()->position().CalculateScore(game_->options().komi)));
   } else {
     // Game is over, we have the result available.
     return Response::Ok(game_->result_string());
@@ -447,7 +643,7 @@ GtpClient::Response GtpClient::HandlePlay(CmdArgs args) {
     MG_LOG(ERROR) << "expected b or w for player color, got " << args[0];
     return Response::Error("illegal move");
   }
-  if (color != player_->root()->position.to_play()) {
+  if (color != player_->root()->position().to_play()) {
     return Response::Error("out of turn moves are not yet supported");
   }
 
@@ -464,6 +660,72 @@ GtpClient::Response GtpClient::HandlePlay(CmdArgs args) {
   return Response::Ok();
 }
 
+GtpClient::Response GtpClient::HandleKgsTimeSettings(CmdArgs args) {
+  auto response = CheckArgsRange(1, 4, args);
+  if (!response.ok) {
+    return response;
+  }
+
+  TimeControl time_control;
+  if (args[0] == "none") {
+    if (args.size() != 1) {
+      return Response::Error("none takes no arguments");
+    }
+    player_->SetTimeControl(time_control);
+    return Response::Ok();
+  }
+
+  // All the remaining systems start with a main time.
+  int a = 0;
+  int b = 0;
+  int c = 0;
+  auto parse_ints = [&args, &a, &b, &c](size_t n) {
+    if (args.size() != n + 1) {
+      return false;
+    }
+    return absl::SimpleAtoi(args[1], &a) && a >= 0 &&
+           (n < 2 || (absl::SimpleAtoi(args[2], &b) && b >= 0)) &&
+           (n < 3 || (absl::SimpleAtoi(args[3], &c) && c >= 0));
+  };
+
+  time_control.enabled = true;
+  if (args[0] == "absolute") {
+    if (!parse_ints(1)) {
+      return Response::Error("couldn't parse absolute time settings");
+    }
+    time_control.main_time_secs = a;
+  } else if (args[0] == "byoyomi") {
+    // Japanese byo-yomi: main time, then `c` periods of `b` seconds, each
+    // covering one move.
+    if (!parse_ints(3)) {
+      return Response::Error("couldn't parse byoyomi time settings");
+    }
+    time_control.main_time_secs = a;
+    time_control.period_secs = b;
+    time_control.periods_left = c;
+  } else if (args[0] == "canadian") {
+    // Canadian overtime: main time, then `b` seconds for every `c` stones.
+    if (!parse_ints(3)) {
+      return Response::Error("couldn't parse canadian time settings");
+    }
+    time_control.main_time_secs = a;
+    time_control.period_secs = b;
+    time_control.period_stones = c;
+  } else if (args[0] == "fischer") {
+    // Non-standard extension: main time plus an increment added after every
+    // move.
+    if (!parse_ints(2)) {
+      return Response::Error("couldn't parse fischer time settings");
+    }
+    time_control.main_time_secs = a;
+    time_control.increment_secs = b;
+  } else {
+    return Response::Error("unknown time system \"", args[0], "\"");
+  }
+  player_->SetTimeControl(time_control);
+  return Response::Ok();
+}
+
 GtpClient::Response GtpClient::HandlePonder(CmdArgs args) {
   auto response = CheckArgsRange(1, 2, args);
   if (!response.ok) {
@@ -534,13 +796,115 @@ GtpClient::Response GtpClient::HandleReadouts(CmdArgs args) {
   return Response::Ok();
 }
 
+GtpClient::Response GtpClient::HandleSavetree(CmdArgs args) {
+  auto response = CheckArgsExact(1, args);
+  if (!response.ok) {
+    return response;
+  }
+
+  if (!file::WriteFile(std::string(args[0]), player_->SaveTreeSnapshot())) {
+    return Response::Error("cannot write file");
+  }
+  return Response::Ok();
+}
+
+GtpClient::Response GtpClient::HandleLoadtree(CmdArgs args) {
+  auto response = CheckArgsExact(1, args);
+  if (!response.ok) {
+    return response;
+  }
+
+  std::string contents;
+  if (!file::ReadFile(std::string(args[0]), &contents)) {
+    return Response::Error("cannot load file");
+  }
+  if (!player_->LoadTreeSnapshot(contents)) {
+    return Response::Error(
+        "snapshot is corrupt or was not taken at the current position");
+  }
+  return Response::Ok();
+}
+
 GtpClient::Response GtpClient::HandleShowboard(CmdArgs args) {
   auto response = CheckArgsExact(0, args);
   if (!response.ok) {
     return response;
   }
   return Response::Ok(
-      absl::StrCat("\n", player_->root()->position.ToPrettyString(false)));
+      absl::StrCat("\n", player_->root()->position().ToPrettyString(false)));
+}
+
+GtpClient::Response GtpClient::HandleTimeLeft(CmdArgs args) {
+  auto response = CheckArgsExact(3, args);
+  if (!response.ok) {
+    return response;
+  }
+
+  char color = std::tolower(args[0][0]);
+  if (color != 'b' && color != 'w') {
+    return Response::Error("expected b or w for player color, got ", args[0]);
+  }
+
+  int time_secs;
+  int stones;
+  if (!absl::SimpleAtoi(args[1], &time_secs) || time_secs < 0 ||
+      !absl::SimpleAtoi(args[2], &stones) || stones < 0) {
+    return Response::Error("couldn't parse time left");
+  }
+
+  // We keep a single clock: controllers report time_left for the player that
+  // is about to move, so the update that matters is the one arriving just
+  // before our genmove. MctsPlayer estimates the clock itself between
+  // updates; this is the authoritative correction.
+  auto time_control = player_->time_control();
+  time_control.enabled = true;
+  time_control.main_time_secs = time_secs;
+  // A non-zero stone count means we're in overtime and owe `stones` moves
+  // before the clock runs out (KGS reports Japanese byo-yomi periods the
+  // same way, which budgets a little conservatively).
+  time_control.stones_left = stones;
+  player_->SetTimeControl(time_control);
+  return Response::Ok();
+}
+
+GtpClient::Response GtpClient::HandleTimeSettings(CmdArgs args) {
+  auto response = CheckArgsExact(3, args);
+  if (!response.ok) {
+    return response;
+  }
+
+  int main_time_secs;
+  int overtime_secs;
+  int overtime_stones;
+  if (!absl::SimpleAtoi(args[0], &main_time_secs) || main_time_secs < 0 ||
+      !absl::SimpleAtoi(args[1], &overtime_secs) || overtime_secs < 0 ||
+      !absl::SimpleAtoi(args[2], &overtime_stones) || overtime_stones < 0) {
+    return Response::Error("couldn't parse time settings");
+  }
+
+  TimeControl time_control;
+  if (overtime_stones == 0) {
+    // Absolute time (the overtime seconds are ignored per the GTP spec); a
+    // main time of zero means no time limit at all.
+    if (main_time_secs > 0) {
+      time_control.enabled = true;
+      time_control.main_time_secs = main_time_secs;
+    }
+  } else {
+    // Canadian overtime.
+    time_control.enabled = true;
+    time_control.period_secs = overtime_secs;
+    time_control.period_stones = overtime_stones;
+    if (main_time_secs > 0) {
+      time_control.main_time_secs = main_time_secs;
+    } else {
+      // No main time: the game starts in overtime.
+      time_control.main_time_secs = overtime_secs;
+      time_control.stones_left = overtime_stones;
+    }
+  }
+  player_->SetTimeControl(time_control);
+  return Response::Ok();
 }
 
 GtpClient::Response GtpClient::HandleUndo(CmdArgs args) {
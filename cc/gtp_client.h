@@ -17,6 +17,7 @@
 
 #include <deque>
 #include <functional>
+#include <istream>
 #include <map>
 #include <memory>
 #include <ostream>
@@ -64,8 +65,26 @@ class GtpClient {
             const std::string& model_path, const Game::Options& game_options,
             const MctsPlayer::Options& player_options,
             const GtpClient::Options& client_options);
+
+  // As above, but with an already constructed model, e.g. a BatchingModel
+  // from a factory shared between the sessions of a multiplexed GTP server
+  // (see gtp_server.cc).
+  GtpClient(std::string device, std::unique_ptr<Model> model,
+            std::shared_ptr<InferenceCache> inference_cache,
+            const Game::Options& game_options,
+            const MctsPlayer::Options& player_options,
+            const GtpClient::Options& client_options);
+
   virtual ~GtpClient();
 
+  // Redirects the GTP conversation to the given streams instead of stdin and
+  // stdout. Must be called before Run; the streams must outlive the client.
+  // `interrupt_read` must unblock any read of `in` that's in progress (e.g.
+  // by shutting down the underlying socket); Run calls it on exit so the
+  // background read thread can be joined before the streams are destroyed.
+  void SetIoStreams(std::istream* in, std::ostream* out,
+                    std::function<void()> interrupt_read);
+
   virtual void Run();
   virtual void NewGame();
 
@@ -93,12 +112,24 @@ class GtpClient {
       return response;
     }
 
+    // A successful response whose output the handler has already streamed
+    // directly to stdout (see HandleAnalyze): the Run loop prints nothing.
+    static Response Streamed() {
+      Response response;
+      response.ok = true;
+      response.streamed = true;
+      return response;
+    }
+
     void set_cmd_id(int id) {
       has_cmd_id = true;
       cmd_id = id;
     }
 
     friend std::ostream& operator<<(std::ostream& os, const Response& r) {
+      if (r.streamed) {
+        return os;
+      }
       os << (r.ok ? "=" : "?");
       if (r.has_cmd_id) {
         os << r.cmd_id;
@@ -118,6 +149,9 @@ class GtpClient {
     // True if the Run loop should exit.
     bool done = false;
 
+    // True if the handler already wrote the response to stdout.
+    bool streamed = false;
+
     bool has_cmd_id = false;
 
     int cmd_id = 0;
@@ -135,6 +169,11 @@ class GtpClient {
         std::bind(handler, static_cast<T*>(this), std::placeholders::_1);
   }
 
+  // Runs dummy inference batches through the model before the engine starts
+  // accepting commands, so that the first genmove doesn't pay the backend's
+  // one-time costs (lazy initialization, autotuning at new batch sizes).
+  void Warmup();
+
   // Begin pondering again if requested.
   void MaybeStartPondering();
 
@@ -162,11 +201,13 @@ class GtpClient {
 
   // TODO(tommadams): clearly document these methods w.r.t. the GTP standard and
   // what public methods they call.
+  virtual Response HandleAnalyze(CmdArgs args);
   virtual Response HandleBenchmark(CmdArgs args);
   virtual Response HandleBoardsize(CmdArgs args);
   virtual Response HandleClearBoard(CmdArgs args);
   virtual Response HandleFinalScore(CmdArgs args);
   virtual Response HandleGenmove(CmdArgs args);
+  virtual Response HandleKgsTimeSettings(CmdArgs args);
   virtual Response HandleKnownCommand(CmdArgs args);
   virtual Response HandleKomi(CmdArgs args);
   virtual Response HandleListCommands(CmdArgs args);
@@ -175,7 +216,11 @@ class GtpClient {
   virtual Response HandlePlay(CmdArgs args);
   virtual Response HandlePonder(CmdArgs args);
   virtual Response HandleReadouts(CmdArgs args);
+  virtual Response HandleSavetree(CmdArgs args);
+  virtual Response HandleLoadtree(CmdArgs args);
   virtual Response HandleShowboard(CmdArgs args);
+  virtual Response HandleTimeLeft(CmdArgs args);
+  virtual Response HandleTimeSettings(CmdArgs args);
   virtual Response HandleUndo(CmdArgs args);
 
   std::shared_ptr<InferenceCache> inference_cache_;
@@ -201,8 +246,23 @@ class GtpClient {
   absl::flat_hash_map<std::string, std::function<Response(CmdArgs)>>
       cmd_handlers_;
 
+  // Formats one line of lz-analyze style output describing the most visited
+  // children of the current search root.
+  std::string FormatAnalysis(int max_moves) const;
+
   ThreadSafeQueue<std::string> stdin_queue_;
 
+  // The streams the GTP conversation runs over: stdin and stdout unless
+  // SetIoStreams was called.
+  std::istream* gtp_in_;
+  std::ostream* gtp_out_;
+  std::function<void()> interrupt_read_;
+
+  // The GTP command that interrupted a streaming command like analyze; the
+  // Run loop handles it before popping more lines from stdin_queue_.
+  std::string pending_cmd_line_;
+  bool has_pending_cmd_ = false;
+
   const std::string device_;
 };
 
@@ -0,0 +1,255 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hosts many independent GTP sessions in one process.
+//
+// Each connection to --port runs a full GTP session, equivalent to a
+// dedicated gtp process. All sessions share one BatchingModelFactory and one
+// inference cache, so concurrently served games batch their inferences
+// together on one GPU the way selfplay games do, instead of each game
+// holding its own copy of the model and running tiny batches:
+//
+//   gtp_server --port=19191 --model=model.minigo
+//   socat - TCP:localhost:19191   # one GTP session per connection
+//
+// POSIX only.
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "cc/constants.h"
+#include "cc/gtp_client.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/model/batching_model.h"
+#include "cc/model/inference_cache.h"
+#include "cc/model/loader.h"
+#include "gflags/gflags.h"
+
+// Server flags.
+DEFINE_int32(port, 0, "Port to listen for GTP connections on.");
+
+// Game options flags.
+DEFINE_bool(courtesy_pass, false,
+            "If true, always pass if the opponent passes.");
+DEFINE_double(resign_threshold, -0.999, "Resign threshold.");
+
+// Tree search flags.
+DEFINE_int32(num_readouts, 100,
+             "Number of readouts to make during tree search for each move.");
+DEFINE_int32(virtual_losses, 8,
+             "Number of virtual losses when running tree search.");
+DEFINE_double(value_init_penalty, 0.0,
+              "New children value initialize penalty.\n"
+              "child's value = parent's value - value_init_penalty * color, "
+              "clamped to [-1, 1].\n"
+              "0 is init-to-parent [default], 2.0 is init-to-loss.\n"
+              "This behaves similarly to leela's FPU \"First Play Urgency\".");
+DEFINE_int32(undo_pool_size, 32,
+             "Number of abandoned search subtrees each session keeps alive "
+             "for reattachment when undo/play navigation returns to a "
+             "previously searched variation. 0 discards abandoned lines "
+             "immediately.");
+
+// Time control flags.
+DEFINE_double(seconds_per_move, 0,
+              "If non-zero, the number of seconds to spend thinking about each "
+              "move instead of using a fixed number of readouts.");
+DEFINE_double(
+    time_limit, 0,
+    "If non-zero, the maximum amount of time to spend thinking in a game: we "
+    "spend seconds_per_move thinking for each move for as many moves as "
+    "possible before exponentially decaying the amount of time.");
+DEFINE_double(decay_factor, 0.98,
+              "If time_limit is non-zero, the decay factor used to shorten the "
+              "amount of time spent thinking as the game progresses.");
+
+// Inference flags.
+DEFINE_string(device, "",
+              "Optional ID of the device to run inference on. For TPUs, pass "
+              "the gRPC address.");
+DEFINE_string(model, "", "Path to a minigo model.");
+DEFINE_int32(cache_size_mb, 1024,
+             "Size of the inference cache in MB, shared between all "
+             "sessions. Tree reuse in GTP mode is disabled, so cache_size_mb "
+             "should be non-zero for reasonable performance.");
+DEFINE_int32(cache_shards, 8,
+             "Number of ways to shard the inference cache, so concurrent "
+             "sessions don't serialize on one cache mutex.");
+
+namespace minigo {
+namespace {
+
+// A std::streambuf over a connected socket, so a GTP session can run over
+// the connection through the same std::istream/std::ostream interface it
+// uses for stdin and stdout.
+class SocketStreambuf : public std::streambuf {
+ public:
+  explicit SocketStreambuf(int fd) : fd_(fd) { setg(buffer_, buffer_, buffer_); }
+
+ protected:
+  int_type underflow() override {
+    auto n = recv(fd_, buffer_, sizeof(buffer_), 0);
+    if (n <= 0) {
+      return traits_type::eof();
+    }
+    setg(buffer_, buffer_, buffer_ + n);
+    return traits_type::to_int_type(buffer_[0]);
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    return WriteAll(&ch, 1) ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    return WriteAll(s, n) ? n : 0;
+  }
+
+ private:
+  bool WriteAll(const char* data, std::streamsize size) {
+    while (size > 0) {
+      auto n = send(fd_, data, size, 0);
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  int fd_;
+  char buffer_[4096];
+};
+
+// Runs one GTP session over the connected socket `fd`, then closes it.
+// Called on a dedicated thread per connection.
+void RunSession(int session_id, int fd, BatchingModelFactory* batcher,
+                std::shared_ptr<ThreadSafeInferenceCache> inference_cache,
+                const Game::Options& game_options,
+                const MctsPlayer::Options& player_options,
+                const GtpClient::Options& client_options) {
+  MG_LOG(INFO) << "session " << session_id << " connected";
+  {
+    SocketStreambuf streambuf(fd);
+    std::iostream stream(&streambuf);
+
+    auto model = batcher->NewModel(FLAGS_model);
+    auto* raw_model = model.get();
+
+    GtpClient client(FLAGS_device, std::move(model), inference_cache,
+                     game_options, player_options, client_options);
+    // Shutting down the socket unblocks the client's read thread so Run can
+    // join it before the stream goes out of scope.
+    client.SetIoStreams(&stream, &stream,
+                        [fd]() { shutdown(fd, SHUT_RDWR); });
+
+    // Tell the batcher the session is live so batch assembly waits for the
+    // other sessions' requests; an idle session (e.g. waiting for its
+    // opponent to move) delays a batch by at most the batcher's flush
+    // timeout.
+    BatchingModelFactory::StartGame(raw_model, raw_model);
+    client.Run();
+    BatchingModelFactory::EndGame(raw_model, raw_model);
+  }
+  close(fd);
+  MG_LOG(INFO) << "session " << session_id << " finished";
+}
+
+void RunServer() {
+  MG_CHECK(FLAGS_port > 0) << "--port is required";
+  MG_CHECK(!FLAGS_model.empty()) << "--model is required";
+
+  Game::Options game_options;
+  game_options.resign_threshold = FLAGS_resign_threshold;
+
+  MctsPlayer::Options player_options;
+  player_options.inject_noise = false;
+  player_options.tree.soft_pick_enabled = false;
+  player_options.tree.value_init_penalty = FLAGS_value_init_penalty;
+  player_options.tree.undo_pool_size = FLAGS_undo_pool_size;
+  player_options.virtual_losses = FLAGS_virtual_losses;
+  player_options.num_readouts = FLAGS_num_readouts;
+  player_options.seconds_per_move = FLAGS_seconds_per_move;
+  player_options.time_limit = FLAGS_time_limit;
+  player_options.decay_factor = FLAGS_decay_factor;
+
+  GtpClient::Options client_options;
+  client_options.courtesy_pass = FLAGS_courtesy_pass;
+
+  std::shared_ptr<ThreadSafeInferenceCache> inference_cache;
+  if (FLAGS_cache_size_mb > 0) {
+    auto capacity = BasicInferenceCache::CalculateCapacity(FLAGS_cache_size_mb);
+    MG_LOG(INFO) << "Will cache up to " << capacity
+                 << " inferences, using roughly " << FLAGS_cache_size_mb
+                 << "MB.\n";
+    inference_cache = std::make_shared<ThreadSafeInferenceCache>(
+        capacity, FLAGS_cache_shards);
+  } else {
+    MG_LOG(WARNING) << "cache_size_mb == 0 results in poor performance in GTP "
+                       "mode because tree reuse is disabled.";
+  }
+
+  // Two buffers so one batch can run on the GPU while the next is assembled.
+  BatchingModelFactory batcher(FLAGS_device, 2);
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  MG_CHECK(listen_fd >= 0) << "couldn't open socket";
+  int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(static_cast<uint16_t>(FLAGS_port));
+  MG_CHECK(bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ==
+           0)
+      << "couldn't bind port " << FLAGS_port;
+  MG_CHECK(listen(listen_fd, 8) == 0);
+  MG_LOG(INFO) << "listening for GTP connections on port " << FLAGS_port;
+
+  for (int session_id = 0;; ++session_id) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    std::thread(RunSession, session_id, fd, &batcher, inference_cache,
+                game_options, player_options, client_options)
+        .detach();
+  }
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::RunServer();
+  minigo::ShutdownModelFactories();
+  return 0;
+}
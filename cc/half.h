@@ -0,0 +1,115 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_HALF_H_
+#define CC_HALF_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace minigo {
+
+// Conversion between float and IEEE 754 half precision bits, rounding to
+// nearest even. Written in portable C++ rather than F16C intrinsics so it
+// works on every build configuration; vectorized code that needs bulk
+// conversions should widen in registers instead (e.g. VCVTPH2PS).
+inline uint16_t FloatToHalf(float value) {
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+  auto sign = static_cast<uint16_t>((f >> 16) & 0x8000);
+  f &= 0x7fffffff;
+
+  if (f >= 0x47800000) {
+    // Too large for half precision: clamp to infinity, preserving NaN.
+    return sign | (f > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+  if (f >= 0x38800000) {
+    // A normal half. The rounding add can carry into the exponent, which
+    // correctly rounds up to the next power of two.
+    f += 0xfff + ((f >> 13) & 1);
+    return sign | static_cast<uint16_t>((f - 0x38000000) >> 13);
+  }
+  if (f < 0x33000000) {
+    // Too small for even a subnormal half: round to zero.
+    return sign;
+  }
+
+  // A subnormal half.
+  int shift = 126 - static_cast<int>(f >> 23);
+  uint32_t mant = (f & 0x7fffff) | 0x800000;
+  uint32_t half = mant >> shift;
+  uint32_t rem = mant & ((1u << shift) - 1);
+  uint32_t halfway = 1u << (shift - 1);
+  if (rem > halfway || (rem == halfway && (half & 1) != 0)) {
+    // Rounding up may overflow into the smallest normal half, which is the
+    // correct encoding.
+    half += 1;
+  }
+  return sign | static_cast<uint16_t>(half);
+}
+
+inline float HalfToFloat(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exp = (half >> 10) & 0x1f;
+  uint32_t mant = half & 0x3ff;
+
+  uint32_t f;
+  if (exp == 0) {
+    if (mant == 0) {
+      f = sign;
+    } else {
+      // A subnormal half is a (small) normal float: renormalize.
+      exp = 113;
+      while ((mant & 0x400) == 0) {
+        mant <<= 1;
+        exp -= 1;
+      }
+      f = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+  } else if (exp == 31) {
+    f = sign | 0x7f800000 | (mant << 13);
+  } else {
+    f = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+
+  float value;
+  std::memcpy(&value, &f, sizeof(value));
+  return value;
+}
+
+// A half precision float used as a compact storage type. Like a float, the
+// conversions to and from half precision are implicit; all arithmetic is
+// performed after widening to float.
+class HalfFloat {
+ public:
+  HalfFloat() = default;
+  HalfFloat(float value) : bits_(FloatToHalf(value)) {}
+
+  HalfFloat& operator=(float value) {
+    bits_ = FloatToHalf(value);
+    return *this;
+  }
+
+  operator float() const { return HalfToFloat(bits_); }
+
+ private:
+  uint16_t bits_ = 0;
+};
+
+static_assert(sizeof(HalfFloat) == sizeof(uint16_t),
+              "HalfFloat must have no overhead over its bits");
+
+}  // namespace minigo
+
+#endif  // CC_HALF_H_
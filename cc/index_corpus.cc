@@ -0,0 +1,215 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sweeps a directory of SGF games once and writes a corpus index (see
+// cc/corpus_index.h):
+//
+//   index_corpus --sgf_dir=sgf/ --output=corpus.mgindex
+//
+// Each game contributes its length, its result and the Zobrist hash of every
+// --stride'th position of its main line (plus the final position), so
+// position lookups and filtered replays only open the matching games instead
+// of replaying the whole corpus.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/types/span.h"
+#include "cc/async/thread.h"
+#include "cc/async/thread_safe_queue.h"
+#include "cc/color.h"
+#include "cc/corpus_index.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/platform/utils.h"
+#include "cc/position.h"
+#include "cc/sgf.h"
+#include "cc/zobrist.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(sgf_dir, "", "Directory to load SGF games from.");
+DEFINE_string(output, "", "Path to write the index to.");
+DEFINE_int32(stride, 8,
+             "Index the position after every this many moves. Smaller "
+             "strides make lookups hit more often but grow the index.");
+DEFINE_int32(num_threads, 0,
+             "Number of worker threads. 0 means use all logical CPUs.");
+
+namespace minigo {
+namespace {
+
+// Everything the index records about one game, gathered by a worker thread.
+struct IndexedGame {
+  std::string basename;
+  uint32_t num_moves = 0;
+  std::string result;
+  std::vector<std::pair<uint32_t, zobrist::Hash>> keys;
+  bool ok = false;
+};
+
+// Replays a game's main line, recording the key of every --stride'th
+// position and the final position.
+class IndexingVisitor : public sgf::StreamingVisitor {
+ public:
+  explicit IndexingVisitor(IndexedGame* game) : game_(game) {}
+
+  // The first tree to close marks the end of the main line.
+  bool OnTreeEnd() override { return false; }
+
+  bool OnProperty(absl::string_view id, absl::string_view value) override {
+    if (id == "RE") {
+      game_->result = std::string(value);
+    }
+    return true;
+  }
+
+  bool OnMove(Move move) override {
+    if (!position_.legal_move(move.c)) {
+      // The game was played under different rules (or is corrupt): a
+      // partial replay would record positions and a length the corpus
+      // doesn't contain, so don't index the game at all.
+      bad_ = true;
+      return false;
+    }
+    position_.PlayMove(move.c);
+    game_->num_moves += 1;
+    if (game_->num_moves % FLAGS_stride == 0) {
+      game_->keys.emplace_back(game_->num_moves,
+                               CorpusIndex::KeyHash(position_));
+    }
+    return true;
+  }
+
+  // Called once the main line has been replayed.
+  void Finish() {
+    if (bad_) {
+      return;
+    }
+    if (game_->keys.empty() || game_->keys.back().first != game_->num_moves) {
+      game_->keys.emplace_back(game_->num_moves,
+                               CorpusIndex::KeyHash(position_));
+    }
+    game_->ok = true;
+  }
+
+ private:
+  IndexedGame* game_;
+  Position position_{Color::kBlack};
+  bool bad_ = false;
+};
+
+IndexedGame ProcessSgf(const std::string& basename, std::string* contents) {
+  IndexedGame game;
+  game.basename = basename;
+  if (!absl::EndsWith(basename, ".sgf")) {
+    return game;
+  }
+
+  auto path = file::JoinPath(FLAGS_sgf_dir, basename);
+  if (!file::ReadFile(path, contents)) {
+    MG_LOG(WARNING) << "couldn't read " << path;
+    return game;
+  }
+
+  IndexingVisitor visitor(&game);
+  std::string error;
+  if (!sgf::ParseStreaming(*contents, &visitor, &error)) {
+    MG_LOG(WARNING) << "error parsing " << path << ": " << error;
+    return game;
+  }
+  visitor.Finish();
+  return game;
+}
+
+void Run() {
+  MG_CHECK(!FLAGS_sgf_dir.empty()) << "--sgf_dir is required";
+  MG_CHECK(!FLAGS_output.empty()) << "--output is required";
+  MG_CHECK(FLAGS_stride > 0) << "--stride must be positive";
+
+  std::vector<std::string> basenames;
+  MG_CHECK(file::ListDir(FLAGS_sgf_dir, &basenames))
+      << "couldn't list " << FLAGS_sgf_dir;
+
+  ThreadSafeQueue<std::string> work_queue;
+  work_queue.PushAll(absl::MakeConstSpan(basenames));
+
+  ThreadSafeQueue<IndexedGame> indexed_queue;
+
+  int num_threads =
+      FLAGS_num_threads > 0 ? FLAGS_num_threads : GetNumLogicalCpus();
+  std::vector<std::unique_ptr<LambdaThread>> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.push_back(absl::make_unique<LambdaThread>([&]() {
+      // Reuse one contents buffer for all the files this thread processes.
+      std::string contents;
+      std::string basename;
+      while (work_queue.TryPop(&basename)) {
+        indexed_queue.Push(ProcessSgf(basename, &contents));
+      }
+    }));
+    threads.back()->Start();
+  }
+
+  std::vector<IndexedGame> indexed;
+  indexed.reserve(basenames.size());
+  for (size_t i = 0; i < basenames.size(); ++i) {
+    auto game = indexed_queue.Pop();
+    if (game.ok) {
+      indexed.push_back(std::move(game));
+    }
+  }
+
+  for (auto& t : threads) {
+    t->Join();
+  }
+
+  // Games arrive in whatever order the workers finish; sort by path so the
+  // index contents don't depend on thread scheduling.
+  std::sort(indexed.begin(), indexed.end(),
+            [](const IndexedGame& a, const IndexedGame& b) {
+              return a.basename < b.basename;
+            });
+
+  CorpusIndex index;
+  for (const auto& game : indexed) {
+    CorpusIndex::Game game_info;
+    game_info.path = file::JoinPath(FLAGS_sgf_dir, game.basename);
+    game_info.num_moves = game.num_moves;
+    game_info.result = game.result;
+    auto game_idx = index.AddGame(std::move(game_info));
+    for (const auto& key : game.keys) {
+      index.AddPosition(key.second, game_idx, key.first);
+    }
+  }
+  MG_LOG(INFO) << "Indexed " << index.num_games() << " games, "
+               << index.num_positions() << " distinct positions";
+
+  MG_CHECK(file::WriteFile(FLAGS_output, index.Serialize()));
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  return 0;
+}
@@ -16,11 +16,17 @@
 
 #include "absl/debugging/failure_signal_handler.h"
 #include "absl/debugging/symbolize.h"
+#include "absl/strings/str_cat.h"
+#include "cc/constants.h"
 #include "gflags/gflags.h"
 
 namespace minigo {
 
 void Init(int* pargc, char*** pargv) {
+  // Board size is baked in at compile time (--define=board_size), so make
+  // binaries self-describing: --version reports which board a build is
+  // specialized for.
+  gflags::SetVersionString(absl::StrCat("board_size=", kN));
   gflags::SetUsageMessage((*pargv)[0]);
   absl::InitializeSymbolizer((*pargv)[0]);
   absl::FailureSignalHandlerOptions options;
@@ -79,14 +79,14 @@ class inline_vector {
   }
 
   void push_back(const T& t) {
-    MG_CHECK(size_ < Capacity);
+    MG_HOT_CHECK(size_ < Capacity);
     new (data() + size_) T(t);
     ++size_;
   }
 
   template <typename... Args>
   void emplace_back(Args&&... args) {
-    MG_CHECK(size_ < Capacity);
+    MG_HOT_CHECK(size_ < Capacity);
     new (data() + size_) T(std::forward<Args>(args)...);
     ++size_;
   }
@@ -97,19 +97,19 @@ class inline_vector {
   const T& back() const { return data()[size_ - 1]; }
 
   void pop_back() {
-    MG_CHECK(size_ > 0);
+    MG_HOT_CHECK(size_ > 0);
     --size_;
   }
 
   void resize(int size) {
-    MG_CHECK(size >= 0);
-    MG_CHECK(size <= Capacity);
+    MG_HOT_CHECK(size >= 0);
+    MG_HOT_CHECK(size <= Capacity);
     size_ = size;
   }
 
   void resize(int size, const T& t) {
-    MG_CHECK(size >= 0);
-    MG_CHECK(size <= Capacity);
+    MG_HOT_CHECK(size >= 0);
+    MG_HOT_CHECK(size <= Capacity);
     for (int i = size_; i < size; ++i) {
       data()[i] = t;
     }
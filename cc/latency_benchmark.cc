@@ -0,0 +1,200 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Single-stream latency benchmark for a model backend, grown from the old
+// simple_example binary. Plays timed games with a single search thread (the
+// same configuration the GTP client runs in) and reports per-move wall time
+// percentiles broken down by phase:
+//
+//   features  : packing positions into the model's input tensor.
+//   inference : Model::RunMany.
+//   tree      : everything else; leaf selection and incorporating results.
+//
+// Backends extract features internally as part of RunMany, so to observe the
+// cost the benchmark runs its own feature-extraction pass before each
+// inference and discards the result. The extra pass inflates each move by
+// exactly the `features` time reported for it; subtract `features` from
+// `move` for the latency an uninstrumented player would see.
+//
+// Percentiles are exact (computed from the sorted per-move samples), not
+// bucketed: p99 is the number that matters when qualifying a backend for
+// latency-sensitive use and a factor-of-two histogram bucket is too coarse
+// for that.
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/game.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/mcts_player.h"
+#include "cc/model/features.h"
+#include "cc/model/loader.h"
+#include "cc/model/model.h"
+#include "cc/model/types.h"
+#include "gflags/gflags.h"
+
+// Inference flags.
+DEFINE_string(device, "", "Device to run on (e.g. TPU address).");
+DEFINE_string(model, "", "Path to a minigo model.");
+
+// Benchmark flags.
+DEFINE_int32(num_games, 1, "Number of games to play.");
+DEFINE_int32(num_readouts, 100,
+             "Number of readouts to make during tree search for each move.");
+DEFINE_int32(virtual_losses, 8,
+             "Number of virtual losses when running tree search.");
+
+namespace minigo {
+namespace {
+
+// Wraps the real model, accumulating the time spent extracting features and
+// running inference. The benchmark takes (and resets) the accumulated times
+// after each move, so a move that runs multiple inference batches reports
+// the sum over its batches.
+class TimingModel : public Model {
+ public:
+  explicit TimingModel(std::unique_ptr<Model> impl)
+      : Model(impl->name(), impl->feature_descriptor()),
+        impl_(std::move(impl)) {}
+
+  void RunMany(const std::vector<const ModelInput*>& inputs,
+               std::vector<ModelOutput*>* outputs,
+               std::string* model_name) override {
+    auto shape =
+        feature_descriptor().GetInputShape(static_cast<int>(inputs.size()));
+    auto t0 = absl::Now();
+    if (feature_descriptor().dtype == FeatureDescriptor::Dtype::kUint8) {
+      byte_features_.resize(shape);
+      feature_descriptor().SetFeatures(inputs, &byte_features_.tensor());
+    } else {
+      float_features_.resize(shape);
+      feature_descriptor().SetFeatures(inputs, &float_features_.tensor());
+    }
+    auto t1 = absl::Now();
+    impl_->RunMany(inputs, outputs, model_name);
+    auto t2 = absl::Now();
+    feature_time_ += t1 - t0;
+    inference_time_ += t2 - t1;
+  }
+
+  // Returns the time accumulated in each phase since the previous call.
+  void TakePhaseTimes(absl::Duration* features, absl::Duration* inference) {
+    *features = feature_time_;
+    *inference = inference_time_;
+    feature_time_ = absl::ZeroDuration();
+    inference_time_ = absl::ZeroDuration();
+  }
+
+ private:
+  std::unique_ptr<Model> impl_;
+  BackedTensor<uint8_t> byte_features_;
+  BackedTensor<float> float_features_;
+  absl::Duration feature_time_;
+  absl::Duration inference_time_;
+};
+
+// Returns the nearest-rank percentile of the sorted samples.
+absl::Duration Percentile(const std::vector<absl::Duration>& sorted, int pct) {
+  auto rank = (sorted.size() * pct + 99) / 100;
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+std::string Summarize(const char* name, std::vector<absl::Duration> samples) {
+  if (samples.empty()) {
+    return absl::StrFormat("%-9s n:0", name);
+  }
+  std::sort(samples.begin(), samples.end());
+  return absl::StrFormat(
+      "%-9s p50:%-10s p90:%-10s p99:%-10s max:%s", name,
+      absl::FormatDuration(Percentile(samples, 50)),
+      absl::FormatDuration(Percentile(samples, 90)),
+      absl::FormatDuration(Percentile(samples, 99)),
+      absl::FormatDuration(samples.back()));
+}
+
+void LatencyBenchmark() {
+  auto timing_model =
+      absl::make_unique<TimingModel>(NewModel(FLAGS_model, FLAGS_device));
+  auto* timing = timing_model.get();
+
+  Game::Options game_options;
+  Game game("black", "white", game_options);
+
+  // Mirror the GTP client's player configuration: no noise, deterministic
+  // move selection and a single search thread. No inference cache is used,
+  // so every readout pays the full feature + inference cost.
+  MctsPlayer::Options player_options;
+  player_options.inject_noise = false;
+  player_options.tree.soft_pick_enabled = false;
+  player_options.num_readouts = FLAGS_num_readouts;
+  player_options.virtual_losses = FLAGS_virtual_losses;
+  MctsPlayer player(std::move(timing_model), nullptr, &game, player_options);
+
+  // One entry per move played, across all games.
+  std::vector<absl::Duration> move_samples;
+  std::vector<absl::Duration> feature_samples;
+  std::vector<absl::Duration> inference_samples;
+  std::vector<absl::Duration> tree_samples;
+
+  for (int i = 0; i < FLAGS_num_games; ++i) {
+    game.NewGame();
+    player.NewGame();
+
+    auto game_start = absl::Now();
+    while (!game.game_over()) {
+      auto t0 = absl::Now();
+      auto move = player.SuggestMove(player_options.num_readouts);
+      auto t1 = absl::Now();
+
+      absl::Duration features, inference;
+      timing->TakePhaseTimes(&features, &inference);
+      move_samples.push_back(t1 - t0);
+      feature_samples.push_back(features);
+      inference_samples.push_back(inference);
+      tree_samples.push_back(t1 - t0 - features - inference);
+
+      MG_CHECK(player.PlayMove(move));
+    }
+    MG_LOG(INFO) << "Game " << (i + 1) << ": " << game.result_string()
+                 << " in " << (absl::Now() - game_start);
+  }
+
+  std::cout << absl::StrFormat(
+                   "model:%s moves:%d games:%d readouts/move:%d "
+                   "virtual_losses:%d\n",
+                   FLAGS_model, move_samples.size(), FLAGS_num_games,
+                   FLAGS_num_readouts, FLAGS_virtual_losses)
+            << Summarize("move", std::move(move_samples)) << "\n"
+            << Summarize("features", std::move(feature_samples)) << "\n"
+            << Summarize("inference", std::move(inference_samples)) << "\n"
+            << Summarize("tree", std::move(tree_samples)) << std::endl;
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::LatencyBenchmark();
+  return 0;
+}
@@ -0,0 +1,98 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_LATENCY_HISTOGRAM_H_
+#define CC_LATENCY_HISTOGRAM_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+
+namespace minigo {
+
+// A fixed-size latency histogram with power-of-two microsecond buckets,
+// covering sub-microsecond to around 35 minutes. Recording a sample is a
+// single relaxed atomic increment, so worker threads can accumulate samples
+// without locks while another thread snapshots the counts for reporting.
+// Reported percentiles are upper bounds of the bucket the percentile falls
+// in, so they're accurate to within a factor of two; good enough to tell
+// which phase of a pipeline a regression lives in.
+class LatencyHistogram {
+ public:
+  // Bucket b counts samples in (2^(b-1), 2^b] microseconds; bucket 0 counts
+  // samples of at most 1us and the last bucket is unbounded above.
+  static constexpr int kNumBuckets = 32;
+
+  void Add(absl::Duration d) {
+    counts_[BucketForMicros(absl::ToInt64Microseconds(d))].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  // Returns a summary like "n:1234 p50:<=4ms p90:<=16ms p99:<=32ms", or
+  // "n:0" if no samples have been recorded. Safe to call concurrently with
+  // Add; samples recorded while the counts are being snapshotted may or may
+  // not be included.
+  std::string ToString() const {
+    std::array<uint64_t, kNumBuckets> counts;
+    uint64_t total = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+      counts[i] = counts_[i].load(std::memory_order_relaxed);
+      total += counts[i];
+    }
+    if (total == 0) {
+      return "n:0";
+    }
+
+    auto result = absl::StrCat("n:", total);
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    for (int percentile : {50, 90, 99}) {
+      // The smallest bucket whose cumulative count covers the percentile.
+      // Percentiles are processed in increasing order, so the scan resumes
+      // from the previous percentile's bucket.
+      uint64_t threshold = (total * percentile + 99) / 100;
+      while (cumulative + counts[bucket] < threshold) {
+        cumulative += counts[bucket];
+        bucket += 1;
+      }
+      absl::StrAppend(&result, " p", percentile, ":<=",
+                      absl::FormatDuration(BucketUpperBound(bucket)));
+    }
+    return result;
+  }
+
+  static int BucketForMicros(int64_t usec) {
+    int b = 0;
+    while (b < kNumBuckets - 1 && (int64_t{1} << b) < usec) {
+      b += 1;
+    }
+    return b;
+  }
+
+  static absl::Duration BucketUpperBound(int bucket) {
+    return absl::Microseconds(int64_t{1} << bucket);
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> counts_{};
+};
+
+}  // namespace minigo
+
+#endif  // CC_LATENCY_HISTOGRAM_H_
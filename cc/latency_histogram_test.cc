@@ -0,0 +1,58 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/latency_histogram.h"
+
+#include <limits>
+
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(LatencyHistogramTest, Bucketing) {
+  EXPECT_EQ(0, LatencyHistogram::BucketForMicros(0));
+  EXPECT_EQ(0, LatencyHistogram::BucketForMicros(1));
+  EXPECT_EQ(1, LatencyHistogram::BucketForMicros(2));
+  EXPECT_EQ(2, LatencyHistogram::BucketForMicros(3));
+  EXPECT_EQ(2, LatencyHistogram::BucketForMicros(4));
+  EXPECT_EQ(10, LatencyHistogram::BucketForMicros(1024));
+
+  // Values beyond the largest bucket's range saturate instead of wrapping.
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::BucketForMicros(
+                std::numeric_limits<int64_t>::max()));
+}
+
+TEST(LatencyHistogramTest, Empty) {
+  LatencyHistogram histogram;
+  EXPECT_EQ("n:0", histogram.ToString());
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+
+  // Half the samples at ~1ms and half at ~1s: the p50 should land in the
+  // 1ms bucket and the p90 and p99 in the 1s bucket.
+  for (int i = 0; i < 50; ++i) {
+    histogram.Add(absl::Milliseconds(1));
+    histogram.Add(absl::Seconds(1));
+  }
+
+  EXPECT_EQ("n:100 p50:<=1.024ms p90:<=1.048576s p99:<=1.048576s",
+            histogram.ToString());
+}
+
+}  // namespace
+}  // namespace minigo
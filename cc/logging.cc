@@ -14,16 +14,20 @@
 
 #include "cc/logging.h"
 
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <thread>
 
 #include "absl/debugging/stacktrace.h"
 #include "absl/debugging/symbolize.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 
 namespace minigo {
-namespace internal {
 
 namespace {
 
@@ -32,6 +36,142 @@ absl::Mutex* mutex() {
   return m;
 }
 
+// In asynchronous mode, formatted log lines are pushed onto a fixed-size ring
+// of records and written to stderr by a background drainer thread. The ring
+// uses per-record sequence numbers (Vyukov's bounded queue scheme) so that
+// producers claim records with a single compare-and-swap and never block each
+// other or the drainer.
+struct LogRecord {
+  std::atomic<uint64_t> seq;
+  uint32_t size;
+  char text[internal::LogStream::kMaxLineSize];
+};
+
+constexpr size_t kNumLogRecords = 1024;  // must be a power of two.
+
+struct AsyncLogger {
+  AsyncLogger() {
+    for (size_t i = 0; i < kNumLogRecords; ++i) {
+      records[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  LogRecord records[kNumLogRecords];
+  std::atomic<uint64_t> head{0};
+  uint64_t tail = 0;  // Only touched by the drainer thread.
+  std::atomic<bool> running{false};
+  std::thread drainer;
+};
+
+AsyncLogger* logger() {
+  static auto* x = new AsyncLogger();
+  return x;
+}
+
+// Set while the drainer thread is running. Checked on every log line, so kept
+// separate from the (heap-allocated) AsyncLogger itself.
+std::atomic<bool> g_async_logging{false};
+
+// Attempts to claim a ring record and copy `size` bytes of formatted log line
+// into it. Returns false if the ring is full, in which case the caller should
+// write the line synchronously instead.
+bool TryPushAsync(const char* data, size_t size) {
+  auto* log = logger();
+  uint64_t pos = log->head.load(std::memory_order_relaxed);
+  for (;;) {
+    auto& record = log->records[pos & (kNumLogRecords - 1)];
+    uint64_t seq = record.seq.load(std::memory_order_acquire);
+    auto diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+    if (diff == 0) {
+      if (log->head.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        record.size = size;
+        std::memcpy(record.text, data, size);
+        record.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // The drainer hasn't consumed this record yet: the ring is full.
+      return false;
+    } else {
+      pos = log->head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Writes ring records to stderr in order until DisableAsyncLogging is called,
+// sleeping briefly whenever it catches up with the producers. Takes the
+// logging mutex around each write so that output doesn't interleave with the
+// synchronous fallback path.
+void DrainLoop() {
+  auto* log = logger();
+
+  auto write_record = [log]() {
+    auto& record = log->records[log->tail & (kNumLogRecords - 1)];
+    {
+      absl::MutexLock lock(mutex());
+      std::cerr.write(record.text, record.size);
+    }
+    record.seq.store(log->tail + kNumLogRecords, std::memory_order_release);
+    log->tail += 1;
+  };
+
+  bool flushed = true;
+  for (;;) {
+    auto& record = log->records[log->tail & (kNumLogRecords - 1)];
+    if (record.seq.load(std::memory_order_acquire) == log->tail + 1) {
+      write_record();
+      flushed = false;
+      continue;
+    }
+    if (!flushed) {
+      absl::MutexLock lock(mutex());
+      std::cerr << std::flush;
+      flushed = true;
+    }
+    if (!log->running.load(std::memory_order_acquire)) {
+      break;
+    }
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+
+  // Drain any records claimed before g_async_logging was cleared, spinning
+  // briefly on producers that are still mid-copy.
+  uint64_t end = log->head.load(std::memory_order_acquire);
+  while (log->tail != end) {
+    auto& record = log->records[log->tail & (kNumLogRecords - 1)];
+    while (record.seq.load(std::memory_order_acquire) != log->tail + 1) {
+    }
+    write_record();
+  }
+  absl::MutexLock lock(mutex());
+  std::cerr << std::flush;
+}
+
+}  // namespace
+
+void EnableAsyncLogging() {
+  auto* log = logger();
+  if (log->running.exchange(true)) {
+    return;
+  }
+  log->drainer = std::thread(DrainLoop);
+  g_async_logging.store(true, std::memory_order_release);
+}
+
+void DisableAsyncLogging() {
+  auto* log = logger();
+  g_async_logging.store(false, std::memory_order_release);
+  if (!log->running.exchange(false)) {
+    return;
+  }
+  log->drainer.join();
+}
+
+namespace internal {
+
+namespace {
+
 void DumpStackTrace(std::ostream* os) {
   void* stack[64];
   int depth = absl::GetStackTrace(stack, 64, 1);
@@ -49,8 +189,10 @@ void DumpStackTrace(std::ostream* os) {
 
 }  // namespace
 
+constexpr size_t LogStream::kMaxLineSize;
+
 LogStream::LogStream(const char* file, int line, LogLevel level)
-    : level_(level) {
+    : stream_(&buffer_), level_(level) {
   if (level == LogLevel::INFO) {
     // We don't add a prefix to MG_LOG(INFO) log lines because many things rely
     // on the exact string being printed (GTP, correct formatting of position &
@@ -86,18 +228,36 @@ LogStream::LogStream(const char* file, int line, LogLevel level)
 }
 
 LogStream::~LogStream() {
-  {
-    absl::MutexLock lock(mutex());
-    stream_ << '\n';
-    std::cerr << stream_.rdbuf();
-    if (level_ == LogLevel::FATAL) {
-      DumpStackTrace(&std::cerr);
-    }
-    std::cerr << std::flush;
+  stream_ << '\n';
+
+  // If the line was truncated, the '\n' we just wrote was dropped: overwrite
+  // the last character so that the line is still terminated.
+  char* data = buffer_.data();
+  size_t size = buffer_.size();
+  if (data[size - 1] != '\n') {
+    data[size - 1] = '\n';
   }
+
+  // FATAL lines are always written synchronously: the stack trace and abort
+  // must not race with (or be lost behind) the drainer thread.
   if (level_ == LogLevel::FATAL) {
+    {
+      absl::MutexLock lock(mutex());
+      std::cerr.write(data, size);
+      DumpStackTrace(&std::cerr);
+      std::cerr << std::flush;
+    }
     abort();
   }
+
+  if (g_async_logging.load(std::memory_order_acquire) &&
+      TryPushAsync(data, size)) {
+    return;
+  }
+
+  absl::MutexLock lock(mutex());
+  std::cerr.write(data, size);
+  std::cerr << std::flush;
 }
 
 CheckFailStream::CheckFailStream(const char* cond, const char* file, int line)
@@ -15,12 +15,28 @@
 #ifndef CC_LOGGING_H_
 #define CC_LOGGING_H_
 
-#include <sstream>
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 
 namespace minigo {
+
+// Switches MG_LOG to asynchronous mode: log lines are formatted into
+// fixed-size records that are pushed onto a lock-free ring buffer and written
+// to stderr by a background thread, so logging on a hot path costs a buffer
+// claim and a memcpy instead of a write under a global mutex. If the ring
+// fills up faster than the background thread can drain it, writes fall back
+// to the synchronous path rather than dropping lines. FATAL logs are always
+// written synchronously.
+void EnableAsyncLogging();
+
+// Drains any outstanding log records and joins the background thread.
+// Subsequent logging is synchronous again.
+void DisableAsyncLogging();
+
 namespace internal {
 
 enum class LogLevel {
@@ -35,8 +51,13 @@ enum class LogLevel {
 // All logging is written to stderr.
 // For log levels other than INFO, the line is prefixed with the log level and
 // source code location of the message.
+// Lines are formatted into a fixed-size inline buffer so that logging never
+// allocates; lines longer than kMaxLineSize are truncated.
 class LogStream {
  public:
+  // Maximum formatted line length in bytes, including the trailing newline.
+  static constexpr size_t kMaxLineSize = 4096;
+
   LogStream(const char* file, int line, LogLevel level);
   ~LogStream();
 
@@ -47,7 +68,20 @@ class LogStream {
   }
 
  private:
-  std::stringstream stream_;
+  // A streambuf over a fixed-size inline array: characters written past the
+  // end of the array are dropped.
+  class FixedBuffer : public std::streambuf {
+   public:
+    FixedBuffer() { setp(text_, text_ + kMaxLineSize); }
+    char* data() { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+
+   private:
+    char text_[kMaxLineSize];
+  };
+
+  FixedBuffer buffer_;
+  std::ostream stream_;
   LogLevel level_;
 };
 
@@ -99,9 +133,17 @@ class CheckStreamVoidify {
   ::minigo::internal::LogStream(__FILE__, __LINE__, \
                                 ::minigo::internal::LogLevel::level)
 
-// MG_CHECK(cond) and MG_DCHECK(cond) halt the program, printing the current
-// the given condition `cond` is not true. MG_CHECK is always enabled, MG_DCHECK
-// is only enabled for debug builds (i.e. when NDEBUG is not defined).
+// MG_CHECK(cond), MG_HOT_CHECK(cond) and MG_DCHECK(cond) halt the program,
+// printing the current source location, if the given condition `cond` is not
+// true.
+//  - MG_CHECK is always enabled. Use it for I/O, startup and anything that
+//    validates external data.
+//  - MG_HOT_CHECK guards internal invariants on performance-critical paths
+//    (playing moves, tree traversal). It is enabled by default, including in
+//    optimized builds, but compiles away in production builds made with
+//    --define=hot_checks=0 (see cc/config/BUILD).
+//  - MG_DCHECK is only enabled for debug builds (i.e. when NDEBUG is not
+//    defined).
 // Both result expressions of the ?: ternary operator evaluate to void, which
 // silences "statement has no effect" compiler warnings.
 #define MG_CHECK(cond)                                \
@@ -109,6 +151,13 @@ class CheckStreamVoidify {
          : ::minigo::internal::CheckStreamVoidify() & \
                ::minigo::internal::CheckFailStream(#cond, __FILE__, __LINE__)
 
+#ifndef MG_DISABLE_HOT_CHECKS
+#define MG_HOT_CHECK(cond) MG_CHECK(cond)
+#else
+#define MG_HOT_CHECK(cond) \
+  while (false && (cond)) ::minigo::internal::CheckNoOpStream()
+#endif
+
 #ifndef NDEBUG
 #define MG_DCHECK(cond) MG_CHECK(cond)
 #else
@@ -0,0 +1,101 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/logging.h"
+
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Redirects stderr into a stringstream for the lifetime of the object.
+class CaptureStderr {
+ public:
+  CaptureStderr() : old_buf_(std::cerr.rdbuf(captured_.rdbuf())) {}
+  ~CaptureStderr() { std::cerr.rdbuf(old_buf_); }
+
+  std::string str() const { return captured_.str(); }
+
+ private:
+  std::stringstream captured_;
+  std::streambuf* old_buf_;
+};
+
+TEST(LoggingTest, Synchronous) {
+  CaptureStderr capture;
+  MG_LOG(INFO) << "hello " << 42;
+  ASSERT_EQ("hello 42\n", capture.str());
+}
+
+// Logs from several threads concurrently in async mode and verifies that
+// every line arrives exactly once and is never interleaved with another.
+TEST(LoggingTest, Asynchronous) {
+  constexpr int kNumThreads = 8;
+  constexpr int kLinesPerThread = 5000;
+
+  CaptureStderr capture;
+  EnableAsyncLogging();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([i]() {
+      for (int j = 0; j < kLinesPerThread; ++j) {
+        MG_LOG(INFO) << "thread " << i << " line " << j;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // Joins the drainer, flushing all outstanding records.
+  DisableAsyncLogging();
+
+  std::set<std::string> lines;
+  for (absl::string_view line : absl::StrSplit(capture.str(), '\n')) {
+    if (!line.empty()) {
+      ASSERT_TRUE(lines.insert(std::string(line)).second) << line;
+    }
+  }
+  ASSERT_EQ(kNumThreads * kLinesPerThread, lines.size());
+  for (int i = 0; i < kNumThreads; ++i) {
+    for (int j = 0; j < kLinesPerThread; ++j) {
+      std::string expected = absl::StrCat("thread ", i, " line ", j);
+      ASSERT_EQ(1, lines.count(expected)) << expected;
+    }
+  }
+}
+
+TEST(LoggingTest, TruncatesLongLines) {
+  CaptureStderr capture;
+  std::string long_line(2 * internal::LogStream::kMaxLineSize, 'x');
+  MG_LOG(INFO) << long_line;
+
+  auto logged = capture.str();
+  ASSERT_EQ(internal::LogStream::kMaxLineSize, logged.size());
+  ASSERT_EQ('\n', logged.back());
+  ASSERT_EQ('x', logged[logged.size() - 2]);
+}
+
+}  // namespace
+}  // namespace minigo
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <limits>
 #include <sstream>
 #include <utility>
 
@@ -24,7 +25,10 @@
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
 #include "absl/time/clock.h"
+#include "cc/async/background_reclaimer.h"
+#include "cc/async/thread.h"
 #include "cc/logging.h"
+#include "cc/opening_book.h"
 #include "cc/random.h"
 
 namespace minigo {
@@ -39,7 +43,10 @@ std::ostream& operator<<(std::ostream& os, const MctsPlayer::Options& options) {
      << " fastplay_frequency:" << options.fastplay_frequency
      << " fastplay_readouts:" << options.fastplay_readouts
      << " target_pruning:" << options.target_pruning
-     << " random_seed:" << options.random_seed << std::flush;
+     << " num_search_threads:" << options.num_search_threads
+     << " random_seed:" << options.random_seed
+     << " opening_book:" << (options.opening_book != nullptr)
+     << " book_temperature:" << options.book_temperature << std::flush;
   return os;
 }
 
@@ -68,6 +75,51 @@ float TimeRecommendation(int move_num, float seconds_per_move, float time_limit,
          std::pow(decay_factor, std::max(player_move_num - core_moves, 0));
 }
 
+float ThinkTimeRecommendation(const TimeControl& time_control, int move_num) {
+  // Leave a fraction of any hard deadline unspent to cover lag and the delay
+  // between clock updates from the server.
+  constexpr float kSafety = 0.95f;
+
+  if (time_control.stones_left > 0) {
+    // Canadian overtime: spread the remaining period time evenly over the
+    // stones we still owe.
+    return kSafety * time_control.main_time_secs / time_control.stones_left;
+  }
+
+  if (time_control.main_time_secs <= 0) {
+    if (time_control.periods_left > 0) {
+      // Japanese byo-yomi: a period is consumed whether we use none of it or
+      // all of it, so use almost all of it. Keep a bigger reserve on the
+      // final period, since overrunning that one loses the game.
+      return time_control.period_secs *
+             (time_control.periods_left > 1 ? kSafety : 0.8f);
+    }
+    // Fischer with the bank exhausted: live off the increment.
+    return kSafety * time_control.increment_secs;
+  }
+
+  // Main time: budget against the number of moves we still expect to make
+  // ourselves. Games rarely run much past 0.75 * kN * kN total moves, and we
+  // never assume fewer than 16 of our own moves remain so that the think time
+  // tapers off rather than spiking near the estimated end of the game.
+  float moves_left =
+      std::max(16.0f, (0.75f * kN * kN - move_num) / 2);
+  float think =
+      time_control.main_time_secs / moves_left + time_control.increment_secs;
+  if (time_control.period_secs > 0) {
+    // Overtime waiting behind the main clock acts as a cushion: running out
+    // of main time just drops us into the first overtime period, so spend
+    // main time at least as fast as the Japanese overtime pace and don't cap
+    // the think time at the remaining main time.
+    if (time_control.periods_left > 0) {
+      think = std::max(think, 0.8f * time_control.period_secs);
+    }
+    return think;
+  }
+  // Absolute or Fischer: never spend more than the remaining main time.
+  return std::min(think, kSafety * time_control.main_time_secs);
+}
+
 MctsPlayer::MctsPlayer(std::unique_ptr<Model> model,
                        std::shared_ptr<InferenceCache> inference_cache,
                        Game* game, const Options& options)
@@ -83,6 +135,10 @@ MctsPlayer::MctsPlayer(std::unique_ptr<Model> model,
 MctsPlayer::~MctsPlayer() = default;
 
 void MctsPlayer::InitializeGame(const Position& position) {
+  // Destroying a deep tree (and its arena) can take multiple milliseconds;
+  // hand the old tree off to the background reclaimer so that starting a new
+  // game doesn't stall this thread.
+  BackgroundReclaimer::Get()->Reclaim(std::move(tree_));
   tree_ = absl::make_unique<MctsTree>(position, options_.tree);
   game_->NewGame();
 }
@@ -100,23 +156,54 @@ bool MctsPlayer::UndoMove() {
 Coord MctsPlayer::SuggestMove(int new_readouts, bool inject_noise) {
   auto start = absl::Now();
 
+  // Consult the opening book before spending any readouts on search.
+  if (options_.opening_book != nullptr) {
+    auto c = MaybePickBookMove();
+    if (c != Coord::kInvalid) {
+      return c;
+    }
+  }
+
   if (inject_noise) {
     InjectNoise(kDirichletAlpha);
   }
 
   const auto* root = tree_->root();
-  int target_readouts = root->N() + new_readouts;
-
-  if (options_.seconds_per_move > 0) {
+  int start_n = root->N();
+  int target_readouts = start_n + new_readouts;
+
+  auto deadline = absl::InfiniteFuture();
+  bool allow_early_stop = false;
+  if (time_control_.enabled) {
+    // Budget think time from the remaining clock. The clock, not the read
+    // count, is the limiting resource, so don't cap the number of reads.
+    deadline = start + absl::Seconds(ThinkTimeRecommendation(
+                           time_control_, root->position().n()));
+    target_readouts = std::numeric_limits<int>::max();
+    // Stopping early once the most-visited move is unassailable is only
+    // sound when the move will be picked by visit count; during the soft
+    // pick phase the whole visit distribution matters.
+    allow_early_stop = !options_.tree.soft_pick_enabled ||
+                       root->position().n() >= options_.tree.soft_pick_cutoff;
+  } else if (options_.seconds_per_move > 0) {
     // Use time to limit the number of reads.
     float seconds_per_move = options_.seconds_per_move;
     if (options_.time_limit > 0) {
       seconds_per_move =
-          TimeRecommendation(root->position.n(), seconds_per_move,
+          TimeRecommendation(root->position().n(), seconds_per_move,
                              options_.time_limit, options_.decay_factor);
     }
-    while (absl::Now() - start < absl::Seconds(seconds_per_move)) {
+    deadline = start + absl::Seconds(seconds_per_move);
+  }
+
+  if (options_.num_search_threads > 1) {
+    ParallelTreeSearch(target_readouts, deadline, allow_early_stop);
+  } else if (deadline != absl::InfiniteFuture()) {
+    while (absl::Now() < deadline) {
       TreeSearch(options_.virtual_losses, target_readouts);
+      if (allow_early_stop && SearchIsSettled(start_n, start, deadline)) {
+        break;
+      }
     }
   } else {
     // Use a fixed number of reads.
@@ -124,6 +211,10 @@ Coord MctsPlayer::SuggestMove(int new_readouts, bool inject_noise) {
       TreeSearch(options_.virtual_losses, target_readouts);
     }
   }
+  if (time_control_.enabled) {
+    UpdateClock(absl::Now() - start);
+  }
+
   if (ShouldResign()) {
     return Coord::kResign;
   }
@@ -131,10 +222,168 @@ Coord MctsPlayer::SuggestMove(int new_readouts, bool inject_noise) {
   return tree_->PickMove(&rnd_, true);
 }
 
+void MctsPlayer::UpdateClock(absl::Duration elapsed) {
+  float spent = absl::ToDoubleSeconds(elapsed);
+  auto& tc = time_control_;
+
+  if (tc.stones_left > 0) {
+    // Canadian overtime (or the conservative interpretation of byo-yomi that
+    // time_left reports): this move was one of the stones owed.
+    tc.main_time_secs = std::max(0.0f, tc.main_time_secs - spent);
+    if (--tc.stones_left == 0) {
+      // Made it: a fresh period starts.
+      tc.main_time_secs = tc.period_secs;
+      tc.stones_left = tc.period_stones;
+    }
+    return;
+  }
+
+  if (tc.main_time_secs <= 0 && tc.periods_left > 0) {
+    // Japanese byo-yomi: a period is kept if the move was played within it,
+    // and every period the move overran is lost.
+    while (tc.periods_left > 1 && spent > tc.period_secs) {
+      spent -= tc.period_secs;
+      tc.periods_left -= 1;
+    }
+    return;
+  }
+
+  // Main time, possibly overflowing into overtime.
+  tc.main_time_secs -= spent;
+  if (tc.main_time_secs >= 0) {
+    tc.main_time_secs += tc.increment_secs;
+    return;
+  }
+  float over = -tc.main_time_secs;
+  tc.main_time_secs = 0;
+  if (tc.period_stones > 0) {
+    // Entered Canadian overtime; this move counts against the first period.
+    tc.main_time_secs = std::max(0.0f, tc.period_secs - over);
+    tc.stones_left = std::max(1, tc.period_stones - 1);
+  } else if (tc.periods_left > 0) {
+    // Entered Japanese byo-yomi, losing any periods the move overran.
+    while (tc.periods_left > 1 && over > tc.period_secs) {
+      over -= tc.period_secs;
+      tc.periods_left -= 1;
+    }
+  }
+}
+
 void MctsPlayer::TreeSearch(int num_leaves, int max_num_reads) {
   MaybeExpandRoot();
-  SelectLeaves(num_leaves, max_num_reads);
-  ProcessLeaves();
+  SelectLeaves(num_leaves, max_num_reads, &search_buffer_);
+  RunInference(&search_buffer_);
+  IncorporateLeaves(&search_buffer_);
+}
+
+void MctsPlayer::Ponder(int max_num_reads, absl::Time deadline) {
+  if (options_.num_search_threads > 1) {
+    ParallelTreeSearch(max_num_reads, deadline);
+    return;
+  }
+  MaybeExpandRoot();
+  while (tree_->root()->N() < max_num_reads && absl::Now() < deadline) {
+    TreeSearch(options_.virtual_losses, max_num_reads);
+  }
+}
+
+void MctsPlayer::ParallelTreeSearch(int target_readouts, absl::Time deadline,
+                                    bool allow_early_stop) {
+  MaybeExpandRoot();
+  int start_n = tree_->root()->N();
+  auto start_time = absl::Now();
+
+  std::vector<LambdaThread> threads;
+  threads.reserve(options_.num_search_threads);
+  for (int i = 0; i < options_.num_search_threads; ++i) {
+    threads.emplace_back("search", [this, target_readouts, deadline,
+                                    allow_early_stop, start_n, start_time]() {
+      SearchBuffer buffer;
+      for (;;) {
+        {
+          absl::MutexLock lock(&tree_mutex_);
+          if (tree_->root()->N() >= target_readouts ||
+              absl::Now() >= deadline ||
+              (allow_early_stop &&
+               SearchIsSettled(start_n, start_time, deadline))) {
+            return;
+          }
+          SelectLeaves(options_.virtual_losses, target_readouts, &buffer);
+        }
+
+        // Inference runs outside the lock: this is where almost all the time
+        // goes, and the virtual losses applied during selection steer the
+        // other threads towards different leaves in the meantime.
+        RunInference(&buffer);
+
+        {
+          absl::MutexLock lock(&tree_mutex_);
+          IncorporateLeaves(&buffer);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.Start();
+  }
+  for (auto& t : threads) {
+    t.Join();
+  }
+}
+
+bool MctsPlayer::SearchIsSettled(int start_n, absl::Time start_time,
+                                 absl::Time deadline) const {
+  const auto* root = tree_->root();
+  int n = root->N() - start_n;
+  // Wait for a meaningful sample of reads before estimating the read rate.
+  if (n < 2 * options_.virtual_losses) {
+    return false;
+  }
+
+  auto now = absl::Now();
+  double elapsed = absl::ToDoubleSeconds(now - start_time);
+  if (elapsed <= 0) {
+    return false;
+  }
+  double reads_left = (n / elapsed) * absl::ToDoubleSeconds(deadline - now);
+  if (reads_left <= 0) {
+    return true;
+  }
+
+  // Find the two highest child visit counts.
+  int best = 0;
+  int second = 0;
+  for (int i = 0; i < kNumMoves; ++i) {
+    int child_n = root->child_N(i);
+    if (child_n > best) {
+      second = best;
+      best = child_n;
+    } else if (child_n > second) {
+      second = child_n;
+    }
+  }
+
+  // Settled if the runner-up can't catch the most-visited child even when
+  // given every remaining read.
+  return best - second > reads_left;
+}
+
+Coord MctsPlayer::MaybePickBookMove() {
+  const auto* root = tree_->root();
+  auto key = OpeningBook::KeyHash(root->move, symmetry::kIdentity,
+                                  root->position());
+  const auto* entry = options_.opening_book->Lookup(key);
+  if (entry == nullptr) {
+    return Coord::kInvalid;
+  }
+
+  auto c = OpeningBook::SampleMove(*entry, options_.book_temperature, &rnd_);
+  // Guard against key collisions and books built under different rules.
+  if (!tree_->is_legal_move(c)) {
+    return Coord::kInvalid;
+  }
+  played_book_move_ = true;
+  return c;
 }
 
 void MctsPlayer::InjectNoise(float dirichlet_alpha) {
@@ -145,13 +394,15 @@ void MctsPlayer::InjectNoise(float dirichlet_alpha) {
 
 void MctsPlayer::MaybeExpandRoot() {
   if (!tree_->root()->is_expanded) {
-    SelectLeaves(1, tree_->root()->N() + 1);
-    ProcessLeaves();
+    SelectLeaves(1, tree_->root()->N() + 1, &search_buffer_);
+    RunInference(&search_buffer_);
+    IncorporateLeaves(&search_buffer_);
   }
 }
 
-void MctsPlayer::SelectLeaves(int num_leaves, int max_num_reads) {
-  tree_search_inferences_.clear();
+void MctsPlayer::SelectLeaves(int num_leaves, int max_num_reads,
+                              SearchBuffer* buffer) {
+  buffer->inferences.clear();
   ModelOutput cached_output;
 
   int max_cache_misses = num_leaves * 2;
@@ -163,7 +414,7 @@ void MctsPlayer::SelectLeaves(int num_leaves, int max_num_reads) {
 
     if (leaf->game_over()) {
       float value =
-          leaf->position.CalculateScore(game_->options().komi) > 0 ? 1 : -1;
+          leaf->position().CalculateScore(game_->options().komi) > 0 ? 1 : -1;
       tree_->IncorporateEndGameResult(leaf, value);
       ++num_cache_misses;
       continue;
@@ -176,7 +427,7 @@ void MctsPlayer::SelectLeaves(int num_leaves, int max_num_reads) {
     InferenceCache::Key cache_key;
     if (inference_cache_ != nullptr) {
       cache_key =
-          InferenceCache::Key(leaf->move, canonical_sym, leaf->position);
+          InferenceCache::Key(leaf->move, canonical_sym, leaf->position());
 
       if (inference_cache_->TryGet(cache_key, canonical_sym, inference_sym,
                                    &cached_output)) {
@@ -188,21 +439,12 @@ void MctsPlayer::SelectLeaves(int num_leaves, int max_num_reads) {
 
     ++num_cache_misses;
 
-    tree_search_inferences_.emplace_back(cache_key, canonical_sym,
-                                         inference_sym, leaf);
+    buffer->inferences.emplace_back(cache_key, canonical_sym, inference_sym,
+                                    leaf);
 
-    auto& input = tree_search_inferences_.back().input;
+    auto& input = buffer->inferences.back().input;
     input.sym = inference_sym;
-    // TODO(tommadams): add a method to Model that returns the required position
-    // history size.
-    auto* node = leaf;
-    for (int i = 0; i < input.position_history.capacity(); ++i) {
-      input.position_history.push_back(&node->position);
-      node = node->parent;
-      if (node == nullptr) {
-        break;
-      }
-    }
+    tree_->GetStoneHistory(leaf, &input);
 
     tree_->AddVirtualLoss(leaf);
     if (++num_selected == num_leaves) {
@@ -216,50 +458,63 @@ void MctsPlayer::SelectLeaves(int num_leaves, int max_num_reads) {
   }
 }
 
-void MctsPlayer::ProcessLeaves() {
-  if (tree_search_inferences_.empty()) {
+void MctsPlayer::RunInference(SearchBuffer* buffer) {
+  if (buffer->inferences.empty()) {
     return;
   }
 
-  input_ptrs_.clear();
-  output_ptrs_.clear();
-  for (auto& x : tree_search_inferences_) {
-    input_ptrs_.push_back(&x.input);
-    output_ptrs_.push_back(&x.output);
+  buffer->input_ptrs.clear();
+  buffer->output_ptrs.clear();
+  for (auto& x : buffer->inferences) {
+    buffer->input_ptrs.push_back(&x.input);
+    buffer->output_ptrs.push_back(&x.output);
   }
 
-  // Run inference.
-  model_->RunMany(input_ptrs_, &output_ptrs_, &inference_model_);
+  model_->RunMany(buffer->input_ptrs, &buffer->output_ptrs,
+                  &buffer->model_name);
+}
+
+void MctsPlayer::IncorporateLeaves(SearchBuffer* buffer) {
+  if (buffer->inferences.empty()) {
+    return;
+  }
 
   // Record some information about the inference.
-  if (!inference_model_.empty()) {
-    if (inferences_.empty() || inference_model_ != inferences_.back().model) {
-      inferences_.emplace_back(inference_model_, tree_->root()->position.n());
+  if (!buffer->model_name.empty()) {
+    if (inferences_.empty() || buffer->model_name != inferences_.back().model) {
+      inferences_.emplace_back(buffer->model_name,
+                               tree_->root()->position().n());
     }
-    inferences_.back().last_move = tree_->root()->position.n();
-    inferences_.back().total_count += tree_search_inferences_.size();
+    inferences_.back().last_move = tree_->root()->position().n();
+    inferences_.back().total_count += buffer->inferences.size();
   }
 
-  // Incorporate the inference outputs back into tree search.
-  for (auto& inference : tree_search_inferences_) {
-    auto& output = inference.output;
-
-    // Merge the inference output with those in the inference cache, possibly
-    // updating the values in `output`.
-    if (inference_cache_ != nullptr) {
+  // Merge the inference outputs with those in the inference cache, possibly
+  // updating the values in each `output`.
+  if (inference_cache_ != nullptr) {
+    for (auto& inference : buffer->inferences) {
       inference_cache_->Merge(inference.cache_key, inference.canonical_sym,
-                              inference.inference_sym, &output);
+                              inference.inference_sym, &inference.output);
     }
+  }
 
-    // Propagate the results back up the tree to the root.
-    tree_->IncorporateResults(inference.leaf, output.policy, output.value);
+  // Incorporate the inference outputs back into tree search, backing the
+  // whole batch's values up the tree in one deduplicated pass.
+  buffer->leaf_ptrs.clear();
+  buffer->const_output_ptrs.clear();
+  for (auto& inference : buffer->inferences) {
+    buffer->leaf_ptrs.push_back(inference.leaf);
+    buffer->const_output_ptrs.push_back(&inference.output);
+  }
+  tree_->IncorporateResultsBatch(buffer->leaf_ptrs, buffer->const_output_ptrs);
+  for (auto& inference : buffer->inferences) {
     tree_->RevertVirtualLoss(inference.leaf);
   }
 
   if (tree_search_cb_ != nullptr) {
     std::vector<const MctsNode*> leaves;
-    leaves.reserve(tree_search_inferences_.size());
-    for (auto& inference : tree_search_inferences_) {
+    leaves.reserve(buffer->inferences.size());
+    for (auto& inference : buffer->inferences) {
       leaves.push_back(inference.leaf);
     }
     tree_search_cb_(leaves);
@@ -310,6 +565,13 @@ bool MctsPlayer::PlayMove(Coord c, bool is_trainable) {
     return false;
   }
 
+  // A book move is played without any search, so there are no statistics to
+  // train on.
+  if (played_book_move_) {
+    is_trainable = false;
+    played_book_move_ = false;
+  }
+
   // Adjust the visits before adding the move's search_pi to the Game.
   if (is_trainable && options_.target_pruning) {
     tree_->ReshapeFinalVisits(true);
@@ -343,7 +605,7 @@ void MctsPlayer::UpdateGame(Coord c, bool is_trainable) {
   std::vector<std::string> models;
   if (!inferences_.empty()) {
     for (auto it = inferences_.rbegin(); it != inferences_.rend(); ++it) {
-      if (it->last_move < root->position.n()) {
+      if (it->last_move < root->position().n()) {
         break;
       }
       models.push_back(it->model);
@@ -361,11 +623,11 @@ void MctsPlayer::UpdateGame(Coord c, bool is_trainable) {
   // Update the game history.
   if (is_trainable && c != Coord::kResign) {
     auto search_pi = tree_->CalculateSearchPi();
-    game_->AddTrainableMove(tree_->to_play(), c, root->position,
+    game_->AddTrainableMove(tree_->to_play(), c, root->position(),
                             std::move(comment), root->Q(), root->N(),
                             search_pi);
   } else {
-    game_->AddNonTrainableMove(tree_->to_play(), c, root->position,
+    game_->AddNonTrainableMove(tree_->to_play(), c, root->position(),
                                std::move(comment), root->Q(), root->N());
   }
 }
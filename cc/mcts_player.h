@@ -23,6 +23,8 @@
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "cc/algorithm.h"
 #include "cc/constants.h"
@@ -36,10 +38,46 @@
 
 namespace minigo {
 
+class OpeningBook;
+
 // Exposed for testing.
 float TimeRecommendation(int move_num, float seconds_per_move, float time_limit,
                          float decay_factor);
 
+// Describes the game's time control and this player's clock, as reported by
+// the GTP time_settings, kgs-time_settings and time_left commands.
+struct TimeControl {
+  // True once a time control has been set. SuggestMove then budgets its think
+  // time from the remaining clock instead of Options::seconds_per_move, and
+  // stops searching early once the best move can no longer change.
+  bool enabled = false;
+
+  // Seconds remaining on the main clock or, once in Canadian overtime, in the
+  // current overtime period.
+  float main_time_secs = 0;
+
+  // Fischer increment added to the clock after every move, if any.
+  float increment_secs = 0;
+
+  // Overtime parameters: seconds per overtime period and the number of stones
+  // that must be played in a period (0 for Japanese byo-yomi, where a period
+  // covers a single move).
+  float period_secs = 0;
+  int period_stones = 0;
+
+  // Japanese byo-yomi periods remaining.
+  int periods_left = 0;
+
+  // When in Canadian overtime, the number of stones left to play before
+  // main_time_secs runs out; 0 otherwise.
+  int stones_left = 0;
+};
+
+// Exposed for testing.
+// Returns the recommended number of seconds to spend thinking about move
+// `move_num` under the given time control.
+float ThinkTimeRecommendation(const TimeControl& time_control, int move_num);
+
 class MctsPlayer {
  public:
   struct Options {
@@ -51,6 +89,15 @@ class MctsPlayer {
 
     int virtual_losses = 8;
 
+    // Number of threads to fan tree search across. Each thread repeatedly
+    // selects a batch of `virtual_losses` leaves from the shared tree, runs
+    // inference on them, then incorporates the results. Tree mutations are
+    // serialized; inference (where almost all the time goes) runs in
+    // parallel, with virtual loss steering concurrent selections apart.
+    // Values > 1 require a model whose RunMany is safe to call concurrently,
+    // e.g. one created through BatchingModelFactory.
+    int num_search_threads = 1;
+
     // Random seed & stream used for random permutations.
     uint64_t random_seed = Random::kUniqueSeed;
 
@@ -97,6 +144,17 @@ class MctsPlayer {
     // reward distribution.  "False" == no pruning will be applied.
     bool target_pruning = false;
 
+    // If non-null, an opening book consulted at the start of SuggestMove.
+    // Positions found in the book play a book move immediately without
+    // spending any readouts. The book must outlive the player. Book moves
+    // carry no search statistics and are never recorded as trainable.
+    const OpeningBook* opening_book = nullptr;
+
+    // Temperature applied to the book's move weights when sampling a book
+    // move. 0 always plays the book's most common move; higher values add
+    // diversity for selfplay.
+    float book_temperature = 0;
+
     friend std::ostream& operator<<(std::ostream& ios, const Options& options);
   };
 
@@ -147,6 +205,18 @@ class MctsPlayer {
   // which moves they were used for.
   std::string GetModelsUsedForInference() const;
 
+  // Serializes the current search tree to a binary snapshot that can be
+  // persisted & later restored by a player at the same position. See
+  // MctsTree::SerializeSnapshot for details.
+  std::string SaveTreeSnapshot() const { return tree_->SerializeSnapshot(); }
+
+  // Restores a search tree snapshot previously created by SaveTreeSnapshot.
+  // The player must be at the same position the snapshot was taken at.
+  // Returns false if it isn't, or if the snapshot is corrupt.
+  bool LoadTreeSnapshot(absl::string_view data) {
+    return tree_->DeserializeSnapshot(data);
+  }
+
   // Returns the root of the current search tree, i.e. the current board state.
   // TODO(tommadams): convert all callers to player->tree().root();
   const MctsNode* root() const { return tree_->root(); }
@@ -159,8 +229,21 @@ class MctsPlayer {
 
   void SetOptions(const Options& options) { options_ = options; }
 
+  // Sets the game's time control, or updates the clock mid-game.
+  void SetTimeControl(const TimeControl& time_control) {
+    time_control_ = time_control;
+  }
+  const TimeControl& time_control() const { return time_control_; }
+
   void TreeSearch(int num_leaves, int max_num_reads);
 
+  // Runs tree search from the current root until it has `max_num_reads` reads
+  // or `deadline` passes, fanning out across `Options::num_search_threads`
+  // threads when configured. Used by GTP pondering to think on the opponent's
+  // time: with tree reuse, the subtree matching the opponent's reply is
+  // promoted to the root as soon as the reply is played.
+  void Ponder(int max_num_reads, absl::Time deadline);
+
   // Protected methods that get exposed for testing.
  protected:
   MctsTree* mutable_tree() { return tree_.get(); }
@@ -206,7 +289,7 @@ class MctsPlayer {
   symmetry::Symmetry GetInferenceSymmetry(const MctsNode* node) const {
     if (options_.random_symmetry) {
       uint64_t bits = Random::MixBits(
-          node->position.stone_hash() * Random::kLargePrime + inference_mix_);
+          node->position().stone_hash() * Random::kLargePrime + inference_mix_);
       return static_cast<symmetry::Symmetry>(bits % symmetry::kNumSymmetries);
     } else {
       return symmetry::kIdentity;
@@ -216,6 +299,12 @@ class MctsPlayer {
   // Inject noise into the root node.
   void InjectNoise(float dirichlet_alpha);
 
+  // Samples a move for the current position from the opening book.
+  // Returns kInvalid if the position isn't in the book (or, in the
+  // vanishingly unlikely case of a key collision, if the book's move isn't
+  // legal).
+  Coord MaybePickBookMove();
+
   // Expand the root node if necessary.
   // In order to correctly count the number of reads performed or to inject
   // noise, the root node must be expanded. The root will always be expanded
@@ -224,21 +313,76 @@ class MctsPlayer {
   // of the tree have been cleared.
   void MaybeExpandRoot();
 
+  struct TreeSearchInference {
+    TreeSearchInference(InferenceCache::Key cache_key,
+                        symmetry::Symmetry canonical_sym,
+                        symmetry::Symmetry inference_sym, MctsNode* leaf)
+        : cache_key(cache_key),
+          canonical_sym(canonical_sym),
+          inference_sym(inference_sym),
+          leaf(leaf) {}
+    InferenceCache::Key cache_key;
+    symmetry::Symmetry canonical_sym;
+    symmetry::Symmetry inference_sym;
+    MctsNode* leaf;
+    ModelInput input;
+    ModelOutput output;
+  };
+
+  // Holds the leaves selected by one call to SelectLeaves and the inference
+  // inputs & outputs for them. The serial search path reuses a single member
+  // buffer; parallel search gives each search thread its own.
+  struct SearchBuffer {
+    std::vector<TreeSearchInference> inferences;
+    std::vector<const ModelInput*> input_ptrs;
+    std::vector<ModelOutput*> output_ptrs;
+
+    // Scratch space for MctsTree::IncorporateResultsBatch.
+    std::vector<MctsNode*> leaf_ptrs;
+    std::vector<const ModelOutput*> const_output_ptrs;
+
+    // Name of the model that performed the inferences, returned by RunMany.
+    std::string model_name;
+  };
+
   // Select up to `num_leaves` leaves to perform inference on, storing the
-  // selected leaves in `tree_search_inferences_`. If the player has an
-  // inference cache, this can cause more nodes to be added to the tree when
-  // the selected leaves are already in the cache. To limit this, SelectLeaves
-  // will stop once the root has `max_num_reads`.
+  // selected leaves in `buffer`. If the player has an inference cache, this
+  // can cause more nodes to be added to the tree when the selected leaves are
+  // already in the cache. To limit this, SelectLeaves will stop once the root
+  // has `max_num_reads`.
   //
   // In some positions, the model may favor one move so heavily that it
   // overcomes the effects of virtual loss. In this case, SelectLeaves may
   // choose the same leaf multiple times.
-  void SelectLeaves(int num_leaves, int max_num_reads);
-
-  // Run inference on the contents of `inferences_` that was previously
-  // populated by a call to SelectLeaves, and propagate the results back up the
-  // tree to the root.
-  void ProcessLeaves();
+  void SelectLeaves(int num_leaves, int max_num_reads, SearchBuffer* buffer);
+
+  // Run inference on the leaves in `buffer` previously selected by
+  // SelectLeaves. Doesn't touch the tree, so in parallel search mode multiple
+  // threads can run inference concurrently.
+  void RunInference(SearchBuffer* buffer);
+
+  // Propagate the inference results in `buffer` back up the tree to the root.
+  void IncorporateLeaves(SearchBuffer* buffer);
+
+  // Runs tree search across `Options::num_search_threads` threads until the
+  // root has `target_readouts` reads or `deadline` passes. If
+  // `allow_early_stop` is true, the search also stops as soon as
+  // SearchIsSettled reports that the best move can no longer change.
+  void ParallelTreeSearch(int target_readouts, absl::Time deadline,
+                          bool allow_early_stop = false);
+
+  // Returns true if a deadline-bounded search can stop early: given the read
+  // rate observed since `start_time` (when the root had `start_n` reads), the
+  // reads achievable before `deadline` can no longer lift the second
+  // most-visited child above the most-visited one.
+  bool SearchIsSettled(int start_n, absl::Time start_time,
+                       absl::Time deadline) const;
+
+  // Updates the time control's clock after spending `elapsed` thinking about
+  // a move. This is only an estimate to keep the budgeting sane if the GTP
+  // controller is slow to send time_left updates; a time_left command
+  // overwrites it with the authoritative value.
+  void UpdateClock(absl::Duration elapsed);
 
   void UpdateGame(Coord c, bool is_trainable);
 
@@ -246,41 +390,29 @@ class MctsPlayer {
 
   std::unique_ptr<MctsTree> tree_;
 
+  // Serializes tree mutations (and the inference bookkeeping above) when
+  // num_search_threads > 1. Uncontended in serial search, which is the only
+  // mode used by selfplay.
+  absl::Mutex tree_mutex_;
+
   Game* game_;
 
   Random rnd_;
 
   Options options_;
 
-  // The name of the model used for inferences. In the case of ReloadingModel,
-  // this is different from the model's name: the model name is the pattern used
-  // to match each generation of model, while the inference model name is the
-  // path to the actual serialized model file.
-  std::string inference_model_;
+  // True if the last move returned by SuggestMove came from the opening
+  // book, in which case the next PlayMove records it as non-trainable.
+  bool played_book_move_ = false;
+
+  TimeControl time_control_;
 
   std::vector<InferenceInfo> inferences_;
 
   std::shared_ptr<InferenceCache> inference_cache_;
 
-  struct TreeSearchInference {
-    TreeSearchInference(InferenceCache::Key cache_key,
-                        symmetry::Symmetry canonical_sym,
-                        symmetry::Symmetry inference_sym, MctsNode* leaf)
-        : cache_key(cache_key),
-          canonical_sym(canonical_sym),
-          inference_sym(inference_sym),
-          leaf(leaf) {}
-    InferenceCache::Key cache_key;
-    symmetry::Symmetry canonical_sym;
-    symmetry::Symmetry inference_sym;
-    MctsNode* leaf;
-    ModelInput input;
-    ModelOutput output;
-  };
-
-  std::vector<TreeSearchInference> tree_search_inferences_;
-  std::vector<const ModelInput*> input_ptrs_;
-  std::vector<ModelOutput*> output_ptrs_;
+  // Buffer used by the serial search path.
+  SearchBuffer search_buffer_;
 
   TreeSearchCallback tree_search_cb_ = nullptr;
 
@@ -73,8 +73,8 @@ int CountPendingVirtualLosses(const MctsNode* node) {
     pending.pop_back();
     MG_CHECK(node->num_virtual_losses_applied >= 0);
     num += node->num_virtual_losses_applied;
-    for (const auto& p : node->children) {
-      pending.push_back(p.second.get());
+    for (const auto* child : node->children) {
+      pending.push_back(child);
     }
   }
   return num;
@@ -126,7 +126,8 @@ class MctsPlayerTest : public ::testing::Test {
     auto* tree = player->mutable_tree();
 
     ModelInput input;
-    input.position_history.push_back(&player->root()->position);
+    input.position = &player->root()->position();
+    input.stone_history.push_back(&player->root()->position().stone_snapshot());
     auto output = player->Run(input);
     tree->IncorporateResults(tree->SelectLeaf(true), output.policy,
                              output.value);
@@ -182,10 +183,66 @@ TEST_F(MctsPlayerTest, TimeRecommendation) {
   EXPECT_GT(0.0001, TimeRecommendation(1000, 5, 100, 0.98));
 }
 
+TEST_F(MctsPlayerTest, ThinkTimeRecommendation) {
+  // Absolute time: early thinking time should leave plenty of time for the
+  // rest of the game and never exceed the remaining clock.
+  TimeControl absolute;
+  absolute.enabled = true;
+  absolute.main_time_secs = 600;
+  float early = ThinkTimeRecommendation(absolute, 0);
+  EXPECT_LT(0, early);
+  EXPECT_GT(absolute.main_time_secs / 16, early);
+  absolute.main_time_secs = 2;
+  EXPECT_GE(2, ThinkTimeRecommendation(absolute, 200));
+
+  // Fischer: once main time is exhausted, live off the increment without
+  // quite spending all of it.
+  TimeControl fischer;
+  fischer.enabled = true;
+  fischer.main_time_secs = 0;
+  fischer.increment_secs = 10;
+  float think = ThinkTimeRecommendation(fischer, 100);
+  EXPECT_LT(0, think);
+  EXPECT_GT(fischer.increment_secs, think);
+
+  // Japanese byo-yomi: with spare periods we can spend a whole period, but
+  // on the last period we must stay safely inside it.
+  TimeControl byoyomi;
+  byoyomi.enabled = true;
+  byoyomi.main_time_secs = 0;
+  byoyomi.period_secs = 30;
+  byoyomi.periods_left = 5;
+  EXPECT_LE(byoyomi.period_secs * 0.9f, ThinkTimeRecommendation(byoyomi, 100));
+  byoyomi.periods_left = 1;
+  EXPECT_GT(byoyomi.period_secs, ThinkTimeRecommendation(byoyomi, 100));
+
+  // Byo-yomi also acts as a cushion during main time: the recommendation
+  // should never drop below a large fraction of a period because overrunning
+  // main time just starts the first period.
+  TimeControl cushion;
+  cushion.enabled = true;
+  cushion.main_time_secs = 1;
+  cushion.period_secs = 30;
+  cushion.periods_left = 5;
+  EXPECT_LE(cushion.period_secs * 0.5f, ThinkTimeRecommendation(cushion, 100));
+
+  // Canadian overtime: the remaining time is divided between the remaining
+  // stones of the period.
+  TimeControl canadian;
+  canadian.enabled = true;
+  canadian.main_time_secs = 100;
+  canadian.period_secs = 300;
+  canadian.period_stones = 25;
+  canadian.stones_left = 10;
+  float per_stone = ThinkTimeRecommendation(canadian, 100);
+  EXPECT_LT(canadian.main_time_secs / 20, per_stone);
+  EXPECT_GE(canadian.main_time_secs / 10, per_stone);
+}
+
 TEST_F(MctsPlayerTest, DontPassIfLosing) {
   auto player = CreateAlmostDonePlayer();
   auto* root = player->root();
-  EXPECT_EQ(-0.5, root->position.CalculateScore(game_->options().komi));
+  EXPECT_EQ(-0.5, root->position().CalculateScore(game_->options().komi));
 
   for (int i = 0; i < 20; ++i) {
     player->TreeSearch(1, std::numeric_limits<int>::max());
@@ -243,6 +300,20 @@ TEST_F(MctsPlayerTest, RidiculouslyParallelTreeSearch) {
   EXPECT_EQ(0, CountPendingVirtualLosses(root));
 }
 
+TEST_F(MctsPlayerTest, MultiThreadedTreeSearch) {
+  MctsPlayer::Options options;
+  options.num_search_threads = 4;
+  auto player = CreateBasicPlayer(options);
+  auto* root = player->root();
+
+  player->SuggestMove(400);
+
+  // All threads should have finished their reads and reverted their virtual
+  // losses.
+  EXPECT_LE(400, root->N());
+  EXPECT_EQ(0, CountPendingVirtualLosses(root));
+}
+
 TEST_F(MctsPlayerTest, ColdStartParallelTreeSearch) {
   MctsPlayer::Options options;
   options.random_seed = 17;
@@ -295,7 +366,7 @@ TEST_F(MctsPlayerTest, ExtractDataNormalEnd) {
 
   auto* root = player->root();
   EXPECT_TRUE(root->game_over());
-  EXPECT_EQ(Color::kBlack, root->position.to_play());
+  EXPECT_EQ(Color::kBlack, root->position().to_play());
 
   ASSERT_EQ(2, game_->num_moves());
 
@@ -317,7 +388,7 @@ TEST_F(MctsPlayerTest, ExtractDataResignEnd) {
   auto* root = player->root();
 
   // Black is winning on the board.
-  EXPECT_LT(0, root->position.CalculateScore(game_->options().komi));
+  EXPECT_LT(0, root->position().CalculateScore(game_->options().komi));
   EXPECT_EQ(-1, game_->result());
   EXPECT_EQ("W+R", game_->result_string());
 }
@@ -334,7 +405,7 @@ TEST_F(MctsPlayerTest, UndoMove) {
 
   auto* root = player->root();
   EXPECT_TRUE(game_->game_over());
-  EXPECT_EQ(Color::kBlack, root->position.to_play());
+  EXPECT_EQ(Color::kBlack, root->position().to_play());
   ASSERT_EQ(2, game_->num_moves());
   EXPECT_EQ(-1, game_->result());
   EXPECT_EQ("W+7.5", game_->result_string());
@@ -345,7 +416,7 @@ TEST_F(MctsPlayerTest, UndoMove) {
   root = player->root();
   EXPECT_FALSE(root->game_over());
   EXPECT_EQ(Coord::kPass, root->move);
-  EXPECT_EQ(Color::kWhite, root->position.to_play());
+  EXPECT_EQ(Color::kWhite, root->position().to_play());
   EXPECT_EQ(1, game_->num_moves());
 }
 
@@ -361,9 +432,3 @@ TEST_F(MctsPlayerTest, SoftPickWithNoVisits) {
 
 }  // namespace
 }  // namespace minigo
-
-int main(int argc, char** argv) {
-  ::testing::InitGoogleTest(&argc, argv);
-  ::minigo::zobrist::Init(614944751);
-  return RUN_ALL_TESTS();
-}
@@ -16,8 +16,19 @@
 
 #include <emmintrin.h>
 
+// AVX2 and AVX-512 implementations of CalculateChildActionScore are compiled
+// with per-function target attributes and selected at runtime, so that a
+// single binary can take advantage of whatever vector width the selfplay
+// hosts support. Toolchains without target attribute support (e.g. MSVC) fall
+// back to the SSE2 implementation.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MG_INTERNAL_HAVE_AVX_DISPATCH 1
+#include <immintrin.h>
+#endif
+
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <tuple>
 #include <utility>
@@ -31,28 +42,285 @@ namespace minigo {
 
 namespace {
 
-// Superko implementation that uses MctsNode::superko_cache.
+// Superko implementation that uses the superko cache in MctsNode::ColdState.
+// The node's ancestor chain is walked once on construction: queries then only
+// check a few contiguous recent hashes and do one hash set lookup, instead of
+// chasing parent pointers for each of the ~kNumMoves legality checks
+// performed when a node is expanded.
 class ZobristHistory : public Position::ZobristHistory {
  public:
-  explicit ZobristHistory(const MctsNode* node) : node_(node) {}
+  explicit ZobristHistory(const MctsNode* node) {
+    for (; node != nullptr; node = node->parent) {
+      if (node->cold->superko_cache != nullptr) {
+        cache_ = node->cold->superko_cache.get();
+        break;
+      }
+      recent_hashes_.push_back(node->position().stone_hash());
+    }
+  }
 
   bool HasPositionBeenPlayedBefore(zobrist::Hash stone_hash) const {
-    for (const auto* node = node_; node != nullptr; node = node->parent) {
-      if (node->superko_cache != nullptr) {
-        return node->superko_cache->contains(stone_hash);
-      } else {
-        if (node->position.stone_hash() == stone_hash) {
-          return true;
-        }
+    for (auto hash : recent_hashes_) {
+      if (hash == stone_hash) {
+        return true;
       }
     }
-    return false;
+    return cache_ != nullptr && cache_->contains(stone_hash);
   }
 
  private:
-  const MctsNode* node_;
+  // Hashes of the ancestors between the node (inclusive) and its nearest
+  // cache-holding ancestor or the tree's root. A cache is built whenever a
+  // node's move number is a multiple of kSuperKoCacheStride, so the walk
+  // visits fewer than 2 * kSuperKoCacheStride nodes.
+  inline_vector<zobrist::Hash, 16> recent_hashes_;
+  const MctsNode::SuperkoCache* cache_ = nullptr;
 };
 
+constexpr int kSuperKoCacheStride = 8;
+
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+
+// AVX2 version of MctsNode::CalculateChildActionScoreSimd: identical math to
+// the SSE2 implementation below but processes eight moves per iteration.
+// F16C (available on every AVX2 CPU) widens fp16 priors during the load.
+__attribute__((target("avx2,f16c"))) void CalculateChildActionScoreAvx2(
+    const MctsNode& node, PaddedSpan<float> result) {
+  __m256 to_play = _mm256_set1_ps(node.to_play == Color::kBlack ? 1 : -1);
+  __m256 U_common = _mm256_set1_ps(
+      node.U_scale() * std::sqrt(std::max<float>(1, node.N() - 1)));
+
+  __m256i one = _mm256_set1_epi32(1);
+  __m256 one_thousand = _mm256_set1_ps(1000);
+
+  const auto& edges = node.edges;
+  const auto* legal_moves = node.legal_moves;
+  for (int i = 0; i < kNumMoves; i += 8) {
+    __m256i N = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(edges.N.data() + i));
+    __m256 rcp_N_one = _mm256_rcp_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(one, N)));
+
+    __m256 W = _mm256_loadu_ps(edges.W.data() + i);
+    __m256 Q = _mm256_mul_ps(W, rcp_N_one);
+
+#ifdef MG_FP16_PRIORS
+    __m256 P = _mm256_cvtph_ps(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(edges.P.data() + i)));
+#else
+    __m256 P = _mm256_loadu_ps(edges.P.data() + i);
+#endif
+    __m256 U = _mm256_mul_ps(_mm256_mul_ps(U_common, P), rcp_N_one);
+
+    // Widen the next eight legal move bytes to 32 bits each.
+    __m256i legal_bits = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(legal_moves + i)));
+
+    // `legal = legal_bits == 0 ? 1000 : 0`
+    __m256 legal = _mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(legal_bits, _mm256_setzero_si256()));
+    legal = _mm256_and_ps(legal, one_thousand);
+
+    __m256 cas =
+        _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(Q, to_play), U), legal);
+    _mm256_storeu_ps(result.data() + i, cas);
+  }
+}
+
+// AVX-512 version of MctsNode::CalculateChildActionScoreSimd: sixteen moves
+// per iteration, using mask registers for the illegal move penalty.
+__attribute__((target("avx512f"))) void CalculateChildActionScoreAvx512(
+    const MctsNode& node, PaddedSpan<float> result) {
+  __m512 to_play = _mm512_set1_ps(node.to_play == Color::kBlack ? 1 : -1);
+  __m512 U_common = _mm512_set1_ps(
+      node.U_scale() * std::sqrt(std::max<float>(1, node.N() - 1)));
+
+  __m512i one = _mm512_set1_epi32(1);
+  __m512 one_thousand = _mm512_set1_ps(1000);
+
+  const auto& edges = node.edges;
+  const auto* legal_moves = node.legal_moves;
+  for (int i = 0; i < kNumMoves; i += 16) {
+    __m512i N = _mm512_loadu_si512(edges.N.data() + i);
+    __m512 rcp_N_one =
+        _mm512_rcp14_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(one, N)));
+
+    __m512 W = _mm512_loadu_ps(edges.W.data() + i);
+    __m512 Q = _mm512_mul_ps(W, rcp_N_one);
+
+#ifdef MG_FP16_PRIORS
+    __m512 P = _mm512_cvtph_ps(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(edges.P.data() + i)));
+#else
+    __m512 P = _mm512_loadu_ps(edges.P.data() + i);
+#endif
+    __m512 U = _mm512_mul_ps(_mm512_mul_ps(U_common, P), rcp_N_one);
+
+    // Widen the next sixteen legal move bytes to 32 bits each and compare
+    // against zero: lanes whose mask bit is set get the -1000 penalty.
+    __m512i legal_bits = _mm512_cvtepu8_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(legal_moves + i)));
+    __mmask16 illegal =
+        _mm512_cmpeq_epi32_mask(legal_bits, _mm512_setzero_si512());
+
+    __m512 cas = _mm512_fmadd_ps(Q, to_play, U);
+    cas = _mm512_mask_sub_ps(cas, illegal, cas, one_thousand);
+    _mm512_storeu_ps(result.data() + i, cas);
+  }
+}
+
+// Returns the widest vector instruction set supported by the CPU:
+// 0 == SSE2, 1 == AVX2, 2 == AVX-512.
+int DetectVectorLevel() {
+  if (__builtin_cpu_supports("avx512f")) {
+    return 2;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return 1;
+  }
+  return 0;
+}
+
+#endif  // MG_INTERNAL_HAVE_AVX_DISPATCH
+
+// Tree snapshot format.
+// Snapshots only store the tree's shape and edge stats: positions, zobrist
+// hashes and superko caches are all recomputed when the nodes are recreated
+// during deserialization.
+constexpr uint32_t kSnapshotMagic = 0x5347544d;  // "MTGS"
+constexpr uint32_t kSnapshotVersion = 1;
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t board_size;
+  uint32_t root_n;            // Root position's move number.
+  uint64_t root_stone_hash;   // Root position's stone hash.
+};
+
+template <typename T>
+void SnapshotWrite(const T& v, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Reads scalars & arrays out of a serialized snapshot, checking for
+// truncation.
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(absl::string_view data) : data_(data) {}
+
+  bool ReadBytes(void* dst, size_t len) {
+    if (data_.size() < len) {
+      return false;
+    }
+    memcpy(dst, data_.data(), len);
+    data_.remove_prefix(len);
+    return true;
+  }
+
+  template <typename T>
+  bool Read(T* v) {
+    return ReadBytes(v, sizeof(*v));
+  }
+
+  bool empty() const { return data_.empty(); }
+
+ private:
+  absl::string_view data_;
+};
+
+// Snapshots always store priors as fp32 so they can be exchanged between
+// builds with and without MG_FP16_PRIORS.
+void SerializePriors(const PaddedArray<MctsNode::Prior, kNumMoves>& priors,
+                     std::string* dst) {
+#ifndef MG_FP16_PRIORS
+  dst->append(reinterpret_cast<const char*>(priors.data()),
+              kNumMoves * sizeof(float));
+#else
+  std::array<float, kNumMoves> widened;
+  for (int i = 0; i < kNumMoves; ++i) {
+    widened[i] = priors[i];
+  }
+  dst->append(reinterpret_cast<const char*>(widened.data()),
+              kNumMoves * sizeof(float));
+#endif
+}
+
+bool DeserializePriors(SnapshotReader* reader,
+                       PaddedArray<MctsNode::Prior, kNumMoves>* priors) {
+#ifndef MG_FP16_PRIORS
+  return reader->ReadBytes(priors->data(), kNumMoves * sizeof(float));
+#else
+  std::array<float, kNumMoves> widened;
+  if (!reader->ReadBytes(widened.data(), kNumMoves * sizeof(float))) {
+    return false;
+  }
+  for (int i = 0; i < kNumMoves; ++i) {
+    (*priors)[i] = widened[i];
+  }
+  return true;
+#endif
+}
+
+// Appends the records for the expanded subtree rooted at `node` in pre-order:
+// the node's edge stats, then the number of expanded children, then each
+// expanded child's move followed by its own record. Unexpanded children don't
+// need records: their visit stats live in the parent's edges and SelectLeaf
+// recreates the nodes on demand.
+void SerializeNodeRecords(const MctsNode* node, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(node->edges.N.data()),
+              kNumMoves * sizeof(int32_t));
+  dst->append(reinterpret_cast<const char*>(node->edges.W.data()),
+              kNumMoves * sizeof(float));
+  SerializePriors(node->edges.P, dst);
+  SerializePriors(node->edges.original_P, dst);
+
+  uint16_t num_expanded = 0;
+  for (const auto* child : node->children) {
+    if (child->is_expanded) {
+      num_expanded += 1;
+    }
+  }
+  SnapshotWrite(num_expanded, dst);
+
+  for (const auto* child : node->children) {
+    if (child->is_expanded) {
+      SnapshotWrite(static_cast<uint16_t>(child->move), dst);
+      SerializeNodeRecords(child, dst);
+    }
+  }
+}
+
+// Inverse of SerializeNodeRecords. Returns false if the snapshot is truncated
+// or contains an invalid move.
+bool DeserializeNodeRecords(SnapshotReader* reader, MctsNode* node,
+                            Arena* arena) {
+  if (!reader->ReadBytes(node->edges.N.data(), kNumMoves * sizeof(int32_t)) ||
+      !reader->ReadBytes(node->edges.W.data(), kNumMoves * sizeof(float)) ||
+      !DeserializePriors(reader, &node->edges.P) ||
+      !DeserializePriors(reader, &node->edges.original_P)) {
+    return false;
+  }
+  node->is_expanded = true;
+
+  uint16_t num_expanded;
+  if (!reader->Read(&num_expanded)) {
+    return false;
+  }
+  for (uint16_t i = 0; i < num_expanded; ++i) {
+    uint16_t move;
+    if (!reader->Read(&move) || move >= kNumMoves) {
+      return false;
+    }
+    auto* child = node->MaybeAddChild(move, arena);
+    if (!DeserializeNodeRecords(reader, child, arena)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 absl::optional<symmetry::Symmetry> CalculateCanonicalSymmetry(
     const Position& position) {
   // TODO(tommadams): skip this check if `move` is kPass or on the diagonal.
@@ -62,52 +330,55 @@ absl::optional<symmetry::Symmetry> CalculateCanonicalSymmetry(
   // be the one with the smallest Zobrist hash. The "best" symmetry is only
   // canonical if its hash value is also unique among the hashes from the
   // other possible symmetries.
+  // Position maintains the hash of every symmetry incrementally as stones
+  // are placed and removed, so this is just a min over the eight cached
+  // values; no boards are transformed or rehashed. Element `sym` of the
+  // array is the hash of the board transformed by Inverse(sym), which is
+  // exactly the canonical symmetry convention used by InferenceCache::Key,
+  // so no final inversion is required either.
+  const auto& hashes = position.symmetric_stone_hashes();
   auto best_symmetry = symmetry::kIdentity;
-  auto best_hash = position.stone_hash();
+  auto best_hash = hashes[symmetry::kIdentity];
   bool found_unique_hash = true;
-  std::array<Stone, kN * kN> transformed;
   for (int i = 1; i < symmetry::kNumSymmetries; ++i) {
-    auto sym = static_cast<symmetry::Symmetry>(i);
-    symmetry::ApplySymmetry<kN, 1>(sym, position.stones().data(),
-                                   transformed.data());
-    auto stone_hash = Position::CalculateStoneHash(transformed);
-    if (stone_hash < best_hash) {
-      best_symmetry = sym;
-      best_hash = stone_hash;
-    } else if (stone_hash == best_hash) {
+    if (hashes[i] < best_hash) {
+      best_symmetry = static_cast<symmetry::Symmetry>(i);
+      best_hash = hashes[i];
+      found_unique_hash = true;
+    } else if (hashes[i] == best_hash) {
       found_unique_hash = false;
-      break;
     }
   }
 
   if (found_unique_hash) {
-    return symmetry::Inverse(best_symmetry);
+    return best_symmetry;
   }
   return absl::nullopt;
 }
 
-constexpr int kSuperKoCacheStride = 8;
-
-}  // namespace
-
-MctsNode::MctsNode(EdgeStats* stats, const Position& position)
+MctsNode::MctsNode(EdgeStats* stats, const Position& position, Arena* arena)
     : parent(nullptr),
       stats(stats),
+      cold(arena->New<ColdState>(position)),
       stats_idx(0),
       move(Coord::kInvalid),
       is_expanded(false),
       has_canonical_symmetry(false),
-      position(position) {}
+      to_play(position.to_play()) {
+  legal_moves = cold->position.legal_moves().data();
+}
 
-MctsNode::MctsNode(MctsNode* parent, Coord move)
+MctsNode::MctsNode(MctsNode* parent, Coord move, Arena* arena)
     : parent(parent),
       stats(&parent->edges),
+      cold(arena->New<ColdState>(parent->cold->position)),
       stats_idx(move),
       move(move),
       is_expanded(false),
       has_canonical_symmetry(parent->has_canonical_symmetry),
-      canonical_symmetry(parent->canonical_symmetry),
-      position(parent->position) {
+      canonical_symmetry(parent->canonical_symmetry) {
+  auto& position = cold->position;
+
   // TODO(tommadams): move this code into the MctsTree and only perform it
   // only if we are using an inference cache.
   if (!has_canonical_symmetry) {
@@ -124,19 +395,33 @@ MctsNode::MctsNode(MctsNode* parent, Coord move)
   ZobristHistory zobrist_history(this);
   position.PlayMove(move, position.to_play(), &zobrist_history);
 
+  // Cache the position state that selection reads into the hot node. The
+  // legality pointer stays valid because the ColdState never moves.
+  to_play = position.to_play();
+  legal_moves = position.legal_moves().data();
+
   // Insert a cache of ancestor Zobrist hashes at regular depths in the tree.
-  // See the comment for superko_cache in the mcts_node.h for more details.
+  // See the comment for SuperkoCache in mcts_tree.h for more details.
   if ((position.n() % kSuperKoCacheStride) == 0) {
-    superko_cache = absl::make_unique<SuperkoCache>();
-    superko_cache->reserve(position.n() + 1);
+    // Find the nearest ancestor cache: copy-constructing from it is much
+    // cheaper than rehashing its elements one at a time, which matters
+    // because every node at this depth builds its own cache.
+    const MctsNode* cache_node = parent;
+    while (cache_node != nullptr &&
+           cache_node->cold->superko_cache == nullptr) {
+      cache_node = cache_node->parent;
+    }
+    auto& superko_cache = cold->superko_cache;
+    if (cache_node != nullptr) {
+      superko_cache =
+          absl::make_unique<SuperkoCache>(*cache_node->cold->superko_cache);
+    } else {
+      superko_cache = absl::make_unique<SuperkoCache>();
+      superko_cache->reserve(position.n() + 1);
+    }
     superko_cache->insert(position.stone_hash());
-    for (auto* node = parent; node != nullptr; node = node->parent) {
-      if (node->superko_cache != nullptr) {
-        superko_cache->insert(node->superko_cache->begin(),
-                              node->superko_cache->end());
-        break;
-      }
-      superko_cache->insert(node->position.stone_hash());
+    for (auto* node = parent; node != cache_node; node = node->parent) {
+      superko_cache->insert(node->position().stone_hash());
     }
   }
 }
@@ -148,7 +433,7 @@ Coord MctsNode::GetMostVisitedMove(bool restrict_pass_alive) const {
   std::array<Color, kN * kN> out_of_bounds;
 
   if (restrict_pass_alive) {
-    out_of_bounds = position.CalculatePassAliveRegions();
+    out_of_bounds = position().CalculatePassAliveRegions();
   } else {
     for (auto& x : out_of_bounds) {
       x = Color::kEmpty;
@@ -180,15 +465,15 @@ Coord MctsNode::GetMostVisitedMove(bool restrict_pass_alive) const {
   }
 
   // Otherwise, break tie using the child action score.
-  float to_play = position.to_play() == Color::kBlack ? 1 : -1;
+  float to_play_scale = to_play == Color::kBlack ? 1 : -1;
   float U_common = U_scale() * std::sqrt(1.0f + N());
 
   Coord c = moves[0];
   float best_cas =
-      CalculateSingleMoveChildActionScore(to_play, U_common, moves[0]);
+      CalculateSingleMoveChildActionScore(to_play_scale, U_common, moves[0]);
   for (int i = 0; i < moves.size(); ++i) {
     float cas =
-        CalculateSingleMoveChildActionScore(to_play, U_common, moves[i]);
+        CalculateSingleMoveChildActionScore(to_play_scale, U_common, moves[i]);
     if (cas > best_cas) {
       best_cas = cas;
       c = moves[i];
@@ -214,14 +499,14 @@ std::vector<Coord> MctsNode::GetMostVisitedPath() const {
 
     path.push_back(c);
 
-    auto it = node->children.find(c);
-    if (it == node->children.end()) {
+    const auto* child = node->children.find(c);
+    if (child == nullptr) {
       // When we reach the move limit, last node will have children with visit
       // counts but no children.
       break;
     }
 
-    node = it->second.get();
+    node = child;
   }
   return path;
 }
@@ -230,9 +515,9 @@ std::string MctsNode::GetMostVisitedPathString() const {
   std::string result;
   const auto* node = this;
   for (Coord c : GetMostVisitedPath()) {
-    auto it = node->children.find(c);
-    MG_CHECK(it != node->children.end());
-    node = it->second.get();
+    const auto* child = node->children.find(c);
+    MG_CHECK(child != nullptr);
+    node = child;
     absl::StrAppendFormat(&result, "%s (%d) ==> ", node->move.ToGtp(),
                           node->N());
   }
@@ -241,9 +526,12 @@ std::string MctsNode::GetMostVisitedPathString() const {
 }
 
 void MctsNode::PruneChildren(Coord c) {
-  auto child = std::move(children[c]);
+  // Nodes are owned by the tree's arena, so there's nothing to free here:
+  // the discarded subtrees are reclaimed in bulk when the arena is reset.
+  auto* child = children.find(c);
+  MG_DCHECK(child != nullptr);
   children.clear();
-  children[c] = std::move(child);
+  children.insert(c, child);
 }
 
 void MctsNode::ClearChildren() {
@@ -254,9 +542,19 @@ void MctsNode::ClearChildren() {
   is_expanded = false;
 }
 
-// Vectorized version of CalculateChildActionScore.
-void MctsNode::CalculateChildActionScoreSse(PaddedSpan<float> result) const {
-  __m128 to_play = _mm_set_ps1(position.to_play() == Color::kBlack ? 1 : -1);
+void MctsNode::CalculateChildActionScoreSimd(PaddedSpan<float> result) const {
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const int vector_level = DetectVectorLevel();
+  if (vector_level == 2) {
+    return CalculateChildActionScoreAvx512(*this, result);
+  }
+  if (vector_level == 1) {
+    return CalculateChildActionScoreAvx2(*this, result);
+  }
+#endif
+
+  // SSE2 fallback.
+  __m128 to_play_v = _mm_set_ps1(to_play == Color::kBlack ? 1 : -1);
   __m128 U_common =
       _mm_set_ps1(U_scale() * std::sqrt(std::max<float>(1, N() - 1)));
 
@@ -277,14 +575,21 @@ void MctsNode::CalculateChildActionScoreSse(PaddedSpan<float> result) const {
     __m128 Q = _mm_mul_ps(W, rcp_N_one);
 
     // `U = U_common * child_P(i) / (1 + child_N(i))`
+#ifdef MG_FP16_PRIORS
+    // F16C isn't part of the SSE2 baseline: widen the four priors in scalar
+    // code instead.
+    __m128 P = _mm_set_ps(edges.P[i + 3], edges.P[i + 2], edges.P[i + 1],
+                          edges.P[i]);
+#else
     __m128 P = _mm_loadu_ps(edges.P.data() + i);
+#endif
     __m128 U = _mm_mul_ps(_mm_mul_ps(U_common, P), rcp_N_one);
 
-    // `legal_bits = position.legal_move(i)`
+    // `legal_bits = legal_move(i)`
     // This requires a few instructions to load the legal move bytes and
     // shuffle them into each of the four vector slots.
     __m128i legal_bits = _mm_loadu_si128(
-        reinterpret_cast<const __m128i*>(position.legal_moves().data() + i));
+        reinterpret_cast<const __m128i*>(legal_moves + i));
     legal_bits = _mm_unpacklo_epi8(legal_bits, _mm_setzero_si128());
     legal_bits = _mm_unpacklo_epi16(legal_bits, _mm_setzero_si128());
 
@@ -294,31 +599,29 @@ void MctsNode::CalculateChildActionScoreSse(PaddedSpan<float> result) const {
     legal = _mm_and_ps(legal, one_thousand);
 
     // `child_action_score[i] = Q * to_play + U - legal`
-    __m128 cas = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(Q, to_play), U), legal);
+    __m128 cas = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(Q, to_play_v), U), legal);
     _mm_storeu_ps(result.data() + i, cas);
   }
 }
 
 std::array<float, kNumMoves> MctsNode::CalculateChildActionScore() const {
-  float to_play = position.to_play() == Color::kBlack ? 1 : -1;
+  float to_play_scale = to_play == Color::kBlack ? 1 : -1;
   float U_common = U_scale() * std::sqrt(std::max<float>(1, N() - 1));
 
   std::array<float, kNumMoves> result;
   for (int i = 0; i < kNumMoves; ++i) {
-    result[i] = CalculateSingleMoveChildActionScore(to_play, U_common, i);
+    result[i] = CalculateSingleMoveChildActionScore(to_play_scale, U_common, i);
   }
   return result;
 }
 
-MctsNode* MctsNode::MaybeAddChild(Coord c) {
-  auto it = children.find(c);
-  if (it == children.end()) {
-    // TODO(tommadams): Allocate children out of a custom block allocator: we
-    // spend about 5% of our runtme inside MctsNode::PruneChildren freeing
-    // nodes.
-    it = children.emplace(c, absl::make_unique<MctsNode>(this, c)).first;
+MctsNode* MctsNode::MaybeAddChild(Coord c, Arena* arena) {
+  auto* child = children.find(c);
+  if (child == nullptr) {
+    child = arena->New<MctsNode>(this, c, arena);
+    children.insert(c, child);
   }
-  return it->second.get();
+  return child;
 }
 
 std::string MctsTree::Stats::ToString() const {
@@ -334,40 +637,144 @@ std::ostream& operator<<(std::ostream& os, const MctsTree::Options& options) {
   return os << "value_init_penalty:" << options.value_init_penalty
             << " policy_softmax_temp:" << options.policy_softmax_temp
             << " soft_pick_enabled:" << options.soft_pick_enabled
-            << " soft_pick_cutoff:" << options.soft_pick_cutoff;
+            << " soft_pick_cutoff:" << options.soft_pick_cutoff
+            << " use_transposition_table:" << options.use_transposition_table
+            << " undo_pool_size:" << options.undo_pool_size;
 }
 
 MctsTree::MctsTree(const Position& position, const Options& options)
-    : game_root_(&game_root_stats_, position), options_(options) {
+    : game_root_(&game_root_stats_, position, &arena_), options_(options) {
   root_ = &game_root_;
 }
 
+void MctsTree::Reset(const Position& position) {
+  // The transposition table's entries are allocated from the arena, so the
+  // table must be cleared before the arena is, and any preserved subtrees
+  // are about to dangle.
+  transposition_table_.clear();
+  undo_pool_.clear();
+  arena_.Reset(/*keep_blocks=*/true);
+  game_root_stats_ = MctsNode::EdgeStats();
+  game_root_ = MctsNode(&game_root_stats_, position, &arena_);
+  root_ = &game_root_;
+  history_head_ = 0;
+  history_len_ = 0;
+}
+
+void MctsTree::Compact() {
+  auto snapshot = SerializeSnapshot();
+
+  // The root's ancestors are about to be freed, so give the new root a
+  // superko cache holding the hash of every position played to reach it:
+  // legality checks must not depend on the ancestor chain afterwards.
+  auto superko_cache = absl::make_unique<MctsNode::SuperkoCache>();
+  const MctsNode* cache_node = root_;
+  while (cache_node != nullptr && cache_node->cold->superko_cache == nullptr) {
+    cache_node = cache_node->parent;
+  }
+  if (cache_node != nullptr) {
+    *superko_cache = *cache_node->cold->superko_cache;
+  } else {
+    superko_cache->reserve(root_->position().n() + 1);
+  }
+  for (const auto* node = root_; node != cache_node; node = node->parent) {
+    superko_cache->insert(node->position().stone_hash());
+  }
+
+  auto position = root_->position();
+  bool has_canonical_symmetry = root_->has_canonical_symmetry;
+  auto canonical_symmetry = root_->canonical_symmetry;
+
+  // The transposition table's entries are allocated from the arena, so the
+  // table must be cleared before the arena is, and any preserved subtrees
+  // are about to dangle. Unlike Reset, the arena's blocks are freed rather
+  // than retained: returning memory is the point.
+  transposition_table_.clear();
+  undo_pool_.clear();
+  arena_.Reset(/*keep_blocks=*/false);
+  game_root_stats_ = MctsNode::EdgeStats();
+  game_root_ = MctsNode(&game_root_stats_, position, &arena_);
+  game_root_.has_canonical_symmetry = has_canonical_symmetry;
+  game_root_.canonical_symmetry = canonical_symmetry;
+  game_root_.cold->superko_cache = std::move(superko_cache);
+  root_ = &game_root_;
+
+  // The snapshot was taken at the position the tree is now rooted at, so
+  // deserialization can only fail if snapshotting itself is broken.
+  MG_CHECK(DeserializeSnapshot(snapshot));
+}
+
+void MctsTree::GetStoneHistory(const MctsNode* leaf, ModelInput* input) const {
+  input->position = &leaf->position();
+
+  auto& history = input->stone_history;
+  history.clear();
+
+  // Nodes from the leaf up to the root supply their own stones.
+  const auto* node = leaf;
+  for (;;) {
+    history.push_back(&node->position().stone_snapshot());
+    if (history.size() == history.capacity() || node == root_) {
+      break;
+    }
+    node = node->parent;
+  }
+
+  // Positions played before the root come from the ring buffer, newest
+  // first.
+  const int ring_size = static_cast<int>(history_ring_.size());
+  for (int i = 0; history.size() < history.capacity() && i < history_len_;
+       ++i) {
+    history.push_back(
+        &history_ring_[(history_head_ + ring_size - 1 - i) % ring_size]);
+  }
+}
+
 MctsNode* MctsTree::SelectLeaf(bool allow_pass) {
   auto* node = root_;
   for (;;) {
     // If a node has never been evaluated, we have no basis to select a child.
     if (!node->is_expanded) {
+      // If a transposed copy of this position has already been evaluated,
+      // expand the node from the transposition table and keep selecting: the
+      // inference would be identical, so there's no point running it again.
+      if (options_.use_transposition_table && !node->game_over()) {
+        auto it = transposition_table_.find(InferenceCache::Key(
+            node->move, symmetry::kIdentity, node->position()));
+        if (it != transposition_table_.end()) {
+          const auto* entry = it->second;
+          IncorporateResults(
+              node, absl::MakeConstSpan(entry->P.data(), kNumMoves),
+              entry->value);
+          continue;
+        }
+      }
       return node;
     }
 
     PaddedArray<float, kNumMoves> child_action_score;
-    node->CalculateChildActionScoreSse(child_action_score);
+    node->CalculateChildActionScoreSimd(child_action_score);
     if (!allow_pass) {
       child_action_score[Coord::kPass] = -100000;
     }
 
-    Coord best_move = ArgMaxSse(child_action_score);
-    if (!node->position.legal_move(best_move)) {
+    Coord best_move = ArgMaxSimd(child_action_score);
+    if (!node->legal_move(best_move)) {
       best_move = Coord::kPass;
     }
 
-    node = node->MaybeAddChild(best_move);
+    node = node->MaybeAddChild(best_move, &arena_);
   }
 }
 
+MctsNode* MctsTree::MaybeAddRootChild(Coord c) {
+  MG_CHECK(root_->legal_move(c));
+  return root_->MaybeAddChild(c, &arena_);
+}
+
 Coord MctsTree::PickMove(Random* rnd, bool restrict_pass_alive) const {
   if (options_.soft_pick_enabled &&
-      root_->position.n() < options_.soft_pick_cutoff) {
+      root_->position().n() < options_.soft_pick_cutoff) {
     return SoftPickMove(rnd);
   } else {
     return PickMostVisitedMove(restrict_pass_alive);
@@ -377,12 +784,100 @@ Coord MctsTree::PickMove(Random* rnd, bool restrict_pass_alive) const {
 void MctsTree::PlayMove(Coord c) {
   MG_CHECK(!is_game_over() && is_legal_move(c))
       << c << " " << is_game_over() << " " << is_legal_move(c);
-  root_ = root_->MaybeAddChild(c);
+
+  // Record the stones of the position we're leaving: once the root advances,
+  // inference inputs take their above-root stone history from the ring
+  // instead of walking the ancestor chain.
+  const int ring_size = static_cast<int>(history_ring_.size());
+  history_ring_[history_head_] = root_->position().stone_snapshot();
+  history_head_ = (history_head_ + 1) % ring_size;
+  history_len_ = std::min(history_len_ + 1, ring_size);
+
+  auto* parent = root_;
+  root_ = parent->MaybeAddChild(c, &arena_);
+  if (options_.undo_pool_size > 0) {
+    // Stash the departing sibling lines before PruneChildren drops the only
+    // pointers to them.
+    for (auto* const* it = parent->children.begin();
+         it != parent->children.end(); ++it) {
+      if (*it != root_) {
+        StashSubtree(*it);
+      }
+    }
+  }
   // Don't need to keep the parent's children around anymore because we'll
   // never revisit them during normal play.
   // TODO(tommadams): we should just delete all ancestors. This will require
   // changes to UndoMove though.
-  root_->parent->PruneChildren(c);
+  parent->PruneChildren(c);
+  if (options_.undo_pool_size > 0) {
+    MaybeReattachSubtree();
+  }
+}
+
+zobrist::Hash MctsTree::UndoPoolKey(const Position& position) {
+  return position.stone_hash() ^ zobrist::ToPlayHash(position.to_play());
+}
+
+void MctsTree::StashSubtree(MctsNode* node) {
+  if (node->N() == 0) {
+    // An unvisited node carries no search worth preserving.
+    return;
+  }
+
+  auto age = undo_pool_age_++;
+  undo_pool_[UndoPoolKey(node->position())] = {node, age};
+
+  while (undo_pool_.size() > static_cast<size_t>(options_.undo_pool_size)) {
+    // The pool is small, so a linear scan for the LRU entry is cheaper than
+    // maintaining an eviction list.
+    auto lru = undo_pool_.begin();
+    for (auto it = undo_pool_.begin(); it != undo_pool_.end(); ++it) {
+      if (it->second.age < lru->second.age) {
+        lru = it;
+      }
+    }
+    undo_pool_.erase(lru);
+  }
+}
+
+void MctsTree::MaybeReattachSubtree() {
+  auto it = undo_pool_.find(UndoPoolKey(root_->position()));
+  if (it == undo_pool_.end()) {
+    return;
+  }
+  auto* candidate = it->second.node;
+  undo_pool_.erase(it);
+
+  // The pool is keyed on a hash, so make sure the stashed subtree really is
+  // rooted at this position (including ko and the move that reached it:
+  // both feed the model's input features) and that it's richer than
+  // whatever search the current root has accumulated since.
+  const auto& position = root_->position();
+  const auto& stashed = candidate->position();
+  if (candidate->move != root_->move || stashed.n() != position.n() ||
+      stashed.to_play() != position.to_play() ||
+      stashed.ko() != position.ko() ||
+      !(stashed.stone_snapshot().black == position.stone_snapshot().black) ||
+      !(stashed.stone_snapshot().white == position.stone_snapshot().white) ||
+      candidate->N() <= root_->N()) {
+    return;
+  }
+
+  // Splice the stashed subtree in where the current root sits. The node's
+  // own (N, W) live in its parent's edges, so they're carried over to the
+  // new parent explicitly; everything below the node is self-contained.
+  auto n = candidate->N();
+  auto w = candidate->W();
+  auto* parent = root_->parent;
+  candidate->parent = parent;
+  candidate->stats = &parent->edges;
+  candidate->stats_idx = root_->stats_idx;
+  parent->edges.N[candidate->stats_idx] = n;
+  parent->edges.W[candidate->stats_idx] = w;
+  parent->children.clear();
+  parent->children.insert(candidate->move, candidate);
+  root_ = candidate;
 }
 
 void MctsTree::AddVirtualLoss(MctsNode* leaf) {
@@ -390,7 +885,7 @@ void MctsTree::AddVirtualLoss(MctsNode* leaf) {
   for (;;) {
     ++node->num_virtual_losses_applied;
     node->stats->W[node->stats_idx] +=
-        node->position.to_play() == Color::kBlack ? 1 : -1;
+        node->to_play == Color::kBlack ? 1 : -1;
     if (node == root_) {
       return;
     }
@@ -403,7 +898,7 @@ void MctsTree::RevertVirtualLoss(MctsNode* leaf) {
   for (;;) {
     --node->num_virtual_losses_applied;
     node->stats->W[node->stats_idx] -=
-        node->position.to_play() == Color::kBlack ? 1 : -1;
+        node->to_play == Color::kBlack ? 1 : -1;
     if (node == root_) {
       return;
     }
@@ -414,6 +909,46 @@ void MctsTree::RevertVirtualLoss(MctsNode* leaf) {
 void MctsTree::IncorporateResults(MctsNode* leaf,
                                   absl::Span<const float> move_probabilities,
                                   float value) {
+  if (ExpandLeaf(leaf, move_probabilities, value)) {
+    BackupValue(leaf, value);
+  }
+}
+
+void MctsTree::IncorporateResultsBatch(
+    absl::Span<MctsNode* const> leaves,
+    absl::Span<const ModelOutput* const> outputs) {
+  MG_CHECK(leaves.size() == outputs.size());
+
+  // Accumulate each backed-up leaf's (W, N) delta along its path to the
+  // root. Nodes shared by several paths end up with a single accumulated
+  // delta instead of being read and written once per leaf.
+  backup_deltas_.clear();
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    auto* leaf = leaves[i];
+    const auto& output = *outputs[i];
+    if (!ExpandLeaf(leaf, output.policy, output.value)) {
+      continue;
+    }
+    for (auto* node = leaf;; node = node->parent) {
+      auto& delta = backup_deltas_[node];
+      delta.first += output.value;
+      delta.second += 1;
+      if (node == root_) {
+        break;
+      }
+    }
+  }
+
+  for (const auto& kv : backup_deltas_) {
+    auto* node = kv.first;
+    node->stats->W[node->stats_idx] += kv.second.first;
+    node->stats->N[node->stats_idx] += kv.second.second;
+  }
+}
+
+bool MctsTree::ExpandLeaf(MctsNode* leaf,
+                          absl::Span<const float> move_probabilities,
+                          float value) {
   MG_DCHECK(move_probabilities.size() == kNumMoves);
   // A finished game should not be going through this code path, it should
   // directly call BackupValue on the result of the game.
@@ -422,12 +957,12 @@ void MctsTree::IncorporateResults(MctsNode* leaf,
   // If the node has already been selected for the next inference batch, we
   // shouldn't 'expand' it again.
   if (leaf->is_expanded) {
-    return;
+    return false;
   }
 
   float policy_scalar = 0;
   for (int i = 0; i < kNumMoves; ++i) {
-    if (leaf->position.legal_move(i)) {
+    if (leaf->legal_move(i)) {
       policy_scalar += move_probabilities[i];
     }
   }
@@ -461,15 +996,14 @@ void MctsTree::IncorporateResults(MctsNode* leaf,
   //      We think of this as saying "Only a small number of moves work don't
   //      get distracted"
   float reduction = options_.value_init_penalty *
-                    (leaf->position.to_play() == Color::kBlack ? 1 : -1);
+                    (leaf->to_play == Color::kBlack ? 1 : -1);
   float reduced_value = std::min(1.0f, std::max(-1.0f, value - reduction));
 
   leaf->is_expanded = true;
   for (int i = 0; i < kNumMoves; ++i) {
     // Zero out illegal moves, and re-normalize move_probabilities.
-    float move_prob = leaf->position.legal_move(i)
-                          ? policy_scalar * move_probabilities[i]
-                          : 0;
+    float move_prob =
+        leaf->legal_move(i) ? policy_scalar * move_probabilities[i] : 0;
 
     leaf->edges.original_P[i] = leaf->edges.P[i] = move_prob;
 
@@ -485,7 +1019,27 @@ void MctsTree::IncorporateResults(MctsNode* leaf,
     // assign.
     leaf->edges.W[i] += reduced_value;
   }
-  BackupValue(leaf, value);
+
+  // Record the evaluation in the transposition table so that other move
+  // orders that reach the same position can reuse it. The first evaluation
+  // of a position wins. The entry stores the raw inference priors rather
+  // than the normalized edges so that a node expanded from the table runs
+  // exactly the same normalization arithmetic as the node that created the
+  // entry, making their priors bitwise identical.
+  if (options_.use_transposition_table) {
+    InferenceCache::Key key(leaf->move, symmetry::kIdentity, leaf->position());
+    auto it = transposition_table_.find(key);
+    if (it == transposition_table_.end()) {
+      auto* entry = arena_.New<TranspositionEntry>();
+      for (int i = 0; i < kNumMoves; ++i) {
+        entry->P[i] = move_probabilities[i];
+      }
+      entry->value = value;
+      transposition_table_.emplace(key, entry);
+    }
+  }
+
+  return true;
 }
 
 void MctsTree::IncorporateEndGameResult(MctsNode* leaf, float value) {
@@ -515,7 +1069,7 @@ void MctsTree::InjectNoise(const std::array<float, kNumMoves>& noise,
 
   float scalar = 0;
   for (int i = 0; i < kNumMoves; ++i) {
-    if (root_->position.legal_move(i)) {
+    if (root_->legal_move(i)) {
       scalar += noise[i];
     }
   }
@@ -525,8 +1079,7 @@ void MctsTree::InjectNoise(const std::array<float, kNumMoves>& noise,
   }
 
   for (int i = 0; i < kNumMoves; ++i) {
-    float scaled_noise =
-        scalar * (root_->position.legal_move(i) ? noise[i] : 0);
+    float scaled_noise = scalar * (root_->legal_move(i) ? noise[i] : 0);
     root_->edges.P[i] = (1 - mix) * root_->edges.P[i] + mix * scaled_noise;
   }
 }
@@ -537,9 +1090,10 @@ void MctsTree::ReshapeFinalVisits(bool restrict_pass_alive) {
   // reshape based on its action score.
   Coord best = root_->GetMostVisitedMove(false);
   MG_CHECK(root_->edges.N[best] > 0);
-  auto pass_alive_regions = root_->position.CalculatePassAliveRegions();
+  const auto& pass_alive_regions =
+      root_->position().CalculatePassAliveRegions();
   float U_common = root_->U_scale() * std::sqrt(1.0f + root_->N());
-  float to_play = root_->position.to_play() == Color::kBlack ? 1 : -1;
+  float to_play = root_->to_play == Color::kBlack ? 1 : -1;
   float best_cas = root_->CalculateSingleMoveChildActionScore(to_play, U_common,
                                                               uint16_t(best));
 
@@ -590,7 +1144,7 @@ void MctsTree::ReshapeFinalVisits(bool restrict_pass_alive) {
 std::array<float, kNumMoves> MctsTree::CalculateSearchPi() const {
   std::array<float, kNumMoves> search_pi;
   if (options_.soft_pick_enabled &&
-      root_->position.n() < options_.soft_pick_cutoff) {
+      root_->position().n() < options_.soft_pick_cutoff) {
     // Squash counts before normalizing to match softpick behavior in PickMove.
     for (int i = 0; i < kNumMoves; ++i) {
       search_pi[i] = std::pow(root_->child_N(i), options_.policy_softmax_temp);
@@ -622,8 +1176,8 @@ MctsTree::Stats MctsTree::CalculateStats() const {
     stats.max_depth = std::max(depth, stats.max_depth);
     stats.depth_sum += depth;
 
-    for (const auto& child : node.children) {
-      traverse(*child.second.get(), depth + 1);
+    for (const auto* child : node.children) {
+      traverse(*child, depth + 1);
     }
   };
 
@@ -687,12 +1241,75 @@ bool MctsTree::UndoMove() {
     return false;
   }
   root_ = root_->parent;
+
+  // Rebuild the history ring from the ancestors of the restored root, which
+  // are still in the tree (see the TODO in PlayMove).
+  const int ring_size = static_cast<int>(history_ring_.size());
+  history_head_ = 0;
+  history_len_ = 0;
+  inline_vector<const MctsNode*, kMaxPositionHistory> ancestors;
+  for (const auto* node = root_->parent;
+       node != nullptr && ancestors.size() < ancestors.capacity();
+       node = node->parent) {
+    ancestors.push_back(node);
+  }
+  for (int i = ancestors.size() - 1; i >= 0; --i) {
+    history_ring_[history_head_] = ancestors[i]->position().stone_snapshot();
+    history_head_ = (history_head_ + 1) % ring_size;
+    ++history_len_;
+  }
+  return true;
+}
+
+std::string MctsTree::SerializeSnapshot() const {
+  SnapshotHeader header;
+  header.magic = kSnapshotMagic;
+  header.version = kSnapshotVersion;
+  header.board_size = kN;
+  header.root_n = root_->position().n();
+  header.root_stone_hash = root_->position().stone_hash();
+
+  std::string result;
+  SnapshotWrite(header, &result);
+
+  // The root's own stats live in its parent's edges; serialize them explicitly
+  // so that N() and Q() of the restored root match the original.
+  SnapshotWrite(root_->N(), &result);
+  SnapshotWrite(root_->W(), &result);
+
+  SerializeNodeRecords(root_, &result);
+  return result;
+}
+
+bool MctsTree::DeserializeSnapshot(absl::string_view data) {
+  SnapshotReader reader(data);
+  SnapshotHeader header;
+  if (!reader.Read(&header) || header.magic != kSnapshotMagic ||
+      header.version != kSnapshotVersion || header.board_size != kN ||
+      header.root_n != static_cast<uint32_t>(root_->position().n()) ||
+      header.root_stone_hash != root_->position().stone_hash()) {
+    return false;
+  }
+
+  int32_t root_n;
+  float root_w;
+  if (!reader.Read(&root_n) || !reader.Read(&root_w)) {
+    return false;
+  }
+
+  root_->ClearChildren();
+  if (!DeserializeNodeRecords(&reader, root_, &arena_) || !reader.empty()) {
+    root_->ClearChildren();
+    return false;
+  }
+  root_->stats->N[root_->stats_idx] = root_n;
+  root_->stats->W[root_->stats_idx] = root_w;
   return true;
 }
 
 Coord MctsTree::PickMostVisitedMove(bool restrict_pass_alive) const {
   auto c = root_->GetMostVisitedMove(restrict_pass_alive);
-  if (!root_->position.legal_move(c)) {
+  if (!root_->legal_move(c)) {
     c = Coord::kPass;
   }
   return c;
@@ -15,6 +15,7 @@
 #ifndef CC_MCTS_TREE_H_
 #define CC_MCTS_TREE_H_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <cstdint>
@@ -22,14 +23,20 @@
 #include <ostream>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "cc/arena.h"
 #include "cc/constants.h"
+#include "cc/half.h"
 #include "cc/inline_vector.h"
+#include "cc/model/inference_cache.h"
 #include "cc/padded_array.h"
 #include "cc/position.h"
 #include "cc/random.h"
@@ -38,24 +45,120 @@
 
 namespace minigo {
 
+class MctsNode;
+
+// Returns the symmetry with the smallest of the position's eight symmetric
+// Zobrist hashes, or nullopt if that smallest hash isn't unique. This is the
+// canonical symmetry convention used by InferenceCache::Key; MctsNode
+// computes it lazily along the game path and it's exposed here so that
+// offline tools (e.g. the cache pack builder) can derive the same keys that
+// selfplay will look up.
+absl::optional<symmetry::Symmetry> CalculateCanonicalSymmetry(
+    const Position& position);
+
+// Cache-friendly index of a node's expanded children: a sorted array of moves
+// with a parallel array of child pointers. Lookups during the selection loop
+// are a binary search over a small contiguous uint16 array instead of a hash
+// probe over scattered buckets.
+class ChildIndex {
+ public:
+  bool empty() const { return moves_.empty(); }
+  size_t size() const { return moves_.size(); }
+  int count(Coord c) const { return find(c) != nullptr ? 1 : 0; }
+
+  // Returns the child node for move c, or nullptr if c hasn't been expanded.
+  MctsNode* find(Coord c) const {
+    auto it = std::lower_bound(moves_.begin(), moves_.end(), c);
+    return (it != moves_.end() && *it == c) ? nodes_[it - moves_.begin()]
+                                            : nullptr;
+  }
+
+  // Inserts the (move, node) pair. The move must not already be present.
+  void insert(Coord c, MctsNode* node) {
+    auto it = std::lower_bound(moves_.begin(), moves_.end(), c);
+    nodes_.insert(nodes_.begin() + (it - moves_.begin()), node);
+    moves_.insert(it, c);
+  }
+
+  void clear() {
+    moves_.clear();
+    nodes_.clear();
+  }
+
+  // Iterates over child nodes in move order.
+  MctsNode* const* begin() const { return nodes_.data(); }
+  MctsNode* const* end() const { return nodes_.data() + nodes_.size(); }
+
+  // The sorted moves of the expanded children.
+  const std::vector<Coord>& moves() const { return moves_; }
+
+ private:
+  std::vector<Coord> moves_;
+  std::vector<MctsNode*> nodes_;
+};
+
 class MctsNode {
   friend class MctsTree;
 
  public:
-  // MctsNode::CalculateChildActionScoreSse requires that the arrays in
-  // EdgeStats are padded to a multiple of 16 bytes.
+  // The storage type of the P and original_P prior arrays. Priors are
+  // probabilities in [0, 1], which half precision represents with ample
+  // accuracy, so building with --define=fp16_priors=1 stores them as fp16 and
+  // cuts EdgeStats from ~16 to ~10 bytes per move: deep searches fit in cache
+  // and RAM budgets that full floats blow. The vectorized action score
+  // kernels widen fp16 priors during the load; everything else goes through
+  // HalfFloat's implicit float conversions.
+#ifdef MG_FP16_PRIORS
+  using Prior = HalfFloat;
+#else
+  using Prior = float;
+#endif
+
+  // MctsNode::CalculateChildActionScoreSimd requires that the arrays in
+  // EdgeStats are padded to a multiple of the widest supported vector size
+  // (64 bytes for AVX-512).
   struct EdgeStats {
     PaddedArray<int32_t, kNumMoves> N{};
     PaddedArray<float, kNumMoves> W{};
-    PaddedArray<float, kNumMoves> P{};
-    PaddedArray<float, kNumMoves> original_P{};
+    PaddedArray<Prior, kNumMoves> P{};
+    PaddedArray<Prior, kNumMoves> original_P{};
+  };
+
+  // Each position contains a Zobrist hash of its stones, which can be used for
+  // superko detection. In order to accelerate superko detection, caches of all
+  // ancestor positions are added at regular depths in the search tree. This
+  // reduces superko detection time complexity from O(N) to O(1).
+  //
+  // If non-null, ColdState::superko_cache contains the Zobrist hash of all
+  // positions played to this position, including position().stone_hash().
+  // If null, clients should determine whether a position has appeared before
+  // during the game by walking up the tree (via the parent pointer), checking
+  // the position().stone_hash() of each node visited, until a node is found
+  // that contains a non-null superko cache.
+  using SuperkoCache = absl::flat_hash_set<zobrist::Hash>;
+
+  // Per-node state that selection descents never touch: the full board
+  // position and the superko bookkeeping. It lives in a separate arena
+  // allocation so the node itself holds only the selection-hot fields and
+  // the edge arrays; a descent through a node no longer drags the ~2KB of
+  // cold position state through the cache on its way to the edges. The hot
+  // node caches the two pieces of position state selection does need:
+  // `to_play` and a pointer to the position's legal move array.
+  struct ColdState {
+    explicit ColdState(const Position& position) : position(position) {}
+
+    Position position;
+    std::unique_ptr<SuperkoCache> superko_cache;
   };
 
-  // Constructor for root node in the tree.
-  MctsNode(EdgeStats* stats, const Position& position);
+  // Constructor for root node in the tree. The node's ColdState is
+  // allocated from `arena`.
+  MctsNode(EdgeStats* stats, const Position& position, Arena* arena);
 
   // Constructor for child nodes.
-  MctsNode(MctsNode* parent, Coord move);
+  MctsNode(MctsNode* parent, Coord move, Arena* arena);
+
+  const Position& position() const { return cold->position; }
 
   int N() const { return stats->N[stats_idx]; }
   float W() const { return stats->W[stats_idx]; }
@@ -63,7 +166,7 @@ class MctsNode {
   float original_P() const { return stats->original_P[stats_idx]; }
   float Q() const { return W() / (1 + N()); }
   float Q_perspective() const {
-    return position.to_play() == Color::kBlack ? Q() : -Q();
+    return to_play == Color::kBlack ? Q() : -Q();
   }
   float U_scale() const {
     return 2.0 * (std::log((1.0f + N() + kUct_base) / kUct_base) + kUct_init);
@@ -99,16 +202,32 @@ class MctsNode {
 
   std::array<float, kNumMoves> CalculateChildActionScore() const;
 
-  void CalculateChildActionScoreSse(PaddedSpan<float> result) const;
+  // Vectorized version of CalculateChildActionScore that dispatches at
+  // runtime to the widest instruction set the CPU supports (SSE2, AVX2 or
+  // AVX-512).
+  void CalculateChildActionScoreSimd(PaddedSpan<float> result) const;
 
-  float CalculateSingleMoveChildActionScore(float to_play, float U_common,
-                                            int i) const {
+  float CalculateSingleMoveChildActionScore(float to_play_scale,
+                                            float U_common, int i) const {
     float Q = child_Q(i);
     float U = U_common * child_P(i) / (1 + child_N(i));
-    return Q * to_play + U - 1000.0f * !position.legal_move(i);
+    return Q * to_play_scale + U - 1000.0f * !legal_moves[i];
   }
 
-  MctsNode* MaybeAddChild(Coord c);
+  // Same as position().legal_move(c), but reads the hot node's cached
+  // pointer to the legality array instead of touching the cold position.
+  bool legal_move(Coord c) const {
+    MG_DCHECK(c < kNumMoves);
+    return legal_moves[c] != 0;
+  }
+
+  // Returns the child node for move c, allocating it from `arena` if it
+  // doesn't exist yet.
+  MctsNode* MaybeAddChild(Coord c, Arena* arena);
+
+  // The fields below up to `edges` are the node's hot record: everything a
+  // selection descent reads fits in the first couple of cache lines, followed
+  // directly by the edge arrays the action score kernel streams through.
 
   // Parent node.
   MctsNode* parent;
@@ -116,6 +235,15 @@ class MctsNode {
   // Stats for the edge from parent to this.
   EdgeStats* stats;
 
+  // Cached pointer to cold->position's legal move array, so the action score
+  // kernel and SelectLeaf don't touch the cold position. The pointer stays
+  // valid because ColdState is arena-allocated and never moves.
+  const uint8_t* legal_moves;
+
+  // Cold state: the full position and superko bookkeeping, touched when the
+  // node is created or expanded but not during selection.
+  ColdState* cold;
+
   // Index into `stats` for this node's stats.
   // This is the same as `move` for all nodes except the game root node; the
   // game root's `stats_idx` is initiliazed to 0 because its `move` is
@@ -138,30 +266,18 @@ class MctsNode {
   // etc.
   symmetry::Symmetry canonical_symmetry = symmetry::kIdentity;
 
-  EdgeStats edges;
-
-  // Map from move to resulting MctsNode.
-  absl::flat_hash_map<Coord, std::unique_ptr<MctsNode>> children;
-
-  // Current board position.
-  Position position;
+  // Cached position().to_play(), hot in the action score and value backup.
+  Color to_play;
 
   // Number of virtual losses on this node.
   int num_virtual_losses_applied = 0;
 
-  // Each position contains a Zobrist hash of its stones, which can be used for
-  // superko detection. In order to accelerate superko detection, caches of all
-  // ancestor positions are added at regular depths in the search tree. This
-  // reduces superko detection time complexity from O(N) to O(1).
-  //
-  // If non-null, superko_cache contains the Zobrist hash of all positions
-  // played to this position, including position.stone_hash().
-  // If null, clients should determine whether a position has appeared before
-  // during the game by walking up the tree (via the parent pointer), checking
-  // the position.stone_hash() of each node visited, until a node is found that
-  // contains a non-null superko_cache.
-  using SuperkoCache = absl::flat_hash_set<zobrist::Hash>;
-  std::unique_ptr<SuperkoCache> superko_cache;
+  // Index from move to resulting MctsNode.
+  // Child nodes are owned by the tree's arena, not by their parent: they are
+  // destroyed in bulk when the arena is reset.
+  ChildIndex children;
+
+  EdgeStats edges;
 };
 
 class MctsTree {
@@ -199,6 +315,22 @@ class MctsTree {
     // number of softpicks.
     int soft_pick_cutoff = ((kN * kN / 12) / 2) * 2;
 
+    // If true, the tree keeps a transposition table of evaluated positions.
+    // When SelectLeaf reaches a leaf whose position was already evaluated via
+    // a different move order, the leaf's priors and value are taken from the
+    // table instead of requiring another inference, and selection continues
+    // deeper into the tree.
+    bool use_transposition_table = false;
+
+    // If > 0, up to this many subtrees abandoned when the root moves onto a
+    // sibling line (the other children are normally pruned by PlayMove) are
+    // kept in an LRU pool keyed by position, and reattached when navigation
+    // returns to their position. Interactive analysis that bounces between
+    // variations via undo then resumes each line's accumulated search
+    // instead of starting over. Intended for GTP use; selfplay never
+    // revisits abandoned lines.
+    int undo_pool_size = 0;
+
     friend std::ostream& operator<<(std::ostream& ios, const Options& options);
   };
 
@@ -206,9 +338,9 @@ class MctsTree {
 
   const MctsNode* root() const { return root_; }
 
-  Color to_play() const { return root_->position.to_play(); }
+  Color to_play() const { return root_->to_play; }
   bool is_game_over() const { return root_->game_over(); }
-  bool is_legal_move(Coord c) const { return root_->position.legal_move(c); }
+  bool is_legal_move(Coord c) const { return root_->legal_move(c); }
 
   // Selects the next leaf node for inference.
   // If inference is being batched and SelectLeaf chooses a node that has
@@ -216,6 +348,20 @@ class MctsTree {
   // called), then SelectLeaf will return that same node.
   MctsNode* SelectLeaf(bool allow_pass);
 
+  // Fills `input` with `leaf`'s position and pointers to the packed stones
+  // of the positions leading up to it, newest first. Nodes between `leaf`
+  // and the root supply their own stones; earlier positions come from the
+  // tree's ring buffer of played moves, so assembling inference inputs
+  // doesn't depend on the root's ancestor chain being kept alive.
+  void GetStoneHistory(const MctsNode* leaf, ModelInput* input) const;
+
+  // Returns the root's child for move `c`, adding an unexpanded node to the
+  // tree if one doesn't exist yet. Used to build speculative inference
+  // requests for likely children without disturbing selection: the node's
+  // stats are untouched so SelectLeaf treats it exactly as if it had been
+  // created during descent.
+  MctsNode* MaybeAddRootChild(Coord c);
+
   // Performs a soft-pick using `rnd` if the number of moves played is
   // < `soft_pick_cutoff`. Picks the most visited legal move otherwise.
   // If `restrict_pass_alive` is true, playing in pass-alive territory is
@@ -232,6 +378,16 @@ class MctsTree {
                           absl::Span<const float> move_probabilities,
                           float value);
 
+  // Incorporates a whole batch of inference results at once. Equivalent to
+  // calling IncorporateResults for each (leaf, output) pair, except that the
+  // backup phase deduplicates the leaves' shared path prefixes: every node
+  // on any leaf's path to the root has its visit stats updated exactly once
+  // with the batch's accumulated (W, N) delta. Leaves of a deep search share
+  // most of their path near the root, so this touches far less memory than
+  // backing each leaf up individually.
+  void IncorporateResultsBatch(absl::Span<MctsNode* const> leaves,
+                               absl::Span<const ModelOutput* const> outputs);
+
   void IncorporateEndGameResult(MctsNode* leaf, float value);
 
   // Exposed for testing.
@@ -261,20 +417,114 @@ class MctsTree {
   // and UndoMove will leave the tree in a bad state.
   bool UndoMove();
 
+  // Serializes the subtree under the current root into a compact binary
+  // snapshot: edge stats for every expanded node plus the tree shape. Board
+  // positions and superko caches are not stored; they are rebuilt during
+  // deserialization, which keeps snapshots small enough to ship between
+  // replicas.
+  std::string SerializeSnapshot() const;
+
+  // Restores a snapshot produced by SerializeSnapshot, replacing the current
+  // root's subtree. The caller must first bring the tree to the same position
+  // the snapshot was taken at (e.g. by replaying the game's moves); the
+  // snapshot records the root position's move number and stone hash and
+  // deserialization fails if they don't match. If the snapshot turns out to
+  // be truncated or corrupt part-way through deserialization, the root's
+  // subtree is cleared and DeserializeSnapshot returns false.
+  bool DeserializeSnapshot(absl::string_view data);
+
   void ClearSubtrees() { root_->ClearChildren(); }
 
+  // Resets the tree to a new game starting from `position`. The tree's
+  // arena keeps its blocks, so a recycled tree's node allocations reuse the
+  // previous game's memory instead of growing a fresh arena.
+  void Reset(const Position& position);
+
+  // Total size in bytes of the arena blocks backing the tree's nodes.
+  size_t allocated_bytes() const { return arena_.allocated_bytes(); }
+
+  // Rebuilds the tree so that it holds only the subtree under the current
+  // root, returning everything else's memory to the OS. PlayMove keeps the
+  // root's ancestors and their unplayed branches alive for the rest of the
+  // game, so a long game's arena grows without bound even though only the
+  // root's subtree is still searched. Compact snapshots that subtree, frees
+  // the arena and restores the subtree into fresh blocks; the stone history
+  // ring and superko state are preserved. Must not be called while a search
+  // is in flight.
+  void Compact();
+
   float CalculateScore(float komi) const {
-    return root_->position.CalculateScore(komi);
+    return root_->position().CalculateScore(komi);
   }
 
  private:
   Coord PickMostVisitedMove(bool restrict_pass_alive) const;
   Coord SoftPickMove(Random* rnd) const;
 
+  // Expands `leaf` with an inference output, returning false if the leaf was
+  // already expanded (in which case its value must not be backed up again).
+  // Common to IncorporateResults and IncorporateResultsBatch, which differ
+  // only in how they back the value up the tree.
+  bool ExpandLeaf(MctsNode* leaf, absl::Span<const float> move_probabilities,
+                  float value);
+
+  // The priors and value a position was first evaluated with. Transposed
+  // copies of the position are expanded from this entry without inference.
+  // Note that only the evaluation is shared: visit counts and values
+  // accumulate separately in each transposed branch.
+  struct TranspositionEntry {
+    PaddedArray<float, kNumMoves> P;
+    float value;
+  };
+
+  // Map from position key to evaluation result, keyed the same way as the
+  // inference cache (stones, to play, legal moves, whether the previous move
+  // was a pass) so that transposed positions with different superko or ko
+  // state are kept distinct. Entries are allocated from `arena_`.
+  absl::flat_hash_map<InferenceCache::Key, TranspositionEntry*>
+      transposition_table_;
+
+  // Accumulated (W, N) deltas for the current IncorporateResultsBatch call.
+  // A member only so the map's storage is reused across batches.
+  absl::flat_hash_map<MctsNode*, std::pair<float, int>> backup_deltas_;
+
+  // Subtree preservation across undo/redo, see Options::undo_pool_size.
+  // Stashed nodes stay allocated in the arena either way; the pool just
+  // keeps their pointers reachable after PlayMove prunes them, so the only
+  // cost of a large pool is the arena memory it keeps from being recycled
+  // by Reset/Compact (both of which clear the pool).
+  void StashSubtree(MctsNode* node);
+  void MaybeReattachSubtree();
+  static zobrist::Hash UndoPoolKey(const Position& position);
+
+  struct PreservedSubtree {
+    MctsNode* node;
+    // Insertion sequence number, used for LRU eviction.
+    uint64_t age;
+  };
+  absl::flat_hash_map<zobrist::Hash, PreservedSubtree> undo_pool_;
+  uint64_t undo_pool_age_ = 0;
+
+  // Arena that all nodes in the tree except `game_root_` are allocated from.
+  // Allocating nodes from an arena makes tree expansion a pointer bump and
+  // avoids freeing nodes individually: all nodes are freed wholesale when the
+  // tree is destroyed.
+  Arena arena_;
+
   MctsNode* root_;
   MctsNode game_root_;
   MctsNode::EdgeStats game_root_stats_;
   Options options_;
+
+  // Ring buffer of packed snapshots of the positions played before the
+  // current root, written by PlayMove. Stone history features only need the
+  // stones of earlier positions, so inference inputs reference these
+  // snapshots instead of the root's ancestor nodes. `history_head_` is the
+  // slot the next snapshot will be written to; the newest entry is the slot
+  // before it.
+  std::array<StoneSnapshot, kMaxPositionHistory> history_ring_;
+  int history_head_ = 0;
+  int history_len_ = 0;
 };
 
 }  // namespace minigo
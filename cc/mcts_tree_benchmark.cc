@@ -0,0 +1,118 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks for the MctsTree hot paths: SelectLeaf, IncorporateResults
+// and the child action score kernel. The tree is grown from a realistic
+// mid-game position using randomized inference results, so the measured
+// selection and backup paths have the same shape as those of a real search.
+
+#include <array>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "cc/constants.h"
+#include "cc/coord.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/mcts_tree.h"
+#include "cc/padded_array.h"
+#include "cc/position.h"
+#include "cc/random.h"
+
+namespace minigo {
+namespace {
+
+// Plays out a random game for `num_moves` moves, returning the resulting
+// mid-game position.
+Position BuildMidGamePosition(int num_moves) {
+  Random rnd(23423, 23454);
+  Position position(Color::kBlack);
+  for (int i = 0; i < num_moves;) {
+    Coord c(rnd.UniformUint64() % kNumPoints);
+    if (position.legal_move(c)) {
+      position.PlayMove(c);
+      i += 1;
+    }
+  }
+  return position;
+}
+
+void RunBenchmark() {
+  constexpr int kNumReads = 50000;
+
+  auto position = BuildMidGamePosition(kNumPoints / 3);
+  MctsTree tree(position, {});
+
+  Random rnd(614944751, 473537234);
+  std::array<float, kNumMoves> probs;
+
+  // Grow the tree one leaf at a time, timing selection and backup
+  // separately. Randomized priors and values keep the tree's shape
+  // realistically lopsided rather than uniformly wide.
+  absl::Duration select_duration;
+  absl::Duration incorporate_duration;
+  for (int i = 0; i < kNumReads; ++i) {
+    for (auto& p : probs) {
+      p = rnd();
+    }
+    float value = rnd() * 2 - 1;
+
+    auto start = absl::Now();
+    auto* leaf = tree.SelectLeaf(true);
+    auto now = absl::Now();
+    select_duration += now - start;
+
+    if (leaf->game_over()) {
+      tree.IncorporateEndGameResult(leaf, value);
+    } else {
+      tree.IncorporateResults(leaf, probs, value);
+    }
+    incorporate_duration += absl::Now() - now;
+  }
+
+  MG_LOG(INFO) << kN << "x" << kN << ":SelectLeaf " << select_duration << " ("
+               << absl::ToInt64Nanoseconds(select_duration) / kNumReads
+               << "ns/read)";
+  MG_LOG(INFO) << kN << "x" << kN << ":IncorporateResults "
+               << incorporate_duration << " ("
+               << absl::ToInt64Nanoseconds(incorporate_duration) / kNumReads
+               << "ns/read)";
+
+  // Time the action score kernel on its own against the now heavily visited
+  // root. The checksum stops the whole loop being optimized away.
+  constexpr int kNumScoreIterations = 100000;
+  PaddedArray<float, kNumMoves> child_action_score;
+  float checksum = 0;
+  auto start = absl::Now();
+  for (int i = 0; i < kNumScoreIterations; ++i) {
+    tree.root()->CalculateChildActionScoreSimd(child_action_score);
+    checksum += child_action_score[i % kNumMoves];
+  }
+  auto score_duration = absl::Now() - start;
+
+  MG_LOG(INFO) << kN << "x" << kN << ":CalculateChildActionScore "
+               << score_duration << " ("
+               << absl::ToInt64Nanoseconds(score_duration) /
+                      kNumScoreIterations
+               << "ns/call, checksum " << checksum << ")";
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::RunBenchmark();
+  return 0;
+}
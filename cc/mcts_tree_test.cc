@@ -22,12 +22,24 @@
 #include "cc/position.h"
 #include "cc/random.h"
 #include "cc/test_utils.h"
-#include "cc/zobrist.h"
 #include "gtest/gtest.h"
 
 namespace minigo {
 namespace {
 
+// Comparison tolerances for values derived from priors. Priors are exact in
+// the default build, but round at about 2^-11 relative when MG_FP16_PRIORS
+// stores them in half precision.
+#ifndef MG_FP16_PRIORS
+constexpr float kUcbEpsilon = 1e-7;
+constexpr float kPriorSumEpsilon = 1e-6;
+#define EXPECT_PRIOR_EQ(expected, actual) EXPECT_FLOAT_EQ(expected, actual)
+#else
+constexpr float kUcbEpsilon = 1e-4;
+constexpr float kPriorSumEpsilon = 1e-3;
+#define EXPECT_PRIOR_EQ(expected, actual) EXPECT_NEAR(expected, actual, 1e-3)
+#endif
+
 static constexpr char kAlmostDoneBoard[] = R"(
     .XO.XO.OO
     X.XXOOOO.
@@ -63,7 +75,7 @@ static constexpr char kOnlyBensonsBoard[] = R"(
 
 // Test puct and child action score calculation
 TEST(MctsTreeTest, UpperConfidenceBound) {
-  float epsilon = 1e-7;
+  float epsilon = kUcbEpsilon;
   std::array<float, kNumMoves> probs;
   for (float& prob : probs) {
     prob = 0.02;
@@ -150,7 +162,7 @@ TEST(MctsTreeTest, SelectLeaf) {
 
   EXPECT_EQ(Color::kWhite, tree.to_play());
   auto* leaf = tree.SelectLeaf(true);
-  EXPECT_EQ(tree.root()->children.find(c)->second.get(), leaf);
+  EXPECT_EQ(tree.root()->children.find(c), leaf);
 }
 
 // Verifies IncorporateResults and BackupValue.
@@ -292,7 +304,7 @@ TEST(MctsTreeTest, DoNotExplorePastFinish) {
   auto* second_pass = tree.SelectLeaf(true);
   ASSERT_EQ(Coord::kPass, second_pass->move);
   EXPECT_DEATH(tree.IncorporateResults(second_pass, probs, 0), "game_over");
-  float value = second_pass->position.CalculateScore(0) > 0 ? 1 : -1;
+  float value = second_pass->position().CalculateScore(0) > 0 ? 1 : -1;
   tree.IncorporateEndGameResult(second_pass, value);
 
   // should just stop exploring at the end position.
@@ -303,30 +315,68 @@ TEST(MctsTreeTest, DoNotExplorePastFinish) {
 }
 
 TEST(MctsTreeTest, AddChild) {
+  Arena arena;
   MctsTree tree(Position(Color::kBlack), {});
   auto* root = tree.SelectLeaf(true);
 
   Coord c = Coord::FromGtp("B9");
-  auto* child = root->MaybeAddChild(c);
+  auto* child = root->MaybeAddChild(c, &arena);
   EXPECT_EQ(1, root->children.count(c));
   EXPECT_EQ(root, child->parent);
   EXPECT_EQ(child->move, c);
 }
 
 TEST(MctsTreeTest, AddChildIdempotency) {
+  Arena arena;
   MctsTree tree(Position(Color::kBlack), {});
   auto* root = tree.SelectLeaf(true);
 
   Coord c = Coord::FromGtp("B9");
-  auto* child = root->MaybeAddChild(c);
+  auto* child = root->MaybeAddChild(c, &arena);
   EXPECT_EQ(1, root->children.count(c));
   EXPECT_EQ(1, root->children.size());
-  auto* child2 = root->MaybeAddChild(c);
+  auto* child2 = root->MaybeAddChild(c, &arena);
   EXPECT_EQ(child, child2);
   EXPECT_EQ(1, root->children.count(c));
   EXPECT_EQ(1, root->children.size());
 }
 
+TEST(MctsTreeTest, UndoPoolPreservesSubtrees) {
+  std::array<float, kNumMoves> probs;
+  for (float& prob : probs) {
+    prob = 0.02;
+  }
+
+  MctsTree::Options options;
+  options.undo_pool_size = 4;
+  MctsTree tree(Position(Color::kBlack), options);
+  tree.IncorporateResults(tree.SelectLeaf(true), probs, 0);
+
+  Coord a = Coord::FromGtp("C3");
+  Coord b = Coord::FromGtp("G7");
+
+  // Accumulate some search below move A.
+  tree.PlayMove(a);
+  for (int i = 0; i < 10; ++i) {
+    tree.IncorporateResults(tree.SelectLeaf(true), probs, 0.25);
+  }
+  auto n_a = tree.root()->N();
+  auto q_a = tree.root()->Q();
+  ASSERT_LT(0, n_a);
+
+  // Departing for a sibling line prunes A's subtree, which the pool keeps
+  // alive.
+  ASSERT_TRUE(tree.UndoMove());
+  tree.PlayMove(b);
+  tree.IncorporateResults(tree.SelectLeaf(true), probs, -0.25);
+
+  // Navigating back to A reattaches its subtree, search and all.
+  ASSERT_TRUE(tree.UndoMove());
+  tree.PlayMove(a);
+  EXPECT_EQ(n_a, tree.root()->N());
+  EXPECT_FLOAT_EQ(q_a, tree.root()->Q());
+}
+
 TEST(MctsTreeTest, NeverSelectIllegalMoves) {
   std::array<float, kNumMoves> probs;
   for (float& prob : probs) {
@@ -346,7 +396,7 @@ TEST(MctsTreeTest, NeverSelectIllegalMoves) {
   // action score for unvisited moves...
   root->stats->N[root->stats_idx] = 100000;
   for (int i = 0; i < kNumMoves; ++i) {
-    if (root->position.ClassifyMoveIgnoringSuperko(i) !=
+    if (root->position().ClassifyMoveIgnoringSuperko(i) !=
         Position::MoveType::kIllegal) {
       root->edges.N[i] = 10000;
     }
@@ -448,7 +498,7 @@ TEST(MctsTreeTest, BensonRestrictionStillPasses) {
   auto* root = tree.SelectLeaf(true);
   ASSERT_EQ(tree.root(), root);
   for (int i = 0; i < kNumMoves; ++i) {
-    if (root->position.ClassifyMoveIgnoringSuperko(i) !=
+    if (root->position().ClassifyMoveIgnoringSuperko(i) !=
         Position::MoveType::kIllegal) {
       root->edges.N[i] = 10;
     }
@@ -666,11 +716,11 @@ TEST(MctsTreeTest, NormalizeTest) {
   float normalized = 1.0 / (kNumMoves - 1 + 4);
   for (int i = 0; i < kNumMoves; ++i) {
     if (i == 17) {
-      EXPECT_FLOAT_EQ(5 * normalized, tree.root()->child_P(i));
+      EXPECT_PRIOR_EQ(5 * normalized, tree.root()->child_P(i));
     } else if (i == 18) {
-      EXPECT_FLOAT_EQ(0, tree.root()->child_P(i));
+      EXPECT_PRIOR_EQ(0, tree.root()->child_P(i));
     } else {
-      EXPECT_FLOAT_EQ(normalized, tree.root()->child_P(i));
+      EXPECT_PRIOR_EQ(normalized, tree.root()->child_P(i));
     }
   }
 }
@@ -694,7 +744,7 @@ TEST(MctsTreeTest, InjectNoise) {
   for (int i = 0; i < kNumMoves; ++i) {
     sum_P += tree.root()->child_P(i);
   }
-  EXPECT_NEAR(1, sum_P, 0.000001);
+  EXPECT_NEAR(1, sum_P, kPriorSumEpsilon);
   for (int i = 0; i < kNumMoves; ++i) {
     EXPECT_EQ(tree.root()->child_U(0), tree.root()->child_U(i));
   }
@@ -708,7 +758,7 @@ TEST(MctsTreeTest, InjectNoise) {
   for (int i = 0; i < kNumMoves; ++i) {
     sum_P += tree.root()->child_P(i);
   }
-  EXPECT_NEAR(1, sum_P, 0.000001);
+  EXPECT_NEAR(1, sum_P, kPriorSumEpsilon);
 
   // With Dirichlet noise, majority of density should be in one node.
   int i = ArgMax(tree.root()->edges.P);
@@ -732,9 +782,9 @@ TEST(MctsTreeTest, InjectNoiseOnlyLegalMoves) {
 
   for (int i = 0; i < kNumMoves; ++i) {
     if (tree.is_legal_move(i)) {
-      EXPECT_FLOAT_EQ(uniform_policy, tree.root()->edges.P[i]);
+      EXPECT_PRIOR_EQ(uniform_policy, tree.root()->edges.P[i]);
     } else {
-      EXPECT_FLOAT_EQ(0, tree.root()->edges.P[i]);
+      EXPECT_PRIOR_EQ(0, tree.root()->edges.P[i]);
     }
   }
 
@@ -750,7 +800,7 @@ TEST(MctsTreeTest, InjectNoiseOnlyLegalMoves) {
       EXPECT_LT(0.75 * uniform_policy, tree.root()->edges.P[i]);
       EXPECT_GT(0.75 * uniform_policy + 0.25, tree.root()->edges.P[i]);
     } else {
-      EXPECT_FLOAT_EQ(0, tree.root()->edges.P[i]);
+      EXPECT_PRIOR_EQ(0, tree.root()->edges.P[i]);
     }
   }
 }
@@ -797,7 +847,7 @@ TEST(MctsTreeTest, TestSuperko) {
     // at C1 is valid.
     auto c1 = Coord::FromGtp("C1");
     EXPECT_EQ(Position::MoveType::kCapture,
-              tree.root()->position.ClassifyMoveIgnoringSuperko(c1));
+              tree.root()->position().ClassifyMoveIgnoringSuperko(c1));
 
     // When checking superko however, playing at C1 is not legal because it
     // repeats a position.
@@ -820,8 +870,9 @@ TEST(MctsTreeTest, PickMoveArgMax) {
       {{1, 0}, 5},
       {{3, 0}, 1},
   };
+  Arena arena;
   for (const auto& p : child_visits) {
-    root->MaybeAddChild(p.first);
+    root->MaybeAddChild(p.first, &arena);
     root->edges.N[p.first] = p.second;
   }
 
@@ -878,7 +929,7 @@ TEST(MctsTreeTest, CalculateChildActionScore) {
     auto* leaf = tree.SelectLeaf(true);
     ASSERT_NE(leaf, nullptr);
     if (leaf->game_over()) {
-      float value = leaf->position.CalculateScore(kDefaultKomi) > 0 ? 1 : -1;
+      float value = leaf->position().CalculateScore(kDefaultKomi) > 0 ? 1 : -1;
       tree.IncorporateEndGameResult(leaf, value);
     } else {
       float value = rnd();
@@ -898,18 +949,173 @@ TEST(MctsTreeTest, CalculateChildActionScore) {
   auto c_action_score = tree.root()->CalculateChildActionScore();
 
   PaddedArray<float, kNumMoves> sse_action_score;
-  tree.root()->CalculateChildActionScoreSse(sse_action_score);
+  tree.root()->CalculateChildActionScoreSimd(sse_action_score);
 
   for (int i = 0; i < kNumMoves; ++i) {
     EXPECT_NEAR(c_action_score[i], sse_action_score[i], 0.001) << Coord(i);
   }
 }
 
-}  // namespace
-}  // namespace minigo
+// Verifies that when the transposition table is enabled, a leaf whose
+// position was already evaluated via a different move order is expanded from
+// the table and selection continues past it.
+TEST(MctsTreeTest, TranspositionTable) {
+  Coord a = Coord::FromGtp("A1");
+  Coord b = Coord::FromGtp("B1");
+  Coord c = Coord::FromGtp("C1");
+  Coord d = Coord::FromGtp("D1");
+
+  auto make_probs = [](Coord preferred) {
+    std::array<float, kNumMoves> probs;
+    for (float& prob : probs) {
+      prob = 0.001;
+    }
+    probs[preferred] = 0.9;
+    return probs;
+  };
+
+  MctsTree::Options options;
+  options.use_transposition_table = true;
+  MctsTree tree(TestablePosition("", Color::kBlack), options);
+  Arena arena;
+
+  auto* root = tree.SelectLeaf(true);
+  ASSERT_EQ(tree.root(), root);
+  tree.IncorporateResults(root, make_probs(c), 0);
+
+  // Manually expand the path root -> a -> b -> c.
+  auto* node_a = root->MaybeAddChild(a, &arena);
+  tree.IncorporateResults(node_a, make_probs(b), 0.1);
+  auto* node_b = node_a->MaybeAddChild(b, &arena);
+  tree.IncorporateResults(node_b, make_probs(c), 0.2);
+  auto* node_c = node_b->MaybeAddChild(c, &arena);
+  tree.IncorporateResults(node_c, make_probs(d), 0.3);
+
+  // Now search the transposed ordering root -> c -> b -> a, which reaches
+  // the same position as node_c. The priors above guarantee the search
+  // follows this path.
+  auto* leaf = tree.SelectLeaf(true);
+  ASSERT_EQ(c, leaf->move);
+  tree.IncorporateResults(leaf, make_probs(b), 0);
+
+  leaf = tree.SelectLeaf(true);
+  ASSERT_EQ(b, leaf->move);
+  tree.IncorporateResults(leaf, make_probs(a), 0);
 
-int main(int argc, char** argv) {
-  ::testing::InitGoogleTest(&argc, argv);
-  ::minigo::zobrist::Init(614944751);
-  return RUN_ALL_TESTS();
+  // The next selected leaf should not be the transposed node for move a:
+  // that node should be expanded from the transposition table and selection
+  // should continue into its children, following the priors node_c was
+  // originally evaluated with.
+  leaf = tree.SelectLeaf(true);
+  EXPECT_EQ(d, leaf->move);
+
+  const auto* node_a2 = leaf->parent;
+  ASSERT_EQ(a, node_a2->move);
+  EXPECT_NE(node_c, node_a2);
+  EXPECT_TRUE(node_a2->is_expanded);
+  EXPECT_EQ(1, node_a2->N());
+  for (int i = 0; i < kNumMoves; ++i) {
+    EXPECT_FLOAT_EQ(node_c->child_P(i), node_a2->child_P(i)) << Coord(i);
+  }
+}
+
+// Verifies that a tree snapshot round-trips: the restored tree has the same
+// shape & stats as the original. Also verifies that a snapshot is rejected if
+// the tree it's restored into is at a different position.
+TEST(MctsTreeTest, Compact) {
+  Random rnd(506874426, 2);
+
+  // Play a few moves with some search between them, so that the tree holds
+  // plenty of nodes outside the current root's subtree. Passes are disallowed
+  // during search to keep the tree free of game-over leaves.
+  MctsTree tree(TestablePosition("", Color::kBlack), {});
+  std::array<float, kNumMoves> probs;
+  for (int move = 0; move < 8; ++move) {
+    for (int i = 0; i < 250; ++i) {
+      auto* leaf = tree.SelectLeaf(false);
+      rnd.Uniform(0, 1, &probs);
+      tree.IncorporateResults(leaf, probs, rnd.Uniform(-1, 1));
+    }
+    tree.PlayMove(tree.PickMove(&rnd, false));
+  }
+
+  auto expected_stats = tree.CalculateStats();
+  auto expected_path = tree.root()->GetMostVisitedPathString();
+  auto expected_n = tree.root()->N();
+  auto expected_w = tree.root()->W();
+  auto bytes_before = tree.allocated_bytes();
+
+  tree.Compact();
+
+  // The root's subtree survives intact and the arena shrank.
+  auto actual_stats = tree.CalculateStats();
+  EXPECT_EQ(expected_stats.num_nodes, actual_stats.num_nodes);
+  EXPECT_EQ(expected_stats.num_leaf_nodes, actual_stats.num_leaf_nodes);
+  EXPECT_EQ(expected_stats.max_depth, actual_stats.max_depth);
+  EXPECT_EQ(expected_stats.depth_sum, actual_stats.depth_sum);
+  EXPECT_EQ(expected_path, tree.root()->GetMostVisitedPathString());
+  EXPECT_EQ(expected_n, tree.root()->N());
+  EXPECT_EQ(expected_w, tree.root()->W());
+  EXPECT_LT(tree.allocated_bytes(), bytes_before);
+
+  // The compacted tree is still searchable and playable.
+  for (int i = 0; i < 100; ++i) {
+    auto* leaf = tree.SelectLeaf(false);
+    rnd.Uniform(0, 1, &probs);
+    tree.IncorporateResults(leaf, probs, rnd.Uniform(-1, 1));
+  }
+  tree.PlayMove(tree.PickMove(&rnd, false));
+}
+
+TEST(MctsTreeTest, SnapshotRoundTrip) {
+  Random rnd(506874426, 1);
+
+  // Build a tree with a few hundred incorporated reads.
+  MctsTree tree(TestablePosition("", Color::kBlack), {});
+  std::array<float, kNumMoves> probs;
+  for (int i = 0; i < 300; ++i) {
+    auto* leaf = tree.SelectLeaf(true);
+    rnd.Uniform(0, 1, &probs);
+    tree.IncorporateResults(leaf, probs, rnd.Uniform(-1, 1));
+  }
+
+  auto snapshot = tree.SerializeSnapshot();
+
+  MctsTree restored(TestablePosition("", Color::kBlack), {});
+  ASSERT_TRUE(restored.DeserializeSnapshot(snapshot));
+
+  auto expected_stats = tree.CalculateStats();
+  auto actual_stats = restored.CalculateStats();
+  EXPECT_EQ(expected_stats.num_nodes, actual_stats.num_nodes);
+  EXPECT_EQ(expected_stats.num_leaf_nodes, actual_stats.num_leaf_nodes);
+  EXPECT_EQ(expected_stats.max_depth, actual_stats.max_depth);
+  EXPECT_EQ(expected_stats.depth_sum, actual_stats.depth_sum);
+
+  EXPECT_EQ(tree.root()->N(), restored.root()->N());
+  EXPECT_EQ(tree.root()->W(), restored.root()->W());
+  for (int i = 0; i < kNumMoves; ++i) {
+    EXPECT_EQ(tree.root()->child_N(i), restored.root()->child_N(i));
+    EXPECT_EQ(tree.root()->child_W(i), restored.root()->child_W(i));
+    EXPECT_EQ(tree.root()->child_P(i), restored.root()->child_P(i));
+  }
+  EXPECT_EQ(tree.root()->GetMostVisitedPathString(),
+            restored.root()->GetMostVisitedPathString());
+
+  // The restored tree should be searchable.
+  auto* leaf = restored.SelectLeaf(true);
+  rnd.Uniform(0, 1, &probs);
+  restored.IncorporateResults(leaf, probs, 0);
+
+  // A tree at a different position should reject the snapshot.
+  MctsTree other(TestablePosition("", Color::kBlack), {});
+  other.PlayMove(Coord::FromGtp("D4"));
+  EXPECT_FALSE(other.DeserializeSnapshot(snapshot));
+
+  // As should obviously corrupt data.
+  MctsTree fresh(TestablePosition("", Color::kBlack), {});
+  EXPECT_FALSE(fresh.DeserializeSnapshot(snapshot.substr(0, 100)));
+  EXPECT_FALSE(fresh.DeserializeSnapshot(""));
 }
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,131 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/metrics.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace minigo {
+
+namespace {
+
+// Metrics are never unregistered (they're required to have static storage
+// duration), so the registry only grows.
+struct Registry {
+  absl::Mutex mutex;
+  std::vector<const Counter*> counters;
+  std::vector<const Gauge*> gauges;
+};
+
+Registry* registry() {
+  static auto* r = new Registry();
+  return r;
+}
+
+}  // namespace
+
+namespace internal {
+
+int MetricShardIndex() {
+  static std::atomic<int> next_shard{0};
+  thread_local int shard = next_shard.fetch_add(1, std::memory_order_relaxed) &
+                           (Counter::kNumShards - 1);
+  return shard;
+}
+
+}  // namespace internal
+
+constexpr int Counter::kNumShards;
+
+Counter::Counter(const char* name) : name_(name) {
+  auto* r = registry();
+  absl::MutexLock lock(&r->mutex);
+  r->counters.push_back(this);
+}
+
+int64_t Counter::Sum() const {
+  int64_t sum = 0;
+  for (const auto& shard : shards_) {
+    sum += shard.value.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+Gauge::Gauge(const char* name) : name_(name) {
+  auto* r = registry();
+  absl::MutexLock lock(&r->mutex);
+  r->gauges.push_back(this);
+}
+
+std::string DumpMetricsLine() {
+  std::vector<std::pair<absl::string_view, int64_t>> values;
+  auto* r = registry();
+  {
+    absl::MutexLock lock(&r->mutex);
+    values.reserve(r->counters.size() + r->gauges.size());
+    for (const auto* counter : r->counters) {
+      values.emplace_back(counter->name(), counter->Sum());
+    }
+    for (const auto* gauge : r->gauges) {
+      values.emplace_back(gauge->name(), gauge->value());
+    }
+  }
+  std::sort(values.begin(), values.end());
+
+  auto line = absl::StrCat("metrics t=", absl::ToUnixMicros(absl::Now()));
+  for (const auto& value : values) {
+    absl::StrAppend(&line, " ", value.first, "=", value.second);
+  }
+  return line;
+}
+
+std::string DumpPrometheusText() {
+  std::vector<std::pair<absl::string_view, int64_t>> counters;
+  std::vector<std::pair<absl::string_view, int64_t>> gauges;
+  auto* r = registry();
+  {
+    absl::MutexLock lock(&r->mutex);
+    counters.reserve(r->counters.size());
+    for (const auto* counter : r->counters) {
+      counters.emplace_back(counter->name(), counter->Sum());
+    }
+    gauges.reserve(r->gauges.size());
+    for (const auto* gauge : r->gauges) {
+      gauges.emplace_back(gauge->name(), gauge->value());
+    }
+  }
+  std::sort(counters.begin(), counters.end());
+  std::sort(gauges.begin(), gauges.end());
+
+  std::string text;
+  for (const auto& counter : counters) {
+    absl::StrAppend(&text, "# TYPE ", counter.first, " counter\n",
+                    counter.first, " ", counter.second, "\n");
+  }
+  for (const auto& gauge : gauges) {
+    absl::StrAppend(&text, "# TYPE ", gauge.first, " gauge\n", gauge.first,
+                    " ", gauge.second, "\n");
+  }
+  return text;
+}
+
+}  // namespace minigo
@@ -0,0 +1,101 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_METRICS_H_
+#define CC_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace minigo {
+
+// Always-on, low overhead performance counters for hot-path visibility in
+// production, where WTF tracing is too heavyweight to leave enabled.
+//
+// Counters and gauges register themselves with a global registry when
+// constructed and must have static storage duration; define them at file
+// scope next to the code they instrument:
+//
+//   Counter nodes_expanded("selfplay_nodes_expanded");
+//   ...
+//   nodes_expanded.Increment();
+//
+// DumpMetricsLine snapshots every registered metric into a single
+// machine-readable log line.
+
+namespace internal {
+// Returns a small per-thread shard index, assigned round-robin as threads
+// first touch a sharded metric.
+int MetricShardIndex();
+}  // namespace internal
+
+// A monotonically increasing counter. Increment is a relaxed atomic add on a
+// per-thread shard, so counters hit from every selfplay thread don't bounce a
+// single cache line between cores.
+class Counter {
+ public:
+  static constexpr int kNumShards = 16;
+
+  explicit Counter(const char* name);
+
+  void Increment(int64_t n = 1) {
+    shards_[internal::MetricShardIndex()].value.fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
+  // Returns the sum over all shards. Safe to call concurrently with
+  // Increment; increments that race with the sum may or may not be included.
+  int64_t Sum() const;
+
+  const char* name() const { return name_; }
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<int64_t> value{0};
+  };
+  Shard shards_[kNumShards];
+  const char* name_;
+};
+
+// A gauge that reports the most recently set value (queue depth, batch size,
+// etc).
+class Gauge {
+ public:
+  explicit Gauge(const char* name);
+
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  const char* name() const { return name_; }
+
+ private:
+  std::atomic<int64_t> value_{0};
+  const char* name_;
+};
+
+// Returns a snapshot of every registered metric as a single line of the form:
+//   metrics t=<unix_micros> <name>=<value> <name>=<value> ...
+// with the metrics sorted by name, suitable for scraping from the logs.
+std::string DumpMetricsLine();
+
+// Returns a snapshot of every registered metric in the Prometheus text
+// exposition format (one "# TYPE" comment and one sample per metric, sorted
+// by name), suitable for serving from a scrape endpoint (see
+// cc/metrics_server.h).
+std::string DumpPrometheusText();
+
+}  // namespace minigo
+
+#endif  // CC_METRICS_H_
@@ -0,0 +1,142 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/metrics_server.h"
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+#include <cstring>
+#include <string>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "cc/logging.h"
+#include "cc/metrics.h"
+
+namespace minigo {
+
+#ifndef _WIN32
+
+MetricsServer::~MetricsServer() { Stop(); }
+
+bool MetricsServer::Start(int port) {
+  MG_CHECK(thread_ == nullptr) << "MetricsServer is already running";
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    MG_LOG(ERROR) << "couldn't open metrics socket";
+    return false;
+  }
+
+  // Allow quick restarts without waiting for old sockets in TIME_WAIT.
+  int reuse = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      listen(listen_fd_, 1) < 0) {
+    MG_LOG(ERROR) << "couldn't listen on metrics port " << port;
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+
+  socklen_t addr_len = sizeof(addr);
+  MG_CHECK(getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+                       &addr_len) == 0);
+  port_ = ntohs(addr.sin_port);
+
+  running_.store(true, std::memory_order_release);
+  thread_ = absl::make_unique<LambdaThread>("metrics", [this]() { Run(); });
+  thread_->Start();
+  MG_LOG(INFO) << "serving metrics on port " << port_;
+  return true;
+}
+
+void MetricsServer::Stop() {
+  if (thread_ == nullptr) {
+    return;
+  }
+  running_.store(false, std::memory_order_release);
+  // Unblock the serving thread's accept(2).
+  shutdown(listen_fd_, SHUT_RDWR);
+  thread_->Join();
+  thread_ = nullptr;
+  close(listen_fd_);
+  listen_fd_ = -1;
+  port_ = 0;
+}
+
+void MetricsServer::Run() {
+  for (;;) {
+    int client_fd = accept(listen_fd_, nullptr, nullptr);
+    if (!running_.load(std::memory_order_acquire)) {
+      if (client_fd >= 0) {
+        close(client_fd);
+      }
+      return;
+    }
+    if (client_fd < 0) {
+      continue;
+    }
+
+    // Drain whatever request the scraper sent; the response is the same
+    // metrics snapshot regardless of the path.
+    char request[1024];
+    recv(client_fd, request, sizeof(request), 0);
+
+    auto body = DumpPrometheusText();
+    auto response = absl::StrCat(
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: ",
+        body.size(), "\r\n\r\n", body);
+    const char* data = response.data();
+    size_t remaining = response.size();
+    while (remaining > 0) {
+      auto n = send(client_fd, data, remaining, 0);
+      if (n <= 0) {
+        break;
+      }
+      data += n;
+      remaining -= n;
+    }
+    close(client_fd);
+  }
+}
+
+#else  // _WIN32
+
+MetricsServer::~MetricsServer() {}
+
+bool MetricsServer::Start(int port) {
+  MG_LOG(ERROR) << "MetricsServer is not supported on Windows";
+  return false;
+}
+
+void MetricsServer::Stop() {}
+
+void MetricsServer::Run() {}
+
+#endif  // _WIN32
+
+}  // namespace minigo
@@ -0,0 +1,61 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_METRICS_SERVER_H_
+#define CC_METRICS_SERVER_H_
+
+#include <atomic>
+#include <memory>
+
+#include "cc/async/thread.h"
+
+namespace minigo {
+
+// Serves the registered metrics (see cc/metrics.h) over HTTP in the
+// Prometheus text format, so fleet monitoring can scrape a selfplay worker
+// directly instead of tailing its logs.
+//
+// The server is deliberately minimal: a single thread accepts one connection
+// at a time, answers every request with a metrics snapshot and closes the
+// connection. Metrics are only formatted when a scraper connects, so an idle
+// server costs a blocked accept(2) and nothing on the hot paths.
+//
+// Not supported on Windows: Start logs an error and returns false there.
+class MetricsServer {
+ public:
+  ~MetricsServer();
+
+  // Starts serving on `port`. Pass 0 to let the kernel pick a free port,
+  // which port() then reports. Returns false if the socket couldn't be
+  // opened.
+  bool Start(int port);
+
+  // Stops the serving thread. Called automatically on destruction.
+  void Stop();
+
+  // The port the server is listening on, or 0 if it isn't running.
+  int port() const { return port_; }
+
+ private:
+  void Run();
+
+  std::unique_ptr<LambdaThread> thread_;
+  std::atomic<bool> running_{false};
+  int listen_fd_ = -1;
+  int port_ = 0;
+};
+
+}  // namespace minigo
+
+#endif  // CC_METRICS_SERVER_H_
@@ -0,0 +1,95 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/metrics_server.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "cc/logging.h"
+#include "cc/metrics.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Metrics must have static storage duration.
+Counter scrape_counter("scrape_test_counter");
+Gauge scrape_gauge("scrape_test_gauge");
+
+// Connects to the server on localhost and returns the full response to a
+// GET /metrics request.
+std::string Scrape(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  MG_CHECK(fd >= 0);
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  MG_CHECK(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+
+  const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+  MG_CHECK(send(fd, request, sizeof(request) - 1, 0) ==
+           static_cast<ssize_t>(sizeof(request) - 1));
+
+  std::string response;
+  char buffer[4096];
+  for (;;) {
+    auto n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      break;
+    }
+    response.append(buffer, n);
+  }
+  close(fd);
+  return response;
+}
+
+TEST(MetricsServerTest, ServesPrometheusText) {
+  scrape_counter.Increment(3);
+  scrape_gauge.Set(57);
+
+  MetricsServer server;
+  ASSERT_TRUE(server.Start(0));
+  ASSERT_NE(0, server.port());
+
+  auto response = Scrape(server.port());
+  EXPECT_EQ(0, response.find("HTTP/1.0 200 OK\r\n"));
+  EXPECT_NE(std::string::npos,
+            response.find("Content-Type: text/plain; version=0.0.4\r\n"));
+  EXPECT_NE(std::string::npos,
+            response.find("# TYPE scrape_test_counter counter\n"));
+  EXPECT_NE(std::string::npos,
+            response.find(absl::StrCat("scrape_test_counter ",
+                                       scrape_counter.Sum(), "\n")));
+  EXPECT_NE(std::string::npos,
+            response.find("# TYPE scrape_test_gauge gauge\n"));
+  EXPECT_NE(std::string::npos, response.find("scrape_test_gauge 57\n"));
+
+  // Each scrape takes a fresh snapshot.
+  scrape_gauge.Set(58);
+  EXPECT_NE(std::string::npos,
+            Scrape(server.port()).find("scrape_test_gauge 58\n"));
+
+  server.Stop();
+  EXPECT_EQ(0, server.port());
+}
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,62 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/metrics.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Metrics must have static storage duration.
+Counter test_counter("test_counter");
+Gauge test_gauge("test_gauge");
+
+TEST(MetricsTest, CounterSumsAcrossThreads) {
+  constexpr int kNumThreads = 8;
+  constexpr int kIncrementsPerThread = 10000;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([]() {
+      for (int j = 0; j < kIncrementsPerThread; ++j) {
+        test_counter.Increment();
+      }
+      test_counter.Increment(2);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  ASSERT_EQ(kNumThreads * (kIncrementsPerThread + 2), test_counter.Sum());
+}
+
+TEST(MetricsTest, DumpMetricsLine) {
+  test_gauge.Set(42);
+
+  auto line = DumpMetricsLine();
+  ASSERT_EQ(0, line.find("metrics t="));
+  ASSERT_NE(std::string::npos,
+            line.find(absl::StrCat(" test_counter=", test_counter.Sum())));
+  ASSERT_NE(std::string::npos, line.find(" test_gauge=42"));
+}
+
+}  // namespace
+}  // namespace minigo
@@ -38,10 +38,10 @@ namespace {
 // Returns the Q of the best legal child move for the node.
 // Returns the node's Q if there are no legal moves.
 float GetBestMoveQ(const MctsNode* node) {
-  float scale = node->position.to_play() == Color::kBlack ? 1 : -1;
+  float scale = node->position().to_play() == Color::kBlack ? 1 : -1;
   float bestChildQ = node->Q();
   for (int i = 0; i < kNumMoves; ++i) {
-    if (!node->position.legal_move(i)) {
+    if (!node->position().legal_move(i)) {
       continue;
     }
     if (node->child_Q(i) * scale > bestChildQ * scale) {
@@ -198,11 +198,11 @@ GtpClient::Response MiniguiGtpClient::ReplaySgf(
             continue;
           }
 
-          if (node->move.color != player_->root()->position.to_play()) {
+          if (node->move.color != player_->root()->position().to_play()) {
             // The move color is different than expected. Play a pass move to
             // flip the colors.
             if (player_->root()->move == Coord::kPass) {
-              auto expected = ColorToCode(player_->root()->position.to_play());
+              auto expected = ColorToCode(player_->root()->position().to_play());
               auto actual = node->move.ToSgf();
               MG_LOG(ERROR)
                   << "expected move by " << expected << ", got " << actual
@@ -282,6 +282,16 @@ void MiniguiGtpClient::ReportSearchStatus(const MctsNode* leaf,
   auto sorted_child_info = player_->tree().CalculateRankedMoveInfo();
   auto* root = player_->root();
 
+  // Periodic reports for an unchanged root only contain the values that
+  // changed since the last report; the frontend merges them into its copy of
+  // the search state. Anything else (including the final report sent at the
+  // end of a genmove) gets the full state.
+  bool delta = !include_tree_stats && root == last_report_.root;
+  if (!delta) {
+    last_report_.root = root;
+    last_report_.variation_N.clear();
+  }
+
   nlohmann::json j = {
       {"id", variation_tree_->current_node()->id},
       {"n", root->N()},
@@ -293,24 +303,34 @@ void MiniguiGtpClient::ReportSearchStatus(const MctsNode* leaf,
   nlohmann::json variations;
   for (int i = 0; i < 10; ++i) {
     Coord c = sorted_child_info[i].c;
-    const auto child_it = root->children.find(c);
-    if (child_it == root->children.end() || root->child_N(c) == 0) {
+    const auto* node = root->children.find(c);
+    if (node == nullptr || root->child_N(c) == 0) {
       break;
     }
 
-    nlohmann::json moves = {c.ToGtp()};
-    const auto* node = child_it->second.get();
+    auto key = c.ToGtp();
+    if (delta) {
+      auto it = last_report_.variation_N.find(key);
+      if (it != last_report_.variation_N.end() &&
+          it->second == root->child_N(c)) {
+        // The variation hasn't been visited since the last report.
+        continue;
+      }
+    }
+    last_report_.variation_N[key] = root->child_N(c);
+
+    nlohmann::json moves = {key};
     for (const auto c : node->GetMostVisitedPath()) {
       moves.push_back(c.ToGtp());
     }
-    variations[c.ToGtp()] = {
+    variations[std::move(key)] = {
         {"n", root->child_N(c)},
         {"q", root->child_Q(c)},
         {"moves", std::move(moves)},
     };
   }
   if (!variations.empty()) {
-    j["variations"] = std::move(variations);
+    j[delta ? "variationsDelta" : "variations"] = std::move(variations);
   }
 
   // Current live search variation.
@@ -325,7 +345,7 @@ void MiniguiGtpClient::ReportSearchStatus(const MctsNode* leaf,
       for (const auto* node : live) {
         moves.push_back(node->move.ToGtp());
       }
-      j["variations"]["live"] = {
+      j[delta ? "variationsDelta" : "variations"]["live"] = {
           {"n", live.front()->N()},
           {"q", GetBestMoveQ(live.front())},
           {"moves", std::move(moves)},
@@ -333,16 +353,38 @@ void MiniguiGtpClient::ReportSearchStatus(const MctsNode* leaf,
     }
   }
 
-  // Child N.
-  auto& child_N = j["childN"];
-  for (auto N : root->edges.N) {
-    child_N.push_back(static_cast<int>(N));
-  }
-
-  // Child Q.
-  auto& child_Q = j["childQ"];
-  for (int i = 0; i < kNumMoves; ++i) {
-    child_Q.push_back(static_cast<int>(std::round(root->child_Q(i) * 1000)));
+  // Child N & child Q. Full reports send dense arrays; delta reports send
+  // sparse index -> value objects holding only the entries that changed.
+  if (!delta) {
+    auto& child_N = j["childN"];
+    auto& child_Q = j["childQ"];
+    for (int i = 0; i < kNumMoves; ++i) {
+      last_report_.child_N[i] = static_cast<int>(root->child_N(i));
+      last_report_.child_Q[i] =
+          static_cast<int>(std::round(root->child_Q(i) * 1000));
+      child_N.push_back(last_report_.child_N[i]);
+      child_Q.push_back(last_report_.child_Q[i]);
+    }
+  } else {
+    nlohmann::json child_N_delta, child_Q_delta;
+    for (int i = 0; i < kNumMoves; ++i) {
+      int n = static_cast<int>(root->child_N(i));
+      if (n != last_report_.child_N[i]) {
+        last_report_.child_N[i] = n;
+        child_N_delta[absl::StrCat(i)] = n;
+      }
+      int q = static_cast<int>(std::round(root->child_Q(i) * 1000));
+      if (q != last_report_.child_Q[i]) {
+        last_report_.child_Q[i] = q;
+        child_Q_delta[absl::StrCat(i)] = q;
+      }
+    }
+    if (!child_N_delta.empty()) {
+      j["childNDelta"] = std::move(child_N_delta);
+    }
+    if (!child_Q_delta.empty()) {
+      j["childQDelta"] = std::move(child_Q_delta);
+    }
   }
 
   if (include_tree_stats) {
@@ -359,7 +401,7 @@ void MiniguiGtpClient::ReportSearchStatus(const MctsNode* leaf,
 
 void MiniguiGtpClient::ReportRootPosition() {
   const auto* root = player_->root();
-  const auto& position = root->position;
+  const auto& position = root->position();
 
   std::ostringstream oss;
   for (const auto& stone : position.stones()) {
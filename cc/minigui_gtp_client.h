@@ -15,6 +15,7 @@
 #ifndef CC_MINIGUI_GTP_CLIENT_H_
 #define CC_MINIGUI_GTP_CLIENT_H_
 
+#include <array>
 #include <deque>
 #include <map>
 #include <memory>
@@ -224,6 +225,19 @@ class MiniguiGtpClient : public GtpClient {
   // report_search_interval_.
   void TreeSearchCb(const std::vector<const MctsNode*>& leaves);
 
+  // Snapshot of the last mg-update written to stderr, used to send the
+  // frontend incremental updates: periodic reports only contain the child N
+  // and Q values and variations whose visit counts changed since the last
+  // report, which is much cheaper to serialize than the full search state.
+  // A full report is sent whenever the search root changes.
+  struct LastReport {
+    const MctsNode* root = nullptr;
+    std::array<int, kNumMoves> child_N;
+    std::array<int, kNumMoves> child_Q;
+    absl::flat_hash_map<std::string, int> variation_N;
+  };
+  LastReport last_report_;
+
   absl::Duration report_search_interval_;
   absl::Time last_report_time_;
   std::unique_ptr<VariationTree> variation_tree_;
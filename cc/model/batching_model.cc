@@ -20,19 +20,62 @@
 #include "absl/time/clock.h"
 #include "cc/logging.h"
 #include "cc/model/buffered_model.h"
+#include "cc/model/inference_trace.h"
 #include "cc/model/loader.h"
+#include "cc/metrics.h"
 #include "wtf/macros.h"
 
 namespace minigo {
 
 namespace internal {
 
+namespace {
+
+// Always-on counters for fleet dashboards: batch occupancy is
+// batcher_inferences / batcher_batches over a scrape interval.
+Counter batches_counter("batcher_batches");
+Counter inferences_counter("batcher_inferences");
+Gauge queue_depth_gauge("batcher_queue_depth");
+
+}  // namespace
+
+void ModelBatcher::RequestQueue::push(InferenceRequest request) {
+  if (size_ == buffer_.size()) {
+    // Full: move the live entries to the front of a larger buffer.
+    std::vector<InferenceRequest> grown(std::max<size_t>(16, size_ * 2));
+    for (size_t i = 0; i < size_; ++i) {
+      grown[i] = std::move(buffer_[(head_ + i) % buffer_.size()]);
+    }
+    buffer_ = std::move(grown);
+    head_ = 0;
+  }
+  buffer_[(head_ + size_) % buffer_.size()] = std::move(request);
+  size_ += 1;
+}
+
+void ModelBatcher::RequestQueue::pop() {
+  MG_DCHECK(size_ > 0);
+  // Reset the slot so a moved-out callback doesn't linger in the ring.
+  buffer_[head_] = InferenceRequest();
+  head_ = (head_ + 1) % buffer_.size();
+  size_ -= 1;
+}
+
+void ModelBatcher::BatchSlab::Clear() {
+  inputs.clear();
+  outputs.clear();
+  inferences.clear();
+}
+
 ModelBatcher::ModelBatcher(std::unique_ptr<Model> model_impl, int buffer_count)
     : model_impl_(std::move(model_impl)), stats_(buffer_count) {}
 
 ModelBatcher::~ModelBatcher() {
   MG_LOG(INFO) << "Ran " << num_batches_ << " batches with an average size of "
                << static_cast<float>(num_inferences_) / num_batches_;
+  MG_LOG(INFO) << "Batch latencies: queue wait ["
+               << queue_wait_histogram_.ToString() << "] inference ["
+               << run_many_histogram_.ToString() << "]";
 }
 
 void ModelBatcher::StartGame() {
@@ -49,14 +92,30 @@ void ModelBatcher::EndGame() {
 void ModelBatcher::RunMany(ModelBatcher* other_batcher,
                            const std::vector<const ModelInput*>& inputs,
                            std::vector<ModelOutput*>* outputs,
-                           std::string* model_name) {
+                           std::string* model_name,
+                           InferencePriority priority) {
   WTF_SCOPE("ModelBatcher::RunMany", size_t)(inputs.size());
 
   absl::Notification notification;
+  RunManyAsync(other_batcher, inputs, outputs, model_name, priority,
+               [&notification]() { notification.Notify(); });
+  notification.WaitForNotification();
+}
+
+void ModelBatcher::RunManyAsync(ModelBatcher* other_batcher,
+                                const std::vector<const ModelInput*>& inputs,
+                                std::vector<ModelOutput*>* outputs,
+                                std::string* model_name,
+                                InferencePriority priority,
+                                std::function<void()> callback) {
+  WTF_SCOPE("ModelBatcher::RunManyAsync", size_t)(inputs.size());
 
   {
     absl::MutexLock lock(&mutex_);
-    queue_.push({other_batcher, &inputs, outputs, model_name, &notification});
+    auto* queue =
+        priority == InferencePriority::kHigh ? &high_priority_queue_ : &queue_;
+    queue->push({other_batcher, &inputs, outputs, model_name,
+                 std::move(callback), absl::Now()});
     if (other_batcher != nullptr) {
       other_batcher->num_waiting_ += 1;
     }
@@ -67,26 +126,35 @@ void ModelBatcher::RunMany(ModelBatcher* other_batcher,
     absl::MutexLock lock(&other_batcher->mutex_);
     other_batcher->MaybeRunBatchesLocked();
   }
-
-  notification.WaitForNotification();
 }
 
 BatchingModelStats ModelBatcher::FlushStats() {
   mutex_.Lock();
   auto result = stats_;
+  result.target_batch_size = GetBatchSize();
+  result.flush_timeout = flush_timeout_;
   stats_ = BatchingModelStats(stats_.buffer_count);
   mutex_.Unlock();
   return result;
 }
 
 size_t ModelBatcher::GetBatchSize() const {
+  if (target_batch_size_ != 0) {
+    return target_batch_size_;
+  }
+  // No batches have run yet: derive the batch size from the number of active
+  // clients.
   return std::max<size_t>(1, num_active_clients_ / stats_.buffer_count);
 }
 
 void ModelBatcher::MaybeRunBatchesLocked() {
-  while (!queue_.empty()) {
-    auto queue_size = queue_.size();
+  while (!queue_.empty() || !high_priority_queue_.empty()) {
+    auto queue_size = queue_.size() + high_priority_queue_.size();
     if (queue_size < GetBatchSize()) {
+      // A high priority request preempts batch assembly: run whatever has
+      // been queued so far rather than make the request wait for a full
+      // batch.
+      bool has_high_priority = !high_priority_queue_.empty();
       // The queue doesn't have enough requests to fill a batch: see if we
       // can run a smaller batch instead.
       //
@@ -105,7 +173,14 @@ void ModelBatcher::MaybeRunBatchesLocked() {
       bool can_run_small_batch =
           queue_size >= num_active_clients_ / stats_.buffer_count &&
           queue_size + num_waiting_ >= num_active_clients_;
-      if (!can_run_small_batch) {
+
+      // Run whatever we have if the request at the front of the queue has
+      // been waiting for its batch to fill up for too long.
+      bool flush_timed_out =
+          !queue_.empty() &&
+          absl::Now() - queue_.front().enqueue_time >= flush_timeout_;
+
+      if (!has_high_priority && !can_run_small_batch && !flush_timed_out) {
         break;
       }
     }
@@ -119,29 +194,54 @@ void ModelBatcher::RunBatch() {
   auto run_batch_start_time = absl::Now();
 
   auto batch_size = GetBatchSize();
+  auto queue_depth = queue_.size() + high_priority_queue_.size();
+
+  // Assemble the batch into a recycled slab: the slab's vectors keep their
+  // capacity from previous batches, so nothing here allocates once the
+  // batcher has reached its steady-state batch size.
+  std::unique_ptr<BatchSlab> slab;
+  if (!free_slabs_.empty()) {
+    slab = std::move(free_slabs_.back());
+    free_slabs_.pop_back();
+  } else {
+    slab = absl::make_unique<BatchSlab>();
+  }
+  auto& inputs = slab->inputs;
+  auto& outputs = slab->outputs;
+  auto& inferences = slab->inferences;
+  inferences.reserve(batch_size);
+
+  auto fill_from = [&](RequestQueue* queue) {
+    while (!queue->empty() && inferences.size() < batch_size) {
+      auto& inference = queue->front();
+      size_t num_features = inference.inputs->size();
+
+      std::copy_n(inference.inputs->begin(), num_features,
+                  std::back_inserter(inputs));
+      std::copy_n(inference.outputs->begin(), num_features,
+                  std::back_inserter(outputs));
+      inferences.push_back(std::move(inference));
+
+      queue->pop();
+    }
+  };
 
-  // TODO(tommadams): reserve GetBatchSize() * virtual_losses elements.
-  std::vector<const ModelInput*> inputs;
-  std::vector<ModelOutput*> outputs;
-  std::vector<InferenceRequest> inferences;
-
-  while (!queue_.empty() && inferences.size() < batch_size) {
-    auto& inference = queue_.front();
-    size_t num_features = inference.inputs->size();
-
-    std::copy_n(inference.inputs->begin(), num_features,
-                std::back_inserter(inputs));
-    std::copy_n(inference.outputs->begin(), num_features,
-                std::back_inserter(outputs));
-    inferences.push_back(inference);
+  // High priority requests always go at the front of the batch.
+  fill_from(&high_priority_queue_);
+  fill_from(&queue_);
 
-    queue_.pop();
+  for (const auto& inference : inferences) {
+    queue_wait_histogram_.Add(run_batch_start_time - inference.enqueue_time);
   }
 
   num_batches_ += 1;
   num_inferences_ += inputs.size();
   auto num_inferences_in_batch = inputs.size();
 
+  batches_counter.Increment();
+  inferences_counter.Increment(inputs.size());
+  queue_depth_gauge.Set(queue_depth);
+
   // Unlock the mutex while running inference. This allows more inferences
   // to be enqueued while inference is running.
   mutex_.Unlock();
@@ -152,6 +252,13 @@ void ModelBatcher::RunBatch() {
   MG_CHECK(inputs.size() == outputs.size());
   model_impl_->RunMany(inputs, &outputs, &model_name);
   auto run_many_time = absl::Now() - run_many_start_time;
+  run_many_histogram_.Add(run_many_time);
+
+  // Record the batch before invoking any callbacks: the inputs belong to the
+  // waiting clients and may be destroyed as soon as they're unblocked.
+  if (auto* trace_writer = InferenceTraceWriter::Get()) {
+    trace_writer->WriteBatch(inputs, run_many_time);
+  }
 
   for (auto& inference : inferences) {
     if (inference.model_name != nullptr) {
@@ -166,7 +273,7 @@ void ModelBatcher::RunBatch() {
 
   // All the required work is done, unblock all the waiting clients.
   for (auto& inference : inferences) {
-    inference.notification->Notify();
+    inference.callback();
   }
 
   // Lock the mutex again.
@@ -176,18 +283,62 @@ void ModelBatcher::RunBatch() {
       (absl::Now() - run_batch_start_time) / stats_.buffer_count;
   stats_.run_many_time += (run_many_time) / stats_.buffer_count;
   stats_.num_inferences += num_inferences_in_batch;
+  stats_.num_batches += 1;
+
+  UpdateBatchingParams(queue_depth, inferences.size(), run_many_time);
+
+  slab->Clear();
+  free_slabs_.push_back(std::move(slab));
+}
+
+void ModelBatcher::UpdateBatchingParams(size_t queue_depth, size_t batch_size,
+                                        absl::Duration latency) {
+  auto target = GetBatchSize();
+  if (batch_size >= target && queue_depth > batch_size) {
+    // The batch launched full and there were requests left over: demand
+    // exceeds the current target, grow it. The target is capped at the
+    // number of active clients since each client has at most one request in
+    // flight.
+    target = std::min(target + 1, std::max<size_t>(1, num_active_clients_));
+  } else if (batch_size < target) {
+    // The batch launched under-full (the small batch rule or flush timeout
+    // triggered): shrink the target towards the demand we actually saw.
+    target -= 1;
+  }
+  target_batch_size_ = std::max<size_t>(1, target);
+
+  // Track an exponential moving average of the model's per-batch latency and
+  // allow a partially filled batch to wait at most roughly one batch, so
+  // waiting for the batch to fill never costs more than running it.
+  if (avg_batch_latency_ == absl::ZeroDuration()) {
+    avg_batch_latency_ = latency;
+  } else {
+    avg_batch_latency_ = avg_batch_latency_ * 0.9 + latency * 0.1;
+  }
+  flush_timeout_ = std::min(std::max(avg_batch_latency_, absl::Milliseconds(1)),
+                            absl::Milliseconds(100));
 }
 
 }  // namespace internal
 
-BatchingModel::BatchingModel(std::shared_ptr<internal::ModelBatcher> batcher)
+BatchingModel::BatchingModel(std::shared_ptr<internal::ModelBatcher> batcher,
+                             InferencePriority priority)
     : Model(batcher->name(), batcher->feature_descriptor()),
-      batcher_(std::move(batcher)) {}
+      batcher_(std::move(batcher)),
+      priority_(priority) {}
 
 void BatchingModel::RunMany(const std::vector<const ModelInput*>& inputs,
                             std::vector<ModelOutput*>* outputs,
                             std::string* model) {
-  batcher_->RunMany(other_batcher_.get(), inputs, outputs, model);
+  batcher_->RunMany(other_batcher_.get(), inputs, outputs, model, priority_);
+}
+
+void BatchingModel::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                                 std::vector<ModelOutput*>* outputs,
+                                 std::string* model,
+                                 std::function<void()> callback) {
+  batcher_->RunManyAsync(other_batcher_.get(), inputs, outputs, model,
+                         priority_, std::move(callback));
 }
 
 void BatchingModel::StartGame() { batcher_->StartGame(); }
@@ -208,7 +359,7 @@ BatchingModelFactory::BatchingModelFactory(std::string device, int buffer_count)
     : device_(std::move(device)), buffer_count_(buffer_count) {}
 
 std::unique_ptr<BatchingModel> BatchingModelFactory::NewModel(
-    const std::string& path) {
+    const std::string& path, InferencePriority priority) {
   absl::MutexLock lock(&mutex_);
 
   // Find or create a service for the requested model.
@@ -225,7 +376,7 @@ std::unique_ptr<BatchingModel> BatchingModelFactory::NewModel(
     it = batchers_.emplace(path, std::move(batcher)).first;
   }
 
-  auto model = absl::make_unique<BatchingModel>(it->second);
+  auto model = absl::make_unique<BatchingModel>(it->second, priority);
 
   // Take this opportunity to prune any services that have no clients.
   it = batchers_.begin();
@@ -16,8 +16,8 @@
 #define CC_MODEL_BATCHING_MODEL_H_
 
 #include <atomic>
+#include <functional>
 #include <memory>
-#include <queue>
 #include <string>
 #include <vector>
 
@@ -25,6 +25,7 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
+#include "cc/latency_histogram.h"
 #include "cc/model/factory.h"
 #include "cc/model/model.h"
 
@@ -34,9 +35,25 @@ struct BatchingModelStats {
   explicit BatchingModelStats(size_t buffer_count)
       : buffer_count(buffer_count) {}
   size_t num_inferences = 0;
+  size_t num_batches = 0;
   size_t buffer_count = 0;
   absl::Duration run_batch_time;
   absl::Duration run_many_time;
+
+  // Snapshot of the adaptive batching parameters at the time the stats were
+  // flushed, see ModelBatcher::UpdateBatchingParams.
+  size_t target_batch_size = 0;
+  absl::Duration flush_timeout;
+};
+
+// Priority lane for a BatchingModel client's inference requests. High
+// priority requests (e.g. from an interactive GTP frontend that shares a GPU
+// with background selfplay) are batched ahead of queued low priority
+// requests and preempt batch assembly: the batcher runs a partial batch
+// rather than making a high priority request wait for a full one.
+enum class InferencePriority {
+  kLow,
+  kHigh,
 };
 
 namespace internal {
@@ -46,6 +63,13 @@ namespace internal {
 // efficient) inferences.
 // Each ModelBatcher instance is responsible for batching inference requests
 // for a single model.
+// The target batch size adapts to the measured per-batch latency and queue
+// depth: it grows while there are more queued requests than fit in a batch
+// and shrinks when batches repeatedly launch under-full (e.g. at the end of
+// a run when few games are left). A flush timeout derived from the average
+// batch latency bounds how long a partially filled batch can wait, so
+// shrinking game counts degrade into smaller, prompt batches instead of
+// stalls.
 class ModelBatcher {
  public:
   // A single inference request from a client, possibly containing multiple
@@ -55,7 +79,13 @@ class ModelBatcher {
     const std::vector<const ModelInput*>* inputs;
     std::vector<ModelOutput*>* outputs;
     std::string* model_name;
-    absl::Notification* notification;
+
+    // Invoked once the request's outputs have been filled in, after the
+    // batch it was assigned to has run.
+    std::function<void()> callback;
+
+    // When the request was enqueued, used to enforce the flush timeout.
+    absl::Time enqueue_time;
   };
 
   // model_impl: the model that will evaluate the batched inferences.
@@ -71,20 +101,88 @@ class ModelBatcher {
   void EndGame() LOCKS_EXCLUDED(&mutex_);
   void RunMany(ModelBatcher* other_batcher,
                const std::vector<const ModelInput*>& inputs,
-               std::vector<ModelOutput*>* outputs, std::string* model_name);
+               std::vector<ModelOutput*>* outputs, std::string* model_name,
+               InferencePriority priority);
+
+  // Like RunMany but returns as soon as the request has been enqueued,
+  // invoking `callback` once the batch containing the request has run. The
+  // callback is invoked on whichever thread runs the batch.
+  void RunManyAsync(ModelBatcher* other_batcher,
+                    const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs, std::string* model_name,
+                    InferencePriority priority, std::function<void()> callback);
+
   BatchingModelStats FlushStats() LOCKS_EXCLUDED(&mutex_);
 
  private:
+  // FIFO of pending requests, backed by a ring over a flat vector. The
+  // buffer only grows when more requests are queued than ever before, so
+  // steady-state enqueue and dequeue never touch the heap (a std::queue's
+  // deque churns through chunk allocations as requests drain).
+  class RequestQueue {
+   public:
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    const InferenceRequest& front() const { return buffer_[head_]; }
+    InferenceRequest& front() { return buffer_[head_]; }
+    void push(InferenceRequest request);
+    void pop();
+
+   private:
+    std::vector<InferenceRequest> buffer_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+  };
+
+  // Scratch storage for assembling one batch. The mutex is released while
+  // the model runs, so one batch per buffered model can be in flight at a
+  // time, each using its own slab. Completed batches return their slab to
+  // free_slabs_ for reuse: once every slab has grown to the steady-state
+  // batch size, batch assembly stops allocating.
+  struct BatchSlab {
+    std::vector<const ModelInput*> inputs;
+    std::vector<ModelOutput*> outputs;
+    std::vector<InferenceRequest> inferences;
+
+    void Clear();
+  };
+
   size_t GetBatchSize() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
 
   void MaybeRunBatchesLocked() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
   void RunBatch() EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
 
+  // Adjusts target_batch_size_ and flush_timeout_ after a batch has run.
+  // `queue_depth` is the number of queued requests when the batch was
+  // launched, `batch_size` the number of requests it contained and `latency`
+  // how long the model took to evaluate it.
+  void UpdateBatchingParams(size_t queue_depth, size_t batch_size,
+                            absl::Duration latency)
+      EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
   absl::Mutex mutex_;
   std::unique_ptr<Model> model_impl_;
-  std::queue<InferenceRequest> queue_ GUARDED_BY(&mutex_);
+  RequestQueue queue_ GUARDED_BY(&mutex_);
+
+  // Requests from high priority clients. Batches are filled from this queue
+  // first and its requests never wait for a batch to fill up.
+  RequestQueue high_priority_queue_ GUARDED_BY(&mutex_);
+
+  // Slabs not currently in use by an in-flight batch.
+  std::vector<std::unique_ptr<BatchSlab>> free_slabs_ GUARDED_BY(&mutex_);
+
   BatchingModelStats stats_ GUARDED_BY(&mutex_);
 
+  // Per-batch latency broken down by layer, reported when the batcher is
+  // destroyed. stats_.run_many_time only tracks the aggregate wall time
+  // around the model, which conflates host queueing with device execution;
+  // these histograms separate how long requests sat in the queue from how
+  // long the model took to evaluate the batches, so a slowdown can be
+  // attributed to the right layer. LatencyHistogram is lock-free, so these
+  // aren't guarded by mutex_.
+  LatencyHistogram queue_wait_histogram_;
+  LatencyHistogram run_many_histogram_;
+
   // Number of clients of this batcher that are playing in a two player game
   // and are currently waiting for the other player to play a move. These
   // clients are not going to make an inference request until it's their turn
@@ -97,6 +195,20 @@ class ModelBatcher {
   // Stats that get reported when the ModelBatcher is destroyed.
   size_t num_batches_ GUARDED_BY(&mutex_) = 0;
   size_t num_inferences_ GUARDED_BY(&mutex_) = 0;
+
+  // Adaptive target batch size, in requests. 0 until the first batch has
+  // run, in which case the batch size is derived from the number of active
+  // clients as before.
+  size_t target_batch_size_ GUARDED_BY(&mutex_) = 0;
+
+  // Exponential moving average of the model's per-batch latency.
+  absl::Duration avg_batch_latency_ GUARDED_BY(&mutex_);
+
+  // How long the request at the front of the queue is allowed to wait for
+  // its batch to fill up before the batch is run regardless. The deadline is
+  // checked whenever a request is enqueued or a batch completes, so it's
+  // enforced opportunistically rather than by a dedicated timer thread.
+  absl::Duration flush_timeout_ GUARDED_BY(&mutex_) = absl::Milliseconds(10);
 };
 
 }  // namespace internal
@@ -107,12 +219,17 @@ class ModelBatcher {
 // ModelBatcher knows whose turn it is.
 class BatchingModel : public Model {
  public:
-  explicit BatchingModel(std::shared_ptr<internal::ModelBatcher> batcher);
+  BatchingModel(std::shared_ptr<internal::ModelBatcher> batcher,
+                InferencePriority priority);
 
   void RunMany(const std::vector<const ModelInput*>& inputs,
                std::vector<ModelOutput*>* outputs,
                std::string* model_name) override;
 
+  void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs, std::string* model_name,
+                    std::function<void()> callback) override;
+
   void StartGame();
   void EndGame();
   void SetOther(BatchingModel* other);
@@ -123,6 +240,9 @@ class BatchingModel : public Model {
   // The ModelBatcher used to batch our RunMany calls.
   std::shared_ptr<internal::ModelBatcher> batcher_;
 
+  // Priority lane our requests are assigned to.
+  const InferencePriority priority_;
+
   // In a two player game where StartGame was called with different
   // BatchingModel instances, other_batcher_ points to the ModelBatcher
   // used by the other player in the game. It's possible that batcher_ ==
@@ -136,7 +256,9 @@ class BatchingModelFactory {
  public:
   BatchingModelFactory(std::string device, int buffer_count);
 
-  std::unique_ptr<BatchingModel> NewModel(const std::string& path);
+  std::unique_ptr<BatchingModel> NewModel(
+      const std::string& path,
+      InferencePriority priority = InferencePriority::kLow);
 
   static void StartGame(Model* black, Model* white);
   static void EndGame(Model* black, Model* white);
@@ -14,6 +14,12 @@
 
 #include "cc/model/buffered_model.h"
 
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "cc/logging.h"
+
 namespace minigo {
 
 BufferedModel::BufferedModel(std::vector<std::unique_ptr<Model>> impls)
@@ -25,16 +31,67 @@ BufferedModel::BufferedModel(std::vector<std::unique_ptr<Model>> impls)
              feature_descriptor().set_bytes);
     MG_CHECK(x->feature_descriptor().set_floats ==
              feature_descriptor().set_floats);
-    impls_.Push(std::move(x));
+    devices_.push_back(absl::make_unique<Device>(std::move(x)));
   }
 }
 
 void BufferedModel::RunMany(const std::vector<const ModelInput*>& inputs,
                             std::vector<ModelOutput*>* outputs,
                             std::string* model_name) {
-  auto impl = impls_.Pop();
-  impl->RunMany(inputs, outputs, model_name);
-  impls_.Push(std::move(impl));
+  auto* device = AcquireDevice();
+  auto start_time = absl::Now();
+  device->model->RunMany(inputs, outputs, model_name);
+  ReleaseDevice(device, absl::Now() - start_time);
+}
+
+void BufferedModel::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                                 std::vector<ModelOutput*>* outputs,
+                                 std::string* model_name,
+                                 std::function<void()> callback) {
+  auto* device = AcquireDevice();
+  auto start_time = absl::Now();
+  device->model->RunManyAsync(
+      inputs, outputs, model_name, [this, device, start_time, callback]() {
+        ReleaseDevice(device, absl::Now() - start_time);
+        callback();
+      });
+}
+
+BufferedModel::Device* BufferedModel::AcquireDevice() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(this, &BufferedModel::any_idle));
+
+  // Route the batch to the idle device with the lowest average latency.
+  // Devices that haven't evaluated a batch yet have a zero average and so
+  // are always tried first.
+  Device* best = nullptr;
+  for (auto& device : devices_) {
+    if (!device->busy &&
+        (best == nullptr || device->avg_latency < best->avg_latency)) {
+      best = device.get();
+    }
+  }
+  best->busy = true;
+  return best;
+}
+
+void BufferedModel::ReleaseDevice(Device* device, absl::Duration latency) {
+  absl::MutexLock lock(&mutex_);
+  device->busy = false;
+  if (device->avg_latency == absl::ZeroDuration()) {
+    device->avg_latency = latency;
+  } else {
+    device->avg_latency = device->avg_latency * 0.9 + latency * 0.1;
+  }
+}
+
+bool BufferedModel::any_idle() const {
+  for (const auto& device : devices_) {
+    if (!device->busy) {
+      return true;
+    }
+  }
+  return false;
 }
 
 }  // namespace minigo
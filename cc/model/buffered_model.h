@@ -19,11 +19,18 @@
 #include <string>
 #include <vector>
 
-#include "cc/async/thread_safe_queue.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "cc/model/model.h"
 
 namespace minigo {
 
+// BufferedModel multiplexes RunMany calls over multiple Model instances,
+// typically one per inference device. Each batch is routed to the idle
+// instance with the lowest average per-batch latency, so on hosts with
+// heterogeneous devices the faster ones serve proportionally more batches
+// instead of a slow device dragging down a round-robin rotation.
 class BufferedModel : public Model {
  public:
   explicit BufferedModel(std::vector<std::unique_ptr<Model>> impls);
@@ -32,8 +39,38 @@ class BufferedModel : public Model {
                std::vector<ModelOutput*>* outputs,
                std::string* model_name) override;
 
+  void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                    std::vector<ModelOutput*>* outputs, std::string* model_name,
+                    std::function<void()> callback) override;
+
  private:
-  ThreadSafeQueue<std::unique_ptr<Model>> impls_;
+  // State for a single Model instance. All fields but `model` are guarded by
+  // mutex_.
+  struct Device {
+    explicit Device(std::unique_ptr<Model> model) : model(std::move(model)) {}
+
+    std::unique_ptr<Model> model;
+
+    // Whether the device is currently evaluating a batch.
+    bool busy = false;
+
+    // Exponential moving average of the device's per-batch latency.
+    absl::Duration avg_latency;
+  };
+
+  // Returns the idle device expected to evaluate a batch soonest, marking it
+  // busy. Blocks until a device is idle.
+  Device* AcquireDevice() LOCKS_EXCLUDED(&mutex_);
+
+  // Marks the device idle again and folds the latency of the batch it just
+  // evaluated into its average.
+  void ReleaseDevice(Device* device, absl::Duration latency)
+      LOCKS_EXCLUDED(&mutex_);
+
+  bool any_idle() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  mutable absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Device>> devices_ GUARDED_BY(&mutex_);
 };
 
 }  // namespace minigo
@@ -14,6 +14,7 @@
 #ifndef CC_MODEL_MODEL_FACTORY_H_
 #define CC_MODEL_MODEL_FACTORY_H_
 
+#include <cstddef>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -79,10 +80,48 @@ class ModelMetadata {
   absl::flat_hash_map<std::string, ModelProperty> impl_;
 };
 
+// Immutable buffer of serialized model bytes.
+// The buffer either owns heap storage, or views a read-only file mapping
+// from the host-local model cache that is shared with other processes on the
+// host (see cc/model/model_cache.h). Copies share the underlying storage.
+class ModelBytes {
+ public:
+  ModelBytes() = default;
+
+  // Takes ownership of `bytes`.
+  explicit ModelBytes(std::string bytes) {
+    auto owner = std::make_shared<std::string>(std::move(bytes));
+    data_ = owner->data();
+    size_ = owner->size();
+    owner_ = std::move(owner);
+  }
+
+  // Views `size` bytes starting at `data`, which must remain valid for as
+  // long as `owner` is alive.
+  ModelBytes(std::shared_ptr<const void> owner, const char* data, size_t size)
+      : owner_(std::move(owner)), data_(data), size_(size) {}
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns a buffer viewing the bytes from `pos` onwards, sharing the
+  // underlying storage.
+  ModelBytes Suffix(size_t pos) const {
+    MG_CHECK(pos <= size_);
+    return ModelBytes(owner_, data_ + pos, size_ - pos);
+  }
+
+ private:
+  std::shared_ptr<const void> owner_;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
 struct ModelDefinition {
   std::string path;
   ModelMetadata metadata;
-  std::string model_bytes;
+  ModelBytes model_bytes;
 };
 
 // Factory that creates Model instances.
@@ -14,12 +14,124 @@
 
 #include "cc/model/features.h"
 
+// The AVX2 plane expansion kernels are compiled with per-function target
+// attributes and selected at runtime, following the same pattern as the
+// child action score kernels in mcts_tree.cc.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MG_INTERNAL_HAVE_AVX_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
 #include "cc/logging.h"
 
 namespace minigo {
+namespace internal {
+namespace {
+
+// Scalar bit-to-byte expansion, one word at a time.
+template <typename T>
+void ExpandPlaneScalar(const Bitboard& src, T* dst) {
+  int i = 0;
+  for (auto word : src.words()) {
+    for (int bit = 0; bit < 64 && i < kNumPoints; ++bit, ++i) {
+      dst[i] = static_cast<T>((word >> bit) & 1);
+    }
+  }
+}
+
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+
+// Expands 32 bits into 32 bytes of 0/1 per iteration: each source byte is
+// replicated across 8 output bytes with a shuffle, masked down to one bit
+// per lane and compared against the mask.
+__attribute__((target("avx2"))) void ExpandPlaneAvx2(const Bitboard& src,
+                                                     uint8_t* dst) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(src.words().data());
+
+  // vpshufb shuffles within 128 bit lanes: both lanes hold the same 32 bit
+  // chunk, so the low lane picks bytes 0 and 1 and the high lane bytes 2
+  // and 3.
+  const __m256i shuffle = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,  //
+      2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i bits = _mm256_set1_epi64x(0x8040201008040201);
+  const __m256i one = _mm256_set1_epi8(1);
+
+  constexpr int kSafePoints = (kNumPoints / 32) * 32;
+  int i = 0;
+  for (; i < kSafePoints; i += 32) {
+    uint32_t chunk;
+    memcpy(&chunk, bytes + i / 8, sizeof(chunk));
+    __m256i v = _mm256_set1_epi32(chunk);
+    v = _mm256_shuffle_epi8(v, shuffle);
+    v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_and_si256(v, one));
+  }
+  for (; i < kNumPoints; ++i) {
+    dst[i] = src.test(i);
+  }
+}
+
+// Expands 8 bits into 8 floats of 0.0/1.0 per iteration.
+__attribute__((target("avx2"))) void ExpandPlaneAvx2(const Bitboard& src,
+                                                     float* dst) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(src.words().data());
+
+  const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  const __m256 one = _mm256_set1_ps(1.0f);
+
+  constexpr int kSafePoints = (kNumPoints / 8) * 8;
+  int i = 0;
+  for (; i < kSafePoints; i += 8) {
+    __m256i v = _mm256_set1_epi32(bytes[i / 8]);
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(v, bits), bits);
+    _mm256_storeu_ps(dst + i, _mm256_and_ps(_mm256_castsi256_ps(eq), one));
+  }
+  for (; i < kNumPoints; ++i) {
+    dst[i] = src.test(i) ? 1.0f : 0.0f;
+  }
+}
+
+// Returns true if the CPU supports AVX2.
+bool DetectAvx2() { return __builtin_cpu_supports("avx2") != 0; }
+
+#endif  // MG_INTERNAL_HAVE_AVX_DISPATCH
+
+}  // namespace
+
+void ExpandPlane(const Bitboard& src, uint8_t* dst) {
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const bool have_avx2 = DetectAvx2();
+  if (have_avx2) {
+    return ExpandPlaneAvx2(src, dst);
+  }
+#endif
+  ExpandPlaneScalar(src, dst);
+}
+
+void ExpandPlane(const Bitboard& src, float* dst) {
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const bool have_avx2 = DetectAvx2();
+  if (have_avx2) {
+    return ExpandPlaneAvx2(src, dst);
+  }
+#endif
+  ExpandPlaneScalar(src, dst);
+}
+
+}  // namespace internal
 
 FeatureDescriptor FeatureDescriptor::Create(absl::string_view input_features,
                                             absl::string_view input_layout) {
+  return Create(input_features, input_layout, "float");
+}
+
+FeatureDescriptor FeatureDescriptor::Create(absl::string_view input_features,
+                                            absl::string_view input_layout,
+                                            absl::string_view input_type) {
   FeatureDescriptor::Layout layout;
   if (input_layout == "nhwc") {
     layout = FeatureDescriptor::Layout::kNhwc;
@@ -30,10 +142,20 @@ FeatureDescriptor FeatureDescriptor::Create(absl::string_view input_features,
     return {};
   }
 
+  FeatureDescriptor::Dtype dtype;
+  if (input_type == "float") {
+    dtype = FeatureDescriptor::Dtype::kFloat;
+  } else if (input_type == "uint8" || input_type == "bool") {
+    dtype = FeatureDescriptor::Dtype::kUint8;
+  } else {
+    MG_LOG(FATAL) << "Unrecognized input type \"" << input_type << "\"";
+    return {};
+  }
+
   if (input_features == "agz") {
-    return FeatureDescriptor::Create<AgzFeatures>(layout);
+    return FeatureDescriptor::Create<AgzFeatures>(layout, dtype);
   } else if (input_features == "mlperf07") {
-    return FeatureDescriptor::Create<Mlperf07Features>(layout);
+    return FeatureDescriptor::Create<Mlperf07Features>(layout, dtype);
   } else {
     MG_LOG(FATAL) << "Unrecognized input features \"" << input_features << "\"";
     return {};
@@ -15,13 +15,12 @@
 #ifndef CC_MODEL_FEATURES_H_
 #define CC_MODEL_FEATURES_H_
 
-#include <emmintrin.h>
-
 #include <array>
 #include <utility>
 
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "cc/bitboard.h"
 #include "cc/color.h"
 #include "cc/constants.h"
 #include "cc/logging.h"
@@ -39,6 +38,11 @@
 //  - kNumPlanes : the number of planes for this feature.
 //  - SetNhwc : a method that sets NHWC feature on an input tensor.
 //  - SetNchw : a method that sets NCWH feature on an input tensor.
+//
+// SetNhwc takes a `src_coords` table mapping each point of the output tensor
+// to the board coordinate whose features should be written there, so that the
+// input's symmetry is applied as the features are generated instead of in a
+// separate pass over the tensor.
 
 namespace minigo {
 
@@ -56,118 +60,81 @@ struct StoneFeatures {
 
   template <typename T>
   MG_ALWAYS_INLINE static void SetNhwc(const ModelInput& input, int num_planes,
-                                       T* dst) {
-    auto my_color = input.position_history[0]->to_play();
+                                       const Coord* src_coords, T* dst) {
+    auto my_color = input.position->to_play();
     auto their_color = OtherColor(my_color);
 
-    auto n = std::min(input.position_history.size(), PositionHistory);
-
-    // Write the features for the position history that we have.
-    int j = 0;
-    for (; j < n; ++j) {
-      const auto* src = input.position_history[j]->stones().data();
-      const auto* end = dst + kNumPoints * num_planes;
-      for (auto* d = dst + j * 2; d < end; d += num_planes) {
-        auto color = src->color();
-        src += 1;
-        d[0] = color == my_color;
-        d[1] = color == their_color;
-      }
-    }
-
-    // Pad the features with zeros if we have fewer than 8 moves of history.
-    for (; j < PositionHistory; ++j) {
-      const auto* end = dst + kNumPoints * num_planes;
-      for (auto* d = dst + j * 2; d < end; d += num_planes) {
-        d[0] = 0;
-        d[1] = 0;
-      }
-    }
-  }
-
-  MG_ALWAYS_INLINE static void SetNchw(const ModelInput& input, float* dst) {
-    auto my_color = input.position_history[0]->to_play();
-    auto their_color = OtherColor(my_color);
-
-    auto n = std::min(input.position_history.size(), PositionHistory);
-
-    // Write the features for the position history that we have.
-    int j = 0;
-    for (; j < n; ++j) {
-      const auto& stones = input.position_history[j]->stones();
-      for (const auto& stone : stones) {
-        *dst++ = stone.color() == my_color;
+    auto n = std::min(input.stone_history.size(), PositionHistory);
+
+    // Consecutive positions in the history differ by only one move plus any
+    // captures, so rather than reading every position's stones at every
+    // point, seed all the history planes at each point from the oldest
+    // snapshot and then patch just the points that changed at each step.
+    // This reads O(kNumPoints + changed points) stones instead of
+    // O(kNumPoints * n).
+    const auto& oldest = *input.stone_history[n - 1];
+    const auto& oldest_mine =
+        my_color == Color::kBlack ? oldest.black : oldest.white;
+    const auto& oldest_theirs =
+        my_color == Color::kBlack ? oldest.white : oldest.black;
+    for (int i = 0; i < kNumPoints; ++i) {
+      T mine = oldest_mine.test(src_coords[i]);
+      T theirs = oldest_theirs.test(src_coords[i]);
+      auto* d = dst + i * num_planes;
+      int j = 0;
+      for (; j < n; ++j) {
+        d[2 * j] = mine;
+        d[2 * j + 1] = theirs;
       }
-      for (const auto& stone : stones) {
-        *dst++ = stone.color() == their_color;
+      // Pad the features with zeros if we have fewer than 8 moves of history.
+      for (; j < PositionHistory; ++j) {
+        d[2 * j] = 0;
+        d[2 * j + 1] = 0;
       }
     }
 
-    // Pad the features with zeros if we have fewer than 8 moves of history.
-    for (; j < PositionHistory; ++j) {
-      for (int i = 0; i < 2 * kNumPoints; ++i) {
-        *dst++ = 0;
-      }
+    // Replay the history from oldest to newest. The points that changed at
+    // each step are found by diffing the two snapshots' stone bitboards and
+    // take that step's color in all newer planes, until a later step patches
+    // them again.
+    for (int j = n - 2; j >= 0; --j) {
+      const auto& snapshot = *input.stone_history[j];
+      const auto& prev = *input.stone_history[j + 1];
+      auto changed =
+          (snapshot.black ^ prev.black) | (snapshot.white ^ prev.white);
+      changed.ForEach([&](int p) {
+        auto color = snapshot.color_at(p);
+        T mine = color == my_color;
+        T theirs = color == their_color;
+        auto* d =
+            dst + symmetry::ApplySymmetry(input.sym, Coord(p)) * num_planes;
+        for (int jj = 0; jj <= j; ++jj) {
+          d[2 * jj] = mine;
+          d[2 * jj + 1] = theirs;
+        }
+      });
     }
   }
 
-  MG_ALWAYS_INLINE static void SetNchw(const ModelInput& input, uint8_t* dst) {
-    auto my_color = input.position_history[0]->to_play();
-    auto their_color = OtherColor(my_color);
-
-    auto n = std::min(input.position_history.size(), PositionHistory);
-
-    // Stones are stored as bit-packed uint16_t, with the color stored in the
-    // bottom two bits.
-    static_assert(sizeof(Stone) == 2, "");
-    __m128i color_mask = _mm_set1_epi16(3);
+  template <typename T>
+  MG_ALWAYS_INLINE static void SetNchw(const ModelInput& input, T* dst) {
+    auto my_color = input.position->to_play();
 
-    // Initialize useful single byte values.
-    __m128i one = _mm_set1_epi8(1);
-    __m128i my_color_mm = _mm_set1_epi8(static_cast<int>(my_color));
-    __m128i their_color_mm = _mm_set1_epi8(static_cast<int>(their_color));
+    auto n = std::min(input.stone_history.size(), PositionHistory);
 
-    // Write the features for the position history that we have.
-    int safe_size = (kNumPoints / 16) * 16;
+    // Write the features for the position history that we have. Each plane
+    // is just one of the snapshot's stone bitboards expanded to bytes or
+    // floats.
     int j = 0;
     for (; j < n; ++j) {
-      const auto* stones = input.position_history[j]->stones().data();
-      int i = 0;
-      for (; i < safe_size; i += 16) {
-        // Load 16 stones.
-        __m128i a =
-            _mm_loadu_si128(reinterpret_cast<const __m128i*>(stones + i));
-        __m128i b =
-            _mm_loadu_si128(reinterpret_cast<const __m128i*>(stones + i + 8));
-
-        // Clear all but the bottom two bits of each stone, leaving just their
-        // colors.
-        a = _mm_and_si128(a, color_mask);
-        b = _mm_and_si128(b, color_mask);
-
-        // Extract the color values from a & b and pack them into a single.
-        __m128i col = _mm_packus_epi16(a, b);
-
-        // Generate 16 input features for two planes: current player's stones
-        // and opponent's stones.
-        // my[i] = col[i] == my_color ? 1 : 0.
-        // their[i] = col[i] == their_color ? 1 : 0.
-        __m128i my = _mm_and_si128(one, _mm_cmpeq_epi8(col, my_color_mm));
-        __m128i their = _mm_and_si128(one, _mm_cmpeq_epi8(col, their_color_mm));
-
-        // Store the input features.
-        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), my);
-        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + kNumPoints), their);
-        dst += 16;
-      }
-
-      // Finish up the last few input features.
-      for (; i < kNumPoints; ++i) {
-        auto color = stones[i].color();
-        dst[0] = color == my_color;
-        dst[kNumPoints] = color == their_color;
-        dst += 1;
-      }
+      const auto& snapshot = *input.stone_history[j];
+      const auto& my_stones =
+          my_color == Color::kBlack ? snapshot.black : snapshot.white;
+      const auto& their_stones =
+          my_color == Color::kBlack ? snapshot.white : snapshot.black;
+      internal::ExpandPlane(my_stones, dst);
+      dst += kNumPoints;
+      internal::ExpandPlane(their_stones, dst);
       dst += kNumPoints;
     }
 
@@ -184,10 +151,12 @@ struct StoneFeatures {
 struct ToPlayFeature {
   static constexpr int kNumPlanes = 1;
 
+  // The plane is constant, so the symmetry lookup through `src_coords` is a
+  // no-op.
   template <typename T>
   MG_ALWAYS_INLINE static void SetNhwc(const ModelInput& input, int num_planes,
-                                       T* dst) {
-    T f = input.position_history[0]->to_play() == Color::kBlack;
+                                       const Coord* src_coords, T* dst) {
+    T f = input.position->to_play() == Color::kBlack;
     const auto* end = dst + kNumPoints * num_planes;
     for (auto* d = dst; d < end; d += num_planes) {
       d[0] = f;
@@ -196,7 +165,7 @@ struct ToPlayFeature {
 
   template <typename T>
   MG_ALWAYS_INLINE static void SetNchw(const ModelInput& input, T* dst) {
-    T f = input.position_history[0]->to_play() == Color::kBlack;
+    T f = input.position->to_play() == Color::kBlack;
     for (int i = 0; i < kNumPoints; ++i) {
       *dst++ = f;
     }
@@ -208,31 +177,28 @@ struct ToPlayFeature {
 struct LibertyFeatures {
   static constexpr int kNumPlanes = 3;
 
+  // The position maintains the liberty-bucket planes alongside its legal
+  // moves, so extraction just reads three bitplanes instead of looking up
+  // every point's group.
   template <typename T>
   MG_ALWAYS_INLINE static void SetNhwc(const ModelInput& input, int num_planes,
-                                       T* dst) {
-    const auto& position = *input.position_history[0];
+                                       const Coord* src_coords, T* dst) {
+    const auto& planes = input.position->liberty_planes();
     for (int i = 0; i < kNumPoints; ++i) {
-      auto num_liberties = position.num_chain_liberties(i);
-      dst[0] = num_liberties == 1;
-      dst[1] = num_liberties == 2;
-      dst[2] = num_liberties >= 3;
+      auto c = src_coords[i];
+      dst[0] = planes[0].test(c);
+      dst[1] = planes[1].test(c);
+      dst[2] = planes[2].test(c);
       dst += num_planes;
     }
   }
 
   template <typename T>
   MG_ALWAYS_INLINE static void SetNchw(const ModelInput& input, T* dst) {
-    const auto& position = *input.position_history[0];
-    auto* dst0 = dst;
-    auto* dst1 = dst0 + kNumPoints;
-    auto* dst2 = dst1 + kNumPoints;
-    for (int i = 0; i < kNumPoints; ++i) {
-      auto num_liberties = position.num_chain_liberties(i);
-      *dst0++ = num_liberties == 1;
-      *dst1++ = num_liberties == 2;
-      *dst2++ = num_liberties >= 3;
-    }
+    const auto& planes = input.position->liberty_planes();
+    internal::ExpandPlane(planes[0], dst);
+    internal::ExpandPlane(planes[1], dst + kNumPoints);
+    internal::ExpandPlane(planes[2], dst + 2 * kNumPoints);
   }
 };
 
@@ -241,42 +207,39 @@ struct WouldCaptureFeature {
 
   template <typename T>
   MG_ALWAYS_INLINE static void SetNhwc(const ModelInput& input, int num_planes,
-                                       T* dst) {
-    const auto& position = *input.position_history[0];
-    auto my_color = position.to_play();
-    auto their_color = OtherColor(my_color);
-    const auto& stones = position.stones();
-
+                                       const Coord* src_coords, T* dst) {
+    auto would_capture = ComputeWouldCapture(*input.position);
     for (int i = 0; i < kNumPoints; ++i) {
-      int f = 0;
-      if (position.legal_move(i)) {
-        for (auto nc : kNeighborCoords[i]) {
-          f |= ((stones[nc].color() == their_color) &
-                (position.num_chain_liberties(nc) == 1));
-        }
-      }
-      dst[0] = f;
+      dst[0] = would_capture.test(src_coords[i]);
       dst += num_planes;
     }
   }
 
   template <typename T>
   MG_ALWAYS_INLINE static void SetNchw(const ModelInput& input, T* dst) {
-    const auto& position = *input.position_history[0];
-    auto my_color = position.to_play();
-    auto their_color = OtherColor(my_color);
+    internal::ExpandPlane(ComputeWouldCapture(*input.position),
+                          dst);
+  }
+
+ private:
+  // Returns the bitboard of legal moves that would capture at least one
+  // opponent stone: the neighbors of the opponent's chains in atari,
+  // restricted to legal points.
+  static Bitboard ComputeWouldCapture(const Position& position) {
+    auto their_color = OtherColor(position.to_play());
     const auto& stones = position.stones();
 
+    Bitboard would_capture;
     for (int i = 0; i < kNumPoints; ++i) {
-      int f = 0;
-      if (position.legal_move(i)) {
+      if (stones[i].color() == their_color &&
+          position.num_chain_liberties(i) == 1) {
         for (auto nc : kNeighborCoords[i]) {
-          f |= ((stones[nc].color() == their_color) &
-                (position.num_chain_liberties(nc) == 1));
+          would_capture.set(nc);
         }
       }
-      *dst++ = f;
     }
+    would_capture &= position.legal_bitboard();
+    return would_capture;
   }
 };
 
@@ -310,11 +273,14 @@ struct Features {
 
     int stride = features->shape[1] * features->shape[2] * features->shape[3];
     auto* data = features->data;
-    std::array<T, kNumPoints * kNumPlanes> raw_features;
     for (const auto* input : inputs) {
-      Impl::SetAllNhwc(*input, Impl::kNumPlanes, raw_features.data());
-      symmetry::ApplySymmetry<kN, kNumPlanes>(input->sym, raw_features.data(),
-                                              data);
+      // Rather than generating the features and then permuting the whole
+      // tensor by the input's symmetry in a second pass, read each feature
+      // through the symmetry's source coordinate table as it's written:
+      // `kCoords[sym][i]` is the coordinate whose value ApplySymmetry would
+      // have placed at point `i`.
+      Impl::SetAllNhwc(*input, Impl::kNumPlanes,
+                       symmetry::kCoords[input->sym].data(), data);
       data += stride;
     }
   }
@@ -364,19 +330,27 @@ struct FeatureDescriptor {
     kNchw,
   };
 
+  // Element type of the model's input feature tensor. Minigo's features are
+  // all small integral values, so models may take them as single bytes
+  // instead of floats, quartering the feature tensor's memory bandwidth.
+  enum class Dtype {
+    kFloat,
+    kUint8,
+  };
+
   template <typename T>
   using SetFeaturesFn = void (*)(absl::Span<const ModelInput* const>,
                                  Tensor<T>*);
 
   template <typename FeatureType>
-  static FeatureDescriptor Create(Layout layout) {
+  static FeatureDescriptor Create(Layout layout, Dtype dtype = Dtype::kFloat) {
     switch (layout) {
       case Layout::kNhwc:
-        return FeatureDescriptor{FeatureType::kNumPlanes, layout,
+        return FeatureDescriptor{FeatureType::kNumPlanes, layout, dtype,
                                  &FeatureType::template SetNhwc<uint8_t>,
                                  &FeatureType::template SetNhwc<float>};
       case Layout::kNchw:
-        return FeatureDescriptor{FeatureType::kNumPlanes, layout,
+        return FeatureDescriptor{FeatureType::kNumPlanes, layout, dtype,
                                  &FeatureType::template SetNchw<uint8_t>,
                                  &FeatureType::template SetNchw<float>};
     }
@@ -387,6 +361,12 @@ struct FeatureDescriptor {
   static FeatureDescriptor Create(absl::string_view input_features,
                                   absl::string_view input_layout);
 
+  // Like the two argument overload, but also sets the input tensor's element
+  // type: "float" or "uint8".
+  static FeatureDescriptor Create(absl::string_view input_features,
+                                  absl::string_view input_layout,
+                                  absl::string_view input_type);
+
   // Returns the feature tensor shape for a batch size of `n` that uses the
   // descriptors input layout.
   TensorShape GetInputShape(int n) const {
@@ -410,8 +390,14 @@ struct FeatureDescriptor {
     set_floats(inputs, features);
   }
 
+  // Returns the size in bytes of one feature tensor element.
+  int bytes_per_element() const {
+    return dtype == Dtype::kUint8 ? sizeof(uint8_t) : sizeof(float);
+  }
+
   int num_planes;
   Layout layout;
+  Dtype dtype;
   SetFeaturesFn<uint8_t> set_bytes;
   SetFeaturesFn<float> set_floats;
 };
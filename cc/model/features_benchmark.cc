@@ -35,9 +35,20 @@ void BenchmarkFeatures(absl::string_view input_features,
 
   Random rnd(23423, 23454);
 
+  // Play out a random game, snapshotting the position after every move, so
+  // that the feature generation runs on realistic boards rather than empty
+  // ones and each input's position history is a run of consecutive positions
+  // like the ones selfplay generates.
+  constexpr int kNumPositions = 256;
   std::vector<Position> positions;
-  for (int i = 0; i < kBatchSize; ++i) {
-    positions.emplace_back(Color::kBlack);
+  Position position(Color::kBlack);
+  positions.push_back(position);
+  while (static_cast<int>(positions.size()) < kNumPositions) {
+    Coord c(rnd.UniformUint64() % kNumPoints);
+    if (position.legal_move(c)) {
+      position.PlayMove(c);
+      positions.push_back(position);
+    }
   }
 
   std::vector<ModelInput> inputs;
@@ -45,10 +56,12 @@ void BenchmarkFeatures(absl::string_view input_features,
     ModelInput input;
     input.sym = static_cast<symmetry::Symmetry>(rnd.UniformUint64() %
                                                 symmetry::kNumSymmetries);
-    input.sym = symmetry::kIdentity;
+    int newest = kMaxPositionHistory - 1 +
+                 static_cast<int>(rnd.UniformUint64() %
+                                  (kNumPositions - kMaxPositionHistory + 1));
+    input.position = &positions[newest];
     for (int j = 0; j < kMaxPositionHistory; ++j) {
-      input.position_history.push_back(
-          &positions[rnd.UniformUint64() % positions.size()]);
+      input.stone_history.push_back(&positions[newest - j].stone_snapshot());
     }
     inputs.push_back(input);
   }
@@ -15,8 +15,11 @@
 #ifndef CC_MODEL_FEATURES_INTERNAL_H_
 #define CC_MODEL_FEATURES_INTERNAL_H_
 
+#include <cstdint>
 #include <type_traits>
 
+#include "cc/bitboard.h"
+#include "cc/coord.h"
 #include "cc/model/types.h"
 
 // Internal implementation details of the features code.
@@ -24,6 +27,11 @@
 namespace minigo {
 namespace internal {
 
+// Expands the bitboard plane `src` into kN * kN 0/1 feature values at `dst`,
+// dispatching to an AVX2 kernel when the CPU supports it.
+void ExpandPlane(const Bitboard& src, uint8_t* dst);
+void ExpandPlane(const Bitboard& src, float* dst);
+
 // `FeaturesImpl` calls the `Set` static method on each of the feature types in
 // `Fs`.
 template <typename... Fs>
@@ -38,11 +46,15 @@ struct FeaturesImpl<First, Rest...> {
   static constexpr int kNumPlanes =
       First::kNumPlanes + FeaturesImpl<Rest...>::kNumPlanes;
 
+  // `src_coords[i]` is the board coordinate whose features should be written
+  // at point `i` of the output tensor, which lets the caller fuse a symmetry
+  // into the feature generation pass. See `Features::SetNhwc`.
   template <typename T>
-  static void SetAllNhwc(const ModelInput& input, int stride, T* dst) {
-    First::SetNhwc(input, stride, dst);
+  static void SetAllNhwc(const ModelInput& input, int stride,
+                         const Coord* src_coords, T* dst) {
+    First::SetNhwc(input, stride, src_coords, dst);
     dst += First::kNumPlanes;
-    FeaturesImpl<Rest...>::SetAllNhwc(input, stride, dst);
+    FeaturesImpl<Rest...>::SetAllNhwc(input, stride, src_coords, dst);
   }
 
   template <typename T>
@@ -67,7 +79,8 @@ struct FeaturesImpl<> {
   static constexpr int kNumPlanes = 0;
 
   template <typename T>
-  static void SetAllNhwc(const ModelInput& input, int stride, T* dst) {}
+  static void SetAllNhwc(const ModelInput& input, int stride,
+                         const Coord* src_coords, T* dst) {}
 
   template <typename T>
   static void SetAllNchw(const ModelInput& input, T* dst) {}
@@ -31,7 +31,7 @@ namespace {
 struct Planes3 {
   static constexpr int kNumPlanes = 3;
   template <typename T>
-  static void SetNhwc(const ModelInput&, int, T*) {}
+  static void SetNhwc(const ModelInput&, int, const Coord*, T*) {}
   template <typename T>
   static void SetNchw(const ModelInput&, T*) {}
 };
@@ -39,7 +39,7 @@ struct Planes3 {
 struct Planes2 {
   static constexpr int kNumPlanes = 2;
   template <typename T>
-  static void SetNhwc(const ModelInput&, int, T*) {}
+  static void SetNhwc(const ModelInput&, int, const Coord*, T*) {}
   template <typename T>
   static void SetNchw(const ModelInput&, T*) {}
 };
@@ -47,7 +47,7 @@ struct Planes2 {
 struct Planes4 {
   static constexpr int kNumPlanes = 4;
   template <typename T>
-  static void SetNhwc(const ModelInput&, int, T*) {}
+  static void SetNhwc(const ModelInput&, int, const Coord*, T*) {}
   template <typename T>
   static void SetNchw(const ModelInput&, T*) {}
 };
@@ -55,7 +55,7 @@ struct Planes4 {
 struct NotRegistered {
   static constexpr int kNumPlanes = 1;
   template <typename T>
-  static void SetNhwc(const ModelInput&, int, T*) {}
+  static void SetNhwc(const ModelInput&, int, const Coord*, T*) {}
   template <typename T>
   static void SetNchw(const ModelInput&, T*) {}
 };
@@ -113,9 +113,10 @@ struct Set1 {
   static constexpr int kNumPlanes = 1;
 
   template <typename T>
-  static void SetNhwc(const ModelInput&, int num_planes, T* dst) {
+  static void SetNhwc(const ModelInput&, int num_planes,
+                      const Coord* src_coords, T* dst) {
     for (int i = 0; i < kN * kN; ++i) {
-      dst[0] = 1000 + i;
+      dst[0] = 1000 + src_coords[i];
       dst += num_planes;
     }
   }
@@ -132,10 +133,11 @@ struct Set2 {
   static constexpr int kNumPlanes = 2;
 
   template <typename T>
-  static void SetNhwc(const ModelInput&, int num_planes, T* dst) {
+  static void SetNhwc(const ModelInput&, int num_planes,
+                      const Coord* src_coords, T* dst) {
     for (int i = 0; i < kN * kN; ++i) {
-      dst[0] = 2000 + i;
-      dst[1] = 3000 + i;
+      dst[0] = 2000 + src_coords[i];
+      dst[1] = 3000 + src_coords[i];
       dst += num_planes;
     }
   }
@@ -155,11 +157,12 @@ struct Set3 {
   static constexpr int kNumPlanes = 3;
 
   template <typename T>
-  static void SetNhwc(const ModelInput&, int num_planes, T* dst) {
+  static void SetNhwc(const ModelInput&, int num_planes,
+                      const Coord* src_coords, T* dst) {
     for (int i = 0; i < kN * kN; ++i) {
-      dst[0] = 4000 + i;
-      dst[1] = 5000 + i;
-      dst[2] = 6000 + i;
+      dst[0] = 4000 + src_coords[i];
+      dst[1] = 5000 + src_coords[i];
+      dst[2] = 6000 + src_coords[i];
       dst += num_planes;
     }
   }
@@ -235,7 +238,6 @@ TEST(FeaturesTest, TestSetNhwc) {
         }
       }
     }
-    break;
   }
 }
 
@@ -321,8 +323,9 @@ TEST(FeaturesTest, CompareNhwcNchw) {
   for (int n = 0; n < kBatchSize; ++n) {
     ModelInput input;
     input.sym = symmetry::kIdentity;
+    input.position = &positions[0];
     for (int i = 0; i <= n; ++i) {
-      input.position_history.push_back(&positions[i]);
+      input.stone_history.push_back(&positions[i].stone_snapshot());
     }
     inputs.push_back(std::move(input));
   }
@@ -366,5 +369,20 @@ TEST(FeaturesTest, CompareNhwcNchw) {
   }
 }
 
+TEST(FeaturesTest, DescriptorDtype) {
+  // Descriptors default to float features.
+  auto desc = FeatureDescriptor::Create("agz", "nhwc");
+  EXPECT_EQ(FeatureDescriptor::Dtype::kFloat, desc.dtype);
+  EXPECT_EQ(sizeof(float), desc.bytes_per_element());
+
+  // Quantized models ask for byte features; TPU models spell the type
+  // "bool" in their metadata.
+  for (const auto* input_type : {"uint8", "bool"}) {
+    desc = FeatureDescriptor::Create("agz", "nhwc", input_type);
+    EXPECT_EQ(FeatureDescriptor::Dtype::kUint8, desc.dtype);
+    EXPECT_EQ(sizeof(uint8_t), desc.bytes_per_element());
+  }
+}
+
 }  // namespace
 }  // namespace minigo
@@ -0,0 +1,204 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/flat_weights.h"
+
+#include <cstring>
+
+#include "cc/logging.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr char kMagic[8] = {'m', 'g', 'w', 'g', 'h', 't', 's', 0};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kBlobAlignment = 64;
+
+// The structs are written by oneoffs/flatten_checkpoint.py, which packs
+// them with no padding.
+static_assert(sizeof(FlatWeightsHeader) == 32, "unexpected header padding");
+static_assert(sizeof(TensorEntry) == 56, "unexpected entry padding");
+
+size_t AlignUp(size_t x) {
+  return (x + kBlobAlignment - 1) & ~(kBlobAlignment - 1);
+}
+
+// Returns the number of elements implied by a tensor's dims.
+uint64_t NumElements(absl::Span<const uint32_t> dims) {
+  uint64_t n = 1;
+  for (auto dim : dims) {
+    n *= dim;
+  }
+  return n;
+}
+
+}  // namespace
+
+size_t TensorDataTypeSize(TensorDataType type) {
+  switch (type) {
+    case TensorDataType::kFloat32:
+      return 4;
+    case TensorDataType::kFloat16:
+      return 2;
+    case TensorDataType::kInt8:
+      return 1;
+    case TensorDataType::kInt32:
+      return 4;
+  }
+  MG_LOG(FATAL) << "bad tensor data type " << static_cast<uint32_t>(type);
+  return 0;
+}
+
+bool FlatWeightsView::Parse(absl::string_view contents,
+                            FlatWeightsView* view) {
+  if (contents.size() < sizeof(FlatWeightsHeader)) {
+    MG_LOG(WARNING) << "flat weights payload too small (" << contents.size()
+                    << " bytes)";
+    return false;
+  }
+  const auto* header =
+      reinterpret_cast<const FlatWeightsHeader*>(contents.data());
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+    MG_LOG(WARNING) << "bad magic in flat weights payload";
+    return false;
+  }
+  if (header->version != kVersion) {
+    MG_LOG(WARNING) << "unsupported flat weights version " << header->version;
+    return false;
+  }
+
+  size_t directory_size = header->num_tensors * sizeof(TensorEntry);
+  if (sizeof(FlatWeightsHeader) + directory_size > contents.size() ||
+      header->name_table_offset + header->name_table_size > contents.size()) {
+    MG_LOG(WARNING) << "flat weights payload is truncated";
+    return false;
+  }
+  const auto* entries = reinterpret_cast<const TensorEntry*>(
+      contents.data() + sizeof(FlatWeightsHeader));
+
+  view->tensors_.clear();
+  view->tensors_.reserve(header->num_tensors);
+  view->index_.clear();
+  view->index_.reserve(header->num_tensors);
+  for (uint32_t i = 0; i < header->num_tensors; ++i) {
+    const auto& entry = entries[i];
+    if (entry.name_offset + entry.name_size > header->name_table_size ||
+        entry.data_offset % kBlobAlignment != 0 ||
+        entry.data_offset + entry.data_size > contents.size() ||
+        entry.type > static_cast<uint32_t>(TensorDataType::kInt32) ||
+        entry.num_dims > kMaxTensorDims) {
+      MG_LOG(WARNING) << "bad tensor " << i << " in flat weights payload";
+      return false;
+    }
+
+    Tensor tensor;
+    tensor.name = contents.substr(
+        header->name_table_offset + entry.name_offset, entry.name_size);
+    tensor.type = static_cast<TensorDataType>(entry.type);
+    tensor.dims = absl::MakeConstSpan(entry.dims, entry.num_dims);
+    tensor.data = contents.substr(entry.data_offset, entry.data_size);
+    if (tensor.data.size() !=
+        NumElements(tensor.dims) * TensorDataTypeSize(tensor.type)) {
+      MG_LOG(WARNING) << "tensor \"" << tensor.name
+                      << "\" has wrong size in flat weights payload";
+      return false;
+    }
+    if (!view->index_.emplace(tensor.name, view->tensors_.size()).second) {
+      MG_LOG(WARNING) << "duplicate tensor \"" << tensor.name
+                      << "\" in flat weights payload";
+      return false;
+    }
+    view->tensors_.push_back(tensor);
+  }
+  return true;
+}
+
+const FlatWeightsView::Tensor* FlatWeightsView::Lookup(
+    absl::string_view name) const {
+  auto it = index_.find(name);
+  return it == index_.end() ? nullptr : &tensors_[it->second];
+}
+
+void FlatWeightsBuilder::Add(absl::string_view name, TensorDataType type,
+                             absl::Span<const uint32_t> dims,
+                             absl::string_view data) {
+  MG_CHECK(dims.size() <= kMaxTensorDims);
+  MG_CHECK(data.size() == NumElements(dims) * TensorDataTypeSize(type))
+      << "tensor \"" << name << "\" data doesn't match its dims";
+  for (const auto& tensor : tensors_) {
+    MG_CHECK(tensor.name != name) << "duplicate tensor \"" << name << "\"";
+  }
+
+  PendingTensor tensor;
+  tensor.name = std::string(name);
+  tensor.type = type;
+  tensor.dims.assign(dims.begin(), dims.end());
+  tensor.data = std::string(data);
+  tensors_.push_back(std::move(tensor));
+}
+
+std::string FlatWeightsBuilder::Serialize() const {
+  FlatWeightsHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_tensors = static_cast<uint32_t>(tensors_.size());
+
+  size_t directory_size = tensors_.size() * sizeof(TensorEntry);
+  header.name_table_offset = sizeof(header) + directory_size;
+  header.name_table_size = 0;
+  for (const auto& tensor : tensors_) {
+    header.name_table_size += tensor.name.size();
+  }
+
+  // Lay out the directory and data blobs.
+  std::vector<TensorEntry> entries;
+  entries.reserve(tensors_.size());
+  uint64_t name_offset = 0;
+  size_t data_offset =
+      AlignUp(header.name_table_offset + header.name_table_size);
+  for (const auto& tensor : tensors_) {
+    TensorEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.name_offset = name_offset;
+    entry.name_size = static_cast<uint32_t>(tensor.name.size());
+    entry.type = static_cast<uint32_t>(tensor.type);
+    entry.num_dims = static_cast<uint32_t>(tensor.dims.size());
+    for (size_t i = 0; i < tensor.dims.size(); ++i) {
+      entry.dims[i] = tensor.dims[i];
+    }
+    entry.data_offset = data_offset;
+    entry.data_size = tensor.data.size();
+    entries.push_back(entry);
+
+    name_offset += tensor.name.size();
+    data_offset = AlignUp(data_offset + tensor.data.size());
+  }
+
+  std::string contents;
+  contents.reserve(data_offset);
+  contents.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  contents.append(reinterpret_cast<const char*>(entries.data()),
+                  directory_size);
+  for (const auto& tensor : tensors_) {
+    contents.append(tensor.name);
+  }
+  for (size_t i = 0; i < tensors_.size(); ++i) {
+    contents.resize(entries[i].data_offset);
+    contents.append(tensors_[i].data);
+  }
+  return contents;
+}
+
+}  // namespace minigo
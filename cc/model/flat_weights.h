@@ -0,0 +1,136 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_MODEL_FLAT_WEIGHTS_H_
+#define CC_MODEL_FLAT_WEIGHTS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace minigo {
+
+// A flat, mmap-ready weight format for Minigo models. Backends that load a
+// serialized graph (cc/model/loader.cc) pay seconds of parsing and session
+// initialization per generation swap per process; a flat weights payload is
+// just named, aligned tensor blobs, so "loading" it is validating a small
+// directory and taking pointers into the mapping. Payloads are carried as
+// the model bytes of a regular <minigo> model file and are converted offline
+// from a training checkpoint by oneoffs/flatten_checkpoint.py; with the
+// host-local model cache enabled (cc/model/model_cache.h) the mapping is
+// read-only and the weight pages are physically shared between every
+// process on the host.
+//
+// The payload is laid out as:
+//
+//   Header           (magic, version, tensor count, name table location)
+//   tensor directory num_tensors * TensorEntry
+//   name table       concatenated tensor names
+//   tensor data      each tensor's blob, 64 byte aligned
+//
+// Tensor offsets are relative to the start of the payload. The converter
+// pads the model file's metadata so the payload itself starts on a 64 byte
+// file offset, keeping the blobs aligned in the mapping.
+
+// Element type of a tensor's data.
+enum class TensorDataType : uint32_t {
+  kFloat32 = 0,
+  kFloat16 = 1,
+  kInt8 = 2,
+  kInt32 = 3,
+};
+
+// Returns the size in bytes of one element of the given type.
+size_t TensorDataTypeSize(TensorDataType type);
+
+constexpr int kMaxTensorDims = 4;
+
+struct FlatWeightsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_tensors;
+  uint64_t name_table_offset;
+  uint64_t name_table_size;
+};
+
+// One fixed-size directory entry. Field order avoids internal padding so
+// the struct can be written and read with memcpy on any platform.
+struct TensorEntry {
+  uint64_t name_offset;
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint32_t name_size;
+  uint32_t type;
+  uint32_t num_dims;
+  uint32_t dims[kMaxTensorDims];
+  uint32_t reserved;
+};
+
+// A validated, zero-copy view of a flat weights payload. The view points
+// into `contents`, which must outlive it; parsing touches only the header,
+// directory and name table, so unused weight pages are never faulted in.
+class FlatWeightsView {
+ public:
+  struct Tensor {
+    absl::string_view name;
+    TensorDataType type;
+    absl::Span<const uint32_t> dims;
+    absl::string_view data;
+  };
+
+  // Parses and validates `contents`, returning false if it isn't a flat
+  // weights payload.
+  static bool Parse(absl::string_view contents, FlatWeightsView* view);
+
+  // Returns the tensor with the given name, or nullptr if there isn't one.
+  const Tensor* Lookup(absl::string_view name) const;
+
+  // All tensors, in payload order.
+  const std::vector<Tensor>& tensors() const { return tensors_; }
+
+ private:
+  std::vector<Tensor> tensors_;
+  absl::flat_hash_map<absl::string_view, size_t> index_;
+};
+
+// Builds a flat weights payload. Only used by conversion tools and tests;
+// production payloads are written offline by oneoffs/flatten_checkpoint.py.
+class FlatWeightsBuilder {
+ public:
+  // Adds a tensor. Names must be unique and `data` must hold exactly the
+  // number of bytes implied by `dims` and `type`.
+  void Add(absl::string_view name, TensorDataType type,
+           absl::Span<const uint32_t> dims, absl::string_view data);
+
+  // Serializes the payload.
+  std::string Serialize() const;
+
+ private:
+  struct PendingTensor {
+    std::string name;
+    TensorDataType type;
+    std::vector<uint32_t> dims;
+    std::string data;
+  };
+
+  std::vector<PendingTensor> tensors_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_MODEL_FLAT_WEIGHTS_H_
@@ -0,0 +1,96 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/flat_weights.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Returns the bytes of a float tensor holding 0, 1, 2, ...
+std::string FloatData(size_t num_elements) {
+  std::vector<float> elements(num_elements);
+  for (size_t i = 0; i < num_elements; ++i) {
+    elements[i] = static_cast<float>(i);
+  }
+  return std::string(reinterpret_cast<const char*>(elements.data()),
+                     elements.size() * sizeof(float));
+}
+
+TEST(FlatWeightsTest, BuildParseRoundTrip) {
+  FlatWeightsBuilder builder;
+  auto conv = FloatData(3 * 3 * 16 * 16);
+  auto bias = FloatData(16);
+  builder.Add("conv_1/kernel", TensorDataType::kFloat32, {3, 3, 16, 16},
+              conv);
+  builder.Add("conv_1/bias", TensorDataType::kFloat32, {16}, bias);
+  std::string int8_data(64, '\x7f');
+  builder.Add("quantized", TensorDataType::kInt8, {64}, int8_data);
+  auto contents = builder.Serialize();
+
+  FlatWeightsView view;
+  ASSERT_TRUE(FlatWeightsView::Parse(contents, &view));
+  ASSERT_EQ(3, view.tensors().size());
+
+  const auto* tensor = view.Lookup("conv_1/kernel");
+  ASSERT_NE(nullptr, tensor);
+  EXPECT_EQ(TensorDataType::kFloat32, tensor->type);
+  ASSERT_EQ(4, tensor->dims.size());
+  EXPECT_EQ(3, tensor->dims[0]);
+  EXPECT_EQ(16, tensor->dims[3]);
+  EXPECT_EQ(conv, tensor->data);
+  // Blobs are 64 byte aligned within the payload.
+  EXPECT_EQ(0, (tensor->data.data() - contents.data()) % 64);
+
+  tensor = view.Lookup("conv_1/bias");
+  ASSERT_NE(nullptr, tensor);
+  EXPECT_EQ(bias, tensor->data);
+  EXPECT_EQ(0, (tensor->data.data() - contents.data()) % 64);
+
+  tensor = view.Lookup("quantized");
+  ASSERT_NE(nullptr, tensor);
+  EXPECT_EQ(TensorDataType::kInt8, tensor->type);
+  EXPECT_EQ(int8_data, tensor->data);
+
+  EXPECT_EQ(nullptr, view.Lookup("missing"));
+}
+
+TEST(FlatWeightsTest, RejectsCorruptPayloads) {
+  FlatWeightsBuilder builder;
+  builder.Add("bias", TensorDataType::kFloat32, {16}, FloatData(16));
+  auto contents = builder.Serialize();
+
+  FlatWeightsView view;
+  EXPECT_FALSE(FlatWeightsView::Parse("", &view));
+  EXPECT_FALSE(
+      FlatWeightsView::Parse(contents.substr(0, contents.size() - 1), &view));
+
+  auto bad_magic = contents;
+  bad_magic[0] = 'x';
+  EXPECT_FALSE(FlatWeightsView::Parse(bad_magic, &view));
+
+  // Corrupt the directory entry's num_dims.
+  auto bad_dims = contents;
+  bad_dims[sizeof(FlatWeightsHeader) + offsetof(TensorEntry, num_dims)] = 5;
+  EXPECT_FALSE(FlatWeightsView::Parse(bad_dims, &view));
+}
+
+}  // namespace
+}  // namespace minigo
@@ -14,12 +14,39 @@
 
 #include "cc/model/inference_cache.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <tuple>
+#include <utility>
 
 #include "absl/memory/memory.h"
+#include "cc/half.h"
+#include "cc/logging.h"
 
 namespace minigo {
 
+void CompressedModelOutput::Compress(const ModelOutput& output) {
+  for (int i = 0; i < kNumMoves; ++i) {
+    policy[i] = FloatToHalf(output.policy[i]);
+  }
+  value = output.value;
+}
+
+void CompressedModelOutput::Decompress(ModelOutput* output) const {
+  for (int i = 0; i < kNumMoves; ++i) {
+    output->policy[i] = HalfToFloat(policy[i]);
+  }
+  output->value = value;
+}
+
 std::ostream& operator<<(std::ostream& os, InferenceCache::Key key) {
   return os << absl::StreamFormat("%016x:%016x", key.cache_hash_,
                                   key.stone_hash_);
@@ -40,22 +67,26 @@ InferenceCache::Key::Key(Coord prev_move, symmetry::Symmetry canonical_sym,
     cache_hash_ ^= zobrist::OpponentPassedHash();
   }
 
+  // Position maintains the stone hash of every symmetry incrementally, so
+  // the stone contribution is a single lookup; the loop only has to fold in
+  // the illegal empty points.
+  stone_hash_ = position.symmetric_stone_hashes()[canonical_sym];
+  cache_hash_ ^= stone_hash_;
+
   const auto& coord_symmetry = symmetry::kCoords[canonical_sym];
   const auto& stones = position.stones();
   for (int real_c = 0; real_c < kN * kN; ++real_c) {
-    auto symmetric_c = coord_symmetry[real_c];
-    auto h = zobrist::MoveHash(symmetric_c, stones[real_c].color());
-    stone_hash_ ^= h;
-    cache_hash_ ^= h;
     if (stones[real_c].color() == Color::kEmpty &&
         !position.legal_move(real_c)) {
-      cache_hash_ ^= zobrist::IllegalEmptyPointHash(symmetric_c);
+      cache_hash_ ^= zobrist::IllegalEmptyPointHash(coord_symmetry[real_c]);
     }
   }
 }
 
 InferenceCache::~InferenceCache() = default;
 
+bool InferenceCache::SetCapacity(size_t capacity) { return false; }
+
 std::ostream& operator<<(std::ostream& os, const InferenceCache::Stats& stats) {
   auto num_lookups =
       stats.num_hits + stats.num_complete_misses + stats.num_symmetry_misses;
@@ -66,7 +97,7 @@ std::ostream& operator<<(std::ostream& os, const InferenceCache::Stats& stats) {
 
   return os << "size:" << stats.size << " capacity:" << stats.capacity
             << " full:" << (100 * full) << "%"
-            << " hits:" << stats.num_hits
+            << " hits:" << stats.num_hits << " hot_hits:" << stats.num_hot_hits
             << " complete_misses:" << stats.num_complete_misses
             << " symmetry_misses:" << stats.num_symmetry_misses
             << " hit_rate:" << (100 * hit_rate) << "%";
@@ -120,13 +151,8 @@ void BasicInferenceCache::Clear() {
 void BasicInferenceCache::Merge(Key key, symmetry::Symmetry canonical_sym,
                                 symmetry::Symmetry inference_sym,
                                 ModelOutput* output) {
-  if (map_.size() == stats_.capacity) {
-    // Cache is full, remove the last element from the LRU queue.
-    auto it = map_.find(static_cast<Element*>(list_.prev)->key);
-    MG_CHECK(it != map_.end());
-    Unlink(&it->second);
-    map_.erase(it);
-    stats_.size -= 1;
+  if (map_.size() >= stats_.capacity) {
+    Evict();
   }
 
   // Symmetry that converts the model output into canonical form.
@@ -142,7 +168,9 @@ void BasicInferenceCache::Merge(Key key, symmetry::Symmetry canonical_sym,
 
   if (inserted) {
     // Transform the model output into canonical form.
-    Model::ApplySymmetry(inverse_canonical_sym, *output, &elem->output);
+    ModelOutput canonical_output;
+    Model::ApplySymmetry(inverse_canonical_sym, *output, &canonical_output);
+    elem->output.Compress(canonical_output);
     elem->valid_symmetry_bits = sym_bit;
     elem->num_valid_symmetries = 1;
     stats_.size += 1;
@@ -150,6 +178,9 @@ void BasicInferenceCache::Merge(Key key, symmetry::Symmetry canonical_sym,
     // The element was already in the cache.
     Unlink(elem);
 
+    ModelOutput cached;
+    elem->output.Decompress(&cached);
+
     if ((elem->valid_symmetry_bits & sym_bit) == 0) {
       const auto& coord_symmetry = symmetry::kCoords[inverse_canonical_sym];
 
@@ -158,18 +189,18 @@ void BasicInferenceCache::Merge(Key key, symmetry::Symmetry canonical_sym,
       float a = n / (n + 1);
       float b = 1 / (n + 1);
 
-      auto& cached = elem->output;
       for (size_t i = 0; i < kNumMoves; ++i) {
         cached.policy[i] =
             a * cached.policy[i] + b * output->policy[coord_symmetry[i]];
       }
       cached.value = a * cached.value + b * output->value;
+      elem->output.Compress(cached);
 
       elem->valid_symmetry_bits |= sym_bit;
       elem->num_valid_symmetries += 1;
     }
 
-    Model::ApplySymmetry(canonical_sym, elem->output, output);
+    Model::ApplySymmetry(canonical_sym, cached, output);
   }
   PushFront(elem);
 }
@@ -200,7 +231,15 @@ bool BasicInferenceCache::TryGet(Key key, symmetry::Symmetry canonical_sym,
     return false;
   }
 
-  Model::ApplySymmetry(canonical_sym, elem->output, output);
+  ModelOutput cached;
+  elem->output.Decompress(&cached);
+  Model::ApplySymmetry(canonical_sym, cached, output);
+  if (elem->hit_count < std::numeric_limits<uint16_t>::max()) {
+    elem->hit_count += 1;
+  }
+  if (elem->hit_count > 1) {
+    stats_.num_hot_hits += 1;
+  }
   stats_.num_hits += 1;
   return true;
 }
@@ -209,6 +248,37 @@ BasicInferenceCache::Stats BasicInferenceCache::GetStats() const {
   return stats_;
 }
 
+bool BasicInferenceCache::SetCapacity(size_t capacity) {
+  MG_CHECK(capacity > 0);
+  while (map_.size() > capacity) {
+    Evict();
+  }
+  stats_.capacity = capacity;
+  return true;
+}
+
+void BasicInferenceCache::Evict() {
+  // Evict the least-recently-used element that has never served a hit,
+  // giving a second chance to up to kMaxEvictionScan hot elements: this
+  // stops a burst of one-off leaf positions from flushing the entries the
+  // search keeps re-reaching. Halving the hit count of the spared elements
+  // makes entries that have stopped being hit decay back to evictable.
+  for (int i = 0; i < kMaxEvictionScan; ++i) {
+    auto* tail = static_cast<Element*>(list_.prev);
+    if (tail->hit_count == 0) {
+      break;
+    }
+    tail->hit_count /= 2;
+    Unlink(tail);
+    PushFront(tail);
+  }
+  auto it = map_.find(static_cast<Element*>(list_.prev)->key);
+  MG_CHECK(it != map_.end());
+  Unlink(&it->second);
+  map_.erase(it);
+  stats_.size -= 1;
+}
+
 ThreadSafeInferenceCache::ThreadSafeInferenceCache(size_t total_capacity,
                                                    int num_shards) {
   shards_.reserve(num_shards);
@@ -254,10 +324,417 @@ InferenceCache::Stats ThreadSafeInferenceCache::GetStats() const {
     result.size += s.size;
     result.capacity += s.capacity;
     result.num_hits += s.num_hits;
+    result.num_hot_hits += s.num_hot_hits;
     result.num_complete_misses += s.num_complete_misses;
     result.num_symmetry_misses += s.num_symmetry_misses;
   }
   return result;
 }
 
+bool ThreadSafeInferenceCache::SetCapacity(size_t total_capacity) {
+  auto num_shards = shards_.size();
+  for (size_t i = 0; i < num_shards; ++i) {
+    auto a = i * total_capacity / num_shards;
+    auto b = (i + 1) * total_capacity / num_shards;
+    // BasicInferenceCache requires a non-zero capacity, so give every shard
+    // at least one element if the total capacity is tiny.
+    auto shard_capacity = std::max<size_t>(1, b - a);
+    absl::MutexLock lock(&shards_[i]->mutex);
+    shards_[i]->cache.SetCapacity(shard_capacity);
+  }
+  return true;
+}
+
+size_t LockFreeInferenceCache::CalculateCapacity(size_t size_mb) {
+  // All entries are allocated up front in a flat array, so unlike
+  // BasicInferenceCache there's no load factor or per-node allocation
+  // overhead to account for.
+  return static_cast<size_t>(size_mb * 1024.0f * 1024.0f / sizeof(Entry));
+}
+
+LockFreeInferenceCache::LockFreeInferenceCache(size_t capacity)
+    : owned_entries_(capacity),
+      entries_(owned_entries_.data()),
+      capacity_(capacity) {
+  MG_CHECK(capacity > 0);
+}
+
+LockFreeInferenceCache::LockFreeInferenceCache(Entry* entries, size_t capacity)
+    : entries_(entries), capacity_(capacity) {
+  MG_CHECK(entries != nullptr);
+  MG_CHECK(capacity > 0);
+
+  // Rebuild the size and tick counters from the existing entries. An odd
+  // version means a writer held the entry's seqlock when the array was last
+  // in use (e.g. the process crashed mid-write), so its payload can't be
+  // trusted: vacate it.
+  size_t size = 0;
+  uint32_t tick = 0;
+  for (size_t i = 0; i < capacity_; ++i) {
+    auto& entry = entries_[i];
+    auto version = entry.version.load(std::memory_order_relaxed);
+    if ((version & 1) != 0) {
+      entry.version.store(Entry::kVacant, std::memory_order_relaxed);
+      entry.last_used.store(0, std::memory_order_relaxed);
+      continue;
+    }
+    if (version != Entry::kVacant) {
+      size += 1;
+      tick = std::max(tick, entry.last_used.load(std::memory_order_relaxed));
+    }
+  }
+  size_.store(size, std::memory_order_relaxed);
+  tick_.store(tick + 1, std::memory_order_relaxed);
+}
+
+void LockFreeInferenceCache::Clear() {
+  for (size_t i = 0; i < capacity_; ++i) {
+    entries_[i].version.store(Entry::kVacant, std::memory_order_relaxed);
+    entries_[i].last_used.store(0, std::memory_order_relaxed);
+  }
+  size_.store(0, std::memory_order_relaxed);
+}
+
+void LockFreeInferenceCache::Merge(Key key, symmetry::Symmetry canonical_sym,
+                                   symmetry::Symmetry inference_sym,
+                                   ModelOutput* output) {
+  // Symmetry that converts the model output into canonical form.
+  auto inverse_canonical_sym = symmetry::Inverse(canonical_sym);
+
+  auto canonical_inference_sym =
+      symmetry::Concat(inference_sym, inverse_canonical_sym);
+  int sym_bit = (1 << canonical_inference_sym);
+
+  auto base = static_cast<size_t>(key.Shard(capacity_));
+  Entry* victim = nullptr;
+  uint64_t victim_version = 0;
+  uint32_t victim_used = 0;
+  for (int i = 0; i < kProbeWidth; ++i) {
+    auto& entry = entries_[(base + i) % capacity_];
+    auto version = entry.version.load(std::memory_order_acquire);
+    if ((version & 1) != 0) {
+      // Another writer owns the entry; it can't be a victim either.
+      continue;
+    }
+
+    if (version == Entry::kVacant) {
+      if (!entry.version.compare_exchange_strong(version, version + 1,
+                                                 std::memory_order_acq_rel)) {
+        // Another writer claimed the vacant entry first.
+        continue;
+      }
+      // Claimed a vacant entry: fill it with the canonical form of the
+      // output.
+      entry.key = key;
+      ModelOutput canonical_output;
+      Model::ApplySymmetry(inverse_canonical_sym, *output, &canonical_output);
+      entry.output.Compress(canonical_output);
+      entry.valid_symmetry_bits = sym_bit;
+      entry.num_valid_symmetries = 1;
+      entry.last_used.store(NextTick(), std::memory_order_relaxed);
+      entry.version.store(version + 2, std::memory_order_release);
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    if (entry.key == key) {
+      // The version was stable when loaded, so claiming the seqlock with a
+      // compare-exchange guarantees the key we just read wasn't torn: any
+      // intervening write would have changed the version and failed the
+      // compare-exchange.
+      if (!entry.version.compare_exchange_strong(version, version + 1,
+                                                 std::memory_order_acq_rel)) {
+        // Another writer is updating this key; drop our merge.
+        return;
+      }
+      ModelOutput cached;
+      entry.output.Decompress(&cached);
+
+      if ((entry.valid_symmetry_bits & sym_bit) == 0) {
+        const auto& coord_symmetry = symmetry::kCoords[inverse_canonical_sym];
+
+        // This is a new symmetry for this key: merge it in.
+        float n = static_cast<float>(entry.num_valid_symmetries);
+        float a = n / (n + 1);
+        float b = 1 / (n + 1);
+
+        for (size_t j = 0; j < kNumMoves; ++j) {
+          cached.policy[j] =
+              a * cached.policy[j] + b * output->policy[coord_symmetry[j]];
+        }
+        cached.value = a * cached.value + b * output->value;
+        entry.output.Compress(cached);
+
+        entry.valid_symmetry_bits |= sym_bit;
+        entry.num_valid_symmetries += 1;
+      }
+      Model::ApplySymmetry(canonical_sym, cached, output);
+      entry.last_used.store(NextTick(), std::memory_order_relaxed);
+      entry.version.store(version + 2, std::memory_order_release);
+      return;
+    }
+
+    // A stable entry for a different key: remember the stalest one in the
+    // probe window as the eviction victim.
+    auto used = entry.last_used.load(std::memory_order_relaxed);
+    if (victim == nullptr || used < victim_used) {
+      victim = &entry;
+      victim_version = version;
+      victim_used = used;
+    }
+  }
+
+  // The key isn't in its probe window and there are no vacant entries: evict
+  // the least-recently-used entry in the window. If another writer touched
+  // the victim since we examined it, just drop our merge.
+  if (victim != nullptr &&
+      victim->version.compare_exchange_strong(victim_version,
+                                              victim_version + 1,
+                                              std::memory_order_acq_rel)) {
+    victim->key = key;
+    ModelOutput canonical_output;
+    Model::ApplySymmetry(inverse_canonical_sym, *output, &canonical_output);
+    victim->output.Compress(canonical_output);
+    victim->valid_symmetry_bits = sym_bit;
+    victim->num_valid_symmetries = 1;
+    victim->last_used.store(NextTick(), std::memory_order_relaxed);
+    victim->version.store(victim_version + 2, std::memory_order_release);
+  }
+}
+
+bool LockFreeInferenceCache::TryGet(Key key, symmetry::Symmetry canonical_sym,
+                                    symmetry::Symmetry inference_sym,
+                                    ModelOutput* output) {
+  // Symmetry that converts the model output into canonical form.
+  auto inverse_canonical_sym = symmetry::Inverse(canonical_sym);
+
+  auto canonical_inference_sym =
+      symmetry::Concat(inference_sym, inverse_canonical_sym);
+  int sym_bit = (1 << canonical_inference_sym);
+
+  auto base = static_cast<size_t>(key.Shard(capacity_));
+  for (int i = 0; i < kProbeWidth; ++i) {
+    auto& entry = entries_[(base + i) % capacity_];
+    auto version = entry.version.load(std::memory_order_acquire);
+    if (version == Entry::kVacant || (version & 1) != 0) {
+      continue;
+    }
+    if (!(entry.key == key)) {
+      continue;
+    }
+
+    // Optimistically copy the payload, then validate that no writer touched
+    // the entry during the copy. A torn copy is treated as a miss.
+    auto cached = entry.output;
+    auto valid_symmetry_bits = entry.valid_symmetry_bits;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.version.load(std::memory_order_relaxed) != version) {
+      break;
+    }
+
+    if ((valid_symmetry_bits & sym_bit) == 0) {
+      // We have some symmetries for this position, just not the one
+      // requested.
+      num_symmetry_misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    entry.last_used.store(NextTick(), std::memory_order_relaxed);
+    ModelOutput decompressed;
+    cached.Decompress(&decompressed);
+    Model::ApplySymmetry(canonical_sym, decompressed, output);
+    num_hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  num_complete_misses_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+InferenceCache::Stats LockFreeInferenceCache::GetStats() const {
+  Stats stats;
+  stats.size = size_.load(std::memory_order_relaxed);
+  stats.capacity = capacity_;
+  stats.num_hits = num_hits_.load(std::memory_order_relaxed);
+  stats.num_complete_misses =
+      num_complete_misses_.load(std::memory_order_relaxed);
+  stats.num_symmetry_misses =
+      num_symmetry_misses_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+namespace {
+
+// On-disk header of an MmapInferenceCache file. The entry table immediately
+// follows the header.
+struct MmapCacheHeader {
+  static constexpr uint64_t kMagic = 0x006568636163676dULL;  // "mgcache"
+  static constexpr uint32_t kVersion = 1;
+
+  uint64_t magic;
+  uint32_t version;
+  uint32_t board_size;
+  uint64_t entry_size;
+  uint64_t capacity;
+  uint64_t model_hash;
+  // Leading bytes of the model name, to make cache files identifiable with a
+  // hex dump. Validation compares the whole header, including these bytes.
+  char model_name[64];
+};
+
+// FNV-1a. The header hash must be stable across processes so that a cache
+// file written by one run (or by build_cache_pack) is recognized by the
+// next; absl::Hash is seeded per-process and can't be stored in files.
+uint64_t StableModelHash(absl::string_view model_name) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (char c : model_name) {
+    h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+}  // namespace
+
+std::unique_ptr<MmapInferenceCache> MmapInferenceCache::Open(
+    const std::string& path, size_t capacity, absl::string_view model_name) {
+#ifdef _WIN32
+  MG_LOG(ERROR) << "MmapInferenceCache is not supported on Windows";
+  return nullptr;
+#else
+  MG_CHECK(capacity > 0);
+
+  MmapCacheHeader expected;
+  std::memset(&expected, 0, sizeof(expected));
+  expected.magic = MmapCacheHeader::kMagic;
+  expected.version = MmapCacheHeader::kVersion;
+  expected.board_size = kN;
+  expected.entry_size = sizeof(Entry);
+  expected.capacity = capacity;
+  expected.model_hash = StableModelHash(model_name);
+  auto name_len = std::min(model_name.size(), sizeof(expected.model_name) - 1);
+  std::memcpy(expected.model_name, model_name.data(), name_len);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    MG_LOG(ERROR) << "error opening \"" << path << "\"";
+    return nullptr;
+  }
+
+  auto mapping_size = sizeof(MmapCacheHeader) + capacity * sizeof(Entry);
+
+  // Only keep the existing contents if the file is exactly the size we'd
+  // write and its header matches: any mismatch means the file was built for
+  // a different model, board size, capacity or cache version.
+  struct stat st;
+  bool preserve = false;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) == mapping_size) {
+    MmapCacheHeader existing;
+    if (pread(fd, &existing, sizeof(existing), 0) ==
+        static_cast<ssize_t>(sizeof(existing))) {
+      preserve = std::memcmp(&existing, &expected, sizeof(expected)) == 0;
+    }
+  }
+
+  if (!preserve) {
+    // Truncate to zero first so stale entries can't survive, then extend to
+    // the full size, which zero-fills: all entries start out vacant.
+    if (ftruncate(fd, 0) != 0 ||
+        ftruncate(fd, static_cast<off_t>(mapping_size)) != 0) {
+      MG_LOG(ERROR) << "error resizing \"" << path << "\" to " << mapping_size
+                    << " bytes";
+      close(fd);
+      return nullptr;
+    }
+  }
+
+  void* mapping =
+      mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    MG_LOG(ERROR) << "error mapping \"" << path << "\"";
+    return nullptr;
+  }
+
+  if (!preserve) {
+    std::memcpy(mapping, &expected, sizeof(expected));
+  }
+
+  return absl::WrapUnique(
+      new MmapInferenceCache(mapping, mapping_size, capacity));
+#endif  // _WIN32
+}
+
+MmapInferenceCache::MmapInferenceCache(void* mapping, size_t mapping_size,
+                                       size_t capacity)
+    : LockFreeInferenceCache(
+          reinterpret_cast<Entry*>(static_cast<char*>(mapping) +
+                                   sizeof(MmapCacheHeader)),
+          capacity),
+      mapping_(mapping),
+      mapping_size_(mapping_size) {}
+
+MmapInferenceCache::~MmapInferenceCache() {
+#ifndef _WIN32
+  msync(mapping_, mapping_size_, MS_SYNC);
+  munmap(mapping_, mapping_size_);
+#endif  // _WIN32
+}
+
+TieredInferenceCache::TieredInferenceCache(std::unique_ptr<InferenceCache> l1,
+                                           std::unique_ptr<InferenceCache> l2)
+    : l1_(std::move(l1)), l2_(std::move(l2)) {
+  MG_CHECK(l1_ != nullptr);
+  MG_CHECK(l2_ != nullptr);
+}
+
+void TieredInferenceCache::Clear() {
+  l1_->Clear();
+  l2_->Clear();
+}
+
+void TieredInferenceCache::Merge(Key key, symmetry::Symmetry canonical_sym,
+                                 symmetry::Symmetry inference_sym,
+                                 ModelOutput* output) {
+  // Merge a copy into L2 so that the output returned to the caller is the one
+  // merged by L1, matching the behavior of a single-level cache.
+  ModelOutput l2_output = *output;
+  l2_->Merge(key, canonical_sym, inference_sym, &l2_output);
+  l1_->Merge(key, canonical_sym, inference_sym, output);
+}
+
+bool TieredInferenceCache::TryGet(Key key, symmetry::Symmetry canonical_sym,
+                                  symmetry::Symmetry inference_sym,
+                                  ModelOutput* output) {
+  if (l1_->TryGet(key, canonical_sym, inference_sym, output)) {
+    return true;
+  }
+  if (!l2_->TryGet(key, canonical_sym, inference_sym, output)) {
+    return false;
+  }
+
+  // Promote the L2 hit into L1. TryGet returns the output in the same
+  // orientation that Merge consumes, so merging a copy installs it.
+  ModelOutput l1_output = *output;
+  l1_->Merge(key, canonical_sym, inference_sym, &l1_output);
+  return true;
+}
+
+bool TieredInferenceCache::SetCapacity(size_t capacity) {
+  return l1_->SetCapacity(capacity);
+}
+
+InferenceCache::Stats TieredInferenceCache::GetStats() const {
+  auto result = l1_->GetStats();
+  auto s = l2_->GetStats();
+  result.size += s.size;
+  result.capacity += s.capacity;
+  result.num_hits += s.num_hits;
+  result.num_hot_hits += s.num_hot_hits;
+  result.num_complete_misses += s.num_complete_misses;
+  result.num_symmetry_misses += s.num_symmetry_misses;
+  return result;
+}
+
 }  // namespace minigo
@@ -16,12 +16,16 @@
 #define CC_MODEL_INFERENCE_CACHE_H_
 
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <ostream>
+#include <string>
 #include <vector>
 
 #include "absl/container/node_hash_map.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "cc/constants.h"
 #include "cc/coord.h"
@@ -83,6 +87,11 @@ class InferenceCache {
 
     int Shard(int num_shards) const { return cache_hash_ % num_shards; }
 
+    // The key's hash value. It's computed from the compile-time Zobrist
+    // tables, so unlike absl::Hash it's stable across processes and safe to
+    // store in files (e.g. opening books).
+    zobrist::Hash hash() const { return cache_hash_; }
+
     friend std::ostream& operator<<(std::ostream& os, Key key);
 
    private:
@@ -99,6 +108,11 @@ class InferenceCache {
     size_t size = 0;
     size_t capacity = 0;
     size_t num_hits = 0;
+    // Hits on entries that had already been hit at least once before. The
+    // split between hot and first-time hits shows how much of the hit rate
+    // comes from positions the search keeps re-reaching (e.g. openings)
+    // rather than one-off transposition hits.
+    size_t num_hot_hits = 0;
     size_t num_complete_misses = 0;
     size_t num_symmetry_misses = 0;
   };
@@ -125,10 +139,35 @@ class InferenceCache {
                       ModelOutput* output) = 0;
 
   virtual Stats GetStats() const = 0;
+
+  // Changes the cache's capacity, evicting elements if the cache currently
+  // holds more than `capacity`. Returns false if the cache's capacity is
+  // fixed (e.g. the lock-free caches allocate their entry table up front):
+  // the default implementation refuses, and caches that can resize override
+  // it.
+  virtual bool SetCapacity(size_t capacity);
 };
 
 std::ostream& operator<<(std::ostream& os, const InferenceCache::Stats& stats);
 
+// A ModelOutput with the policy compressed to IEEE 754 half precision.
+// The inference caches store their entries in this form: policy values are
+// softmax probabilities in [0, 1], where half precision is accurate to
+// ~0.0005, well below the variation between inferences of different
+// symmetries of the same position. Halving the policy storage roughly
+// doubles the number of positions a cache can hold at fixed memory. The
+// value is a single float, so it's kept at full precision.
+struct CompressedModelOutput {
+  // Fills the entry from `output`, rounding the policy to half precision.
+  void Compress(const ModelOutput& output);
+
+  // Expands the entry back into a full ModelOutput.
+  void Decompress(ModelOutput* output) const;
+
+  std::array<uint16_t, kNumMoves> policy;
+  float value;
+};
+
 // Not thread safe.
 class NullInferenceCache final : public InferenceCache {
  public:
@@ -147,6 +186,11 @@ class NullInferenceCache final : public InferenceCache {
 };
 
 // Not thread safe.
+// Eviction is LRU with a second chance for entries that have served hits:
+// a full cache evicts the least-recently-used entry that has a zero hit
+// count, halving the hit count of any hot entries it skips over. A burst of
+// deep-search leaf positions (which are merged once and never hit again)
+// therefore can't flush the shallow entries that every game revisits.
 class BasicInferenceCache : public InferenceCache {
  public:
   // Calculates a reasonable approximation for how many elements can fit in
@@ -161,6 +205,7 @@ class BasicInferenceCache : public InferenceCache {
   bool TryGet(Key key, symmetry::Symmetry canonical_sym,
               symmetry::Symmetry inference_sym, ModelOutput* output) override;
   Stats GetStats() const override;
+  bool SetCapacity(size_t capacity) override;
 
  private:
   struct ListNode {
@@ -176,7 +221,7 @@ class BasicInferenceCache : public InferenceCache {
           valid_symmetry_bits(1 << inference_sym),
           num_valid_symmetries(1) {}
     Key key;
-    ModelOutput output;
+    CompressedModelOutput output;
 
     // If bit (1 << symmetry) is set, then that symmetry has been merged into
     // the cache.
@@ -184,8 +229,21 @@ class BasicInferenceCache : public InferenceCache {
 
     // Num bits set in valid_symmetry_bits.
     uint8_t num_valid_symmetries;
+
+    // Number of times the element has been returned by TryGet, halved each
+    // time the element is spared from eviction so stale hot entries decay.
+    uint16_t hit_count = 0;
   };
 
+  // Maximum number of hot entries one eviction will skip over, so a cache
+  // full of hot entries degrades to plain LRU instead of scanning the whole
+  // list.
+  static constexpr int kMaxEvictionScan = 8;
+
+  // Evicts one element using the second-chance LRU policy described in the
+  // class comment. The cache must not be empty.
+  void Evict();
+
   // Removes the given element from the LRU list.
   void Unlink(Element* elem) {
     elem->next->prev = elem->prev;
@@ -248,6 +306,10 @@ class ThreadSafeInferenceCache : public InferenceCache {
   // for their stats in turn. Nevertheless, the results should be close enough.
   Stats GetStats() const override;
 
+  // Divides the new capacity between the shards the same way the constructor
+  // does. Each shard is locked and resized in turn.
+  bool SetCapacity(size_t total_capacity) override;
+
  private:
   struct Shard {
     explicit Shard(size_t capacity) : cache(capacity) {}
@@ -258,6 +320,158 @@ class ThreadSafeInferenceCache : public InferenceCache {
   std::vector<std::unique_ptr<Shard>> shards_;
 };
 
+// Inference cache that doesn't take any locks: a fixed-size, open-addressing
+// probe table allocated up front, with each entry guarded by its own seqlock.
+// Readers never block: TryGet optimistically copies an entry and validates
+// that the entry's version didn't change during the copy, treating a torn
+// read as a cache miss. Writers claim an entry with a single compare-exchange
+// and simply drop their update if another writer got there first; the cache
+// is best-effort, so losing the occasional Merge is fine.
+//
+// Instead of the exact LRU list that BasicInferenceCache maintains, each
+// entry records the value of a global tick counter when it was last touched
+// and Merge evicts the stalest entry in the key's probe window.
+//
+// Unlike ThreadSafeInferenceCache there are no shards: the mutexes were the
+// reason to shard, and the probe window already localizes writer contention
+// to individual entries.
+class LockFreeInferenceCache : public InferenceCache {
+ public:
+  // Calculates a reasonable approximation for how many elements can fit in
+  // a LockFreeInferenceCache of size_mb MB.
+  static size_t CalculateCapacity(size_t size_mb);
+
+  explicit LockFreeInferenceCache(size_t capacity);
+
+  // Unlike Merge and TryGet, Clear is not safe to call concurrently with
+  // other methods.
+  void Clear() override;
+
+  void Merge(Key key, symmetry::Symmetry canonical_sym,
+             symmetry::Symmetry inference_sym, ModelOutput* output) override;
+
+  bool TryGet(Key key, symmetry::Symmetry canonical_sym,
+              symmetry::Symmetry inference_sym, ModelOutput* output) override;
+
+  Stats GetStats() const override;
+
+ protected:
+  struct Entry {
+    // Seqlock guarding the entry's payload (key, output and symmetry state).
+    // kVacant means the entry has never been written; an odd value means a
+    // writer currently owns the entry; any other even value is stable.
+    static constexpr uint64_t kVacant = 0;
+    std::atomic<uint64_t> version{kVacant};
+
+    // Value of tick_ when the entry was last hit or merged. Only used to
+    // approximate LRU eviction, so updated with relaxed ordering.
+    std::atomic<uint32_t> last_used{0};
+
+    // The payload. Only read while the version is validated as stable, and
+    // only written by the thread that owns the seqlock.
+    Key key;
+    CompressedModelOutput output;
+    uint8_t valid_symmetry_bits;
+    uint8_t num_valid_symmetries;
+  };
+
+  // Wraps an externally allocated entry array (e.g. a memory-mapped file)
+  // instead of allocating one. The array must either be zero-filled or hold
+  // entries previously written by a LockFreeInferenceCache: the constructor
+  // rebuilds the size and tick counters from the existing entries and vacates
+  // any entry whose seqlock was left held by a crashed writer.
+  LockFreeInferenceCache(Entry* entries, size_t capacity);
+
+ private:
+  // Number of slots probed for a key, starting at the slot the key hashes to.
+  static constexpr int kProbeWidth = 8;
+
+  uint32_t NextTick() { return tick_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Backing storage for entries_ when using the public constructor; empty
+  // when the entry array is externally allocated.
+  std::vector<Entry> owned_entries_;
+
+  Entry* entries_;
+  size_t capacity_;
+
+  std::atomic<uint32_t> tick_{0};
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> num_hits_{0};
+  std::atomic<size_t> num_complete_misses_{0};
+  std::atomic<size_t> num_symmetry_misses_{0};
+};
+
+// A LockFreeInferenceCache whose entry table lives in a memory-mapped file,
+// so that cached inferences survive process restarts and a warmed cache file
+// can be shipped to new workers. The file records the model it was built for:
+// opening it with a different model name, board size or capacity discards the
+// previous contents, which makes the cache effectively keyed by
+// (model name, InferenceCache::Key).
+//
+// Page faults make individual lookups slower than a heap-allocated cache, so
+// it's best used as the second level of a TieredInferenceCache with an
+// in-memory cache in front.
+//
+// Only supported on POSIX platforms; Open always fails on Windows.
+class MmapInferenceCache : public LockFreeInferenceCache {
+ public:
+  static size_t CalculateCapacity(size_t size_mb) {
+    // The file header is negligible compared to the entry table.
+    return LockFreeInferenceCache::CalculateCapacity(size_mb);
+  }
+
+  // Opens or creates a cache file at `path` holding `capacity` entries for
+  // the model named `model_name`. If the file already exists and was written
+  // by a compatible cache for the same model, its contents are preserved;
+  // otherwise the file is reinitialized empty. Returns nullptr if the file
+  // can't be created, resized or mapped.
+  static std::unique_ptr<MmapInferenceCache> Open(const std::string& path,
+                                                  size_t capacity,
+                                                  absl::string_view model_name);
+
+  // Flushes the mapping back to the file and unmaps it.
+  ~MmapInferenceCache() override;
+
+ private:
+  MmapInferenceCache(void* mapping, size_t mapping_size, size_t capacity);
+
+  void* mapping_;
+  size_t mapping_size_;
+};
+
+// Layers a small, fast cache (L1) over a larger and typically slower or
+// persistent one (L2). Merge writes through to both levels and TryGet
+// promotes L2 hits into L1, so repeated lookups of hot positions are served
+// entirely from L1. The tiered cache is only as thread safe as its least
+// thread safe level.
+class TieredInferenceCache : public InferenceCache {
+ public:
+  TieredInferenceCache(std::unique_ptr<InferenceCache> l1,
+                       std::unique_ptr<InferenceCache> l2);
+
+  void Clear() override;
+
+  void Merge(Key key, symmetry::Symmetry canonical_sym,
+             symmetry::Symmetry inference_sym, ModelOutput* output) override;
+
+  bool TryGet(Key key, symmetry::Symmetry canonical_sym,
+              symmetry::Symmetry inference_sym, ModelOutput* output) override;
+
+  // Sums the stats of both levels, so an element present in both levels is
+  // counted twice towards size and capacity.
+  Stats GetStats() const override;
+
+  // Resizes L1 only: L2 is typically a fixed-size persistent cache (e.g.
+  // MmapInferenceCache), and L1 is the level that competes with the rest of
+  // the process for memory.
+  bool SetCapacity(size_t capacity) override;
+
+ private:
+  std::unique_ptr<InferenceCache> l1_;
+  std::unique_ptr<InferenceCache> l2_;
+};
+
 }  // namespace minigo
 
 #endif  // CC_MODEL_INFERENCE_CACHE_H_
@@ -15,12 +15,17 @@
 #include "cc/model/inference_cache.h"
 
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <sstream>
 #include <thread>
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/strings/str_join.h"
+#include "cc/file/path.h"
+#include "cc/logging.h"
 #include "cc/random.h"
 #include "cc/symmetries.h"
 #include "cc/test_utils.h"
@@ -36,6 +41,19 @@ struct Inference {
   ModelOutput output;
 };
 
+// The caches store the policy in half precision (see CompressedModelOutput),
+// so an output read back from a cache matches what was merged to half
+// precision accuracy rather than exactly. Policy values are probabilities in
+// [0, 1], where half precision is accurate to ~0.0005.
+constexpr float kHalfPolicyTolerance = 0.0005f;
+
+void ExpectPolicyNear(const std::array<float, kNumMoves>& expected,
+                      const std::array<float, kNumMoves>& actual) {
+  for (int i = 0; i < kNumMoves; ++i) {
+    EXPECT_NEAR(expected[i], actual[i], kHalfPolicyTolerance) << Coord(i);
+  }
+}
+
 // Verify that all symmetries of a position generate the same cache key.
 TEST(KeyTest, CanonicalSymmetry) {
   // Generate a position that isn't symmetric and contains some empty points
@@ -121,19 +139,108 @@ TEST(BasicInferenceCacheTest, LruTest) {
   ModelOutput output;
   for (int i = 0; i < 3; ++i) {
     ASSERT_TRUE(cache.TryGet(inferences[i].key, sym, sym, &output));
-    EXPECT_EQ(inferences[i].output.policy, output.policy);
+    ExpectPolicyNear(inferences[i].output.policy, output.policy);
     EXPECT_EQ(inferences[i].output.value, output.value);
   }
 
   // Adding a fourth element should evict the least recently used one.
   cache.Merge(inferences[3].key, sym, sym, &inferences[3].output);
   ASSERT_TRUE(cache.TryGet(inferences[3].key, sym, sym, &output));
-  EXPECT_EQ(inferences[3].output.policy, output.policy);
+  ExpectPolicyNear(inferences[3].output.policy, output.policy);
   EXPECT_EQ(inferences[3].output.value, output.value);
 
   EXPECT_FALSE(cache.TryGet(inferences[0].key, sym, sym, &output));
 }
 
+// Verify that entries which have served hits survive a burst of one-off
+// insertions that would flush them under pure LRU.
+TEST(BasicInferenceCacheTest, SecondChanceTest) {
+  BasicInferenceCache cache(3);
+  auto sym = symmetry::kIdentity;
+
+  Random rnd(20522, 1);
+  ModelOutput output;
+  rnd.Uniform(&output.policy);
+  output.value = rnd();
+
+  auto make_key = [](int i) {
+    return InferenceCache::Key::CreateTestKey(i, i);
+  };
+
+  // Fill the cache with keys 0..2, then hit key 0 twice to make it hot.
+  for (int i = 0; i < 3; ++i) {
+    auto merged = output;
+    cache.Merge(make_key(i), sym, sym, &merged);
+  }
+  ASSERT_TRUE(cache.TryGet(make_key(0), sym, sym, &output));
+  ASSERT_TRUE(cache.TryGet(make_key(0), sym, sym, &output));
+  EXPECT_EQ(1, cache.GetStats().num_hot_hits);
+
+  // Merge a burst of new keys. Each merge evicts the least-recently-used
+  // entry that was never hit; by the third merge, key 0 is the tail but gets
+  // a second chance and key 3 is evicted instead.
+  for (int i = 3; i < 6; ++i) {
+    auto merged = output;
+    cache.Merge(make_key(i), sym, sym, &merged);
+  }
+  EXPECT_TRUE(cache.TryGet(make_key(0), sym, sym, &output));
+  EXPECT_FALSE(cache.TryGet(make_key(3), sym, sym, &output));
+  EXPECT_TRUE(cache.TryGet(make_key(4), sym, sym, &output));
+  EXPECT_TRUE(cache.TryGet(make_key(5), sym, sym, &output));
+}
+
+// Verify that shrinking a cache evicts down to the new capacity and that the
+// cache can grow again afterwards.
+TEST(BasicInferenceCacheTest, SetCapacityTest) {
+  BasicInferenceCache cache(8);
+  auto sym = symmetry::kIdentity;
+
+  Random rnd(20522, 2);
+  ModelOutput output;
+  rnd.Uniform(&output.policy);
+  output.value = rnd();
+
+  auto make_key = [](int i) {
+    return InferenceCache::Key::CreateTestKey(i, i);
+  };
+
+  for (int i = 0; i < 8; ++i) {
+    auto merged = output;
+    cache.Merge(make_key(i), sym, sym, &merged);
+  }
+  EXPECT_EQ(8, cache.GetStats().size);
+
+  // Shrinking evicts the least-recently-used entries immediately.
+  ASSERT_TRUE(cache.SetCapacity(3));
+  auto stats = cache.GetStats();
+  EXPECT_EQ(3, stats.size);
+  EXPECT_EQ(3, stats.capacity);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_FALSE(cache.TryGet(make_key(i), sym, sym, &output));
+  }
+  for (int i = 5; i < 8; ++i) {
+    EXPECT_TRUE(cache.TryGet(make_key(i), sym, sym, &output));
+  }
+
+  // Growing back doesn't touch the surviving entries and makes room for new
+  // ones without eviction.
+  ASSERT_TRUE(cache.SetCapacity(8));
+  for (int i = 8; i < 13; ++i) {
+    auto merged = output;
+    cache.Merge(make_key(i), sym, sym, &merged);
+  }
+  stats = cache.GetStats();
+  EXPECT_EQ(8, stats.size);
+  EXPECT_EQ(8, stats.capacity);
+  for (int i = 5; i < 13; ++i) {
+    EXPECT_TRUE(cache.TryGet(make_key(i), sym, sym, &output));
+  }
+
+  // The fixed-size lock-free cache refuses to resize.
+  LockFreeInferenceCache lock_free_cache(64);
+  EXPECT_FALSE(lock_free_cache.SetCapacity(32));
+}
+
 // A basic test of putting a single symmetry of a position into the cache.
 TEST(InferenceCacheTest, SingleSymmetryTest) {
   Random rnd(80379245, 1);
@@ -255,20 +362,20 @@ TEST(InferenceCacheTest, MergeSymmetiesTest) {
       for (int i = 0; i < kN * kN; ++i) {
         if (expected_non_zero_points.contains(i)) {
           EXPECT_NEAR(1.0f / (symmetry_merged + 1), inference_output.policy[i],
-                      0.0001);
+                      kHalfPolicyTolerance);
         } else {
           EXPECT_EQ(0, inference_output.policy[i]);
         }
       }
       EXPECT_NEAR(symmetry_merged / 2.0f, inference_output.policy[Coord::kPass],
-                  0.0001);
+                  kHalfPolicyTolerance);
 
       EXPECT_NEAR(3.0f * symmetry_merged / 2.0f, inference_output.value,
                   0.0001);
 
       EXPECT_TRUE(
           cache.TryGet(key, canonical_sym, inference_sym, &cached_output));
-      EXPECT_EQ(inference_output.policy, cached_output.policy);
+      ExpectPolicyNear(inference_output.policy, cached_output.policy);
       EXPECT_EQ(inference_output.value, cached_output.value);
     }
   }
@@ -304,7 +411,7 @@ TEST(ThreadSafeInferenceCacheTest, SimpleTest) {
   ModelOutput output;
   for (const auto& inference : inferences) {
     ASSERT_TRUE(cache.TryGet(inference.key, sym, sym, &output));
-    EXPECT_EQ(inference.output.policy, output.policy);
+    ExpectPolicyNear(inference.output.policy, output.policy);
     EXPECT_EQ(inference.output.value, output.value);
   }
 }
@@ -346,11 +453,243 @@ TEST(ThreadSafeInferenceCacheTest, StressTest) {
   }
 }
 
-}  // namespace
-}  // namespace minigo
+TEST(LockFreeInferenceCacheTest, SimpleTest) {
+  LockFreeInferenceCache cache(32);
+
+  // Create some positions & inference outputs.
+  Random rnd(35374, 1);
+  std::vector<Inference> inferences;
+  auto prev_move = Coord::kInvalid;
+  auto sym = symmetry::kIdentity;
+
+  TestablePosition position("");
+  for (int i = 0; i < 4; ++i) {
+    auto key = InferenceCache::Key::CreateTestKey(i, i);
+    prev_move = GetRandomLegalMove(position, &rnd);
+    position.PlayMove(prev_move);
+
+    ModelOutput output;
+    rnd.Uniform(&output.policy);
+    output.value = rnd();
+    inferences.emplace_back(key, output);
+  }
+
+  // Fill the cache.
+  for (auto& inference : inferences) {
+    cache.Merge(inference.key, sym, sym, &inference.output);
+  }
+
+  // Verify that the elements stored in the cache are as expected.
+  ModelOutput output;
+  for (const auto& inference : inferences) {
+    ASSERT_TRUE(cache.TryGet(inference.key, sym, sym, &output));
+    ExpectPolicyNear(inference.output.policy, output.policy);
+    EXPECT_EQ(inference.output.value, output.value);
+  }
+}
+
+// Verifies that when the probe window for a key fills up, merging a new key
+// evicts the least-recently-used entry in the window rather than growing the
+// table.
+TEST(LockFreeInferenceCacheTest, EvictionTest) {
+  // With a single slot, every key shares the same probe window.
+  LockFreeInferenceCache cache(1);
+  auto sym = symmetry::kIdentity;
+
+  ModelOutput output;
+  Random rnd(88, 1);
+  rnd.Uniform(&output.policy);
+  output.value = rnd();
+
+  auto key_a = InferenceCache::Key::CreateTestKey(1, 1);
+  auto key_b = InferenceCache::Key::CreateTestKey(2, 2);
+
+  auto merged_a = output;
+  cache.Merge(key_a, sym, sym, &merged_a);
+  ASSERT_TRUE(cache.TryGet(key_a, sym, sym, &output));
+
+  // Merging a second key must evict the first.
+  auto merged_b = output;
+  cache.Merge(key_b, sym, sym, &merged_b);
+  EXPECT_FALSE(cache.TryGet(key_a, sym, sym, &output));
+  EXPECT_TRUE(cache.TryGet(key_b, sym, sym, &output));
+  EXPECT_EQ(1, cache.GetStats().size);
+}
+
+TEST(LockFreeInferenceCacheTest, StressTest) {
+  constexpr int kCacheSize = 32;
+  constexpr int kNumThreads = 10;
+  constexpr int kNumIterations = 10000;
+  auto sym = symmetry::kIdentity;
+
+  LockFreeInferenceCache cache(kCacheSize);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&cache, i, sym]() {
+      int hits = 0;
+      int misses = 0;
+      ModelOutput output;
+      Random rnd(27, i);
+      for (int i = 0; i < kNumIterations; ++i) {
+        TestablePosition position("");
+        // Create cache keys that only differ by a few bits so that the test
+        // gets a roughly 50/50 split of cache hits and misses.
+        auto key = InferenceCache::Key::CreateTestKey(rnd.UniformInt(0, 7),
+                                                      rnd.UniformInt(0, 8));
+        if (cache.TryGet(key, sym, sym, &output)) {
+          hits += 1;
+        } else {
+          misses += 1;
+        }
+        cache.Merge(key, sym, sym, &output);
+      }
+      MG_LOG(INFO) << "thread:" << i << " hits:" << hits
+                   << " misses:" << misses;
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // The cache never grows beyond its fixed capacity.
+  EXPECT_LE(cache.GetStats().size, kCacheSize);
+}
+
+// Returns a path under TEST_TMPDIR for a cache file, removing any file left
+// over from a previous run.
+std::string FreshCachePath(const char* basename) {
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  auto path = file::JoinPath(tmpdir, basename);
+  std::remove(path.c_str());
+  return path;
+}
+
+TEST(MmapInferenceCacheTest, PersistsAcrossReopen) {
+  auto path = FreshCachePath("persists_across_reopen.cache");
+  auto sym = symmetry::kIdentity;
+
+  // Create some positions & inference outputs.
+  Random rnd(35374, 1);
+  std::vector<Inference> inferences;
+  TestablePosition position("");
+  for (int i = 0; i < 4; ++i) {
+    auto key = InferenceCache::Key::CreateTestKey(i, i);
+    position.PlayMove(GetRandomLegalMove(position, &rnd));
+
+    ModelOutput output;
+    rnd.Uniform(&output.policy);
+    output.value = rnd();
+    inferences.emplace_back(key, output);
+  }
+
+  // Fill a cache file, then close it as if the process restarted.
+  {
+    auto cache = MmapInferenceCache::Open(path, 32, "model_a");
+    ASSERT_NE(cache, nullptr);
+    for (auto& inference : inferences) {
+      cache->Merge(inference.key, sym, sym, &inference.output);
+    }
+  }
+
+  // Reopening the file for the same model preserves the cached inferences.
+  auto cache = MmapInferenceCache::Open(path, 32, "model_a");
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(inferences.size(), cache->GetStats().size);
 
-int main(int argc, char** argv) {
-  ::testing::InitGoogleTest(&argc, argv);
-  ::minigo::zobrist::Init(375089798);
-  return RUN_ALL_TESTS();
+  ModelOutput output;
+  for (const auto& inference : inferences) {
+    ASSERT_TRUE(cache->TryGet(inference.key, sym, sym, &output));
+    ExpectPolicyNear(inference.output.policy, output.policy);
+    EXPECT_EQ(inference.output.value, output.value);
+  }
 }
+
+TEST(MmapInferenceCacheTest, DiscardsIncompatibleFile) {
+  auto path = FreshCachePath("discards_incompatible_file.cache");
+  auto sym = symmetry::kIdentity;
+
+  auto key = InferenceCache::Key::CreateTestKey(1, 1);
+  ModelOutput output;
+  Random rnd(88, 1);
+  rnd.Uniform(&output.policy);
+  output.value = rnd();
+
+  {
+    auto cache = MmapInferenceCache::Open(path, 32, "model_a");
+    ASSERT_NE(cache, nullptr);
+    auto merged = output;
+    cache->Merge(key, sym, sym, &merged);
+  }
+
+  // Opening the file for a different model discards its contents.
+  {
+    auto cache = MmapInferenceCache::Open(path, 32, "model_b");
+    ASSERT_NE(cache, nullptr);
+    EXPECT_EQ(0, cache->GetStats().size);
+    EXPECT_FALSE(cache->TryGet(key, sym, sym, &output));
+  }
+
+  // The file now belongs to model_b, so model_a's inferences are gone even
+  // when reopening for model_a.
+  {
+    auto cache = MmapInferenceCache::Open(path, 32, "model_a");
+    ASSERT_NE(cache, nullptr);
+    EXPECT_EQ(0, cache->GetStats().size);
+  }
+
+  // Opening with a different capacity also discards the contents.
+  {
+    auto cache = MmapInferenceCache::Open(path, 16, "model_a");
+    ASSERT_NE(cache, nullptr);
+    EXPECT_EQ(0, cache->GetStats().size);
+  }
+}
+
+TEST(TieredInferenceCacheTest, L2HoldsMoreThanL1) {
+  // An L1 cache with a single element over a larger L2.
+  TieredInferenceCache cache(absl::make_unique<BasicInferenceCache>(1),
+                             absl::make_unique<BasicInferenceCache>(32));
+  auto sym = symmetry::kIdentity;
+
+  // Create some positions & inference outputs.
+  Random rnd(35374, 1);
+  std::vector<Inference> inferences;
+  TestablePosition position("");
+  for (int i = 0; i < 4; ++i) {
+    auto key = InferenceCache::Key::CreateTestKey(i, i);
+    position.PlayMove(GetRandomLegalMove(position, &rnd));
+
+    ModelOutput output;
+    rnd.Uniform(&output.policy);
+    output.value = rnd();
+    inferences.emplace_back(key, output);
+  }
+
+  // Fill the cache. Each Merge evicts the previous key from the L1 cache,
+  // but all keys stay resident in L2.
+  for (auto& inference : inferences) {
+    cache.Merge(inference.key, sym, sym, &inference.output);
+  }
+
+  // Every key must still hit: L2 serves the ones L1 evicted, and each hit is
+  // promoted back into L1.
+  ModelOutput output;
+  for (const auto& inference : inferences) {
+    ASSERT_TRUE(cache.TryGet(inference.key, sym, sym, &output));
+    ExpectPolicyNear(inference.output.policy, output.policy);
+    EXPECT_EQ(inference.output.value, output.value);
+
+    // The key was just promoted, so looking it up again also hits.
+    ASSERT_TRUE(cache.TryGet(inference.key, sym, sym, &output));
+    ExpectPolicyNear(inference.output.policy, output.policy);
+    EXPECT_EQ(inference.output.value, output.value);
+  }
+
+  // A key that was never merged misses both levels.
+  auto missing_key = InferenceCache::Key::CreateTestKey(99, 99);
+  EXPECT_FALSE(cache.TryGet(missing_key, sym, sym, &output));
+}
+
+}  // namespace
+}  // namespace minigo
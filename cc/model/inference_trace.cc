@@ -0,0 +1,168 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/inference_trace.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "absl/time/clock.h"
+#include "cc/logging.h"
+#include "cc/position.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr char kMagic[8] = {'<', 'm', 'g', 't', 'r', 'a', 'c', 'e'};
+constexpr uint32_t kVersion = 2;
+
+// Stones are packed two bits per point: four Color values per byte.
+constexpr int kPackedStonesSize = (kN * kN + 3) / 4;
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t board_size;
+};
+
+// The fixed-size prefix of each batch record, followed by
+// `num_inferences` variable-size inference records.
+struct BatchHeader {
+  uint64_t timestamp_us;
+  uint32_t model_latency_us;
+  uint16_t num_inferences;
+};
+
+template <typename T>
+void WriteValue(const T& value, FILE* f) {
+  MG_CHECK(fwrite(&value, sizeof(value), 1, f) == 1);
+}
+
+template <typename T>
+void ReadValue(T* value, FILE* f) {
+  MG_CHECK(fread(value, sizeof(*value), 1, f) == 1);
+}
+
+}  // namespace
+
+InferenceTraceWriter::InferenceTraceWriter(const std::string& path)
+    : start_time_(absl::Now()) {
+  file_ = fopen(path.c_str(), "wb");
+  MG_CHECK(file_ != nullptr) << "error opening " << path << " for write";
+
+  TraceHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.board_size = kN;
+  WriteValue(header, file_);
+  MG_CHECK(fflush(file_) == 0);
+}
+
+InferenceTraceWriter::~InferenceTraceWriter() {
+  absl::MutexLock lock(&mutex_);
+  fclose(file_);
+}
+
+void InferenceTraceWriter::WriteBatch(
+    const std::vector<const ModelInput*>& inputs,
+    absl::Duration model_latency) {
+  absl::MutexLock lock(&mutex_);
+
+  BatchHeader header;
+  header.timestamp_us = absl::ToInt64Microseconds(absl::Now() - start_time_);
+  header.model_latency_us = absl::ToInt64Microseconds(model_latency);
+  header.num_inferences = static_cast<uint16_t>(inputs.size());
+  WriteValue(header, file_);
+
+  for (const auto* input : inputs) {
+    WriteValue(static_cast<uint8_t>(input->sym), file_);
+    WriteValue(static_cast<uint8_t>(input->position->to_play()), file_);
+    WriteValue(static_cast<uint8_t>(input->stone_history.size()), file_);
+    for (const auto* snapshot : input->stone_history) {
+      uint8_t packed[kPackedStonesSize] = {0};
+      for (int i = 0; i < kN * kN; ++i) {
+        packed[i / 4] |= static_cast<uint8_t>(snapshot->color_at(i))
+                         << (2 * (i % 4));
+      }
+      MG_CHECK(fwrite(packed, sizeof(packed), 1, file_) == 1);
+    }
+  }
+
+  MG_CHECK(fflush(file_) == 0);
+}
+
+namespace {
+InferenceTraceWriter* trace_writer = nullptr;
+}  // namespace
+
+InferenceTraceWriter* InferenceTraceWriter::Get() { return trace_writer; }
+
+void InferenceTraceWriter::Enable(const std::string& path) {
+  MG_CHECK(trace_writer == nullptr) << "trace capture is already enabled";
+  trace_writer = new InferenceTraceWriter(path);
+  MG_LOG(INFO) << "Capturing inference trace to " << path;
+}
+
+std::vector<TraceBatch> ReadInferenceTrace(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  MG_CHECK(f != nullptr) << "error opening " << path << " for read";
+
+  TraceHeader header;
+  ReadValue(&header, f);
+  MG_CHECK(memcmp(header.magic, kMagic, sizeof(kMagic)) == 0)
+      << path << " is not an inference trace";
+  MG_CHECK(header.version == kVersion) << header.version;
+  MG_CHECK(header.board_size == kN)
+      << "trace was recorded on a " << header.board_size << "x"
+      << header.board_size << " board, this build is " << kN << "x" << kN;
+
+  std::vector<TraceBatch> batches;
+  for (;;) {
+    BatchHeader batch_header;
+    if (fread(&batch_header, sizeof(batch_header), 1, f) != 1) {
+      MG_CHECK(feof(f)) << "error reading " << path;
+      break;
+    }
+
+    TraceBatch batch;
+    batch.timestamp = absl::Microseconds(batch_header.timestamp_us);
+    batch.model_latency = absl::Microseconds(batch_header.model_latency_us);
+    batch.inferences.resize(batch_header.num_inferences);
+    for (auto& inference : batch.inferences) {
+      uint8_t sym, to_play, history_len;
+      ReadValue(&sym, f);
+      ReadValue(&to_play, f);
+      ReadValue(&history_len, f);
+      MG_CHECK(sym <= symmetry::kNumSymmetries);
+      MG_CHECK(history_len <= kMaxPositionHistory);
+      inference.sym = static_cast<symmetry::Symmetry>(sym);
+      inference.to_play = static_cast<Color>(to_play);
+      inference.stone_history.resize(history_len);
+      for (auto& stones : inference.stone_history) {
+        uint8_t packed[kPackedStonesSize];
+        MG_CHECK(fread(packed, sizeof(packed), 1, f) == 1);
+        for (int i = 0; i < kN * kN; ++i) {
+          stones[i] = static_cast<Color>((packed[i / 4] >> (2 * (i % 4))) & 3);
+        }
+      }
+    }
+    batches.push_back(std::move(batch));
+  }
+
+  fclose(f);
+  return batches;
+}
+
+}  // namespace minigo
@@ -0,0 +1,96 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_MODEL_INFERENCE_TRACE_H_
+#define CC_MODEL_INFERENCE_TRACE_H_
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "cc/color.h"
+#include "cc/constants.h"
+#include "cc/model/model.h"
+#include "cc/symmetries.h"
+
+namespace minigo {
+
+// Capture and replay of the inference batches a ModelBatcher submits to its
+// model, so that new backends can be qualified against production batch
+// shapes and symmetry mixes without rerunning the workload that produced
+// them.
+//
+// A trace is a compact binary log: a fixed header (magic, version, board
+// size), followed by one record per batch. Each record stores the batch's
+// submission time relative to the start of the trace, the model's measured
+// latency, and for every inference in the batch its symmetry, the to-play
+// color of the evaluated position, and the stones of each position in its
+// history packed two bits per point. That's enough to reconstruct the exact
+// ModelInputs, and therefore the exact input features, at replay time.
+
+// The in-memory form of a traced batch, as returned by ReadInferenceTrace.
+struct TraceBatch {
+  struct Inference {
+    symmetry::Symmetry sym;
+    Color to_play;
+    // Stones of the evaluated position and the positions that led up to it,
+    // newest first.
+    std::vector<std::array<Color, kN * kN>> stone_history;
+  };
+
+  // When the batch was submitted, relative to the start of the trace.
+  absl::Duration timestamp;
+
+  // How long the traced model took to evaluate the batch.
+  absl::Duration model_latency;
+
+  std::vector<Inference> inferences;
+};
+
+// Appends batches to a trace file. WriteBatch is thread-safe and flushes
+// after every record so an aborted run still leaves a usable trace.
+class InferenceTraceWriter {
+ public:
+  explicit InferenceTraceWriter(const std::string& path);
+  ~InferenceTraceWriter();
+
+  InferenceTraceWriter(const InferenceTraceWriter&) = delete;
+  InferenceTraceWriter& operator=(const InferenceTraceWriter&) = delete;
+
+  void WriteBatch(const std::vector<const ModelInput*>& inputs,
+                  absl::Duration model_latency) LOCKS_EXCLUDED(&mutex_);
+
+  // Process-wide capture: once Enable has been called, Get returns the
+  // writer that every ModelBatcher records its batches to. Returns nullptr
+  // if capture isn't enabled. The writer is never destroyed, like the other
+  // process-wide singletons, so capture is safe from any thread until exit.
+  static InferenceTraceWriter* Get();
+  static void Enable(const std::string& path);
+
+ private:
+  absl::Mutex mutex_;
+  FILE* file_ GUARDED_BY(&mutex_);
+  absl::Time start_time_ GUARDED_BY(&mutex_);
+};
+
+// Reads a complete trace into memory, checking the header matches this
+// build's board size.
+std::vector<TraceBatch> ReadInferenceTrace(const std::string& path);
+
+}  // namespace minigo
+
+#endif  // CC_MODEL_INFERENCE_TRACE_H_
@@ -0,0 +1,102 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/inference_trace.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "cc/file/path.h"
+#include "cc/position.h"
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Returns a path under TEST_TMPDIR for the trace file, removing any file
+// left behind by a previous run.
+std::string GetTracePath() {
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  auto path = file::JoinPath(tmpdir, "test.mgtrace");
+  std::remove(path.c_str());
+  return path;
+}
+
+TEST(InferenceTraceTest, RoundTrip) {
+  // Play out a short random game to get realistic position histories.
+  Random rnd(614944751, 473537234);
+  std::vector<Position> game;
+  Position position(Color::kBlack);
+  game.push_back(position);
+  while (static_cast<int>(game.size()) < 20) {
+    Coord c(rnd.UniformUint64() % kNumPoints);
+    if (position.legal_move(c)) {
+      position.PlayMove(c);
+      game.push_back(position);
+    }
+  }
+
+  auto path = GetTracePath();
+  constexpr int kNumBatches = 5;
+  constexpr int kBatchSize = 7;
+  {
+    InferenceTraceWriter writer(path);
+    for (int i = 0; i < kNumBatches; ++i) {
+      std::vector<ModelInput> inputs(kBatchSize);
+      std::vector<const ModelInput*> input_ptrs;
+      for (int j = 0; j < kBatchSize; ++j) {
+        inputs[j].sym = static_cast<symmetry::Symmetry>(
+            (i + j) % symmetry::kNumSymmetries);
+        int newest = 1 + (i * kBatchSize + j) % (game.size() - 1);
+        inputs[j].position = &game[newest];
+        for (int h = 0; h <= newest && h < kMaxPositionHistory; ++h) {
+          inputs[j].stone_history.push_back(&game[newest - h].stone_snapshot());
+        }
+        input_ptrs.push_back(&inputs[j]);
+      }
+      writer.WriteBatch(input_ptrs, absl::Milliseconds(i + 1));
+    }
+  }
+
+  auto batches = ReadInferenceTrace(path);
+  ASSERT_EQ(kNumBatches, batches.size());
+  for (int i = 0; i < kNumBatches; ++i) {
+    const auto& batch = batches[i];
+    EXPECT_EQ(absl::Milliseconds(i + 1), batch.model_latency);
+    EXPECT_LE(absl::ZeroDuration(), batch.timestamp);
+    ASSERT_EQ(kBatchSize, batch.inferences.size());
+    for (int j = 0; j < kBatchSize; ++j) {
+      const auto& inference = batch.inferences[j];
+      EXPECT_EQ((i + j) % symmetry::kNumSymmetries, inference.sym);
+
+      int newest = 1 + (i * kBatchSize + j) % (game.size() - 1);
+      int expected_len = std::min(newest + 1, kMaxPositionHistory);
+      EXPECT_EQ(game[newest].to_play(), inference.to_play);
+      ASSERT_EQ(expected_len, inference.stone_history.size());
+      for (int h = 0; h < expected_len; ++h) {
+        const auto& original = game[newest - h];
+        const auto& traced = inference.stone_history[h];
+        for (int c = 0; c < kN * kN; ++c) {
+          EXPECT_EQ(original.stones()[c].color(), traced[c]);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace minigo
@@ -17,15 +17,19 @@
 #include <cstdint>
 
 #include "absl/memory/memory.h"
+#include "absl/strings/match.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_split.h"
 #include "absl/synchronization/mutex.h"
+#include "cc/dual_net/fake_dual_net.h"
 #include "cc/dual_net/random_dual_net.h"
-#include "cc/file/utils.h"
+#include "cc/dual_net/shm_dual_net.h"
 #include "cc/json.h"
 #include "cc/logging.h"
+#include "cc/model/model_cache.h"
 
 #ifdef MG_ENABLE_TF_DUAL_NET
+#include "cc/dual_net/remote_dual_net.h"
 #include "cc/dual_net/tf_dual_net.h"
 #endif  // MG_ENABLE_TF_DUAL_NET
 
@@ -37,6 +41,10 @@
 #include "cc/dual_net/tpu_dual_net.h"
 #endif  // MG_ENABLE_TPU_DUAL_NET
 
+#ifdef MG_ENABLE_TRT_DUAL_NET
+#include "cc/dual_net/trt_dual_net.h"
+#endif  // MG_ENABLE_TRT_DUAL_NET
+
 namespace minigo {
 
 namespace {
@@ -102,15 +110,32 @@ class FactoryRegistry {
       return absl::make_unique<RandomDualNetFactory>();
     }
 
+    if (engine == "fake") {
+      return absl::make_unique<FakeDualNetFactory>();
+    }
+
+    // A shm:// device submits inference to an inference server on the same
+    // host through shared memory instead of running the model in-process.
+    // The server owns the device and the engine that runs on it, so the
+    // model's engine doesn't matter here.
+    if (absl::StartsWith(device, "shm://")) {
+      return absl::make_unique<ShmDualNetFactory>(device);
+    }
+
 #ifdef MG_ENABLE_TF_DUAL_NET
     if (engine == "tf") {
+      // A grpc:// device streams inference to a remote server instead of
+      // running the model in-process.
+      if (absl::StartsWith(device, "grpc://")) {
+        return absl::make_unique<RemoteDualNetFactory>(device);
+      }
       return absl::make_unique<TfDualNetFactory>(device);
     }
 #endif  // MG_ENABLE_TF_DUAL_NET
 
 #ifdef MG_ENABLE_LITE_DUAL_NET
     if (engine == "lite") {
-      return absl::make_unique<LiteDualNetFactory>();
+      return absl::make_unique<LiteDualNetFactory>(device);
     }
 #endif  // MG_ENABLE_LITE_DUAL_NET
 
@@ -120,6 +145,12 @@ class FactoryRegistry {
     }
 #endif  // MG_ENABLE_TPU_DUAL_NET
 
+#ifdef MG_ENABLE_TRT_DUAL_NET
+    if (engine == "trt") {
+      return absl::make_unique<TrtDualNetFactory>(device);
+    }
+#endif  // MG_ENABLE_TRT_DUAL_NET
+
     MG_LOG(FATAL) << "Unrecognized inference engine \"" << engine << "\"";
     return nullptr;
   }
@@ -147,13 +178,38 @@ ModelDefinition CreateRandomModelDefinition(absl::string_view descriptor) {
   return def;
 }
 
+// Descriptor format: "base_latency_us:latency_per_input_us:jitter".
+// A FakeDualNet with a simulated inference latency of
+//   base_latency_us + batch_size * latency_per_input_us
+// microseconds per batch, randomly perturbed by up to +/- `jitter`
+// (a fraction, e.g. 0.1 for 10%). For example "fake:2000:40:0.1"
+// simulates a device that runs a 96 inference batch in roughly 5.8ms.
+ModelDefinition CreateFakeModelDefinition(absl::string_view descriptor) {
+  ModelDefinition def;
+
+  std::vector<absl::string_view> parts = absl::StrSplit(descriptor, ':');
+  MG_CHECK(parts.size() == 3) << "\"" << descriptor << "\"";
+
+  uint64_t base_latency_us, latency_per_input_us;
+  float jitter;
+  MG_CHECK(absl::SimpleAtoi(parts[0], &base_latency_us));
+  MG_CHECK(absl::SimpleAtoi(parts[1], &latency_per_input_us));
+  MG_CHECK(absl::SimpleAtof(parts[2], &jitter));
+
+  def.path = std::string(descriptor);
+  def.metadata.Set("engine", "fake");
+  def.metadata.Set("base_latency_us", base_latency_us);
+  def.metadata.Set("latency_per_input_us", latency_per_input_us);
+  def.metadata.Set("jitter", jitter);
+  return def;
+}
+
 ModelDefinition ReadModelDefinition(const std::string& path) {
   ModelDefinition def;
 
   def.path = path;
 
-  std::string contents;
-  MG_CHECK(file::ReadFile(path, &contents));
+  auto contents = ReadModelBytes(path);
 
   ModelHeader header;
   MG_CHECK(contents.size() >= sizeof(header));
@@ -195,11 +251,7 @@ ModelDefinition ReadModelDefinition(const std::string& path) {
     }
   }
 
-  // TODO(tommadams): this copies almost the entire file. Add a proper file
-  // abstraction that can load partial files to avoid this (currently the only
-  // abstraction we have is file::ReadFile, which can only read an entire file's
-  // contents in one shot).
-  def.model_bytes = contents.substr(sizeof(header) + header.metadata_size);
+  def.model_bytes = contents.Suffix(sizeof(header) + header.metadata_size);
 
   MG_CHECK(def.metadata.Has("engine"));
   MG_CHECK(def.metadata.Has("input_features"));
@@ -216,6 +268,8 @@ ModelDefinition LoadModelDefinition(const std::string& path) {
   absl::string_view path_view(path);
   if (absl::ConsumePrefix(&path_view, "random:")) {
     return CreateRandomModelDefinition(path_view);
+  } else if (absl::ConsumePrefix(&path_view, "fake:")) {
+    return CreateFakeModelDefinition(path_view);
   } else {
     return ReadModelDefinition(path);
   }
@@ -14,9 +14,85 @@
 
 #include "cc/model/model.h"
 
+// The AVX2 policy gather kernel is compiled with a per-function target
+// attribute and selected at runtime, following the same pattern as the
+// transform kernels in symmetries.cc.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MG_INTERNAL_HAVE_AVX_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <utility>
 
 namespace minigo {
+namespace {
+
+// symmetry::kCoords is already a gather table (applying `sym` to a policy
+// array is dst[i] = src[kCoords[sym][i]], with the pass index mapping to
+// itself), so unpacking an inference output reduces to one gather per input.
+// The indices are widened to 32 bits here so the AVX2 kernel can feed them to
+// _mm256_i32gather_ps directly. Built lazily because kCoords lives in another
+// translation unit and has no guaranteed initialization order relative to
+// this one.
+const std::array<std::array<int32_t, kNumMoves>, symmetry::kNumSymmetries>&
+PolicyGatherTables() {
+  static const auto tables = []() {
+    std::array<std::array<int32_t, kNumMoves>, symmetry::kNumSymmetries>
+        result;
+    for (auto sym : symmetry::kAllSymmetries) {
+      for (int i = 0; i < kNumMoves; ++i) {
+        result[sym][i] = static_cast<int32_t>(symmetry::kCoords[sym][i]);
+      }
+    }
+    return result;
+  }();
+  return tables;
+}
+
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+bool DetectAvx2() { return __builtin_cpu_supports("avx2") != 0; }
+
+__attribute__((target("avx2"))) void GatherPolicyAvx2(const int32_t* idx,
+                                                      const float* src,
+                                                      float* dst) {
+  int i = 0;
+  for (; i + 8 <= kNumMoves; i += 8) {
+    auto vidx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + i));
+    _mm256_storeu_ps(dst + i, _mm256_i32gather_ps(src, vidx, 4));
+  }
+  for (; i < kNumMoves; ++i) {
+    dst[i] = src[idx[i]];
+  }
+}
+#endif  // MG_INTERNAL_HAVE_AVX_DISPATCH
+
+void GatherPolicyScalar(const int32_t* idx, const float* src, float* dst) {
+  for (int i = 0; i < kNumMoves; ++i) {
+    dst[i] = src[idx[i]];
+  }
+}
+
+// Writes the policy permuted by `sym` from `src` into `dst` (which must not
+// alias `src`).
+void ApplyPolicySymmetry(symmetry::Symmetry sym, const float* src, float* dst) {
+  if (sym == symmetry::kIdentity) {
+    std::memcpy(dst, src, kNumMoves * sizeof(float));
+    return;
+  }
+  const auto* idx = PolicyGatherTables()[sym].data();
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const bool have_avx2 = DetectAvx2();
+  if (have_avx2) {
+    return GatherPolicyAvx2(idx, src, dst);
+  }
+#endif
+  GatherPolicyScalar(idx, src, dst);
+}
+
+}  // namespace
 
 Model::Model(std::string name, const FeatureDescriptor& feature_desc)
     : name_(std::move(name)), feature_desc_(feature_desc) {}
@@ -31,25 +107,34 @@ void Model::GetOutputs(absl::Span<const ModelInput* const> inputs,
   MG_CHECK(value.shape.is({policy.shape[0]}));
   MG_CHECK(static_cast<int>(inputs.size()) <= policy.shape[0]);
 
-  // Copy the policy and value out of the output tensors.
+  // Unpack the policy and value tensors into the per-input outputs: one
+  // gather through the symmetry's coordinate table per input, written
+  // straight into the output struct.
   for (size_t input_idx = 0; input_idx < inputs.size(); ++input_idx) {
-    const auto sym = inputs[input_idx]->sym;
+    const auto inv_sym = symmetry::Inverse(inputs[input_idx]->sym);
     const auto* raw_policy = policy.data + kNumMoves * input_idx;
-    const auto* raw_value = value.data + input_idx;
     auto& output = *outputs[input_idx];
 
-    symmetry::ApplySymmetry<kN, 1>(symmetry::Inverse(sym), raw_policy,
-                                   output.policy.data());
-    output.policy[Coord::kPass] = raw_policy[Coord::kPass];
-    output.value = *raw_value;
+    ApplyPolicySymmetry(inv_sym, raw_policy, output.policy.data());
+    output.value = value.data[input_idx];
   }
 }
 
 void Model::ApplySymmetry(symmetry::Symmetry sym, const ModelOutput& src,
                           ModelOutput* dst) {
-  symmetry::ApplySymmetry<kN, 1>(sym, src.policy.data(), dst->policy.data());
-  dst->policy[Coord::kPass] = src.policy[Coord::kPass];
+  ApplyPolicySymmetry(sym, src.policy.data(), dst->policy.data());
   dst->value = src.value;
 }
 
+void Model::RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                         std::vector<ModelOutput*>* outputs,
+                         std::string* model_name,
+                         std::function<void()> callback) {
+  {
+    absl::MutexLock lock(&async_mutex_);
+    RunMany(inputs, outputs, model_name);
+  }
+  callback();
+}
+
 }  // namespace minigo
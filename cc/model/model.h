@@ -15,9 +15,11 @@
 #ifndef CC_MODEL_MODEL_H_
 #define CC_MODEL_MODEL_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
+#include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
 #include "cc/color.h"
 #include "cc/constants.h"
@@ -61,9 +63,27 @@ class Model {
                        std::vector<ModelOutput*>* outputs,
                        std::string* model_name) = 0;
 
+  // Asynchronously runs inference on a batch of inputs, invoking `callback`
+  // once `outputs` (and `model_name`, if non-null) have been filled in. The
+  // callback may be invoked on a different thread. `inputs`, `outputs` and
+  // `model_name` must remain valid until the callback is invoked.
+  // Unlike RunMany, RunManyAsync is always safe to call concurrently from
+  // multiple threads: the base implementation serializes concurrent callers,
+  // runs RunMany synchronously and invokes the callback before returning.
+  // Models that can overlap inference with the caller's work (e.g.
+  // BatchingModel) override this to return as soon as the request has been
+  // submitted.
+  virtual void RunManyAsync(const std::vector<const ModelInput*>& inputs,
+                            std::vector<ModelOutput*>* outputs,
+                            std::string* model_name,
+                            std::function<void()> callback);
+
  private:
   const std::string name_;
   const FeatureDescriptor feature_desc_;
+
+  // Serializes concurrent callers of the base RunManyAsync implementation.
+  absl::Mutex async_mutex_;
 };
 
 }  // namespace minigo
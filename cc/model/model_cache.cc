@@ -0,0 +1,238 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/model_cache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+#include "cc/model/model_delta.h"
+
+namespace minigo {
+
+namespace {
+
+std::string* CacheDir() {
+  static auto* dir = new std::string;
+  return dir;
+}
+
+// Content-addresses cached model files and keys the source path -> cached
+// file references, so we don't have to sanitize model paths (which may be
+// GCS URLs) into file names. ModelFingerprint is shared with the delta
+// format so that a delta's base generation can be found in the cache by
+// fingerprint alone.
+std::string HexFingerprint(absl::string_view bytes) {
+  return absl::StrCat(absl::Hex(ModelFingerprint(bytes), absl::kZeroPad16));
+}
+
+std::string HexFingerprint(uint64_t fingerprint) {
+  return absl::StrCat(absl::Hex(fingerprint, absl::kZeroPad16));
+}
+
+#ifndef _WIN32
+
+// Holds an exclusive advisory lock on `path`, blocking in the constructor
+// until the lock is acquired. Used to serialize cache fills across all minigo
+// processes on the host.
+class FileLock {
+ public:
+  explicit FileLock(const std::string& path)
+      : fd_(open(path.c_str(), O_CREAT | O_RDWR, 0666)) {
+    MG_CHECK(fd_ >= 0) << "error opening " << path;
+    MG_CHECK(flock(fd_, LOCK_EX) == 0) << "error locking " << path;
+  }
+
+  ~FileLock() {
+    flock(fd_, LOCK_UN);
+    close(fd_);
+  }
+
+ private:
+  const int fd_;
+};
+
+// Maps the file at `path` read-only. The mapping is shared with any other
+// process on the host that maps the same file.
+ModelBytes MapReadOnly(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  MG_CHECK(fd >= 0) << "error opening " << path;
+  struct stat st;
+  MG_CHECK(fstat(fd, &st) == 0) << "error statting " << path;
+  auto size = static_cast<size_t>(st.st_size);
+  MG_CHECK(size > 0) << path << " is empty";
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  MG_CHECK(data != MAP_FAILED) << "error mapping " << path;
+  std::shared_ptr<const void> owner(
+      data, [size](void* p) { munmap(p, size); });
+  auto* char_data = static_cast<const char*>(data);
+  return ModelBytes(std::move(owner), char_data, size);
+}
+
+// Writes `contents` to `path`, atomically: readers either see the whole file
+// or no file, never a partial write.
+void AtomicWriteFile(const std::string& path, absl::string_view contents) {
+  auto tmp_path = absl::StrCat(path, ".tmp.", getpid());
+  MG_CHECK(file::WriteFile(tmp_path, contents));
+  MG_CHECK(std::rename(tmp_path.c_str(), path.c_str()) == 0)
+      << "error renaming " << tmp_path << " to " << path;
+}
+
+// Returns the path of `ref_path`'s cached copy of the model, or an empty
+// string if the model isn't cached yet.
+std::string LookupCachedModel(const std::string& dir,
+                              const std::string& ref_path) {
+  std::string cached_name;
+  if (!file::FileExists(ref_path) || !file::ReadFile(ref_path, &cached_name)) {
+    return "";
+  }
+  auto cached_path = file::JoinPath(dir, cached_name);
+  if (!file::FileExists(cached_path)) {
+    return "";
+  }
+  return cached_path;
+}
+
+// Attempts to satisfy a fetch of `path` by downloading the `.mgdelta`
+// sidecar published next to it and patching the cached copy of the base
+// generation (see cc/model/model_delta.h). On success the reconstructed
+// model is written into the cache and its cached name is returned; on any
+// failure (no sidecar, base generation not cached, malformed or mismatched
+// delta) returns an empty string and the caller falls back to a full fetch.
+std::string TryFetchModelDelta(const std::string& dir,
+                               const std::string& path) {
+  auto delta_path = absl::StrCat(path, ".mgdelta");
+  std::string delta;
+  if (!file::FileExists(delta_path) || !file::ReadFile(delta_path, &delta)) {
+    return "";
+  }
+
+  uint64_t base_fingerprint;
+  if (!ReadModelDeltaHeader(delta, &base_fingerprint, nullptr, nullptr)) {
+    MG_LOG(WARNING) << delta_path << " is not a valid model delta";
+    return "";
+  }
+
+  auto base_path = file::JoinPath(
+      dir, absl::StrCat(HexFingerprint(base_fingerprint), ".minigo"));
+  if (!file::FileExists(base_path)) {
+    // We don't have the generation the delta was built against (e.g. this
+    // host just came up and skipped it).
+    return "";
+  }
+
+  std::string base;
+  if (!file::ReadFile(base_path, &base)) {
+    return "";
+  }
+  std::string contents;
+  if (!ApplyModelDelta(base, delta, &contents)) {
+    MG_LOG(WARNING) << "failed to apply " << delta_path
+                    << ", falling back to a full fetch";
+    return "";
+  }
+
+  MG_LOG(INFO) << "patched " << path << " from cached base generation: "
+               << "downloaded " << delta.size() << " bytes instead of "
+               << contents.size();
+
+  auto cached_name = absl::StrCat(HexFingerprint(contents), ".minigo");
+  auto cached_path = file::JoinPath(dir, cached_name);
+  if (!file::FileExists(cached_path)) {
+    AtomicWriteFile(cached_path, contents);
+  }
+  return cached_name;
+}
+
+// Returns the path of the cached copy of the model file at `path`,
+// downloading it into the cache if no process on the host has done so yet.
+std::string FetchModelIntoCache(const std::string& dir,
+                                const std::string& path) {
+  auto ref_path =
+      file::JoinPath(dir, absl::StrCat(HexFingerprint(path), ".ref"));
+
+  auto cached_path = LookupCachedModel(dir, ref_path);
+  if (!cached_path.empty()) {
+    return cached_path;
+  }
+
+  // Take a host-wide lock so that processes racing on a cold start perform
+  // one download between them instead of one each.
+  FileLock lock(file::JoinPath(dir, ".lock"));
+
+  cached_path = LookupCachedModel(dir, ref_path);
+  if (!cached_path.empty()) {
+    return cached_path;
+  }
+
+  // A delta sidecar next to the model can turn the download of a new
+  // generation into the download of a small patch against the previous one.
+  auto cached_name = TryFetchModelDelta(dir, path);
+  if (cached_name.empty()) {
+    MG_LOG(INFO) << "fetching " << path << " into model cache";
+    std::string contents;
+    MG_CHECK(file::ReadFile(path, &contents)) << "error reading " << path;
+
+    cached_name = absl::StrCat(HexFingerprint(contents), ".minigo");
+    cached_path = file::JoinPath(dir, cached_name);
+    if (!file::FileExists(cached_path)) {
+      AtomicWriteFile(cached_path, contents);
+    }
+  }
+  AtomicWriteFile(ref_path, cached_name);
+  return file::JoinPath(dir, cached_name);
+}
+
+#endif  // _WIN32
+
+}  // namespace
+
+void SetModelCacheDir(std::string dir) {
+#ifdef _WIN32
+  MG_LOG(WARNING) << "the model cache is not supported on Windows";
+#endif
+  *CacheDir() = std::move(dir);
+}
+
+ModelBytes ReadModelBytes(const std::string& path) {
+#ifndef _WIN32
+  const auto& dir = *CacheDir();
+  if (!dir.empty()) {
+    MG_CHECK(file::RecursivelyCreateDir(dir));
+    return MapReadOnly(FetchModelIntoCache(dir, path));
+  }
+#endif  // _WIN32
+
+  std::string contents;
+  MG_CHECK(file::ReadFile(path, &contents)) << "error reading " << path;
+  return ModelBytes(std::move(contents));
+}
+
+}  // namespace minigo
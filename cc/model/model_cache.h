@@ -0,0 +1,42 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_MODEL_MODEL_CACHE_H_
+#define CC_MODEL_MODEL_CACHE_H_
+
+#include <string>
+
+#include "cc/model/factory.h"
+
+namespace minigo {
+
+// Sets the directory used as a host-local, content-addressed cache of model
+// files, shared by every minigo process on the host. An empty path (the
+// default) disables the cache. Must be called before any models are loaded.
+// The cache requires POSIX file locking & mmap and is ignored on Windows.
+void SetModelCacheDir(std::string dir);
+
+// Reads the serialized model file at `path`.
+// With the cache disabled, reads the whole file into heap storage, once per
+// call. With the cache enabled, the first process to request `path` downloads
+// it into the cache and every reader gets a read-only mapping of the single
+// cached copy: a cold start after a new generation costs one download and one
+// set of physical pages per host, however many processes are running.
+// Model files are assumed to be immutable once written (models are named by
+// their generation), so cached copies are never invalidated.
+ModelBytes ReadModelBytes(const std::string& path);
+
+}  // namespace minigo
+
+#endif  //  CC_MODEL_MODEL_CACHE_H_
@@ -0,0 +1,102 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/model_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+#include "cc/model/model_delta.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+absl::string_view AsStringView(const ModelBytes& bytes) {
+  return absl::string_view(bytes.data(), bytes.size());
+}
+
+// Creates a fresh temporary directory.
+std::string MakeTempDir() {
+  std::string path = "/tmp/model_cache_test.XXXXXX";
+  MG_CHECK(mkdtemp(&path[0]) != nullptr);
+  return path;
+}
+
+TEST(ModelCacheTest, ReadWithoutCache) {
+  SetModelCacheDir("");
+
+  auto dir = MakeTempDir();
+  auto path = file::JoinPath(dir, "model");
+  ASSERT_TRUE(file::WriteFile(path, "some model bytes"));
+
+  auto bytes = ReadModelBytes(path);
+  EXPECT_EQ("some model bytes", AsStringView(bytes));
+  EXPECT_EQ("model bytes", AsStringView(bytes.Suffix(5)));
+}
+
+TEST(ModelCacheTest, ReadWithCache) {
+  auto src_dir = MakeTempDir();
+  auto path = file::JoinPath(src_dir, "model");
+  ASSERT_TRUE(file::WriteFile(path, "cached model bytes"));
+
+  SetModelCacheDir(MakeTempDir());
+
+  auto bytes = ReadModelBytes(path);
+  EXPECT_EQ("cached model bytes", AsStringView(bytes));
+
+  // Delete the source file: a second read must be served entirely from the
+  // cache.
+  ASSERT_EQ(0, std::remove(path.c_str()));
+  auto cached_bytes = ReadModelBytes(path);
+  EXPECT_EQ("cached model bytes", AsStringView(cached_bytes));
+
+  SetModelCacheDir("");
+}
+
+TEST(ModelCacheTest, FetchViaDelta) {
+  auto src_dir = MakeTempDir();
+  auto base_path = file::JoinPath(src_dir, "gen_1");
+  auto target_path = file::JoinPath(src_dir, "gen_2");
+  std::string base(1 << 18, 'a');
+  auto target = base;
+  target.append("new generation bytes");
+  ASSERT_TRUE(file::WriteFile(base_path, base));
+  ASSERT_TRUE(file::WriteFile(target_path, target));
+  ASSERT_TRUE(file::WriteFile(absl::StrCat(target_path, ".mgdelta"),
+                              BuildModelDelta(base, target)));
+
+  SetModelCacheDir(MakeTempDir());
+
+  // Read the base generation so its content-addressed copy is cached.
+  auto base_bytes = ReadModelBytes(base_path);
+  EXPECT_EQ(base, AsStringView(base_bytes));
+
+  // Delete the target: fetching it can only succeed by patching the cached
+  // base with the delta sidecar.
+  ASSERT_EQ(0, std::remove(target_path.c_str()));
+  auto target_bytes = ReadModelBytes(target_path);
+  EXPECT_EQ(target, AsStringView(target_bytes));
+
+  SetModelCacheDir("");
+}
+
+}  // namespace
+}  // namespace minigo
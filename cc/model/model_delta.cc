@@ -0,0 +1,283 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/model_delta.h"
+
+#include <cstring>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cc/logging.h"
+
+namespace minigo {
+namespace {
+
+// Delta file layout: a ModelDeltaHeader followed by a stream of ops, each a
+// one byte tag and its payload:
+//   kCopyOp:    uint64 base offset, uint64 length  (copy bytes from base)
+//   kLiteralOp: uint64 length, then that many raw target bytes
+// All fields are little-endian PODs written and read with memcpy, matching
+// the repo's other binary formats.
+struct ModelDeltaHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t base_fingerprint;
+  uint64_t target_fingerprint;
+  uint64_t target_size;
+  uint64_t chunk_size;
+};
+
+constexpr char kMagic[8] = {'m', 'g', 'd', 'e', 'l', 't', 'a', '\0'};
+constexpr uint64_t kVersion = 1;
+constexpr uint8_t kCopyOp = 0;
+constexpr uint8_t kLiteralOp = 1;
+
+template <typename T>
+void AppendPod(const T& src, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&src), sizeof(src));
+}
+
+template <typename T>
+bool ReadPod(const char** src, const char* end, T* dst) {
+  if (static_cast<size_t>(end - *src) < sizeof(*dst)) {
+    return false;
+  }
+  memcpy(dst, *src, sizeof(*dst));
+  *src += sizeof(*dst);
+  return true;
+}
+
+// rsync's weak checksum: two running 16 bit sums that can be rolled forward
+// one byte at a time. All arithmetic is done mod 2^32 and truncated to
+// 16 bits when the hash is read, which is equivalent to doing it mod 2^16
+// throughout.
+class RollingHash {
+ public:
+  void Init(const char* data, uint64_t len) {
+    s1_ = 0;
+    s2_ = 0;
+    for (uint64_t i = 0; i < len; ++i) {
+      s1_ += static_cast<uint8_t>(data[i]);
+      s2_ += s1_;
+    }
+  }
+
+  // Slides the window one byte forward: `out` leaves the window, `in`
+  // enters it. `len` is the window size.
+  void Roll(uint8_t out, uint8_t in, uint64_t len) {
+    s1_ += in - out;
+    s2_ += s1_ - static_cast<uint32_t>(len) * out;
+  }
+
+  uint32_t get() const { return (s1_ & 0xffff) | (s2_ << 16); }
+
+ private:
+  uint32_t s1_ = 0;
+  uint32_t s2_ = 0;
+};
+
+}  // namespace
+
+uint64_t ModelFingerprint(absl::string_view bytes) {
+  uint64_t h = 14695981039346656037ULL;
+  for (char c : bytes) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+std::string BuildModelDelta(absl::string_view base, absl::string_view target,
+                            uint64_t chunk_size) {
+  MG_CHECK(chunk_size > 0);
+
+  // Index the base's chunks by weak hash. Each bucket keeps the strong
+  // fingerprint too, so a weak collision during the scan costs one
+  // fingerprint comparison rather than a false match.
+  struct ChunkRef {
+    uint64_t strong;
+    uint64_t offset;
+  };
+  absl::flat_hash_map<uint32_t, std::vector<ChunkRef>> chunks;
+  for (uint64_t off = 0; off + chunk_size <= base.size(); off += chunk_size) {
+    RollingHash weak;
+    weak.Init(base.data() + off, chunk_size);
+    chunks[weak.get()].push_back(
+        {ModelFingerprint(base.substr(off, chunk_size)), off});
+  }
+
+  // Scan the target with a rolling window, greedily taking chunk matches and
+  // accumulating unmatched bytes into literals. Ops are collected first so
+  // that runs of adjacent chunks collapse into single copy ops.
+  struct Op {
+    uint8_t tag;
+    uint64_t offset;  // Base offset for copies, target offset for literals.
+    uint64_t len;
+  };
+  std::vector<Op> ops;
+  auto add_copy = [&](uint64_t off) {
+    if (!ops.empty() && ops.back().tag == kCopyOp &&
+        ops.back().offset + ops.back().len == off) {
+      ops.back().len += chunk_size;
+    } else {
+      ops.push_back({kCopyOp, off, chunk_size});
+    }
+  };
+  auto add_literal = [&](uint64_t begin, uint64_t end) {
+    if (end > begin) {
+      ops.push_back({kLiteralOp, begin, end - begin});
+    }
+  };
+
+  uint64_t literal_start = 0;
+  uint64_t i = 0;
+  RollingHash weak;
+  bool weak_valid = false;
+  while (i + chunk_size <= target.size()) {
+    if (!weak_valid) {
+      weak.Init(target.data() + i, chunk_size);
+      weak_valid = true;
+    }
+
+    const ChunkRef* match = nullptr;
+    auto it = chunks.find(weak.get());
+    if (it != chunks.end()) {
+      auto strong = ModelFingerprint(target.substr(i, chunk_size));
+      for (const auto& ref : it->second) {
+        if (ref.strong == strong) {
+          match = &ref;
+          break;
+        }
+      }
+    }
+
+    if (match != nullptr) {
+      add_literal(literal_start, i);
+      add_copy(match->offset);
+      i += chunk_size;
+      literal_start = i;
+      weak_valid = false;
+    } else {
+      if (i + chunk_size < target.size()) {
+        weak.Roll(static_cast<uint8_t>(target[i]),
+                  static_cast<uint8_t>(target[i + chunk_size]), chunk_size);
+      }
+      i += 1;
+    }
+  }
+  add_literal(literal_start, target.size());
+
+  ModelDeltaHeader header;
+  memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.base_fingerprint = ModelFingerprint(base);
+  header.target_fingerprint = ModelFingerprint(target);
+  header.target_size = target.size();
+  header.chunk_size = chunk_size;
+
+  std::string result;
+  AppendPod(header, &result);
+  for (const auto& op : ops) {
+    AppendPod(op.tag, &result);
+    if (op.tag == kCopyOp) {
+      AppendPod(op.offset, &result);
+      AppendPod(op.len, &result);
+    } else {
+      AppendPod(op.len, &result);
+      result.append(target.data() + op.offset, op.len);
+    }
+  }
+  return result;
+}
+
+namespace {
+
+bool ReadHeader(const char** src, const char* end, ModelDeltaHeader* header) {
+  if (!ReadPod(src, end, header)) {
+    return false;
+  }
+  return memcmp(header->magic, kMagic, sizeof(header->magic)) == 0 &&
+         header->version == kVersion && header->chunk_size > 0;
+}
+
+}  // namespace
+
+bool ReadModelDeltaHeader(absl::string_view delta, uint64_t* base_fingerprint,
+                          uint64_t* target_fingerprint, uint64_t* target_size) {
+  const char* src = delta.data();
+  const char* end = src + delta.size();
+  ModelDeltaHeader header;
+  if (!ReadHeader(&src, end, &header)) {
+    return false;
+  }
+  if (base_fingerprint != nullptr) {
+    *base_fingerprint = header.base_fingerprint;
+  }
+  if (target_fingerprint != nullptr) {
+    *target_fingerprint = header.target_fingerprint;
+  }
+  if (target_size != nullptr) {
+    *target_size = header.target_size;
+  }
+  return true;
+}
+
+bool ApplyModelDelta(absl::string_view base, absl::string_view delta,
+                     std::string* target) {
+  const char* src = delta.data();
+  const char* end = src + delta.size();
+
+  ModelDeltaHeader header;
+  if (!ReadHeader(&src, end, &header)) {
+    return false;
+  }
+  if (header.base_fingerprint != ModelFingerprint(base)) {
+    return false;
+  }
+
+  target->clear();
+  target->reserve(header.target_size);
+  while (src < end) {
+    uint8_t tag;
+    if (!ReadPod(&src, end, &tag)) {
+      return false;
+    }
+    if (tag == kCopyOp) {
+      uint64_t offset, len;
+      if (!ReadPod(&src, end, &offset) || !ReadPod(&src, end, &len) ||
+          offset + len < offset || offset + len > base.size()) {
+        return false;
+      }
+      target->append(base.data() + offset, len);
+    } else if (tag == kLiteralOp) {
+      uint64_t len;
+      if (!ReadPod(&src, end, &len) ||
+          static_cast<uint64_t>(end - src) < len) {
+        return false;
+      }
+      target->append(src, len);
+      src += len;
+    } else {
+      return false;
+    }
+    if (target->size() > header.target_size) {
+      return false;
+    }
+  }
+
+  return target->size() == header.target_size &&
+         ModelFingerprint(*target) == header.target_fingerprint;
+}
+
+}  // namespace minigo
@@ -0,0 +1,72 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_MODEL_MODEL_DELTA_H_
+#define CC_MODEL_MODEL_DELTA_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace minigo {
+
+// rsync-style binary deltas between model generations.
+//
+// Consecutive generations are one training epoch apart but each worker
+// downloads the full multi-hundred-MB artifact every swap, which dominates
+// our fleet's network traffic. A delta is built offline (see
+// build_model_delta) by chunking the previous generation, indexing the
+// chunks by a weak rolling checksum plus a strong fingerprint, and scanning
+// the new generation for matching runs: regions the training step left
+// untouched (metadata, tensor directories, frozen or quantized-identical
+// blobs in the flat weight format) become copy ops against the base and
+// only the bytes that actually changed are shipped as literals. The trainer
+// publishes the delta as a `<model>.mgdelta` sidecar next to the model; the
+// host-local model cache (cc/model/model_cache.cc) patches new generations
+// from its cached copy of the base instead of downloading them when the
+// sidecar is available.
+
+// 64 bit FNV-1a fingerprint of model contents. This is the same function the
+// model cache uses for content addressing, so a delta's base generation can
+// be located in the cache by fingerprint alone.
+uint64_t ModelFingerprint(absl::string_view bytes);
+
+constexpr uint64_t kDefaultDeltaChunkSize = 1 << 16;
+
+// Builds a delta that transforms `base` into `target`, matching runs of
+// `chunk_size` bytes. Smaller chunks find more matches but grow the chunk
+// index and the per-op overhead. Never fails: if the generations share
+// nothing, the delta degenerates to one literal holding all of `target`
+// (plus a small header), so shipping a delta is never much worse than
+// shipping the model.
+std::string BuildModelDelta(absl::string_view base, absl::string_view target,
+                            uint64_t chunk_size = kDefaultDeltaChunkSize);
+
+// Parses just the delta's header. Returns false if `delta` isn't a valid
+// model delta. Any of the output pointers may be null.
+bool ReadModelDeltaHeader(absl::string_view delta, uint64_t* base_fingerprint,
+                          uint64_t* target_fingerprint, uint64_t* target_size);
+
+// Applies `delta` to `base`, writing the reconstructed model to `target`.
+// Returns false without MG_CHECK-failing if the delta is malformed, was
+// built against a different base, or the reconstruction doesn't match the
+// delta's target fingerprint: a worker that can't apply a delta should fall
+// back to a full fetch, not crash.
+bool ApplyModelDelta(absl::string_view base, absl::string_view delta,
+                     std::string* target);
+
+}  // namespace minigo
+
+#endif  // CC_MODEL_MODEL_DELTA_H_
@@ -0,0 +1,138 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/model/model_delta.h"
+
+#include <cstdint>
+#include <string>
+
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Small chunks so the tests exercise matching without megabytes of data.
+constexpr uint64_t kChunkSize = 64;
+
+std::string RandomBytes(size_t size, uint64_t seed) {
+  Random rnd(seed, 1);
+  std::string result(size, '\0');
+  for (auto& c : result) {
+    c = static_cast<char>(rnd.UniformInt(0, 255));
+  }
+  return result;
+}
+
+TEST(ModelDeltaTest, IdenticalContents) {
+  auto base = RandomBytes(kChunkSize * 100, 1);
+
+  auto delta = BuildModelDelta(base, base, kChunkSize);
+  // Everything matches, so the delta is a header plus one merged copy op.
+  EXPECT_LT(delta.size(), 100u);
+
+  std::string patched;
+  ASSERT_TRUE(ApplyModelDelta(base, delta, &patched));
+  EXPECT_EQ(base, patched);
+}
+
+TEST(ModelDeltaTest, ModifiedContents) {
+  auto base = RandomBytes(kChunkSize * 100, 2);
+
+  // Overwrite a run in the middle, insert bytes (shifting the chunk
+  // alignment of everything after them) and drop the final chunk.
+  auto target = base;
+  for (uint64_t i = kChunkSize * 10; i < kChunkSize * 12; ++i) {
+    target[i] ^= 0x5a;
+  }
+  target.insert(kChunkSize * 50, "inserted");
+  target.resize(target.size() - kChunkSize);
+
+  auto delta = BuildModelDelta(base, target, kChunkSize);
+  // The unmodified runs should match even after the insertion shifted them,
+  // so the delta should be a small fraction of the target.
+  EXPECT_LT(delta.size(), target.size() / 4);
+
+  std::string patched;
+  ASSERT_TRUE(ApplyModelDelta(base, delta, &patched));
+  EXPECT_EQ(target, patched);
+}
+
+TEST(ModelDeltaTest, NothingShared) {
+  auto base = RandomBytes(kChunkSize * 8, 3);
+  auto target = RandomBytes(kChunkSize * 8, 4);
+
+  auto delta = BuildModelDelta(base, target, kChunkSize);
+
+  std::string patched;
+  ASSERT_TRUE(ApplyModelDelta(base, delta, &patched));
+  EXPECT_EQ(target, patched);
+}
+
+TEST(ModelDeltaTest, EmptyBase) {
+  auto target = RandomBytes(kChunkSize * 8, 5);
+
+  auto delta = BuildModelDelta("", target, kChunkSize);
+
+  std::string patched;
+  ASSERT_TRUE(ApplyModelDelta("", delta, &patched));
+  EXPECT_EQ(target, patched);
+}
+
+TEST(ModelDeltaTest, ReadHeader) {
+  auto base = RandomBytes(kChunkSize * 4, 6);
+  auto target = RandomBytes(kChunkSize * 4, 7);
+  auto delta = BuildModelDelta(base, target, kChunkSize);
+
+  uint64_t base_fingerprint, target_fingerprint, target_size;
+  ASSERT_TRUE(ReadModelDeltaHeader(delta, &base_fingerprint,
+                                   &target_fingerprint, &target_size));
+  EXPECT_EQ(ModelFingerprint(base), base_fingerprint);
+  EXPECT_EQ(ModelFingerprint(target), target_fingerprint);
+  EXPECT_EQ(target.size(), target_size);
+
+  EXPECT_FALSE(ReadModelDeltaHeader("not a delta", nullptr, nullptr, nullptr));
+}
+
+TEST(ModelDeltaTest, RejectsWrongBase) {
+  auto base = RandomBytes(kChunkSize * 8, 8);
+  auto target = RandomBytes(kChunkSize * 8, 9);
+  auto delta = BuildModelDelta(base, target, kChunkSize);
+
+  auto wrong_base = RandomBytes(kChunkSize * 8, 10);
+  std::string patched;
+  EXPECT_FALSE(ApplyModelDelta(wrong_base, delta, &patched));
+}
+
+TEST(ModelDeltaTest, RejectsCorruptDelta) {
+  auto base = RandomBytes(kChunkSize * 8, 11);
+  auto target = base;
+  target.append("trailing literal bytes");
+  auto delta = BuildModelDelta(base, target, kChunkSize);
+
+  std::string patched;
+
+  // Truncated op stream.
+  EXPECT_FALSE(
+      ApplyModelDelta(base, absl::string_view(delta).substr(0, delta.size() - 1),
+                      &patched));
+
+  // A flipped literal byte no longer matches the target fingerprint.
+  auto corrupt = delta;
+  corrupt.back() ^= 1;
+  EXPECT_FALSE(ApplyModelDelta(base, corrupt, &patched));
+}
+
+}  // namespace
+}  // namespace minigo
@@ -16,10 +16,13 @@
 #define CC_MODEL_TYPES_H_
 
 #include <iostream>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "cc/inline_vector.h"
 #include "cc/logging.h"
+#include "cc/platform/utils.h"
 #include "cc/position.h"
 #include "cc/symmetries.h"
 
@@ -113,6 +116,9 @@ struct Tensor {
 template <typename T>
 class BackedTensor {
  public:
+  static_assert(std::is_trivial<T>::value,
+                "BackedTensor elements are not constructed or destroyed");
+
   BackedTensor() = default;
   BackedTensor(const TensorShape& shape) { resize(shape); }
 
@@ -126,27 +132,45 @@ class BackedTensor {
         size *= shape[i];
       }
     }
-    if (static_cast<size_t>(size) > buffer_.size()) {
-      buffer_.resize(size);
+    if (static_cast<size_t>(size) > capacity_) {
+      // Batch feature and output buffers are large, long-lived and rewritten
+      // every inference, so back them with huge pages (when the kernel
+      // provides them) rather than growing a heap vector. Growing discards
+      // the old contents; every user fills the tensor before reading it.
+      size_t bytes = size * sizeof(T);
+      buffer_ = {static_cast<T*>(AllocLargePages(bytes)), Unmapper{bytes}};
+      capacity_ = size;
     }
-    tensor_ = {shape, buffer_.data()};
+    tensor_ = {shape, buffer_.get()};
   }
 
   const Tensor<T>& tensor() const { return tensor_; }
   Tensor<T>& tensor() { return tensor_; }
 
  private:
+  struct Unmapper {
+    size_t bytes = 0;
+    void operator()(T* p) const { FreeLargePages(p, bytes); }
+  };
+
   Tensor<T> tensor_;
-  std::vector<T> buffer_;
+  std::unique_ptr<T[], Unmapper> buffer_;
+  size_t capacity_ = 0;
 };
 
 struct ModelInput {
   // Symmetry to apply to the input features when performing inference.
   symmetry::Symmetry sym = symmetry::kNumSymmetries;
 
-  // position_history[0] holds the current position and position_history[i]
-  // holds the position from i moves ago.
-  inline_vector<const Position*, kMaxPositionHistory> position_history;
+  // The position being evaluated.
+  const Position* position = nullptr;
+
+  // stone_history[0] holds the stones of the current position and
+  // stone_history[i] holds the stones as they were i moves ago. The packed
+  // snapshots are all the input features need from earlier positions, so
+  // assembling an input doesn't require the game history's full Position
+  // objects (or the MctsNode ancestor chain that owns them) to stay alive.
+  inline_vector<const StoneSnapshot*, kMaxPositionHistory> stone_history;
 };
 
 struct ModelOutput {
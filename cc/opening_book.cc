@@ -0,0 +1,200 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/opening_book.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cc/file/utils.h"
+#include "cc/logging.h"
+#include "cc/model/inference_cache.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr char kMagic[8] = {'m', 'g', 'b', 'o', 'o', 'k', 0, 0};
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t board_size;
+  uint64_t num_positions;
+};
+
+template <typename T>
+void AppendPod(const T& src, std::string* dst) {
+  dst->append(reinterpret_cast<const char*>(&src), sizeof(src));
+}
+
+template <typename T>
+bool ReadPod(const char** src, const char* end, T* dst) {
+  if (static_cast<size_t>(end - *src) < sizeof(*dst)) {
+    return false;
+  }
+  memcpy(dst, *src, sizeof(*dst));
+  *src += sizeof(*dst);
+  return true;
+}
+
+}  // namespace
+
+zobrist::Hash OpeningBook::KeyHash(Coord prev_move, symmetry::Symmetry sym,
+                                   const Position& position) {
+  return InferenceCache::Key(prev_move, sym, position).hash();
+}
+
+Coord OpeningBook::SampleMove(const Entry& entry, float temperature,
+                              Random* rnd) {
+  MG_CHECK(!entry.empty());
+  if (temperature == 0) {
+    // Entries are sorted by descending weight.
+    return entry[0].c;
+  }
+
+  std::vector<float> cdf;
+  cdf.reserve(entry.size());
+  float sum = 0;
+  for (const auto& move_info : entry) {
+    sum += std::pow(move_info.weight, 1 / temperature);
+    cdf.push_back(sum);
+  }
+  return entry[rnd->SampleCdf(absl::MakeSpan(cdf))].c;
+}
+
+bool OpeningBook::Load(const std::string& path) {
+  std::string contents;
+  if (!file::ReadFile(path, &contents)) {
+    return false;
+  }
+
+  const char* src = contents.data();
+  const char* end = src + contents.size();
+  Header header;
+  if (!ReadPod(&src, end, &header) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    MG_LOG(WARNING) << path << " is not an opening book";
+    return false;
+  }
+  if (header.version != kVersion) {
+    MG_LOG(WARNING) << path << " has unsupported version " << header.version;
+    return false;
+  }
+  if (header.board_size != kN) {
+    MG_LOG(WARNING) << path << " is for board size " << header.board_size
+                    << ", expected " << kN;
+    return false;
+  }
+
+  entries_.clear();
+  entries_.reserve(header.num_positions);
+  for (uint64_t i = 0; i < header.num_positions; ++i) {
+    zobrist::Hash key;
+    uint32_t num_moves;
+    if (!ReadPod(&src, end, &key) || !ReadPod(&src, end, &num_moves)) {
+      MG_LOG(WARNING) << path << " is truncated";
+      return false;
+    }
+    auto& entry = entries_[key];
+    entry.reserve(num_moves);
+    for (uint32_t j = 0; j < num_moves; ++j) {
+      uint16_t c;
+      uint32_t weight;
+      if (!ReadPod(&src, end, &c) || !ReadPod(&src, end, &weight) ||
+          Coord(c) >= kNumMoves) {
+        MG_LOG(WARNING) << path << " is corrupt";
+        return false;
+      }
+      entry.push_back({Coord(c), weight});
+    }
+    // Serialize writes moves sorted, but don't trust the file.
+    std::sort(entry.begin(), entry.end(),
+              [](const MoveInfo& a, const MoveInfo& b) {
+                return a.weight > b.weight;
+              });
+  }
+  return true;
+}
+
+const OpeningBook::Entry* OpeningBook::Lookup(zobrist::Hash key) const {
+  auto it = entries_.find(key);
+  return it == entries_.end() ? nullptr : &it->second;
+}
+
+void OpeningBook::AddVisits(zobrist::Hash key, Coord c, uint32_t weight) {
+  MG_CHECK(c < kNumMoves);
+  auto& entry = entries_[key];
+  for (auto& move_info : entry) {
+    if (move_info.c == c) {
+      move_info.weight += weight;
+      return;
+    }
+  }
+  entry.push_back({c, weight});
+}
+
+void OpeningBook::Prune(uint32_t min_weight) {
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    auto& entry = it->second;
+    entry.erase(std::remove_if(entry.begin(), entry.end(),
+                               [&](const MoveInfo& move_info) {
+                                 return move_info.weight < min_weight;
+                               }),
+                entry.end());
+    if (entry.empty()) {
+      entries_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::string OpeningBook::Serialize() const {
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.board_size = kN;
+  header.num_positions = entries_.size();
+
+  std::string contents;
+  contents.reserve(sizeof(header) + entries_.size() * 64);
+  AppendPod(header, &contents);
+
+  std::vector<zobrist::Hash> keys;
+  keys.reserve(entries_.size());
+  for (const auto& kv : entries_) {
+    keys.push_back(kv.first);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  for (auto key : keys) {
+    auto entry = entries_.at(key);
+    std::sort(entry.begin(), entry.end(),
+              [](const MoveInfo& a, const MoveInfo& b) {
+                return a.weight != b.weight ? a.weight > b.weight : a.c < b.c;
+              });
+    AppendPod(key, &contents);
+    AppendPod(static_cast<uint32_t>(entry.size()), &contents);
+    for (const auto& move_info : entry) {
+      AppendPod(static_cast<uint16_t>(move_info.c), &contents);
+      AppendPod(move_info.weight, &contents);
+    }
+  }
+  return contents;
+}
+
+}  // namespace minigo
@@ -0,0 +1,94 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_OPENING_BOOK_H_
+#define CC_OPENING_BOOK_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cc/coord.h"
+#include "cc/platform/utils.h"
+#include "cc/position.h"
+#include "cc/random.h"
+#include "cc/symmetries.h"
+#include "cc/zobrist.h"
+
+namespace minigo {
+
+// A book of opening moves aggregated from selfplay games. Every game
+// re-searches the same handful of opening positions at full readouts;
+// positions found in the book can be played directly without spending any,
+// see MctsPlayer::Options::opening_book. Books are built offline by
+// build_opening_book.cc.
+//
+// Positions are keyed by the hash of an InferenceCache::Key, which is
+// deterministic (it's built from the compile-time Zobrist tables) and so safe
+// to store in a file. Lookups use the identity canonical symmetry; the
+// aggregation tool folds each position's eight symmetries into the book so
+// rotated and reflected openings still hit.
+class OpeningBook {
+ public:
+  struct MoveInfo {
+    Coord c;
+    // Total weight accumulated for the move, e.g. the number of games that
+    // played it.
+    uint32_t weight;
+  };
+
+  // The moves recorded for one position, sorted by descending weight.
+  using Entry = std::vector<MoveInfo>;
+
+  // Returns the book key for a position. `prev_move` is the move that
+  // created the position (or kInvalid at the start of the game), as for
+  // InferenceCache::Key.
+  static zobrist::Hash KeyHash(Coord prev_move, symmetry::Symmetry sym,
+                               const Position& position);
+
+  // Samples a move from the entry with each weight raised to
+  // 1 / temperature. A temperature of zero always picks the most common
+  // move; higher values add diversity for selfplay.
+  static Coord SampleMove(const Entry& entry, float temperature, Random* rnd);
+
+  // Loads a book written by Serialize, returning false on failure.
+  MG_WARN_UNUSED_RESULT bool Load(const std::string& path);
+
+  // Returns the book entry for the key, or nullptr if the position isn't in
+  // the book.
+  const Entry* Lookup(zobrist::Hash key) const;
+
+  // The remaining methods are only used when building a book.
+
+  // Adds `weight` to `key`'s entry for the move `c`.
+  void AddVisits(zobrist::Hash key, Coord c, uint32_t weight);
+
+  // Drops moves with less than `min_weight` weight, then positions with no
+  // moves left, removing openings too rare to have trustworthy statistics.
+  void Prune(uint32_t min_weight);
+
+  // Serializes the book. The output is deterministic: entries are written in
+  // ascending key order.
+  std::string Serialize() const;
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  absl::flat_hash_map<zobrist::Hash, Entry> entries_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_OPENING_BOOK_H_
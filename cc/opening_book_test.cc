@@ -0,0 +1,162 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/opening_book.h"
+
+#include <cstdlib>
+#include <limits>
+
+#include "cc/constants.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/position.h"
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(OpeningBookTest, AddLookupPrune) {
+  OpeningBook book;
+  book.AddVisits(123, Coord(3), 1);
+  book.AddVisits(123, Coord(3), 2);
+  book.AddVisits(123, Coord(7), 1);
+  book.AddVisits(456, Coord(9), 1);
+
+  const auto* entry = book.Lookup(123);
+  ASSERT_NE(nullptr, entry);
+  ASSERT_EQ(2, entry->size());
+  EXPECT_EQ(nullptr, book.Lookup(789));
+
+  // Pruning drops the moves at key 123 seen fewer than 3 times, and all of
+  // key 456.
+  book.Prune(3);
+  entry = book.Lookup(123);
+  ASSERT_NE(nullptr, entry);
+  ASSERT_EQ(1, entry->size());
+  EXPECT_EQ(Coord(3), (*entry)[0].c);
+  EXPECT_EQ(3, (*entry)[0].weight);
+  EXPECT_EQ(nullptr, book.Lookup(456));
+  EXPECT_EQ(1, book.size());
+}
+
+TEST(OpeningBookTest, SerializeLoadRoundTrip) {
+  Random rnd(614944751, 1);
+  OpeningBook book;
+  for (int i = 0; i < 100; ++i) {
+    book.AddVisits(rnd.UniformUint64() % 10, rnd.UniformInt(0, kNumMoves - 1),
+                   1 + rnd.UniformInt(0, 100));
+  }
+
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  auto path = file::JoinPath(tmpdir, "test.mgbook");
+  MG_CHECK(file::WriteFile(path, book.Serialize()));
+
+  OpeningBook loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  ASSERT_EQ(book.size(), loaded.size());
+  for (uint64_t key = 0; key < 10; ++key) {
+    const auto* entry = book.Lookup(key);
+    const auto* loaded_entry = loaded.Lookup(key);
+    if (entry == nullptr) {
+      EXPECT_EQ(nullptr, loaded_entry);
+      continue;
+    }
+    ASSERT_NE(nullptr, loaded_entry);
+    ASSERT_EQ(entry->size(), loaded_entry->size());
+    uint32_t prev_weight = std::numeric_limits<uint32_t>::max();
+    for (const auto& loaded_move : *loaded_entry) {
+      // Loaded entries are sorted by descending weight and hold the same
+      // moves as the original.
+      EXPECT_LE(loaded_move.weight, prev_weight);
+      prev_weight = loaded_move.weight;
+      bool found = false;
+      for (const auto& move : *entry) {
+        if (move.c == loaded_move.c) {
+          EXPECT_EQ(move.weight, loaded_move.weight);
+          found = true;
+        }
+      }
+      EXPECT_TRUE(found);
+    }
+  }
+}
+
+TEST(OpeningBookTest, RejectsCorruptBooks) {
+  const char* tmpdir = std::getenv("TEST_TMPDIR");
+  MG_CHECK(tmpdir != nullptr) << "TEST_TMPDIR environment variable not found";
+  auto path = file::JoinPath(tmpdir, "corrupt.mgbook");
+
+  OpeningBook book;
+  book.AddVisits(123, Coord(3), 1);
+  auto contents = book.Serialize();
+
+  OpeningBook loaded;
+  MG_CHECK(file::WriteFile(path, ""));
+  EXPECT_FALSE(loaded.Load(path));
+
+  MG_CHECK(file::WriteFile(path, contents.substr(0, contents.size() - 1)));
+  EXPECT_FALSE(loaded.Load(path));
+
+  auto bad_magic = contents;
+  bad_magic[0] = 'x';
+  MG_CHECK(file::WriteFile(path, bad_magic));
+  EXPECT_FALSE(loaded.Load(path));
+}
+
+// A book built from a game folds in all eight symmetries, so lookups with
+// the identity symmetry hit from any rotation or reflection of the game.
+TEST(OpeningBookTest, SymmetricPositionsShareKeys) {
+  const Coord moves[] = {Coord(2 * kN + 3), Coord(5 * kN + 4),
+                         Coord(3 * kN + 3)};
+
+  for (int i = 0; i < symmetry::kNumSymmetries; ++i) {
+    auto sym = static_cast<symmetry::Symmetry>(i);
+
+    Position position(Color::kBlack);
+    Position symmetric_position(Color::kBlack);
+    Coord prev_move = Coord::kInvalid;
+    Coord symmetric_prev_move = Coord::kInvalid;
+    for (auto c : moves) {
+      EXPECT_EQ(
+          OpeningBook::KeyHash(prev_move, sym, position),
+          OpeningBook::KeyHash(symmetric_prev_move, symmetry::kIdentity,
+                               symmetric_position));
+      position.PlayMove(c);
+      symmetric_position.PlayMove(symmetry::kCoords[sym][c]);
+      prev_move = c;
+      symmetric_prev_move = symmetry::kCoords[sym][c];
+    }
+  }
+}
+
+TEST(OpeningBookTest, SampleMove) {
+  Random rnd(614944751, 2);
+  OpeningBook::Entry entry = {{Coord(3), 100}, {Coord(7), 10}, {Coord(9), 1}};
+
+  // Temperature 0 always picks the most common move.
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(Coord(3), OpeningBook::SampleMove(entry, 0, &rnd));
+  }
+
+  // Higher temperatures sample from the entry's moves.
+  for (int i = 0; i < 100; ++i) {
+    auto c = OpeningBook::SampleMove(entry, 2, &rnd);
+    EXPECT_TRUE(c == Coord(3) || c == Coord(7) || c == Coord(9));
+  }
+}
+
+}  // namespace
+}  // namespace minigo
@@ -19,17 +19,18 @@
 
 namespace minigo {
 
-constexpr size_t kAlignment = 16;
+constexpr size_t kAlignment = 64;
 
 template <typename T>
 class PaddedSpan;
 
 // An array implementation whose internal storage is padded to be a multiple of
-// 16 bytes. This means vectorized SSE code can read and write to the array
-// without having to worry about the last few elements in the array.
+// 64 bytes. This means vectorized code up to AVX-512 width can read and write
+// to the array without having to worry about the last few elements in the
+// array.
 //
 // NOTE: this class does NOT guarantee that the base address of the array is
-// also aligned to 16 bytes, so vectorized code should always use unaligned
+// also aligned to 64 bytes, so vectorized code should always use unaligned
 // loads and stores. In practice these aren't significantly slower than aligned
 // loads and stores on modern x86 architectures anyway.
 template <typename T, size_t Size>
@@ -1025,5 +1025,60 @@ TEST_F(PassAliveTest, 19x19) {
   RunTests(tests);
 }
 
+// Verifies that the lazily computed pass-alive regions track board mutations:
+// the cache must be invalidated by both PlayMove and UndoMove, and copies of
+// a position must see the correct regions.
+TEST_F(PassAliveTest, CacheTracksBoardMutations) {
+  if (kN != 9) {
+    return;
+  }
+
+  // The black group in the top-left corner is one stone (D9) away from being
+  // pass-alive with eyes at A9 and C9.
+  TestablePosition board(
+      R"(. X . . O . . . .
+         X X X X O . . . .
+         O O O O O . . . .
+         . . . . . . . . .
+         . . . . . . . . .
+         . . . . . . . . .
+         . . . . . . . . .
+         . . . . . . . . .
+         . . . . . . . . .)");
+
+  auto count_pass_alive = [](const Position& p) {
+    int n = 0;
+    for (auto color : p.CalculatePassAliveRegions()) {
+      if (color != Color::kEmpty) {
+        n += 1;
+      }
+    }
+    return n;
+  };
+
+  EXPECT_EQ(0, count_pass_alive(board));
+
+  // Completing the group must update the cached regions.
+  board.PlayMove("D9", Color::kBlack);
+  EXPECT_EQ(2, count_pass_alive(board));
+  EXPECT_EQ(Color::kBlack,
+            board.CalculatePassAliveRegions()[Coord::FromString("A9")]);
+  EXPECT_EQ(Color::kBlack,
+            board.CalculatePassAliveRegions()[Coord::FromString("C9")]);
+
+  // Copies share the cached regions.
+  TestablePosition copy = board;
+  EXPECT_EQ(2, count_pass_alive(copy));
+
+  // Filling an eye destroys pass-aliveness; undoing the move restores it.
+  auto undo = board.PlayMove(Coord::FromString("C9"), Color::kBlack);
+  EXPECT_EQ(0, count_pass_alive(board));
+  board.UndoMove(undo);
+  EXPECT_EQ(2, count_pass_alive(board));
+
+  // Moves played on the original don't affect the copy.
+  EXPECT_EQ(2, count_pass_alive(copy));
+}
+
 }  // namespace
 }  // namespace minigo
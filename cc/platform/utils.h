@@ -15,7 +15,9 @@
 #ifndef CC_PLATFORM_UTILS_H_
 #define CC_PLATFORM_UTILS_H_
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 #if defined(_MSC_VER)
 
@@ -47,6 +49,45 @@ using ProcessId = pid_t;
 // Returns the number of logical CPUs.
 int GetNumLogicalCpus();
 
+// Returns the number of NUMA nodes that have CPUs attached. Returns 1 on
+// platforms where the topology can't be queried.
+int GetNumNumaNodes();
+
+// Returns the IDs of the logical CPUs attached to the given NUMA node, or an
+// empty vector on platforms where the topology can't be queried.
+std::vector<int> GetNumaNodeCpus(int node);
+
+// Restricts the calling thread to the CPUs of the given NUMA node. Memory
+// the thread allocates afterwards is placed on that node by the kernel's
+// first-touch policy, so binding a thread before it allocates keeps its
+// working set local to the socket it runs on. No-op on platforms without
+// NUMA support.
+void BindThreadToNumaNode(int node);
+
+// Allocates `size` bytes of zeroed, page-aligned memory. Allocations of at
+// least one huge page (2MB) are rounded up to a whole number of huge pages,
+// aligned to a huge page boundary and advised MADV_HUGEPAGE, so the kernel
+// can back large, long-lived, randomly accessed buffers (MCTS node arenas,
+// batch feature tensors) with 2MB pages instead of thrashing the dTLB.
+// Smaller allocations use normal pages. The advice is best-effort: if
+// transparent huge pages are disabled the mapping just keeps normal pages.
+// CHECK fails if the allocation itself fails. Free with FreeLargePages,
+// passing the same size.
+void* AllocLargePages(size_t size);
+void FreeLargePages(void* p, size_t size);
+
+// Stats for verifying that huge page backing actually happened.
+struct LargePageStats {
+  // Live bytes allocated by AllocLargePages that requested huge pages.
+  size_t requested_bytes = 0;
+
+  // Anonymous memory the kernel reports as actually backed by huge pages
+  // (AnonHugePages in /proc/self/smaps_rollup). Process-wide, so it can
+  // exceed requested_bytes. Zero on platforms without the instrumentation.
+  size_t anon_huge_bytes = 0;
+};
+LargePageStats GetLargePageStats();
+
 // Returns true if the given file descriptor supports ANSI color codes.
 bool FdSupportsAnsiColors(int fd);
 
@@ -12,18 +12,177 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sched.h>
+#include <sys/mman.h>
 #include <sys/sysinfo.h>
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
+#include "cc/logging.h"
 #include "cc/platform/utils.h"
 
 namespace minigo {
 
+namespace {
+
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+std::atomic<size_t> huge_requested_bytes{0};
+
+size_t RoundUpToHugePages(size_t size) {
+  return (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+}
+
+}  // namespace
+
+void* AllocLargePages(size_t size) {
+  MG_CHECK(size > 0);
+  if (size < kHugePageSize) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    MG_CHECK(p != MAP_FAILED) << "mmap of " << size << " bytes failed";
+    return p;
+  }
+
+  // Over-map by one huge page so an aligned region of the rounded size is
+  // guaranteed to fit, then trim the unaligned head and tail. Transparent
+  // huge pages only back huge page aligned ranges, so without the trim the
+  // first and last 2MB of the buffer would usually stay on small pages.
+  size_t rounded = RoundUpToHugePages(size);
+  auto* raw = static_cast<uint8_t*>(mmap(nullptr, rounded + kHugePageSize,
+                                         PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  MG_CHECK(raw != MAP_FAILED) << "mmap of " << rounded << " bytes failed";
+  auto* p = reinterpret_cast<uint8_t*>(
+      RoundUpToHugePages(reinterpret_cast<uintptr_t>(raw)));
+  size_t head = p - raw;
+  if (head > 0) {
+    munmap(raw, head);
+  }
+  if (head < kHugePageSize) {
+    munmap(p + rounded, kHugePageSize - head);
+  }
+
+#ifdef MADV_HUGEPAGE
+  madvise(p, rounded, MADV_HUGEPAGE);
+#endif
+  huge_requested_bytes.fetch_add(rounded, std::memory_order_relaxed);
+  return p;
+}
+
+void FreeLargePages(void* p, size_t size) {
+  if (p == nullptr) {
+    return;
+  }
+  if (size < kHugePageSize) {
+    munmap(p, size);
+    return;
+  }
+  size_t rounded = RoundUpToHugePages(size);
+  huge_requested_bytes.fetch_sub(rounded, std::memory_order_relaxed);
+  munmap(p, rounded);
+}
+
+LargePageStats GetLargePageStats() {
+  LargePageStats stats;
+  stats.requested_bytes =
+      huge_requested_bytes.load(std::memory_order_relaxed);
+
+  // smaps_rollup sums the per-mapping stats; kernels old enough not to have
+  // it just report zero backed bytes.
+  FILE* f = fopen("/proc/self/smaps_rollup", "r");
+  if (f != nullptr) {
+    char line[256];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+      long kb;
+      if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+        stats.anon_huge_bytes = static_cast<size_t>(kb) * 1024;
+        break;
+      }
+    }
+    fclose(f);
+  }
+  return stats;
+}
+
 bool FdSupportsAnsiColors(int fd) { return isatty(fd); }
 
 int GetNumLogicalCpus() { return get_nprocs(); }
 
+int GetNumNumaNodes() {
+  // Count the nodes that sysfs reports CPUs for. Nodes are numbered
+  // contiguously from 0, so stop at the first gap.
+  int num_nodes = 0;
+  for (;;) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             num_nodes);
+    if (access(path, F_OK) != 0) {
+      break;
+    }
+    num_nodes += 1;
+  }
+  return num_nodes > 0 ? num_nodes : 1;
+}
+
+std::vector<int> GetNumaNodeCpus(int node) {
+  std::vector<int> result;
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+           node);
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) {
+    return result;
+  }
+  char cpulist[512];
+  bool ok = fgets(cpulist, sizeof(cpulist), f) != nullptr;
+  fclose(f);
+  if (!ok) {
+    return result;
+  }
+
+  // The cpulist is a comma-separated list of CPU IDs and ID ranges, e.g.
+  // "0-17,36-53".
+  char* p = cpulist;
+  for (;;) {
+    int lo = strtol(p, &p, 10);
+    int hi = lo;
+    if (*p == '-') {
+      hi = strtol(p + 1, &p, 10);
+    }
+    for (int cpu = lo; cpu <= hi; ++cpu) {
+      result.push_back(cpu);
+    }
+    if (*p != ',') {
+      break;
+    }
+    p += 1;
+  }
+  return result;
+}
+
+void BindThreadToNumaNode(int node) {
+  auto node_cpus = GetNumaNodeCpus(node);
+  if (node_cpus.empty()) {
+    MG_LOG(WARNING) << "couldn't read NUMA node " << node
+                    << "'s cpulist, not binding thread";
+    return;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int cpu : node_cpus) {
+    CPU_SET(cpu, &cpus);
+  }
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+    MG_LOG(WARNING) << "couldn't bind thread to NUMA node " << node;
+  }
+}
+
 ProcessId GetProcessId() { return getpid(); }
 
 std::string GetHostname() {
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sys/mman.h>
 #include <sys/sysctl.h>
 
 #include <cstring>
@@ -29,6 +30,30 @@ int GetNumLogicalCpus() {
   return nproc;
 }
 
+int GetNumNumaNodes() { return 1; }
+
+std::vector<int> GetNumaNodeCpus(int node) { return {}; }
+
+void BindThreadToNumaNode(int node) {}
+
+// No transparent huge page support: allocate normal pages and report no huge
+// page backing.
+void* AllocLargePages(size_t size) {
+  MG_CHECK(size > 0);
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  MG_CHECK(p != MAP_FAILED) << "mmap of " << size << " bytes failed";
+  return p;
+}
+
+void FreeLargePages(void* p, size_t size) {
+  if (p != nullptr) {
+    munmap(p, size);
+  }
+}
+
+LargePageStats GetLargePageStats() { return {}; }
+
 bool FdSupportsAnsiColors(int fd) { return isatty(fd); }
 
 ProcessId GetProcessId() { return getpid(); }
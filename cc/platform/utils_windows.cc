@@ -14,6 +14,7 @@
 
 #include <cstring>
 
+#include "cc/logging.h"
 #include "cc/platform/utils.h"
 
 namespace minigo {
@@ -26,6 +27,29 @@ int GetNumLogicalCpus() {
   return sysinfo.dwNumberOfProcessors;
 }
 
+int GetNumNumaNodes() { return 1; }
+
+std::vector<int> GetNumaNodeCpus(int node) { return {}; }
+
+void BindThreadToNumaNode(int node) {}
+
+// No transparent huge page support: allocate normal pages and report no huge
+// page backing.
+void* AllocLargePages(size_t size) {
+  void* p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE,
+                         PAGE_READWRITE);
+  MG_CHECK(p != nullptr) << "VirtualAlloc of " << size << " bytes failed";
+  return p;
+}
+
+void FreeLargePages(void* p, size_t size) {
+  if (p != nullptr) {
+    VirtualFree(p, 0, MEM_RELEASE);
+  }
+}
+
+LargePageStats GetLargePageStats() { return {}; }
+
 ProcessId GetProcessId() { return ::GetCurrentProcessId(); }
 
 std::string GetHostname() {
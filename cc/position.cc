@@ -16,8 +16,10 @@
 
 #include <algorithm>
 #include <array>
+#include <memory>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/str_format.h"
 #include "cc/tiny_set.h"
@@ -33,6 +35,35 @@ constexpr char kPrintNormal[] = "\x1b[0m";
 
 }  // namespace
 
+struct VisitorLease::Entry {
+  BoardVisitor board_visitor;
+  GroupVisitor group_visitor;
+};
+
+std::vector<std::unique_ptr<VisitorLease::Entry>>*
+VisitorLease::ThreadFreeList() {
+  thread_local std::vector<std::unique_ptr<Entry>> free_list;
+  return &free_list;
+}
+
+VisitorLease::VisitorLease() {
+  auto* free_list = ThreadFreeList();
+  if (free_list->empty()) {
+    entry_ = new Entry();
+  } else {
+    entry_ = free_list->back().release();
+    free_list->pop_back();
+  }
+}
+
+VisitorLease::~VisitorLease() {
+  ThreadFreeList()->push_back(std::unique_ptr<Entry>(entry_));
+}
+
+BoardVisitor* VisitorLease::board_visitor() { return &entry_->board_visitor; }
+
+GroupVisitor* VisitorLease::group_visitor() { return &entry_->group_visitor; }
+
 const std::array<inline_vector<Coord, 4>, kN* kN> kNeighborCoords = []() {
   std::array<inline_vector<Coord, 4>, kN * kN> result;
   for (int row = 0; row < kN; ++row) {
@@ -66,6 +97,9 @@ zobrist::Hash Position::CalculateStoneHash(const Position::Stones& stones) {
 Position::Position(Color to_play) : to_play_(to_play) {
   // All moves are initially legal.
   std::fill(legal_moves_.begin(), legal_moves_.end(), true);
+  for (int c = 0; c < kN * kN; ++c) {
+    legal_bitboard_.set(c);
+  }
 }
 
 Position::UndoState Position::PlayMove(Coord c, Color color,
@@ -81,19 +115,27 @@ Position::UndoState Position::PlayMove(Coord c, Color color,
     }
     MG_DCHECK(ClassifyMoveIgnoringSuperko(c) != MoveType::kIllegal) << c;
     undo.captures = AddStoneToBoard(c, color);
+
+    // The stones changed, so any cached pass-alive regions are stale.
+    pass_alive_regions_ = nullptr;
   }
 
   n_ += 1;
   to_play_ = OtherColor(to_play_);
   UpdateLegalMoves(zobrist_history);
 
-  MG_DCHECK(stone_hash_ == CalculateStoneHash(stones_));
+  MG_DCHECK(stone_hash() == CalculateStoneHash(stones_));
 
   return undo;
 }
 
 void Position::UndoMove(const UndoState& undo,
                         ZobristHistory* zobrist_history) {
+  UndoBoardUpdate(undo);
+  UpdateLegalMoves(zobrist_history);
+}
+
+void Position::UndoBoardUpdate(const UndoState& undo) {
   to_play_ = undo.to_play;
   ko_ = undo.ko;
   Coord c = undo.c;
@@ -101,11 +143,13 @@ void Position::UndoMove(const UndoState& undo,
   if (c != Coord::kPass) {
     auto undo_color = stones_[c].color();
     auto undo_group_id = stones_[c].group_id();
-    MG_CHECK(undo_color != Color::kEmpty);
+    MG_HOT_CHECK(undo_color != Color::kEmpty);
 
     // Remove the stone from the board.
     stones_[c] = {};
-    stone_hash_ ^= zobrist::MoveHash(c, undo_color);
+    UpdateStoneHashes(c, undo_color);
+    stone_bitboard(undo_color)->clear(c);
+    pass_alive_regions_ = nullptr;
 
     // Update the liberty counts of neighboring groups and count how many
     // neighboring stones belong to the same group as the stone removed by the
@@ -133,7 +177,7 @@ void Position::UndoMove(const UndoState& undo,
     }
 
     if (num_group_neighbors > 1) {
-      BoardVisitor board_visitor;
+      VisitorLease visitors;
       // The stone removed by this undo had more than one neighbor of the same
       // color: it's possible that the removal of this stone has split a group.
       // Assign a new group for each neighbor of the same color. If multiple
@@ -143,7 +187,7 @@ void Position::UndoMove(const UndoState& undo,
       for (auto nc : kNeighborCoords[c]) {
         if (stones_[nc].color() == undo_color &&
             stones_[nc].group_id() == undo_group_id) {
-          AssignNewGroup(nc, &board_visitor);
+          AssignNewGroup(nc, visitors.board_visitor());
         }
       }
       groups_.free(undo_group_id);
@@ -163,8 +207,6 @@ void Position::UndoMove(const UndoState& undo,
       UncaptureGroup(other_color, c, cc);
     }
   }
-
-  UpdateLegalMoves(zobrist_history);
 }
 
 std::string Position::ToSimpleString() const {
@@ -292,7 +334,8 @@ inline_vector<Coord, 4> Position::AddStoneToBoard(Coord c, Color color) {
       }
     }
   }
-  stone_hash_ ^= zobrist::MoveHash(c, color);
+  UpdateStoneHashes(c, color);
+  stone_bitboard(color)->set(c);
 
   // Remove captured groups.
   inline_vector<Coord, 4> captured_coords;
@@ -331,7 +374,8 @@ void Position::RemoveGroup(Coord c) {
   while (!stack.empty()) {
     c = stack.pop();
 
-    stone_hash_ ^= zobrist::MoveHash(c, removed_color);
+    UpdateStoneHashes(c, removed_color);
+    stone_bitboard(removed_color)->clear(c);
     tiny_set<GroupId, 4> other_groups;
     for (auto nc : kNeighborCoords[c]) {
       auto ns = stones_[nc];
@@ -359,15 +403,16 @@ void Position::MergeGroup(Coord c) {
   group.num_liberties = 0;
   group.size = 0;
 
-  BoardVisitor board_visitor;
-  board_visitor.Begin();
-  board_visitor.Visit(c);
-  while (!board_visitor.Done()) {
-    c = board_visitor.Next();
+  VisitorLease visitors;
+  auto* board_visitor = visitors.board_visitor();
+  board_visitor->Begin();
+  board_visitor->Visit(c);
+  while (!board_visitor->Done()) {
+    c = board_visitor->Next();
     if (stones_[c].color() == Color::kEmpty) {
       ++group.num_liberties;
     } else {
-      MG_CHECK(stones_[c].color() == color);
+      MG_HOT_CHECK(stones_[c].color() == color);
       ++group.size;
       stones_[c] = s;
       for (auto nc : kNeighborCoords[c]) {
@@ -376,7 +421,7 @@ void Position::MergeGroup(Coord c) {
           // Visiting empty coords through the BoardVisitor API ensures that
           // each one is only counted as a liberty once, even if it is
           // neighbored by multiple stones in this group.
-          board_visitor.Visit(nc);
+          board_visitor->Visit(nc);
         }
       }
     }
@@ -396,7 +441,8 @@ GroupId Position::UncaptureGroup(Color color, Coord capture_c, Coord group_c) {
   stones_[group_c] = {color, group_id};
   while (!stack.empty()) {
     auto c = stack.pop();
-    stone_hash_ ^= zobrist::MoveHash(c, color);
+    UpdateStoneHashes(c, color);
+    stone_bitboard(color)->set(c);
 
     tiny_set<GroupId, 4> neighbor_groups;
     for (auto nc : kNeighborCoords[c]) {
@@ -421,7 +467,7 @@ GroupId Position::UncaptureGroup(Color color, Coord capture_c, Coord group_c) {
 
 void Position::AssignNewGroup(Coord c, BoardVisitor* board_visitor) {
   auto color = stones_[c].color();
-  MG_CHECK(color != Color::kEmpty);
+  MG_HOT_CHECK(color != Color::kEmpty);
   auto other_color = OtherColor(color);
 
   auto group_id = groups_.alloc(0, 0);
@@ -515,76 +561,49 @@ bool Position::HasNeighboringGroup(Coord c, GroupId group_id) const {
 }
 
 float Position::CalculateScore(float komi) const {
-  static_assert(static_cast<int>(Color::kEmpty) == 0, "Color::kEmpty != 0");
-  static_assert(static_cast<int>(Color::kBlack) == 1, "Color::kBlack != 1");
-  static_assert(static_cast<int>(Color::kWhite) == 2, "Color::kWhite != 2");
-
-  auto territories = CalculatePassAliveRegions();
+  // Tromp-Taylor scoring over the bitboard planes. Points inside a
+  // pass-alive region belong to the region's owner regardless of what's on
+  // them; everywhere else a stone counts for its own color.
+  const auto& territories = CalculatePassAliveRegions();
+  Bitboard black = stone_snapshot_.black;
+  Bitboard white = stone_snapshot_.white;
   for (int i = 0; i < kN * kN; ++i) {
-    if (territories[i] == Color::kEmpty) {
-      territories[i] = stones_[i].color();
+    if (territories[i] == Color::kBlack) {
+      black.set(i);
+      white.clear(i);
+    } else if (territories[i] == Color::kWhite) {
+      white.set(i);
+      black.clear(i);
     }
   }
 
-  int score = 0;
-  BoardVisitor board_visitor;
-  auto score_empty_area = [&board_visitor, &territories](Coord c) {
-    int num_visited = 0;
-    int found_bits = 0;
-    do {
-      c = board_visitor.Next();
-      ++num_visited;
-      for (auto nc : kNeighborCoords[c]) {
-        auto color = territories[nc];
-        if (color == Color::kEmpty) {
-          board_visitor.Visit(nc);
-        } else {
-          found_bits |= static_cast<int>(color);
-        }
-      }
-    } while (!board_visitor.Done());
-
-    if (found_bits == 1) {
-      return num_visited;
-    } else if (found_bits == 2) {
-      return -num_visited;
-    } else {
-      return 0;
-    }
-  };
-
-  board_visitor.Begin();
-  for (int row = 0; row < kN; ++row) {
-    for (int col = 0; col < kN; ++col) {
-      Coord c(row, col);
-      auto color = territories[c];
-      if (color == Color::kEmpty) {
-        if (board_visitor.Visit(c)) {
-          score += score_empty_area(c);
-        }
-      } else if (color == Color::kBlack) {
-        score += 1;
-      } else {
-        score -= 1;
-      }
-    }
-  }
+  // Label the remaining empty regions with parallel bit propagation instead
+  // of a scalar flood-fill: an empty region scores for a color if it's
+  // reachable from that color's points and not from the opponent's.
+  Bitboard empty = ~(black | white);
+  Bitboard black_reach = FloodFill(Neighbors(black) & empty, empty);
+  Bitboard white_reach = FloodFill(Neighbors(white) & empty, empty);
 
+  int score = black.count() - white.count();
+  score += (black_reach & ~white_reach).count();
+  score -= (white_reach & ~black_reach).count();
   return static_cast<float>(score) - komi;
 }
 
-std::array<Color, kN * kN> Position::CalculatePassAliveRegions() const {
-  std::array<Color, kN * kN> result;
-  for (auto& x : result) {
-    x = Color::kEmpty;
+const std::array<Color, kN * kN>& Position::CalculatePassAliveRegions() const {
+  if (pass_alive_regions_ == nullptr) {
+    auto result = std::make_shared<std::array<Color, kN * kN>>();
+    for (auto& x : *result) {
+      x = Color::kEmpty;
+    }
+    VisitorLease visitors;
+    CalculatePassAliveRegionsForColor(Color::kBlack, visitors.board_visitor(),
+                                      visitors.group_visitor(), result.get());
+    CalculatePassAliveRegionsForColor(Color::kWhite, visitors.board_visitor(),
+                                      visitors.group_visitor(), result.get());
+    pass_alive_regions_ = std::move(result);
   }
-  BoardVisitor board_visitor;
-  GroupVisitor group_visitor;
-  CalculatePassAliveRegionsForColor(Color::kBlack, &board_visitor,
-                                    &group_visitor, &result);
-  CalculatePassAliveRegionsForColor(Color::kWhite, &board_visitor,
-                                    &group_visitor, &result);
-  return result;
+  return *pass_alive_regions_;
 }
 
 // A _region_ is a connected set of intersections regardless of color.
@@ -887,7 +906,7 @@ void Position::CalculatePassAliveRegionsForColor(
   board_visitor->Begin();
   for (auto& r : regions) {
     // All regions must have at least one empty point, otherwise they'd be dead.
-    MG_CHECK(r.num_empty_points != 0);
+    MG_HOT_CHECK(r.num_empty_points != 0);
     if (r.num_enclosing_groups == 0) {
       // Skip regions that have no enclosing group (the empty board).
       // Because we consider regions that have one empty point that isn't
@@ -945,7 +964,7 @@ void Position::CalculatePassAliveRegionsForColor(
 }
 
 bool Position::CalculateWholeBoardPassAlive() const {
-  auto territories = CalculatePassAliveRegions();
+  const auto& territories = CalculatePassAliveRegions();
   for (int i = 0; i < kN * kN; ++i) {
     if (territories[i] == Color::kEmpty && stones_[i].empty()) {
       return false;
@@ -954,52 +973,89 @@ bool Position::CalculateWholeBoardPassAlive() const {
   return true;
 }
 
-void Position::UpdateLegalMoves(ZobristHistory* zobrist_history) {
-  legal_moves_[Coord::kPass] = true;
-
-  if (zobrist_history == nullptr) {
-    // We're not checking for superko, use the basic result from
-    // ClassifyMoveIgnoringSuperko to determine whether each move is legal.
-    for (int c = 0; c < kN * kN; ++c) {
-      legal_moves_[c] = ClassifyMoveIgnoringSuperko(c) != MoveType::kIllegal;
+Bitboard Position::CalculateAllLegalMoves(
+    Bitboard* capture_moves, std::array<Bitboard, 3>* liberty_planes) const {
+  // Classify each group once: a move on an empty point is legal (ignoring
+  // superko) if it has an empty neighbor, captures an opponent group that's in
+  // atari, or connects to a friendly group with a spare liberty. The liberty
+  // feature planes bucket the same per-group liberty counts, so fill them in
+  // the same sweep when asked.
+  if (liberty_planes != nullptr) {
+    for (auto& plane : *liberty_planes) {
+      plane.clear_all();
     }
-  } else {
-    // We're using superko, things are a bit trickier.
-    for (int c = 0; c < kN * kN; ++c) {
-      switch (ClassifyMoveIgnoringSuperko(c)) {
-        case Position::MoveType::kIllegal: {
-          // The move is trivially not legal.
-          legal_moves_[c] = false;
-          break;
-        }
+  }
+  Bitboard in_atari;
+  Bitboard has_liberties;
+  auto other_color = OtherColor(to_play_);
+  (stone_snapshot_.black | stone_snapshot_.white).ForEach([&](int c) {
+    Stone s = stones_[c];
+    auto num_liberties = groups_[s.group_id()].num_liberties;
+    if (liberty_planes != nullptr) {
+      (*liberty_planes)[num_liberties >= 3 ? 2 : num_liberties - 1].set(c);
+    }
+    if (s.color() == other_color) {
+      if (num_liberties == 1) {
+        in_atari.set(c);
+      }
+    } else {
+      if (num_liberties > 1) {
+        has_liberties.set(c);
+      }
+    }
+  });
+
+  Bitboard empty = ~(stone_snapshot_.black | stone_snapshot_.white);
+  *capture_moves = empty & Neighbors(in_atari);
+  Bitboard legal = empty & (Neighbors(empty) | Neighbors(has_liberties));
+  legal |= *capture_moves;
+  if (ko_ != Coord::kInvalid) {
+    legal.clear(ko_);
+    capture_moves->clear(ko_);
+  }
+  return legal;
+}
 
-        case Position::MoveType::kNoCapture: {
-          // The move will not capture any stones: we can calculate the new
-          // position's stone hash directly.
-          auto new_hash = stone_hash_ ^ zobrist::MoveHash(c, to_play_);
-          legal_moves_[c] =
-              !zobrist_history->HasPositionBeenPlayedBefore(new_hash);
-          break;
-        }
+void Position::UpdateLegalMoves(ZobristHistory* zobrist_history) {
+  legal_moves_[Coord::kPass] = true;
 
-        case Position::MoveType::kCapture: {
-          // The move will capture some opponent stones: in order to calculate
-          // the stone hash, we actually have to play the move.
-
-          Position new_position(*this);
-          // It's safe to call AddStoneToBoard instead of PlayMove because:
-          //  - we know the move is not kPass.
-          //  - the move is legal (modulo superko).
-          //  - we only care about new_position's stone_hash and not the rest of
-          //    the bookkeeping that PlayMove updates.
-          new_position.AddStoneToBoard(c, to_play_);
-          auto new_hash = new_position.stone_hash();
-          legal_moves_[c] =
-              !zobrist_history->HasPositionBeenPlayedBefore(new_hash);
-          break;
-        }
+  Bitboard capture_moves;
+  legal_bitboard_ = CalculateAllLegalMoves(&capture_moves, &liberty_planes_);
+
+  if (zobrist_history != nullptr) {
+    // We're using superko: also reject each otherwise legal move whose
+    // resulting position has been played before.
+    legal_bitboard_.ForEach([&](int c) {
+      zobrist::Hash new_hash;
+      if (!capture_moves.test(c)) {
+        // The move will not capture any stones: we can calculate the new
+        // position's stone hash directly.
+        new_hash = stone_hash() ^ zobrist::MoveHash(c, to_play_);
+      } else {
+        // The move will capture some opponent stones: in order to calculate
+        // the stone hash, we actually have to play the move. Play it
+        // directly on this position and then undo the board update, which
+        // is much cheaper than copying the whole position.
+        // It's safe to call AddStoneToBoard instead of PlayMove because:
+        //  - we know the move is not kPass.
+        //  - the move is legal (modulo superko).
+        //  - we only care about the new stone_hash and not the rest of the
+        //    bookkeeping that PlayMove updates.
+        UndoState undo(c, to_play_, ko_);
+        auto saved_num_captures = num_captures_;
+        undo.captures = AddStoneToBoard(c, to_play_);
+        new_hash = stone_hash();
+        UndoBoardUpdate(undo);
+        num_captures_ = saved_num_captures;
       }
-    }
+      if (zobrist_history->HasPositionBeenPlayedBefore(new_hash)) {
+        legal_bitboard_.clear(c);
+      }
+    });
+  }
+
+  for (int c = 0; c < kN * kN; ++c) {
+    legal_moves_[c] = legal_bitboard_.test(c);
   }
 }
 
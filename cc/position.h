@@ -19,7 +19,9 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "cc/bitboard.h"
 #include "cc/color.h"
 #include "cc/constants.h"
 #include "cc/coord.h"
@@ -28,6 +30,7 @@
 #include "cc/logging.h"
 #include "cc/padded_array.h"
 #include "cc/stone.h"
+#include "cc/symmetries.h"
 #include "cc/zobrist.h"
 
 namespace minigo {
@@ -35,6 +38,23 @@ namespace minigo {
 // Array of neighbor points for each point on the board.
 extern const std::array<inline_vector<Coord, 4>, kN * kN> kNeighborCoords;
 
+// A packed snapshot of the stones on the board: one bitboard per color, two
+// bits per point in total. This is everything the stone history input
+// features need from earlier positions, so model inputs reference snapshots
+// instead of requiring the full Position objects of the game history to stay
+// alive (see ModelInput::stone_history).
+struct StoneSnapshot {
+  Color color_at(Coord c) const {
+    if (black.test(c)) {
+      return Color::kBlack;
+    }
+    return white.test(c) ? Color::kWhite : Color::kEmpty;
+  }
+
+  Bitboard black;
+  Bitboard white;
+};
+
 // A fixed-capacity stack of Coords used when traversing connected points on
 // the board.
 class CoordStack : private inline_vector<Coord, kN * kN> {
@@ -137,6 +157,31 @@ class GroupVisitor {
   uint8_t epoch_ = 0xff;
 };
 
+// Scoped lease of a BoardVisitor & GroupVisitor pair from a thread-local
+// pool. The visitors are expensive to construct relative to the work most
+// call sites do with them (their visited arrays must be zeroed on the first
+// Begin), so leases recycle per-thread instances instead of constructing
+// new visitors on hot paths. Leases nest: code holding one lease can call
+// into code that takes another, and the pool only grows as deep as the
+// deepest nesting seen on the thread.
+class VisitorLease {
+ public:
+  VisitorLease();
+  ~VisitorLease();
+
+  VisitorLease(const VisitorLease&) = delete;
+  VisitorLease& operator=(const VisitorLease&) = delete;
+
+  BoardVisitor* board_visitor();
+  GroupVisitor* group_visitor();
+
+ private:
+  struct Entry;
+  static std::vector<std::unique_ptr<Entry>>* ThreadFreeList();
+
+  Entry* entry_;
+};
+
 // Position represents a single board position.
 // It tracks the stones on the board and their groups, and contains the logic
 // for removing groups with no remaining liberties and merging neighboring
@@ -148,10 +193,11 @@ class GroupVisitor {
 // possible, which means we have to preallocate some pools of memory. In
 // particular, the BoardVisitor and GroupVisitor classes that Position uses to
 // update its internal state are relatively large compared to the board size
-// (even though we're only talking a couple of kB in total. Consequently, the
-// caller of the Position code must pass pointers to previously allocated
-// instances of BoardVisitor and GroupVisitor. These can then be reused by all
-// instances of the Position class.
+// (even though we're only talking a couple of kB in total). Consequently,
+// Position leases previously constructed instances of BoardVisitor and
+// GroupVisitor from a thread-local pool (see VisitorLease above) rather than
+// constructing them on hot paths; they are shared by all instances of the
+// Position class on the thread.
 class Position {
  public:
   using Stones = std::array<Stone, kN * kN>;
@@ -220,7 +266,10 @@ class Position {
   // The returned array will be set to:
   //   . X . X X . .
   //   . . . . . . .
-  std::array<Color, kN * kN> CalculatePassAliveRegions() const;
+  // The result is computed lazily and cached: repeated calls without an
+  // intervening board mutation (and calls on copies of this position) return
+  // the cached regions without re-running Benson's algorithm.
+  const std::array<Color, kN * kN>& CalculatePassAliveRegions() const;
 
   // Returns true if the whole board is pass-alive.
   bool CalculateWholeBoardPassAlive() const;
@@ -245,6 +294,19 @@ class Position {
   };
   MoveType ClassifyMoveIgnoringSuperko(Coord c) const;
 
+  // Computes the legality (ignoring superko) of every point on the board in
+  // one sweep, returning the result as a bitboard. Sets `capture_moves` to the
+  // subset of legal moves that would capture an opponent group.
+  // Unlike calling ClassifyMoveIgnoringSuperko for each point, each group's
+  // liberty count is only looked up once.
+  // If `liberty_planes` is non-null, the same sweep also fills it with the
+  // liberty-bucket planes described at liberty_planes() below.
+  // Most callers should use legal_moves() or legal_bitboard(), which are kept
+  // up to date incrementally from this by PlayMove and UndoMove.
+  Bitboard CalculateAllLegalMoves(
+      Bitboard* capture_moves,
+      std::array<Bitboard, 3>* liberty_planes = nullptr) const;
+
   std::string ToSimpleString() const;
   std::string ToPrettyString(bool use_ansi_colors = true) const;
 
@@ -252,7 +314,22 @@ class Position {
   const Stones& stones() const { return stones_; }
   int n() const { return n_; }
   Coord ko() const { return ko_; }
-  zobrist::Hash stone_hash() const { return stone_hash_; }
+  zobrist::Hash stone_hash() const {
+    return symmetric_stone_hashes_[symmetry::kIdentity];
+  }
+
+  // Zobrist hashes of the stones under each of the eight symmetries,
+  // maintained incrementally by PlayMove and UndoMove: placing or removing a
+  // stone updates one hash table lookup per symmetry. Element `sym` is the
+  // hash of the board transformed by the inverse of `sym`, i.e. the hash the
+  // inference cache computes for a position keyed with canonical symmetry
+  // `sym`. Determining the canonical symmetry of a position is a min over
+  // these eight values (see CalculateCanonicalSymmetry in mcts_tree.cc)
+  // instead of eight full-board transforms and rehashes.
+  const std::array<zobrist::Hash, symmetry::kNumSymmetries>&
+  symmetric_stone_hashes() const {
+    return symmetric_stone_hashes_;
+  }
   uint8_t legal_move(Coord c) const {
     MG_DCHECK(c < kNumMoves);
     return legal_moves_[c];
@@ -261,6 +338,34 @@ class Position {
     return legal_moves_;
   }
 
+  // Bitboard planes of the stones & legal moves, maintained incrementally by
+  // PlayMove and UndoMove. The legal plane only covers points on the board:
+  // use legal_move(Coord::kPass) to query the pass move.
+  const Bitboard& black_bitboard() const { return stone_snapshot_.black; }
+  const Bitboard& white_bitboard() const { return stone_snapshot_.white; }
+  const Bitboard& legal_bitboard() const { return legal_bitboard_; }
+
+  // The stone bitboards viewed as a packed snapshot, for building model
+  // inputs' stone history.
+  const StoneSnapshot& stone_snapshot() const { return stone_snapshot_; }
+
+  // Bitboard planes of the stones whose chain has exactly 1, exactly 2 and
+  // 3 or more liberties, maintained by PlayMove and UndoMove in the same
+  // sweep as the legal moves. Feature extraction reads these directly
+  // instead of looking up every point's group per model input.
+  const std::array<Bitboard, 3>& liberty_planes() const {
+    return liberty_planes_;
+  }
+
+  // Returns a plane with (at most) the single ko point set.
+  Bitboard ko_bitboard() const {
+    Bitboard b;
+    if (ko_ != Coord::kInvalid) {
+      b.set(ko_);
+    }
+    return b;
+  }
+
   // Returns the number of liberties the chain at c has.
   int num_chain_liberties(Coord c) const {
     MG_DCHECK(c <= kN * kN);
@@ -321,6 +426,14 @@ class Position {
   // has two or more distinct neighboring groups of the same color.
   void MergeGroup(Coord c);
 
+  // Restores the board state (stones, groups, hashes, ko) to what it was
+  // before the move recorded in `undo` was played, without recomputing the
+  // legal moves. This is the body of UndoMove; UpdateLegalMoves also uses it
+  // to play & undo candidate capturing moves in place when checking superko,
+  // instead of copying the whole position.
+  // Does not restore num_captures_.
+  void UndoBoardUpdate(const UndoState& undo);
+
   // Called as part of UndoMove for the given color at point capture_c.
   // Replaces the previously captured stones at point group_c.
   GroupId UncaptureGroup(Color color, Coord capture_c, Coord group_c);
@@ -329,9 +442,26 @@ class Position {
   // Create a new group for the chain of stones at c.
   void AssignNewGroup(Coord c, BoardVisitor* board_visitor);
 
+  // XORs the hash of a stone of `color` placed at (or removed from) `c` into
+  // the stone hash of each of the eight symmetries.
+  void UpdateStoneHashes(Coord c, Color color) {
+    for (int sym = 0; sym < symmetry::kNumSymmetries; ++sym) {
+      symmetric_stone_hashes_[sym] ^=
+          zobrist::MoveHash(symmetry::kCoords[sym][c], color);
+    }
+  }
+
   // Returns true if the point at coordinate c neighbors the given group.
   bool HasNeighboringGroup(Coord c, GroupId group_id) const;
 
+  // Returns the stone bitboard plane for the given color, which must be
+  // kBlack or kWhite.
+  Bitboard* stone_bitboard(Color color) {
+    MG_DCHECK(color != Color::kEmpty);
+    return color == Color::kBlack ? &stone_snapshot_.black
+                                  : &stone_snapshot_.white;
+  }
+
   Stones stones_;
   GroupPool groups_;
 
@@ -345,14 +475,28 @@ class Position {
 
   int n_ = 0;
 
-  // MctsNode::CalculateChildActionScoreSse requires that `legal_moves_` is
-  // padded to a multiple of 16 bytes.
+  // MctsNode::CalculateChildActionScoreSimd requires that `legal_moves_` is
+  // padded to a multiple of the widest supported vector size (64 bytes for
+  // AVX-512).
   PaddedArray<uint8_t, kNumMoves> legal_moves_;
 
-  // Zobrist hash of the stones. It can be used for positional superko.
-  // This does not include number of consecutive passes or ko, so should not
-  // be used for caching inferences.
-  zobrist::Hash stone_hash_ = 0;
+  // Bitboard planes kept in sync with `stones_` and `legal_moves_`.
+  StoneSnapshot stone_snapshot_;
+  Bitboard legal_bitboard_;
+  std::array<Bitboard, 3> liberty_planes_;
+
+  // Zobrist hashes of the stones, one per symmetry; element kIdentity is the
+  // stone_hash() used for positional superko. These do not include number of
+  // consecutive passes or ko, so should not be used for caching inferences.
+  std::array<zobrist::Hash, symmetry::kNumSymmetries> symmetric_stone_hashes_{};
+
+  // Lazily computed cache of CalculatePassAliveRegions. The regions depend
+  // only on the stones, so copies of a position share the cache and only
+  // moves that mutate the board (i.e. not passes) invalidate it. Copying an
+  // empty cache is free, so positions copied during tree expansion (which
+  // never query pass-alive state) don't pay for it.
+  mutable std::shared_ptr<const std::array<Color, kN * kN>>
+      pass_alive_regions_;
 };
 
 }  // namespace minigo
@@ -0,0 +1,148 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks for the Position hot paths: PlayMove (including the
+// group-merge path in AddStoneToBoard) and CalculatePassAliveRegions.
+// Like features_benchmark, the inputs are positions from played-out random
+// games rather than empty boards, so captures, merges and realistic group
+// structures all show up in the measured work.
+// Each benchmark prints a checksum of its results: a build with hot-path
+// checks compiled out (--define=hot_checks=0) must print the same checksums
+// as the default build.
+
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "cc/constants.h"
+#include "cc/coord.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/position.h"
+#include "cc/random.h"
+#include "cc/zobrist.h"
+
+namespace minigo {
+namespace {
+
+// Plays out a random game, returning the sequence of moves played.
+std::vector<Coord> RecordRandomGame(int num_moves) {
+  Random rnd(23423, 23454);
+  std::vector<Coord> moves;
+  Position position(Color::kBlack);
+  while (static_cast<int>(moves.size()) < num_moves) {
+    Coord c(rnd.UniformUint64() % kNumPoints);
+    if (position.legal_move(c)) {
+      position.PlayMove(c);
+      moves.push_back(c);
+    }
+  }
+  return moves;
+}
+
+// Returns a move sequence that stresses the group-merge path in
+// AddStoneToBoard: black first plays a sparse grid of isolated stones, then
+// fills the points between them so that almost every later move merges two
+// or more existing groups.
+std::vector<Coord> RecordMergeHeavyGame() {
+  std::vector<Coord> moves;
+  // Isolated stones on every other column of every other row.
+  for (int row = 0; row < kN; row += 2) {
+    for (int col = 0; col < kN; col += 2) {
+      moves.emplace_back(row, col);
+    }
+  }
+  // Fill the gaps between them, row by row. The even rows merge the isolated
+  // stones into lines; the odd rows merge the lines into one group. Leave
+  // the last column empty so the growing group always has liberties.
+  for (int row = 0; row < kN; ++row) {
+    for (int col = (row % 2 == 0) ? 1 : 0; col < kN - 1; col += 2) {
+      moves.emplace_back(row, col);
+    }
+  }
+  return moves;
+}
+
+// Replays `moves` onto a fresh board `num_games` times, playing every stone
+// as black if `all_black` is set (so merge-heavy sequences aren't broken up
+// by alternating colors).
+void BenchmarkPlayMove(const char* name, const std::vector<Coord>& moves,
+                       int num_games, bool all_black) {
+  auto color = all_black ? Color::kBlack : Color::kEmpty;
+  // The final stone hash doubles as a checksum for verifying that builds
+  // with and without hot-path checks play out the games identically.
+  zobrist::Hash checksum = 0;
+  auto start = absl::Now();
+  for (int i = 0; i < num_games; ++i) {
+    Position position(Color::kBlack);
+    for (auto c : moves) {
+      position.PlayMove(c, color);
+    }
+    checksum = position.stone_hash();
+  }
+  auto duration = absl::Now() - start;
+
+  auto num_moves = static_cast<int64_t>(num_games) * moves.size();
+  MG_LOG(INFO) << kN << "x" << kN << ":" << name << " " << duration << " ("
+               << absl::ToInt64Nanoseconds(duration) / num_moves
+               << "ns/move, checksum " << checksum << ")";
+}
+
+void BenchmarkCalculatePassAliveRegions(const std::vector<Coord>& moves) {
+  constexpr int kNumIterations = 2000;
+
+  // Snapshot the position every few moves. The snapshots are never queried
+  // directly so their pass-alive caches stay empty, and copies made from
+  // them start with an empty cache too.
+  std::vector<Position> positions;
+  Position position(Color::kBlack);
+  for (size_t i = 0; i < moves.size(); ++i) {
+    position.PlayMove(moves[i]);
+    if (i % 8 == 0) {
+      positions.push_back(position);
+    }
+  }
+
+  size_t checksum = 0;
+  auto start = absl::Now();
+  for (int i = 0; i < kNumIterations; ++i) {
+    Position copy = positions[i % positions.size()];
+    const auto& regions = copy.CalculatePassAliveRegions();
+    for (auto region_color : regions) {
+      checksum += region_color != Color::kEmpty ? 1 : 0;
+    }
+  }
+  auto duration = absl::Now() - start;
+
+  MG_LOG(INFO) << kN << "x" << kN << ":CalculatePassAliveRegions " << duration
+               << " (" << absl::ToInt64Nanoseconds(duration) / kNumIterations
+               << "ns/call, checksum " << checksum << ")";
+}
+
+void RunBenchmark() {
+  auto game_moves = RecordRandomGame(kNumPoints);
+  auto merge_moves = RecordMergeHeavyGame();
+
+  BenchmarkPlayMove("PlayMove", game_moves, 2000, false);
+  BenchmarkPlayMove("PlayMoveMergeHeavy", merge_moves, 2000, true);
+  BenchmarkCalculatePassAliveRegions(game_moves);
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::RunBenchmark();
+  return 0;
+}
@@ -14,6 +14,7 @@
 
 #include "cc/position.h"
 
+#include <algorithm>
 #include <set>
 #include <string>
 #include <utility>
@@ -515,6 +516,23 @@ void ValidatePosition(TestablePosition* p) {
         << c << " : expected_num_liberties:" << expected_group.num_liberties
         << " actual_num_liberties:" << actual_group.num_liberties;
   }
+
+  // Check that the incrementally maintained bitboard planes match the stones
+  // and legal moves.
+  for (int i = 0; i < kN * kN; ++i) {
+    auto c = static_cast<Coord>(i);
+    auto color = p->stones()[c].color();
+    MG_CHECK(p->black_bitboard().test(c) == (color == Color::kBlack)) << c;
+    MG_CHECK(p->white_bitboard().test(c) == (color == Color::kWhite)) << c;
+    MG_CHECK(p->legal_bitboard().test(c) == (p->legal_move(c) != 0)) << c;
+    MG_CHECK(p->ko_bitboard().test(c) == (p->ko() == c)) << c;
+
+    auto num_liberties = p->num_chain_liberties(c);
+    const auto& liberty_planes = p->liberty_planes();
+    MG_CHECK(liberty_planes[0].test(c) == (num_liberties == 1)) << c;
+    MG_CHECK(liberty_planes[1].test(c) == (num_liberties == 2)) << c;
+    MG_CHECK(liberty_planes[2].test(c) == (num_liberties >= 3)) << c;
+  }
 }
 
 TEST(PositionTest, UndoMove) {
@@ -657,5 +675,42 @@ TEST(PositionTest, PlayRandomLegalMoves) {
   }
 }
 
+// Plays random legal moves with positional superko enforced, validating the
+// board state after every move. This exercises the play & undo path that
+// UpdateLegalMoves uses to check capturing moves for superko.
+TEST(PositionTest, PlayRandomLegalMovesWithSuperko) {
+  class VectorHistory : public Position::ZobristHistory {
+   public:
+    bool HasPositionBeenPlayedBefore(zobrist::Hash hash) const override {
+      return std::find(hashes_.begin(), hashes_.end(), hash) != hashes_.end();
+    }
+    void Add(zobrist::Hash hash) { hashes_.push_back(hash); }
+
+   private:
+    std::vector<zobrist::Hash> hashes_;
+  };
+
+  Random rnd(27706144, 1);
+  TestablePosition position("");
+  VectorHistory history;
+  history.Add(position.stone_hash());
+
+  for (int i = 0; i < 1000; ++i) {
+    std::vector<Coord> legal_moves;
+    for (int c = 0; c < kN * kN; ++c) {
+      if (position.legal_move(c)) {
+        legal_moves.push_back(c);
+      }
+    }
+    if (legal_moves.empty()) {
+      break;
+    }
+    auto c = legal_moves[rnd.UniformInt(0, legal_moves.size() - 1)];
+    position.PlayMove(c, position.to_play(), &history);
+    history.Add(position.stone_hash());
+    ValidatePosition(&position);
+  }
+}
+
 }  // namespace
 }  // namespace minigo
@@ -15,12 +15,91 @@
 #include "cc/random.h"
 
 #include <atomic>
+#include <cmath>
 
 namespace minigo {
 
 namespace {
 std::atomic<int> unique_stream_id{0};
 
+// The bulk span methods draw a fresh 64 bit key from the serial PCG generator
+// and then produce samples by hashing (key, counter) with the SplitMix64
+// finalizer. Unlike iterating the PCG state, there's no serial dependency
+// between samples, so the loops pipeline and vectorize.
+constexpr uint64_t kCounterIncrement = 0x9e3779b97f4a7c15ULL;
+
+inline uint64_t CounterHash(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Scales a 24 bit integer to [0, 1).
+constexpr float kScale24 = 1.0f / 16777216.0f;
+
+// Fills `samples` with uniform random numbers in [0, 1), two samples per
+// 64 bit hash.
+void FillUniform(uint64_t key, absl::Span<float> samples) {
+  size_t i = 0;
+  for (; i + 2 <= samples.size(); i += 2) {
+    uint64_t x = CounterHash(key + (i / 2) * kCounterIncrement);
+    samples[i] = (x >> 40) * kScale24;
+    samples[i + 1] = ((x >> 8) & 0xffffff) * kScale24;
+  }
+  if (i < samples.size()) {
+    samples[i] = (CounterHash(key + (i / 2) * kCounterIncrement) >> 40) *
+                 kScale24;
+  }
+}
+
+// An unbounded counter-based stream of uniform and normal variates, for the
+// rejection sampling methods that consume a data-dependent number of draws.
+class CounterStream {
+ public:
+  explicit CounterStream(uint64_t key) : key_(key) {}
+
+  // Returns a uniform random number in [0, 1).
+  float Uniform() {
+    if (has_cached_uniform_) {
+      has_cached_uniform_ = false;
+      return cached_uniform_;
+    }
+    uint64_t x = CounterHash(key_ + ctr_++ * kCounterIncrement);
+    cached_uniform_ = ((x >> 8) & 0xffffff) * kScale24;
+    has_cached_uniform_ = true;
+    return (x >> 40) * kScale24;
+  }
+
+  // Returns a standard normal random number, by Marsaglia's polar method.
+  float Normal() {
+    if (has_cached_normal_) {
+      has_cached_normal_ = false;
+      return cached_normal_;
+    }
+    float u, v, s;
+    do {
+      u = 2.0f * Uniform() - 1.0f;
+      v = 2.0f * Uniform() - 1.0f;
+      s = u * u + v * v;
+    } while (s >= 1.0f || s == 0.0f);
+    float f = std::sqrt(-2.0f * std::log(s) / s);
+    cached_normal_ = f * v;
+    has_cached_normal_ = true;
+    return f * u;
+  }
+
+ private:
+  const uint64_t key_;
+  uint64_t ctr_ = 0;
+  float cached_uniform_ = 0;
+  float cached_normal_ = 0;
+  bool has_cached_uniform_ = false;
+  bool has_cached_normal_ = false;
+};
+
 uint64_t ChooseSeed(uint64_t seed) {
   if (seed == 0) {
     std::random_device rd;
@@ -47,12 +126,52 @@ constexpr int Random::kUniqueStream;
 Random::Random(uint64_t seed, int stream)
     : seed_(ChooseSeed(seed)), impl_(seed_, ChooseStream(stream)) {}
 
+void Random::Reseed(uint64_t seed, int stream) {
+  seed_ = ChooseSeed(seed);
+  impl_ = Impl(seed_, ChooseStream(stream));
+}
+
 void Random::Dirichlet(float alpha, absl::Span<float> samples) {
-  std::gamma_distribution<float> distribution(alpha);
+  // Gamma variates via Marsaglia & Tsang's squeeze method, consuming batches
+  // of counter-based normals and uniforms. For alpha < 1 (always the case for
+  // Dirichlet exploration noise), draw Gamma(alpha + 1) and multiply by
+  // U^(1/alpha).
+  const bool boost = alpha < 1;
+  const float shape = boost ? alpha + 1 : alpha;
+  const float d = shape - 1.0f / 3.0f;
+  const float c = 1.0f / std::sqrt(9.0f * d);
+  const float inv_alpha = 1.0f / alpha;
+
+  CounterStream stream(UniformUint64());
 
   float sum = 0;
   for (float& sample : samples) {
-    sample = distribution(impl_);
+    float g;
+    for (;;) {
+      float x = stream.Normal();
+      float v = 1.0f + c * x;
+      if (v <= 0) {
+        continue;
+      }
+      v = v * v * v;
+      float u = stream.Uniform();
+      if (u < 1.0f - 0.0331f * x * x * x * x) {
+        g = d * v;
+        break;
+      }
+      if (u > 0 &&
+          std::log(u) < 0.5f * x * x + d * (1.0f - v + std::log(v))) {
+        g = d * v;
+        break;
+      }
+    }
+    if (boost) {
+      float u = stream.Uniform();
+      // u^(1/alpha) underflows to zero for small alpha and u; that's fine,
+      // the sample just doesn't receive any noise mass.
+      g *= u > 0 ? std::pow(u, inv_alpha) : 0.0f;
+    }
+    sample = g;
     sum += sample;
   }
   float norm = 1 / sum;
@@ -67,9 +186,12 @@ float Random::Uniform(float a, float b) {
 }
 
 void Random::Uniform(float a, float b, absl::Span<float> samples) {
-  std::uniform_real_distribution<float> distribution(a, b);
-  for (float& sample : samples) {
-    sample = distribution(impl_);
+  FillUniform(UniformUint64(), samples);
+  if (a != 0 || b != 1) {
+    float scale = b - a;
+    for (float& sample : samples) {
+      sample = a + scale * sample;
+    }
   }
 }
 
@@ -79,9 +201,9 @@ float Random::NormalDistribution(float mean, float stddev) {
 
 void Random::NormalDistribution(float mean, float stddev,
                                 absl::Span<float> samples) {
-  std::normal_distribution<float> distribution(mean, stddev);
+  CounterStream stream(UniformUint64());
   for (float& sample : samples) {
-    sample = distribution(impl_);
+    sample = mean + stddev * stream.Normal();
   }
 }
 
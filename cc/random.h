@@ -41,6 +41,12 @@ class Random {
   // Random::kUniqueStream for the stream.
   explicit Random(uint64_t seed, int stream);
 
+  // Re-keys the generator to the given (seed, stream) pair, exactly as if it
+  // had been freshly constructed with them. Used by deterministic replay
+  // modes that key a long-lived generator's stream by (game, move) so the
+  // draws don't depend on how many draws earlier work consumed.
+  void Reseed(uint64_t seed, int stream);
+
   // Draw samples from a Dirichlet distribution.
   void Dirichlet(float alpha, absl::Span<float> samples);
 
@@ -148,7 +154,7 @@ class Random {
     }
 
     uint64_t state;
-    const uint64_t inc;
+    uint64_t inc;
   };
 
   uint64_t seed_;
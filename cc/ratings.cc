@@ -0,0 +1,308 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Incremental ratings calculator over eval game output.
+//
+//   ratings --sgf_dir=eval_sgf/ --state=ratings.json
+//
+// Scans the SGFs written by eval for games it hasn't seen before, folds
+// their results into per-pairing win counts kept in the --state file, and
+// refits Elo ratings from the aggregated counts. Because the state file
+// remembers which games have already been ingested and the fit runs over
+// counts rather than games, a refresh after an eval run takes seconds
+// regardless of how much history has accumulated, unlike the Python
+// scripts in ratings/ that re-read every historical record.
+//
+// Ratings are a Bradley-Terry maximum likelihood fit (the model underlying
+// Elo and BayesElo), regularized by --prior_games virtual drawn games
+// between every model and a fixed reference point so that models with few
+// games don't get runaway ratings.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "cc/file/path.h"
+#include "cc/file/utils.h"
+#include "cc/init.h"
+#include "cc/json.h"
+#include "cc/logging.h"
+#include "cc/sgf.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(sgf_dir, "",
+              "Directory of eval game SGFs, as written by eval --sgf_dir.");
+DEFINE_string(state, "",
+              "Path to the persistent ratings state file. Created on the "
+              "first run; later runs only ingest games added to --sgf_dir "
+              "since the state was last written.");
+DEFINE_string(anchor, "",
+              "Optional name of the model whose rating is pinned to "
+              "--anchor_elo. If empty, ratings are shifted so their mean is "
+              "--anchor_elo.");
+DEFINE_double(anchor_elo, 0, "The rating of the anchor (see --anchor).");
+DEFINE_double(prior_games, 2,
+              "Number of virtual drawn games between every model and a "
+              "fixed reference point, regularizing the ratings of models "
+              "with few real games.");
+
+namespace minigo {
+namespace {
+
+// One directed pairing: how many games `black` has won and lost against
+// `white` when playing black.
+struct PairCount {
+  int black_wins = 0;
+  int white_wins = 0;
+};
+
+// The persistent state: which SGFs have been ingested, and the aggregated
+// per-pairing win counts they produced.
+struct RatingsState {
+  std::map<std::string, bool> processed;
+  std::map<std::pair<std::string, std::string>, PairCount> pairs;
+};
+
+bool LoadState(const std::string& path, RatingsState* state) {
+  if (!file::FileExists(path)) {
+    return false;
+  }
+  std::string contents;
+  MG_CHECK(file::ReadFile(path, &contents));
+  auto j = nlohmann::json::parse(contents, nullptr, false);
+  MG_CHECK(!j.is_discarded()) << "couldn't parse state file " << path;
+  for (const auto& name : j["processed"]) {
+    state->processed[name.get<std::string>()] = true;
+  }
+  for (const auto& p : j["pairs"]) {
+    auto& pair = state->pairs[{p["black"].get<std::string>(),
+                               p["white"].get<std::string>()}];
+    pair.black_wins = p["black_wins"].get<int>();
+    pair.white_wins = p["white_wins"].get<int>();
+  }
+  return true;
+}
+
+void SaveState(const std::string& path, const RatingsState& state) {
+  nlohmann::json j;
+  j["processed"] = nlohmann::json::array();
+  for (const auto& kv : state.processed) {
+    j["processed"].push_back(kv.first);
+  }
+  j["pairs"] = nlohmann::json::array();
+  for (const auto& kv : state.pairs) {
+    j["pairs"].push_back({{"black", kv.first.first},
+                          {"white", kv.first.second},
+                          {"black_wins", kv.second.black_wins},
+                          {"white_wins", kv.second.white_wins}});
+  }
+  MG_CHECK(file::WriteFile(path, j.dump(2)));
+}
+
+// Pulls the player names and result out of an SGF header, stopping as soon
+// as the first move is reached.
+class HeaderVisitor : public sgf::StreamingVisitor {
+ public:
+  bool OnMove(Move) override { return false; }
+
+  bool OnProperty(absl::string_view id, absl::string_view value) override {
+    if (id == "PB" && black_.empty()) {
+      black_ = std::string(value);
+    } else if (id == "PW" && white_.empty()) {
+      white_ = std::string(value);
+    } else if (id == "RE" && result_.empty()) {
+      result_ = std::string(value);
+    }
+    return true;
+  }
+
+  const std::string& black() const { return black_; }
+  const std::string& white() const { return white_; }
+  const std::string& result() const { return result_; }
+
+ private:
+  std::string black_;
+  std::string white_;
+  std::string result_;
+};
+
+// Ingests the given game into the state's pair counts. Returns false if the
+// game doesn't have a usable header (unknown players or an unfinished
+// game's result).
+bool IngestGame(const std::string& path, RatingsState* state) {
+  std::string contents;
+  if (!file::ReadFile(path, &contents)) {
+    return false;
+  }
+
+  HeaderVisitor visitor;
+  std::string error;
+  if (!sgf::ParseStreaming(contents, &visitor, &error)) {
+    MG_LOG(WARNING) << "couldn't parse \"" << path << "\": " << error;
+    return false;
+  }
+  if (visitor.black().empty() || visitor.white().empty()) {
+    return false;
+  }
+
+  auto& pair = state->pairs[{visitor.black(), visitor.white()}];
+  if (absl::StartsWith(visitor.result(), "B+")) {
+    pair.black_wins += 1;
+  } else if (absl::StartsWith(visitor.result(), "W+")) {
+    pair.white_wins += 1;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Fits Bradley-Terry strengths to the aggregated win counts with the
+// standard minorization-maximization iteration and converts them to Elo:
+// rating = 400 * log10(strength). Every model also plays --prior_games
+// virtual drawn games against a fixed reference point of strength 1.
+std::map<std::string, double> FitRatings(const RatingsState& state) {
+  // Total wins and per-opponent game counts for each model, colors folded
+  // together (eval alternates colors between games of a pairing, so color
+  // advantage cancels out of the aggregate).
+  std::map<std::string, double> wins;
+  std::map<std::pair<std::string, std::string>, double> num_games;
+  for (const auto& kv : state.pairs) {
+    const auto& black = kv.first.first;
+    const auto& white = kv.first.second;
+    double n = kv.second.black_wins + kv.second.white_wins;
+    wins[black] += kv.second.black_wins;
+    wins[white] += kv.second.white_wins;
+    num_games[{black, white}] += n;
+    num_games[{white, black}] += n;
+  }
+
+  std::map<std::string, double> strength;
+  for (const auto& kv : wins) {
+    strength[kv.first] = 1;
+  }
+
+  for (int iteration = 0; iteration < 1000; ++iteration) {
+    double max_delta = 0;
+    for (auto& kv : strength) {
+      const auto& name = kv.first;
+      // The virtual draws contribute half a win and a full game against the
+      // reference point's strength of 1.
+      double w = wins[name] + 0.5 * FLAGS_prior_games;
+      double denom = FLAGS_prior_games / (kv.second + 1);
+      for (const auto& opponent : strength) {
+        auto it = num_games.find({name, opponent.first});
+        if (it != num_games.end()) {
+          denom += it->second / (kv.second + opponent.second);
+        }
+      }
+      double updated = w / denom;
+      max_delta = std::max(max_delta, std::abs(updated - kv.second));
+      kv.second = updated;
+    }
+    if (max_delta < 1e-9) {
+      break;
+    }
+  }
+
+  std::map<std::string, double> ratings;
+  for (const auto& kv : strength) {
+    ratings[kv.first] = 400 * std::log10(kv.second);
+  }
+
+  // Anchor the scale: ratings are only identified up to a constant offset.
+  double offset = 0;
+  auto anchor_it = ratings.find(FLAGS_anchor);
+  if (anchor_it != ratings.end()) {
+    offset = FLAGS_anchor_elo - anchor_it->second;
+  } else if (!ratings.empty()) {
+    double mean = 0;
+    for (const auto& kv : ratings) {
+      mean += kv.second;
+    }
+    mean /= ratings.size();
+    offset = FLAGS_anchor_elo - mean;
+  }
+  for (auto& kv : ratings) {
+    kv.second += offset;
+  }
+  return ratings;
+}
+
+void Run() {
+  MG_CHECK(!FLAGS_sgf_dir.empty()) << "--sgf_dir is required";
+  MG_CHECK(!FLAGS_state.empty()) << "--state is required";
+
+  RatingsState state;
+  if (LoadState(FLAGS_state, &state)) {
+    MG_LOG(INFO) << "loaded state for " << state.processed.size()
+                 << " games from " << FLAGS_state;
+  } else {
+    MG_LOG(INFO) << "no state at " << FLAGS_state << ", starting fresh";
+  }
+
+  std::vector<std::string> basenames;
+  MG_CHECK(file::ListDir(FLAGS_sgf_dir, &basenames))
+      << "couldn't list " << FLAGS_sgf_dir;
+  std::sort(basenames.begin(), basenames.end());
+
+  int num_new = 0;
+  for (const auto& basename : basenames) {
+    if (!absl::EndsWith(basename, ".sgf") ||
+        state.processed.find(basename) != state.processed.end()) {
+      continue;
+    }
+    // Games that can't be ingested (unparseable, or abandoned without a
+    // result) are still marked processed so they aren't re-read every run.
+    IngestGame(file::JoinPath(FLAGS_sgf_dir, basename), &state);
+    state.processed[basename] = true;
+    num_new += 1;
+  }
+  MG_LOG(INFO) << "ingested " << num_new << " new games";
+
+  auto ratings = FitRatings(state);
+
+  std::vector<std::pair<std::string, double>> sorted(ratings.begin(),
+                                                     ratings.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<std::string, double>& a,
+               const std::pair<std::string, double>& b) {
+              return a.second > b.second;
+            });
+  for (const auto& kv : sorted) {
+    double num_games = 0;
+    for (const auto& pair : state.pairs) {
+      if (pair.first.first == kv.first || pair.first.second == kv.first) {
+        num_games += pair.second.black_wins + pair.second.white_wins;
+      }
+    }
+    printf("%-40s  %7.1f  %6.0f games\n", kv.first.c_str(), kv.second,
+           num_games);
+  }
+
+  SaveState(FLAGS_state, state);
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  return 0;
+}
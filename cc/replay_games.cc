@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/types/span.h"
 #include "cc/async/thread.h"
 #include "cc/async/thread_safe_queue.h"
 #include "cc/color.h"
@@ -26,12 +27,14 @@
 #include "cc/file/utils.h"
 #include "cc/init.h"
 #include "cc/logging.h"
+#include "cc/platform/utils.h"
 #include "cc/position.h"
 #include "cc/sgf.h"
 #include "gflags/gflags.h"
 
 DEFINE_string(sgf_dir, "", "Directory to load SGF games from.");
-DEFINE_int32(num_threads, 8, "Number of worker threads.");
+DEFINE_int32(num_threads, 0,
+             "Number of worker threads. 0 means use all logical CPUs.");
 
 namespace minigo {
 namespace {
@@ -54,34 +57,65 @@ struct GameInfo {
   int game_length;
 };
 
-GameInfo ProcessSgf(const std::string& path) {
-  std::string contents;
-  MG_CHECK(file::ReadFile(path, &contents));
+// Replays a game's main line directly from the SGF parser's callbacks,
+// without materializing the game tree. Once the game over reason has been
+// determined, the remaining main line moves are only counted so that the
+// reported game length covers the whole game.
+class MainLineReplayer : public sgf::StreamingVisitor {
+ public:
+  bool OnTreeBegin() override {
+    saw_tree_ = true;
+    return true;
+  }
 
-  sgf::Collection collection;
-  std::string error;
-  MG_CHECK(sgf::Parse(contents, &collection, &error)) << error;
-  MG_CHECK(!collection.trees.empty());
-
-  Position position(Color::kBlack);
-
-  Coord prev_move = Coord::kInvalid;
-  const auto& moves = collection.trees[0]->ExtractMainLine();
-  auto num_moves = static_cast<int>(moves.size());
-  for (int i = 0; i < num_moves; ++i) {
-    const auto& move = moves[i];
-    MG_CHECK(position.legal_move(move.c));
-    position.PlayMove(move.c);
-    if (move.c == Coord::kPass && prev_move == Coord::kPass) {
-      return GameInfo(GameOverReason::kPassPass, 0, num_moves);
+  // The first tree to close marks the end of the main line.
+  bool OnTreeEnd() override { return false; }
+
+  bool OnMove(Move move) override {
+    num_moves_ += 1;
+    if (game_over_) {
+      return true;
     }
-    if (position.CalculateWholeBoardPassAlive()) {
-      return GameInfo(GameOverReason::kWholeBoardPassAlive, i, num_moves);
+    MG_CHECK(position_.legal_move(move.c));
+    position_.PlayMove(move.c);
+    if (move.c == Coord::kPass && prev_move_ == Coord::kPass) {
+      game_over_ = true;
+      game_over_reason_ = GameOverReason::kPassPass;
+    } else if (position_.CalculateWholeBoardPassAlive()) {
+      game_over_ = true;
+      game_over_reason_ = GameOverReason::kWholeBoardPassAlive;
+      whole_board_pass_alive_move_ = num_moves_ - 1;
     }
-    prev_move = move.c;
+    prev_move_ = move.c;
+    return true;
+  }
+
+  bool saw_tree() const { return saw_tree_; }
+
+  GameInfo game_info() const {
+    return GameInfo(game_over_reason_, whole_board_pass_alive_move_,
+                    num_moves_);
   }
 
-  return GameInfo(GameOverReason::kMoveLimit, 0, num_moves);
+ private:
+  Position position_{Color::kBlack};
+  Coord prev_move_ = Coord::kInvalid;
+  bool saw_tree_ = false;
+  bool game_over_ = false;
+  GameOverReason game_over_reason_ = GameOverReason::kMoveLimit;
+  int whole_board_pass_alive_move_ = 0;
+  int num_moves_ = 0;
+};
+
+GameInfo ProcessSgf(const std::string& path, std::string* contents) {
+  MG_CHECK(file::ReadFile(path, contents));
+
+  MainLineReplayer replayer;
+  std::string error;
+  MG_CHECK(sgf::ParseStreaming(*contents, &replayer, &error)) << error;
+  MG_CHECK(replayer.saw_tree());
+
+  return replayer.game_info();
 }
 
 void Run() {
@@ -89,19 +123,21 @@ void Run() {
   MG_CHECK(file::ListDir(FLAGS_sgf_dir, &basenames));
 
   ThreadSafeQueue<std::string> work_queue;
-  for (const auto& basename : basenames) {
-    work_queue.Push(basename);
-  }
+  work_queue.PushAll(absl::MakeConstSpan(basenames));
 
   ThreadSafeQueue<GameInfo> game_info_queue;
 
+  int num_threads =
+      FLAGS_num_threads > 0 ? FLAGS_num_threads : GetNumLogicalCpus();
   std::vector<std::unique_ptr<LambdaThread>> threads;
-  for (int i = 0; i < FLAGS_num_threads; ++i) {
+  for (int i = 0; i < num_threads; ++i) {
     threads.push_back(absl::make_unique<LambdaThread>([&]() {
+      // Reuse one contents buffer for all the files this thread processes.
+      std::string contents;
       std::string basename;
       while (work_queue.TryPop(&basename)) {
         auto path = file::JoinPath(FLAGS_sgf_dir, basename);
-        game_info_queue.Push(ProcessSgf(path));
+        game_info_queue.Push(ProcessSgf(path, &contents));
       }
     }));
     threads.back()->Start();
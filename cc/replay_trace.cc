@@ -0,0 +1,169 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Drives a model from an inference trace recorded by ModelBatcher (see
+// cc/model/inference_trace.h) and reports per-batch latency percentiles and
+// throughput. Because the trace preserves the production batch shapes,
+// position histories and symmetry mixes, this gives an apples-to-apples
+// comparison of inference backends without rerunning the workload that
+// produced the trace:
+//
+//   replay_trace --trace=eval.mgtrace --model=foo.minigo --device=trt:0
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "cc/constants.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/model/inference_trace.h"
+#include "cc/model/loader.h"
+#include "cc/model/model.h"
+#include "cc/position.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(trace, "", "Path to an inference trace.");
+DEFINE_string(model, "", "Path to a minigo model.");
+DEFINE_string(device, "",
+              "Optional ID of the device to run inference on. For TPUs, pass "
+              "the gRPC address of the TPU to connect to.");
+DEFINE_bool(pace, false,
+            "If true, submit each batch at its recorded timestamp instead of "
+            "back to back, reproducing the traced submission rate.");
+DEFINE_int32(warmup_batches, 8,
+             "Number of batches to replay before starting measurement, so "
+             "one-time backend initialization doesn't skew the results.");
+
+namespace minigo {
+namespace {
+
+// Rebuilds a Position from a traced board. The stones are replayed through
+// AddStoneToBoard so groups and liberties (which some feature sets read) are
+// reconstructed exactly.
+class TracePosition : public Position {
+ public:
+  TracePosition(Color to_play, const std::array<Color, kN * kN>& stones)
+      : Position(to_play) {
+    for (int i = 0; i < kN * kN; ++i) {
+      if (stones[i] != Color::kEmpty) {
+        AddStoneToBoard(i, stones[i]);
+      }
+    }
+    UpdateLegalMoves(nullptr);
+  }
+};
+
+// Builds a packed snapshot from a traced board.
+StoneSnapshot MakeSnapshot(const std::array<Color, kN * kN>& stones) {
+  StoneSnapshot snapshot;
+  for (int i = 0; i < kN * kN; ++i) {
+    if (stones[i] == Color::kBlack) {
+      snapshot.black.set(i);
+    } else if (stones[i] == Color::kWhite) {
+      snapshot.white.set(i);
+    }
+  }
+  return snapshot;
+}
+
+absl::Duration Percentile(const std::vector<absl::Duration>& sorted_latencies,
+                          int pct) {
+  auto i = sorted_latencies.size() * pct / 100;
+  return sorted_latencies[std::min(i, sorted_latencies.size() - 1)];
+}
+
+void Run() {
+  auto batches = ReadInferenceTrace(FLAGS_trace);
+  MG_CHECK(!batches.empty()) << FLAGS_trace << " contains no batches";
+  MG_LOG(INFO) << "Read " << batches.size() << " batches from " << FLAGS_trace;
+
+  auto model = NewModel(FLAGS_model, FLAGS_device);
+
+  std::vector<absl::Duration> latencies;
+  size_t num_inferences = 0;
+  absl::Duration model_time;
+
+  auto replay_start = absl::Now();
+  for (size_t i = 0; i < batches.size(); ++i) {
+    const auto& batch = batches[i];
+
+    // Rebuild the batch's exact ModelInputs. Reconstruction isn't counted
+    // against the model: only the RunMany call is timed.
+    std::vector<TracePosition> positions;
+    positions.reserve(batch.inferences.size());
+    std::vector<StoneSnapshot> snapshots;
+    snapshots.reserve(batch.inferences.size() * kMaxPositionHistory);
+    std::vector<ModelInput> inputs(batch.inferences.size());
+    std::vector<ModelOutput> outputs(batch.inferences.size());
+    std::vector<const ModelInput*> input_ptrs;
+    std::vector<ModelOutput*> output_ptrs;
+    for (size_t j = 0; j < batch.inferences.size(); ++j) {
+      const auto& inference = batch.inferences[j];
+      MG_CHECK(!inference.stone_history.empty());
+      inputs[j].sym = inference.sym;
+      positions.emplace_back(inference.to_play, inference.stone_history[0]);
+      inputs[j].position = &positions.back();
+      for (const auto& stones : inference.stone_history) {
+        snapshots.push_back(MakeSnapshot(stones));
+        inputs[j].stone_history.push_back(&snapshots.back());
+      }
+      input_ptrs.push_back(&inputs[j]);
+      output_ptrs.push_back(&outputs[j]);
+    }
+
+    if (FLAGS_pace) {
+      absl::SleepFor(batch.timestamp - (absl::Now() - replay_start));
+    }
+
+    auto start = absl::Now();
+    model->RunMany(input_ptrs, &output_ptrs, nullptr);
+    auto latency = absl::Now() - start;
+
+    if (static_cast<int>(i) >= FLAGS_warmup_batches) {
+      latencies.push_back(latency);
+      num_inferences += input_ptrs.size();
+      model_time += latency;
+    }
+  }
+
+  MG_CHECK(!latencies.empty())
+      << "trace has no batches left after --warmup_batches="
+      << FLAGS_warmup_batches;
+
+  std::sort(latencies.begin(), latencies.end());
+  auto num_batches = latencies.size();
+
+  MG_LOG(INFO) << "Replayed " << num_batches << " batches ("
+               << num_inferences << " inferences, average batch size "
+               << static_cast<float>(num_inferences) / num_batches << ")";
+  MG_LOG(INFO) << "Batch latency: p50 " << Percentile(latencies, 50)
+               << ", p90 " << Percentile(latencies, 90) << ", p99 "
+               << Percentile(latencies, 99) << ", max " << latencies.back();
+  MG_LOG(INFO) << "Throughput: "
+               << num_inferences / absl::ToDoubleSeconds(model_time)
+               << " inferences/second, "
+               << num_batches / absl::ToDoubleSeconds(model_time)
+               << " batches/second";
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  minigo::ShutdownModelFactories();
+  return 0;
+}
@@ -12,17 +12,31 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "cc/async/thread.h"
+#include "cc/columnar_examples.h"
 #include "cc/init.h"
 #include "cc/logging.h"
 #include "cc/random.h"
@@ -55,7 +69,29 @@ DEFINE_uint64(seed, 0, "Random seed.");
 DEFINE_bool(shuffle, false, "Whether to shuffle the sampled records.");
 DEFINE_string(dst, "",
               "Destination path. If path has a .zz suffix, the file will be "
-              "automatically compressed.");
+              "automatically compressed. If path has a .mgcol suffix, the "
+              "sampled examples are written in the columnar format (see "
+              "cc/columnar_examples.h); this requires the source files to be "
+              ".mgcol too, since converting to or from TF Examples would "
+              "need a proto decode. Columnar output is always uncompressed "
+              "so that training can mmap it, and --compression is ignored.");
+DEFINE_bool(daemon, false,
+            "Run continuously instead of as a batch job: poll the source "
+            "patterns for record files as selfplay produces them, keep the "
+            "most recent records in a bounded in-memory shuffle pool, and "
+            "emit a shuffled --num_records sample of the pool whenever new "
+            "files arrive. Each emission writes to the --dst path with a "
+            "sequence number inserted before the extension. Requires "
+            "--num_records; --sample_frac optionally thins the incoming "
+            "records; --files_per_pattern is ignored.");
+DEFINE_int32(poll_interval_secs, 30,
+             "Interval between scans of the source patterns for new files "
+             "in --daemon mode.");
+DEFINE_uint64(shuffle_pool_size, 1 << 21,
+              "Maximum number of records kept in the in-memory shuffle pool "
+              "in --daemon mode. When the pool is full, the oldest records "
+              "are dropped, so the pool is a sliding window over the most "
+              "recently played games.");
 
 namespace minigo {
 
@@ -63,6 +99,22 @@ class ReadThread : public Thread {
  public:
   struct Options {
     float sample_frac = 1;
+
+    // If non-zero, keep a uniform reservoir of at most this many records
+    // instead of Bernoulli sampling with sample_frac.
+    size_t reservoir_size = 0;
+  };
+
+  // A sampled record tagged with a uniformly random key. A reservoir keeps
+  // the records with the smallest keys it has seen, so reservoirs sampled on
+  // different threads can be merged exactly by selecting the smallest keys
+  // across all of them.
+  using KeyedRecord = std::pair<uint64_t, absl::string_view>;
+
+  struct KeyLess {
+    bool operator()(const KeyedRecord& a, const KeyedRecord& b) const {
+      return a.first < b.first;
+    }
   };
 
   ReadThread(std::vector<std::string> paths, const Options& options)
@@ -70,15 +122,50 @@ class ReadThread : public Thread {
         paths_(std::move(paths)),
         options_(options) {}
 
-  std::vector<std::string>& sampled_records() { return sampled_records_; }
-  const std::vector<std::string>& sampled_records() const {
+  ~ReadThread() override {
+#ifndef _WIN32
+    for (const auto& mapping : mappings_) {
+      munmap(mapping.first, mapping.second);
+    }
+#endif  // _WIN32
+  }
+
+  // The returned views point into memory owned by this thread (either mapped
+  // files or decompressed records), so the thread must outlive any use of
+  // them.
+  std::vector<absl::string_view>& sampled_records() {
     return sampled_records_;
   }
+  const std::vector<absl::string_view>& sampled_records() const {
+    return sampled_records_;
+  }
+
+  // The thread's reservoir, only populated when Options::reservoir_size != 0.
+  std::vector<KeyedRecord>& keyed_records() { return keyed_records_; }
+
+  // The per-example feature tensor size of the columnar files this thread
+  // read, or 0 if it read none.
+  uint32_t columnar_feature_bytes() const { return columnar_feature_bytes_; }
+
+  // True if the thread read any TFRecord files.
+  bool read_tfrecords() const { return read_tfrecords_; }
 
  private:
   void Run() override {
     tensorflow::io::RecordReaderOptions options;
     for (const auto& path : paths_) {
+      if (absl::EndsWith(path, ".mgcol")) {
+        ReadColumnar(path);
+        continue;
+      }
+      read_tfrecords_ = true;
+
+      // Uncompressed local files are memory-mapped and their records sampled
+      // zero-copy; everything else goes through TensorFlow's record reader.
+      if (!absl::EndsWith(path, ".zz") && TryReadMapped(path)) {
+        continue;
+      }
+
       std::unique_ptr<tensorflow::RandomAccessFile> file;
       TF_CHECK_OK(tensorflow::Env::Default()->NewRandomAccessFile(path, &file));
       if (absl::EndsWith(path, ".zz")) {
@@ -102,16 +189,173 @@ class ReadThread : public Thread {
           continue;
         }
 
-        if (options_.sample_frac == 1 || rnd_() < options_.sample_frac) {
-          sampled_records_.push_back(std::move(record));
-        }
+        Sample(record, &record);
       }
     }
   }
 
+  // Maps `path` into memory and samples record views directly from the
+  // mapped region without copying. Returns false if the file can't be mapped
+  // (e.g. it's on GCS), in which case the caller falls back to streaming
+  // reads.
+  bool TryReadMapped(const std::string& path) {
+    auto contents = MapFile(path);
+    if (contents.empty()) {
+      return false;
+    }
+
+    // Each TFRecord is framed as:
+    //   uint64 length, uint32 masked crc of length,
+    //   byte   data[length], uint32 masked crc of data.
+    // The CRCs aren't verified: these are local files we just wrote
+    // ourselves and TensorFlow verifies them again when the shuffled output
+    // is read for training.
+    const char* p = contents.data();
+    const char* end = p + contents.size();
+    while (p + 12 <= end) {
+      uint64_t length;
+      memcpy(&length, p, sizeof(length));
+      p += 12;
+      auto remaining = static_cast<size_t>(end - p);
+      if (length > remaining || remaining - length < 4) {
+        MG_LOG(WARNING) << "truncated record in \"" << path << "\"";
+        break;
+      }
+      Sample(absl::string_view(p, length), nullptr);
+      p += length + 4;
+    }
+    return true;
+  }
+
+  // Maps `path` into memory, returning an empty view if the file can't be
+  // mapped (e.g. it's on GCS). The mapping lives until the thread is
+  // destroyed.
+  absl::string_view MapFile(const std::string& path) {
+#ifdef _WIN32
+    return {};
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return {};
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return {};
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return {};
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    mappings_.emplace_back(data, size);
+    return absl::string_view(static_cast<const char*>(data), size);
+#endif  // _WIN32
+  }
+
+  // Reads a columnar example file (see cc/columnar_examples.h), offering
+  // each example to the sampler as a fixed-stride row. Rows have to be
+  // gathered from the file's columns, so unlike mapped TFRecords the
+  // sampled rows are copied; the write side scatters them back into
+  // columns.
+  void ReadColumnar(const std::string& path) {
+    auto contents = MapFile(path);
+    if (contents.empty()) {
+      // The file can't be mapped (e.g. it's on GCS): stream it into memory
+      // instead. The contents have to be kept alive until the columns have
+      // been sampled from, but not longer.
+      std::string data;
+      TF_CHECK_OK(
+          tensorflow::ReadFileToString(tensorflow::Env::Default(), path,
+                                       &data));
+      ReadColumnarContents(path, data);
+      return;
+    }
+    ReadColumnarContents(path, contents);
+  }
+
+  void ReadColumnarContents(const std::string& path,
+                            absl::string_view contents) {
+    columnar::FileView view;
+    if (!columnar::FileView::Parse(contents, &view)) {
+      MG_LOG(WARNING) << "skipping \"" << path << "\"";
+      return;
+    }
+    if (columnar_feature_bytes_ == 0) {
+      columnar_feature_bytes_ = view.header->feature_bytes;
+    } else {
+      MG_CHECK(columnar_feature_bytes_ == view.header->feature_bytes)
+          << "\"" << path << "\" has " << view.header->feature_bytes
+          << " byte features, other files have " << columnar_feature_bytes_;
+    }
+
+    std::string row;
+    for (uint64_t i = 0; i < view.header->num_examples; ++i) {
+      row.clear();
+      view.AppendRow(i, &row);
+      Sample(absl::string_view(row), &row);
+    }
+  }
+
+  // Offers a record to the sampler. If `owned` is non-null it holds the
+  // record's storage, which is claimed if (and only if) the record is kept;
+  // otherwise the record must point into one of this thread's mappings.
+  void Sample(absl::string_view record, std::string* owned) {
+    if (options_.reservoir_size == 0) {
+      if (options_.sample_frac == 1 || rnd_() < options_.sample_frac) {
+        sampled_records_.push_back(Retain(record, owned));
+      }
+      return;
+    }
+
+    // Reservoir sampling: keep the records with the smallest keys, using a
+    // max-heap on the key to find the record to evict.
+    auto key = rnd_.UniformUint64();
+    if (keyed_records_.size() < options_.reservoir_size) {
+      keyed_records_.emplace_back(key, Retain(record, owned));
+      std::push_heap(keyed_records_.begin(), keyed_records_.end(), KeyLess());
+    } else if (key < keyed_records_.front().first) {
+      std::pop_heap(keyed_records_.begin(), keyed_records_.end(), KeyLess());
+      keyed_records_.back() = {key, Retain(record, owned)};
+      std::push_heap(keyed_records_.begin(), keyed_records_.end(), KeyLess());
+    }
+  }
+
+  absl::string_view Retain(absl::string_view record, std::string* owned) {
+    if (owned == nullptr) {
+      return record;
+    }
+    owned_records_.push_back(std::move(*owned));
+    return owned_records_.back();
+  }
+
   Random rnd_;
   const std::vector<std::string> paths_;
-  std::vector<std::string> sampled_records_;
+
+  // Views of the sampled records, pointing into either mappings_ or
+  // owned_records_.
+  std::vector<absl::string_view> sampled_records_;
+
+  // Reservoir of sampled records, used instead of sampled_records_ when
+  // reservoir_size != 0. Records evicted from the reservoir may leave their
+  // storage behind in owned_records_; that's no worse than the old behavior
+  // of keeping every record when sampling an exact count.
+  std::vector<KeyedRecord> keyed_records_;
+
+  // Records read through TensorFlow's record reader. A deque keeps the
+  // strings' addresses stable as more are appended.
+  std::deque<std::string> owned_records_;
+
+  // Mapped regions of the uncompressed input files.
+  std::vector<std::pair<void*, size_t>> mappings_;
+
+  // Feature tensor size of the columnar files read so far; see
+  // columnar_feature_bytes().
+  uint32_t columnar_feature_bytes_ = 0;
+  bool read_tfrecords_ = false;
+
   const Options options_;
 };
 
@@ -121,30 +365,57 @@ class WriteThread : public Thread {
     int shard = 0;
     int num_shards = 1;
     int compression = 1;
+
+    // Shuffle the shard's records before writing them.
+    bool shuffle = false;
+
+    // If non-zero, the records are columnar example rows with this feature
+    // tensor size and the output is written as an uncompressed columnar
+    // file (see cc/columnar_examples.h) instead of a TFRecord file.
+    uint32_t columnar_feature_bytes = 0;
   };
 
-  WriteThread(std::vector<std::string> records, std::string path,
+  // The record views must stay valid until the thread finishes: they
+  // typically point into memory owned by the ReadThreads.
+  WriteThread(std::vector<absl::string_view> records, std::string path,
               const Options& options)
       : records_(std::move(records)), options_(options) {
     if (options_.num_shards == 1) {
       path_ = path;
     } else {
-      absl::string_view expected_ext =
-          options_.compression == 0 ? ".tfrecord" : ".tfrecord.zz";
+      absl::string_view expected_ext;
+      if (options_.columnar_feature_bytes != 0) {
+        expected_ext = ".mgcol";
+      } else {
+        expected_ext = options_.compression == 0 ? ".tfrecord" : ".tfrecord.zz";
+      }
       absl::string_view stem = path;
       MG_CHECK(absl::ConsumeSuffix(&stem, expected_ext))
           << "expected path to have extension '" << expected_ext
           << "', got '" << stem << "'";
-      path_ = absl::StrFormat("%s-%05d-of-%05d.tfrecord.zz", stem,
-                              options_.shard, options_.num_shards);
+      path_ = absl::StrFormat("%s-%05d-of-%05d%s", stem, options_.shard,
+                              options_.num_shards, expected_ext);
     }
   }
 
  private:
   void Run() override {
+    if (options_.shuffle) {
+      Random rnd(FLAGS_seed, Random::kUniqueStream);
+      rnd.Shuffle(&records_);
+    }
+
     std::unique_ptr<tensorflow::WritableFile> file;
     TF_CHECK_OK(tensorflow::Env::Default()->NewWritableFile(path_, &file));
 
+    if (options_.columnar_feature_bytes != 0) {
+      auto contents =
+          columnar::SerializeRows(options_.columnar_feature_bytes, records_);
+      TF_CHECK_OK(file->Append(contents));
+      TF_CHECK_OK(file->Close());
+      return;
+    }
+
     tensorflow::io::RecordWriterOptions options;
     if (options_.compression > 0) {
       MG_CHECK(options_.compression <= 9);
@@ -157,7 +428,7 @@ class WriteThread : public Thread {
 
     tensorflow::io::RecordWriter writer(file.get(), options);
     for (const auto& record : records_) {
-      TF_CHECK_OK(writer.WriteRecord(record));
+      TF_CHECK_OK(writer.WriteRecord({record.data(), record.size()}));
     }
 
     TF_CHECK_OK(writer.Close());
@@ -165,7 +436,7 @@ class WriteThread : public Thread {
   }
 
   std::string path_;
-  std::vector<std::string> records_;
+  std::vector<absl::string_view> records_;
   const Options options_;
 };
 
@@ -179,19 +450,25 @@ void MoveAppend(std::vector<T>* src, std::vector<T>* dst) {
   }
 }
 
-std::vector<std::string> Read(std::vector<std::string> paths) {
+// The sampled record views point into memory owned by the ReadThreads, so
+// the threads are kept alive alongside them.
+struct SampledRecords {
+  std::vector<absl::string_view> records;
+  std::vector<std::unique_ptr<ReadThread>> threads;
+
+  // Non-zero if the records are columnar example rows; see
+  // ReadThread::columnar_feature_bytes().
+  uint32_t columnar_feature_bytes = 0;
+};
+
+SampledRecords Read(std::vector<std::string> paths,
+                    const ReadThread::Options& read_options) {
   int num_paths = static_cast<int>(paths.size());
   int num_read_threads = std::min<int>(FLAGS_num_read_threads, num_paths);
 
   MG_LOG(INFO) << "reading " << num_paths << " files on " << num_read_threads
                << " threads";
 
-  ReadThread::Options read_options;
-  // If --sample_frac wasn't set, default to reading all records: we need to
-  // read all records from all files in order to fairly read exaclty
-  // --num_records records.
-  read_options.sample_frac = FLAGS_sample_frac == 0 ? 1 : FLAGS_sample_frac;
-
   std::vector<std::unique_ptr<ReadThread>> threads;
   for (int i = 0; i < num_read_threads; ++i) {
     // Get the record paths that this thread should run on.
@@ -211,32 +488,70 @@ std::vector<std::string> Read(std::vector<std::string> paths) {
     t->Join();
   }
 
-  // Concatenate sampled records.
-  size_t n = 0;
-  for (const auto& t : threads) {
-    n += t->sampled_records().size();
+  SampledRecords sampled;
+  if (read_options.reservoir_size != 0) {
+    // Merge the per-thread reservoirs: the records with the reservoir_size
+    // smallest keys across the union form a uniform sample of all records.
+    std::vector<ReadThread::KeyedRecord> merged;
+    for (const auto& t : threads) {
+      MoveAppend(&t->keyed_records(), &merged);
+    }
+    if (merged.size() > read_options.reservoir_size) {
+      std::nth_element(merged.begin(),
+                       merged.begin() + static_cast<std::ptrdiff_t>(
+                                            read_options.reservoir_size),
+                       merged.end(), ReadThread::KeyLess());
+      merged.resize(read_options.reservoir_size);
+    }
+    sampled.records.reserve(merged.size());
+    for (const auto& keyed_record : merged) {
+      sampled.records.push_back(keyed_record.second);
+    }
+    MG_LOG(INFO) << "sampled " << sampled.records.size() << " records";
+  } else {
+    // Concatenate sampled records.
+    size_t n = 0;
+    for (const auto& t : threads) {
+      n += t->sampled_records().size();
+    }
+    MG_LOG(INFO) << "sampled " << n << " records";
+    MG_LOG(INFO) << "concatenating";
+    sampled.records.reserve(n);
+    for (const auto& t : threads) {
+      MoveAppend(&t->sampled_records(), &sampled.records);
+    }
   }
-  MG_LOG(INFO) << "sampled " << n << " records";
-  MG_LOG(INFO) << "concatenating";
-  std::vector<std::string> records;
-  records.reserve(n);
+  // Columnar rows and TFRecords can't be mixed: their bytes are
+  // interchangeable to the sampler but not to the writer, so every input
+  // must agree on the format (and, for columnar, the feature size).
   for (const auto& t : threads) {
-    MoveAppend(&t->sampled_records(), &records);
+    if (t->columnar_feature_bytes() == 0) {
+      continue;
+    }
+    if (sampled.columnar_feature_bytes == 0) {
+      sampled.columnar_feature_bytes = t->columnar_feature_bytes();
+    } else {
+      MG_CHECK(sampled.columnar_feature_bytes == t->columnar_feature_bytes());
+    }
   }
+  if (sampled.columnar_feature_bytes != 0) {
+    for (const auto& t : threads) {
+      MG_CHECK(!t->read_tfrecords()) << "can't mix columnar and TFRecord "
+                                        "source files";
+    }
+  }
+  sampled.threads = std::move(threads);
 
-  return records;
-}
-
-void Shuffle(std::vector<std::string>* records) {
-  Random rnd(FLAGS_seed, Random::kUniqueStream);
-  MG_LOG(INFO) << "shuffling";
-  rnd.Shuffle(records);
+  return sampled;
 }
 
-void Write(std::vector<std::string> records, const std::string& path) {
+void Write(std::vector<absl::string_view> records,
+           uint32_t columnar_feature_bytes, const std::string& path) {
   WriteThread::Options write_options;
   write_options.num_shards = FLAGS_num_write_threads;
   write_options.compression = FLAGS_compression;
+  write_options.shuffle = FLAGS_shuffle;
+  write_options.columnar_feature_bytes = columnar_feature_bytes;
 
   size_t num_records;
   if (FLAGS_num_records != 0) {
@@ -250,33 +565,49 @@ void Write(std::vector<std::string> records, const std::string& path) {
     num_records = static_cast<size_t>(records.size());
   }
 
+  std::vector<std::vector<absl::string_view>> shard_records(
+      FLAGS_num_write_threads);
+  if (FLAGS_shuffle) {
+    // Scatter the records uniformly at random across the shards; each
+    // WriteThread shuffles its own shard before writing it. Together these
+    // produce an unbiased shuffle, while the O(num_records) shuffle passes
+    // run on all the write threads in parallel instead of serially here.
+    MG_LOG(INFO) << "scattering across " << FLAGS_num_write_threads
+                 << " shards";
+    Random rnd(FLAGS_seed, Random::kUniqueStream);
+    for (size_t i = 0; i < num_records; ++i) {
+      size_t j = i * records.size() / num_records;
+      shard_records[rnd.UniformInt(0, FLAGS_num_write_threads - 1)].push_back(
+          records[j]);
+    }
+  } else {
+    for (int shard = 0; shard < FLAGS_num_write_threads; ++shard) {
+      // Calculate the range of source records for this shard.
+      size_t begin_src = shard * records.size() / FLAGS_num_write_threads;
+      size_t end_src = (shard + 1) * records.size() / FLAGS_num_write_threads;
+      size_t num_src = end_src - begin_src;
+
+      // Calculate the number of destination records for this shard.
+      size_t begin_dst = shard * num_records / FLAGS_num_write_threads;
+      size_t end_dst = (shard + 1) * num_records / FLAGS_num_write_threads;
+      size_t num_dst = end_dst - begin_dst;
+
+      // Sample the records for this shard.
+      shard_records[shard].reserve(num_dst);
+      for (size_t i = 0; i < num_dst; ++i) {
+        size_t j = begin_src + i * num_src / num_dst;
+        shard_records[shard].push_back(records[j]);
+      }
+    }
+  }
+
   size_t total_dst = 0;
   std::vector<std::unique_ptr<WriteThread>> threads;
   for (int shard = 0; shard < FLAGS_num_write_threads; ++shard) {
     write_options.shard = shard;
-
-    // Calculate the range of source records for this shard.
-    size_t begin_src = shard * records.size() / FLAGS_num_write_threads;
-    size_t end_src = (shard + 1) * records.size() / FLAGS_num_write_threads;
-    size_t num_src = end_src - begin_src;
-
-    // Calculate the number of destination records for this shard.
-    size_t begin_dst = shard * num_records / FLAGS_num_write_threads;
-    size_t end_dst = (shard + 1) * num_records / FLAGS_num_write_threads;
-    size_t num_dst = end_dst - begin_dst;
-
-    total_dst += num_dst;
-
-    // Sample the records for this shard.
-    std::vector<std::string> shard_records;
-    shard_records.reserve(num_dst);
-    for (size_t i = 0; i < num_dst; ++i) {
-      size_t j = begin_src + i * num_src / num_dst;
-      shard_records.push_back(std::move(records[j]));
-    }
-
-    threads.push_back(absl::make_unique<WriteThread>(std::move(shard_records),
-                                                     path, write_options));
+    total_dst += shard_records[shard].size();
+    threads.push_back(absl::make_unique<WriteThread>(
+        std::move(shard_records[shard]), path, write_options));
   }
 
   MG_CHECK(total_dst == num_records);
@@ -297,21 +628,163 @@ void Run(std::vector<std::string> src_paths, const std::string& dst_path) {
   MG_CHECK(!src_paths.empty());
   MG_CHECK(!dst_path.empty());
 
-  auto records = Read(std::move(src_paths));
-
-  if (FLAGS_shuffle) {
-    Shuffle(&records);
+  ReadThread::Options read_options;
+  if (FLAGS_num_records != 0) {
+    // Sampling an exact number of records: each thread keeps a reservoir of
+    // --num_records records, which are merged once the threads finish. This
+    // avoids having to keep every record in memory to fairly sample an
+    // exact count.
+    read_options.reservoir_size = FLAGS_num_records;
+  } else {
+    read_options.sample_frac = FLAGS_sample_frac;
   }
 
-  Write(std::move(records), dst_path);
+  auto sampled = Read(std::move(src_paths), read_options);
+
+  MG_CHECK((sampled.columnar_feature_bytes != 0) ==
+           absl::EndsWith(dst_path, ".mgcol"))
+      << "columnar sources must be written to a .mgcol destination and "
+         "TFRecord sources to a .tfrecord one; can't convert between the "
+         "formats";
+
+  // Shuffling happens on the write threads; see Write.
+  // The ReadThreads in `sampled` own the records' storage, so they must stay
+  // alive until the write completes.
+  Write(std::move(sampled.records), sampled.columnar_feature_bytes, dst_path);
 
   MG_LOG(INFO) << "done";
 }
 
+// Returns the path for the daemon's next emission: `dst` with a sequence
+// number inserted before the format extension, e.g. "t.tfrecord.zz" becomes
+// "t-000042.tfrecord.zz".
+std::string EmissionPath(const std::string& dst, int sequence) {
+  for (absl::string_view ext : {".tfrecord.zz", ".tfrecord", ".mgcol"}) {
+    absl::string_view stem = dst;
+    if (absl::ConsumeSuffix(&stem, ext)) {
+      return absl::StrFormat("%s-%06d%s", stem, sequence, ext);
+    }
+  }
+  MG_LOG(FATAL) << "unrecognized destination extension \"" << dst << "\"";
+  return "";
+}
+
+// Daemon mode: tail the source patterns for record files as selfplay
+// produces them, keep a sliding window of the most recent records in a
+// bounded pool and emit a shuffled --num_records sample of the pool after
+// each batch of new files, so data preparation overlaps selfplay instead of
+// serializing the RL iteration behind a batch shuffle.
+void RunDaemon(const std::vector<std::string>& patterns,
+               const std::string& dst_path) {
+  MG_CHECK(FLAGS_num_records != 0)
+      << "--daemon requires --num_records (the size of each emission)";
+  MG_CHECK(FLAGS_shuffle_pool_size >= FLAGS_num_records)
+      << "--shuffle_pool_size must be at least --num_records";
+  MG_CHECK(!patterns.empty());
+  MG_CHECK(!dst_path.empty());
+
+  ReadThread::Options read_options;
+  read_options.sample_frac = FLAGS_sample_frac == 0 ? 1 : FLAGS_sample_frac;
+
+  // Unlike the batch job, the pool owns copies of its records: the mapped
+  // input files can't all be kept alive for the lifetime of the process. A
+  // deque never moves its elements, so views of pooled records stay valid
+  // until the record is evicted.
+  std::deque<std::string> pool;
+  uint32_t pool_feature_bytes = 0;
+  absl::flat_hash_set<std::string> seen;
+  Random rnd(FLAGS_seed, Random::kUniqueStream);
+  int sequence = 0;
+
+  MG_LOG(INFO) << "tailing " << patterns.size() << " pattern(s) every "
+               << FLAGS_poll_interval_secs << "s";
+  for (;;) {
+    // Find finished files that haven't been ingested yet. A file younger
+    // than one poll interval may still be being written, so it's left for a
+    // later scan.
+    std::vector<std::string> new_paths;
+    auto now_nsec = absl::ToUnixNanos(absl::Now());
+    auto grace_nsec =
+        absl::ToInt64Nanoseconds(absl::Seconds(FLAGS_poll_interval_secs));
+    for (const auto& pattern : patterns) {
+      std::vector<std::string> paths;
+      TF_CHECK_OK(
+          tensorflow::Env::Default()->GetMatchingPaths(pattern, &paths));
+      for (auto& path : paths) {
+        if (seen.contains(path)) {
+          continue;
+        }
+        tensorflow::FileStatistics stat;
+        if (!tensorflow::Env::Default()->Stat(path, &stat).ok() ||
+            now_nsec - stat.mtime_nsec < grace_nsec) {
+          continue;
+        }
+        seen.insert(path);
+        new_paths.push_back(std::move(path));
+      }
+    }
+
+    if (new_paths.empty()) {
+      absl::SleepFor(absl::Seconds(FLAGS_poll_interval_secs));
+      continue;
+    }
+
+    // Read and sample the new files, then copy the sampled records into the
+    // pool, dropping the oldest records to stay within bounds.
+    auto sampled = Read(std::move(new_paths), read_options);
+    if (sampled.columnar_feature_bytes != 0) {
+      MG_CHECK(pool_feature_bytes == 0 ||
+               pool_feature_bytes == sampled.columnar_feature_bytes);
+      pool_feature_bytes = sampled.columnar_feature_bytes;
+    }
+    for (const auto& record : sampled.records) {
+      pool.emplace_back(record.data(), record.size());
+    }
+    while (pool.size() > FLAGS_shuffle_pool_size) {
+      pool.pop_front();
+    }
+    MG_LOG(INFO) << "pool holds " << pool.size() << " records";
+
+    if (pool.size() < FLAGS_num_records) {
+      continue;
+    }
+    MG_CHECK((pool_feature_bytes != 0) == absl::EndsWith(dst_path, ".mgcol"))
+        << "columnar sources must be written to a .mgcol destination and "
+           "TFRecord sources to a .tfrecord one; can't convert between the "
+           "formats";
+
+    // Emit a uniform sample of the pool via a partial Fisher-Yates shuffle.
+    // The sample comes out in random order, so the emitted shards are
+    // already shuffled and --shuffle isn't needed.
+    auto pool_size = static_cast<int>(pool.size());
+    std::vector<int> indices(pool.size());
+    for (int i = 0; i < pool_size; ++i) {
+      indices[i] = i;
+    }
+    std::vector<absl::string_view> emission;
+    emission.reserve(FLAGS_num_records);
+    for (int i = 0; i < static_cast<int>(FLAGS_num_records); ++i) {
+      std::swap(indices[i], indices[rnd.UniformInt(i, pool_size - 1)]);
+      emission.push_back(pool[indices[i]]);
+    }
+    Write(std::move(emission), pool_feature_bytes,
+          EmissionPath(dst_path, sequence++));
+  }
+}
+
 }  // namespace minigo
 
 int main(int argc, char* argv[]) {
   minigo::Init(&argc, &argv);
+
+  if (FLAGS_daemon) {
+    // Daemon mode polls the patterns itself so it can pick up files created
+    // after startup.
+    std::vector<std::string> patterns(argv + 1, argv + argc);
+    minigo::RunDaemon(patterns, FLAGS_dst);
+    return 0;
+  }
+
   std::vector<std::string> src_paths;
   for (int i = 1; i < argc; ++i) {
     const auto& pattern = argv[i];
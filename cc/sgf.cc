@@ -30,11 +30,65 @@ namespace sgf {
 
 namespace {
 
-class Parser {
+// Low-level cursor over the SGF input, shared by the Ast-building Parser and
+// the streaming StreamParser.
+class ParserBase {
  public:
-  Parser(absl::string_view contents, std::string* error)
+  ParserBase(absl::string_view contents, std::string* error)
       : original_contents_(contents), contents_(contents), error_(error) {}
 
+  bool done() const { return contents_.empty(); }
+  char peek() const { return contents_[0]; }
+
+ protected:
+  bool Read(char c) {
+    if (done()) {
+      return Error("expected '", absl::string_view(&c, 1), "', got EOF");
+    }
+    if (contents_[0] != c) {
+      return Error("expected '", absl::string_view(&c, 1), "', got '",
+                   contents_.substr(0, 1), "'");
+    }
+    contents_ = contents_.substr(1);
+    return true;
+  }
+
+  // Skip over whitespace.
+  // Updates contents_ and returns true if there are non-whitespace characters
+  // remaining. Leaves contents_ alone and returns false if only whitespace
+  // characters remain.
+  bool SkipWhitespace() {
+    contents_ = absl::StripLeadingAsciiWhitespace(contents_);
+    return !contents_.empty();
+  }
+
+  template <typename... Args>
+  bool Error(Args&&... args) {
+    // Find the line & column number the error occured at.
+    int line = 1;
+    int col = 1;
+    for (auto* c = original_contents_.data(); c != contents_.data(); ++c) {
+      if (*c == '\n') {
+        ++line;
+        col = 1;
+      } else {
+        ++col;
+      }
+    }
+    *error_ = absl::StrCat("ERROR at line:", line, " col:", col, ": ", args...);
+    return false;
+  }
+
+  absl::string_view original_contents_;
+  absl::string_view contents_;
+  std::string* error_;
+};
+
+class Parser : public ParserBase {
+ public:
+  Parser(absl::string_view contents, std::string* error)
+      : ParserBase(contents, error) {}
+
   bool Parse(Collection* collection) {
     *error_ = "";
     while (SkipWhitespace()) {
@@ -46,9 +100,6 @@ class Parser {
     return done();
   }
 
-  bool done() const { return contents_.empty(); }
-  char peek() const { return contents_[0]; }
-
  private:
   bool ParseTree(Tree* tree) {
     if (!Read('(')) {
@@ -152,18 +203,6 @@ class Parser {
     return Read('[') && ReadTo(']', value) && Read(']');
   }
 
-  bool Read(char c) {
-    if (done()) {
-      return Error("expected '", absl::string_view(&c, 1), "', got EOF");
-    }
-    if (contents_[0] != c) {
-      return Error("expected '", absl::string_view(&c, 1), "', got '",
-                   contents_.substr(0, 1), "'");
-    }
-    contents_ = contents_.substr(1);
-    return true;
-  }
-
   bool ReadTo(char c, std::string* result) {
     result->clear();
     bool read_escape = false;
@@ -188,36 +227,170 @@ class Parser {
     }
     return Error("reached EOF before finding '", absl::string_view(&c, 1), "'");
   }
+};
 
-  // Skip over whitespace.
-  // Updates contents_ and returns true if there are non-whitespace characters
-  // remaining. Leaves contents_ alone and returns false if only whitespace
-  // characters remain.
-  bool SkipWhitespace() {
-    contents_ = absl::StripLeadingAsciiWhitespace(contents_);
-    return !contents_.empty();
+// Streaming equivalent of Parser: performs the same validation but invokes
+// StreamingVisitor callbacks instead of building a Collection, and never
+// allocates. Property values are passed through as views over the input with
+// escape sequences left intact.
+class StreamParser : public ParserBase {
+ public:
+  StreamParser(absl::string_view contents, StreamingVisitor* visitor,
+               std::string* error)
+      : ParserBase(contents, error), visitor_(visitor) {}
+
+  bool Parse() {
+    *error_ = "";
+    while (SkipWhitespace()) {
+      if (!ParseTree()) {
+        // Stopping early at the visitor's request isn't an error.
+        return stopped_;
+      }
+    }
+    return done();
   }
 
-  template <typename... Args>
-  bool Error(Args&&... args) {
-    // Find the line & column number the error occured at.
-    int line = 1;
-    int col = 1;
-    for (auto* c = original_contents_.data(); c != contents_.data(); ++c) {
-      if (*c == '\n') {
-        ++line;
-        col = 1;
+ private:
+  bool ParseTree() {
+    if (!Read('(') || !Visit(visitor_->OnTreeBegin())) {
+      return false;
+    }
+
+    if (!ParseSequence()) {
+      return false;
+    }
+
+    for (;;) {
+      if (!SkipWhitespace()) {
+        return Error("reached EOF when parsing tree");
+      }
+      if (peek() == '(') {
+        if (!ParseTree()) {
+          return false;
+        }
       } else {
-        ++col;
+        return Read(')') && Visit(visitor_->OnTreeEnd());
       }
     }
-    *error_ = absl::StrCat("ERROR at line:", line, " col:", col, ": ", args...);
-    return false;
   }
 
-  absl::string_view original_contents_;
-  absl::string_view contents_;
-  std::string* error_;
+  bool ParseSequence() {
+    bool saw_node = false;
+    for (;;) {
+      if (!SkipWhitespace()) {
+        return Error("reached EOF when parsing sequence");
+      }
+      if (peek() != ';') {
+        break;
+      }
+      saw_node = true;
+      if (!ParseNode()) {
+        return false;
+      }
+    }
+    if (!saw_node) {
+      return Error("tree has no nodes");
+    }
+    return true;
+  }
+
+  bool ParseNode() {
+    MG_CHECK(Read(';'));
+    if (!Visit(visitor_->OnNode())) {
+      return false;
+    }
+    bool has_move = false;
+    for (;;) {
+      if (!SkipWhitespace()) {
+        return Error("reached EOF when parsing node");
+      }
+      if (!absl::ascii_isupper(peek())) {
+        return true;
+      }
+      if (!ParseProperty(&has_move)) {
+        return false;
+      }
+    }
+  }
+
+  bool ParseProperty(bool* has_move) {
+    absl::string_view id;
+    if (!ReadTo('[', &id)) {
+      return false;
+    }
+    if (id.empty()) {
+      return Error("property has an empty ID");
+    }
+    if (!SkipWhitespace()) {
+      return Error("reached EOF when parsing property ", id);
+    }
+    bool is_move = id == "B" || id == "W";
+    int num_values = 0;
+    for (;;) {
+      absl::string_view value;
+      if (!Read('[') || !ReadTo(']', &value) || !Read(']')) {
+        return false;
+      }
+      num_values += 1;
+      if (is_move) {
+        if (num_values != 1) {
+          return Error("expected exactly one value for property ", id);
+        }
+        if (*has_move) {
+          return Error("node already has a move");
+        }
+        *has_move = true;
+        Move move(id == "B" ? Color::kBlack : Color::kWhite,
+                  Coord::FromSgf(value, true));
+        if (move.c == Coord::kInvalid) {
+          return Error(value, " is not a valid SGF coordinate");
+        }
+        if (!Visit(visitor_->OnMove(move))) {
+          return false;
+        }
+      } else if (!Visit(visitor_->OnProperty(id, value))) {
+        return false;
+      }
+      SkipWhitespace();
+      if (peek() != '[') {
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Reads up to (but not including) the next unescaped occurrence of `c`,
+  // returning the characters read as a view over the input.
+  bool ReadTo(char c, absl::string_view* result) {
+    bool read_escape = false;
+    for (size_t i = 0; i < contents_.size(); ++i) {
+      char x = contents_[i];
+      if (!read_escape) {
+        read_escape = x == '\\';
+        if (read_escape) {
+          continue;
+        }
+      }
+
+      if ((!read_escape || x != ']') && x == c) {
+        *result = contents_.substr(0, i);
+        contents_ = contents_.substr(i);
+        return true;
+      }
+
+      read_escape = false;
+    }
+    return Error("reached EOF before finding '", absl::string_view(&c, 1), "'");
+  }
+
+  // Returns the visitor callback's result, recording an early stop.
+  bool Visit(bool keep_going) {
+    stopped_ = !keep_going;
+    return keep_going;
+  }
+
+  StreamingVisitor* visitor_;
+  bool stopped_ = false;
 };
 
 }  // namespace
@@ -320,6 +493,13 @@ bool Parse(absl::string_view contents, Collection* collection,
   return Parser(contents, error).Parse(collection);
 }
 
+StreamingVisitor::~StreamingVisitor() = default;
+
+bool ParseStreaming(absl::string_view contents, StreamingVisitor* visitor,
+                    std::string* error) {
+  return StreamParser(contents, visitor, error).Parse();
+}
+
 std::string CreateSgfString(absl::Span<const MoveWithComment> moves,
                             const CreateSgfOptions& options) {
   auto str = absl::StrFormat(
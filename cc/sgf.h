@@ -92,6 +92,43 @@ struct Collection {
 MG_WARN_UNUSED_RESULT bool Parse(absl::string_view contents,
                                  Collection* collection, std::string* error);
 
+// Visitor interface for ParseStreaming.
+// Each callback returns true to continue parsing, or false to stop early.
+// The default implementations ignore everything and continue.
+class StreamingVisitor {
+ public:
+  virtual ~StreamingVisitor();
+
+  // Called when a game tree or sub-tree is opened or closed. Sub-trees are
+  // visited in order, so the first OnTreeEnd marks the end of the collection's
+  // main line.
+  virtual bool OnTreeBegin() { return true; }
+  virtual bool OnTreeEnd() { return true; }
+
+  // Called at the start of each node.
+  virtual bool OnNode() { return true; }
+
+  // Called for each B or W property.
+  virtual bool OnMove(Move move) { return true; }
+
+  // Called once per value of every other property. `id` and `value` point
+  // into the buffer passed to ParseStreaming and are only valid for the
+  // duration of the call. Unlike Parse, escape sequences in `value` are left
+  // unprocessed.
+  virtual bool OnProperty(absl::string_view id, absl::string_view value) {
+    return true;
+  }
+};
+
+// Streaming alternative to Parse for bulk SGF ingestion: walks the input
+// without building a Collection, invoking the visitor's callbacks as it goes.
+// Performs no heap allocation regardless of input size.
+// Returns false and sets `error` if the input is malformed; stopping early
+// from a callback counts as success.
+MG_WARN_UNUSED_RESULT bool ParseStreaming(absl::string_view contents,
+                                          StreamingVisitor* visitor,
+                                          std::string* error);
+
 // TODO(tommadams): Replace sgf::MoveWithComment with sgf::Node.
 // A single move with a (possibly empty) comment.
 struct MoveWithComment {
@@ -208,6 +208,85 @@ TEST_F(SgfTest, CommentEscaping) {
   EXPECT_EQ("]", tree->nodes[2]->GetComment());
 }
 
+// Records the streaming parser's callbacks as a flat list of events.
+class RecordingVisitor : public StreamingVisitor {
+ public:
+  bool OnTreeBegin() override {
+    events.push_back("(");
+    return true;
+  }
+  bool OnTreeEnd() override {
+    events.push_back(")");
+    return true;
+  }
+  bool OnNode() override {
+    events.push_back(";");
+    return true;
+  }
+  bool OnMove(Move move) override {
+    events.push_back(absl::StrCat(ColorToCode(move.color), "[",
+                                  move.c.ToSgf(), "]"));
+    return true;
+  }
+  bool OnProperty(absl::string_view id, absl::string_view value) override {
+    events.push_back(absl::StrCat(id, "[", value, "]"));
+    return true;
+  }
+
+  std::vector<std::string> events;
+};
+
+TEST_F(SgfTest, StreamingParse) {
+  std::string sgf = "(;FF[4]AB[aa][bb];B[ac](;W[ad])(;W[ae]))";
+
+  RecordingVisitor visitor;
+  ASSERT_TRUE(ParseStreaming(sgf, &visitor, &error_)) << error_;
+
+  std::vector<std::string> expected = {
+      "(", ";", "FF[4]", "AB[aa]", "AB[bb]", ";", "B[ac]",
+      "(", ";", "W[ad]", ")", "(", ";", "W[ae]", ")", ")",
+  };
+  EXPECT_THAT(visitor.events, ::testing::ContainerEq(expected));
+}
+
+TEST_F(SgfTest, StreamingParseDoesntUnescapeValues) {
+  // Unlike Parse, the streaming parser passes escaped characters through
+  // verbatim.
+  std::string sgf = "(;C[test [?\\]: comment])";
+
+  RecordingVisitor visitor;
+  ASSERT_TRUE(ParseStreaming(sgf, &visitor, &error_)) << error_;
+
+  std::vector<std::string> expected = {"(", ";", "C[test [?\\]: comment]", ")"};
+  EXPECT_THAT(visitor.events, ::testing::ContainerEq(expected));
+}
+
+TEST_F(SgfTest, StreamingParseStopsEarly) {
+  // Stopping at the first OnTreeEnd skips everything after the main line.
+  class MainLineVisitor : public RecordingVisitor {
+   public:
+    bool OnTreeEnd() override { return false; }
+  };
+
+  std::string sgf = "(;B[aa](;W[ab])(;W[ac]))";
+
+  MainLineVisitor visitor;
+  ASSERT_TRUE(ParseStreaming(sgf, &visitor, &error_)) << error_;
+
+  std::vector<std::string> expected = {"(", ";", "B[aa]", "(", ";", "W[ab]"};
+  EXPECT_THAT(visitor.events, ::testing::ContainerEq(expected));
+}
+
+TEST_F(SgfTest, StreamingParseErrors) {
+  RecordingVisitor visitor;
+  EXPECT_FALSE(ParseStreaming("   \n  x", &visitor, &error_));
+  EXPECT_FALSE(ParseStreaming("()", &visitor, &error_));
+  EXPECT_FALSE(ParseStreaming("(;a[])", &visitor, &error_));
+  EXPECT_FALSE(ParseStreaming("(;B[xx])", &visitor, &error_));
+  EXPECT_FALSE(ParseStreaming("(;B[aa]W[bb])", &visitor, &error_));
+  EXPECT_FALSE(ParseStreaming("(;B[aa][bb])", &visitor, &error_));
+}
+
 }  // namespace
 }  // namespace sgf
 }  // namespace minigo
@@ -0,0 +1,233 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Serves inference to co-located selfplay processes through a shared memory
+// segment (see cc/dual_net/shm_buffer.h). The server owns the accelerator;
+// clients select it by passing --device=shm://<name> and the same model.
+// All pending client requests are gathered into a single device batch, so
+// running many small selfplay processes per host no longer fragments
+// batching.
+
+#include <signal.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "cc/constants.h"
+#include "cc/dual_net/shm_buffer.h"
+#include "cc/init.h"
+#include "cc/logging.h"
+#include "cc/model/factory.h"
+#include "cc/model/features.h"
+#include "cc/model/loader.h"
+#include "gflags/gflags.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
+#include "tensorflow/core/public/session.h"
+
+DEFINE_string(model, "", "Path to a minigo model.");
+DEFINE_string(device, "", "Optional ID of the GPU to run on.");
+DEFINE_string(shm_name, "minigo",
+              "Name of the shared memory segment to serve on. Clients "
+              "connect with --device=shm://<shm_name>.");
+DEFINE_int32(num_slots, 8,
+             "Number of request slots in the shared memory segment. Should "
+             "be at least the total number of inference threads across all "
+             "client processes that are expected to run concurrently.");
+DEFINE_int32(slot_capacity, 256,
+             "Maximum number of inputs one client request can hold. Must be "
+             "at least the largest virtual_losses * parallel_games of any "
+             "client.");
+
+namespace minigo {
+namespace {
+
+volatile sig_atomic_t g_interrupted = 0;
+
+void HandleSignal(int /*signum*/) { g_interrupted = 1; }
+
+void Run() {
+  auto def = LoadModelDefinition(FLAGS_model);
+  MG_CHECK(def.metadata.Get<std::string>("engine") == "tf")
+      << "the shared memory server can only serve tf models";
+
+  std::string input_type = "float";
+  def.metadata.TryGet("input_type", &input_type);
+  MG_CHECK(input_type == "float")
+      << "shared memory inference only supports float features";
+
+  auto feature_desc =
+      FeatureDescriptor::Create(def.metadata.Get<std::string>("input_features"),
+                                def.metadata.Get<std::string>("input_layout"));
+  const int num_feature_elements = feature_desc.num_planes * kN * kN;
+
+  tensorflow::protobuf::io::CodedInputStream coded_stream(
+      reinterpret_cast<const uint8_t*>(def.model_bytes.data()),
+      def.model_bytes.size());
+  coded_stream.SetTotalBytesLimit(1024 * 1024 * 1024);
+
+  tensorflow::GraphDef graph_def;
+  MG_CHECK(graph_def.ParseFromCodedStream(&coded_stream) &&
+           coded_stream.ConsumedEntireMessage());
+
+  auto device = absl::StrCat("/gpu:", FLAGS_device.empty() ? "0" : FLAGS_device);
+  for (auto& node : *graph_def.mutable_node()) {
+    node.set_device(device);
+  }
+
+  // Match TfDualNet's session configuration: let Grappler optimize the
+  // frozen graph once at load time, and fall back to the CPU for any op the
+  // GPU doesn't support.
+  tensorflow::SessionOptions session_options;
+  session_options.config.set_allow_soft_placement(true);
+  session_options.config.mutable_gpu_options()->set_allow_growth(true);
+  auto* rewriter_config =
+      session_options.config.mutable_graph_options()->mutable_rewrite_options();
+  rewriter_config->set_constant_folding(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_arithmetic_optimization(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_dependency_optimization(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_remapping(tensorflow::RewriterConfig::ON);
+  rewriter_config->set_layout_optimizer(tensorflow::RewriterConfig::ON);
+
+  std::unique_ptr<tensorflow::Session> session(
+      tensorflow::NewSession(session_options));
+  TF_CHECK_OK(session->Create(graph_def));
+
+  tensorflow::CallableOptions callable_options;
+  callable_options.add_feed("pos_tensor");
+  callable_options.add_fetch("policy_output");
+  callable_options.add_fetch("value_output");
+  callable_options.add_target("policy_output");
+  callable_options.add_target("value_output");
+
+  tensorflow::Session::CallableHandle handle;
+  TF_CHECK_OK(session->MakeCallable(callable_options, &handle));
+
+  auto buffer =
+      ShmBuffer::Create(absl::StrCat("/", FLAGS_shm_name), FLAGS_num_slots,
+                        FLAGS_slot_capacity, num_feature_elements);
+  MG_LOG(INFO) << "serving \"" << FLAGS_model << "\" on shm://"
+               << FLAGS_shm_name << " with " << FLAGS_num_slots
+               << " slots of capacity " << FLAGS_slot_capacity;
+
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+
+  // Grow-only pre-allocated feed tensor; see TfDualNet::Reserve.
+  std::vector<tensorflow::Tensor> session_inputs;
+  std::vector<tensorflow::Tensor> session_outputs;
+  int batch_capacity = 0;
+
+  std::vector<int> pending;
+  for (;;) {
+    // Gather all pending slots into one batch.
+    pending.clear();
+    buffer->Lock();
+    for (;;) {
+      for (int i = 0; i < FLAGS_num_slots; ++i) {
+        if (*buffer->slot_state(i) == ShmBuffer::kPending) {
+          *buffer->slot_state(i) = ShmBuffer::kRunning;
+          pending.push_back(i);
+        }
+      }
+      if (!pending.empty() || g_interrupted) {
+        break;
+      }
+      buffer->WaitRequestWithTimeout(100);
+    }
+    buffer->Unlock();
+
+    if (g_interrupted) {
+      break;
+    }
+
+    int total = 0;
+    for (int i : pending) {
+      total += static_cast<int>(*buffer->slot_batch_size(i));
+    }
+
+    if (total > batch_capacity) {
+      batch_capacity = total;
+      auto shape = feature_desc.GetInputShape(batch_capacity);
+      tensorflow::TensorShape tf_shape(
+          {shape[0], shape[1], shape[2], shape[3]});
+      session_inputs.clear();
+      session_inputs.emplace_back(tensorflow::DT_FLOAT, tf_shape);
+    }
+
+    // Concatenate the slots' features into the feed tensor, zeroing any
+    // padding rows left over from a larger previous batch.
+    auto* features = session_inputs[0].flat<float>().data();
+    int row = 0;
+    for (int i : pending) {
+      auto n = static_cast<int>(*buffer->slot_batch_size(i));
+      memcpy(features + row * num_feature_elements, buffer->slot_features(i),
+             sizeof(float) * n * num_feature_elements);
+      row += n;
+    }
+    if (row < batch_capacity) {
+      memset(features + row * num_feature_elements, 0,
+             sizeof(float) * (batch_capacity - row) * num_feature_elements);
+    }
+
+    session_outputs.clear();
+    TF_CHECK_OK(session->RunCallable(handle, session_inputs, &session_outputs,
+                                     nullptr));
+
+    // Scatter the raw outputs back; clients apply symmetries and the
+    // pass-alive policy filter themselves via Model::GetOutputs.
+    const auto* policy = session_outputs[0].flat<float>().data();
+    const auto* value = session_outputs[1].flat<float>().data();
+    row = 0;
+    for (int i : pending) {
+      auto n = static_cast<int>(*buffer->slot_batch_size(i));
+      memcpy(buffer->slot_policy(i), policy + row * kNumMoves,
+             sizeof(float) * n * kNumMoves);
+      memcpy(buffer->slot_value(i), value + row, sizeof(float) * n);
+      row += n;
+    }
+
+    buffer->Lock();
+    for (int i : pending) {
+      *buffer->slot_state(i) = ShmBuffer::kDone;
+    }
+    buffer->BroadcastResponse();
+    buffer->Unlock();
+  }
+
+  MG_LOG(INFO) << "shutting down";
+  buffer->Lock();
+  buffer->header()->shutdown = 1;
+  buffer->BroadcastResponse();
+  buffer->Unlock();
+
+  TF_CHECK_OK(session->ReleaseCallable(handle));
+  TF_CHECK_OK(session->Close());
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Run();
+  return 0;
+}
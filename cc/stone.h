@@ -25,8 +25,9 @@ namespace minigo {
 
 // Stone represents either a stone on the board or, when empty() == true, an
 // empty point on the board.
-// Stone tracks both the color (empty, black or white) and group the ID of the
-// stone's.
+// Stone packs both the stone's color (empty, black or white) and the ID of
+// the group it belongs to into 16 bits, so the board's per-point group
+// tracking is a single flat array of uint16_t.
 class Stone {
  public:
   Stone() = default;
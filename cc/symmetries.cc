@@ -14,6 +14,16 @@
 
 #include "cc/symmetries.h"
 
+// The AVX2 transform kernels are compiled with per-function target attributes
+// and selected at runtime, following the same pattern as the child action
+// score kernels in mcts_tree.cc.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MG_INTERNAL_HAVE_AVX_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
 namespace minigo {
 namespace symmetry {
 
@@ -101,5 +111,263 @@ Coord ApplySymmetry(Symmetry sym, Coord c) {
 
 Symmetry Concat(Symmetry a, Symmetry b) { return kConcatTable[a][b]; }
 
+namespace internal {
+namespace {
+
+// Every planar transform decomposes into at most two of three primitives:
+// copying rows in reverse order (a memcpy per row), reversing runs of
+// elements, and transposing the plane. The latter two have AVX2 kernels.
+
+template <typename T>
+void CopyRowsReversed(const T* src, T* dst, int n) {
+  for (int j = 0; j < n; ++j) {
+    std::memcpy(dst + j * n, src + (n - 1 - j) * n, n * sizeof(T));
+  }
+}
+
+template <typename T>
+void ReverseScalar(const T* src, T* dst, int len) {
+  for (int i = 0; i < len; ++i) {
+    dst[i] = src[len - 1 - i];
+  }
+}
+
+template <typename T>
+void TransposeScalar(const T* src, T* dst, int n) {
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      dst[i * n + j] = src[j * n + i];
+    }
+  }
+}
+
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+
+__attribute__((target("avx2"))) void ReverseAvx2(const float* src, float* dst,
+                                                 int len) {
+  const __m256i idx = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  int i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + len - 8 - i);
+    _mm256_storeu_ps(dst + i, _mm256_permutevar8x32_ps(v, idx));
+  }
+  for (; i < len; ++i) {
+    dst[i] = src[len - 1 - i];
+  }
+}
+
+__attribute__((target("avx2"))) void ReverseAvx2(const uint8_t* src,
+                                                 uint8_t* dst, int len) {
+  // vpshufb reverses the bytes within each 128 bit lane, then the lanes are
+  // swapped.
+  const __m256i rev = _mm256_setr_epi8(  //
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,  //
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + len - 32 - i));
+    v = _mm256_shuffle_epi8(v, rev);
+    v = _mm256_permute2x128_si256(v, v, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+  }
+  for (; i < len; ++i) {
+    dst[i] = src[len - 1 - i];
+  }
+}
+
+// Transposes an 8x8 block of floats with the usual unpack, shuffle, permute
+// cascade.
+__attribute__((target("avx2"))) void Transpose8x8(const float* src,
+                                                  int src_stride, float* dst,
+                                                  int dst_stride) {
+  __m256 r0 = _mm256_loadu_ps(src + 0 * src_stride);
+  __m256 r1 = _mm256_loadu_ps(src + 1 * src_stride);
+  __m256 r2 = _mm256_loadu_ps(src + 2 * src_stride);
+  __m256 r3 = _mm256_loadu_ps(src + 3 * src_stride);
+  __m256 r4 = _mm256_loadu_ps(src + 4 * src_stride);
+  __m256 r5 = _mm256_loadu_ps(src + 5 * src_stride);
+  __m256 r6 = _mm256_loadu_ps(src + 6 * src_stride);
+  __m256 r7 = _mm256_loadu_ps(src + 7 * src_stride);
+
+  __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+  __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+  __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+  __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+  __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+  __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+  __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+  __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+  __m256 u0 = _mm256_shuffle_ps(t0, t2, 0x44);
+  __m256 u1 = _mm256_shuffle_ps(t0, t2, 0xee);
+  __m256 u2 = _mm256_shuffle_ps(t1, t3, 0x44);
+  __m256 u3 = _mm256_shuffle_ps(t1, t3, 0xee);
+  __m256 u4 = _mm256_shuffle_ps(t4, t6, 0x44);
+  __m256 u5 = _mm256_shuffle_ps(t4, t6, 0xee);
+  __m256 u6 = _mm256_shuffle_ps(t5, t7, 0x44);
+  __m256 u7 = _mm256_shuffle_ps(t5, t7, 0xee);
+
+  _mm256_storeu_ps(dst + 0 * dst_stride, _mm256_permute2f128_ps(u0, u4, 0x20));
+  _mm256_storeu_ps(dst + 1 * dst_stride, _mm256_permute2f128_ps(u1, u5, 0x20));
+  _mm256_storeu_ps(dst + 2 * dst_stride, _mm256_permute2f128_ps(u2, u6, 0x20));
+  _mm256_storeu_ps(dst + 3 * dst_stride, _mm256_permute2f128_ps(u3, u7, 0x20));
+  _mm256_storeu_ps(dst + 4 * dst_stride, _mm256_permute2f128_ps(u0, u4, 0x31));
+  _mm256_storeu_ps(dst + 5 * dst_stride, _mm256_permute2f128_ps(u1, u5, 0x31));
+  _mm256_storeu_ps(dst + 6 * dst_stride, _mm256_permute2f128_ps(u2, u6, 0x31));
+  _mm256_storeu_ps(dst + 7 * dst_stride, _mm256_permute2f128_ps(u3, u7, 0x31));
+}
+
+// Transposes a 16x16 block of bytes: four rounds of interleaving row i with
+// row i + 8 doubles the transposed element width each round, ending with
+// whole rows.
+__attribute__((target("avx2"))) void Transpose16x16(const uint8_t* src,
+                                                    int src_stride,
+                                                    uint8_t* dst,
+                                                    int dst_stride) {
+  __m128i a[16];
+  __m128i b[16];
+  for (int i = 0; i < 16; ++i) {
+    a[i] = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(src + i * src_stride));
+  }
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 8; ++i) {
+      b[2 * i] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+      b[2 * i + 1] = _mm_unpackhi_epi8(a[i], a[i + 8]);
+    }
+    std::memcpy(a, b, sizeof(a));
+  }
+  for (int i = 0; i < 16; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * dst_stride), a[i]);
+  }
+}
+
+template <int kBlock, typename T, typename BlockFn>
+void TransposeBlocked(const T* src, T* dst, int n, BlockFn&& transpose_block) {
+  int nb = n & ~(kBlock - 1);
+  for (int bj = 0; bj < nb; bj += kBlock) {
+    for (int bi = 0; bi < nb; bi += kBlock) {
+      transpose_block(src + bj * n + bi, n, dst + bi * n + bj, n);
+    }
+  }
+  // Scalar loops for the edges that don't fill a whole block.
+  for (int j = nb; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      dst[i * n + j] = src[j * n + i];
+    }
+  }
+  for (int j = 0; j < nb; ++j) {
+    for (int i = nb; i < n; ++i) {
+      dst[i * n + j] = src[j * n + i];
+    }
+  }
+}
+
+__attribute__((target("avx2"))) void TransposeAvx2(const float* src, float* dst,
+                                                   int n) {
+  TransposeBlocked<8>(src, dst, n, Transpose8x8);
+}
+
+__attribute__((target("avx2"))) void TransposeAvx2(const uint8_t* src,
+                                                   uint8_t* dst, int n) {
+  TransposeBlocked<16>(src, dst, n, Transpose16x16);
+}
+
+// Returns true if the CPU supports AVX2.
+bool DetectAvx2() { return __builtin_cpu_supports("avx2") != 0; }
+
+#endif  // MG_INTERNAL_HAVE_AVX_DISPATCH
+
+template <typename T>
+void Reverse(const T* src, T* dst, int len) {
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const bool have_avx2 = DetectAvx2();
+  if (have_avx2) {
+    return ReverseAvx2(src, dst, len);
+  }
+#endif
+  ReverseScalar(src, dst, len);
+}
+
+template <typename T>
+void Transpose(const T* src, T* dst, int n) {
+#ifdef MG_INTERNAL_HAVE_AVX_DISPATCH
+  static const bool have_avx2 = DetectAvx2();
+  if (have_avx2) {
+    return TransposeAvx2(src, dst, n);
+  }
+#endif
+  TransposeScalar(src, dst, n);
+}
+
+template <typename T>
+void ReverseRows(const T* src, T* dst, int n) {
+  for (int j = 0; j < n; ++j) {
+    Reverse(src + j * n, dst + j * n, n);
+  }
+}
+
+template <typename T>
+void ApplySymmetryPlanarImpl(Symmetry sym, const T* src, T* dst, int n,
+                             int num_planes) {
+  MG_DCHECK(dst != src);
+  MG_DCHECK(n <= kN);
+
+  // Scratch plane for the transforms that compose a reversal with a
+  // transpose.
+  T tmp[kN * kN];
+  for (int p = 0; p < num_planes; ++p) {
+    switch (sym) {
+      case kIdentity:
+        std::memcpy(dst, src, n * n * sizeof(T));
+        break;
+      case kRot90:
+        ReverseRows(src, tmp, n);
+        Transpose(tmp, dst, n);
+        break;
+      case kRot180:
+        Reverse(src, dst, n * n);
+        break;
+      case kRot270:
+        CopyRowsReversed(src, tmp, n);
+        Transpose(tmp, dst, n);
+        break;
+      case kFlip:
+        Transpose(src, dst, n);
+        break;
+      case kFlipRot90:
+        CopyRowsReversed(src, dst, n);
+        break;
+      case kFlipRot180:
+        Reverse(src, tmp, n * n);
+        Transpose(tmp, dst, n);
+        break;
+      case kFlipRot270:
+        ReverseRows(src, dst, n);
+        break;
+      default:
+        MG_LOG(FATAL) << static_cast<int>(sym);
+        break;
+    }
+    src += n * n;
+    dst += n * n;
+  }
+}
+
+}  // namespace
+
+void ApplySymmetryPlanar(Symmetry sym, const uint8_t* src, uint8_t* dst, int n,
+                         int num_planes) {
+  ApplySymmetryPlanarImpl(sym, src, dst, n, num_planes);
+}
+
+void ApplySymmetryPlanar(Symmetry sym, const float* src, float* dst, int n,
+                         int num_planes) {
+  ApplySymmetryPlanarImpl(sym, src, dst, n, num_planes);
+}
+
+}  // namespace internal
+
 }  // namespace symmetry
 }  // namespace minigo
@@ -66,6 +66,19 @@ extern const std::array<std::array<Coord, kNumMoves>, kNumSymmetries> kCoords;
 
 inline Symmetry Inverse(Symmetry sym) { return kInverseSymmetries[sym]; }
 
+namespace internal {
+
+// Applies `sym` to `num_planes` planes of `n * n` elements, for the element
+// types used by feature and policy tensors. Implemented in symmetries.cc as
+// compositions of row reversals and blocked transposes that dispatch to AVX2
+// kernels at runtime when the CPU supports them. `n` must be at most kN.
+void ApplySymmetryPlanar(Symmetry sym, const uint8_t* src, uint8_t* dst, int n,
+                         int num_planes);
+void ApplySymmetryPlanar(Symmetry sym, const float* src, float* dst, int n,
+                         int num_planes);
+
+}  // namespace internal
+
 // Identity symmetry is the same for both interleaved (NHWC) and planar (NCHW)
 // data.
 template <int N, int num, typename T>
@@ -173,9 +186,9 @@ inline void FlipRot270Interleaved(const T* src, T* dst) {
   }
 }
 
-// TODO(tommadams): rename ApplySymmetry to ApplySymmetryInterleaved
+// Generic implementation of ApplySymmetry for any element type.
 template <int N, int num_channels, typename T>
-inline void ApplySymmetry(Symmetry sym, const T* src, T* dst) {
+inline void ApplySymmetryGeneric(Symmetry sym, const T* src, T* dst) {
   switch (sym) {
     case kIdentity:
       Identity<N, num_channels>(src, dst);
@@ -207,6 +220,31 @@ inline void ApplySymmetry(Symmetry sym, const T* src, T* dst) {
   }
 }
 
+// TODO(tommadams): rename ApplySymmetry to ApplySymmetryInterleaved
+template <int N, int num_channels, typename T>
+inline void ApplySymmetry(Symmetry sym, const T* src, T* dst) {
+  ApplySymmetryGeneric<N, num_channels>(sym, src, dst);
+}
+
+// Single channel interleaved data is laid out identically to a single plane,
+// so route it through the vectorized planar transforms. This covers undoing
+// the symmetry on every inference's policy output.
+template <int N, int num_channels>
+inline void ApplySymmetry(Symmetry sym, const uint8_t* src, uint8_t* dst) {
+  if (num_channels == 1) {
+    return internal::ApplySymmetryPlanar(sym, src, dst, N, 1);
+  }
+  ApplySymmetryGeneric<N, num_channels>(sym, src, dst);
+}
+
+template <int N, int num_channels>
+inline void ApplySymmetry(Symmetry sym, const float* src, float* dst) {
+  if (num_channels == 1) {
+    return internal::ApplySymmetryPlanar(sym, src, dst, N, 1);
+  }
+  ApplySymmetryGeneric<N, num_channels>(sym, src, dst);
+}
+
 // Symmetries for planar tensors (NCHW).
 template <int N, int num_planes, typename T>
 inline void Rot90Planar(const T* src, T* dst) {
@@ -313,8 +351,9 @@ inline void FlipRot270Planar(const T* src, T* dst) {
   }
 }
 
+// Generic implementation of ApplySymmetryPlanar for any element type.
 template <int N, int num_planes, typename T>
-inline void ApplySymmetryPlanar(Symmetry sym, const T* src, T* dst) {
+inline void ApplySymmetryPlanarGeneric(Symmetry sym, const T* src, T* dst) {
   switch (sym) {
     case kIdentity:
       Identity<N, num_planes>(src, dst);
@@ -346,6 +385,22 @@ inline void ApplySymmetryPlanar(Symmetry sym, const T* src, T* dst) {
   }
 }
 
+template <int N, int num_planes, typename T>
+inline void ApplySymmetryPlanar(Symmetry sym, const T* src, T* dst) {
+  ApplySymmetryPlanarGeneric<N, num_planes>(sym, src, dst);
+}
+
+template <int N, int num_planes>
+inline void ApplySymmetryPlanar(Symmetry sym, const uint8_t* src,
+                                uint8_t* dst) {
+  internal::ApplySymmetryPlanar(sym, src, dst, N, num_planes);
+}
+
+template <int N, int num_planes>
+inline void ApplySymmetryPlanar(Symmetry sym, const float* src, float* dst) {
+  internal::ApplySymmetryPlanar(sym, src, dst, N, num_planes);
+}
+
 Coord ApplySymmetry(Symmetry sym, Coord c);
 
 // Returns the Symmetry obtained by first applying a then b.
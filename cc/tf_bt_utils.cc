@@ -12,12 +12,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
 #include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <utility>
 
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "cc/async/thread.h"
 #include "cc/constants.h"
 #include "cc/tf_utils.h"
 #include "google/cloud/bigtable/data_client.h"
@@ -49,11 +57,170 @@ const char kGameRowFormat[] = "g_%010d";
 const char kEvalGameRowFormat[] = "e_%010d";
 const char kPrefixAndMoveFormat[] = "%s_m_%03d";
 
+namespace {
+
+// Accumulates row mutations across games and applies them to a table from
+// background threads in large BulkApply batches, so that callers like the
+// selfplay OutputThread don't block on Bigtable RPCs for every game.
+// The number of buffered and in-flight rows is bounded: Add blocks once the
+// bound is reached, applying back-pressure instead of growing without limit
+// if Bigtable can't keep up.
+class BulkMutator {
+ public:
+  // Large enough to amortize the per-RPC overhead while staying well below
+  // Bigtable's 100,000 mutation cap for a single BulkApply (each row written
+  // only holds a few mutations).
+  static constexpr size_t kFlushBatchRows = 2048;
+
+  // Bound on the number of buffered plus in-flight rows.
+  static constexpr size_t kMaxPendingRows = 32768;
+
+  // Number of concurrent BulkApply RPCs.
+  static constexpr int kNumFlushThreads = 4;
+
+  BulkMutator(const std::string& gcp_project_name,
+              const std::string& instance_name, const std::string& table_name)
+      : gcp_project_name_(gcp_project_name),
+        instance_name_(instance_name),
+        table_name_(table_name) {
+    for (int i = 0; i < kNumFlushThreads; ++i) {
+      flush_threads_.push_back(
+          absl::make_unique<LambdaThread>([this]() { FlushLoop(); }));
+      flush_threads_.back()->Start();
+    }
+  }
+
+  // The mutators returned by Get are never destroyed: games keep arriving
+  // until the process exits and exit paths call Flush explicitly.
+
+  // Returns the shared mutator for the given table, creating it on first use.
+  static BulkMutator* Get(const std::string& gcp_project_name,
+                          const std::string& instance_name,
+                          const std::string& table_name) {
+    static auto* mutex = new absl::Mutex();
+    static auto* mutators =
+        new std::map<std::string, std::unique_ptr<BulkMutator>>();
+    auto key = absl::StrCat(gcp_project_name, "/", instance_name, "/",
+                            table_name);
+    absl::MutexLock lock(mutex);
+    auto& mutator = (*mutators)[key];
+    if (mutator == nullptr) {
+      mutator = absl::make_unique<BulkMutator>(gcp_project_name, instance_name,
+                                               table_name);
+    }
+    return mutator.get();
+  }
+
+  // Queues the mutations of `row` for writing.
+  // Blocks if kMaxPendingRows rows are already pending.
+  void Add(SingleRowMutation row) {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(this, &BulkMutator::has_capacity));
+    num_pending_rows_ += 1;
+    queue_.push_back(std::move(row));
+  }
+
+  // Blocks until every row queued so far has been applied.
+  void Flush() {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(this, &BulkMutator::nothing_pending));
+  }
+
+ private:
+  bool has_capacity() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return num_pending_rows_ < kMaxPendingRows;
+  }
+
+  bool nothing_pending() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return num_pending_rows_ == 0;
+  }
+
+  bool has_queued_rows() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return !queue_.empty();
+  }
+
+  void FlushLoop() {
+    // Each flush thread gets its own Table (and so its own gRPC channel).
+    // Mutation batches are retried with exponential backoff on transient
+    // errors. AlwaysRetryMutationPolicy is safe here because every cell we
+    // write is only ever written with one value, so replaying a mutation
+    // whose first attempt actually succeeded is a no-op.
+    auto client_options = ClientOptions();
+    auto channel_args = client_options.channel_arguments();
+    channel_args.SetUserAgentPrefix("minigo_bulk_mutator");
+    channel_args.SetInt(GRPC_ARG_ENABLE_CENSUS, 0);
+    channel_args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 0);
+    channel_args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, 60 * 1000);
+    client_options.set_channel_arguments(channel_args);
+    Table table(CreateDefaultDataClient(gcp_project_name_, instance_name_,
+                                        client_options),
+                table_name_,
+                google::cloud::bigtable::AlwaysRetryMutationPolicy(),
+                google::cloud::bigtable::LimitedTimeRetryPolicy(
+                    std::chrono::minutes(5)),
+                google::cloud::bigtable::ExponentialBackoffPolicy(
+                    std::chrono::milliseconds(100), std::chrono::seconds(10)));
+
+    for (;;) {
+      BulkMutation batch;
+      size_t batch_rows = 0;
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(this, &BulkMutator::has_queued_rows));
+        while (!queue_.empty() && batch_rows < kFlushBatchRows) {
+          batch.emplace_back(std::move(queue_.front()));
+          queue_.pop_front();
+          batch_rows += 1;
+        }
+      }
+
+      table.BulkApply(std::move(batch));
+
+      {
+        absl::MutexLock lock(&mutex_);
+        num_pending_rows_ -= batch_rows;
+      }
+    }
+  }
+
+  const std::string gcp_project_name_;
+  const std::string instance_name_;
+  const std::string table_name_;
+
+  absl::Mutex mutex_;
+  std::deque<SingleRowMutation> queue_ GUARDED_BY(&mutex_);
+
+  // Number of rows that are either queued or part of an in-flight BulkApply.
+  size_t num_pending_rows_ GUARDED_BY(&mutex_) = 0;
+
+  std::vector<std::unique_ptr<LambdaThread>> flush_threads_;
+};
+
+constexpr size_t BulkMutator::kFlushBatchRows;
+constexpr size_t BulkMutator::kMaxPendingRows;
+constexpr int BulkMutator::kNumFlushThreads;
+
+}  // namespace
+
 // Fetches the tensorflow Examples from a MctsPlayer.
 // Linked from tf_utils.cc
 // TODO(tommadams): Move this declaration into a header file.
 std::vector<tensorflow::Example> MakeExamples(const Game& game);
 
+void UpdateMoveCountForGame(BulkMutator* mutator,
+                            const std::string& game_prefix, int move_count) {
+  auto zero_row = absl::StrFormat(kPrefixAndMoveFormat, game_prefix, 0);
+  auto move_count_str = absl::StrCat(move_count);
+  auto count_row =
+      absl::StrCat("ct_", game_prefix.substr(2), "_", move_count_str);
+  SingleRowMutation zero_row_mut(zero_row);
+  zero_row_mut.emplace_back(SetCell("metadata", "move_count", move_count_str));
+  mutator->Add(std::move(zero_row_mut));
+  SingleRowMutation count_row_mut(count_row);
+  count_row_mut.emplace_back(SetCell("metadata", "move_count", move_count_str));
+  mutator->Add(std::move(count_row_mut));
+}
+
 void UpdateMoveCountForGame(BulkMutation& game_batch,
                             const std::string& game_prefix, int move_count) {
   auto zero_row = absl::StrFormat(kPrefixAndMoveFormat, game_prefix, 0);
@@ -68,10 +235,10 @@ void UpdateMoveCountForGame(BulkMutation& game_batch,
   game_batch.emplace_back(std::move(count_row_mut));
 }
 
-// Writes a list of tensorflow Example protos to a series of Bigtable rows.
-void WriteTfExamples(Table& table, const std::string& row_prefix,
+// Queues a list of tensorflow Example protos for writing to a series of
+// Bigtable rows.
+void WriteTfExamples(BulkMutator* mutator, const std::string& row_prefix,
                      const std::vector<tensorflow::Example>& examples) {
-  BulkMutation game_batch;
   int move_number = 0;
   for (const auto& example : examples) {
     std::string data;
@@ -82,11 +249,10 @@ void WriteTfExamples(Table& table, const std::string& row_prefix,
     row_mutation.emplace_back(SetCell("tfexample", "example", data));
     row_mutation.emplace_back(
         SetCell("metadata", "move", std::to_string(move_number)));
-    game_batch.emplace_back(std::move(row_mutation));
+    mutator->Add(std::move(row_mutation));
     move_number++;
   }
-  UpdateMoveCountForGame(game_batch, row_prefix, move_number);
-  table.BulkApply(std::move(game_batch));
+  UpdateMoveCountForGame(mutator, row_prefix, move_number);
 }
 
 void WriteGameExamples(const std::string& gcp_project_name,
@@ -94,16 +260,16 @@ void WriteGameExamples(const std::string& gcp_project_name,
                        const std::string& table_name,
                        Model::FeatureType feature_type, const Game& game) {
   auto examples = MakeExamples(feature_type, game);
-  Table table(
-      CreateDefaultDataClient(gcp_project_name, instance_name, ClientOptions()),
-      table_name);
   // This will be everything from a single game, so retrieve the game
   // counter from the Bigtable and increment it atomically.
   uint64_t game_counter = IncrementGameCounter(gcp_project_name, instance_name,
                                                table_name, "game_counter", 1);
 
+  // The game's rows are only queued here: the shared mutator batches rows
+  // across games and applies them in bulk from its own threads.
+  auto* mutator = BulkMutator::Get(gcp_project_name, instance_name, table_name);
   auto row_prefix = absl::StrFormat(kGameRowFormat, game_counter);
-  WriteTfExamples(table, row_prefix, examples);
+  WriteTfExamples(mutator, row_prefix, examples);
   int bleakest_move = 0;
   float bleakest_q = 0.0;
   if (game.FindBleakestMove(&bleakest_move, &bleakest_q)) {
@@ -112,13 +278,19 @@ void WriteGameExamples(const std::string& gcp_project_name,
     SingleRowMutation row_mutation(bleak_row_name);
     row_mutation.emplace_back(
         SetCell("metadata", "bleakest_q", absl::StrCat(bleakest_q)));
-    table.Apply(std::move(row_mutation));
+    mutator->Add(std::move(row_mutation));
   }
 
-  MG_LOG(INFO) << "Bigtable rows written to prefix " << row_prefix << " : "
+  MG_LOG(INFO) << "Bigtable rows queued for prefix " << row_prefix << " : "
                << examples.size();
 }
 
+void FlushGameExamples(const std::string& gcp_project_name,
+                       const std::string& instance_name,
+                       const std::string& table_name) {
+  BulkMutator::Get(gcp_project_name, instance_name, table_name)->Flush();
+}
+
 void WriteEvalRecord(const std::string& gcp_project_name,
                      const std::string& instance_name,
                      const std::string& table_name, const Game& game,
@@ -172,17 +344,6 @@ void PortGamesToBigtable(const std::string& gcp_project_name,
                          const std::string& table_name,
                          const std::vector<std::string>& paths,
                          int64_t game_counter) {
-  auto client_options = ClientOptions();
-  auto channel_args = client_options.channel_arguments();
-  channel_args.SetUserAgentPrefix("minigo_to_cbt");
-  channel_args.SetInt(GRPC_ARG_ENABLE_CENSUS, 0);
-  channel_args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 0);
-  channel_args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, 60 * 1000);
-  client_options.set_channel_arguments(channel_args);
-  Table table(
-      CreateDefaultDataClient(gcp_project_name, instance_name, client_options),
-      table_name);
-
   if (game_counter < 0) {
     if (paths.size() != 1) {
       MG_LOG(FATAL) << "Atomic game updates require batch size of 1 game";
@@ -192,51 +353,90 @@ void PortGamesToBigtable(const std::string& gcp_project_name,
     return;
   }
 
-  BulkMutation game_batch;
+  // Pair each file with the game counter its rows are keyed by up front, so
+  // the files can be converted in any order.
+  std::deque<std::pair<std::string, int64_t>> work;
+  for (const auto& path : paths) {
+    work.emplace_back(path, game_counter);
+    game_counter++;
+  }
+
+  // The files are decompressed and parsed by a pool of reader threads that
+  // queue rows on the shared bulk mutator, which applies them from its own
+  // threads, pipelining file reads with Bigtable RPCs.
+  constexpr int kNumReadThreads = 8;
+  auto* mutator = BulkMutator::Get(gcp_project_name, instance_name, table_name);
+
+  absl::Mutex mutex;
   auto start_time = absl::Now();
   int changes = 0;
-  for (const auto& path : paths) {
-    std::unique_ptr<tensorflow::RandomAccessFile> file;
-    TF_CHECK_OK(tensorflow::Env::Default()->NewRandomAccessFile(path, &file));
+  std::vector<std::unique_ptr<LambdaThread>> threads;
+  for (int i = 0; i < kNumReadThreads; ++i) {
+    threads.push_back(absl::make_unique<LambdaThread>([&]() {
+      for (;;) {
+        std::string path;
+        int64_t counter;
+        {
+          absl::MutexLock lock(&mutex);
+          if (work.empty()) {
+            return;
+          }
+          path = std::move(work.front().first);
+          counter = work.front().second;
+          work.pop_front();
+        }
 
-    RecordReaderOptions options;
-    options.compression_type = RecordReaderOptions::ZLIB_COMPRESSION;
-    SequentialRecordReader reader(file.get(), options);
+        std::unique_ptr<tensorflow::RandomAccessFile> file;
+        TF_CHECK_OK(
+            tensorflow::Env::Default()->NewRandomAccessFile(path, &file));
 
-    auto row_prefix = absl::StrFormat(kGameRowFormat, game_counter);
+        RecordReaderOptions options;
+        options.compression_type = RecordReaderOptions::ZLIB_COMPRESSION;
+        SequentialRecordReader reader(file.get(), options);
 
-    // Transforms something like:
-    //     gs://minigo/data/play/2018-10-14-13/1539522000-8x7lb.tfrecord.zz
-    // into:
-    //     2018-10-14-13-1539522000-8x7lb
-    auto game_id = path;
-    game_id.erase(game_id.rfind(".tfrecord.zz"));
-    game_id[game_id.rfind('/')] = '-';
-    game_id.erase(0, game_id.rfind('/') + 1);
+        auto row_prefix = absl::StrFormat(kGameRowFormat, counter);
 
-    auto zero_row = absl::StrFormat(kPrefixAndMoveFormat, row_prefix, 0);
-    SingleRowMutation zero_row_mutation(zero_row);
-    zero_row_mutation.emplace_back(SetCell("metadata", "game_id", game_id));
-    game_batch.emplace_back(std::move(zero_row_mutation));
+        // Transforms something like:
+        //     gs://minigo/data/play/2018-10-14-13/1539522000-8x7lb.tfrecord.zz
+        // into:
+        //     2018-10-14-13-1539522000-8x7lb
+        auto game_id = path;
+        game_id.erase(game_id.rfind(".tfrecord.zz"));
+        game_id[game_id.rfind('/')] = '-';
+        game_id.erase(0, game_id.rfind('/') + 1);
 
-    std::string data;
-    int move_number = 0;
-    while (reader.ReadRecord(&data).ok()) {
-      auto row_name =
-          absl::StrFormat(kPrefixAndMoveFormat, row_prefix, move_number);
-      SingleRowMutation row_mutation(row_name);
-      row_mutation.emplace_back(SetCell("tfexample", "example", data));
-      row_mutation.emplace_back(
-          SetCell("metadata", "move", std::to_string(move_number)));
-      game_batch.emplace_back(std::move(row_mutation));
-      move_number++;
-      changes++;
-    }
-    UpdateMoveCountForGame(game_batch, row_prefix, move_number);
-    game_counter++;
+        auto zero_row = absl::StrFormat(kPrefixAndMoveFormat, row_prefix, 0);
+        SingleRowMutation zero_row_mutation(zero_row);
+        zero_row_mutation.emplace_back(SetCell("metadata", "game_id", game_id));
+        mutator->Add(std::move(zero_row_mutation));
+
+        std::string data;
+        int move_number = 0;
+        while (reader.ReadRecord(&data).ok()) {
+          auto row_name =
+              absl::StrFormat(kPrefixAndMoveFormat, row_prefix, move_number);
+          SingleRowMutation row_mutation(row_name);
+          row_mutation.emplace_back(SetCell("tfexample", "example", data));
+          row_mutation.emplace_back(
+              SetCell("metadata", "move", std::to_string(move_number)));
+          mutator->Add(std::move(row_mutation));
+          move_number++;
+        }
+        UpdateMoveCountForGame(mutator, row_prefix, move_number);
+
+        {
+          absl::MutexLock lock(&mutex);
+          changes += move_number;
+        }
+      }
+    }));
+    threads.back()->Start();
+  }
+  for (auto& t : threads) {
+    t->Join();
   }
+  mutator->Flush();
 
-  table.BulkApply(std::move(game_batch));
   auto finish_time = absl::Now();
   double elapsed = absl::ToDoubleSeconds(finish_time - start_time);
   VLOG(2) << "Total changes: " << changes << " at " << changes / elapsed
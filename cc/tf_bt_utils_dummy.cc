@@ -29,6 +29,15 @@ void WriteGameExamples(const std::string& gcp_project_name,
          "Please recompile, passing --define=bt=1 to bazel build.";
 }
 
+void FlushGameExamples(const std::string& gcp_project_name,
+                       const std::string& instance_name,
+                       const std::string& table_name) {
+  MG_LOG(FATAL)
+      << "Can't flush TensorFlow examples to Bigtable without Bigtable "
+         "support enabled. "
+         "Please recompile, passing --define=bt=1 to bazel build.";
+}
+
 void WriteEvalRecord(const std::string& gcp_project_name,
                      const std::string& instance_name,
                      const std::string& table_name, const Game& game,
@@ -17,7 +17,11 @@
 #include <algorithm>
 #include <array>
 #include <memory>
+#include <utility>
 
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
 #include "cc/constants.h"
 #include "cc/file/path.h"
 #include "cc/file/utils.h"
@@ -27,6 +31,7 @@
 #include "tensorflow/core/lib/io/record_writer.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/protobuf.h"
 
 using tensorflow::io::RecordWriter;
 using tensorflow::io::RecordWriterOptions;
@@ -36,35 +41,50 @@ namespace tf_utils {
 
 namespace {
 
-tensorflow::Feature MakeBytesFeature(const Tensor<uint8_t>& src) {
+// A game's worth of Example protos and the arena they're allocated on.
+// Building the protos on an arena turns the tens of small string and
+// repeated field allocations each example would otherwise make into bumps
+// of the arena pointer, and frees them all at once when the batch is
+// destroyed. `scratch` is reused for every example's serialized bytes when
+// the batch is written out.
+struct ExampleBatch {
+  tensorflow::protobuf::Arena arena;
+  std::vector<const tensorflow::Example*> examples;
+  std::string scratch;
+};
+
+void SetBytesFeature(const Tensor<uint8_t>& src, tensorflow::Feature* dst) {
   int size = src.shape.num_elements();
-  tensorflow::Feature feature;
-  feature.mutable_bytes_list()->add_value(
-      reinterpret_cast<const void*>(src.data), size);
-  return feature;
+  dst->mutable_bytes_list()->add_value(reinterpret_cast<const void*>(src.data),
+                                       size);
 }
 
-template <size_t N>
-tensorflow::Feature MakeBytesFeature(const std::array<float, N>& data) {
-  tensorflow::Feature feature;
-  feature.mutable_bytes_list()->add_value(
-      reinterpret_cast<const void*>(data.data()), sizeof(float) * data.size());
-  return feature;
+void SetBytesFeature(const void* data, size_t size, tensorflow::Feature* dst) {
+  dst->mutable_bytes_list()->add_value(data, size);
 }
 
 // Converts board features, and the pi & value outputs of MTCS to a tensorflow
-// example proto.
-tensorflow::Example MakeTfExample(const Tensor<uint8_t>& features,
-                                  const std::array<float, kNumMoves>& pi,
-                                  float Q, int N, Coord c, float outcome) {
-  tensorflow::Example example;
-  auto& dst_features = *example.mutable_features()->mutable_feature();
+// example proto, filled in place so it (and everything it allocates) stays on
+// its batch's arena.
+void MakeTfExample(const Tensor<uint8_t>& features, const SparsePi& pi,
+                   float Q, int N, Coord c, float outcome,
+                   tensorflow::Example* example) {
+  auto& dst_features = *example->mutable_features()->mutable_feature();
 
   // The input features are expected to be uint8 bytes.
-  dst_features["x"] = MakeBytesFeature(features);
+  SetBytesFeature(features, &dst_features["x"]);
 
-  // pi is expected to be a float array serialized as bytes.
-  dst_features["pi"] = MakeBytesFeature(pi);
+  // pi is stored sparsely as slices of SparsePi's packed encoding: the
+  // visited moves' coordinates (uint16, padded with kPaddingCoord), their
+  // probabilities (float, padded with zero) and the dropped probability
+  // mass. preprocessing.py scatters them back into a dense policy.
+  char packed[SparsePi::kPackedSize];
+  pi.Pack(packed);
+  constexpr size_t kCoordBytes = SparsePi::kMaxEntries * sizeof(uint16_t);
+  constexpr size_t kProbBytes = SparsePi::kMaxEntries * sizeof(float);
+  SetBytesFeature(packed, kCoordBytes, &dst_features["pi_idx"]);
+  SetBytesFeature(packed + kCoordBytes, kProbBytes, &dst_features["pi_val"]);
+  dst_features["pi_remainder"].mutable_float_list()->add_value(pi.remainder());
 
   // outcome is a single float.
   dst_features["outcome"].mutable_float_list()->add_value(outcome);
@@ -77,39 +97,77 @@ tensorflow::Example MakeTfExample(const Tensor<uint8_t>& features,
 
   // The move played is a single int.
   dst_features["c"].mutable_int64_list()->add_value(c);
-
-  return example;
 }
 
-// Writes a list of tensorflow Example protos to a zlib compressed TFRecord
-// file.
-void WriteTfExamples(const std::string& path,
-                     const std::vector<tensorflow::Example>& examples) {
-  std::unique_ptr<tensorflow::WritableFile> file;
-  TF_CHECK_OK(tensorflow::Env::Default()->NewWritableFile(path, &file));
+// A WritableFile that appends to a std::string, so a TFRecord file can be
+// serialized in memory.
+class StringWritableFile : public tensorflow::WritableFile {
+ public:
+  explicit StringWritableFile(std::string* str) : str_(str) {}
+
+  tensorflow::Status Append(tensorflow::StringPiece data) override {
+    str_->append(data.data(), data.size());
+    return tensorflow::Status::OK();
+  }
 
+  tensorflow::Status Close() override { return tensorflow::Status::OK(); }
+  tensorflow::Status Flush() override { return tensorflow::Status::OK(); }
+  tensorflow::Status Sync() override { return tensorflow::Status::OK(); }
+
+ private:
+  std::string* str_;
+};
+
+RecordWriterOptions ZlibRecordWriterOptions() {
   RecordWriterOptions options;
   options.compression_type = RecordWriterOptions::ZLIB_COMPRESSION;
   options.zlib_options.compression_level = 2;
-  RecordWriter writer(file.get(), options);
+  return options;
+}
 
-  std::string data;
-  for (const auto& example : examples) {
-    example.SerializeToString(&data);
-    TF_CHECK_OK(writer.WriteRecord(data));
+// Returns the summed serialized size of the batch's examples, which also
+// caches each message's byte size for the subsequent serialization pass.
+size_t EstimateSerializedSize(const ExampleBatch& batch) {
+  size_t size = 0;
+  for (const auto* example : batch.examples) {
+    size += example->ByteSizeLong();
+  }
+  return size;
+}
+
+// Serializes a batch of Example protos as the contents of a zlib compressed
+// TFRecord file. Each example is serialized into the batch's reused scratch
+// buffer; the output string is sized up front from the summed byte sizes so
+// it doesn't repeatedly regrow while the records are appended.
+std::string SerializeTfExamples(ExampleBatch* batch) {
+  std::string contents;
+  // Assume compression shrinks the examples by at least half.
+  contents.reserve(EstimateSerializedSize(*batch) / 2);
+  StringWritableFile file(&contents);
+  RecordWriter writer(&file, ZlibRecordWriterOptions());
+
+  for (const auto* example : batch->examples) {
+    example->SerializeToString(&batch->scratch);
+    TF_CHECK_OK(writer.WriteRecord(batch->scratch));
   }
 
   TF_CHECK_OK(writer.Close());
-  TF_CHECK_OK(file->Close());
+  return contents;
 }
 
-}  // namespace
+// Writes a batch of Example protos to a zlib compressed TFRecord file.
+void WriteTfExamples(const std::string& path, ExampleBatch* batch) {
+  std::unique_ptr<tensorflow::WritableFile> file;
+  TF_CHECK_OK(tensorflow::Env::Default()->NewWritableFile(path, &file));
+  TF_CHECK_OK(file->Append(SerializeTfExamples(batch)));
+  TF_CHECK_OK(file->Close());
+}
 
-std::vector<tensorflow::Example> MakeExamples(
+std::shared_ptr<ExampleBatch> MakeExamples(
     const FeatureDescriptor& feature_desc, const Game& game) {
   // Write the TensorFlow examples.
-  std::vector<tensorflow::Example> examples;
-  examples.reserve(game.num_moves());
+  auto batch = std::make_shared<ExampleBatch>();
+  batch->examples.reserve(game.num_moves());
 
   auto shape = feature_desc.GetInputShape(1);
   BoardFeatureBuffer<uint8_t> features_buffer;
@@ -123,13 +181,88 @@ std::vector<tensorflow::Example> MakeExamples(
 
     ModelInput input;
     input.sym = symmetry::kIdentity;
-    game.GetPositionHistory(i, kMaxPositionHistory, &input.position_history);
+    input.position = &move->position;
+    game.GetStoneHistory(i, kMaxPositionHistory, &input.stone_history);
 
     feature_desc.set_bytes({&input}, &features);
-    examples.push_back(MakeTfExample(features, move->search_pi.value(), move->Q,
-                                     move->N, move->c, game.result()));
+    auto* example =
+        tensorflow::protobuf::Arena::CreateMessage<tensorflow::Example>(
+            &batch->arena);
+    MakeTfExample(features, move->search_pi.value(), move->Q, move->N, move->c,
+                  game.result(), example);
+    batch->examples.push_back(example);
   }
-  return examples;
+  return batch;
+}
+
+}  // namespace
+
+namespace internal {
+
+// The TF half of ShardedExampleWriter, kept out of the header so tf_utils.h
+// doesn't pull in TensorFlow (tf_utils_dummy.cc provides an empty stand-in).
+// The RecordWriter compresses into the ShardedExampleWriter's `contents_`
+// string via a StringWritableFile.
+struct ShardedExampleWriterImpl {
+  explicit ShardedExampleWriterImpl(std::string* contents)
+      : file(contents), writer(&file, ZlibRecordWriterOptions()) {}
+
+  StringWritableFile file;
+  RecordWriter writer;
+};
+
+}  // namespace internal
+
+ShardedExampleWriter::ShardedExampleWriter(std::string stem,
+                                           size_t max_shard_bytes,
+                                           absl::Duration max_shard_age,
+                                           file::AsyncWriter* writer)
+    : stem_(std::move(stem)),
+      max_shard_bytes_(max_shard_bytes),
+      max_shard_age_(max_shard_age),
+      writer_(writer) {}
+
+ShardedExampleWriter::~ShardedExampleWriter() { Flush(); }
+
+void ShardedExampleWriter::Write(const std::string& output_dir,
+                                 const FeatureDescriptor& feature_desc,
+                                 const Game& game) {
+  auto now = absl::Now();
+  if (impl_ != nullptr &&
+      (output_dir != output_dir_ || contents_.size() >= max_shard_bytes_ ||
+       now - shard_start_ >= max_shard_age_)) {
+    Flush();
+  }
+  if (impl_ == nullptr) {
+    output_dir_ = output_dir;
+    shard_start_ = now;
+    impl_ = absl::make_unique<internal::ShardedExampleWriterImpl>(&contents_);
+  }
+
+  auto batch = MakeExamples(feature_desc, game);
+  for (const auto* example : batch->examples) {
+    example->SerializeToString(&batch->scratch);
+    TF_CHECK_OK(impl_->writer.WriteRecord(batch->scratch));
+  }
+
+  // Flush the compressor after each game so that `contents_` reflects the
+  // shard's real compressed size for the rotation check above. This costs a
+  // little compression ratio but keeps shard boundaries game-aligned.
+  TF_CHECK_OK(impl_->writer.Flush());
+}
+
+void ShardedExampleWriter::Flush() {
+  if (impl_ == nullptr) {
+    return;
+  }
+  TF_CHECK_OK(impl_->writer.Close());
+  impl_ = nullptr;
+
+  auto path = file::JoinPath(
+      output_dir_,
+      absl::StrFormat("%s-%05d.tfrecord.zz", stem_, shard_num_++));
+  writer_->WriteFile(std::move(path), std::move(contents_));
+  contents_.clear();
 }
 
 void WriteGameExamples(const std::string& output_dir,
@@ -139,8 +272,25 @@ void WriteGameExamples(const std::string& output_dir,
   MG_CHECK(file::RecursivelyCreateDir(output_dir));
   auto output_path = file::JoinPath(output_dir, output_name + ".tfrecord.zz");
 
-  auto examples = MakeExamples(feature_desc, game);
-  WriteTfExamples(output_path, examples);
+  auto batch = MakeExamples(feature_desc, game);
+  WriteTfExamples(output_path, batch.get());
+}
+
+void WriteGameExamples(const std::string& output_dir,
+                       const std::string& output_name,
+                       const FeatureDescriptor& feature_desc, const Game& game,
+                       file::AsyncWriter* writer) {
+  auto output_path = file::JoinPath(output_dir, output_name + ".tfrecord.zz");
+
+  // The examples are built here because they borrow from `game`, which
+  // doesn't outlive the call. Serializing and compressing them is by far the
+  // most expensive part of writing a game out though, so that is deferred to
+  // the writer pool, where it runs in parallel across queued games.
+  auto batch = MakeExamples(feature_desc, game);
+
+  auto estimated_size = EstimateSerializedSize(*batch) / 2;
+  writer->WriteFile(output_path, estimated_size,
+                    [batch]() { return SerializeTfExamples(batch.get()); });
 }
 
 }  // namespace tf_utils
@@ -15,9 +15,12 @@
 #ifndef CC_TF_UTILS_H_
 #define CC_TF_UTILS_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/time/time.h"
+#include "cc/file/async_writer.h"
 #include "cc/game.h"
 #include "cc/model/features.h"
 
@@ -35,6 +38,73 @@ void WriteGameExamples(const std::string& output_dir,
                        const std::string& output_name,
                        const FeatureDescriptor& feature_desc, const Game& game);
 
+// Like the above, but serializes, compresses and writes the TFRecord file on
+// `writer`'s thread pool, so the caller neither burns CPU on compression nor
+// blocks on slow filesystems like GCS.
+// CHECK fails if the binary was not compiled with --define=tf=1.
+void WriteGameExamples(const std::string& output_dir,
+                       const std::string& output_name,
+                       const FeatureDescriptor& feature_desc, const Game& game,
+                       file::AsyncWriter* writer);
+
+namespace internal {
+struct ShardedExampleWriterImpl;
+}  // namespace internal
+
+// Appends many games' examples into large rotating TFRecord shards instead
+// of writing one tiny file per game. At fleet scale the per-game files
+// number in the millions, which makes bucket listing and training input
+// reads slow; a shard holds on the order of a hundred games, so it cuts the
+// object count by the same factor.
+//
+// Each shard is compressed into memory as games arrive and queued on the
+// async writer as a single whole-file write when it's finalized, so shards
+// work on filesystems without append support (e.g. GCS). Shards are named
+// `<stem>-NNNNN.tfrecord.zz`, which the training pipeline and sample_records
+// pick up with the same globs as the per-game files.
+//
+// Not thread safe: each output thread should own its own writer with a
+// unique stem.
+class ShardedExampleWriter {
+ public:
+  // `stem` prefixes every shard's filename and must be unique across all
+  // workers writing to the same directory (see GetOutputName). The open
+  // shard is finalized and handed to `writer` when its compressed size
+  // reaches `max_shard_bytes`, when it has been open for `max_shard_age`,
+  // or when a game arrives for a different output directory.
+  ShardedExampleWriter(std::string stem, size_t max_shard_bytes,
+                       absl::Duration max_shard_age,
+                       file::AsyncWriter* writer);
+
+  // Finalizes the open shard.
+  ~ShardedExampleWriter();
+
+  // Appends `game`'s examples to the current shard, rotating first if the
+  // shard is full, too old, or was started under a different `output_dir`.
+  // Rotation is only checked here, so an idle writer holds its last few
+  // games until the next call or destruction.
+  // CHECK fails if the binary was not compiled with --define=tf=1.
+  void Write(const std::string& output_dir,
+             const FeatureDescriptor& feature_desc, const Game& game);
+
+  // Finalizes the open shard (if any) and queues it on the async writer.
+  void Flush();
+
+ private:
+  const std::string stem_;
+  const size_t max_shard_bytes_;
+  const absl::Duration max_shard_age_;
+  file::AsyncWriter* writer_;
+
+  int shard_num_ = 0;
+  std::string output_dir_;
+  absl::Time shard_start_ = absl::InfinitePast();
+  // The open shard's compressed contents. The impl's RecordWriter appends
+  // to this; Flush moves it out to the async writer.
+  std::string contents_;
+  std::unique_ptr<internal::ShardedExampleWriterImpl> impl_;
+};
+
 // Writes a list of tensorflow Example protos to the specified
 // Bigtable, one example per row, starting at the given row cursor.
 void WriteGameExamples(const std::string& gcp_project_name,
@@ -42,6 +112,14 @@ void WriteGameExamples(const std::string& gcp_project_name,
                        const std::string& table_name,
                        const FeatureDescriptor& feature_desc, const Game& game);
 
+// Blocks until every game example queued for the specified Bigtable by the
+// function above has been applied. The Bigtable flavor of WriteGameExamples
+// only queues its rows on a shared bulk mutator, so callers must flush before
+// exiting.
+void FlushGameExamples(const std::string& gcp_project_name,
+                       const std::string& instance_name,
+                       const std::string& table_name);
+
 // Writes information about an eval game to the specified Bigtable.
 void WriteEvalRecord(const std::string& gcp_project_name,
                      const std::string& instance_name,
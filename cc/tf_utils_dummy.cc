@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <utility>
+
 #include "cc/logging.h"
 #include "cc/tf_utils.h"
 
@@ -27,5 +29,41 @@ void WriteGameExamples(const std::string& output_dir,
          "Please recompile, passing --define=tf=1 to bazel build.";
 }
 
+void WriteGameExamples(const std::string& output_dir,
+                       const std::string& output_name,
+                       const FeatureDescriptor& feature_desc, const Game& game,
+                       file::AsyncWriter* writer) {
+  MG_LOG(FATAL)
+      << "Can't write TensorFlow examples without TensorFlow support enabled. "
+         "Please recompile, passing --define=tf=1 to bazel build.";
+}
+
+namespace internal {
+// Empty stand-in for the TF-backed impl so the unique_ptr's deleter can be
+// instantiated without TensorFlow.
+struct ShardedExampleWriterImpl {};
+}  // namespace internal
+
+ShardedExampleWriter::ShardedExampleWriter(std::string stem,
+                                           size_t max_shard_bytes,
+                                           absl::Duration max_shard_age,
+                                           file::AsyncWriter* writer)
+    : stem_(std::move(stem)),
+      max_shard_bytes_(max_shard_bytes),
+      max_shard_age_(max_shard_age),
+      writer_(writer) {}
+
+ShardedExampleWriter::~ShardedExampleWriter() = default;
+
+void ShardedExampleWriter::Write(const std::string& output_dir,
+                                 const FeatureDescriptor& feature_desc,
+                                 const Game& game) {
+  MG_LOG(FATAL)
+      << "Can't write TensorFlow examples without TensorFlow support enabled. "
+         "Please recompile, passing --define=tf=1 to bazel build.";
+}
+
+void ShardedExampleWriter::Flush() {}
+
 }  // namespace tf_utils
 }  // namespace minigo
@@ -18,7 +18,9 @@
 #include <cstdio>
 #include <cstring>
 #include <deque>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -55,19 +57,30 @@ DEFINE_string(output_bigtable, "",
               "If empty, no examples are written to Bigtable.");
 DEFINE_string(glob_pattern, "", "Input filename glob pattern");
 DEFINE_bool(async, false, "Run in background after incrementing game counter.");
+DEFINE_string(resume_manifest, "",
+              "Path of a manifest file recording which input files have "
+              "already been converted. Files listed in the manifest are "
+              "skipped, and each batch is appended to the manifest once it "
+              "has been written to Bigtable, so an interrupted conversion "
+              "can be resumed by rerunning with the same manifest.");
 
-void wait_for_children(std::set<int>* pids, size_t maximum_children) {
-  while (pids->size() > maximum_children) {
+// Waits until at most maximum_children converted batches are still in flight,
+// invoking on_batch_done with the files of each batch that completes.
+void wait_for_children(
+    std::map<int, std::vector<std::string>>* children, size_t maximum_children,
+    const std::function<void(const std::vector<std::string>&)>& on_batch_done) {
+  while (children->size() > maximum_children) {
     int status;
     int child_pid = wait(&status);
     if (status != 0) {
       MG_LOG(FATAL) << "Child pid " << child_pid << " did not succeed";
     }
-    auto where = pids->find(child_pid);
-    if (where == pids->end()) {
+    auto where = children->find(child_pid);
+    if (where == children->end()) {
       MG_LOG(FATAL) << "Child pid " << child_pid << " not found";
     } else {
-      pids->erase(where);
+      on_batch_done(where->second);
+      children->erase(where);
     }
   }
 }
@@ -100,7 +113,39 @@ int main(int argc, char* argv[]) {
               << paths.size() << " files to process." << std::endl;
   }
 
-  std::set<int> pending_children;
+  // Skip files the manifest records as already converted and append each
+  // batch to the manifest as it completes. The whole manifest is rewritten
+  // each time so that it also works on filesystems without append (GCS).
+  std::string manifest_contents;
+  if (!FLAGS_resume_manifest.empty() &&
+      minigo::file::FileExists(FLAGS_resume_manifest)) {
+    MG_CHECK(
+        minigo::file::ReadFile(FLAGS_resume_manifest, &manifest_contents));
+    std::set<absl::string_view> converted =
+        absl::StrSplit(manifest_contents, '\n', absl::SkipEmpty());
+    std::deque<std::string> remaining;
+    for (auto& path : paths) {
+      if (converted.count(path) == 0) {
+        remaining.push_back(std::move(path));
+      }
+    }
+    std::cout << "Resume manifest covers " << (paths.size() - remaining.size())
+              << " files, " << remaining.size() << " left to process."
+              << std::endl;
+    paths = std::move(remaining);
+  }
+  auto record_batch = [&](const std::vector<std::string>& batch) {
+    if (FLAGS_resume_manifest.empty()) {
+      return;
+    }
+    for (const auto& path : batch) {
+      absl::StrAppend(&manifest_contents, path, "\n");
+    }
+    MG_CHECK(
+        minigo::file::WriteFile(FLAGS_resume_manifest, manifest_contents));
+  };
+
+  std::map<int, std::vector<std::string>> pending_children;
   auto total_games = paths.size();
   auto const& project = bigtable_spec[0];
   auto const& instance = bigtable_spec[1];
@@ -139,11 +184,11 @@ int main(int argc, char* argv[]) {
       return 0;
     }
     game_counter += batch.size();
-    pending_children.insert(pid);
-    wait_for_children(&pending_children, FLAGS_concurrency);
+    pending_children.emplace(pid, std::move(batch));
+    wait_for_children(&pending_children, FLAGS_concurrency, record_batch);
   }
 
-  wait_for_children(&pending_children, 0);
+  wait_for_children(&pending_children, 0, record_batch);
   auto full_stop = absl::Now();
   double elapsed = absl::ToDoubleSeconds(full_stop - full_start);
   if (!FLAGS_async) {
@@ -0,0 +1,82 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_TRACE_SAMPLER_H_
+#define CC_TRACE_SAMPLER_H_
+
+#include <atomic>
+
+#include "wtf/macros.h"
+
+namespace minigo {
+
+// Samples WTF timeline tracing so it can stay enabled continuously in
+// production instead of being all-or-nothing.
+//
+// Each thread that records WTF scopes owns a TraceSampler and calls Tick at
+// the start of every unit of work (a selfplay iteration, an executor
+// batch). One unit in every `period` is traced end-to-end; for the rest the
+// thread's WTF event buffer is detached, so every WTF_SCOPE in the unit
+// reduces to a thread-local null check. WTF scope events themselves are
+// registered once, when their line first executes inside a traced window;
+// after that, sampled windows append events by ID without hashing the scope
+// name again.
+//
+// The sampling period is process-wide and shared by all samplers. The
+// default period of 1 traces everything (the old WTF_THREAD_ENABLE
+// behavior); a period of N traces one unit in N; a period <= 0 disables
+// tracing entirely.
+class TraceSampler {
+ public:
+  // `thread_name` labels this thread in the trace; it must outlive the
+  // sampler (a string literal, in practice).
+  explicit TraceSampler(const char* thread_name)
+      : thread_name_(thread_name) {}
+
+  // Sets the process-wide sampling period. Call once at startup, before the
+  // traced threads are created.
+  static void SetPeriod(int period) {
+    period_.store(period, std::memory_order_relaxed);
+  }
+
+  // Called at the start of each unit of work on the owning thread.
+  // Attaches or detaches the thread's WTF event buffer at window
+  // boundaries; all other calls are a counter increment and a compare.
+  void Tick() {
+#ifdef WTF_ENABLE
+    int period = period_.load(std::memory_order_relaxed);
+    bool trace = period > 0 && count_++ % period == 0;
+    if (trace == enabled_) {
+      return;
+    }
+    if (trace) {
+      wtf::Runtime::GetInstance()->EnableCurrentThread(thread_name_);
+    } else {
+      wtf::Runtime::GetInstance()->DisableCurrentThread();
+    }
+    enabled_ = trace;
+#endif  // WTF_ENABLE
+  }
+
+ private:
+  const char* thread_name_;
+  int count_ = 0;
+  bool enabled_ = false;
+
+  static std::atomic<int> period_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_TRACE_SAMPLER_H_
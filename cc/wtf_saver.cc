@@ -18,27 +18,26 @@
 #include <functional>
 #include <utility>
 
-#include "absl/memory/memory.h"
 #include "absl/time/time.h"
-#include "cc/async/poll_thread.h"
+#include "cc/async/timer_service.h"
 #include "cc/logging.h"
 
 namespace minigo {
 
 WtfSaver::WtfSaver(std::string path, absl::Duration poll_interval)
     : path_(std::move(path)) {
-  poll_thread_ = absl::make_unique<PollThread>(
-      "WtfSaver", poll_interval, std::bind(&WtfSaver::Poll, this));
-  poll_thread_->Start();
-
   options_ = wtf::Runtime::SaveOptions::ForStreamingFile(&checkpoint_);
 
   // Overwrite on the first write.
   options_.open_mode = std::ios_base::trunc | std::ios_base::binary;
+
+  poll_timer_ = TimerService::Get()->AddPeriodic(
+      poll_interval, std::bind(&WtfSaver::Poll, this));
 }
 
 WtfSaver::~WtfSaver() {
-  poll_thread_->Join();
+  // Cancel blocks until any in-flight Poll has returned.
+  TimerService::Get()->Cancel(poll_timer_);
 }
 
 void WtfSaver::Poll() {
@@ -17,7 +17,7 @@
 
 #include <string>
 
-#include "cc/async/thread.h"
+#include "cc/async/timer_service.h"
 #include "wtf/runtime.h"
 
 namespace minigo {
@@ -33,7 +33,7 @@ class WtfSaver {
   const std::string path_;
   wtf::Runtime::SaveOptions options_;
   wtf::Runtime::SaveCheckpoint checkpoint_;
-  std::unique_ptr<Thread> poll_thread_;
+  TimerService::TimerId poll_timer_ = TimerService::kInvalidTimerId;
 };
 
 }  // namespace minigo
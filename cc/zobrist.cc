@@ -14,38 +14,14 @@
 
 #include "cc/zobrist.h"
 
-#include "cc/random.h"
-
 namespace minigo {
 namespace zobrist {
-
 namespace internal {
-Hash kBlackToPlayHash;
-Hash kOpponentPassedHash;
-std::array<std::array<Hash, 3>, kNumMoves> kMoveHashes;
-std::array<Hash, kN * kN> kKoHashes;
-std::array<Hash, kN * kN> kIllegalEmptyPointHashes;
-}  // namespace internal
 
-void Init(uint64_t seed) {
-  minigo::Random rnd(seed, Random::kUniqueStream);
-
-  internal::kBlackToPlayHash = rnd.UniformUint64();
-  internal::kOpponentPassedHash = rnd.UniformUint64();
-  for (auto& x : internal::kMoveHashes) {
-    for (size_t i = 0; i < x.size(); ++i) {
-      // For simplicity, the hashes are indexed by kMoveHashes[coord][color].
-      // Set the empty hash to 0 for each position.
-      x[i] = i == static_cast<int>(Color::kEmpty) ? 0 : rnd.UniformUint64();
-    }
-  }
-  for (auto& x : internal::kKoHashes) {
-    x = rnd.UniformUint64();
-  }
-  for (auto& x : internal::kIllegalEmptyPointHashes) {
-    x = rnd.UniformUint64();
-  }
-}
+// Out-of-line definitions of the constexpr tables, required until C++17.
+constexpr MoveHashTable HashTables::kMoveHashes;
+constexpr PointHashTable HashTables::kIllegalEmptyPointHashes;
 
+}  // namespace internal
 }  // namespace zobrist
 }  // namespace minigo
@@ -15,8 +15,6 @@
 #ifndef CC_ZOBRIST_H_
 #define CC_ZOBRIST_H_
 
-#include <algorithm>
-#include <array>
 #include <cstdint>
 
 #include "cc/color.h"
@@ -29,10 +27,71 @@ namespace zobrist {
 using Hash = uint64_t;
 
 namespace internal {
-extern Hash kBlackToPlayHash;
-extern Hash kOpponentPassedHash;
-extern std::array<std::array<Hash, 3>, kNumMoves> kMoveHashes;
-extern std::array<Hash, kN * kN> kIllegalEmptyPointHashes;
+
+// Seed of the compile-time PRNG that the hash tables are expanded from.
+// Baking the tables into the binary's read-only data means there's no
+// runtime initialization, the pages are shared between co-located processes,
+// and every minigo binary computes identical stone hashes, which anything
+// that persists data keyed by stone hash relies on.
+constexpr uint64_t kSeed = 0x1848f6f2c48d2e4c;
+
+// Returns the i'th output of a splitmix64 sequence seeded with kSeed.
+constexpr Hash HashAt(uint64_t i) {
+  uint64_t z = kSeed + (i + 1) * uint64_t{0x9e3779b97f4a7c15};
+  z = (z ^ (z >> 30)) * uint64_t{0xbf58476d1ce4e5b9};
+  z = (z ^ (z >> 27)) * uint64_t{0x94d049bb133111eb};
+  return z ^ (z >> 31);
+}
+
+// Indices into the splitmix64 sequence for each table, so the tables draw
+// disjoint ranges of outputs.
+constexpr uint64_t kMoveHashBase = 0;
+constexpr uint64_t kIllegalEmptyPointHashBase = kMoveHashBase + 2 * kNumMoves;
+constexpr uint64_t kScalarHashBase = kIllegalEmptyPointHashBase + kN * kN;
+
+// The tables use plain arrays because std::array's operator[] isn't
+// constexpr until C++17.
+struct MoveHashTable {
+  Hash hashes[kNumMoves][3];
+};
+struct PointHashTable {
+  Hash hashes[kN * kN];
+};
+
+constexpr MoveHashTable MakeMoveHashes() {
+  MoveHashTable t{};
+  uint64_t i = kMoveHashBase;
+  for (int c = 0; c < kNumMoves; ++c) {
+    for (int color = 0; color < 3; ++color) {
+      // For simplicity, the hashes are indexed by hashes[coord][color].
+      // Set the empty hash to 0 for each position.
+      t.hashes[c][color] =
+          color == static_cast<int>(Color::kEmpty) ? 0 : HashAt(i++);
+    }
+  }
+  return t;
+}
+
+constexpr PointHashTable MakeIllegalEmptyPointHashes() {
+  PointHashTable t{};
+  for (int c = 0; c < kN * kN; ++c) {
+    t.hashes[c] = HashAt(kIllegalEmptyPointHashBase + c);
+  }
+  return t;
+}
+
+// The tables are static constexpr members so their values are visible for
+// constant folding in every translation unit; zobrist.cc provides the
+// out-of-line definitions that C++14 still requires.
+struct HashTables {
+  static constexpr MoveHashTable kMoveHashes = MakeMoveHashes();
+  static constexpr PointHashTable kIllegalEmptyPointHashes =
+      MakeIllegalEmptyPointHashes();
+};
+
+constexpr Hash kBlackToPlayHash = HashAt(kScalarHashBase);
+constexpr Hash kOpponentPassedHash = HashAt(kScalarHashBase + 1);
+
 }  // namespace internal
 
 // Non-zero when it's black's turn.
@@ -45,17 +104,15 @@ inline Hash OpponentPassedHash() { return internal::kOpponentPassedHash; }
 
 // Hashes for moves by black and white.
 inline Hash MoveHash(Coord c, Color color) {
-  return internal::kMoveHashes[c][static_cast<int>(color)];
+  return internal::HashTables::kMoveHashes.hashes[c][static_cast<int>(color)];
 }
 
 // Hashes used for empty points that can't be played because of things like
 // self-capture, ko or positional superko.
 inline Hash IllegalEmptyPointHash(Coord c) {
-  return internal::kIllegalEmptyPointHashes[c];
+  return internal::HashTables::kIllegalEmptyPointHashes.hashes[c];
 }
 
-void Init(uint64_t seed);
-
 }  // namespace zobrist
 }  // namespace minigo
 
@@ -44,13 +44,17 @@ def write_graph_def(graph_def, metadata, dst_path):
     write_model_bytes(graph_def.SerializeToString(), metadata, dst_path)
 
 
-def write_model_bytes(model_bytes, metadata, dst_path):
+def write_model_bytes(model_bytes, metadata, dst_path,
+                      model_bytes_alignment=1):
     """Writes a serialized model & metadata in Minigo format.
 
     Args:
       model_bytes: the serialized model.
       metadata: a dictionary of metadata to write to file.
       dst_path: destination path to write to.
+      model_bytes_alignment: pad the metadata so the model bytes start on a
+          file offset that's a multiple of this, e.g. so the tensor blobs of
+          a flat weights payload stay aligned when the file is mapped.
     """
 
     for key, value in metadata.items():
@@ -78,6 +82,12 @@ def write_model_bytes(model_bytes, metadata, dst_path):
     #   uint64: metadata size
     version = 1
     header_size = 32
+    if model_bytes_alignment > 1:
+        # Pad with spaces, which JSON parsers skip as trailing whitespace.
+        misalignment = (
+            header_size + len(metadata_bytes)) % model_bytes_alignment
+        if misalignment:
+            metadata_bytes += b' ' * (model_bytes_alignment - misalignment)
     metadata_size = len(metadata_bytes)
     model_size = len(model_bytes)
     file_size = header_size + metadata_size + model_size
@@ -168,24 +168,54 @@ class Position {
       this.childQ = [];
       for (let q of update.childQ) { this.childQ.push(q / 1000); }
     }
+    if (update.childNDelta !== undefined) {
+      if (this.childN == null) {
+        this.childN = new Array<number>(N * N + 1).fill(0);
+      }
+      for (let key in update.childNDelta) {
+        this.childN[parseInt(key)] = update.childNDelta[key];
+      }
+    }
+    if (update.childQDelta !== undefined) {
+      if (this.childQ == null) {
+        this.childQ = new Array<number>(N * N + 1).fill(0);
+      }
+      for (let key in update.childQDelta) {
+        this.childQ[parseInt(key)] = update.childQDelta[key] / 1000;
+      }
+    }
     if (update.treeStats !== undefined) { this.treeStats = update.treeStats; }
     if (update.variations !== undefined) {
       this.variations.clear();
-      let pv: Nullable<Position.Variation> = null;
-      for (let key in update.variations) {
-        let variation = {
-          n: update.variations[key].n,
-          q: update.variations[key].q,
-          moves: util.parseMoves(update.variations[key].moves),
-        };
-        this.variations.set(key, variation);
-        if (pv == null || variation.n > pv.n) {
-          pv = variation;
-        }
+      this.mergeVariations(update.variations);
+    }
+    if (update.variationsDelta !== undefined) {
+      this.mergeVariations(update.variationsDelta);
+    }
+  }
+
+  // Merges updated variations into the variation map and recalculates the
+  // principal variation. Incremental updates only contain the variations
+  // whose visit counts changed since the last update.
+  private mergeVariations(update: Position.VariationUpdates) {
+    for (let key in update) {
+      this.variations.set(key, {
+        n: update[key].n,
+        q: update[key].q,
+        moves: util.parseMoves(update[key].moves),
+      });
+    }
+    let pv: Nullable<Position.Variation> = null;
+    this.variations.forEach((variation, key) => {
+      if (key == "pv") {
+        return;
       }
-      if (pv != null) {
-        this.variations.set("pv", pv);
+      if (pv == null || variation.n > pv.n) {
+        pv = variation;
       }
+    });
+    if (pv != null) {
+      this.variations.set("pv", pv);
     }
   }
 
@@ -243,14 +273,20 @@ namespace Position {
     q?: number;
     childN?: number[];
     childQ?: number[];
+    childNDelta?: {[index: string]: number};
+    childQDelta?: {[index: string]: number};
     treeStats?: TreeStats;
-    variations?: {
-      [index:string]: {
-        n: number;
-        q: number;
-        moves: string[];
-      }
-    };
+    variations?: VariationUpdates;
+    variationsDelta?: VariationUpdates;
+  }
+
+  // Variations received from the engine, keyed by their first move.
+  export interface VariationUpdates {
+    [index: string]: {
+      n: number;
+      q: number;
+      moves: string[];
+    }
   }
 }
 
@@ -31,12 +31,44 @@ TF_RECORD_CONFIG = tf.python_io.TFRecordOptions(
     tf.python_io.TFRecordCompressionType.ZLIB)
 
 
+# The policy is stored sparsely, matching the SparsePi encoding written by
+# the C++ selfplay binaries (see cc/game.h): the SPARSE_PI_MAX_ENTRIES most
+# probable moves are stored as (coordinate, probability) pairs padded to a
+# fixed size, plus the total probability mass of any dropped entries.
+SPARSE_PI_MAX_ENTRIES = 32
+SPARSE_PI_PAD = 0xffff
+
+
 def _one_hot(index):
     onehot = np.zeros([go.N * go.N + 1], dtype=np.float32)
     onehot[index] = 1
     return onehot
 
 
+def make_sparse_pi(pi):
+    """Returns the (coords, probs, remainder) sparse encoding of a dense pi.
+
+    Args:
+        pi: [N * N + 1] nparray of float32
+
+    Returns:
+        A tuple of a [SPARSE_PI_MAX_ENTRIES] uint16 nparray of move
+        coordinates (padded with SPARSE_PI_PAD), a [SPARSE_PI_MAX_ENTRIES]
+        float32 nparray of their probabilities (padded with zero), and the
+        float32 probability mass of the dropped entries.
+    """
+    idx = np.nonzero(pi)[0]
+    if len(idx) > SPARSE_PI_MAX_ENTRIES:
+        order = np.argsort(pi[idx])[::-1][:SPARSE_PI_MAX_ENTRIES]
+        idx = np.sort(idx[order])
+    coords = np.full([SPARSE_PI_MAX_ENTRIES], SPARSE_PI_PAD, dtype=np.uint16)
+    probs = np.zeros([SPARSE_PI_MAX_ENTRIES], dtype=np.float32)
+    coords[:len(idx)] = idx
+    probs[:len(idx)] = pi[idx]
+    remainder = np.float32(pi.sum() - probs.sum())
+    return coords, probs, remainder
+
+
 def make_tf_example(features, pi, value):
     """
     Args:
@@ -44,13 +76,20 @@ def make_tf_example(features, pi, value):
         pi: [N * N + 1] nparray of float32
         value: float
     """
+    coords, probs, remainder = make_sparse_pi(pi)
     return tf.train.Example(features=tf.train.Features(feature={
         'x': tf.train.Feature(
             bytes_list=tf.train.BytesList(
                 value=[features.tostring()])),
-        'pi': tf.train.Feature(
+        'pi_idx': tf.train.Feature(
+            bytes_list=tf.train.BytesList(
+                value=[coords.tostring()])),
+        'pi_val': tf.train.Feature(
             bytes_list=tf.train.BytesList(
-                value=[pi.tostring()])),
+                value=[probs.tostring()])),
+        'pi_remainder': tf.train.Feature(
+            float_list=tf.train.FloatList(
+                value=[remainder])),
         'outcome': tf.train.Feature(
             float_list=tf.train.FloatList(
                 value=[value]))}))
@@ -85,7 +124,9 @@ def batch_parse_tf_example(batch_size, layout, example_batch):
 
     features = {
         'x': tf.FixedLenFeature([], tf.string),
-        'pi': tf.FixedLenFeature([], tf.string),
+        'pi_idx': tf.FixedLenFeature([], tf.string),
+        'pi_val': tf.FixedLenFeature([], tf.string),
+        'pi_remainder': tf.FixedLenFeature([], tf.float32),
         'outcome': tf.FixedLenFeature([], tf.float32),
     }
     parsed = tf.parse_example(example_batch, features)
@@ -98,8 +139,21 @@ def batch_parse_tf_example(batch_size, layout, example_batch):
         shape = [batch_size, planes, go.N, go.N]
     x = tf.reshape(x, shape)
 
-    pi = tf.decode_raw(parsed['pi'], tf.float32)
-    pi = tf.reshape(pi, [batch_size, go.N * go.N + 1])
+    # Scatter the sparse policy back into a dense one. Padding slots hold an
+    # out of range coordinate, so their one_hot rows are all zero and they
+    # contribute nothing.
+    num_moves = go.N * go.N + 1
+    idx = tf.cast(tf.decode_raw(parsed['pi_idx'], tf.uint16), tf.int32)
+    idx = tf.reshape(idx, [batch_size, SPARSE_PI_MAX_ENTRIES])
+    val = tf.decode_raw(parsed['pi_val'], tf.float32)
+    val = tf.reshape(val, [batch_size, SPARSE_PI_MAX_ENTRIES])
+    one_hot = tf.one_hot(idx, num_moves)
+    pi = tf.reduce_sum(one_hot * tf.expand_dims(val, 2), axis=1)
+    # Spread the dropped probability mass uniformly over the unstored moves.
+    stored = tf.reduce_max(one_hot, axis=1)
+    num_unstored = tf.reduce_sum(1.0 - stored, axis=1, keepdims=True)
+    remainder = tf.expand_dims(parsed['pi_remainder'], 1)
+    pi += remainder / num_unstored * (1.0 - stored)
     outcome = parsed['outcome']
     outcome.set_shape([batch_size])
     return x, {'pi_tensor': pi, 'value_tensor': outcome}
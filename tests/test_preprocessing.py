@@ -37,7 +37,15 @@ class TestPreprocessing(test_utils.MinigoUnitTest):
         for _ in range(num_examples):
             feature = (256 * np.random.random([
                 go.N, go.N, planes])).astype(np.uint8)
-            pi = np.random.random([go.N * go.N + 1]).astype(np.float32)
+            # The sparse policy encoding is exact as long as there are at
+            # most SPARSE_PI_MAX_ENTRIES non-zero entries, as is the case
+            # for real search policies.
+            pi = np.zeros([go.N * go.N + 1], dtype=np.float32)
+            visited = np.random.choice(
+                go.N * go.N + 1, preprocessing.SPARSE_PI_MAX_ENTRIES // 2,
+                replace=False)
+            pi[visited] = np.random.random(len(visited)).astype(np.float32)
+            pi /= pi.sum()
             value = np.random.random()
             raw_data.append((feature, pi, value))
         return raw_data